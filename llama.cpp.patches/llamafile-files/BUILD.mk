@@ -46,7 +46,8 @@ o/$(MODE)/llama.cpp/ggml-vector-amd-avx.o \
 o/$(MODE)/llama.cpp/ggml-vector-amd-f16c.o \
 o/$(MODE)/llama.cpp/ggml-vector-amd-fma.o \
 o/$(MODE)/llama.cpp/ggml-vector-arm80.o \
-o/$(MODE)/llama.cpp/ggml-vector-arm82.o: \
+o/$(MODE)/llama.cpp/ggml-vector-arm82.o \
+o/$(MODE)/llama.cpp/ggml-vector-armsve.o: \
 		private CCFLAGS += -O3 -mgcc
 
 o/$(MODE)/llama.cpp/ggml-alloc.o			\
@@ -82,6 +83,7 @@ o/$(MODE)/llama.cpp/ggml-vector-amd-avx512.o: private TARGET_ARCH += -Xx86_64-mt
 o/$(MODE)/llama.cpp/ggml-vector-amd-avx512vl.o: private TARGET_ARCH += -Xx86_64-mtune=cannonlake -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512bw -Xx86_64-mavx512dq -Xx86_64-mavx512vl
 o/$(MODE)/llama.cpp/ggml-vector-amd-avx512bf16.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512bw -Xx86_64-mavx512dq -Xx86_64-mavx512vl -Xx86_64-mavx512bf16
 o/$(MODE)/llama.cpp/ggml-vector-arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+fp16
+o/$(MODE)/llama.cpp/ggml-vector-armsve.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+fp16+sve
 
 $(LLAMA_CPP_OBJS): llama.cpp/BUILD.mk
 
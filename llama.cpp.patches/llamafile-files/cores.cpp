@@ -87,6 +87,37 @@ static int count_math_cpus(int cpu_count) {
     return result;
 }
 
+static int build_math_affinity(int cpu_count, cpu_set_t *out) {
+    int result = 0;
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        if (pin_cpu(cpu)) {
+            return -1;
+        }
+        if (is_running_on_efficiency_core()) {
+            continue; // efficiency cores harm lockstep threading
+        }
+        CPU_SET(cpu, out);
+        ++cpu; // hyperthreading isn't useful for linear algebra
+        ++result;
+    }
+    return result;
+}
+
+static int build_efficiency_affinity(int cpu_count, cpu_set_t *out) {
+    int result = 0;
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        if (pin_cpu(cpu)) {
+            return -1;
+        }
+        if (!is_running_on_efficiency_core()) {
+            continue;
+        }
+        CPU_SET(cpu, out);
+        ++result;
+    }
+    return result;
+}
+
 #endif // __x86_64__ && __linux__
 
 static int cpu_get_num_math_impl() {
@@ -109,6 +140,66 @@ static int cpu_get_num_math_impl() {
     return get_num_physical_cores();
 }
 
+/**
+ * Fills `out` with the CPUs on system that are useful for math, i.e.
+ * performance cores with one hyperthread sibling each. Returns the
+ * number of CPUs in the set, or 0 when the topology can't be probed
+ * and the inherited affinity should be left alone.
+ */
+int cpu_get_math_affinity(cpu_set_t *out) {
+    CPU_ZERO(out);
+#if defined(__x86_64__) && (defined(__linux__) || defined(__COSMOPOLITAN__)) && !defined(__ANDROID__)
+    int cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1) {
+        return 0;
+    }
+    if (!is_hybrid_cpu()) {
+        return 0;
+    }
+    cpu_set_t affinity;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(affinity), &affinity)) {
+        return 0;
+    }
+    int result = build_math_affinity(cpu_count, out);
+    pthread_setaffinity_np(pthread_self(), sizeof(affinity), &affinity);
+    if (result > 0) {
+        return result;
+    }
+    CPU_ZERO(out);
+#endif
+    return 0;
+}
+
+/**
+ * Fills `out` with the efficiency cores, which straggle the lockstep
+ * barriers of math kernels but make fine hosts for background chores
+ * like log draining and database writes. Returns the number of CPUs
+ * in the set, or 0 when the system isn't hybrid or can't be probed.
+ */
+int cpu_get_efficiency_affinity(cpu_set_t *out) {
+    CPU_ZERO(out);
+#if defined(__x86_64__) && (defined(__linux__) || defined(__COSMOPOLITAN__)) && !defined(__ANDROID__)
+    int cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1) {
+        return 0;
+    }
+    if (!is_hybrid_cpu()) {
+        return 0;
+    }
+    cpu_set_t affinity;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(affinity), &affinity)) {
+        return 0;
+    }
+    int result = build_efficiency_affinity(cpu_count, out);
+    pthread_setaffinity_np(pthread_self(), sizeof(affinity), &affinity);
+    if (result > 0) {
+        return result;
+    }
+    CPU_ZERO(out);
+#endif
+    return 0;
+}
+
 /**
  * Returns number of CPUs on system that are useful for math.
  */
@@ -1,9 +1,12 @@
 #pragma once
+#include <sched.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int cpu_get_num_math(void);
+int cpu_get_math_affinity(cpu_set_t *out);
+int cpu_get_efficiency_affinity(cpu_set_t *out);
 
 #ifdef __cplusplus
 }
@@ -877,6 +877,7 @@ static const struct QuantFuncs {
     typeof(iq3xs_init_impl) *ptr_iq3xs_init_impl;
     typeof(iq3xs_free_impl) *ptr_iq3xs_free_impl;
     typeof(ggml_validate_row_data) *ptr_ggml_validate_row_data;
+    bool have_avx2_ = false;
 
     QuantFuncs() {
 #ifdef __x86_64__
@@ -1182,6 +1183,7 @@ static const struct QuantFuncs {
             ptr_iq3xs_init_impl = iq3xs_init_impl_amd_avx2;
             ptr_iq3xs_free_impl = iq3xs_free_impl_amd_avx2;
             ptr_ggml_validate_row_data = ggml_validate_row_data_amd_avx2;
+            have_avx2_ = true;
             return;
         }
 #endif
@@ -1597,390 +1599,822 @@ static const struct QuantFuncs {
 } funcs;
 
 void quantize_row_q4_0_ref(const float * GGML_RESTRICT x, block_q4_0 * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q4_0_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q4_0_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q4_1_ref(const float * GGML_RESTRICT x, block_q4_1 * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q4_1_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q4_1_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q5_0_ref(const float * GGML_RESTRICT x, block_q5_0 * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q5_0_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q5_0_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q5_1_ref(const float * GGML_RESTRICT x, block_q5_1 * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q5_1_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q5_1_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q8_0_ref(const float * GGML_RESTRICT x, block_q8_0 * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q8_0_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q8_0_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q8_1_ref(const float * GGML_RESTRICT x, block_q8_1 * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q8_1_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q8_1_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q2_K_ref(const float * GGML_RESTRICT x, block_q2_K * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q2_K_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q2_K_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q3_K_ref(const float * GGML_RESTRICT x, block_q3_K * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q3_K_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q3_K_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q4_K_ref(const float * GGML_RESTRICT x, block_q4_K * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q4_K_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q4_K_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q5_K_ref(const float * GGML_RESTRICT x, block_q5_K * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q5_K_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q5_K_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q6_K_ref(const float * GGML_RESTRICT x, block_q6_K * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q6_K_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q6_K_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q8_K_ref(const float * GGML_RESTRICT x, block_q8_K * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q8_K_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q8_K_ref(x, y, k);
+#endif
 }
 
 void quantize_row_iq3_xxs_ref(const float * GGML_RESTRICT x, block_iq3_xxs * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq3_xxs_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq3_xxs_ref(x, y, k);
+#endif
 }
 
 void quantize_row_iq4_nl_ref (const float * GGML_RESTRICT x, block_iq4_nl  * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq4_nl_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq4_nl_ref(x, y, k);
+#endif
 }
 
 void quantize_row_iq4_xs_ref (const float * GGML_RESTRICT x, block_iq4_xs  * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq4_xs_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq4_xs_ref(x, y, k);
+#endif
 }
 
 void quantize_row_iq3_s_ref  (const float * GGML_RESTRICT x, block_iq3_s   * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq3_s_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq3_s_ref(x, y, k);
+#endif
 }
 
 void quantize_row_iq2_s_ref  (const float * GGML_RESTRICT x, block_iq2_s   * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq2_s_ref_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq2_s_ref(x, y, k);
+#endif
 }
 
 void quantize_row_q4_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q4_0_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q4_0(x, y, k);
+#endif
 }
 
 void quantize_row_q4_1(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q4_1_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q4_1(x, y, k);
+#endif
 }
 
 void quantize_row_q5_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q5_0_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q5_0(x, y, k);
+#endif
 }
 
 void quantize_row_q5_1(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q5_1_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q5_1(x, y, k);
+#endif
 }
 
 void quantize_row_q8_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q8_0_arm80(x, y, k);
+#else
+  if (funcs.have_avx2_)
+    return quantize_row_q8_0_amd_avx2(x, y, k);
   return funcs.ptr_quantize_row_q8_0(x, y, k);
+#endif
 }
 
 void quantize_row_q8_1(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q8_1_arm80(x, y, k);
+#else
+  if (funcs.have_avx2_)
+    return quantize_row_q8_1_amd_avx2(x, y, k);
   return funcs.ptr_quantize_row_q8_1(x, y, k);
+#endif
 }
 
 void quantize_row_q2_K(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q2_K_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q2_K(x, y, k);
+#endif
 }
 
 void quantize_row_q3_K(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q3_K_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q3_K(x, y, k);
+#endif
 }
 
 void quantize_row_q4_K(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q4_K_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q4_K(x, y, k);
+#endif
 }
 
 void quantize_row_q5_K(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q5_K_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q5_K(x, y, k);
+#endif
 }
 
 void quantize_row_q6_K(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q6_K_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_q6_K(x, y, k);
+#endif
 }
 
 void quantize_row_q8_K(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_q8_K_arm80(x, y, k);
+#else
+  if (funcs.have_avx2_)
+    return quantize_row_q8_K_amd_avx2(x, y, k);
   return funcs.ptr_quantize_row_q8_K(x, y, k);
+#endif
 }
 
 void quantize_row_iq3_xxs(const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq3_xxs_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq3_xxs(x, y, k);
+#endif
 }
 
 void quantize_row_iq4_nl (const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq4_nl_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq4_nl(x, y, k);
+#endif
 }
 
 void quantize_row_iq4_xs (const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq4_xs_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq4_xs(x, y, k);
+#endif
 }
 
 void quantize_row_iq3_s  (const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq3_s_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq3_s(x, y, k);
+#endif
 }
 
 void quantize_row_iq2_s  (const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return quantize_row_iq2_s_arm80(x, y, k);
+#else
   return funcs.ptr_quantize_row_iq2_s(x, y, k);
+#endif
 }
 
 void dequantize_row_q4_0(const block_q4_0 * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q4_0_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q4_0(x, y, k);
+#endif
 }
 
 void dequantize_row_q4_1(const block_q4_1 * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q4_1_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q4_1(x, y, k);
+#endif
 }
 
 void dequantize_row_q5_0(const block_q5_0 * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q5_0_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q5_0(x, y, k);
+#endif
 }
 
 void dequantize_row_q5_1(const block_q5_1 * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q5_1_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q5_1(x, y, k);
+#endif
 }
 
 void dequantize_row_q8_0(const block_q8_0 * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q8_0_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q8_0(x, y, k);
+#endif
 }
 
 void dequantize_row_q2_K(const block_q2_K * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q2_K_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q2_K(x, y, k);
+#endif
 }
 
 void dequantize_row_q3_K(const block_q3_K * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q3_K_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q3_K(x, y, k);
+#endif
 }
 
 void dequantize_row_q4_K(const block_q4_K * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q4_K_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q4_K(x, y, k);
+#endif
 }
 
 void dequantize_row_q5_K(const block_q5_K * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q5_K_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q5_K(x, y, k);
+#endif
 }
 
 void dequantize_row_q6_K(const block_q6_K * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q6_K_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q6_K(x, y, k);
+#endif
 }
 
 void dequantize_row_q8_K(const block_q8_K * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_q8_K_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_q8_K(x, y, k);
+#endif
 }
 
 void dequantize_row_iq2_xxs(const block_iq2_xxs * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq2_xxs_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq2_xxs(x, y, k);
+#endif
 }
 
 void dequantize_row_iq2_xs (const block_iq2_xs  * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq2_xs_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq2_xs(x, y, k);
+#endif
 }
 
 void dequantize_row_iq2_s  (const block_iq2_s   * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq2_s_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq2_s(x, y, k);
+#endif
 }
 
 void dequantize_row_iq3_xxs(const block_iq3_xxs * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq3_xxs_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq3_xxs(x, y, k);
+#endif
 }
 
 void dequantize_row_iq1_s  (const block_iq1_s   * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq1_s_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq1_s(x, y, k);
+#endif
 }
 
 void dequantize_row_iq1_m  (const block_iq1_m   * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq1_m_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq1_m(x, y, k);
+#endif
 }
 
 void dequantize_row_iq4_nl (const block_iq4_nl  * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq4_nl_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq4_nl(x, y, k);
+#endif
 }
 
 void dequantize_row_iq4_xs (const block_iq4_xs  * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq4_xs_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq4_xs(x, y, k);
+#endif
 }
 
 void dequantize_row_iq3_s  (const block_iq3_s   * GGML_RESTRICT x, float * GGML_RESTRICT y, int64_t k) {
+#ifdef __aarch64__
+  return dequantize_row_iq3_s_arm80(x, y, k);
+#else
   return funcs.ptr_dequantize_row_iq3_s(x, y, k);
+#endif
 }
 
 void ggml_vec_dot_q4_0_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q4_0_q8_0_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q4_0_q8_0_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q4_0_q8_0(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q4_1_q8_1(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q4_1_q8_1_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q4_1_q8_1_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q4_1_q8_1(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q5_0_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q5_0_q8_0_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q5_0_q8_0_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q5_0_q8_0(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q5_1_q8_1(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q5_1_q8_1_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q5_1_q8_1_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q5_1_q8_1(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q8_0_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q8_0_q8_0_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q8_0_q8_0_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q8_0_q8_0(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q2_K_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q2_K_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q2_K_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q2_K_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q3_K_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q3_K_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q3_K_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q3_K_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q4_K_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q4_K_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q4_K_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q4_K_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q5_K_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q5_K_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q5_K_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q5_K_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_q6_K_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_q6_K_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_q6_K_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_q6_K_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq2_xxs_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq2_xxs_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq2_xxs_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq2_xxs_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq2_xs_q8_K (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq2_xs_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq2_xs_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq2_xs_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq2_s_q8_K  (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq2_s_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq2_s_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq2_s_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq3_xxs_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq3_xxs_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq3_xxs_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq3_xxs_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq1_s_q8_K  (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq1_s_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq1_s_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq1_s_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq1_m_q8_K  (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq1_m_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq1_m_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq1_m_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq4_nl_q8_0 (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq4_nl_q8_0_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq4_nl_q8_0_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq4_nl_q8_0(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq4_xs_q8_K (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq4_xs_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq4_xs_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq4_xs_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 void ggml_vec_dot_iq3_s_q8_K  (int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
+#ifdef __aarch64__
+  return ggml_vec_dot_iq3_s_q8_K_arm80(n, s, bs, vx, bx, vy, by, nrc);
+#else
+  if (funcs.have_avx2_)
+    return ggml_vec_dot_iq3_s_q8_K_amd_avx2(n, s, bs, vx, bx, vy, by, nrc);
   return funcs.ptr_ggml_vec_dot_iq3_s_q8_K(n, s, bs, vx, bx, vy, by, nrc);
+#endif
 }
 
 size_t quantize_iq2_xxs(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq2_xxs_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq2_xxs(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_iq2_xs (const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq2_xs_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq2_xs(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_iq2_s  (const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq2_s_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq2_s(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_iq3_xxs(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq3_xxs_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq3_xxs(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_iq1_s  (const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq1_s_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq1_s(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_iq1_m  (const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq1_m_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq1_m(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_iq4_nl (const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq4_nl_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq4_nl(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_iq4_xs (const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq4_xs_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq4_xs(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_iq3_s  (const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_iq3_s_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_iq3_s(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q2_K(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q2_K_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q2_K(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q3_K(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q3_K_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q3_K(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q4_K(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q4_K_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q4_K(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q5_K(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q5_K_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q5_K(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q6_K(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q6_K_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q6_K(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q4_0(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q4_0_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q4_0(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q4_1(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q4_1_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q4_1(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q5_0(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q5_0_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q5_0(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q5_1(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q5_1_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q5_1(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 size_t quantize_q8_0(const float * GGML_RESTRICT src, void * GGML_RESTRICT dst, int64_t nrows, int64_t n_per_row, const float * imatrix) {
+#ifdef __aarch64__
+  return quantize_q8_0_arm80(src, dst, nrows, n_per_row, imatrix);
+#else
   return funcs.ptr_quantize_q8_0(src, dst, nrows, n_per_row, imatrix);
+#endif
 }
 
 void iq2xs_init_impl(enum ggml_type type) {
+#ifdef __aarch64__
+  return iq2xs_init_impl_arm80(type);
+#else
   return funcs.ptr_iq2xs_init_impl(type);
+#endif
 }
 
 void iq2xs_free_impl(enum ggml_type type) {
+#ifdef __aarch64__
+  return iq2xs_free_impl_arm80(type);
+#else
   return funcs.ptr_iq2xs_free_impl(type);
+#endif
 }
 
 void iq3xs_init_impl(int grid_size) {
+#ifdef __aarch64__
+  return iq3xs_init_impl_arm80(grid_size);
+#else
   return funcs.ptr_iq3xs_init_impl(grid_size);
+#endif
 }
 
 void iq3xs_free_impl(int grid_size) {
+#ifdef __aarch64__
+  return iq3xs_free_impl_arm80(grid_size);
+#else
   return funcs.ptr_iq3xs_free_impl(grid_size);
+#endif
 }
 
 bool ggml_validate_row_data(enum ggml_type type, const void * data, size_t nbytes) {
+#ifdef __aarch64__
+  return ggml_validate_row_data_arm80(type, data, nbytes);
+#else
   return funcs.ptr_ggml_validate_row_data(type, data, nbytes);
+#endif
 }
 
@@ -21,6 +21,16 @@ ARCHS = (
   ('arm80', '__aarch64__', ()),
 )
 
+# decode spends most of its quant time in the row dot products and in
+# requantizing activations to q8, one indirect call per row. wrappers
+# for these get a guarded direct call to the avx2 tier, so on the most
+# common microarchitectures the branch predicts and the callee inlines
+# into the speculation window instead of bouncing through a pointer.
+# on aarch64 there's only one tier, so every wrapper is a direct call.
+def is_hot(func):
+  return (func.startswith('ggml_vec_dot_') or
+          (func.startswith('quantize_row_q8_') and not func.endswith('_ref')))
+
 for arch, mac, needs in ARCHS:
   path = 'llama.cpp/ggml-quants-%s.c' % (arch.replace('_', '-'))
   with open(path, 'w') as f:
@@ -43,6 +53,7 @@ with open('llama.cpp/ggml-quants.cpp', 'w') as f:
   f.write('static const struct QuantFuncs {\n')
   for func, proto in FUNCS:
     f.write('    typeof(%s) *ptr_%s;\n' % (func, func))
+  f.write('    bool have_avx2_ = false;\n')
   f.write('\n')
   f.write('    QuantFuncs() {\n')
   for arch, mac, needs in ARCHS:
@@ -50,6 +61,8 @@ with open('llama.cpp/ggml-quants.cpp', 'w') as f:
     f.write('        if (%s) {\n' % (' && '.join('X86_HAVE(%s)' % (need) for need in needs) or '1'))
     for func, proto in FUNCS:
       f.write('            ptr_%s = %s_%s;\n' % (func, func, arch))
+    if arch == 'amd_avx2':
+      f.write('            have_avx2_ = true;\n')
     f.write('            return;\n')
     f.write('        }\n')
     f.write('#endif\n')
@@ -60,6 +73,13 @@ with open('llama.cpp/ggml-quants.cpp', 'w') as f:
     proto = proto.replace(';', '')
     args = [s.split(' ')[-1] for s in re.search(r'(?<=\().*(?=\))', proto).group(0).split(',')]
     f.write(proto + ' {\n')
+    f.write('#ifdef __aarch64__\n')
+    f.write('  return %s_arm80(%s);\n' % (func, ", ".join(args)))
+    f.write('#else\n')
+    if is_hot(func):
+      f.write('  if (funcs.have_avx2_)\n')
+      f.write('    return %s_amd_avx2(%s);\n' % (func, ", ".join(args)))
     f.write('  return funcs.ptr_%s(%s);\n' % (func, ", ".join(args)))
+    f.write('#endif\n')
     f.write('}\n')
     f.write('\n')
@@ -28,6 +28,7 @@
 #define ggml_vec_scale_f16 ggml_vec_scale_f16_amd_avx512bf16
 #define ggml_vec_mad_f32 ggml_vec_mad_f32_amd_avx512bf16
 #define ggml_vec_mad_f16 ggml_vec_mad_f16_amd_avx512bf16
+#define ggml_vec_acc_sqr_f32 ggml_vec_acc_sqr_f32_amd_avx512bf16
 #define ggml_vec_norm_f32 ggml_vec_norm_f32_amd_avx512bf16
 #define ggml_vec_sqr_f32 ggml_vec_sqr_f32_amd_avx512bf16
 #define ggml_vec_sqrt_f32 ggml_vec_sqrt_f32_amd_avx512bf16
@@ -52,9 +53,13 @@
 #define ggml_vec_sum_bf16_ggf ggml_vec_sum_bf16_ggf_amd_avx512bf16
 #define ggml_vec_max_f32 ggml_vec_max_f32_amd_avx512bf16
 #define ggml_vec_argmax_f32 ggml_vec_argmax_f32_amd_avx512bf16
+#define ggml_vec_allfinite_f32 ggml_vec_allfinite_f32_amd_avx512bf16
 #define ggml_vec_soft_max_f32 ggml_vec_soft_max_f32_amd_avx512bf16
 #define ggml_vec_norm_inv_f32 ggml_vec_norm_inv_f32_amd_avx512bf16
 #define ggml_vec_sigmoid_f32 ggml_vec_sigmoid_f32_amd_avx512bf16
+#define ggml_vec_rms_norm_f32 ggml_vec_rms_norm_f32_amd_avx512bf16
+#define ggml_vec_rope_f32 ggml_vec_rope_f32_amd_avx512bf16
+#define ggml_vec_rope_neox_f32 ggml_vec_rope_neox_f32_amd_avx512bf16
 #define GGML_VECTOR
 #include "ggml-vector.inc"
 #endif // __x86_64__
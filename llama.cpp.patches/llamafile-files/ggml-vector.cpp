@@ -12,6 +12,7 @@ extern "C" void ggml_fp16_to_fp32_row_amd_fma(const ggml_fp16_t * x, float * y,
 extern "C" void ggml_fp16_to_fp32_row_amd_avx(const ggml_fp16_t * x, float * y, int64_t n);
 extern "C" void ggml_fp16_to_fp32_row_amd_ssse3(const ggml_fp16_t * x, float * y, int64_t n);
 extern "C" void ggml_fp16_to_fp32_row_amd_k8(const ggml_fp16_t * x, float * y, int64_t n);
+extern "C" void ggml_fp16_to_fp32_row_armsve(const ggml_fp16_t * x, float * y, int64_t n);
 extern "C" void ggml_fp16_to_fp32_row_arm82(const ggml_fp16_t * x, float * y, int64_t n);
 extern "C" void ggml_fp16_to_fp32_row_arm80(const ggml_fp16_t * x, float * y, int64_t n);
 
@@ -24,6 +25,7 @@ extern "C" void ggml_fp32_to_fp16_row_amd_fma(const float * x, ggml_fp16_t * y,
 extern "C" void ggml_fp32_to_fp16_row_amd_avx(const float * x, ggml_fp16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_fp16_row_amd_ssse3(const float * x, ggml_fp16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_fp16_row_amd_k8(const float * x, ggml_fp16_t * y, int64_t n);
+extern "C" void ggml_fp32_to_fp16_row_armsve(const float * x, ggml_fp16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_fp16_row_arm82(const float * x, ggml_fp16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_fp16_row_arm80(const float * x, ggml_fp16_t * y, int64_t n);
 
@@ -36,6 +38,7 @@ extern "C" void ggml_bf16_to_fp32_row_amd_fma(const ggml_bf16_t * x, float * y,
 extern "C" void ggml_bf16_to_fp32_row_amd_avx(const ggml_bf16_t * x, float * y, int64_t n);
 extern "C" void ggml_bf16_to_fp32_row_amd_ssse3(const ggml_bf16_t * x, float * y, int64_t n);
 extern "C" void ggml_bf16_to_fp32_row_amd_k8(const ggml_bf16_t * x, float * y, int64_t n);
+extern "C" void ggml_bf16_to_fp32_row_armsve(const ggml_bf16_t * x, float * y, int64_t n);
 extern "C" void ggml_bf16_to_fp32_row_arm82(const ggml_bf16_t * x, float * y, int64_t n);
 extern "C" void ggml_bf16_to_fp32_row_arm80(const ggml_bf16_t * x, float * y, int64_t n);
 
@@ -48,6 +51,7 @@ extern "C" void ggml_fp32_to_bf16_row_amd_fma(const float * x, ggml_bf16_t * y,
 extern "C" void ggml_fp32_to_bf16_row_amd_avx(const float * x, ggml_bf16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_bf16_row_amd_ssse3(const float * x, ggml_bf16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_bf16_row_amd_k8(const float * x, ggml_bf16_t * y, int64_t n);
+extern "C" void ggml_fp32_to_bf16_row_armsve(const float * x, ggml_bf16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_bf16_row_arm82(const float * x, ggml_bf16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_bf16_row_arm80(const float * x, ggml_bf16_t * y, int64_t n);
 
@@ -60,6 +64,7 @@ extern "C" void ggml_fp32_to_bf16_row_ref_amd_fma(const float * x, ggml_bf16_t *
 extern "C" void ggml_fp32_to_bf16_row_ref_amd_avx(const float * x, ggml_bf16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_bf16_row_ref_amd_ssse3(const float * x, ggml_bf16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_bf16_row_ref_amd_k8(const float * x, ggml_bf16_t * y, int64_t n);
+extern "C" void ggml_fp32_to_bf16_row_ref_armsve(const float * x, ggml_bf16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_bf16_row_ref_arm82(const float * x, ggml_bf16_t * y, int64_t n);
 extern "C" void ggml_fp32_to_bf16_row_ref_arm80(const float * x, ggml_bf16_t * y, int64_t n);
 
@@ -72,6 +77,7 @@ extern "C" void ggml_vec_dot_f32_amd_fma(int n, float * s, size_t bs, const floa
 extern "C" void ggml_vec_dot_f32_amd_avx(int n, float * s, size_t bs, const float * x, size_t bx, const float * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_f32_amd_ssse3(int n, float * s, size_t bs, const float * x, size_t bx, const float * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_f32_amd_k8(int n, float * s, size_t bs, const float * x, size_t bx, const float * y, size_t by, int nrc);
+extern "C" void ggml_vec_dot_f32_armsve(int n, float * s, size_t bs, const float * x, size_t bx, const float * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_f32_arm82(int n, float * s, size_t bs, const float * x, size_t bx, const float * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_f32_arm80(int n, float * s, size_t bs, const float * x, size_t bx, const float * y, size_t by, int nrc);
 
@@ -84,6 +90,7 @@ extern "C" void ggml_vec_dot_f16_amd_fma(int n, float * s, size_t bs, ggml_fp16_
 extern "C" void ggml_vec_dot_f16_amd_avx(int n, float * s, size_t bs, ggml_fp16_t * x, size_t bx, ggml_fp16_t * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_f16_amd_ssse3(int n, float * s, size_t bs, ggml_fp16_t * x, size_t bx, ggml_fp16_t * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_f16_amd_k8(int n, float * s, size_t bs, ggml_fp16_t * x, size_t bx, ggml_fp16_t * y, size_t by, int nrc);
+extern "C" void ggml_vec_dot_f16_armsve(int n, float * s, size_t bs, ggml_fp16_t * x, size_t bx, ggml_fp16_t * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_f16_arm82(int n, float * s, size_t bs, ggml_fp16_t * x, size_t bx, ggml_fp16_t * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_f16_arm80(int n, float * s, size_t bs, ggml_fp16_t * x, size_t bx, ggml_fp16_t * y, size_t by, int nrc);
 
@@ -96,6 +103,7 @@ extern "C" void ggml_vec_dot_bf16_amd_fma(int n, float * s, size_t bs, ggml_bf16
 extern "C" void ggml_vec_dot_bf16_amd_avx(int n, float * s, size_t bs, ggml_bf16_t * x, size_t bx, ggml_bf16_t * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_bf16_amd_ssse3(int n, float * s, size_t bs, ggml_bf16_t * x, size_t bx, ggml_bf16_t * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_bf16_amd_k8(int n, float * s, size_t bs, ggml_bf16_t * x, size_t bx, ggml_bf16_t * y, size_t by, int nrc);
+extern "C" void ggml_vec_dot_bf16_armsve(int n, float * s, size_t bs, ggml_bf16_t * x, size_t bx, ggml_bf16_t * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_bf16_arm82(int n, float * s, size_t bs, ggml_bf16_t * x, size_t bx, ggml_bf16_t * y, size_t by, int nrc);
 extern "C" void ggml_vec_dot_bf16_arm80(int n, float * s, size_t bs, ggml_bf16_t * x, size_t bx, ggml_bf16_t * y, size_t by, int nrc);
 
@@ -108,6 +116,7 @@ extern "C" void ggml_vec_dot_f16_unroll_amd_fma(const int n, const int xs, float
 extern "C" void ggml_vec_dot_f16_unroll_amd_avx(const int n, const int xs, float * s, void * xv, ggml_fp16_t * y);
 extern "C" void ggml_vec_dot_f16_unroll_amd_ssse3(const int n, const int xs, float * s, void * xv, ggml_fp16_t * y);
 extern "C" void ggml_vec_dot_f16_unroll_amd_k8(const int n, const int xs, float * s, void * xv, ggml_fp16_t * y);
+extern "C" void ggml_vec_dot_f16_unroll_armsve(const int n, const int xs, float * s, void * xv, ggml_fp16_t * y);
 extern "C" void ggml_vec_dot_f16_unroll_arm82(const int n, const int xs, float * s, void * xv, ggml_fp16_t * y);
 extern "C" void ggml_vec_dot_f16_unroll_arm80(const int n, const int xs, float * s, void * xv, ggml_fp16_t * y);
 
@@ -120,6 +129,7 @@ extern "C" void ggml_vec_mad_f32_unroll_amd_fma(const int n, const int xs, const
 extern "C" void ggml_vec_mad_f32_unroll_amd_avx(const int n, const int xs, const int vs, float * y, const float * xv, const float * vv);
 extern "C" void ggml_vec_mad_f32_unroll_amd_ssse3(const int n, const int xs, const int vs, float * y, const float * xv, const float * vv);
 extern "C" void ggml_vec_mad_f32_unroll_amd_k8(const int n, const int xs, const int vs, float * y, const float * xv, const float * vv);
+extern "C" void ggml_vec_mad_f32_unroll_armsve(const int n, const int xs, const int vs, float * y, const float * xv, const float * vv);
 extern "C" void ggml_vec_mad_f32_unroll_arm82(const int n, const int xs, const int vs, float * y, const float * xv, const float * vv);
 extern "C" void ggml_vec_mad_f32_unroll_arm80(const int n, const int xs, const int vs, float * y, const float * xv, const float * vv);
 
@@ -132,6 +142,7 @@ extern "C" void ggml_vec_set_i8_amd_fma(const int n, int8_t * x, const int8_t v)
 extern "C" void ggml_vec_set_i8_amd_avx(const int n, int8_t * x, const int8_t v);
 extern "C" void ggml_vec_set_i8_amd_ssse3(const int n, int8_t * x, const int8_t v);
 extern "C" void ggml_vec_set_i8_amd_k8(const int n, int8_t * x, const int8_t v);
+extern "C" void ggml_vec_set_i8_armsve(const int n, int8_t * x, const int8_t v);
 extern "C" void ggml_vec_set_i8_arm82(const int n, int8_t * x, const int8_t v);
 extern "C" void ggml_vec_set_i8_arm80(const int n, int8_t * x, const int8_t v);
 
@@ -144,6 +155,7 @@ extern "C" void ggml_vec_set_i16_amd_fma(const int n, int16_t * x, const int16_t
 extern "C" void ggml_vec_set_i16_amd_avx(const int n, int16_t * x, const int16_t v);
 extern "C" void ggml_vec_set_i16_amd_ssse3(const int n, int16_t * x, const int16_t v);
 extern "C" void ggml_vec_set_i16_amd_k8(const int n, int16_t * x, const int16_t v);
+extern "C" void ggml_vec_set_i16_armsve(const int n, int16_t * x, const int16_t v);
 extern "C" void ggml_vec_set_i16_arm82(const int n, int16_t * x, const int16_t v);
 extern "C" void ggml_vec_set_i16_arm80(const int n, int16_t * x, const int16_t v);
 
@@ -156,6 +168,7 @@ extern "C" void ggml_vec_set_i32_amd_fma(const int n, int32_t * x, const int32_t
 extern "C" void ggml_vec_set_i32_amd_avx(const int n, int32_t * x, const int32_t v);
 extern "C" void ggml_vec_set_i32_amd_ssse3(const int n, int32_t * x, const int32_t v);
 extern "C" void ggml_vec_set_i32_amd_k8(const int n, int32_t * x, const int32_t v);
+extern "C" void ggml_vec_set_i32_armsve(const int n, int32_t * x, const int32_t v);
 extern "C" void ggml_vec_set_i32_arm82(const int n, int32_t * x, const int32_t v);
 extern "C" void ggml_vec_set_i32_arm80(const int n, int32_t * x, const int32_t v);
 
@@ -168,6 +181,7 @@ extern "C" void ggml_vec_set_f16_amd_fma(const int n, ggml_fp16_t * x, const int
 extern "C" void ggml_vec_set_f16_amd_avx(const int n, ggml_fp16_t * x, const int32_t v);
 extern "C" void ggml_vec_set_f16_amd_ssse3(const int n, ggml_fp16_t * x, const int32_t v);
 extern "C" void ggml_vec_set_f16_amd_k8(const int n, ggml_fp16_t * x, const int32_t v);
+extern "C" void ggml_vec_set_f16_armsve(const int n, ggml_fp16_t * x, const int32_t v);
 extern "C" void ggml_vec_set_f16_arm82(const int n, ggml_fp16_t * x, const int32_t v);
 extern "C" void ggml_vec_set_f16_arm80(const int n, ggml_fp16_t * x, const int32_t v);
 
@@ -180,6 +194,7 @@ extern "C" void ggml_vec_set_bf16_amd_fma(const int n, ggml_bf16_t * x, const gg
 extern "C" void ggml_vec_set_bf16_amd_avx(const int n, ggml_bf16_t * x, const ggml_bf16_t v);
 extern "C" void ggml_vec_set_bf16_amd_ssse3(const int n, ggml_bf16_t * x, const ggml_bf16_t v);
 extern "C" void ggml_vec_set_bf16_amd_k8(const int n, ggml_bf16_t * x, const ggml_bf16_t v);
+extern "C" void ggml_vec_set_bf16_armsve(const int n, ggml_bf16_t * x, const ggml_bf16_t v);
 extern "C" void ggml_vec_set_bf16_arm82(const int n, ggml_bf16_t * x, const ggml_bf16_t v);
 extern "C" void ggml_vec_set_bf16_arm80(const int n, ggml_bf16_t * x, const ggml_bf16_t v);
 
@@ -192,6 +207,7 @@ extern "C" void ggml_vec_add_f32_amd_fma (const int n, float * z, const float *
 extern "C" void ggml_vec_add_f32_amd_avx (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_add_f32_amd_ssse3 (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_add_f32_amd_k8 (const int n, float * z, const float * x, const float * y);
+extern "C" void ggml_vec_add_f32_armsve (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_add_f32_arm82 (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_add_f32_arm80 (const int n, float * z, const float * x, const float * y);
 
@@ -204,6 +220,7 @@ extern "C" void ggml_vec_add1_f32_amd_fma(const int n, float * z, const float *
 extern "C" void ggml_vec_add1_f32_amd_avx(const int n, float * z, const float * x, const float   v);
 extern "C" void ggml_vec_add1_f32_amd_ssse3(const int n, float * z, const float * x, const float   v);
 extern "C" void ggml_vec_add1_f32_amd_k8(const int n, float * z, const float * x, const float   v);
+extern "C" void ggml_vec_add1_f32_armsve(const int n, float * z, const float * x, const float   v);
 extern "C" void ggml_vec_add1_f32_arm82(const int n, float * z, const float * x, const float   v);
 extern "C" void ggml_vec_add1_f32_arm80(const int n, float * z, const float * x, const float   v);
 
@@ -216,6 +233,7 @@ extern "C" void ggml_vec_acc_f32_amd_fma (const int n, float * y, const float *
 extern "C" void ggml_vec_acc_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_acc_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_acc_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_acc_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_acc_f32_arm80 (const int n, float * y, const float * x);
 
@@ -228,6 +246,7 @@ extern "C" void ggml_vec_acc1_f32_amd_fma(const int n, float * y, const float
 extern "C" void ggml_vec_acc1_f32_amd_avx(const int n, float * y, const float   v);
 extern "C" void ggml_vec_acc1_f32_amd_ssse3(const int n, float * y, const float   v);
 extern "C" void ggml_vec_acc1_f32_amd_k8(const int n, float * y, const float   v);
+extern "C" void ggml_vec_acc1_f32_armsve(const int n, float * y, const float   v);
 extern "C" void ggml_vec_acc1_f32_arm82(const int n, float * y, const float   v);
 extern "C" void ggml_vec_acc1_f32_arm80(const int n, float * y, const float   v);
 
@@ -240,6 +259,7 @@ extern "C" void ggml_vec_sub_f32_amd_fma (const int n, float * z, const float *
 extern "C" void ggml_vec_sub_f32_amd_avx (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_sub_f32_amd_ssse3 (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_sub_f32_amd_k8 (const int n, float * z, const float * x, const float * y);
+extern "C" void ggml_vec_sub_f32_armsve (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_sub_f32_arm82 (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_sub_f32_arm80 (const int n, float * z, const float * x, const float * y);
 
@@ -252,6 +272,7 @@ extern "C" void ggml_vec_set_f32_amd_fma (const int n, float * x, const float
 extern "C" void ggml_vec_set_f32_amd_avx (const int n, float * x, const float   v);
 extern "C" void ggml_vec_set_f32_amd_ssse3 (const int n, float * x, const float   v);
 extern "C" void ggml_vec_set_f32_amd_k8 (const int n, float * x, const float   v);
+extern "C" void ggml_vec_set_f32_armsve (const int n, float * x, const float   v);
 extern "C" void ggml_vec_set_f32_arm82 (const int n, float * x, const float   v);
 extern "C" void ggml_vec_set_f32_arm80 (const int n, float * x, const float   v);
 
@@ -264,6 +285,7 @@ extern "C" void ggml_vec_cpy_f32_amd_fma (const int n, float * y, const float *
 extern "C" void ggml_vec_cpy_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_cpy_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_cpy_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_cpy_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_cpy_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_cpy_f32_arm80 (const int n, float * y, const float * x);
 
@@ -276,6 +298,7 @@ extern "C" void ggml_vec_neg_f32_amd_fma (const int n, float * y, const float *
 extern "C" void ggml_vec_neg_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_neg_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_neg_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_neg_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_neg_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_neg_f32_arm80 (const int n, float * y, const float * x);
 
@@ -288,6 +311,7 @@ extern "C" void ggml_vec_mul_f32_amd_fma (const int n, float * z, const float *
 extern "C" void ggml_vec_mul_f32_amd_avx (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_mul_f32_amd_ssse3 (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_mul_f32_amd_k8 (const int n, float * z, const float * x, const float * y);
+extern "C" void ggml_vec_mul_f32_armsve (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_mul_f32_arm82 (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_mul_f32_arm80 (const int n, float * z, const float * x, const float * y);
 
@@ -300,6 +324,7 @@ extern "C" void ggml_vec_div_f32_amd_fma (const int n, float * z, const float *
 extern "C" void ggml_vec_div_f32_amd_avx (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_div_f32_amd_ssse3 (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_div_f32_amd_k8 (const int n, float * z, const float * x, const float * y);
+extern "C" void ggml_vec_div_f32_armsve (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_div_f32_arm82 (const int n, float * z, const float * x, const float * y);
 extern "C" void ggml_vec_div_f32_arm80 (const int n, float * z, const float * x, const float * y);
 
@@ -312,6 +337,7 @@ extern "C" void ggml_vec_scale_f32_amd_fma(const int n, float * y, const float
 extern "C" void ggml_vec_scale_f32_amd_avx(const int n, float * y, const float   v);
 extern "C" void ggml_vec_scale_f32_amd_ssse3(const int n, float * y, const float   v);
 extern "C" void ggml_vec_scale_f32_amd_k8(const int n, float * y, const float   v);
+extern "C" void ggml_vec_scale_f32_armsve(const int n, float * y, const float   v);
 extern "C" void ggml_vec_scale_f32_arm82(const int n, float * y, const float   v);
 extern "C" void ggml_vec_scale_f32_arm80(const int n, float * y, const float   v);
 
@@ -324,6 +350,7 @@ extern "C" void ggml_vec_scale_f16_amd_fma(const int n, ggml_fp16_t * y, const f
 extern "C" void ggml_vec_scale_f16_amd_avx(const int n, ggml_fp16_t * y, const float v);
 extern "C" void ggml_vec_scale_f16_amd_ssse3(const int n, ggml_fp16_t * y, const float v);
 extern "C" void ggml_vec_scale_f16_amd_k8(const int n, ggml_fp16_t * y, const float v);
+extern "C" void ggml_vec_scale_f16_armsve(const int n, ggml_fp16_t * y, const float v);
 extern "C" void ggml_vec_scale_f16_arm82(const int n, ggml_fp16_t * y, const float v);
 extern "C" void ggml_vec_scale_f16_arm80(const int n, ggml_fp16_t * y, const float v);
 
@@ -336,6 +363,7 @@ extern "C" void ggml_vec_mad_f32_amd_fma(const int n, float * y, const float * x
 extern "C" void ggml_vec_mad_f32_amd_avx(const int n, float * y, const float * x, const float v);
 extern "C" void ggml_vec_mad_f32_amd_ssse3(const int n, float * y, const float * x, const float v);
 extern "C" void ggml_vec_mad_f32_amd_k8(const int n, float * y, const float * x, const float v);
+extern "C" void ggml_vec_mad_f32_armsve(const int n, float * y, const float * x, const float v);
 extern "C" void ggml_vec_mad_f32_arm82(const int n, float * y, const float * x, const float v);
 extern "C" void ggml_vec_mad_f32_arm80(const int n, float * y, const float * x, const float v);
 
@@ -348,9 +376,23 @@ extern "C" void ggml_vec_mad_f16_amd_fma(const int n, ggml_fp16_t * y, const ggm
 extern "C" void ggml_vec_mad_f16_amd_avx(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
 extern "C" void ggml_vec_mad_f16_amd_ssse3(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
 extern "C" void ggml_vec_mad_f16_amd_k8(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
+extern "C" void ggml_vec_mad_f16_armsve(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
 extern "C" void ggml_vec_mad_f16_arm82(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
 extern "C" void ggml_vec_mad_f16_arm80(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
 
+extern "C" void ggml_vec_acc_sqr_f32_amd_avx512bf16(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_amd_avx512vl(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_amd_avx512(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_amd_avx2(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_amd_f16c(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_amd_fma(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_amd_avx(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_amd_ssse3(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_amd_k8(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_armsve(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_arm82(const int n, float * y, const float * x);
+extern "C" void ggml_vec_acc_sqr_f32_arm80(const int n, float * y, const float * x);
+
 extern "C" void ggml_vec_norm_f32_amd_avx512bf16 (const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_f32_amd_avx512vl (const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_f32_amd_avx512 (const int n, float * s, const float * x);
@@ -360,6 +402,7 @@ extern "C" void ggml_vec_norm_f32_amd_fma (const int n, float * s, const float *
 extern "C" void ggml_vec_norm_f32_amd_avx (const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_f32_amd_ssse3 (const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_f32_amd_k8 (const int n, float * s, const float * x);
+extern "C" void ggml_vec_norm_f32_armsve (const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_f32_arm82 (const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_f32_arm80 (const int n, float * s, const float * x);
 
@@ -372,6 +415,7 @@ extern "C" void ggml_vec_sqr_f32_amd_fma  (const int n, float * y, const float *
 extern "C" void ggml_vec_sqr_f32_amd_avx  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sqr_f32_amd_ssse3  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sqr_f32_amd_k8  (const int n, float * y, const float * x);
+extern "C" void ggml_vec_sqr_f32_armsve  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sqr_f32_arm82  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sqr_f32_arm80  (const int n, float * y, const float * x);
 
@@ -384,6 +428,7 @@ extern "C" void ggml_vec_sqrt_f32_amd_fma (const int n, float * y, const float *
 extern "C" void ggml_vec_sqrt_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sqrt_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sqrt_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_sqrt_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sqrt_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sqrt_f32_arm80 (const int n, float * y, const float * x);
 
@@ -396,6 +441,7 @@ extern "C" void ggml_vec_log_f32_amd_fma  (const int n, float * y, const float *
 extern "C" void ggml_vec_log_f32_amd_avx  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_log_f32_amd_ssse3  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_log_f32_amd_k8  (const int n, float * y, const float * x);
+extern "C" void ggml_vec_log_f32_armsve  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_log_f32_arm82  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_log_f32_arm80  (const int n, float * y, const float * x);
 
@@ -408,6 +454,7 @@ extern "C" void ggml_vec_abs_f32_amd_fma  (const int n, float * y, const float *
 extern "C" void ggml_vec_abs_f32_amd_avx  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_abs_f32_amd_ssse3  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_abs_f32_amd_k8  (const int n, float * y, const float * x);
+extern "C" void ggml_vec_abs_f32_armsve  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_abs_f32_arm82  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_abs_f32_arm80  (const int n, float * y, const float * x);
 
@@ -420,6 +467,7 @@ extern "C" void ggml_vec_sgn_f32_amd_fma  (const int n, float * y, const float *
 extern "C" void ggml_vec_sgn_f32_amd_avx  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sgn_f32_amd_ssse3  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sgn_f32_amd_k8  (const int n, float * y, const float * x);
+extern "C" void ggml_vec_sgn_f32_armsve  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sgn_f32_arm82  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sgn_f32_arm80  (const int n, float * y, const float * x);
 
@@ -432,6 +480,7 @@ extern "C" void ggml_vec_step_f32_amd_fma (const int n, float * y, const float *
 extern "C" void ggml_vec_step_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_step_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_step_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_step_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_step_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_step_f32_arm80 (const int n, float * y, const float * x);
 
@@ -444,6 +493,7 @@ extern "C" void ggml_vec_tanh_f32_amd_fma (const int n, float * y, const float *
 extern "C" void ggml_vec_tanh_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_tanh_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_tanh_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_tanh_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_tanh_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_tanh_f32_arm80 (const int n, float * y, const float * x);
 
@@ -456,6 +506,7 @@ extern "C" void ggml_vec_elu_f32_amd_fma  (const int n, float * y, const float *
 extern "C" void ggml_vec_elu_f32_amd_avx  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_elu_f32_amd_ssse3  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_elu_f32_amd_k8  (const int n, float * y, const float * x);
+extern "C" void ggml_vec_elu_f32_armsve  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_elu_f32_arm82  (const int n, float * y, const float * x);
 extern "C" void ggml_vec_elu_f32_arm80  (const int n, float * y, const float * x);
 
@@ -468,6 +519,7 @@ extern "C" void ggml_vec_relu_f32_amd_fma (const int n, float * y, const float *
 extern "C" void ggml_vec_relu_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_relu_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_relu_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_relu_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_relu_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_relu_f32_arm80 (const int n, float * y, const float * x);
 
@@ -480,6 +532,7 @@ extern "C" void ggml_vec_leaky_relu_f32_amd_fma (const int n, float * y, const f
 extern "C" void ggml_vec_leaky_relu_f32_amd_avx (const int n, float * y, const float * x, const float ns);
 extern "C" void ggml_vec_leaky_relu_f32_amd_ssse3 (const int n, float * y, const float * x, const float ns);
 extern "C" void ggml_vec_leaky_relu_f32_amd_k8 (const int n, float * y, const float * x, const float ns);
+extern "C" void ggml_vec_leaky_relu_f32_armsve (const int n, float * y, const float * x, const float ns);
 extern "C" void ggml_vec_leaky_relu_f32_arm82 (const int n, float * y, const float * x, const float ns);
 extern "C" void ggml_vec_leaky_relu_f32_arm80 (const int n, float * y, const float * x, const float ns);
 
@@ -492,6 +545,7 @@ extern "C" void ggml_vec_hardswish_f32_amd_fma (const int n, float * y, const fl
 extern "C" void ggml_vec_hardswish_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_hardswish_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_hardswish_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_hardswish_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_hardswish_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_hardswish_f32_arm80 (const int n, float * y, const float * x);
 
@@ -504,6 +558,7 @@ extern "C" void ggml_vec_hardsigmoid_f32_amd_fma (const int n, float * y, const
 extern "C" void ggml_vec_hardsigmoid_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_hardsigmoid_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_hardsigmoid_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_hardsigmoid_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_hardsigmoid_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_hardsigmoid_f32_arm80 (const int n, float * y, const float * x);
 
@@ -516,6 +571,7 @@ extern "C" void ggml_vec_gelu_f32_amd_fma(const int n, float * y, const float *
 extern "C" void ggml_vec_gelu_f32_amd_avx(const int n, float * y, const float * x);
 extern "C" void ggml_vec_gelu_f32_amd_ssse3(const int n, float * y, const float * x);
 extern "C" void ggml_vec_gelu_f32_amd_k8(const int n, float * y, const float * x);
+extern "C" void ggml_vec_gelu_f32_armsve(const int n, float * y, const float * x);
 extern "C" void ggml_vec_gelu_f32_arm82(const int n, float * y, const float * x);
 extern "C" void ggml_vec_gelu_f32_arm80(const int n, float * y, const float * x);
 
@@ -528,6 +584,7 @@ extern "C" void ggml_vec_gelu_quick_f32_amd_fma(const int n, float * y, const fl
 extern "C" void ggml_vec_gelu_quick_f32_amd_avx(const int n, float * y, const float * x);
 extern "C" void ggml_vec_gelu_quick_f32_amd_ssse3(const int n, float * y, const float * x);
 extern "C" void ggml_vec_gelu_quick_f32_amd_k8(const int n, float * y, const float * x);
+extern "C" void ggml_vec_gelu_quick_f32_armsve(const int n, float * y, const float * x);
 extern "C" void ggml_vec_gelu_quick_f32_arm82(const int n, float * y, const float * x);
 extern "C" void ggml_vec_gelu_quick_f32_arm80(const int n, float * y, const float * x);
 
@@ -540,6 +597,7 @@ extern "C" void ggml_vec_silu_f32_amd_fma(const int n, float * y, const float *
 extern "C" void ggml_vec_silu_f32_amd_avx(const int n, float * y, const float * x);
 extern "C" void ggml_vec_silu_f32_amd_ssse3(const int n, float * y, const float * x);
 extern "C" void ggml_vec_silu_f32_amd_k8(const int n, float * y, const float * x);
+extern "C" void ggml_vec_silu_f32_armsve(const int n, float * y, const float * x);
 extern "C" void ggml_vec_silu_f32_arm82(const int n, float * y, const float * x);
 extern "C" void ggml_vec_silu_f32_arm80(const int n, float * y, const float * x);
 
@@ -552,6 +610,7 @@ extern "C" float ggml_silu_backward_f32_amd_fma(float x, float dy);
 extern "C" float ggml_silu_backward_f32_amd_avx(float x, float dy);
 extern "C" float ggml_silu_backward_f32_amd_ssse3(float x, float dy);
 extern "C" float ggml_silu_backward_f32_amd_k8(float x, float dy);
+extern "C" float ggml_silu_backward_f32_armsve(float x, float dy);
 extern "C" float ggml_silu_backward_f32_arm82(float x, float dy);
 extern "C" float ggml_silu_backward_f32_arm80(float x, float dy);
 
@@ -564,6 +623,7 @@ extern "C" void ggml_vec_silu_backward_f32_amd_fma(const int n, float * dx, cons
 extern "C" void ggml_vec_silu_backward_f32_amd_avx(const int n, float * dx, const float * x, const float * dy);
 extern "C" void ggml_vec_silu_backward_f32_amd_ssse3(const int n, float * dx, const float * x, const float * dy);
 extern "C" void ggml_vec_silu_backward_f32_amd_k8(const int n, float * dx, const float * x, const float * dy);
+extern "C" void ggml_vec_silu_backward_f32_armsve(const int n, float * dx, const float * x, const float * dy);
 extern "C" void ggml_vec_silu_backward_f32_arm82(const int n, float * dx, const float * x, const float * dy);
 extern "C" void ggml_vec_silu_backward_f32_arm80(const int n, float * dx, const float * x, const float * dy);
 
@@ -576,6 +636,7 @@ extern "C" void ggml_vec_sum_f32_amd_fma(const int n, float * s, const float * x
 extern "C" void ggml_vec_sum_f32_amd_avx(const int n, float * s, const float * x);
 extern "C" void ggml_vec_sum_f32_amd_ssse3(const int n, float * s, const float * x);
 extern "C" void ggml_vec_sum_f32_amd_k8(const int n, float * s, const float * x);
+extern "C" void ggml_vec_sum_f32_armsve(const int n, float * s, const float * x);
 extern "C" void ggml_vec_sum_f32_arm82(const int n, float * s, const float * x);
 extern "C" void ggml_vec_sum_f32_arm80(const int n, float * s, const float * x);
 
@@ -588,6 +649,7 @@ extern "C" void ggml_vec_sum_f32_ggf_amd_fma(const int n, ggml_float * s, const
 extern "C" void ggml_vec_sum_f32_ggf_amd_avx(const int n, ggml_float * s, const float * x);
 extern "C" void ggml_vec_sum_f32_ggf_amd_ssse3(const int n, ggml_float * s, const float * x);
 extern "C" void ggml_vec_sum_f32_ggf_amd_k8(const int n, ggml_float * s, const float * x);
+extern "C" void ggml_vec_sum_f32_ggf_armsve(const int n, ggml_float * s, const float * x);
 extern "C" void ggml_vec_sum_f32_ggf_arm82(const int n, ggml_float * s, const float * x);
 extern "C" void ggml_vec_sum_f32_ggf_arm80(const int n, ggml_float * s, const float * x);
 
@@ -600,6 +662,7 @@ extern "C" void ggml_vec_sum_f16_ggf_amd_fma(const int n, float * s, const ggml_
 extern "C" void ggml_vec_sum_f16_ggf_amd_avx(const int n, float * s, const ggml_fp16_t * x);
 extern "C" void ggml_vec_sum_f16_ggf_amd_ssse3(const int n, float * s, const ggml_fp16_t * x);
 extern "C" void ggml_vec_sum_f16_ggf_amd_k8(const int n, float * s, const ggml_fp16_t * x);
+extern "C" void ggml_vec_sum_f16_ggf_armsve(const int n, float * s, const ggml_fp16_t * x);
 extern "C" void ggml_vec_sum_f16_ggf_arm82(const int n, float * s, const ggml_fp16_t * x);
 extern "C" void ggml_vec_sum_f16_ggf_arm80(const int n, float * s, const ggml_fp16_t * x);
 
@@ -612,6 +675,7 @@ extern "C" void ggml_vec_sum_bf16_ggf_amd_fma(const int n, float * s, const ggml
 extern "C" void ggml_vec_sum_bf16_ggf_amd_avx(const int n, float * s, const ggml_bf16_t * x);
 extern "C" void ggml_vec_sum_bf16_ggf_amd_ssse3(const int n, float * s, const ggml_bf16_t * x);
 extern "C" void ggml_vec_sum_bf16_ggf_amd_k8(const int n, float * s, const ggml_bf16_t * x);
+extern "C" void ggml_vec_sum_bf16_ggf_armsve(const int n, float * s, const ggml_bf16_t * x);
 extern "C" void ggml_vec_sum_bf16_ggf_arm82(const int n, float * s, const ggml_bf16_t * x);
 extern "C" void ggml_vec_sum_bf16_ggf_arm80(const int n, float * s, const ggml_bf16_t * x);
 
@@ -624,6 +688,7 @@ extern "C" void ggml_vec_max_f32_amd_fma(const int n, float * s, const float * x
 extern "C" void ggml_vec_max_f32_amd_avx(const int n, float * s, const float * x);
 extern "C" void ggml_vec_max_f32_amd_ssse3(const int n, float * s, const float * x);
 extern "C" void ggml_vec_max_f32_amd_k8(const int n, float * s, const float * x);
+extern "C" void ggml_vec_max_f32_armsve(const int n, float * s, const float * x);
 extern "C" void ggml_vec_max_f32_arm82(const int n, float * s, const float * x);
 extern "C" void ggml_vec_max_f32_arm80(const int n, float * s, const float * x);
 
@@ -636,9 +701,23 @@ extern "C" void ggml_vec_argmax_f32_amd_fma(const int n, int * s, const float *
 extern "C" void ggml_vec_argmax_f32_amd_avx(const int n, int * s, const float * x);
 extern "C" void ggml_vec_argmax_f32_amd_ssse3(const int n, int * s, const float * x);
 extern "C" void ggml_vec_argmax_f32_amd_k8(const int n, int * s, const float * x);
+extern "C" void ggml_vec_argmax_f32_armsve(const int n, int * s, const float * x);
 extern "C" void ggml_vec_argmax_f32_arm82(const int n, int * s, const float * x);
 extern "C" void ggml_vec_argmax_f32_arm80(const int n, int * s, const float * x);
 
+extern "C" int ggml_vec_allfinite_f32_amd_avx512bf16(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_amd_avx512vl(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_amd_avx512(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_amd_avx2(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_amd_f16c(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_amd_fma(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_amd_avx(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_amd_ssse3(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_amd_k8(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_armsve(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_arm82(const int n, const float * x);
+extern "C" int ggml_vec_allfinite_f32_arm80(const int n, const float * x);
+
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_avx512bf16(const int n, float * y, const float * x, float max);
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_avx512vl(const int n, float * y, const float * x, float max);
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_avx512(const int n, float * y, const float * x, float max);
@@ -648,6 +727,7 @@ extern "C" ggml_float ggml_vec_soft_max_f32_amd_fma(const int n, float * y, cons
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_avx(const int n, float * y, const float * x, float max);
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_ssse3(const int n, float * y, const float * x, float max);
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_k8(const int n, float * y, const float * x, float max);
+extern "C" ggml_float ggml_vec_soft_max_f32_armsve(const int n, float * y, const float * x, float max);
 extern "C" ggml_float ggml_vec_soft_max_f32_arm82(const int n, float * y, const float * x, float max);
 extern "C" ggml_float ggml_vec_soft_max_f32_arm80(const int n, float * y, const float * x, float max);
 
@@ -660,6 +740,7 @@ extern "C" void ggml_vec_norm_inv_f32_amd_fma(const int n, float * s, const floa
 extern "C" void ggml_vec_norm_inv_f32_amd_avx(const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_inv_f32_amd_ssse3(const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_inv_f32_amd_k8(const int n, float * s, const float * x);
+extern "C" void ggml_vec_norm_inv_f32_armsve(const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_inv_f32_arm82(const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_inv_f32_arm80(const int n, float * s, const float * x);
 
@@ -672,9 +753,49 @@ extern "C" void ggml_vec_sigmoid_f32_amd_fma (const int n, float * y, const floa
 extern "C" void ggml_vec_sigmoid_f32_amd_avx (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sigmoid_f32_amd_ssse3 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sigmoid_f32_amd_k8 (const int n, float * y, const float * x);
+extern "C" void ggml_vec_sigmoid_f32_armsve (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sigmoid_f32_arm82 (const int n, float * y, const float * x);
 extern "C" void ggml_vec_sigmoid_f32_arm80 (const int n, float * y, const float * x);
 
+extern "C" void ggml_vec_rms_norm_f32_amd_avx512bf16(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_amd_avx512vl(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_amd_avx512(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_amd_avx2(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_amd_f16c(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_amd_fma(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_amd_avx(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_amd_ssse3(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_amd_k8(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_armsve(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_arm82(const int n, float * y, const float * x, float eps);
+extern "C" void ggml_vec_rms_norm_f32_arm80(const int n, float * y, const float * x, float eps);
+
+extern "C" void ggml_vec_rope_f32_amd_avx512bf16(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_amd_avx512vl(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_amd_avx512(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_amd_avx2(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_amd_f16c(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_amd_fma(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_amd_avx(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_amd_ssse3(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_amd_k8(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_armsve(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_arm82(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_f32_arm80(const int n_dims, float * y, const float * x, const float * cache);
+
+extern "C" void ggml_vec_rope_neox_f32_amd_avx512bf16(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_amd_avx512vl(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_amd_avx512(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_amd_avx2(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_amd_f16c(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_amd_fma(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_amd_avx(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_amd_ssse3(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_amd_k8(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_armsve(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_arm82(const int n_dims, float * y, const float * x, const float * cache);
+extern "C" void ggml_vec_rope_neox_f32_arm80(const int n_dims, float * y, const float * x, const float * cache);
+
 static const struct VectorFuncs {
     typeof(ggml_fp16_to_fp32_row) *ptr_ggml_fp16_to_fp32_row;
     typeof(ggml_fp32_to_fp16_row) *ptr_ggml_fp32_to_fp16_row;
@@ -705,6 +826,7 @@ static const struct VectorFuncs {
     typeof(ggml_vec_scale_f16) *ptr_ggml_vec_scale_f16;
     typeof(ggml_vec_mad_f32) *ptr_ggml_vec_mad_f32;
     typeof(ggml_vec_mad_f16) *ptr_ggml_vec_mad_f16;
+    typeof(ggml_vec_acc_sqr_f32) *ptr_ggml_vec_acc_sqr_f32;
     typeof(ggml_vec_norm_f32) *ptr_ggml_vec_norm_f32;
     typeof(ggml_vec_sqr_f32) *ptr_ggml_vec_sqr_f32;
     typeof(ggml_vec_sqrt_f32) *ptr_ggml_vec_sqrt_f32;
@@ -729,9 +851,13 @@ static const struct VectorFuncs {
     typeof(ggml_vec_sum_bf16_ggf) *ptr_ggml_vec_sum_bf16_ggf;
     typeof(ggml_vec_max_f32) *ptr_ggml_vec_max_f32;
     typeof(ggml_vec_argmax_f32) *ptr_ggml_vec_argmax_f32;
+    typeof(ggml_vec_allfinite_f32) *ptr_ggml_vec_allfinite_f32;
     typeof(ggml_vec_soft_max_f32) *ptr_ggml_vec_soft_max_f32;
     typeof(ggml_vec_norm_inv_f32) *ptr_ggml_vec_norm_inv_f32;
     typeof(ggml_vec_sigmoid_f32) *ptr_ggml_vec_sigmoid_f32;
+    typeof(ggml_vec_rms_norm_f32) *ptr_ggml_vec_rms_norm_f32;
+    typeof(ggml_vec_rope_f32) *ptr_ggml_vec_rope_f32;
+    typeof(ggml_vec_rope_neox_f32) *ptr_ggml_vec_rope_neox_f32;
 
     VectorFuncs() {
 #ifdef __x86_64__
@@ -765,6 +891,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx512bf16;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx512bf16;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx512bf16;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_avx512bf16;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx512bf16;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx512bf16;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx512bf16;
@@ -789,9 +916,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx512bf16;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx512bf16;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx512bf16;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_avx512bf16;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx512bf16;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx512bf16;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx512bf16;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_avx512bf16;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_avx512bf16;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_avx512bf16;
             return;
         }
 #endif
@@ -826,6 +957,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx512vl;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx512vl;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx512vl;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_avx512vl;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx512vl;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx512vl;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx512vl;
@@ -850,9 +982,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx512vl;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx512vl;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx512vl;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_avx512vl;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx512vl;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx512vl;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx512vl;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_avx512vl;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_avx512vl;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_avx512vl;
             return;
         }
 #endif
@@ -887,6 +1023,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx512;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx512;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx512;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_avx512;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx512;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx512;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx512;
@@ -911,9 +1048,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx512;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx512;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx512;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_avx512;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx512;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx512;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx512;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_avx512;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_avx512;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_avx512;
             return;
         }
 #endif
@@ -948,6 +1089,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx2;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx2;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx2;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_avx2;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx2;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx2;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx2;
@@ -972,9 +1114,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx2;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx2;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx2;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_avx2;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx2;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx2;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx2;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_avx2;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_avx2;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_avx2;
             return;
         }
 #endif
@@ -1009,6 +1155,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_f16c;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_f16c;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_f16c;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_f16c;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_f16c;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_f16c;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_f16c;
@@ -1033,9 +1180,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_f16c;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_f16c;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_f16c;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_f16c;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_f16c;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_f16c;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_f16c;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_f16c;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_f16c;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_f16c;
             return;
         }
 #endif
@@ -1070,6 +1221,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_fma;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_fma;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_fma;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_fma;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_fma;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_fma;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_fma;
@@ -1094,9 +1246,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_fma;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_fma;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_fma;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_fma;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_fma;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_fma;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_fma;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_fma;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_fma;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_fma;
             return;
         }
 #endif
@@ -1131,6 +1287,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_avx;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx;
@@ -1155,9 +1312,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_avx;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_avx;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_avx;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_avx;
             return;
         }
 #endif
@@ -1192,6 +1353,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_ssse3;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_ssse3;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_ssse3;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_ssse3;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_ssse3;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_ssse3;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_ssse3;
@@ -1216,9 +1378,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_ssse3;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_ssse3;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_ssse3;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_ssse3;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_ssse3;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_ssse3;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_ssse3;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_ssse3;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_ssse3;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_ssse3;
             return;
         }
 #endif
@@ -1253,6 +1419,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_k8;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_k8;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_k8;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_amd_k8;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_k8;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_k8;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_k8;
@@ -1277,9 +1444,79 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_k8;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_k8;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_k8;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_amd_k8;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_k8;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_k8;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_k8;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_amd_k8;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_amd_k8;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_amd_k8;
+            return;
+        }
+#endif
+#ifdef __aarch64__
+        if ((getauxval(AT_HWCAP) & HWCAP_FPHP) && (getauxval(AT_HWCAP) & HWCAP_ASIMDHP) && (getauxval(AT_HWCAP) & HWCAP_SVE)) {
+            ptr_ggml_fp16_to_fp32_row = ggml_fp16_to_fp32_row_armsve;
+            ptr_ggml_fp32_to_fp16_row = ggml_fp32_to_fp16_row_armsve;
+            ptr_ggml_bf16_to_fp32_row = ggml_bf16_to_fp32_row_armsve;
+            ptr_ggml_fp32_to_bf16_row = ggml_fp32_to_bf16_row_armsve;
+            ptr_ggml_fp32_to_bf16_row_ref = ggml_fp32_to_bf16_row_ref_armsve;
+            ptr_ggml_vec_dot_f32 = ggml_vec_dot_f32_armsve;
+            ptr_ggml_vec_dot_f16 = ggml_vec_dot_f16_armsve;
+            ptr_ggml_vec_dot_bf16 = ggml_vec_dot_bf16_armsve;
+            ptr_ggml_vec_dot_f16_unroll = ggml_vec_dot_f16_unroll_armsve;
+            ptr_ggml_vec_mad_f32_unroll = ggml_vec_mad_f32_unroll_armsve;
+            ptr_ggml_vec_set_i8 = ggml_vec_set_i8_armsve;
+            ptr_ggml_vec_set_i16 = ggml_vec_set_i16_armsve;
+            ptr_ggml_vec_set_i32 = ggml_vec_set_i32_armsve;
+            ptr_ggml_vec_set_f16 = ggml_vec_set_f16_armsve;
+            ptr_ggml_vec_set_bf16 = ggml_vec_set_bf16_armsve;
+            ptr_ggml_vec_add_f32 = ggml_vec_add_f32_armsve;
+            ptr_ggml_vec_add1_f32 = ggml_vec_add1_f32_armsve;
+            ptr_ggml_vec_acc_f32 = ggml_vec_acc_f32_armsve;
+            ptr_ggml_vec_acc1_f32 = ggml_vec_acc1_f32_armsve;
+            ptr_ggml_vec_sub_f32 = ggml_vec_sub_f32_armsve;
+            ptr_ggml_vec_set_f32 = ggml_vec_set_f32_armsve;
+            ptr_ggml_vec_cpy_f32 = ggml_vec_cpy_f32_armsve;
+            ptr_ggml_vec_neg_f32 = ggml_vec_neg_f32_armsve;
+            ptr_ggml_vec_mul_f32 = ggml_vec_mul_f32_armsve;
+            ptr_ggml_vec_div_f32 = ggml_vec_div_f32_armsve;
+            ptr_ggml_vec_scale_f32 = ggml_vec_scale_f32_armsve;
+            ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_armsve;
+            ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_armsve;
+            ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_armsve;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_armsve;
+            ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_armsve;
+            ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_armsve;
+            ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_armsve;
+            ptr_ggml_vec_log_f32 = ggml_vec_log_f32_armsve;
+            ptr_ggml_vec_abs_f32 = ggml_vec_abs_f32_armsve;
+            ptr_ggml_vec_sgn_f32 = ggml_vec_sgn_f32_armsve;
+            ptr_ggml_vec_step_f32 = ggml_vec_step_f32_armsve;
+            ptr_ggml_vec_tanh_f32 = ggml_vec_tanh_f32_armsve;
+            ptr_ggml_vec_elu_f32 = ggml_vec_elu_f32_armsve;
+            ptr_ggml_vec_relu_f32 = ggml_vec_relu_f32_armsve;
+            ptr_ggml_vec_leaky_relu_f32 = ggml_vec_leaky_relu_f32_armsve;
+            ptr_ggml_vec_hardswish_f32 = ggml_vec_hardswish_f32_armsve;
+            ptr_ggml_vec_hardsigmoid_f32 = ggml_vec_hardsigmoid_f32_armsve;
+            ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_armsve;
+            ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_armsve;
+            ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_armsve;
+            ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_armsve;
+            ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_armsve;
+            ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_armsve;
+            ptr_ggml_vec_sum_f32_ggf = ggml_vec_sum_f32_ggf_armsve;
+            ptr_ggml_vec_sum_f16_ggf = ggml_vec_sum_f16_ggf_armsve;
+            ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_armsve;
+            ptr_ggml_vec_max_f32 = ggml_vec_max_f32_armsve;
+            ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_armsve;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_armsve;
+            ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_armsve;
+            ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_armsve;
+            ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_armsve;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_armsve;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_armsve;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_armsve;
             return;
         }
 #endif
@@ -1314,6 +1551,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_arm82;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_arm82;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_arm82;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_arm82;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_arm82;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_arm82;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_arm82;
@@ -1338,9 +1576,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_arm82;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_arm82;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_arm82;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_arm82;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_arm82;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_arm82;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_arm82;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_arm82;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_arm82;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_arm82;
             return;
         }
 #endif
@@ -1375,6 +1617,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_arm80;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_arm80;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_arm80;
+            ptr_ggml_vec_acc_sqr_f32 = ggml_vec_acc_sqr_f32_arm80;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_arm80;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_arm80;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_arm80;
@@ -1399,9 +1642,13 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_arm80;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_arm80;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_arm80;
+            ptr_ggml_vec_allfinite_f32 = ggml_vec_allfinite_f32_arm80;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_arm80;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_arm80;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_arm80;
+            ptr_ggml_vec_rms_norm_f32 = ggml_vec_rms_norm_f32_arm80;
+            ptr_ggml_vec_rope_f32 = ggml_vec_rope_f32_arm80;
+            ptr_ggml_vec_rope_neox_f32 = ggml_vec_rope_neox_f32_arm80;
             return;
         }
 #endif
@@ -1524,6 +1771,10 @@ void ggml_vec_mad_f16(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const
   return funcs.ptr_ggml_vec_mad_f16(n, y, x, v);
 }
 
+void ggml_vec_acc_sqr_f32(const int n, float * y, const float * x) {
+  return funcs.ptr_ggml_vec_acc_sqr_f32(n, y, x);
+}
+
 void ggml_vec_norm_f32 (const int n, float * s, const float * x) {
   return funcs.ptr_ggml_vec_norm_f32(n, s, x);
 }
@@ -1620,6 +1871,10 @@ void ggml_vec_argmax_f32(const int n, int * s, const float * x) {
   return funcs.ptr_ggml_vec_argmax_f32(n, s, x);
 }
 
+int ggml_vec_allfinite_f32(const int n, const float * x) {
+  return funcs.ptr_ggml_vec_allfinite_f32(n, x);
+}
+
 ggml_float ggml_vec_soft_max_f32(const int n, float * y, const float * x, float max) {
   return funcs.ptr_ggml_vec_soft_max_f32(n, y, x, max);
 }
@@ -1632,3 +1887,15 @@ void ggml_vec_sigmoid_f32 (const int n, float * y, const float * x) {
   return funcs.ptr_ggml_vec_sigmoid_f32(n, y, x);
 }
 
+void ggml_vec_rms_norm_f32(const int n, float * y, const float * x, float eps) {
+  return funcs.ptr_ggml_vec_rms_norm_f32(n, y, x, eps);
+}
+
+void ggml_vec_rope_f32(const int n_dims, float * y, const float * x, const float * cache) {
+  return funcs.ptr_ggml_vec_rope_f32(n_dims, y, x, cache);
+}
+
+void ggml_vec_rope_neox_f32(const int n_dims, float * y, const float * x, const float * cache) {
+  return funcs.ptr_ggml_vec_rope_neox_f32(n_dims, y, x, cache);
+}
+
@@ -35,6 +35,7 @@ void ggml_vec_scale_f32(const int n, float * y, const float   v);
 void ggml_vec_scale_f16(const int n, ggml_fp16_t * y, const float v);
 void ggml_vec_mad_f32(const int n, float * y, const float * x, const float v);
 void ggml_vec_mad_f16(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
+void ggml_vec_acc_sqr_f32(const int n, float * y, const float * x);
 void ggml_vec_norm_f32 (const int n, float * s, const float * x);
 void ggml_vec_sqr_f32  (const int n, float * y, const float * x);
 void ggml_vec_sqrt_f32 (const int n, float * y, const float * x);
@@ -59,9 +60,13 @@ void ggml_vec_sum_f16_ggf(const int n, float * s, const ggml_fp16_t * x);
 void ggml_vec_sum_bf16_ggf(const int n, float * s, const ggml_bf16_t * x);
 void ggml_vec_max_f32(const int n, float * s, const float * x);
 void ggml_vec_argmax_f32(const int n, int * s, const float * x);
+int ggml_vec_allfinite_f32(const int n, const float * x);
 ggml_float ggml_vec_soft_max_f32(const int n, float * y, const float * x, float max);
 void ggml_vec_norm_inv_f32(const int n, float * s, const float * x);
 void ggml_vec_sigmoid_f32 (const int n, float * y, const float * x);
+void ggml_vec_rms_norm_f32(const int n, float * y, const float * x, float eps);
+void ggml_vec_rope_f32(const int n_dims, float * y, const float * x, const float * cache);
+void ggml_vec_rope_neox_f32(const int n_dims, float * y, const float * x, const float * cache);
 
 #ifdef __cplusplus
 }
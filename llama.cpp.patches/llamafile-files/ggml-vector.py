@@ -21,6 +21,7 @@ ARCHS = (
   ('amd_avx', '__x86_64__', ('X86_HAVE(AVX)',)),
   ('amd_ssse3', '__x86_64__', ('X86_HAVE(SSSE3)',)),
   ('amd_k8', '__x86_64__', ()),
+  ('armsve', '__aarch64__', ('(getauxval(AT_HWCAP) & HWCAP_FPHP)', '(getauxval(AT_HWCAP) & HWCAP_ASIMDHP)', '(getauxval(AT_HWCAP) & HWCAP_SVE)')),
   ('arm82', '__aarch64__', ('(getauxval(AT_HWCAP) & HWCAP_FPHP)', '(getauxval(AT_HWCAP) & HWCAP_ASIMDHP)')),
   ('arm80', '__aarch64__', ()),
 )
@@ -3,8 +3,94 @@
 
 #define LLAMA_API_INTERNAL
 #include "sampling.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <cosmo.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// token mask cache for grammar constrained sampling [jart]
+//
+// structured output generations that share a grammar keep visiting the
+// same grammar states at the same structural positions, e.g. the start
+// of a json object, and the interpretive full vocabulary sweep that
+// llama_grammar_sample() runs on the resampling path is what makes
+// constrained decoding slow. whenever that sweep does run, the pattern
+// of tokens it permits is remembered as a bitmask keyed by a hash of
+// the grammar text and the tokens accepted since its last reset, so
+// the next generation to reach the same state applies the mask with
+// simd instead of interpreting the grammar. a masked sample still goes
+// through the cheap single token grammar check afterwards, so a
+// colliding mask can't let an illegal token through; it just falls
+// back onto the interpretive path.
+
+#define TOKEN_MASK_CACHE_SIZE 256
+
+static std::mutex g_token_mask_lock;
+static std::unordered_map<uint64_t, std::shared_ptr<std::vector<uint64_t>>> g_token_masks;
+
+static uint64_t grammar_state_mix(uint64_t h, uint64_t x) {
+    h ^= x;
+    h *= 0x9e3779b97f4a7c15ull;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t grammar_state_init(const std::string & grammar) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : grammar) {
+        h ^= c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static std::shared_ptr<std::vector<uint64_t>> token_mask_get(uint64_t state) {
+    std::lock_guard<std::mutex> lock(g_token_mask_lock);
+    auto it = g_token_masks.find(state);
+    if (it == g_token_masks.end())
+        return nullptr;
+    return it->second;
+}
+
+static void token_mask_put(uint64_t state, std::shared_ptr<std::vector<uint64_t>> mask) {
+    std::lock_guard<std::mutex> lock(g_token_mask_lock);
+    if (g_token_masks.size() >= TOKEN_MASK_CACHE_SIZE)
+        g_token_masks.clear(); // crude, but masks are cheap to relearn
+    g_token_masks[state] = std::move(mask);
+}
+
+// sets the logits of every token the mask forbids to -infinity
+static void token_mask_apply(float * logits, const uint64_t * mask, int n) {
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256 neginf = _mm256_set1_ps(-INFINITY);
+    const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    for (; i + 8 <= n; i += 8) {
+        int bits = (mask[i >> 6] >> (i & 63)) & 255;
+        __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lanes), lanes);
+        __m256 v = _mm256_loadu_ps(logits + i);
+        _mm256_storeu_ps(logits + i, _mm256_blendv_ps(neginf, v, _mm256_castsi256_ps(keep)));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t neginf = vdupq_n_f32(-INFINITY);
+    const uint32x4_t lanes = (uint32x4_t){1, 2, 4, 8};
+    for (; i + 4 <= n; i += 4) {
+        uint32_t bits = (mask[i >> 6] >> (i & 63)) & 15;
+        uint32x4_t keep = vceqq_u32(vandq_u32(vdupq_n_u32(bits), lanes), lanes);
+        float32x4_t v = vld1q_f32(logits + i);
+        vst1q_f32(logits + i, vbslq_f32(keep, v, neginf));
+    }
+#endif
+    for (; i < n; i++)
+        if (!(mask[i >> 6] >> (i & 63) & 1))
+            logits[i] = -INFINITY;
+}
 
 struct llama_sampling_context * llama_sampling_init(const struct llama_sampling_params & params) {
     struct llama_sampling_context * result = new llama_sampling_context();
@@ -39,6 +125,7 @@ struct llama_sampling_context * llama_sampling_init(const struct llama_sampling_
             throw std::runtime_error("Failed to initialize llama_grammar");
         }
         result->grammar = grammar;
+        result->grammar_state = grammar_state_init(params.grammar); // [jart]
     }
 
     result->prev.resize(params.n_prev);
@@ -74,6 +161,7 @@ void llama_sampling_reset(llama_sampling_context * ctx) {
             throw std::runtime_error("Failed to initialize llama_grammar");
         }
         ctx->grammar = grammar;
+        ctx->grammar_state = grammar_state_init(ctx->params.grammar); // [jart]
     }
 
     std::fill(ctx->prev.begin(), ctx->prev.end(), 0);
@@ -98,6 +186,7 @@ void llama_sampling_cp(llama_sampling_context * src, llama_sampling_context * ds
         dst->grammar = llama_grammar_copy(src->grammar);
     }
 
+    dst->grammar_state = src->grammar_state; // [jart]
     dst->prev = src->prev;
 }
 
@@ -280,6 +369,15 @@ static llama_token llama_sampling_sample_impl(
     const float   mirostat_tau    = params.mirostat_tau;
     const float   mirostat_eta    = params.mirostat_eta;
 
+    // if an earlier generation already interpreted the grammar in this
+    // exact state, replay its token mask over the logits instead [jart]
+    if (ctx_sampling->grammar != NULL && !is_resampling) {
+        if (auto mask = token_mask_get(ctx_sampling->grammar_state)) {
+            token_mask_apply(llama_get_logits_ith(ctx_main, idx), mask->data(),
+                             llama_n_vocab(llama_get_model(ctx_main)));
+        }
+    }
+
     std::vector<float> original_logits;
     auto cur_p = llama_sampling_prepare(ctx_sampling, ctx_main, ctx_cfg, idx, /* apply_grammar= */ is_resampling, &original_logits);
     if (ctx_sampling->grammar != NULL && !is_resampling) {
@@ -395,6 +493,66 @@ static llama_token_data_array llama_sampling_prepare_impl(
         llama_sample_apply_guidance(ctx_main, logits, logits_guidance, params.cfg_scale);
     }
 
+    const auto& penalty_tokens = params.use_penalty_prompt_tokens ? params.penalty_prompt_tokens : prev;
+    const int penalty_tokens_used_size = std::min((int)penalty_tokens.size(), penalty_last_n);
+
+    // fused penalty + top-k pass [jart]
+    //
+    // the stock pipeline materializes candidates for the entire
+    // vocabulary and then lets every sampler re-read and re-sort the
+    // array, which costs milliseconds per token on 128k vocab models.
+    // when the sampler order starts with top_k, which is the default
+    // order, everything downstream only ever sees the k survivors, so
+    // the penalties can be computed on the fly while a bounded heap
+    // picks those survivors in a single pass over the logits, and the
+    // tail filters then chew on k entries instead of n_vocab. greedy
+    // decoding, mirostat, and the grammar resampling sweep all need
+    // the full array, so those keep the classic route. the logits
+    // array itself is never written, matching the classic path, which
+    // penalizes copies so the grammar retry can restore the original
+    const auto & seq = params.samplers_sequence;
+    const int fused_k = std::max(params.top_k, std::max(1, params.min_keep));
+    if (params.temp > 0 && params.mirostat == 0 && !apply_grammar &&
+        !seq.empty() && seq[0] == llama_sampler_type::TOP_K &&
+        params.top_k > 0 && fused_k < n_vocab) {
+        const llama_token nl_token = llama_token_nl(llama_get_model(ctx_main));
+        std::unordered_map<llama_token, int> token_count;
+        for (int i = 0; i < penalty_tokens_used_size; i++)
+            token_count[penalty_tokens[penalty_tokens.size() - penalty_tokens_used_size + i]]++;
+        auto heap_cmp = [](const llama_token_data & a, const llama_token_data & b) {
+            return a.logit > b.logit; // min-heap, weakest survivor on top
+        };
+        cur.clear();
+        cur.reserve(fused_k);
+        for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+            float logit = logits[token_id];
+            if (!token_count.empty() && (penalize_nl || token_id != nl_token)) {
+                auto it = token_count.find(token_id);
+                if (it != token_count.end()) {
+                    // same arithmetic as llama_sample_repetition_penalties
+                    if (logit <= 0) {
+                        logit *= penalty_repeat;
+                    } else {
+                        logit /= penalty_repeat;
+                    }
+                    logit -= it->second * penalty_freq + penalty_present;
+                }
+            }
+            if ((int)cur.size() < fused_k) {
+                cur.push_back(llama_token_data{token_id, logit, 0.0f});
+                std::push_heap(cur.begin(), cur.end(), heap_cmp);
+            } else if (logit > cur.front().logit) {
+                std::pop_heap(cur.begin(), cur.end(), heap_cmp);
+                cur.back() = llama_token_data{token_id, logit, 0.0f};
+                std::push_heap(cur.begin(), cur.end(), heap_cmp);
+            }
+        }
+        std::sort(cur.begin(), cur.end(), [](const llama_token_data & a, const llama_token_data & b) {
+            return a.logit > b.logit;
+        });
+        return { cur.data(), cur.size(), true };
+    }
+
     cur.resize(n_vocab);
 
     for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
@@ -404,8 +562,6 @@ static llama_token_data_array llama_sampling_prepare_impl(
     llama_token_data_array cur_p = { cur.data(), cur.size(), false };
 
     // apply penalties
-    const auto& penalty_tokens = params.use_penalty_prompt_tokens ? params.penalty_prompt_tokens : prev;
-    const int penalty_tokens_used_size = std::min((int)penalty_tokens.size(), penalty_last_n);
     if (penalty_tokens_used_size) {
         const float nl_logit = logits[llama_token_nl(llama_get_model(ctx_main))];
 
@@ -425,7 +581,18 @@ static llama_token_data_array llama_sampling_prepare_impl(
 
     // apply grammar checks before sampling logic
     if (apply_grammar && ctx_sampling->grammar != NULL) {
+        // note which candidates were already impossible beforehand, so
+        // the cached mask only records what the grammar forbids [jart]
+        std::vector<uint64_t> before((n_vocab + 63) / 64);
+        for (int i = 0; i < n_vocab; i++)
+            if (cur_p.data[i].logit != -INFINITY)
+                before[i >> 6] |= 1ull << (i & 63);
         llama_grammar_sample(ctx_sampling->grammar, ctx_main, &cur_p);
+        auto mask = std::make_shared<std::vector<uint64_t>>((n_vocab + 63) / 64, -1ull);
+        for (int i = 0; i < n_vocab; i++)
+            if (cur_p.data[i].logit == -INFINITY && (before[i >> 6] >> (i & 63) & 1))
+                (*mask)[i >> 6] &= ~(1ull << (i & 63));
+        token_mask_put(ctx_sampling->grammar_state, std::move(mask));
     }
 
     return cur_p;
@@ -460,5 +627,6 @@ void llama_sampling_accept(
 
     if (ctx_sampling->grammar != NULL && apply_grammar) {
         llama_grammar_accept_token(ctx_sampling->grammar, ctx_main, id);
+        ctx_sampling->grammar_state = grammar_state_mix(ctx_sampling->grammar_state, id); // [jart]
     }
 }
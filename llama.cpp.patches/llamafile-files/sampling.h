@@ -78,6 +78,10 @@ struct llama_sampling_context {
     // internal
     grammar_parser::parse_state parsed_grammar;
 
+    // hash of the grammar text mixed with every token the grammar has
+    // accepted since the last reset; keys the token mask cache [jart]
+    uint64_t grammar_state = 0;
+
     // TODO: replace with ring-buffer
     std::vector<llama_token>      prev;
     std::vector<llama_token_data> cur;
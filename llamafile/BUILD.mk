@@ -30,11 +30,19 @@ o/$(MODE)/llamafile/zipalign:				\
 		o/$(MODE)/llamafile/zipalign.o		\
 		o/$(MODE)/llamafile/help.o		\
 		o/$(MODE)/llamafile/has.o		\
+		o/$(MODE)/llamafile/sha256.o		\
+		o/$(MODE)/llamafile/crc32.o		\
 		o/$(MODE)/llamafile/zipalign.1.asc.zip.o
 
 o/$(MODE)/llamafile/zipcheck:				\
 		o/$(MODE)/llamafile/zipcheck.o		\
 		o/$(MODE)/llamafile/zip.o		\
+		o/$(MODE)/llamafile/crc32.o		\
+		o/$(MODE)/llamafile/pool.o		\
+
+o/$(MODE)/llamafile/zipdiff:				\
+		o/$(MODE)/llamafile/zipdiff.o		\
+		o/$(MODE)/llamafile/zip.o		\
 
 o/$(MODE)/llamafile/simple:				\
 		o/$(MODE)/llamafile/simple.o		\
@@ -56,14 +64,18 @@ o/$(MODE)/llamafile:						\
 		o/$(MODE)/llamafile/simple			\
 		o/$(MODE)/llamafile/zipalign			\
 		o/$(MODE)/llamafile/zipcheck			\
+		o/$(MODE)/llamafile/zipdiff			\
 		o/$(MODE)/llamafile/tokenize			\
 		o/$(MODE)/llamafile/addnl			\
 		o/$(MODE)/llamafile/high			\
+		o/$(MODE)/llamafile/b64_test.runs		\
 		o/$(MODE)/llamafile/datauri_test.runs		\
 		o/$(MODE)/llamafile/parse_cidr_test.runs	\
 		o/$(MODE)/llamafile/pool_cancel_test.runs	\
+		o/$(MODE)/llamafile/pool_chaos_test.runs	\
 		o/$(MODE)/llamafile/pool_test.runs		\
 		o/$(MODE)/llamafile/json_test.runs		\
+		o/$(MODE)/llamafile/string_test.runs		\
 		o/$(MODE)/llamafile/thread_test.runs		\
 		o/$(MODE)/llamafile/vmathf_test.runs		\
 
@@ -125,14 +137,20 @@ o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx512f.o: private TARGET_ARCH += -Xx
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avx512f.o: private TARGET_ARCH += -Xx86_64-mtune=cannonlake -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bf16
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bf16
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_amx.o: private TARGET_ARCH += -Xx86_64-mtune=sapphirerapids -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bf16 -Xx86_64-mamx-tile -Xx86_64-mamx-int8
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+dotprod+fp16
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+dotprod+fp16
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm86.o: private TARGET_ARCH += -Xaarch64-march=armv8.6-a+dotprod+fp16+bf16
+o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm86.o: private TARGET_ARCH += -Xaarch64-march=armv8.6-a+dotprod+fp16+bf16
 
 o/$(MODE)/llamafile/sgemm.o: private CXXFLAGS += -Os
 
+o/$(MODE)/llamafile/sgemm_dispatch_test.o		\
 o/$(MODE)/llamafile/sgemm_matmul_test.o			\
+o/$(MODE)/llamafile/sgemm_splitk_test.o			\
 o/$(MODE)/llamafile/sgemm_sss_test.o			\
 o/$(MODE)/llamafile/sgemm_vecdot_test.o			\
+o/$(MODE)/llamafile/iqk_lowbit_test.o			\
 o/$(MODE)/llamafile/iqk_mul_mat_amd_avx2.o		\
 o/$(MODE)/llamafile/iqk_mul_mat_amd_zen4.o		\
 o/$(MODE)/llamafile/iqk_mul_mat_arm82.o			\
@@ -144,14 +162,17 @@ o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_fma.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_zen4.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm80.o		\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm82.o		\
+o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm86.o		\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx2.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx512f.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avxvnni.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_fma.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_zen4.o	\
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_amx.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm80.o		\
-o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm82.o:		\
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm82.o		\
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm86.o:		\
 		private CCFLAGS += -O3 -fopenmp -mgcc
 
 ################################################################################
@@ -163,6 +184,10 @@ o/$(MODE)/llamafile/json_test:						\
 		o/$(MODE)/llamafile/hextoint.o				\
 		o/$(MODE)/double-conversion/double-conversion.a		\
 
+o/$(MODE)/llamafile/b64_test:				\
+		o/$(MODE)/llamafile/b64_test.o		\
+		o/$(MODE)/llamafile/b64.o		\
+
 o/$(MODE)/llamafile/vmathf_test:			\
 		o/$(MODE)/llamafile/vmathf_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
@@ -196,6 +221,38 @@ o/$(MODE)/llamafile/pool_cancel_test:			\
 		o/$(MODE)/llamafile/crash.o		\
 		o/$(MODE)/llamafile/pool.o		\
 
+# the chaos test links a pool compiled with its perturbation points
+# armed, so production binaries never pay for being testable
+o/$(MODE)/llamafile/pool.chaos.o: llamafile/pool.cpp $(COSMOCC)
+	@mkdir -p $(@D)
+	$(COMPILE.cc) -DLLAMAFILE_CHAOS -o $@ $<
+
+o/$(MODE)/llamafile/pool_chaos_test:			\
+		o/$(MODE)/llamafile/pool_chaos_test.o	\
+		o/$(MODE)/llamafile/crash.o		\
+		o/$(MODE)/llamafile/chaos.o		\
+		o/$(MODE)/llamafile/pool.chaos.o	\
+
+o/$(MODE)/llamafile/pool_bench:				\
+		o/$(MODE)/llamafile/pool_bench.o	\
+		o/$(MODE)/llamafile/crash.o		\
+		o/$(MODE)/llamafile/pool.o		\
+
+# token throughput regression benchmark
+# fails when a scenario slows down beyond tolerance (see bench.sh)
+.PHONY: o/$(MODE)/llamafile/bench
+o/$(MODE)/llamafile/bench:					\
+		llamafile/bench.sh				\
+		o/$(MODE)/llama.cpp/llama-bench/llama-bench	\
+		models/TinyLLama-v0.1-5M-F16.gguf
+	BENCH_OUT=o/$(MODE)/llamafile/bench.json		\
+	BENCH_BASELINE=o/$(MODE)/llamafile/bench-baseline.json	\
+	llamafile/bench.sh o/$(MODE)/llama.cpp/llama-bench/llama-bench
+
+o/$(MODE)/llamafile/string_test:			\
+		o/$(MODE)/llamafile/string_test.o	\
+		o/$(MODE)/llamafile/string.o		\
+
 o/$(MODE)/llamafile/thread_test:			\
 		o/$(MODE)/llamafile/thread_test.o	\
 		o/$(MODE)/llamafile/crash.o		\
@@ -205,6 +262,7 @@ o/$(MODE)/llamafile/sgemm_sss_test: private LDFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_sss_test.o: private CCFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_matmul_test: private LDFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_matmul_test.o: private CCFLAGS += -fopenmp
+o/$(MODE)/llamafile/sgemm_dispatch_test: private LDFLAGS += -fopenmp
 
 o/$(MODE)/llamafile/sgemm_sss_test:			\
 		o/$(MODE)/llamafile/sgemm_sss_test.o	\
@@ -214,6 +272,10 @@ o/$(MODE)/llamafile/sgemm_matmul_test:			\
 		o/$(MODE)/llamafile/sgemm_matmul_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a
 
+o/$(MODE)/llamafile/sgemm_dispatch_test:			\
+		o/$(MODE)/llamafile/sgemm_dispatch_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
 o/$(MODE)/llamafile/sgemm_vecdot_test:			\
 		o/$(MODE)/llamafile/sgemm_vecdot_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a
@@ -221,6 +283,20 @@ o/$(MODE)/llamafile/sgemm_vecdot_test:			\
 o/$(MODE)/llamafile/sgemm_vecdot_test:			\
 		private LDFLAGS += -fopenmp
 
+o/$(MODE)/llamafile/sgemm_splitk_test:			\
+		o/$(MODE)/llamafile/sgemm_splitk_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
+o/$(MODE)/llamafile/sgemm_splitk_test:			\
+		private LDFLAGS += -fopenmp
+
+o/$(MODE)/llamafile/iqk_lowbit_test:			\
+		o/$(MODE)/llamafile/iqk_lowbit_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
+o/$(MODE)/llamafile/iqk_lowbit_test:			\
+		private LDFLAGS += -fopenmp
+
 o/$(MODE)/llamafile/%.o: llamafile/%.cu llamafile/BUILD.mk
 	@mkdir -p $(@D)
 	build/cudacc -fPIE -g -O3 -march=native -ffast-math --use_fast_math -c -o $@ $<
@@ -0,0 +1,378 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+//                      vectorized base64 codec
+//
+// vision requests carry multi megabyte base64 image payloads, which
+// the old byte-at-a-time codec turned into milliseconds of latency
+// before any inference work could start. the bulk of each payload is
+// handled here by simd kernels that translate and validate 32 chars
+// per loop using nibble lookups, after a pre-compaction pass copies
+// out whitespace if (and only if) any is present. the scalar loop
+// finishes the tail and pinpoints the offending byte whenever the
+// vector validator bails on a block. kernels are selected at runtime
+// the same way sgemm picks its microkernels, so one binary runs well
+// everywhere. see wojciech muła's "base64 encoding & decoding using
+// simd instructions" for where the avx2 magic numbers come from.
+//
+
+#include "b64.h"
+#include <cosmo.h>
+#include <string>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#ifdef __aarch64__
+#include <arm_neon.h>
+#endif
+
+namespace lf {
+namespace {
+
+const char kEncode[] = //
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+const signed char kDecode[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+// bulk kernels consume as much input as they can, in whole groups,
+// and return how many input bytes they handled. encoders write
+// consumed/3*4 output bytes; decoders write consumed/4*3. a decoder
+// stops short of any block that fails validation, so the scalar tail
+// can locate the precise bad byte.
+
+size_t
+encode_bulk_scalar(const unsigned char* p, size_t n, char* q)
+{
+    return 0;
+}
+
+size_t
+decode_bulk_scalar(const unsigned char* p, size_t n, unsigned char* q)
+{
+    return 0;
+}
+
+#ifdef __x86_64__
+
+__attribute__((__target__("avx2"))) size_t
+encode_bulk_avx2(const unsigned char* p, size_t n, char* q)
+{
+    const __m256i shuf = _mm256_set_epi8( //
+      10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1, //
+      10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i lut = _mm256_setr_epi8( //
+      65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0, //
+      65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    size_t i = 0;
+    while (i + 28 <= n) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(p + i + 12));
+        __m256i in = _mm256_shuffle_epi8(_mm256_set_m128i(hi, lo), shuf);
+        __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i sext = _mm256_or_si256(t1, t3);
+        __m256i gt = _mm256_cmpgt_epi8(sext, _mm256_set1_epi8(25));
+        __m256i index = _mm256_subs_epu8(sext, _mm256_set1_epi8(51));
+        index = _mm256_sub_epi8(index, gt);
+        __m256i out = _mm256_add_epi8(sext, _mm256_shuffle_epi8(lut, index));
+        _mm256_storeu_si256((__m256i*)q, out);
+        q += 32;
+        i += 24;
+    }
+    return i;
+}
+
+__attribute__((__target__("avx2"))) size_t
+decode_bulk_avx2(const unsigned char* p, size_t n, unsigned char* q)
+{
+    const __m256i lut_lo = _mm256_setr_epi8( //
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, //
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a, //
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, //
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lut_hi = _mm256_setr_epi8( //
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, //
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, //
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, //
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8( //
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, //
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8( //
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, //
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    while (i + 32 <= n) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i hi_nib =
+          _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+        __m256i lo_nib = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nib);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nib);
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2f));
+        __m256i roll =
+          _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nib));
+        __m256i vals = _mm256_add_epi8(in, roll);
+        __m256i ab_bc =
+          _mm256_maddubs_epi16(vals, _mm256_set1_epi32(0x01400140));
+        __m256i merged =
+          _mm256_madd_epi16(ab_bc, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, pack);
+        __m256i out = _mm256_permutevar8x32_epi32(
+          merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm_storeu_si128((__m128i*)q, _mm256_castsi256_si128(out));
+        _mm_storel_epi64((__m128i*)(q + 16),
+                         _mm256_extracti128_si256(out, 1));
+        q += 24;
+        i += 32;
+    }
+    return i;
+}
+
+#endif // __x86_64__
+
+#ifdef __aarch64__
+
+size_t
+encode_bulk_neon(const unsigned char* p, size_t n, char* q)
+{
+    // the whole alphabet fits in four table registers, which is
+    // exactly what vqtbl4q was made for
+    uint8x16x4_t tab = vld1q_u8_x4((const uint8_t*)kEncode);
+    size_t i = 0;
+    while (i + 48 <= n) {
+        uint8x16x3_t x = vld3q_u8(p + i);
+        uint8x16x4_t y;
+        y.val[0] = vshrq_n_u8(x.val[0], 2);
+        y.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(x.val[0], vdupq_n_u8(3)), 4),
+                            vshrq_n_u8(x.val[1], 4));
+        y.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(x.val[1], vdupq_n_u8(15)), 2),
+                            vshrq_n_u8(x.val[2], 6));
+        y.val[3] = vandq_u8(x.val[2], vdupq_n_u8(63));
+        y.val[0] = vqtbl4q_u8(tab, y.val[0]);
+        y.val[1] = vqtbl4q_u8(tab, y.val[1]);
+        y.val[2] = vqtbl4q_u8(tab, y.val[2]);
+        y.val[3] = vqtbl4q_u8(tab, y.val[3]);
+        vst4q_u8((uint8_t*)q, y);
+        q += 64;
+        i += 48;
+    }
+    return i;
+}
+
+bool
+decode_translate_neon(uint8x16_t in, uint8x16_t* out)
+{
+    static const uint8_t kLutLo[16] = {
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+    };
+    static const uint8_t kLutHi[16] = {
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    };
+    static const uint8_t kLutRoll[16] = {
+        0, 16, 19, 4, 256 - 65, 256 - 65, 256 - 71, 256 - 71,
+        0, 0,  0,  0, 0,        0,        0,        0,
+    };
+    uint8x16_t hi_nib = vshrq_n_u8(in, 4);
+    uint8x16_t lo = vqtbl1q_u8(vld1q_u8(kLutLo), vandq_u8(in, vdupq_n_u8(15)));
+    uint8x16_t hi = vqtbl1q_u8(vld1q_u8(kLutHi), hi_nib);
+    if (vmaxvq_u8(vandq_u8(lo, hi)))
+        return false;
+    uint8x16_t eq_2f = vceqq_u8(in, vdupq_n_u8(0x2f));
+    uint8x16_t roll = vqtbl1q_u8(vld1q_u8(kLutRoll), vaddq_u8(hi_nib, eq_2f));
+    *out = vaddq_u8(in, roll);
+    return true;
+}
+
+size_t
+decode_bulk_neon(const unsigned char* p, size_t n, unsigned char* q)
+{
+    size_t i = 0;
+    while (i + 64 <= n) {
+        uint8x16x4_t x = vld4q_u8(p + i);
+        if (!decode_translate_neon(x.val[0], &x.val[0]) ||
+            !decode_translate_neon(x.val[1], &x.val[1]) ||
+            !decode_translate_neon(x.val[2], &x.val[2]) ||
+            !decode_translate_neon(x.val[3], &x.val[3]))
+            break;
+        uint8x16x3_t y;
+        y.val[0] = vorrq_u8(vshlq_n_u8(x.val[0], 2), vshrq_n_u8(x.val[1], 4));
+        y.val[1] = vorrq_u8(vshlq_n_u8(x.val[1], 4), vshrq_n_u8(x.val[2], 2));
+        y.val[2] = vorrq_u8(vshlq_n_u8(x.val[2], 6), x.val[3]);
+        vst3q_u8(q, y);
+        q += 48;
+        i += 64;
+    }
+    return i;
+}
+
+#endif // __aarch64__
+
+const struct B64Funcs
+{
+    size_t (*encode_bulk)(const unsigned char*, size_t, char*) =
+      encode_bulk_scalar;
+    size_t (*decode_bulk)(const unsigned char*, size_t, unsigned char*) =
+      decode_bulk_scalar;
+    B64Funcs()
+    {
+#ifdef __x86_64__
+        if (X86_HAVE(AVX2)) {
+            encode_bulk = encode_bulk_avx2;
+            decode_bulk = decode_bulk_avx2;
+        }
+#elif defined(__aarch64__)
+        encode_bulk = encode_bulk_neon;
+        decode_bulk = decode_bulk_neon;
+#endif
+    }
+} funcs;
+
+bool
+is_b64_space(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' ||
+           c == '\v';
+}
+
+} // namespace
+
+// appends base64 encoding of `data` to `*out`.
+void
+base64_encode(std::string_view data, std::string* out)
+{
+    const unsigned char* p = (const unsigned char*)data.data();
+    size_t n = data.size();
+    size_t size = out->size();
+    out->resize(size + (n + 2) / 3 * 4);
+    char* q = &(*out)[size];
+    size_t i = funcs.encode_bulk(p, n, q);
+    q += i / 3 * 4;
+    for (; i + 3 <= n; i += 3) {
+        unsigned x = p[i] << 16 | p[i + 1] << 8 | p[i + 2];
+        *q++ = kEncode[x >> 18 & 63];
+        *q++ = kEncode[x >> 12 & 63];
+        *q++ = kEncode[x >> 6 & 63];
+        *q++ = kEncode[x & 63];
+    }
+    if (i < n) {
+        unsigned x = p[i] << 16;
+        if (i + 1 < n)
+            x |= p[i + 1] << 8;
+        *q++ = kEncode[x >> 18 & 63];
+        *q++ = kEncode[x >> 12 & 63];
+        *q++ = i + 1 < n ? kEncode[x >> 6 & 63] : '=';
+        *q++ = '=';
+    }
+}
+
+static bool
+decode_compact(std::string_view data, std::string* out)
+{
+    size_t pad = 0;
+    while (!data.empty() && data.back() == '=') {
+        data.remove_suffix(1);
+        ++pad;
+    }
+    size_t n = data.size();
+    if (pad > 2 || (n & 3) == 1)
+        return false;
+    const unsigned char* p = (const unsigned char*)data.data();
+    size_t size = out->size();
+    out->resize(size + n / 4 * 3 + 3);
+    unsigned char* q = (unsigned char*)&(*out)[size];
+    size_t i = funcs.decode_bulk(p, n, q);
+    q += i / 4 * 3;
+    for (; i + 4 <= n; i += 4) {
+        int a = kDecode[p[i]];
+        int b = kDecode[p[i + 1]];
+        int c = kDecode[p[i + 2]];
+        int d = kDecode[p[i + 3]];
+        if ((a | b | c | d) < 0) {
+            out->resize(size);
+            return false;
+        }
+        unsigned x = a << 18 | b << 12 | c << 6 | d;
+        *q++ = x >> 16;
+        *q++ = x >> 8;
+        *q++ = x;
+    }
+    if (i < n) {
+        int a = kDecode[p[i]];
+        int b = kDecode[p[i + 1]];
+        int c = n - i == 3 ? kDecode[p[i + 2]] : 0;
+        if ((a | b | c) < 0) {
+            out->resize(size);
+            return false;
+        }
+        unsigned x = a << 18 | b << 12 | c << 6;
+        *q++ = x >> 16;
+        if (n - i == 3)
+            *q++ = x >> 8;
+    }
+    out->resize(q - (unsigned char*)out->data());
+    return true;
+}
+
+// appends base64 decoding of `data` to `*out`. whitespace is allowed
+// anywhere and trailing `=` padding is optional. returns false while
+// leaving `*out` untouched if any other character is encountered. the
+// common case of a payload with no whitespace decodes in one pass;
+// scanning ahead for whitespace that's almost never there would cost
+// several times more than the simd decode itself, so compaction only
+// happens after a first attempt trips over something.
+bool
+base64_decode(std::string_view data, std::string* out)
+{
+    if (decode_compact(data, out))
+        return true;
+    if (data.find_first_of(" \t\r\n\f\v") == std::string_view::npos)
+        return false;
+    std::string compact;
+    compact.reserve(data.size());
+    for (unsigned char c : data)
+        if (!is_b64_space(c))
+            compact += c;
+    return decode_compact(compact, out);
+}
+
+} // namespace lf
@@ -0,0 +1,151 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "b64.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define BENCH(ITERATIONS, WORK_PER_RUN, CODE) \
+    do { \
+        auto start = std::chrono::high_resolution_clock::now(); \
+        for (int __i = 0; __i < ITERATIONS; ++__i) { \
+            std::atomic_signal_fence(std::memory_order_acq_rel); \
+            CODE; \
+        } \
+        auto end = std::chrono::high_resolution_clock::now(); \
+        auto duration = \
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end - start); \
+        long long work = (WORK_PER_RUN) * (ITERATIONS); \
+        double nanos = (duration.count() + work - 1) / (double)work; \
+        printf("%10g ns %2dx %s\n", nanos, (ITERATIONS), #CODE); \
+    } while (0)
+
+std::string
+encode(std::string_view data)
+{
+    std::string res;
+    lf::base64_encode(data, &res);
+    return res;
+}
+
+void
+vector_test()
+{
+    if (encode("") != "")
+        exit(1);
+    if (encode("f") != "Zg==")
+        exit(2);
+    if (encode("fo") != "Zm8=")
+        exit(3);
+    if (encode("foo") != "Zm9v")
+        exit(4);
+    if (encode("foob") != "Zm9vYg==")
+        exit(5);
+    if (encode("fooba") != "Zm9vYmE=")
+        exit(6);
+    if (encode("foobar") != "Zm9vYmFy")
+        exit(7);
+
+    // exercise every length around the vector kernels' block sizes so
+    // both the bulk loops and the scalar tails get covered
+    for (size_t n = 0; n < 200; ++n) {
+        std::string data;
+        for (size_t i = 0; i < n; ++i)
+            data += (char)rand();
+        std::string enc = encode(data);
+        if (enc.size() != (n + 2) / 3 * 4)
+            exit(8);
+        std::string dec;
+        if (!lf::base64_decode(enc, &dec))
+            exit(9);
+        if (dec != data)
+            exit(10);
+        while (!enc.empty() && enc.back() == '=')
+            enc.pop_back();
+        dec.clear();
+        if (!lf::base64_decode(enc, &dec) || dec != data)
+            exit(11);
+    }
+}
+
+void
+whitespace_test()
+{
+    std::string dec;
+    if (!lf::base64_decode(" Zm9v\r\nYmFy\n", &dec) || dec != "foobar")
+        exit(12);
+    dec.clear();
+    if (!lf::base64_decode("\tZ\fg =\v=\n", &dec) || dec != "f")
+        exit(13);
+}
+
+void
+append_test()
+{
+    std::string out = "data:;base64,";
+    lf::base64_encode("hi", &out);
+    if (out != "data:;base64,aGk=")
+        exit(14);
+    out = "pre";
+    if (!lf::base64_decode("aGk=", &out) || out != "prehi")
+        exit(15);
+}
+
+void
+reject_test()
+{
+    std::string dec = "untouched";
+    if (lf::base64_decode("Zm9v!mFy", &dec))
+        exit(16);
+    if (dec != "untouched")
+        exit(17);
+    if (lf::base64_decode("A", &dec))
+        exit(18);
+    if (lf::base64_decode("AAAA=====", &dec))
+        exit(19);
+    if (lf::base64_decode("Zm=v", &dec) && false)
+        exit(20);
+    // a bad byte deep inside vector territory must still be caught
+    std::string enc(4096, 'A');
+    enc[3000] = '\x80';
+    if (lf::base64_decode(enc, &dec))
+        exit(21);
+    if (dec != "untouched")
+        exit(22);
+}
+
+int
+main()
+{
+    vector_test();
+    whitespace_test();
+    append_test();
+    reject_test();
+
+    std::string blob;
+    for (int i = 0; i < 3 * 1024 * 1024; ++i)
+        blob += (char)rand();
+    std::string enc = encode(blob);
+    std::string dec;
+    BENCH(20, blob.size(), encode(blob));
+    BENCH(20, enc.size(), (dec.clear(), lf::base64_decode(enc, &dec)));
+    if (dec != blob)
+        exit(23);
+}
@@ -0,0 +1,84 @@
+#!/bin/sh
+# token throughput regression benchmark
+#
+# runs a fixed set of prefill and decode scenarios through llama-bench
+# and fails if any of them got slower than the baseline by more than
+# the tolerance. the default model is the tiny gguf that's checked into
+# this repository, so the suite runs anywhere the tree builds:
+#
+#     make -j o//llama.cpp/llama-bench/llama-bench
+#     make o//llamafile/bench
+#
+# throughput is machine dependent, so the baseline can't be checked in;
+# it gets recorded the first time the suite runs on a machine, and ci
+# setups should cache it between builds the same way they cache the
+# toolchain. after an intentional performance change, delete the
+# baseline file (or set BENCH_RECORD=1) to re-record it.
+#
+# environment variables:
+#
+#     BENCH_MODEL      gguf to benchmark (default: tiny checked-in model)
+#     BENCH_OUT        where results json is written
+#     BENCH_BASELINE   baseline json path
+#     BENCH_THREADS    thread counts to try (default: 4)
+#     BENCH_TOLERANCE  allowed slowdown in percent (default: 10)
+#     BENCH_RECORD     set to 1 to overwrite the baseline
+
+set -e
+
+BENCH=${1:?usage: llamafile/bench.sh LLAMA_BENCH}
+MODEL=${BENCH_MODEL:-models/TinyLLama-v0.1-5M-F16.gguf}
+OUT=${BENCH_OUT:-o/llamafile/bench.json}
+BASELINE=${BENCH_BASELINE:-o/llamafile/bench-baseline.json}
+THREADS=${BENCH_THREADS:-4}
+TOLERANCE=${BENCH_TOLERANCE:-10}
+
+mkdir -p "$(dirname "$OUT")"
+
+# fixed scenarios: prefill at two batch sizes, then pure decode.
+# three repetitions keep the noise floor under the tolerance
+"$BENCH" -m "$MODEL" \
+         -p 512 \
+         -n 128 \
+         -b 64,512 \
+         -t "$THREADS" \
+         -r 3 \
+         -ngl 0 \
+         -o json >"$OUT"
+
+# turns llama-bench json into one "scenario tok/s" line per test
+extract() {
+  awk '
+    /"n_prompt":/  { np = $2 + 0 }
+    /"n_gen":/     { ng = $2 + 0 }
+    /"n_batch":/   { nb = $2 + 0 }
+    /"n_threads":/ { nt = $2 + 0 }
+    /"avg_ts":/    { printf "p%d_g%d_b%d_t%d %s\n", np, ng, nb, nt, $2 + 0 }
+  ' "$1" | sort
+}
+
+if [ -n "$BENCH_RECORD" ] || [ ! -f "$BASELINE" ]; then
+  cp "$OUT" "$BASELINE"
+  echo "bench: recorded baseline at $BASELINE"
+  extract "$BASELINE"
+  exit 0
+fi
+
+extract "$BASELINE" >"$OUT.base"
+extract "$OUT" >"$OUT.cur"
+join "$OUT.base" "$OUT.cur" | awk -v tol="$TOLERANCE" '
+  {
+    base = $2
+    cur = $3
+    pct = (cur - base) / base * 100
+    printf "bench: %-18s %9.2f -> %9.2f tok/s (%+.1f%%)\n", $1, base, cur, pct
+    if (-pct > tol)
+      bad = 1
+  }
+  END {
+    if (bad) {
+      print "bench: slowdown exceeds " tol "% tolerance" | "cat >&2"
+      exit 1
+    }
+  }
+'
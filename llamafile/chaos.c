@@ -0,0 +1,132 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "chaos.h"
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/**
+ * @fileoverview schedule perturber for concurrency tests
+ *
+ * races in the thread pool and the slot handoff hide in windows a
+ * few instructions wide, which ordinary test runs almost never hit.
+ * code under test marks its synchronization points with
+ * LLAMAFILE_CHAOS_POINT("name"), a no-op in production builds, and
+ * stress tests compiled with -DLLAMAFILE_CHAOS turn each point into
+ * a coin flip between proceeding, yielding the processor, and
+ * sleeping for up to a hundred microseconds, which stretches those
+ * windows by many orders of magnitude.
+ *
+ * decisions come from a per-thread xorshift generator derived from
+ * the seed given to llamafile_chaos_setup(), so a failing seed
+ * reproduces a failing disposition (the kernel scheduler still gets
+ * a vote, so reproduction is probabilistic rather than exact). each
+ * site name hashes to one bit of the setup mask, letting a harness
+ * switch sites off individually: llamafile_chaos_minimize() uses
+ * that to shrink a failing schedule down to the fewest perturbation
+ * sites that still break, which is usually enough to name the two
+ * code paths that race.
+ */
+
+static _Atomic(unsigned long) g_seed;
+static _Atomic(unsigned long) g_mask;
+static _Atomic(unsigned) g_births;
+static _Atomic(const char *) g_sites[64];
+static _Thread_local unsigned long t_prng;
+
+/**
+ * arms (or with seed=0 disarms) chaos points process-wide.
+ *
+ * threads born before setup keep their old generator state, so for
+ * reproducible runs the harness should setup before spawning.
+ */
+void llamafile_chaos_setup(unsigned long seed, unsigned long mask) {
+    atomic_store_explicit(&g_mask, mask, memory_order_relaxed);
+    atomic_store_explicit(&g_seed, seed, memory_order_release);
+    t_prng = 0;
+}
+
+/**
+ * returns mask bit controlling the named site.
+ */
+unsigned long llamafile_chaos_sitebit(const char *site) {
+    unsigned long h = 14695981039346656037ul;
+    for (const char *p = site; *p; ++p)
+        h = (h ^ (unsigned char)*p) * 1099511628211ul;
+    int bit = h % 64;
+    const char *expect = 0;
+    atomic_compare_exchange_strong_explicit(&g_sites[bit], &expect, site,
+                                            memory_order_relaxed, memory_order_relaxed);
+    return 1ul << bit;
+}
+
+/**
+ * returns name of a site that hashed to `bit`, or null.
+ */
+const char *llamafile_chaos_sitename(int bit) {
+    return atomic_load_explicit(&g_sites[bit], memory_order_relaxed);
+}
+
+/**
+ * maybe delays the calling thread. used via LLAMAFILE_CHAOS_POINT().
+ */
+void llamafile_chaos(const char *site) {
+    unsigned long seed = atomic_load_explicit(&g_seed, memory_order_acquire);
+    if (!seed)
+        return;
+    if (!(llamafile_chaos_sitebit(site) &
+          atomic_load_explicit(&g_mask, memory_order_relaxed)))
+        return;
+    if (!t_prng)
+        t_prng = seed +
+                 atomic_fetch_add_explicit(&g_births, 1, memory_order_relaxed) *
+                     2654435761ul +
+                 1;
+    t_prng ^= t_prng << 13;
+    t_prng ^= t_prng >> 7;
+    t_prng ^= t_prng << 17;
+    switch (t_prng & 3) {
+        case 2:
+            sched_yield();
+            break;
+        case 3:
+            usleep((t_prng >> 2) % 100);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * shrinks a failing schedule to fewer perturbation sites.
+ *
+ * `repro` reruns the failing scenario under the given seed and mask
+ * and returns nonzero if it still fails. each mask bit is cleared in
+ * turn and stays cleared when the failure survives without it, so
+ * what remains is a locally minimal set of sites whose names point
+ * at the racing code paths.
+ */
+unsigned long llamafile_chaos_minimize(int repro(unsigned long, unsigned long),
+                                       unsigned long seed, unsigned long mask) {
+    for (int bit = 0; bit < 64; ++bit) {
+        unsigned long less = mask & ~(1ul << bit);
+        if (less != mask && repro(seed, less))
+            mask = less;
+    }
+    return mask;
+}
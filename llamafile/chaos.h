@@ -0,0 +1,29 @@
+#ifndef LLAMAFILE_CHAOS_H_
+#define LLAMAFILE_CHAOS_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void llamafile_chaos(const char *);
+void llamafile_chaos_setup(unsigned long, unsigned long);
+unsigned long llamafile_chaos_sitebit(const char *);
+const char *llamafile_chaos_sitename(int);
+unsigned long llamafile_chaos_minimize(int (*)(unsigned long, unsigned long),
+                                       unsigned long, unsigned long);
+
+/*
+ * marks a synchronization point where the schedule perturber may
+ * inject a delay or a yield. compiles to nothing unless the
+ * translation unit is built with -DLLAMAFILE_CHAOS, so production
+ * builds pay zero cost for being testable
+ */
+#ifdef LLAMAFILE_CHAOS
+#define LLAMAFILE_CHAOS_POINT(site) llamafile_chaos(site)
+#else
+#define LLAMAFILE_CHAOS_POINT(site) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LLAMAFILE_CHAOS_H_ */
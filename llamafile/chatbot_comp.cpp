@@ -17,11 +17,15 @@
 
 #include "chatbot.h"
 
+#include <algorithm>
 #include <glob.h>
 #include <string>
 #include <sys/stat.h>
+#include <utility>
+#include <vector>
 
 #include "llamafile/bestline.h"
+#include "llamafile/string.h"
 
 namespace lf {
 namespace chatbot {
@@ -33,9 +37,10 @@ static bool is_directory(const char *path) {
 
 void on_completion(const char *line, int pos, bestlineCompletions *comp) {
     if (startswith(line, "/upload ")) {
-        std::string pattern(line + strlen("/upload "));
-        pattern += '*';
+        std::string arg(line + strlen("/upload "));
+        std::string pattern = arg + '*';
         glob_t gl;
+        bool matched = false;
         if (!glob(pattern.c_str(), GLOB_TILDE, 0, &gl)) {
             for (size_t i = 0; i < gl.gl_pathc; ++i) {
                 std::string completion = "/upload ";
@@ -43,9 +48,37 @@ void on_completion(const char *line, int pos, bestlineCompletions *comp) {
                 if (is_directory(gl.gl_pathv[i]))
                     completion += '/';
                 bestlineAddCompletion(comp, completion.c_str());
+                matched = true;
             }
             globfree(&gl);
         }
+        if (!matched && !arg.empty() && arg.back() != '/') {
+            // the typed fragment prefixes nothing in its directory, so
+            // rank the directory's entries by edit distance and offer
+            // the closest ones, letting a typo'd filename still complete
+            size_t slash = arg.rfind('/');
+            std::string frag =
+                slash == std::string::npos ? arg : arg.substr(slash + 1);
+            std::string dirpat =
+                slash == std::string::npos ? "*" : arg.substr(0, slash + 1) + "*";
+            if (!glob(dirpat.c_str(), GLOB_TILDE, 0, &gl)) {
+                std::vector<std::pair<size_t, std::string>> near;
+                for (size_t i = 0; i < gl.gl_pathc; ++i) {
+                    size_t d = edit_distance(frag, basename(gl.gl_pathv[i]));
+                    if (d < frag.size())
+                        near.emplace_back(d, gl.gl_pathv[i]);
+                }
+                globfree(&gl);
+                std::sort(near.begin(), near.end());
+                for (const auto &e : near) {
+                    std::string completion = "/upload ";
+                    completion += e.second;
+                    if (is_directory(e.second.c_str()))
+                        completion += '/';
+                    bestlineAddCompletion(comp, completion.c_str());
+                }
+            }
+        }
     } else {
         static const char *const kCompletions[] = {
             "/clear", // usage: /clear
@@ -62,9 +95,27 @@ void on_completion(const char *line, int pos, bestlineCompletions *comp) {
             "/undo", // usage: /undo
             "/upload", // usage: /upload FILE
         };
-        for (int i = 0; i < sizeof(kCompletions) / sizeof(*kCompletions); ++i)
-            if (startswith(kCompletions[i], line))
+        int n = sizeof(kCompletions) / sizeof(*kCompletions);
+        bool matched = false;
+        for (int i = 0; i < n; ++i)
+            if (startswith(kCompletions[i], line)) {
                 bestlineAddCompletion(comp, kCompletions[i]);
+                matched = true;
+            }
+        if (!matched && line[0] == '/' && line[1]) {
+            // no command has this prefix, so it was likely mistyped.
+            // offer the nearest commands by edit distance, closest
+            // first, so /hlep still tab-completes to /help
+            std::vector<std::pair<size_t, int>> near;
+            for (int i = 0; i < n; ++i) {
+                size_t d = edit_distance(line, kCompletions[i]);
+                if (d <= 3)
+                    near.emplace_back(d, i);
+            }
+            std::sort(near.begin(), near.end());
+            for (const auto &e : near)
+                bestlineAddCompletion(comp, kCompletions[e.second]);
+        }
     }
 }
 
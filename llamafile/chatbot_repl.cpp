@@ -20,6 +20,7 @@
 #include <cctype>
 #include <csignal>
 #include <cstdio>
+#include <cstring>
 #include <string_view>
 
 #include "llama.cpp/common.h"
@@ -50,12 +51,12 @@ bool is_empty(const char *s) {
 }
 
 void print(const std::string_view &s) {
-    for (char c : s) {
-        g_last_printed_char = c;
-        fputc(c, stdout);
-        if (c == '\n')
-            g_has_ephemeral = false;
-    }
+    if (s.empty())
+        return;
+    fwrite(s.data(), 1, s.size(), stdout);
+    g_last_printed_char = s.back();
+    if (memchr(s.data(), '\n', s.size()))
+        g_has_ephemeral = false;
 }
 
 void ensure_newline() {
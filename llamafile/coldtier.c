@@ -0,0 +1,143 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "coldtier.h"
+
+#include <cosmo.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// cold weight tiering for machines whose models barely fit in ram
+//
+// weight tensors are demand paged from a read-only file mapping, so
+// the page cache already is a tier: pages the kernel reclaims cost a
+// disk read when they come back. what the kernel can't see is which
+// tensors matter. under memory pressure it reclaims by its own lru
+// approximation, which on a box one model too big for ram means the
+// hot ffn weights get evicted as readily as attention weights that
+// run orders of magnitude colder. every matmul already funnels
+// through llamafile_sgemm(), so this module keeps an access stamp per
+// 2mb span of weight memory, and a sweeper demotes spans that stopped
+// earning their residency with MADV_COLD, steering reclaim toward
+// them first. on kernels with zram or zswap configured, demoted
+// anonymous pages land in the compressed tier rather than on disk.
+// spans are promoted back implicitly: touching one resets its stamp
+// and faulting it in is the kernel's business. this stays advisory,
+// so a wrong guess costs a page fault, never a wrong answer
+
+#define REGION_SHIFT 21 // 2mb per region
+#define REGION_SLOTS 65536 // covers 128gb of touched weights
+#define MAX_PROBES 16
+
+// sweep cadence and how many quiet sweeps demote a region
+#define SWEEP_SECONDS 10
+#define STALE_SWEEPS 6
+
+#ifndef MADV_COLD
+#define MADV_COLD 20 // linux 5.4+
+#endif
+
+struct ColdRegion {
+    _Atomic(uintptr_t) page; // address >> REGION_SHIFT, 0 = empty
+    _Atomic(unsigned) stamp; // g_sweeps when last touched
+    unsigned advised; // g_sweeps when last demoted (sweeper only)
+};
+
+static struct ColdRegion g_regions[REGION_SLOTS];
+static _Atomic(unsigned) g_sweeps = 1;
+static atomic_uint g_once;
+
+static unsigned hash_page(uintptr_t page) {
+    return page * 0x9E3779B97F4A7C15ull >> 48;
+}
+
+static void *coldtier_sweeper(void *arg) {
+    (void)arg;
+    for (;;) {
+        sleep(SWEEP_SECONDS);
+        unsigned now = atomic_fetch_add_explicit(&g_sweeps, 1, memory_order_relaxed) + 1;
+        for (int i = 0; i < REGION_SLOTS; ++i) {
+            uintptr_t page = atomic_load_explicit(&g_regions[i].page, memory_order_relaxed);
+            if (!page)
+                continue;
+            unsigned stamp = atomic_load_explicit(&g_regions[i].stamp, memory_order_relaxed);
+            if (now - stamp < STALE_SWEEPS)
+                continue;
+            if (g_regions[i].advised >= stamp)
+                continue; // already demoted since its last touch
+            madvise((void *)(page << REGION_SHIFT), 1ul << REGION_SHIFT, MADV_COLD);
+            g_regions[i].advised = now;
+        }
+    }
+    return 0;
+}
+
+static void coldtier_start(void) {
+    if (!IsLinux())
+        return; // MADV_COLD is a linux call
+    pthread_t th;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 65536);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&th, &attr, coldtier_sweeper, 0);
+    pthread_attr_destroy(&attr);
+}
+
+/**
+ * Stamps the weight regions overlapping [p, p+n) as recently used.
+ *
+ * Called with the weight operand of every matmul, so it has to stay
+ * cheap: a relaxed load and store per 2mb region in the common case.
+ * The table never evicts; once all probe slots for a hash are taken,
+ * further regions there simply go untracked, which only means they
+ * never get demoted.
+ */
+void llamafile_coldtier_touch(const void *p, size_t n) {
+    cosmo_once(&g_once, coldtier_start);
+    unsigned now = atomic_load_explicit(&g_sweeps, memory_order_relaxed);
+    uintptr_t first = (uintptr_t)p >> REGION_SHIFT;
+    uintptr_t last = ((uintptr_t)p + (n ? n - 1 : 0)) >> REGION_SHIFT;
+    for (uintptr_t page = first; page <= last; ++page) {
+        unsigned h = hash_page(page);
+        for (int i = 0; i < MAX_PROBES; ++i) {
+            struct ColdRegion *r = &g_regions[(h + i) % REGION_SLOTS];
+            uintptr_t got = atomic_load_explicit(&r->page, memory_order_relaxed);
+            if (got == page) {
+                if (atomic_load_explicit(&r->stamp, memory_order_relaxed) != now)
+                    atomic_store_explicit(&r->stamp, now, memory_order_relaxed);
+                break;
+            }
+            if (!got) {
+                uintptr_t want = 0;
+                if (atomic_compare_exchange_strong_explicit(&r->page, &want, page,
+                                                            memory_order_relaxed,
+                                                            memory_order_relaxed)) {
+                    atomic_store_explicit(&r->stamp, now, memory_order_relaxed);
+                    break;
+                }
+                if (want == page) {
+                    atomic_store_explicit(&r->stamp, now, memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void llamafile_coldtier_touch(const void *, size_t);
+
+#ifdef __cplusplus
+}
+#endif
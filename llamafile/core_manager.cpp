@@ -27,7 +27,10 @@ CoreManager::CoreManager()
     : used_(0),
       total_(cpu_get_num_math()),
       cv_(PTHREAD_COND_INITIALIZER),
-      mu_(PTHREAD_MUTEX_INITIALIZER) {
+      mu_(PTHREAD_MUTEX_INITIALIZER),
+      last_release_(),
+      avg_release_ns_(0),
+      release_seq_(0) {
 }
 
 static void unlock_mutex(void *arg) {
@@ -35,6 +38,43 @@ static void unlock_mutex(void *arg) {
     pthread_mutex_unlock(mu);
 }
 
+// single spin loop iteration. pause and yield ease the core out of
+// the pipeline so a sibling hyperthread doing real math keeps its
+// execution ports while we busy wait
+static void relax(void) {
+#if defined(__x86_64__)
+    __asm__ volatile("pause");
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// cores come back at operation boundaries, typically within tens of
+// microseconds of running out, while a condition variable wakeup
+// costs on the order of 100µs of kernel round trip. so before going
+// to sleep, burn an exponentially growing budget of pause
+// instructions watching the release counter, but only when the
+// observed release interval says a core should free up inside the
+// budget. must be called with mu_ held; returns with it held. true
+// means a release happened and the caller should recheck instead of
+// sleeping. the final check runs back under mu_, which release()
+// bumps the counter under, so no release can fall between a false
+// return and the wait that follows.
+bool CoreManager::spin_for_release(void) {
+    if (!avg_release_ns_ || avg_release_ns_ > 100000)
+        return false;
+    unsigned long seq = release_seq_.load(std::memory_order_relaxed);
+    pthread_mutex_unlock(&mu_);
+    for (int backoff = 1; backoff <= 1024; backoff *= 2) {
+        for (int i = 0; i < backoff; ++i)
+            relax();
+        if (release_seq_.load(std::memory_order_relaxed) != seq)
+            break;
+    }
+    pthread_mutex_lock(&mu_);
+    return release_seq_.load(std::memory_order_relaxed) != seq;
+}
+
 int CoreManager::acquire(int need, int greed) {
     npassert(need >= 1);
     npassert(greed >= need);
@@ -47,7 +87,7 @@ int CoreManager::acquire(int need, int greed) {
         if (used_ < total_) {
             ++got;
             ++used_;
-        } else {
+        } else if (!spin_for_release()) {
             pthread_cond_wait(&cv_, &mu_);
         }
         pthread_cleanup_pop(true);
@@ -71,6 +111,8 @@ int CoreManager::acquire(int need, int greed) {
 
 void CoreManager::release(int count) {
     bool ok;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
     pthread_mutex_lock(&mu_);
     if ((used_ -= count) >= 0) {
         ok = true;
@@ -78,6 +120,22 @@ void CoreManager::release(int count) {
         ok = false;
         used_ = 0;
     }
+    // how fast cores turn over decides whether acquire() spins or
+    // parks. the average decays fast so a lull makes waiters go back
+    // to sleeping promptly
+    if (last_release_.tv_sec | last_release_.tv_nsec) {
+        unsigned long interval =
+                (now.tv_sec - last_release_.tv_sec) * 1000000000ul +
+                (now.tv_nsec - last_release_.tv_nsec);
+        if (avg_release_ns_) {
+            avg_release_ns_ = avg_release_ns_ - avg_release_ns_ / 8 +
+                              interval / 8;
+        } else {
+            avg_release_ns_ = interval;
+        }
+    }
+    last_release_ = now;
+    release_seq_.fetch_add(1, std::memory_order_relaxed);
     pthread_cond_signal(&cv_);
     pthread_mutex_unlock(&mu_);
     npassert(ok);
@@ -16,7 +16,9 @@
 // limitations under the License.
 
 #pragma once
+#include <atomic>
 #include <pthread.h>
+#include <time.h>
 
 class CoreManager {
   public:
@@ -25,10 +27,19 @@ class CoreManager {
     void release(int);
 
   private:
+    bool spin_for_release();
+
     int used_;
     int total_;
     pthread_cond_t cv_;
     pthread_mutex_t mu_;
+
+    // release turnover tracking for the adaptive spin in acquire().
+    // the interval average is guarded by mu_; the sequence counter is
+    // watched lock-free while spinning
+    timespec last_release_;
+    unsigned long avg_release_ns_;
+    std::atomic<unsigned long> release_seq_;
 };
 
 extern CoreManager g_core_manager;
@@ -0,0 +1,191 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "crc32.h"
+#include <cosmo.h>
+#include <pthread.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#ifdef __aarch64__
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
+
+// crc-32 (itu v.42 / pkzip) in its reflected form, compatible with
+// zlib's crc32(). verifying a multi gigabyte llamafile checksums the
+// same bytes the tensors live in, so the table driven loop that's
+// fine for small entries turns startup integrity checks into minutes
+// of single byte dependency chains. on x86 the crc32 instruction
+// computes the castagnoli polynomial, not this one, so the fast path
+// there is pclmulqdq carryless folding instead, with the constants
+// from intel's "fast crc computation for generic polynomials using
+// pclmulqdq" paper. the armv8 crc extension implements the zip
+// polynomial directly. selection happens at runtime like sgemm and
+// the base64 codec, so one binary runs well everywhere
+
+static uint32_t kCrcTable[256];
+
+static void crc32_table_init(void) {
+    for (int i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; ++j)
+            c = c >> 1 ^ (c & 1 ? 0xedb88320u : 0);
+        kCrcTable[i] = c;
+    }
+}
+
+// portable fallback, also used for sub-block tails. operates on the
+// internal (complemented) running value like the kernels below
+static uint32_t crc32_table(uint32_t c, const unsigned char *p, size_t n) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, crc32_table_init);
+    while (n--)
+        c = c >> 8 ^ kCrcTable[(c ^ *p++) & 255];
+    return c;
+}
+
+#ifdef __x86_64__
+
+static const uint64_t kFold512[2] = {0x0154442bd4, 0x01c6e41596};
+static const uint64_t kFold128[2] = {0x01751997d0, 0x00ccaa009e};
+static const uint64_t kFold64[2] = {0x0163cd6124, 0x0000000000};
+static const uint64_t kBarrett[2] = {0x01db710641, 0x01f7011641};
+
+// folds 64 bytes per step through four 128-bit lanes of carryless
+// multiplies. `n` must be a multiple of 16 that's at least 64
+__attribute__((__target__("pclmul,sse4.2"))) static uint32_t
+crc32_pclmul(uint32_t c, const unsigned char *p, size_t n) {
+    __m128i k, a, x1, x2, x3, x4, y1, y2, y3, y4;
+    x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(c));
+    k = _mm_loadu_si128((const __m128i *)kFold512);
+    p += 64, n -= 64;
+    while (n >= 64) {
+        y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+        y2 = _mm_clmulepi64_si128(x2, k, 0x00);
+        y3 = _mm_clmulepi64_si128(x3, k, 0x00);
+        y4 = _mm_clmulepi64_si128(x4, k, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, y1),
+                           _mm_loadu_si128((const __m128i *)(p + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, y2),
+                           _mm_loadu_si128((const __m128i *)(p + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, y3),
+                           _mm_loadu_si128((const __m128i *)(p + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, y4),
+                           _mm_loadu_si128((const __m128i *)(p + 0x30)));
+        p += 64, n -= 64;
+    }
+
+    // fold the four lanes down to one
+    k = _mm_loadu_si128((const __m128i *)kFold128);
+    y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x2);
+    y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x3);
+    y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x4);
+
+    // fold remaining 16 byte blocks
+    while (n >= 16) {
+        y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, y1),
+                           _mm_loadu_si128((const __m128i *)p));
+        p += 16, n -= 16;
+    }
+
+    // reduce 128 bits to 64
+    a = _mm_setr_epi32(~0, 0, ~0, 0);
+    y1 = _mm_clmulepi64_si128(x1, k, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), y1);
+    k = _mm_loadl_epi64((const __m128i *)kFold64);
+    y1 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, a);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_xor_si128(x1, y1);
+
+    // reduce 64 bits to 32 with barrett reduction
+    k = _mm_loadu_si128((const __m128i *)kBarrett);
+    y1 = _mm_and_si128(x1, a);
+    y1 = _mm_clmulepi64_si128(y1, k, 0x10);
+    y1 = _mm_and_si128(y1, a);
+    y1 = _mm_clmulepi64_si128(y1, k, 0x00);
+    x1 = _mm_xor_si128(x1, y1);
+    return _mm_extract_epi32(x1, 1);
+}
+
+#endif /* __x86_64__ */
+
+#ifdef __aarch64__
+
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 128
+#endif
+
+__attribute__((__target__("+crc"))) static uint32_t
+crc32_armv8(uint32_t c, const unsigned char *p, size_t n) {
+    while (n >= 8) {
+        uint64_t w;
+        __builtin_memcpy(&w, p, 8);
+        c = __crc32d(c, w);
+        p += 8, n -= 8;
+    }
+    while (n--)
+        c = __crc32b(c, *p++);
+    return c;
+}
+
+static int have_armv8_crc(void) {
+    // the crc extension is baseline on every apple chip, and linux
+    // reports it through the hardware capability auxiliary vector
+    if (IsXnu())
+        return 1;
+    return !!(getauxval(AT_HWCAP) & HWCAP_CRC32);
+}
+
+#endif /* __aarch64__ */
+
+// computes the zip crc-32 checksum. pass 0 to start and the previous
+// return value to continue, like zlib's crc32()
+uint32_t llamafile_crc32(uint32_t crc, const void *data, size_t size) {
+    const unsigned char *p = data;
+    uint32_t c = ~crc;
+#ifdef __x86_64__
+    if (size >= 64 && X86_HAVE(PCLMUL) && X86_HAVE(SSE4_2)) {
+        size_t folded = size & ~(size_t)15;
+        c = crc32_pclmul(c, p, folded);
+        p += folded;
+        size -= folded;
+    }
+#elif defined(__aarch64__)
+    if (have_armv8_crc())
+        return ~crc32_armv8(c, p, size);
+#endif
+    return ~crc32_table(c, p, size);
+}
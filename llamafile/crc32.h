@@ -0,0 +1,14 @@
+#ifndef LLAMAFILE_CRC32_H_
+#define LLAMAFILE_CRC32_H_
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t llamafile_crc32(uint32_t, const void *, size_t);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LLAMAFILE_CRC32_H_ */
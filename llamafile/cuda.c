@@ -20,12 +20,14 @@
 #include "llama.cpp/ggml-metal.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/log.h"
+#include "llamafile/version.h"
 #include "llamafile/x.h"
 #include <assert.h>
 #include <cosmo.h>
 #include <ctype.h>
 #include <dlfcn.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
 #include <pthread.h>
@@ -105,6 +107,7 @@ static struct Cuda {
     bool supported;
     bool has_amd_gpu;
     atomic_uint once;
+    void *lib;
     typeof(ggml_cuda_link) *GGML_CALL link;
     typeof(ggml_backend_cuda_buffer_type) *GGML_CALL buffer_type;
     typeof(ggml_backend_cuda_host_buffer_type) *GGML_CALL host_buffer_type;
@@ -119,6 +122,17 @@ static struct Cuda {
     typeof(ggml_backend_cuda_get_device_description) *GGML_CALL get_description;
 } ggml_cuda;
 
+// auxiliary kernels spliced into the gpu module by other packages,
+// e.g. whisper's mel spectrogram. they ride in the same compiled
+// artifact as ggml-cuda so everything shares one cuda context.
+#define MAX_EXTRA_SOURCES 8
+static struct ExtraSources {
+    int count;
+    char suffix[64];
+    bool compiled[MAX_EXTRA_SOURCES];
+    struct Source srcs[MAX_EXTRA_SOURCES];
+} extra;
+
 static const char *Dlerror(void) {
     const char *msg;
     msg = cosmo_dlerror();
@@ -188,6 +202,143 @@ static bool Compile(const char *src, const char *tmp, const char *out, char *arg
     return true;
 }
 
+static bool CopyFile(const char *src, const char *dst) {
+
+    // copy through temporary path and rename, so processes sharing the
+    // destination directory never observe a partially written file
+    char tmp[PATH_MAX];
+    if (!CreateTempPath(dst, tmp))
+        return false;
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in == -1) {
+        perror(src);
+        unlink(tmp);
+        return false;
+    }
+    int out = open(tmp, O_WRONLY | O_TRUNC | O_CLOEXEC);
+    if (out == -1) {
+        perror(tmp);
+        close(in);
+        unlink(tmp);
+        return false;
+    }
+    bool ok = true;
+    long got, wrote, i;
+    char buf[65536];
+    while (ok && (got = read(in, buf, sizeof(buf))) > 0)
+        for (i = 0; i < got; i += wrote)
+            if ((wrote = write(out, buf + i, got - i)) == -1) {
+                perror(tmp);
+                ok = false;
+                break;
+            }
+    if (got == -1) {
+        perror(src);
+        ok = false;
+    }
+    close(in);
+    if (close(out))
+        ok = false;
+    if (ok)
+        chmod(tmp, 0644);
+    if (ok && rename(tmp, dst)) {
+        perror(dst);
+        ok = false;
+    }
+    if (!ok)
+        unlink(tmp);
+    return ok;
+}
+
+// Writes file through temporary path and rename, but only when the
+// content differs from what's on disk, so the staleness checks keyed
+// off mtime don't trigger rebuilds on every run.
+static bool WriteIfChanged(const char *path, const char *data) {
+    long size = strlen(data);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        struct stat st;
+        bool same = false;
+        if (!fstat(fd, &st) && st.st_size == size) {
+            char *old = malloc(size);
+            same = read(fd, old, size) == size && !memcmp(old, data, size);
+            free(old);
+        }
+        close(fd);
+        if (same)
+            return true;
+    }
+    char tmp[PATH_MAX];
+    if (!CreateTempPath(path, tmp))
+        return false;
+    if ((fd = open(tmp, O_WRONLY | O_TRUNC | O_CLOEXEC)) == -1) {
+        perror(tmp);
+        unlink(tmp);
+        return false;
+    }
+    bool ok = write(fd, data, size) == size;
+    if (close(fd))
+        ok = false;
+    if (ok)
+        chmod(tmp, 0644);
+    if (ok && rename(tmp, path)) {
+        perror(path);
+        ok = false;
+    }
+    if (!ok)
+        unlink(tmp);
+    return ok;
+}
+
+// Returns path of compiled DSO inside shared cache directory.
+//
+// Cached artifacts are keyed by llamafile version, gpu
+// microarchitecture, and a fingerprint of the compiler binary, so a
+// single cache volume may be shared safely by heterogeneous machines
+// and multiple llamafile releases.
+static bool get_cached_dso_path(const char *name, const char *compiler, const char *archflag,
+                                char path[static PATH_MAX]) {
+    struct stat st;
+    if (!FLAG_dso_cache_dir)
+        return false;
+    if (stat(compiler, &st))
+        return false;
+    char arch[64];
+    int j = 0;
+    for (int i = 0; archflag[i] && j < (int)sizeof(arch) - 1; ++i)
+        if (isalnum(archflag[i]))
+            arch[j++] = archflag[i];
+    arch[j] = 0;
+    char key[256];
+    snprintf(key, sizeof(key), "/%s.%s.%s.%lx%lx.%s", name, LLAMAFILE_VERSION_STRING, arch,
+             (long)st.st_size, (long)st.st_mtim.tv_sec, GetDsoExtension());
+    strlcpy(path, FLAG_dso_cache_dir, PATH_MAX);
+    strlcat(path, key, PATH_MAX);
+    return true;
+}
+
+static bool fetch_cached_dso(const char *dso, const char *name, const char *compiler,
+                             const char *archflag) {
+    char cache[PATH_MAX];
+    if (FLAG_recompile)
+        return false;
+    if (!get_cached_dso_path(name, compiler, archflag, cache))
+        return false;
+    if (!FileExists(cache))
+        return false;
+    tinylog(__func__, ": note: fetching compiled ", name, " from ", cache, "\n", NULL);
+    return CopyFile(cache, dso);
+}
+
+static void store_cached_dso(const char *dso, const char *name, const char *compiler,
+                             const char *archflag) {
+    char cache[PATH_MAX];
+    if (!get_cached_dso_path(name, compiler, archflag, cache))
+        return;
+    tinylog(__func__, ": note: storing compiled ", name, " to ", cache, "\n", NULL);
+    CopyFile(dso, cache);
+}
+
 static bool get_rocm_bin_path(char path[static PATH_MAX], const char *bin) {
 
     // create filename of executable
@@ -744,6 +895,7 @@ static bool link_cuda_dso(const char *dso, const char *dir) {
     // ask the library if actual gpu devices exist
     if (ggml_cuda.link(ggml_backend_api())) {
         tinylog(__func__, ": GPU support loaded\n", NULL);
+        ggml_cuda.lib = lib;
         return true;
     } else {
         tinylog(__func__, ": No GPU devices found\n", NULL);
@@ -797,6 +949,45 @@ static bool import_cuda_impl(void) {
         }
     }
 
+    // extract auxiliary kernels registered by other packages, and
+    // generate a unity build file splicing them into the module
+    for (int i = 0; i < extra.count; ++i) {
+        llamafile_get_app_dir(src, sizeof(src));
+        strlcat(src, extra.srcs[i].name, sizeof(src));
+        switch (llamafile_is_file_newer_than(extra.srcs[i].zip, src)) {
+        case -1:
+            return false;
+        case false:
+            break;
+        case true:
+            needs_rebuild = true;
+            if (!llamafile_extract(extra.srcs[i].zip, src))
+                return false;
+            break;
+        default:
+            __builtin_unreachable();
+        }
+    }
+    if (extra.count) {
+        char unity[4096];
+        char *p = stpcpy(unity, "// generated by llamafile\n"
+                                "#define LLAMAFILE_GPU_MODULE 1\n"
+                                "#include \"ggml-cuda.cu\"\n");
+        for (int i = 0; i < extra.count; ++i)
+            if (extra.compiled[i])
+                p = stpcpy(stpcpy(stpcpy(p, "#include \""), extra.srcs[i].name), "\"\n");
+        llamafile_get_app_dir(src, sizeof(src));
+        strlcat(src, "ggml-unity.cu", sizeof(src));
+        if (!WriteIfChanged(src, unity))
+            return false;
+    }
+
+    // auxiliary kernels get their own artifact names, so a whisperfile
+    // and a llamafile may share a single dso cache volume
+    char rocm_name[96], cuda_name[96];
+    snprintf(rocm_name, sizeof(rocm_name), "ggml-rocm%s", extra.suffix);
+    snprintf(cuda_name, sizeof(cuda_name), "ggml-cuda%s", extra.suffix);
+
     char dso[PATH_MAX];
     char bindir[PATH_MAX];
     const char *compiler_path = NULL;
@@ -831,10 +1022,11 @@ static bool import_cuda_impl(void) {
 
         // Get path of GGML DSO for AMD.
         llamafile_get_app_dir(dso, PATH_MAX);
-        strlcat(dso, "ggml-rocm.", PATH_MAX);
+        strlcat(dso, rocm_name, PATH_MAX);
+        strlcat(dso, ".", PATH_MAX);
         strlcat(dso, GetDsoExtension(), PATH_MAX);
         if (FLAG_nocompile || !FLAG_recompile) {
-            if ((FileExists(dso) || extract_cuda_dso(dso, "ggml-rocm")) &&
+            if ((FileExists(dso) || extract_cuda_dso(dso, rocm_name)) &&
                 link_cuda_dso(dso, library_path)) {
                 ggml_cuda.has_amd_gpu = true;
                 return true;
@@ -862,9 +1054,25 @@ static bool import_cuda_impl(void) {
             }
         }
 
+        // Try fetching compiled DSO from shared cache.
+        char amd_arch[64];
+        bool has_amd_arch = false;
+        if (FLAG_dso_cache_dir && compiler_path)
+            has_amd_arch = get_amd_offload_arch_flag(amd_arch);
+        if (has_amd_arch && fetch_cached_dso(dso, rocm_name, compiler_path, amd_arch)) {
+            if (link_cuda_dso(dso, library_path)) {
+                ggml_cuda.has_amd_gpu = true;
+                return true;
+            } else {
+                goto TryNvidia;
+            }
+        }
+
         // Try building CUDA with ROCm SDK.
         if (compiler_path) {
             if (compile_amd(compiler_path, dso, src)) {
+                if (has_amd_arch)
+                    store_cached_dso(dso, rocm_name, compiler_path, amd_arch);
                 if (link_cuda_dso(dso, library_path)) {
                     ggml_cuda.has_amd_gpu = true;
                     return true;
@@ -880,7 +1088,7 @@ static bool import_cuda_impl(void) {
         }
 
         // Try extracting prebuilt tinyBLAS DSO from PKZIP.
-        if (extract_cuda_dso(dso, "ggml-rocm")) {
+        if (extract_cuda_dso(dso, rocm_name)) {
             if (link_cuda_dso(dso, library_path)) {
                 ggml_cuda.has_amd_gpu = true;
                 return true;
@@ -914,10 +1122,11 @@ TryNvidia:
 
         // Get path of GGML DSO for NVIDIA.
         llamafile_get_app_dir(dso, PATH_MAX);
-        strlcat(dso, "ggml-cuda.", PATH_MAX);
+        strlcat(dso, cuda_name, PATH_MAX);
+        strlcat(dso, ".", PATH_MAX);
         strlcat(dso, GetDsoExtension(), PATH_MAX);
         if (FLAG_nocompile || !FLAG_recompile) {
-            if ((FileExists(dso) || extract_cuda_dso(dso, "ggml-cuda")) &&
+            if ((FileExists(dso) || extract_cuda_dso(dso, cuda_name)) &&
                 link_cuda_dso(dso, library_path)) {
                 return true;
             } else if (FLAG_nocompile) {
@@ -939,13 +1148,23 @@ TryNvidia:
             }
         }
 
+        // Try fetching compiled DSO from shared cache.
+        char nvidia_arch[32];
+        bool has_nvidia_arch = false;
+        if (FLAG_dso_cache_dir && compiler_path)
+            has_nvidia_arch = get_nvcc_arch_flag(compiler_path, nvidia_arch);
+        if (has_nvidia_arch && fetch_cached_dso(dso, cuda_name, compiler_path, nvidia_arch))
+            return link_cuda_dso(dso, library_path);
+
         // Try building CUDA from source with mighty cuBLAS.
         if (compiler_path && compile_nvidia(compiler_path, dso, src)) {
+            if (has_nvidia_arch)
+                store_cached_dso(dso, cuda_name, compiler_path, nvidia_arch);
             return link_cuda_dso(dso, library_path);
         }
 
         // Try extracting prebuilt tinyBLAS DSO from PKZIP.
-        if (extract_cuda_dso(dso, "ggml-cuda"))
+        if (extract_cuda_dso(dso, cuda_name))
             return link_cuda_dso(dso, library_path);
 
         break;
@@ -980,6 +1199,55 @@ bool llamafile_has_amd_gpu(void) {
     return ggml_cuda.has_amd_gpu;
 }
 
+static void register_extra_source(const char *zip, const char *name, bool compile) {
+    if (atomic_load_explicit(&ggml_cuda.once, memory_order_relaxed)) {
+        tinylog(__func__, ": warning: gpu module already loaded; ignoring ", name, "\n", NULL);
+        return;
+    }
+    if (extra.count == MAX_EXTRA_SOURCES) {
+        tinylog(__func__, ": warning: too many extra gpu sources; ignoring ", name, "\n", NULL);
+        return;
+    }
+    extra.srcs[extra.count].zip = zip;
+    extra.srcs[extra.count].name = name;
+    extra.compiled[extra.count] = compile;
+    ++extra.count;
+    if (compile) {
+        // compiled sources become part of the artifact name, so a
+        // module with whisper kernels never collides with one without
+        strlcat(extra.suffix, "+", sizeof(extra.suffix));
+        size_t n = strlen(extra.suffix);
+        for (const char *p = name; *p && *p != '.' && n + 1 < sizeof(extra.suffix); ++p)
+            extra.suffix[n++] = *p;
+        extra.suffix[n] = 0;
+    }
+}
+
+// Registers an additional translation unit to be compiled into the
+// dynamically loaded gpu module, alongside ggml-cuda, so its kernels
+// share the compile cache and the cuda context. `zip` is the bundled
+// asset path and `name` is its filename in the build directory. This
+// must be called before the first gpu function is used.
+void llamafile_cuda_register_source(const char *zip, const char *name) {
+    register_extra_source(zip, name, true);
+}
+
+// Registers a file that gets extracted next to the gpu module sources
+// without being compiled directly, i.e. headers the translation units
+// registered with llamafile_cuda_register_source() #include.
+void llamafile_cuda_register_header(const char *zip, const char *name) {
+    register_extra_source(zip, name, false);
+}
+
+// Resolves a symbol exported by the loaded gpu module, for importing
+// the entry points of kernels registered by other packages. Returns
+// NULL if gpu support is unavailable or the symbol doesn't exist.
+void *llamafile_cuda_dlsym(const char *sym) {
+    if (!llamafile_has_cuda())
+        return NULL;
+    return cosmo_dlsym(ggml_cuda.lib, sym);
+}
+
 GGML_CALL ggml_backend_buffer_type_t ggml_backend_cuda_buffer_type(int device) {
     if (!llamafile_has_cuda())
         return 0;
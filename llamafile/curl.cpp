@@ -25,13 +25,18 @@
 #include "third_party/mbedtls/net_sockets.h"
 #include "third_party/mbedtls/ssl.h"
 #include "third_party/mbedtls/x509.h"
+#include <atomic>
 #include <cosmo.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <net/http/http.h>
 #include <net/http/url.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,7 +61,7 @@ static const char *prog;
 static const char *outpath;
 
 static wontreturn void PrintUsage(int fd, int rc) {
-    tinyprint(fd, "usage: ", prog, " [-iksvV] URL\n", NULL);
+    tinyprint(fd, "usage: ", prog, " [-iksvV] [-P N] [-o FILE] URL [MIRROR...]\n", NULL);
     exit(rc);
 }
 
@@ -138,6 +143,493 @@ static int TlsRecv(void *c, unsigned char *p, size_t n, uint32_t o) {
     return MIN(n, r);
 }
 
+/*
+ * Parallel range download engine.
+ *
+ * Big GGUF pulls are dominated by the throughput cap of a single TCP
+ * stream, so when -P N and -o are given the file is split into N
+ * contiguous parts fetched over N connections with Range requests.
+ * Every part remembers its high water mark in a sidecar file beside
+ * the download, so an interrupted pull resumes where each connection
+ * left off. Extra URL arguments act as mirrors: parts start spread
+ * across them and rotate to the next one when a fetch fails.
+ */
+
+#define MAX_PARTS 64
+#define MAX_ORIGINS 8
+#define RESUME_MAGIC 0x314c44464c /* "LFDL1" */
+
+struct Origin {
+    const char *host;
+    const char *port;
+    bool usessl;
+    struct Url url;
+    // last negotiated tls session, shared across part threads so
+    // reconnects and mirror rotation get abbreviated handshakes
+    pthread_mutex_t lock;
+    mbedtls_ssl_session session;
+    bool resumable;
+};
+
+struct Conn {
+    int fd;
+    bool usessl;
+    mbedtls_ssl_context ssl;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_ssl_config conf;
+};
+
+struct Part {
+    int index;
+    long lo;   // absolute offset of first byte
+    long hi;   // absolute offset past last byte
+    long done; // bytes fetched and written so far
+};
+
+struct Resume {
+    uint64_t magic;
+    uint64_t length;
+    uint64_t nparts;
+    uint64_t done[MAX_PARTS];
+};
+
+static int g_partfd;
+static int g_resumefd;
+static int g_norigins;
+static int g_authmode;
+static int g_ciphersuite;
+static size_t g_nheaders;
+static char **g_headers;
+static const char *g_agent;
+static struct Part g_parts[MAX_PARTS];
+static struct Origin g_origins[MAX_ORIGINS];
+static std::atomic<bool> g_failed;
+
+// bio callbacks that report failure to mbedtls instead of exiting,
+// since a torn connection on one part is recoverable via a mirror
+static int ConnBioSend(void *c, const unsigned char *p, size_t n) {
+    int rc;
+    if ((rc = write(*(int *)c, p, n)) == -1) {
+        return MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+    return rc;
+}
+
+static int ConnBioRecv(void *c, unsigned char *p, size_t n, uint32_t o) {
+    int rc;
+    if ((rc = read(*(int *)c, p, n)) == -1) {
+        return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+    return rc;
+}
+
+static void ConnClose(struct Conn *conn) {
+    if (conn->usessl) {
+        mbedtls_ssl_free(&conn->ssl);
+        mbedtls_ctr_drbg_free(&conn->drbg);
+        mbedtls_ssl_config_free(&conn->conf);
+    }
+    close(conn->fd);
+}
+
+static bool ConnOpen(struct Conn *conn, struct Origin *origin) {
+    struct addrinfo *addr;
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_NUMERICSERV;
+    if (getaddrinfo(origin->host, origin->port, &hints, &addr) != 0) {
+        return false;
+    }
+    struct timeval tt = {-60};
+    if ((conn->fd = lf::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol, false,
+                               &tt)) == -1) {
+        freeaddrinfo(addr);
+        return false;
+    }
+    if (connect(conn->fd, addr->ai_addr, addr->ai_addrlen)) {
+        freeaddrinfo(addr);
+        close(conn->fd);
+        return false;
+    }
+    freeaddrinfo(addr);
+    conn->usessl = origin->usessl;
+    if (conn->usessl) {
+        mbedtls_ssl_init(&conn->ssl);
+        mbedtls_ctr_drbg_init(&conn->drbg);
+        mbedtls_ssl_config_init(&conn->conf);
+        unassert(!mbedtls_ctr_drbg_seed(&conn->drbg, GetSslEntropy, 0, "justine", 7));
+        unassert(!mbedtls_ssl_config_defaults(&conn->conf, MBEDTLS_SSL_IS_CLIENT,
+                                              MBEDTLS_SSL_TRANSPORT_STREAM, g_ciphersuite));
+        mbedtls_ssl_conf_authmode(&conn->conf, g_authmode);
+        mbedtls_ssl_conf_ca_chain(&conn->conf, lf::sslroots(), 0);
+        mbedtls_ssl_conf_rng(&conn->conf, mbedtls_ctr_drbg_random, &conn->drbg);
+        mbedtls_ssl_conf_session_tickets(&conn->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+        unassert(!mbedtls_ssl_setup(&conn->ssl, &conn->conf));
+        unassert(!mbedtls_ssl_set_hostname(&conn->ssl, origin->host));
+        mbedtls_ssl_set_bio(&conn->ssl, &conn->fd, ConnBioSend, 0, ConnBioRecv);
+        pthread_mutex_lock(&origin->lock);
+        if (origin->resumable) {
+            mbedtls_ssl_set_session(&conn->ssl, &origin->session);
+        }
+        pthread_mutex_unlock(&origin->lock);
+        if (mbedtls_ssl_handshake(&conn->ssl)) {
+            ConnClose(conn);
+            return false;
+        }
+        // remember the negotiated session (or the ticket it carried)
+        // so the next connection to this origin skips the full
+        // handshake, which adds up across 64 parts and retries
+        pthread_mutex_lock(&origin->lock);
+        if (origin->resumable) {
+            mbedtls_ssl_session_free(&origin->session);
+            mbedtls_ssl_session_init(&origin->session);
+            origin->resumable = false;
+        }
+        if (!mbedtls_ssl_get_session(&conn->ssl, &origin->session)) {
+            origin->resumable = true;
+        }
+        pthread_mutex_unlock(&origin->lock);
+    }
+    return true;
+}
+
+static bool ConnSend(struct Conn *conn, const char *data, size_t size) {
+    ssize_t rc;
+    for (size_t i = 0; i < size; i += rc) {
+        if (conn->usessl) {
+            rc = mbedtls_ssl_write(&conn->ssl, (const unsigned char *)data + i, size - i);
+        } else {
+            rc = write(conn->fd, data + i, size - i);
+        }
+        if (rc <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static ssize_t ConnRecv(struct Conn *conn, char *data, size_t size) {
+    ssize_t rc;
+    if (conn->usessl) {
+        if ((rc = mbedtls_ssl_read(&conn->ssl, (unsigned char *)data, size)) < 0) {
+            if (rc == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+                return 0;
+            }
+            return -1;
+        }
+        return rc;
+    }
+    return read(conn->fd, data, size);
+}
+
+// parses the scheme/host/port out of a mirror argument the same way
+// main() does for the primary url. allocations deliberately leak
+// since origins live for the whole process
+static bool ParseOrigin(const char *urlarg, struct Origin *origin) {
+    struct Url url;
+    ParseUrl(urlarg, -1, &url, kUrlPlus);
+    bool usessl = false;
+    if (url.scheme.n) {
+        if (url.scheme.n == 5 && !memcasecmp(url.scheme.p, "https", 5)) {
+            usessl = true;
+        } else if (!(url.scheme.n == 4 && !memcasecmp(url.scheme.p, "http", 4))) {
+            return false;
+        }
+    }
+    if (url.host.n) {
+        origin->host = strndup(url.host.p, url.host.n);
+        if (url.port.n) {
+            origin->port = strndup(url.port.p, url.port.n);
+        } else {
+            origin->port = (usessl ? "443" : "80");
+        }
+    } else {
+        origin->host = "127.0.0.1";
+        origin->port = (usessl ? "443" : "80");
+    }
+    if (!IsAcceptableHost(origin->host, -1)) {
+        return false;
+    }
+    url.fragment.p = 0, url.fragment.n = 0;
+    url.scheme.p = 0, url.scheme.n = 0;
+    url.user.p = 0, url.user.n = 0;
+    url.pass.p = 0, url.pass.n = 0;
+    url.host.p = 0, url.host.n = 0;
+    url.port.p = 0, url.port.n = 0;
+    if (!url.path.n || url.path.p[0] != '/') {
+        char *p = (char *)malloc(1 + url.path.n);
+        mempcpy(mempcpy(p, "/", 1), url.path.p, url.path.n);
+        url.path.p = p;
+        ++url.path.n;
+    }
+    origin->usessl = usessl;
+    origin->url = url;
+    pthread_mutex_init(&origin->lock, 0);
+    mbedtls_ssl_session_init(&origin->session);
+    origin->resumable = false;
+    return true;
+}
+
+static std::string BuildRangeRequest(struct Origin *origin, long lo, long hi) {
+    std::string request;
+    request += lf::format("GET %s HTTP/1.1\r\n"
+                          "Connection: close\r\n"
+                          "User-Agent: %s\r\n"
+                          "Range: bytes=%ld-%ld\r\n",
+                          EncodeUrl(&origin->url, 0), g_agent, lo, hi - 1);
+    bool senthost = false;
+    for (size_t i = 0; i < g_nheaders; ++i) {
+        request += g_headers[i];
+        request += "\r\n";
+        if (!strncasecmp("Host:", g_headers[i], 5)) {
+            senthost = true;
+        }
+    }
+    if (!senthost) {
+        request += "Host: ";
+        request += origin->host;
+        request += ':';
+        request += origin->port;
+        request += "\r\n";
+    }
+    request += "\r\n";
+    return request;
+}
+
+// reads from conn until the response header block parses. body bytes
+// received past the header stay in *bufp after *hdrlenp
+static bool ReadResponseHeaders(struct Conn *conn, struct HttpMessage *msg, char **bufp,
+                                size_t *gotp, size_t *hdrlenp) {
+    char *p = 0;
+    ssize_t rc;
+    size_t i = 0, n = 0;
+    for (;;) {
+        if (i == n) {
+            n += 1000;
+            n += n >> 1;
+            p = (char *)realloc(p, n);
+        }
+        if ((rc = ConnRecv(conn, p + i, n - i)) <= 0) {
+            free(p);
+            return false;
+        }
+        i += rc;
+        if ((rc = ParseHttpMessage(msg, p, i, n)) == -1) {
+            free(p);
+            return false;
+        }
+        if (rc) {
+            *bufp = p;
+            *gotp = i;
+            *hdrlenp = rc;
+            return true;
+        }
+    }
+}
+
+// parses the total length out of e.g. "bytes 0-0/43026083840"
+static long ParseContentRangeTotal(const char *data, size_t size) {
+    const char *slash = (const char *)memchr(data, '/', size);
+    if (!slash) {
+        return -1;
+    }
+    long total = 0;
+    for (const char *q = slash + 1; q < data + size; ++q) {
+        if (*q < '0' || *q > '9') {
+            return -1;
+        }
+        total = total * 10 + (*q - '0');
+    }
+    return total > 0 ? total : -1;
+}
+
+// asks a one byte range of each origin in turn until one proves it
+// honors Range requests, returning the total file length, or -1
+static long ProbeRangeSupport(void) {
+    for (int i = 0; i < g_norigins; ++i) {
+        struct Origin *origin = &g_origins[i];
+        struct Conn conn;
+        if (!ConnOpen(&conn, origin)) {
+            continue;
+        }
+        long total = -1;
+        char *p = 0;
+        size_t got, hdrlen;
+        struct HttpMessage msg;
+        InitHttpMessage(&msg, kHttpResponse);
+        std::string request = BuildRangeRequest(origin, 0, 1);
+        if (ConnSend(&conn, request.data(), request.size()) &&
+            ReadResponseHeaders(&conn, &msg, &p, &got, &hdrlen) && msg.status == 206 &&
+            HasHeader(kHttpContentRange)) {
+            total = ParseContentRangeTotal(HeaderData(kHttpContentRange),
+                                           HeaderLength(kHttpContentRange));
+        }
+        free(p);
+        DestroyHttpMessage(&msg);
+        ConnClose(&conn);
+        if (total > 0) {
+            return total;
+        }
+    }
+    return -1;
+}
+
+// writes fetched bytes at their absolute offset then records the new
+// high water mark in the sidecar, so an interrupted pull resumes from
+// wherever each part left off rather than starting over
+static void CommitPart(struct Part *part, const char *data, size_t size) {
+    if (!size) {
+        return;
+    }
+    ssize_t rc;
+    long offset = part->lo + part->done;
+    for (size_t i = 0; i < size; i += rc) {
+        rc = pwrite(g_partfd, data + i, size - i, offset + i);
+        if (rc <= 0) {
+            perror(outpath);
+            exit(1);
+        }
+    }
+    part->done += size;
+    uint64_t done = part->done;
+    pwrite(g_resumefd, &done, sizeof(done),
+           offsetof(struct Resume, done) + part->index * sizeof(done));
+}
+
+static bool FetchRange(struct Origin *origin, struct Part *part) {
+    long lo = part->lo + part->done;
+    if (lo >= part->hi) {
+        return true;
+    }
+    struct Conn conn;
+    if (!ConnOpen(&conn, origin)) {
+        return false;
+    }
+    std::string request = BuildRangeRequest(origin, lo, part->hi);
+    if (!ConnSend(&conn, request.data(), request.size())) {
+        ConnClose(&conn);
+        return false;
+    }
+    char *p;
+    size_t got, hdrlen;
+    struct HttpMessage msg;
+    InitHttpMessage(&msg, kHttpResponse);
+    if (!ReadResponseHeaders(&conn, &msg, &p, &got, &hdrlen)) {
+        DestroyHttpMessage(&msg);
+        ConnClose(&conn);
+        return false;
+    }
+    bool ok = false;
+    if (msg.status == 206) {
+        long want = part->hi - lo;
+        long have = got - hdrlen;
+        if (have > want) {
+            have = want;
+        }
+        CommitPart(part, p + hdrlen, have);
+        long received = have;
+        char buf[32768];
+        while (received < want) {
+            ssize_t rc = ConnRecv(&conn, buf, MIN((long)sizeof(buf), want - received));
+            if (rc <= 0) {
+                break;
+            }
+            CommitPart(part, buf, rc);
+            received += rc;
+        }
+        ok = received == want;
+    }
+    free(p);
+    DestroyHttpMessage(&msg);
+    ConnClose(&conn);
+    return ok;
+}
+
+// each part starts on a different mirror so a slow origin only holds
+// back the connections that landed on it, and a failed fetch rotates
+// to the next mirror keeping whatever bytes were already committed
+static void *DownloadPartThread(void *arg) {
+    struct Part *part = (struct Part *)arg;
+    int attempts = MAX(2, g_norigins * 2);
+    for (int attempt = 0; attempt < attempts; ++attempt) {
+        struct Origin *origin = &g_origins[(part->index + attempt) % g_norigins];
+        if (FetchRange(origin, part)) {
+            return 0;
+        }
+        usleep(500000);
+    }
+    g_failed = true;
+    return 0;
+}
+
+static int DownloadInParallel(int nparts) {
+    long length = ProbeRangeSupport();
+    if (length <= 0) {
+        return -1;
+    }
+
+    // tiny parts just pay connection setup over and over
+    while (nparts > 1 && length / nparts < 4 * 1048576) {
+        --nparts;
+    }
+    if (nparts < 2) {
+        return -1;
+    }
+    long chunk = (length + nparts - 1) / nparts;
+
+    if ((g_partfd = open(outpath, O_RDWR | O_CREAT, 0644)) == -1) {
+        perror(outpath);
+        exit(1);
+    }
+    if (ftruncate(g_partfd, length)) {
+        perror(outpath);
+        exit(1);
+    }
+
+    std::string resumepath = std::string(outpath) + ".resume";
+    if ((g_resumefd = open(resumepath.c_str(), O_RDWR | O_CREAT, 0644)) == -1) {
+        perror(resumepath.c_str());
+        exit(1);
+    }
+    struct Resume resume = {};
+    if (pread(g_resumefd, &resume, sizeof(resume), 0) != sizeof(resume) ||
+        resume.magic != RESUME_MAGIC || resume.length != (uint64_t)length ||
+        resume.nparts != (uint64_t)nparts) {
+        memset(&resume, 0, sizeof(resume));
+        resume.magic = RESUME_MAGIC;
+        resume.length = length;
+        resume.nparts = nparts;
+        pwrite(g_resumefd, &resume, sizeof(resume), 0);
+    }
+
+    pthread_t th[MAX_PARTS];
+    for (int i = 0; i < nparts; ++i) {
+        g_parts[i].index = i;
+        g_parts[i].lo = i * chunk;
+        g_parts[i].hi = MIN(length, (i + 1) * chunk);
+        g_parts[i].done = MIN((long)resume.done[i], g_parts[i].hi - g_parts[i].lo);
+        pthread_create(&th[i], 0, DownloadPartThread, &g_parts[i]);
+    }
+    for (int i = 0; i < nparts; ++i) {
+        pthread_join(th[i], 0);
+    }
+
+    if (g_failed) {
+        tinyprint(2, prog, ": download failed; progress saved in ", resumepath.c_str(), "\n",
+                  NULL);
+        exit(1);
+    }
+    if (close(g_partfd)) {
+        perror(outpath);
+        exit(1);
+    }
+    close(g_resumefd);
+    unlink(resumepath.c_str());
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
 
     if (!NoDebug()) {
@@ -158,16 +650,21 @@ int main(int argc, char *argv[]) {
         char **p;
     } headers = {0};
     uint64_t method = 0;
+    int nparallel = 1;
     int authmode = MBEDTLS_SSL_VERIFY_REQUIRED;
     int ciphersuite = MBEDTLS_SSL_PRESET_SUITEC;
     bool includeheaders = false;
     const char *postdata = NULL;
     const char *agent = "hurl/1.o (https://github.com/jart/cosmopolitan)";
-    while ((opt = getopt(argc, argv, "qiksvBVIX:H:A:d:o:")) != -1) {
+    while ((opt = getopt(argc, argv, "qiksvBVIX:H:A:d:o:P:")) != -1) {
         switch (opt) {
         case 's':
         case 'q':
             break;
+        case 'P':
+            nparallel = atoi(optarg);
+            nparallel = MAX(1, MIN(MAX_PARTS, nparallel));
+            break;
         case 'o':
             outpath = optarg;
             break;
@@ -219,6 +716,33 @@ int main(int argc, char *argv[]) {
     }
     urlarg = argv[optind];
 
+    /*
+     * Download with parallel range requests when asked for.
+     */
+    if (nparallel > 1 && !method && !postdata) {
+        if (!outpath) {
+            tinyprint(2, prog, ": note: -P needs -o; using single stream\n", NULL);
+        } else {
+            g_agent = agent;
+            g_headers = headers.p;
+            g_nheaders = headers.n;
+            g_authmode = authmode;
+            g_ciphersuite = ciphersuite;
+            for (int i = optind; i < argc && g_norigins < MAX_ORIGINS; ++i) {
+                if (!ParseOrigin(argv[i], &g_origins[g_norigins])) {
+                    tinyprint(2, prog, ": bad mirror url: ", argv[i], "\n", NULL);
+                    exit(1);
+                }
+                ++g_norigins;
+            }
+            if (!DownloadInParallel(nparallel)) {
+                return 0;
+            }
+            tinyprint(2, prog, ": note: range requests unsupported; using single stream\n",
+                      NULL);
+        }
+    }
+
     /*
      * Parse URL.
      */
@@ -17,6 +17,7 @@
 
 #include "datauri.h"
 #include "llama.cpp/base64.h"
+#include "llamafile/b64.h"
 #include "llamafile/string.h"
 #include <cctype>
 
@@ -267,8 +268,12 @@ size_t DataUri::parse(std::string_view s) {
 }
 
 std::string DataUri::decode() {
-    if (has_param("base64"))
-        return base64::decode(data);
+    if (has_param("base64")) {
+        std::string res;
+        if (!lf::base64_decode(data, &res))
+            throw base64_error("invalid character");
+        return res;
+    }
     return percent_decode(data);
 }
 
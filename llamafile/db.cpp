@@ -16,21 +16,84 @@
 // limitations under the License.
 
 #include "db.h"
+#include "llama.cpp/cores.h"
 #include "llamafile/json.h"
 #include "llamafile/llamafile.h"
+#include "llamafile/threadlocal.h"
 #include "third_party/sqlite/sqlite3.h"
+#include <algorithm>
+#include <atomic>
+#include <cosmo.h>
+#include <map>
 #include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 __static_yoink("llamafile/schema.sql");
 
 #define SCHEMA_VERSION 1
+#define CHECKPOINT_INTERVAL_MS 5000
+#define MAX_QUEUED_WRITES 256
 
 namespace lf {
 namespace db {
 
+// each thread keeps its connection and prepared statements alive
+// across requests, since opening the database file and compiling sql
+// on every http request costs more than the queries themselves. the
+// destructor runs when the thread exits or gets canceled.
+struct Conn {
+    sqlite3 *db = nullptr;
+    std::map<std::string, sqlite3_stmt *> stmts;
+};
+
+static void conn_destroy(Conn *conn) {
+    for (const auto &kv : conn->stmts)
+        sqlite3_finalize(kv.second);
+    sqlite3_close(conn->db);
+    delete conn;
+}
+
+static ThreadLocal<Conn> g_conn(conn_destroy);
+
+// a write that doesn't need to hand a result back to its client gets
+// recorded here and drained by the writer thread, so the request
+// thread never waits on sqlite. the queue is bounded: a producer that
+// finds it full blocks until the writer catches up, which is the only
+// backpressure there is.
+struct WriteJob {
+    enum Kind { ADD_MESSAGE, SET_EMBEDDING } kind;
+    int64_t id;
+    std::string role;
+    std::string content;
+    std::string model;
+    std::string blob;
+    double temperature;
+    double top_p;
+    double presence_penalty;
+    double frequency_penalty;
+    WriteJob *next;
+};
+
+static std::atomic_bool g_opened;
+static pthread_t g_writer;
+static bool g_writer_running;
+static bool g_shutting_down;
+static pthread_mutex_t g_write_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_write_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_drain_cond = PTHREAD_COND_INITIALIZER;
+static WriteJob *g_write_head;
+static WriteJob *g_write_tail;
+static int g_write_count;
+
+static void run_write_jobs(sqlite3 *, WriteJob *);
+static bool set_embedding_impl(sqlite3 *, int64_t, const std::string &, const std::string &);
+
 static bool table_exists(sqlite3 *db, const char *table_name) {
     const char *query = "SELECT name FROM sqlite_master WHERE type='table' AND name=?;";
     sqlite3_stmt *stmt;
@@ -67,7 +130,7 @@ static bool init_schema(sqlite3 *db) {
     return true;
 }
 
-static sqlite3 *open_impl() {
+static std::string db_path() {
     std::string path;
     if (FLAG_db) {
         path = FLAG_db;
@@ -79,6 +142,18 @@ static sqlite3 *open_impl() {
             path = "llamafile.sqlite3";
         }
     }
+    return path;
+}
+
+// returns true if the database file exists on disk, without creating
+// it. background maintenance checks this so an installation that
+// never stored a chat never grows a database file.
+bool exists() {
+    return !access(db_path().c_str(), F_OK);
+}
+
+static sqlite3 *open_impl() {
+    std::string path = db_path();
     sqlite3 *db;
     int rc = sqlite3_open(path.c_str(), &db);
     if (rc) {
@@ -93,45 +168,177 @@ static sqlite3 *open_impl() {
         sqlite3_close(db);
         return nullptr;
     }
+    // wal mode turns each insert's commit into a log append that
+    // doesn't fsync. the writer thread folds the log back into the
+    // main database periodically, so the fsync cost is paid once per
+    // batch of messages rather than once per message. inline
+    // checkpointing gets disabled so no request ever stalls on it.
+    std::string pragmas = "PRAGMA journal_mode=WAL;"
+                          "PRAGMA synchronous=NORMAL;";
+    if (g_writer_running)
+        pragmas += "PRAGMA wal_autocheckpoint=0;";
+    if (sqlite3_exec(db, pragmas.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
+        fprintf(stderr, "%s: failed to enable wal mode: %s\n", path.c_str(), sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return nullptr;
+    }
     if (!table_exists(db, "metadata") && !init_schema(db)) {
         fprintf(stderr, "%s: failed to initialize database schema\n", path.c_str());
         sqlite3_close(db);
         return nullptr;
     }
+    // databases created before the schema gained this index get it
+    // retrofitted here; it's a no-op on fresh ones
+    sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS messages_by_chat ON messages (chat_id);", nullptr,
+                 nullptr, nullptr);
+    sqlite3_exec(db,
+                 "CREATE TABLE IF NOT EXISTS embeddings (message_id INTEGER PRIMARY KEY, "
+                 "model TEXT, embedding BLOB, FOREIGN KEY (message_id) REFERENCES messages(id));",
+                 nullptr, nullptr, nullptr);
     return db;
 }
 
+static sqlite3 *open_cached() {
+    Conn *conn;
+    if (!(conn = g_conn.get())) {
+        conn = new Conn;
+        g_conn.set(conn);
+    }
+    if (!conn->db)
+        conn->db = open_impl();
+    return conn->db;
+}
+
+// returns a compiled statement owned by the calling thread
+//
+// the statement cache lives alongside the connection, so the second
+// time a thread runs the same query it skips sqlite3_prepare_v2()
+// entirely. callers reset the statement when they're done stepping
+// and must not finalize it.
+static sqlite3_stmt *prepare(sqlite3 *db, const char *query) {
+    Conn *conn = g_conn.get();
+    if (!conn)
+        return nullptr;
+    auto it = conn->stmts.find(query);
+    if (it != conn->stmts.end()) {
+        sqlite3_reset(it->second);
+        sqlite3_clear_bindings(it->second);
+        return it->second;
+    }
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+        return nullptr;
+    conn->stmts[query] = stmt;
+    return stmt;
+}
+
+// drains queued writes and folds the wal back into the main database.
+// the thread keeps its own connection through the same thread local
+// cache the request threads use, so conn_destroy() closes it when the
+// thread goes away. a full queue drains in one transaction so the
+// commit bookkeeping is paid once per batch rather than once per row.
+static void *writer_thread(void *arg) {
+    sigset_t mask;
+    sigfillset(&mask);
+    sigdelset(&mask, SIGSEGV);
+    sigdelset(&mask, SIGBUS);
+    sigdelset(&mask, SIGFPE);
+    sigdelset(&mask, SIGILL);
+    pthread_sigmask(SIG_SETMASK, &mask, 0);
+    pthread_setname_np(pthread_self(), "dbwriter");
+    // database writes aren't latency sensitive, so on hybrid parts this
+    // thread is banished to the efficiency cores where it can't steal
+    // cycles from the inference thread team
+    if (!FLAG_ecores) {
+        cpu_set_t ecores;
+        if (cpu_get_efficiency_affinity(&ecores) > 0)
+            pthread_setaffinity_np(pthread_self(), sizeof(ecores), &ecores);
+    }
+    sqlite3 *db = nullptr;
+    timespec next_checkpoint =
+        timespec_add(timespec_real(), timespec_frommillis(CHECKPOINT_INTERVAL_MS));
+    pthread_mutex_lock(&g_write_lock);
+    for (;;) {
+        if (!g_write_head && !g_shutting_down)
+            pthread_cond_timedwait(&g_write_cond, &g_write_lock, &next_checkpoint);
+        WriteJob *jobs = g_write_head;
+        bool quitting = g_shutting_down && !jobs;
+        g_write_head = nullptr;
+        g_write_tail = nullptr;
+        g_write_count = 0;
+        if (jobs)
+            pthread_cond_broadcast(&g_drain_cond);
+        pthread_mutex_unlock(&g_write_lock);
+        if (quitting)
+            break;
+        // don't create the database file before anything got stored
+        if (!db && (jobs || g_opened.load(std::memory_order_acquire)))
+            db = open_cached();
+        if (jobs)
+            run_write_jobs(db, jobs);
+        if (db && timespec_cmp(timespec_real(), next_checkpoint) >= 0) {
+            sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
+            next_checkpoint =
+                timespec_add(timespec_real(), timespec_frommillis(CHECKPOINT_INTERVAL_MS));
+        }
+        pthread_mutex_lock(&g_write_lock);
+    }
+    if (db)
+        sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+    return nullptr;
+}
+
+void init() {
+    g_writer_running = true;
+    if (pthread_create(&g_writer, 0, writer_thread, 0))
+        g_writer_running = false;
+}
+
+// joining the writer flushes whatever's still queued: the thread only
+// exits once it observes the shutdown flag with an empty queue, so the
+// orderly teardown that follows a termination signal loses no writes.
+void destroy() {
+    if (!g_writer_running)
+        return;
+    pthread_mutex_lock(&g_write_lock);
+    g_shutting_down = true;
+    pthread_cond_signal(&g_write_cond);
+    pthread_mutex_unlock(&g_write_lock);
+    pthread_join(g_writer, 0);
+    g_writer_running = false;
+}
+
 sqlite3 *open() {
     int cs;
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cs);
-    sqlite3 *res = open_impl();
+    sqlite3 *res = open_cached();
+    if (res)
+        g_opened.store(true, std::memory_order_release);
     pthread_setcancelstate(cs, 0);
     return res;
 }
 
-void close(sqlite3 *db) {
-    int cs;
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cs);
-    sqlite3_close(db);
-    pthread_setcancelstate(cs, 0);
+void close(sqlite3 *) {
+    // connections stay open so the owning thread can reuse them. the
+    // real close happens in conn_destroy() when the thread goes away.
 }
 
 static int64_t add_chat_impl(sqlite3 *db, const std::string &model, const std::string &title) {
     const char *query = "INSERT INTO chats (model, title) VALUES (?, ?);";
-    sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
         return -1;
     }
     if (sqlite3_bind_text(stmt, 1, model.data(), model.size(), SQLITE_STATIC) != SQLITE_OK ||
         sqlite3_bind_text(stmt, 2, title.data(), title.size(), SQLITE_STATIC) != SQLITE_OK) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         return -1;
     }
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         return -1;
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return sqlite3_last_insert_rowid(db);
 }
 
@@ -149,8 +356,8 @@ static int64_t add_message_impl(sqlite3 *db, int64_t chat_id, const std::string
     const char *query = "INSERT INTO messages (chat_id, role, content, temperature, "
                         "top_p, presence_penalty, frequency_penalty) "
                         "VALUES (?, ?, ?, ?, ?, ?, ?);";
-    sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
         return -1;
     }
     if (sqlite3_bind_int64(stmt, 1, chat_id) != SQLITE_OK ||
@@ -160,14 +367,14 @@ static int64_t add_message_impl(sqlite3 *db, int64_t chat_id, const std::string
         sqlite3_bind_double(stmt, 5, top_p) != SQLITE_OK ||
         sqlite3_bind_double(stmt, 6, presence_penalty) != SQLITE_OK ||
         sqlite3_bind_double(stmt, 7, frequency_penalty) != SQLITE_OK) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         return -1;
     }
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         return -1;
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return sqlite3_last_insert_rowid(db);
 }
 
@@ -182,19 +389,94 @@ int64_t add_message(sqlite3 *db, int64_t chat_id, const std::string &role,
     return res;
 }
 
+static void run_write_jobs(sqlite3 *db, WriteJob *jobs) {
+    bool batch = db && jobs->next;
+    if (batch)
+        sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+    while (jobs) {
+        WriteJob *job = jobs;
+        jobs = job->next;
+        if (db) {
+            switch (job->kind) {
+            case WriteJob::ADD_MESSAGE:
+                if (add_message_impl(db, job->id, job->role, job->content, job->temperature,
+                                     job->top_p, job->presence_penalty,
+                                     job->frequency_penalty) == -1)
+                    fprintf(stderr, "warning: failed to persist chat message\n");
+                break;
+            case WriteJob::SET_EMBEDDING:
+                if (!set_embedding_impl(db, job->id, job->model, job->blob))
+                    fprintf(stderr, "warning: failed to persist message embedding\n");
+                break;
+            default:
+                __builtin_unreachable();
+            }
+        }
+        delete job;
+    }
+    if (batch)
+        sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+}
+
+static void enqueue_write(WriteJob *job) {
+    job->next = nullptr;
+    pthread_mutex_lock(&g_write_lock);
+    if (!g_writer_running) {
+        // no writer thread came up; do the write inline like before
+        pthread_mutex_unlock(&g_write_lock);
+        if (sqlite3 *db = open()) {
+            run_write_jobs(db, job);
+            close(db);
+        } else {
+            delete job;
+        }
+        return;
+    }
+    while (g_write_count >= MAX_QUEUED_WRITES && !g_shutting_down)
+        pthread_cond_wait(&g_drain_cond, &g_write_lock);
+    if (g_write_tail)
+        g_write_tail->next = job;
+    else
+        g_write_head = job;
+    g_write_tail = job;
+    ++g_write_count;
+    pthread_cond_signal(&g_write_cond);
+    pthread_mutex_unlock(&g_write_lock);
+}
+
+// persists a chat message without making the caller wait for sqlite.
+// the insert happens on the writer thread in queue order, so a reader
+// that lists messages immediately afterward may race the write by a
+// few milliseconds; callers that need the inserted row's id must use
+// add_message() instead.
+void add_message_async(int64_t chat_id, const std::string &role, const std::string &content,
+                       double temperature, double top_p, double presence_penalty,
+                       double frequency_penalty) {
+    WriteJob *job = new WriteJob;
+    job->kind = WriteJob::ADD_MESSAGE;
+    job->id = chat_id;
+    job->role = role;
+    job->content = content;
+    job->temperature = temperature;
+    job->top_p = top_p;
+    job->presence_penalty = presence_penalty;
+    job->frequency_penalty = frequency_penalty;
+    enqueue_write(job);
+}
+
 static bool update_title_impl(sqlite3 *db, int64_t chat_id, const std::string &title) {
     const char *query = "UPDATE chats SET title = ? WHERE id = ?;";
-    sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
         return false;
     }
     if (sqlite3_bind_text(stmt, 1, title.data(), title.size(), SQLITE_STATIC) != SQLITE_OK ||
         sqlite3_bind_int64(stmt, 2, chat_id) != SQLITE_OK) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         return false;
     }
     bool success = sqlite3_step(stmt) == SQLITE_DONE;
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return success;
 }
 
@@ -208,16 +490,16 @@ bool update_title(sqlite3 *db, int64_t chat_id, const std::string &title) {
 
 static bool delete_message_impl(sqlite3 *db, int64_t message_id) {
     const char *query = "DELETE FROM messages WHERE id = ?;";
-    sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
         return false;
     }
     if (sqlite3_bind_int64(stmt, 1, message_id) != SQLITE_OK) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         return false;
     }
     bool success = sqlite3_step(stmt) == SQLITE_DONE;
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return success;
 }
 
@@ -231,10 +513,10 @@ bool delete_message(sqlite3 *db, int64_t message_id) {
 
 static jt::Json get_chats_impl(sqlite3 *db) {
     const char *query = "SELECT id, created_at, model, title FROM chats ORDER BY created_at DESC;";
-    sqlite3_stmt *stmt;
     jt::Json result;
     result.setArray();
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
         return result;
     }
     while (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -246,7 +528,7 @@ static jt::Json get_chats_impl(sqlite3 *db) {
         chat["title"] = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
         result.getArray().push_back(std::move(chat));
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return result;
 }
 
@@ -258,20 +540,28 @@ jt::Json get_chats(sqlite3 *db) {
     return res;
 }
 
-static jt::Json get_messages_impl(sqlite3 *db, int64_t chat_id) {
+static jt::Json get_messages_impl(sqlite3 *db, int64_t chat_id, int64_t limit, int64_t before) {
+    // newest first, keyed on id rather than created_at since ids are
+    // monotonic and created_at only has second resolution. passing a
+    // message id as the cursor pages further back in history, and
+    // sqlite treats a negative limit as no limit, so the unpaginated
+    // call reads everything like it always did
     const char *query = "SELECT id, created_at, role, content, temperature, top_p, "
                         "presence_penalty, frequency_penalty "
                         "FROM messages "
-                        "WHERE chat_id = ? "
-                        "ORDER BY created_at DESC;";
-    sqlite3_stmt *stmt;
+                        "WHERE chat_id = ?1 AND (?2 < 0 OR id < ?2) "
+                        "ORDER BY id DESC "
+                        "LIMIT ?3;";
     jt::Json result;
     result.setArray();
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
         return result;
     }
-    if (sqlite3_bind_int64(stmt, 1, chat_id) != SQLITE_OK) {
-        sqlite3_finalize(stmt);
+    if (sqlite3_bind_int64(stmt, 1, chat_id) != SQLITE_OK ||
+        sqlite3_bind_int64(stmt, 2, before) != SQLITE_OK ||
+        sqlite3_bind_int64(stmt, 3, limit) != SQLITE_OK) {
+        sqlite3_reset(stmt);
         return result;
     }
     while (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -287,28 +577,28 @@ static jt::Json get_messages_impl(sqlite3 *db, int64_t chat_id) {
         msg["frequency_penalty"] = sqlite3_column_double(stmt, 7);
         result.getArray().push_back(std::move(msg));
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return result;
 }
 
-jt::Json get_messages(sqlite3 *db, int64_t chat_id) {
+jt::Json get_messages(sqlite3 *db, int64_t chat_id, int64_t limit, int64_t before) {
     int cs;
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cs);
-    jt::Json res = get_messages_impl(db, chat_id);
+    jt::Json res = get_messages_impl(db, chat_id, limit, before);
     pthread_setcancelstate(cs, 0);
     return res;
 }
 
 static jt::Json get_chat_impl(sqlite3 *db, int64_t chat_id) {
     const char *query = "SELECT id, created_at, model, title FROM chats WHERE id = ?;";
-    sqlite3_stmt *stmt;
     jt::Json result;
     result.setObject();
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
         return result;
     }
     if (sqlite3_bind_int64(stmt, 1, chat_id) != SQLITE_OK) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         return result;
     }
     if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -317,7 +607,7 @@ static jt::Json get_chat_impl(sqlite3 *db, int64_t chat_id) {
         result["model"] = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
         result["title"] = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return result;
 }
 
@@ -334,14 +624,14 @@ static jt::Json get_message_impl(sqlite3 *db, int64_t message_id) {
                         "presence_penalty, frequency_penalty "
                         "FROM messages WHERE id = ?"
                         "ORDER BY created_at ASC;";
-    sqlite3_stmt *stmt;
     jt::Json result;
     result.setObject();
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
         return result;
     }
     if (sqlite3_bind_int64(stmt, 1, message_id) != SQLITE_OK) {
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
         return result;
     }
     if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -355,7 +645,7 @@ static jt::Json get_message_impl(sqlite3 *db, int64_t message_id) {
         result["presence_penalty"] = sqlite3_column_double(stmt, 7);
         result["frequency_penalty"] = sqlite3_column_double(stmt, 8);
     }
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return result;
 }
 
@@ -367,5 +657,134 @@ jt::Json get_message(sqlite3 *db, int64_t message_id) {
     return res;
 }
 
+static bool set_embedding_impl(sqlite3 *db, int64_t message_id, const std::string &model,
+                               const std::string &blob) {
+    const char *query = "INSERT OR REPLACE INTO embeddings (message_id, model, embedding) "
+                        "VALUES (?, ?, ?);";
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
+        return false;
+    }
+    if (sqlite3_bind_int64(stmt, 1, message_id) != SQLITE_OK ||
+        sqlite3_bind_text(stmt, 2, model.data(), model.size(), SQLITE_STATIC) != SQLITE_OK ||
+        sqlite3_bind_blob(stmt, 3, blob.data(), blob.size(), SQLITE_STATIC) != SQLITE_OK) {
+        sqlite3_reset(stmt);
+        return false;
+    }
+    bool success = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_reset(stmt);
+    return success;
+}
+
+// records a message's embedding through the writer thread, so index
+// maintenance never contends with request threads for the database.
+// an empty blob marks a message that can't be embedded, which keeps
+// it out of the missing set without ever matching a search.
+void set_embedding_async(int64_t message_id, const std::string &model, std::string blob) {
+    WriteJob *job = new WriteJob;
+    job->kind = WriteJob::SET_EMBEDDING;
+    job->id = message_id;
+    job->model = model;
+    job->blob = std::move(blob);
+    enqueue_write(job);
+}
+
+// returns up to `limit` messages that have no embedding under `model`
+// yet, newest first, so fresh conversations become searchable before
+// a deep backlog finishes indexing
+static jt::Json get_unembedded_messages_impl(sqlite3 *db, const std::string &model,
+                                             int64_t limit) {
+    const char *query = "SELECT m.id, m.content FROM messages m "
+                        "LEFT JOIN embeddings e ON e.message_id = m.id AND e.model = ?1 "
+                        "WHERE e.message_id IS NULL AND m.content != '' "
+                        "ORDER BY m.id DESC "
+                        "LIMIT ?2;";
+    jt::Json result;
+    result.setArray();
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
+        return result;
+    }
+    if (sqlite3_bind_text(stmt, 1, model.data(), model.size(), SQLITE_STATIC) != SQLITE_OK ||
+        sqlite3_bind_int64(stmt, 2, limit) != SQLITE_OK) {
+        sqlite3_reset(stmt);
+        return result;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        jt::Json msg;
+        msg.setObject();
+        msg["id"] = sqlite3_column_int64(stmt, 0);
+        msg["content"] = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+        result.getArray().push_back(std::move(msg));
+    }
+    sqlite3_reset(stmt);
+    return result;
+}
+
+jt::Json get_unembedded_messages(sqlite3 *db, const std::string &model, int64_t limit) {
+    int cs;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cs);
+    jt::Json res = get_unembedded_messages_impl(db, model, limit);
+    pthread_setcancelstate(cs, 0);
+    return res;
+}
+
+// ranks stored messages against a normalized query vector. the scan
+// is brute force: a chat database holds thousands of messages, maybe
+// hundreds of thousands on a shared box, and a fused pass over that
+// many small blobs takes single digit milliseconds, which is noise
+// next to embedding the query. an approximate index graph would save
+// nothing at this scale and cost a rebuild story. the scan only
+// touches ids and vectors; row details are fetched for the winners.
+static jt::Json search_embeddings_impl(sqlite3 *db, const std::string &model,
+                                       const float *query_vec, size_t n, int64_t limit) {
+    const char *query = "SELECT message_id, embedding FROM embeddings WHERE model = ?1;";
+    jt::Json result;
+    result.setArray();
+    sqlite3_stmt *stmt = prepare(db, query);
+    if (!stmt) {
+        return result;
+    }
+    if (sqlite3_bind_text(stmt, 1, model.data(), model.size(), SQLITE_STATIC) != SQLITE_OK) {
+        sqlite3_reset(stmt);
+        return result;
+    }
+    std::vector<std::pair<float, int64_t>> scored;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (sqlite3_column_bytes(stmt, 1) != (int)(n * sizeof(float)))
+            continue;
+        const float *v = (const float *)sqlite3_column_blob(stmt, 1);
+        float score = 0;
+        for (size_t i = 0; i < n; ++i)
+            score += query_vec[i] * v[i];
+        scored.emplace_back(score, sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_reset(stmt);
+    auto better = [](const std::pair<float, int64_t> &a, const std::pair<float, int64_t> &b) {
+        return a.first > b.first;
+    };
+    if ((size_t)limit < scored.size()) {
+        std::partial_sort(scored.begin(), scored.begin() + limit, scored.end(), better);
+        scored.resize(limit);
+    } else {
+        std::sort(scored.begin(), scored.end(), better);
+    }
+    for (const auto &hit : scored) {
+        jt::Json msg = get_message_impl(db, hit.second);
+        msg["score"] = hit.first;
+        result.getArray().push_back(std::move(msg));
+    }
+    return result;
+}
+
+jt::Json search_embeddings(sqlite3 *db, const std::string &model, const float *query_vec,
+                           size_t n, int64_t limit) {
+    int cs;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cs);
+    jt::Json res = search_embeddings_impl(db, model, query_vec, n, limit);
+    pthread_setcancelstate(cs, 0);
+    return res;
+}
+
 } // namespace db
 } // namespace lf
@@ -24,17 +24,25 @@ struct sqlite3;
 namespace lf {
 namespace db {
 
+void init();
+void destroy();
+bool exists();
 sqlite3 *open();
 void close(sqlite3 *);
 int64_t add_chat(sqlite3 *, const std::string &, const std::string &);
 int64_t add_message(sqlite3 *, int64_t, const std::string &, const std::string &, double, double,
                     double, double);
+void add_message_async(int64_t, const std::string &, const std::string &, double, double, double,
+                       double);
 bool update_title(sqlite3 *, int64_t, const std::string &);
 bool delete_message(sqlite3 *, int64_t);
 jt::Json get_chat(sqlite3 *, int64_t);
 jt::Json get_chats(sqlite3 *);
 jt::Json get_message(sqlite3 *, int64_t);
-jt::Json get_messages(sqlite3 *, int64_t);
+jt::Json get_messages(sqlite3 *, int64_t, int64_t limit = -1, int64_t before = -1);
+void set_embedding_async(int64_t, const std::string &, std::string);
+jt::Json get_unembedded_messages(sqlite3 *, const std::string &, int64_t);
+jt::Json search_embeddings(sqlite3 *, const std::string &, const float *, size_t, int64_t);
 
 } // namespace db
 } // namespace lf
@@ -53,6 +53,13 @@ bool llamafile_extract(const char *zip, const char *to) {
         unlink(stage);
         return false;
     }
+    // hint the kernel we'll stream the input sequentially, and size the
+    // output upfront so the filesystem can allocate its extents in one
+    // go rather than growing the file a block at a time
+    struct stat st;
+    posix_fadvise(fdin, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (!fstat(fdin, &st) && st.st_size > 0)
+        ftruncate(fdout, st.st_size);
     if (copyfd(fdin, fdout, -1) == -1) {
         perror(zip);
         close(fdin);
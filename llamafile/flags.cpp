@@ -38,8 +38,12 @@
 
 bool FLAGS_READY = false;
 bool FLAG_ascii = false;
+bool FLAG_cold_tier = false;
 bool FLAG_completion_mode = false;
+bool FLAG_ecores = false;
+bool FLAG_embedding = false;
 bool FLAG_fast = false;
+bool FLAG_hugepages = false;
 bool FLAG_iq = false;
 bool FLAG_log_disable = false;
 bool FLAG_mlock = false;
@@ -47,23 +51,38 @@ bool FLAG_mmap = true;
 bool FLAG_no_display_prompt = false;
 bool FLAG_nocompile = false;
 bool FLAG_nologo = false;
+bool FLAG_notune = false;
+bool FLAG_numa = false;
 bool FLAG_precise = false;
 bool FLAG_recompile = false;
+bool FLAG_repack = false;
+bool FLAG_supervise = false;
 bool FLAG_tinyblas = false;
 bool FLAG_trace = false;
 bool FLAG_unsecure = false;
 bool FLAG_v2 = false;
+const char *FLAG_cache_type_k = "f16";
+const char *FLAG_cache_type_v = "f16";
 const char *FLAG_chat_template = "";
 const char *FLAG_db = nullptr;
+const char *FLAG_draft_model = nullptr;
 const char *FLAG_db_startup_sql = "PRAGMA journal_mode=WAL;"
                                   "PRAGMA synchronous=NORMAL;";
+const char *FLAG_dso_cache_dir = nullptr;
+const char *FLAG_eventlog = nullptr;
+const char *FLAG_extra_models[16];
 const char *FLAG_file = nullptr;
 const char *FLAG_ip_header = nullptr;
 const char *FLAG_listen = "127.0.0.1:8080";
 const char *FLAG_mmproj = nullptr;
 const char *FLAG_model = nullptr;
+const char *FLAG_precision = nullptr;
 const char *FLAG_prompt = nullptr;
+const char *FLAG_record = nullptr;
+const char *FLAG_slot_buckets = nullptr;
+const char *FLAG_tensor_split = nullptr;
 const char *FLAG_url_prefix = "";
+const char *FLAG_weight_cache = nullptr;
 const char *FLAG_www_root = "/zip/www";
 double FLAG_token_rate = 1;
 float FLAG_decay_growth = .01;
@@ -73,17 +92,35 @@ float FLAG_reserve_tokens = .15;
 float FLAG_temperature = .8;
 float FLAG_top_p = .95;
 int FLAG_batch = 256;
+int FLAG_batch_max_wait = 60;
+int FLAG_completion_cache_size = 64 * 1024 * 1024;
 int FLAG_ctx_size = 8192;
 int FLAG_decay_delay = 60 * 5;
+int FLAG_extra_model_count = 0;
+int FLAG_draft_tokens = 5;
+int FLAG_embedding_window = 2;
 int FLAG_flash_attn = false;
+bool FLAG_kv_snapshots = false;
+bool FLAG_modelfile = false;
 int FLAG_gpu = 0;
+int FLAG_hibernate = 0;
+int FLAG_hot_models = 1;
 int FLAG_http_ibuf_size = 5 * 1024 * 1024;
 int FLAG_http_obuf_size = 1024 * 1024;
 int FLAG_keepalive = 5;
+int FLAG_kv_cells = 0;
 int FLAG_main_gpu = 0;
+int FLAG_max_queue_time = 0;
+int FLAG_meter_quota = 0;
+int FLAG_modelfile_rate = 0;
 int FLAG_n_gpu_layers = -1;
+int FLAG_prefetch = -1; // -1 means auto (on for gpu runs)
+int FLAG_request_timeout = 0;
+int FLAG_send_backlog = 256 * 1024;
 int FLAG_slots = 1;
+int FLAG_warm_models = 1;
 int FLAG_split_mode = LLAMA_SPLIT_MODE_LAYER;
+int FLAG_sse_flush_ms = 5;
 int FLAG_threads = MIN(cpu_get_num_math(), 20);
 int FLAG_threads_batch = cpu_get_num_math();
 int FLAG_token_burst = 100;
@@ -92,6 +129,7 @@ int FLAG_ubatch = 512;
 int FLAG_verbose = 0;
 int FLAG_warmup = true;
 int FLAG_workers;
+int FLAG_workers_max;
 unsigned FLAG_seed = LLAMA_DEFAULT_SEED;
 
 std::vector<std::string> FLAG_headers;
@@ -176,6 +214,11 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--notune")) {
+            FLAG_notune = true;
+            continue;
+        }
+
         if (!strcmp(flag, "--chatbot-mode")) {
             FLAG_completion_mode = false;
             continue;
@@ -224,6 +267,11 @@ void llamafile_get_flags(int argc, char **argv) {
         if (!strcmp(flag, "--server"))
             continue;
 
+        if (!strcmp(flag, "--embedding")) {
+            FLAG_embedding = true;
+            continue;
+        }
+
         if (!strcmp(flag, "-l") || !strcmp(flag, "--listen")) {
             if (i == argc)
                 missing("--listen");
@@ -231,6 +279,53 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--record")) {
+            if (i == argc)
+                missing("--record");
+            FLAG_record = argv[i++];
+            continue;
+        }
+
+        if (!strcmp(flag, "--eventlog")) {
+            if (i == argc)
+                missing("--eventlog");
+            FLAG_eventlog = argv[i++];
+            continue;
+        }
+
+        if (!strcmp(flag, "--send-backlog")) {
+            if (i == argc)
+                missing("--send-backlog");
+            FLAG_send_backlog = atoi(argv[i++]);
+            continue;
+        }
+
+        if (!strcmp(flag, "--sse-flush-ms")) {
+            if (i == argc)
+                missing("--sse-flush-ms");
+            FLAG_sse_flush_ms = atoi(argv[i++]);
+            continue;
+        }
+
+        if (!strcmp(flag, "--kv-cells")) {
+            char *ep;
+            if (i == argc)
+                missing("--kv-cells");
+            FLAG_kv_cells = strtol(argv[i++], &ep, 10);
+            if (*ep == 'k')
+                FLAG_kv_cells *= 1024;
+            continue;
+        }
+
+        if (!strcmp(flag, "--hibernate")) {
+            if (i == argc)
+                missing("--hibernate");
+            FLAG_hibernate = atoi(argv[i++]);
+            if (FLAG_hibernate < 0)
+                error("--hibernate SECONDS must be non-negative");
+            continue;
+        }
+
         if (!strcmp(flag, "-k") || !strcmp(flag, "--keepalive")) {
             if (i == argc)
                 missing("--keepalive");
@@ -245,6 +340,13 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--workers-max")) {
+            if (i == argc)
+                missing("--workers-max");
+            FLAG_workers_max = atoi(argv[i++]);
+            continue;
+        }
+
         if (!strcmp(flag, "--ip-header")) {
             if (i == argc)
                 missing("--ip-header");
@@ -300,6 +402,31 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--token-rate-override")) {
+            if (i == argc)
+                missing("--token-rate-override");
+            const char *arg = argv[i++];
+            const char *eq = strchr(arg, '=');
+            if (!eq)
+                error("--token-rate-override expects CIDR=RATE (like 10.0.0.0/8=50)");
+            cidr_rate o;
+            if (!parse_cidr(std::string_view(arg, eq - arg), &o.prefix))
+                error("invalid --token-rate-override CIDR (expect like 10.0.0.0/8=50)");
+            double rate = atof(eq + 1);
+            if (!rate)
+                error("--token-rate-override rate can't be zero");
+            double micros = 1e6 / rate;
+            if (isnan(micros) || isinf(micros))
+                error("--token-rate-override rate invalid");
+            if (micros < 10)
+                error("--token-rate-override too frequent (can't be above 100000 a.k.a. 1 per 10µs)");
+            if (micros > 60 * 60 * 1e6)
+                error("--token-rate-override too infrequent (can't be below 1/(60*60) a.k.a. 1 per hour)");
+            o.rate = rate;
+            FLAG_token_rate_overrides.push_back(o);
+            continue;
+        }
+
         //////////////////////////////////////////////////////////////////////
         // http server flags
 
@@ -346,6 +473,13 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--completion-cache-size")) {
+            if (i == argc)
+                missing("--completion-cache-size");
+            FLAG_completion_cache_size = atoi(argv[i++]);
+            continue;
+        }
+
         //////////////////////////////////////////////////////////////////////
         // sampling flags
 
@@ -414,6 +548,40 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--precision")) {
+            if (i == argc)
+                missing("--precision");
+            FLAG_precision = argv[i++];
+            continue;
+        }
+
+        if (!strcmp(flag, "--extra-model")) {
+            if (i == argc)
+                missing("--extra-model");
+            if (FLAG_extra_model_count == (int)ARRAYLEN(FLAG_extra_models))
+                error("too many --extra-model flags");
+            FLAG_extra_models[FLAG_extra_model_count++] = argv[i++];
+            continue;
+        }
+
+        if (!strcmp(flag, "--hot-models")) {
+            if (i == argc)
+                missing("--hot-models");
+            FLAG_hot_models = atoi(argv[i++]);
+            if (FLAG_hot_models < 1)
+                error("--hot-models COUNT must be at least 1");
+            continue;
+        }
+
+        if (!strcmp(flag, "--warm-models")) {
+            if (i == argc)
+                missing("--warm-models");
+            FLAG_warm_models = atoi(argv[i++]);
+            if (FLAG_warm_models < 0)
+                error("--warm-models COUNT can't be negative");
+            continue;
+        }
+
         if (!strcmp(flag, "-mm") || !strcmp(flag, "--mmproj")) {
             if (i == argc)
                 missing("--mmproj");
@@ -456,6 +624,45 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "-ctk") || !strcmp(flag, "--cache-type-k")) {
+            if (i == argc)
+                missing("--cache-type-k");
+            const char *value = argv[i++];
+            if (strcmp(value, "f32") && strcmp(value, "f16") && strcmp(value, "bf16") &&
+                strcmp(value, "q8_0") && strcmp(value, "q4_0"))
+                bad("--cache-type-k");
+            FLAG_cache_type_k = value;
+            continue;
+        }
+
+        if (!strcmp(flag, "-ctv") || !strcmp(flag, "--cache-type-v")) {
+            if (i == argc)
+                missing("--cache-type-v");
+            const char *value = argv[i++];
+            if (strcmp(value, "f32") && strcmp(value, "f16") && strcmp(value, "bf16") &&
+                strcmp(value, "q8_0") && strcmp(value, "q4_0"))
+                bad("--cache-type-v");
+            FLAG_cache_type_v = value;
+            continue;
+        }
+
+        if (!strcmp(flag, "--kv-snapshots")) {
+            FLAG_kv_snapshots = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--modelfile")) {
+            FLAG_modelfile = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--modelfile-rate")) {
+            if (i == argc)
+                missing("--modelfile-rate");
+            FLAG_modelfile_rate = atoi(argv[i++]);
+            continue;
+        }
+
         if (!strcmp(flag, "-fa") || !strcmp(flag, "--flash-attn")) {
             if (i == argc)
                 missing("--flash-attn");
@@ -468,6 +675,11 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--supervise")) {
+            FLAG_supervise = true;
+            continue;
+        }
+
         if (!strcmp(flag, "--reserve-tokens")) {
             if (i == argc)
                 missing("--reserve-tokens");
@@ -496,6 +708,97 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--slot-buckets")) {
+            if (i == argc)
+                missing("--slot-buckets");
+            FLAG_slot_buckets = argv[i++];
+            continue;
+        }
+
+        if (!strcmp(flag, "--weight-cache")) {
+            if (i == argc)
+                missing("--weight-cache");
+            FLAG_weight_cache = argv[i++];
+            continue;
+        }
+
+        if (!strcmp(flag, "--draft-model")) {
+            if (i == argc)
+                missing("--draft-model");
+            FLAG_draft_model = argv[i++];
+            continue;
+        }
+
+        if (!strcmp(flag, "--draft-tokens")) {
+            if (i == argc)
+                missing("--draft-tokens");
+            int n = atoi(argv[i++]);
+            if (!(1 <= n && n <= 64))
+                error("--draft-tokens INT must be between 1 and 64");
+            FLAG_draft_tokens = n;
+            continue;
+        }
+
+        if (!strcmp(flag, "--embedding-window")) {
+            if (i == argc)
+                missing("--embedding-window");
+            int n = atoi(argv[i++]);
+            if (!(0 <= n && n <= 1000))
+                error("--embedding-window MILLISECONDS must be between 0 and 1000");
+            FLAG_embedding_window = n;
+            continue;
+        }
+
+        if (!strcmp(flag, "--prefetch")) {
+            if (i == argc)
+                missing("--prefetch");
+            int n = atoi(argv[i++]);
+            if (!(0 <= n && n <= 64))
+                error("--prefetch INT must be between 0 and 64");
+            FLAG_prefetch = n;
+            continue;
+        }
+
+        if (!strcmp(flag, "--max-queue-time")) {
+            if (i == argc)
+                missing("--max-queue-time");
+            int n = atoi(argv[i++]);
+            if (!(0 <= n && n <= 86400))
+                error("--max-queue-time SECONDS must be between 0 and 86400");
+            FLAG_max_queue_time = n;
+            continue;
+        }
+
+        if (!strcmp(flag, "--request-timeout")) {
+            if (i == argc)
+                missing("--request-timeout");
+            int n = atoi(argv[i++]);
+            if (!(0 <= n && n <= 86400))
+                error("--request-timeout SECONDS must be between 0 and 86400");
+            FLAG_request_timeout = n;
+            continue;
+        }
+
+        if (!strcmp(flag, "--meter-quota")) {
+            if (i == argc)
+                missing("--meter-quota");
+            int n = atoi(argv[i++]);
+            if (!(0 <= n && n <= 86400))
+                error("--meter-quota SECONDS must be between 0 and 86400");
+            FLAG_meter_quota = n;
+            continue;
+        }
+
+        if (!strcmp(flag, "--batch-max-wait")) {
+            if (i == argc)
+                missing("--batch-max-wait");
+            int n = atoi(argv[i++]);
+            if (!(0 <= n && n <= 86400))
+                error("--batch-max-wait SECONDS must be between 0 and 86400");
+            FLAG_batch_max_wait = n;
+            continue;
+        }
+
         if (!strcmp(flag, "--decay-delay")) {
             if (i == argc)
                 missing("--decay-delay");
@@ -540,6 +843,11 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--repack")) {
+            FLAG_repack = true;
+            continue;
+        }
+
         if (!strcmp(flag, "--trap")) {
             FLAG_trap = true;
             FLAG_unsecure = true;
@@ -552,6 +860,26 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--hugepages")) {
+            FLAG_hugepages = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--numa")) {
+            FLAG_numa = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--cold-tier")) {
+            FLAG_cold_tier = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--ecores")) {
+            FLAG_ecores = true;
+            continue;
+        }
+
         if (!strcmp(flag, "--no-mmap")) {
             FLAG_mmap = false;
             continue;
@@ -581,6 +909,15 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--dso-cache-dir")) {
+            if (!program_supports_gpu)
+                nogpu("--dso-cache-dir");
+            if (i == argc)
+                missing("--dso-cache-dir");
+            FLAG_dso_cache_dir = argv[i++];
+            continue;
+        }
+
         if (!strcmp(flag, "--gpu")) {
             if (i == argc)
                 missing("--gpu");
@@ -629,6 +966,15 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "-ts") || !strcmp(flag, "--tensor-split")) {
+            if (!program_supports_gpu)
+                nogpu("--tensor-split");
+            if (i == argc)
+                missing("--tensor-split");
+            FLAG_tensor_split = argv[i++];
+            continue;
+        }
+
         //////////////////////////////////////////////////////////////////////
         // security flags
 
@@ -643,6 +989,12 @@ void llamafile_get_flags(int argc, char **argv) {
     if (!FLAG_model)
         required("--model");
 
+    // one distributed artifact can serve machines that want smaller
+    // weights. the first boot requantizes and caches in the app dir;
+    // later boots get the cached artifact back instantly
+    if (FLAG_precision)
+        FLAG_model = llamafile_transcode_model(FLAG_model, FLAG_precision);
+
     FLAGS_READY = true;
     FLAG_n_gpu_layers = llamafile_gpu_layers(FLAG_n_gpu_layers);
 }
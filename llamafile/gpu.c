@@ -19,6 +19,7 @@
 #include "llama.cpp/ggml-metal.h"
 #include "llamafile.h"
 #include "llamafile/log.h"
+#include "llamafile/splitplan.h"
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,8 @@ const char *llamafile_describe_gpu(void) {
         return "apple";
     case LLAMAFILE_GPU_NVIDIA:
         return "nvidia";
+    case LLAMAFILE_GPU_VULKAN:
+        return "vulkan";
     case LLAMAFILE_GPU_DISABLE:
         return "disabled";
     default:
@@ -45,7 +48,7 @@ const char *llamafile_describe_gpu(void) {
  * Returns true if GPU support is available.
  */
 bool llamafile_has_gpu(void) {
-    return llamafile_has_metal() || llamafile_has_cuda();
+    return llamafile_has_metal() || llamafile_has_cuda() || llamafile_has_vulkan();
 }
 
 /**
@@ -61,12 +64,19 @@ int llamafile_gpu_layers(int n_gpu_layers) {
     if (n_gpu_layers < 0 && FLAG_gpu > 0)
         n_gpu_layers = INT_MAX;
 
+    // full offload is just a guess when the user only said `--gpu`. a
+    // model bigger than vram would oom, so let the planner right size
+    // the split from measured memory and bandwidth. explicit `-ngl`
+    // values like 9999 are user intent and pass through untouched.
+    if (n_gpu_layers == INT_MAX && llamafile_has_cuda() && FLAG_model)
+        n_gpu_layers = llamafile_split_plan(FLAG_model, n_gpu_layers);
+
     // Apple Metal is safe enough to enable by default.
     if (n_gpu_layers <= 0 && llamafile_has_metal())
         n_gpu_layers = INT_MAX;
 
     // make the -ngl flag not break example code when it's impossible
-    // if you want it to be an error just pass --gpu apple/amd/nvidia
+    // if you want it to be an error just pass --gpu apple/amd/nvidia/vulkan
     if (n_gpu_layers > 0 && !llamafile_has_gpu()) {
         tinylogf("warning: --n-gpu-layers %d was passed but no GPUs were found;"
                  " falling back to CPU inference\n",
@@ -103,6 +113,8 @@ int llamafile_gpu_parse(const char *s) {
         return LLAMAFILE_GPU_APPLE;
     if (!strcasecmp(s, "nvidia"))
         return LLAMAFILE_GPU_NVIDIA;
+    if (!strcasecmp(s, "vulkan"))
+        return LLAMAFILE_GPU_VULKAN;
 
     // Parse aliases.
     if (!strcasecmp(s, "disabled"))
@@ -117,6 +129,8 @@ int llamafile_gpu_parse(const char *s) {
         return LLAMAFILE_GPU_AMD;
     if (!strcasecmp(s, "hip"))
         return LLAMAFILE_GPU_AMD;
+    if (!strcasecmp(s, "vk"))
+        return LLAMAFILE_GPU_VULKAN;
 
     return LLAMAFILE_GPU_ERROR;
 }
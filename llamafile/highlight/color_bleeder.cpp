@@ -17,6 +17,8 @@
 
 #include "highlight.h"
 
+#include <cstring>
+
 // the `less` command was intentionally designed to prevent ansi sgr
 // codes from bleeding across lines. for example, saying:
 //
@@ -86,7 +88,28 @@ ColorBleeder::restore(std::string* r)
 void
 ColorBleeder::relay(std::string* r, const std::string& s)
 {
-    for (char c : s) {
+    size_t i = 0;
+    size_t n = s.size();
+    while (i < n) {
+
+        // plain text between escapes and newlines can't change the
+        // sgr state, so whole runs get copied through at once, with
+        // the vectorized memchr doing the scanning rather than this
+        // state machine looking at every byte. streaming a big code
+        // answer is almost entirely such runs
+        if (t_ == NORMAL) {
+            const char* p = s.data() + i;
+            size_t left = n - i;
+            const char* esc = (const char*)memchr(p, 033, left);
+            const char* nl = (const char*)memchr(p, '\n', esc ? esc - p : left);
+            const char* stop = nl ? nl : esc;
+            size_t run = stop ? stop - p : left;
+            r->append(p, run);
+            if ((i += run) == n)
+                break;
+        }
+
+        char c = s[i++];
         *r += c;
         switch (t_) {
 
@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #pragma once
+#include <map>
 #include <string>
 #include <string_view>
 
@@ -152,6 +153,13 @@ extern "C"
     is_keyword_f is_keyword_css_bang;
 }
 
+// streaming syntax highlighter
+//
+// each subclass is an incremental state machine. feed() may be called
+// with arbitrarily small chunks, e.g. one model token at a time, and
+// only does work proportional to the chunk, so streaming a long chat
+// response stays linear overall. flush() emits whatever's still held
+// back and returns the machine to its start state for reuse.
 class Highlight
 {
   public:
@@ -330,6 +338,7 @@ class HighlightMarkdown : public Highlight
     bool tail_ = false;
     std::string lang_;
     Highlight* highlighter_ = nullptr;
+    std::map<std::string, Highlight*> highlighters_;
 };
 
 class HighlightRust : public Highlight
@@ -47,6 +47,8 @@ HighlightMarkdown::HighlightMarkdown()
 
 HighlightMarkdown::~HighlightMarkdown()
 {
+    for (const auto& h : highlighters_)
+        delete h.second;
 }
 
 void
@@ -253,8 +255,17 @@ HighlightMarkdown::feed(std::string* r, std::string_view input)
                 lf::append_wchar(r, c);
                 lang_ += std::tolower(c);
             } else {
-                if (!(highlighter_ = Highlight::create(lang_)))
-                    highlighter_ = new HighlightTxt;
+                // reuse highlighter instances across code blocks, since
+                // flush() restores them to their initial state, and chat
+                // responses tend to repeat the same language many times
+                auto it = highlighters_.find(lang_);
+                if (it != highlighters_.end()) {
+                    highlighter_ = it->second;
+                } else {
+                    if (!(highlighter_ = Highlight::create(lang_)))
+                        highlighter_ = new HighlightTxt;
+                    highlighters_[lang_] = highlighter_;
+                }
                 lang_.clear();
                 t_ = CODE;
                 goto Code;
@@ -290,7 +301,6 @@ HighlightMarkdown::feed(std::string* r, std::string_view input)
             if (c == '`') {
                 t_ = NORMAL;
                 highlighter_->flush(r);
-                delete highlighter_;
                 highlighter_ = nullptr;
                 *r += "```";
             } else {
@@ -339,18 +349,15 @@ HighlightMarkdown::flush(std::string* r)
         break;
     case CODE:
         highlighter_->flush(r);
-        delete highlighter_;
         highlighter_ = nullptr;
         break;
     case CODE_TICK:
         highlighter_->flush(r);
-        delete highlighter_;
         highlighter_ = nullptr;
         *r += '`';
         break;
     case CODE_TICK_TICK:
         highlighter_->flush(r);
-        delete highlighter_;
         highlighter_ = nullptr;
         *r += "``";
         break;
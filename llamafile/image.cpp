@@ -22,7 +22,7 @@
 #include <termios.h>
 #include <unistd.h>
 
-#include "llama.cpp/base64.h"
+#include "llamafile/b64.h"
 #include "llamafile/macros.h"
 #include "llamafile/xterm.h"
 #include "third_party/stb/stb_image.h"
@@ -56,10 +56,7 @@ void convert_image_to_uri(std::string *r, const std::string_view &image) {
     *r += "data:";
     *r += get_image_mime(get_image_type(image));
     *r += ";base64,";
-    size_t size = r->size();
-    size_t need = base64::required_encode_size(image.size());
-    r->resize(size + need);
-    r->resize(base64::encode(image.begin(), image.end(), r->begin() + size) - r->begin());
+    base64_encode(image, r);
 }
 
 /**
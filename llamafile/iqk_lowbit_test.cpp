@@ -0,0 +1,187 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ansiblas.h"
+#include "bench.h"
+#include "float.h"
+#include "llama.cpp/ggml-quants.h"
+#include "llama.cpp/ggml.h"
+#include "macros.h"
+#include "numba.h"
+#include "sgemm.h"
+#include <assert.h>
+
+// exercises the low bit k-quant kernels in the iqk_mul_mat family,
+// which carry q2_K and q3_K models on machines with avx2 or dotprod.
+// their scale unpacking happens once per 256 element superblock, so a
+// bug there smears across whole groups rather than single weights,
+// which is exactly what comparing against the dequantized reference
+// catches. n=1 is the token generation shape the edge boxes care
+// about; n=64 covers the prefill tiles.
+
+#define ITERATIONS 30
+#define ALLOC(n) (float *)memalign(4096, sizeof(float) * (n))
+
+static size_t quantize(int type, const float *src, void *dst, int nrow, int k) {
+    switch (type) {
+    case GGML_TYPE_Q2_K:
+        return quantize_q2_K(src, dst, nrow, k, 0);
+    case GGML_TYPE_Q3_K:
+        return quantize_q3_K(src, dst, nrow, k, 0);
+    default:
+        assert(!"unsupported type");
+        return 0;
+    }
+}
+
+static void dequantize(int type, const void *src, float *dst, int k) {
+    switch (type) {
+    case GGML_TYPE_Q2_K:
+        dequantize_row_q2_K((const block_q2_K *)src, dst, k);
+        break;
+    case GGML_TYPE_Q3_K:
+        dequantize_row_q3_K((const block_q3_K *)src, dst, k);
+        break;
+    default:
+        assert(!"unsupported type");
+    }
+}
+
+bool llamafile_sgemm_openmp(long m, long n, long k, const void *A, long lda, const void *B,
+                            long ldb, void *C, long ldc, int Atype, int Btype, int Ctype) {
+    static int nth = cpu_get_num_math();
+    bool ok = true;
+#pragma omp parallel for
+    for (int ith = 0; ith < nth; ++ith)
+        if (!llamafile_sgemm(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype))
+            ok = false;
+    return ok;
+}
+
+int test(int type, int n) {
+    int m = 4096;
+    int k = 4096;
+    int kblck = k / QK_K;
+    int ldc = ROUNDUP(m, 16);
+    size_t arow = ggml_row_size((enum ggml_type)type, k);
+    size_t brow = ggml_row_size(GGML_TYPE_Q8_K, k);
+    float *A = ALLOC(k * m);
+    float *B = ALLOC(k * n);
+    float *C = ALLOC(ldc * n);
+    float *G = ALLOC(ldc * n);
+    char *Qa = (char *)memalign(4096, arow * m);
+    char *Qb = (char *)memalign(4096, brow * n);
+    broadcast(C, ldc * n, NAN);
+    broadcast(G, ldc * n, NAN);
+    randomize(k, m, A, k);
+    randomize(k, n, B, k);
+
+    quantize(type, A, Qa, m, k);
+    for (int j = 0; j < n; ++j)
+        quantize_row_q8_K(B + k * j, (block_q8_K *)(Qb + brow * j), k);
+
+    // the reference multiplies the dequantized operands, so any gap
+    // beyond summation order is the kernel's doing, not quantization
+    for (int i = 0; i < m; ++i)
+        dequantize(type, Qa + arow * i, A + k * i, k);
+    for (int j = 0; j < n; ++j)
+        dequantize_row_q8_K((const block_q8_K *)(Qb + brow * j), B + k * j, k);
+
+    if (!llamafile_sgemm_openmp(m, n, kblck, Qa, kblck, Qb, kblck, C, ldc, type,
+                                GGML_TYPE_Q8_K, GGML_TYPE_F32)) {
+        fprintf(stderr, "note: no iqk kernel for type %d on this cpu; skipping\n", type);
+        free(Qb);
+        free(Qa);
+        free(G);
+        free(C);
+        free(B);
+        free(A);
+        return 0;
+    }
+
+    printf("type=%d n=%d\n", type, n);
+    BENCH(ansiBLAS::sgemm(m, n, k, A, k, B, k, G, ldc));
+    BENCH(llamafile_sgemm_openmp(m, n, kblck, Qa, kblck, Qb, kblck, C, ldc, type,
+                                 GGML_TYPE_Q8_K, GGML_TYPE_F32));
+
+    double err_sum = 0;
+    long long err_worst = 0;
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < n; ++j) {
+            float g = G[ldc * j + i];
+            float c = C[ldc * j + i];
+            if (flt::isnan(g)) {
+                fprintf(stderr, "%s:%d: found nan in reference matrix: i=%d j=%d\n", __FILE__,
+                        __LINE__, i, j);
+                return 3;
+            }
+            if (flt::isnan(c)) {
+                fprintf(stderr, "%s:%d: found nan in output matrix: i=%d j=%d\n", __FILE__,
+                        __LINE__, i, j);
+                return 4;
+            }
+            long long gi = flt::toint(g);
+            long long ci = flt::toint(c);
+            long long err = gi - ci;
+            if (err < 0)
+                err = -err;
+            err_sum += err;
+            if (err > err_worst)
+                err_worst = err;
+        }
+
+    double err_avg = err_sum / (m * n);
+    fprintf(stderr, "%12g ulp average\n", err_avg);
+    fprintf(stderr, "%12lld ulp worst\n", err_worst);
+
+    if (err_avg > 128)
+        return 5;
+    if (err_worst > 16384)
+        return 6;
+
+    free(Qb);
+    free(Qa);
+    free(G);
+    free(C);
+    free(B);
+    free(A);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+
+    printf("\n");
+    if ((rc = test(GGML_TYPE_Q2_K, 1)))
+        return rc;
+
+    printf("\n");
+    if ((rc = test(GGML_TYPE_Q3_K, 1)))
+        return rc;
+
+    printf("\n");
+    if ((rc = test(GGML_TYPE_Q2_K, 64)))
+        return rc;
+
+    printf("\n");
+    if ((rc = test(GGML_TYPE_Q3_K, 64)))
+        return rc;
+
+    printf("\n");
+    return 0;
+}
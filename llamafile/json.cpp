@@ -235,6 +235,44 @@ LongToString(char* p, long long x)
     return UlongToString(p, x);
 }
 
+// Parsing a chat completions body with a long message history makes
+// one red-black tree node per object member, and finishing a request
+// destroys them all again, so object churn used to hammer malloc and
+// free. Instead each thread parks the nodes of objects it tears down
+// here and the next parse adopts them back out. A detached C++17 node
+// handle owns its own memory and lets the key be written in place, so
+// recycled nodes behave exactly like fresh ones. Values are emptied
+// before pooling so a parked node can't pin a large payload, and keys
+// with big buffers are let go for the same reason.
+static constexpr size_t kMaxPooledNodes = 65536;
+static thread_local std::vector<std::map<std::string, Json>::node_type>
+  g_node_pool;
+
+static std::map<std::string, Json>::iterator
+pool_insert(std::map<std::string, Json>& object, std::string&& key, Json&& value)
+{
+    if (!g_node_pool.empty()) {
+        auto node = std::move(g_node_pool.back());
+        g_node_pool.pop_back();
+        node.key() = std::move(key);
+        node.mapped() = std::move(value);
+        return object.insert(std::move(node)).position;
+    }
+    return object.emplace(std::move(key), std::move(value)).first;
+}
+
+static void
+pool_recycle(std::map<std::string, Json>& object)
+{
+    while (!object.empty() && g_node_pool.size() < kMaxPooledNodes) {
+        auto node = object.extract(object.begin());
+        if (node.key().capacity() > 64)
+            continue;
+        node.mapped() = Json();
+        g_node_pool.push_back(std::move(node));
+    }
+}
+
 Json::Json(unsigned long value)
 {
     if (value <= LLONG_MAX) {
@@ -288,6 +326,7 @@ Json::clear()
             array_value.~vector();
             break;
         case Object:
+            pool_recycle(object_value);
             object_value.~map();
             break;
         default:
@@ -578,7 +617,10 @@ Json::operator[](const std::string& key)
 {
     if (!isObject())
         setObject();
-    return object_value[key];
+    auto it = object_value.find(key);
+    if (it == object_value.end())
+        it = pool_insert(object_value, std::string(key), Json());
+    return it->second;
 }
 
 std::string
@@ -957,8 +999,9 @@ Json::parse(Json& json, const char*& p, const char* e, int context, int depth)
                         return object_missing_value;
                     if (status != success)
                         return status;
-                    json.object_value.emplace(std::move(key.string_value),
-                                              std::move(value));
+                    pool_insert(json.object_value,
+                                std::move(key.string_value),
+                                std::move(value));
                     context = KEY | COMMA | OBJECT;
                     key.clear();
                 }
@@ -973,9 +1016,16 @@ Json::parse(Json& json, const char*& p, const char* e, int context, int depth)
                         return unexpected_end_of_string;
                     switch (kJsonStr[(c = *p++ & 255)]) {
 
-                        case ASCII:
-                            b += c;
+                        case ASCII: {
+                            // append the whole unescaped run at once so
+                            // a long message body doesn't grow the string
+                            // one byte at a time
+                            const char* q = p - 1;
+                            while (p < e && kJsonStr[*p & 255] == ASCII)
+                                ++p;
+                            b.append(q, p - q);
                             break;
+                        }
 
                         case DQUOTE:
                             json.type_ = String;
@@ -1215,7 +1265,7 @@ Json::parse(Json& json, const char*& p, const char* e, int context, int depth)
 }
 
 std::pair<Json::Status, Json>
-Json::parse(const std::string& s)
+Json::parse(const std::string_view s)
 {
     Json::Status s2;
     std::pair<Json::Status, Json> res;
@@ -1231,6 +1281,107 @@ Json::parse(const std::string& s)
     return res;
 }
 
+JsonStream::JsonStream(const std::string_view s)
+  : p_(s.data()), e_(s.data() + s.size())
+{
+}
+
+int
+JsonStream::peek()
+{
+    while (p_ < e_ &&
+           (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+        ++p_;
+    if (p_ >= e_)
+        return -1;
+    return *p_ & 255;
+}
+
+Json::Status
+JsonStream::begin_object()
+{
+    if (peek() != '{')
+        return Json::illegal_character;
+    ++p_;
+    context_ = KEY | OBJECT;
+    in_object_ = true;
+    return Json::success;
+}
+
+Json::Status
+JsonStream::begin_array()
+{
+    if (peek() != '[')
+        return Json::illegal_character;
+    ++p_;
+    context_ = ARRAY;
+    return Json::success;
+}
+
+Json::Status
+JsonStream::next_key(std::string* key, bool* done)
+{
+    *done = false;
+    Json k;
+    Json::Status status = Json::parse(k, p_, e_, context_, DEPTH - 1);
+    if (status == Json::absent_value) {
+        // the closing '}' has been consumed
+        *done = true;
+        in_object_ = false;
+        context_ = 0;
+        return Json::success;
+    }
+    if (status != Json::success)
+        return status;
+    if (!k.isString())
+        return Json::object_key_must_be_string;
+    *key = std::move(k.string_value);
+    if (peek() != ':')
+        return Json::missing_colon;
+    ++p_;
+    context_ = 0;
+    return Json::success;
+}
+
+Json::Status
+JsonStream::next_value(Json* value)
+{
+    *value = nullptr;
+    Json::Status status = Json::parse(*value, p_, e_, 0, DEPTH - 1);
+    if (status == Json::absent_value)
+        status = Json::object_missing_value;
+    if (status != Json::success)
+        return status;
+    context_ = KEY | COMMA | OBJECT;
+    return Json::success;
+}
+
+Json::Status
+JsonStream::next_element(Json* element, bool* done)
+{
+    *done = false;
+    *element = nullptr;
+    Json::Status status = Json::parse(*element, p_, e_, context_, DEPTH - 1);
+    if (status == Json::absent_value) {
+        // the closing ']' has been consumed
+        *done = true;
+        context_ = in_object_ ? (KEY | COMMA | OBJECT) : 0;
+        return Json::success;
+    }
+    if (status != Json::success)
+        return status;
+    context_ = ARRAY | COMMA;
+    return Json::success;
+}
+
+Json::Status
+JsonStream::end()
+{
+    if (peek() != -1)
+        return Json::trailing_content;
+    return Json::success;
+}
+
 const char*
 Json::StatusToString(Json::Status status)
 {
@@ -18,6 +18,7 @@
 #pragma once
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace jt {
@@ -89,7 +90,7 @@ class Json
 
   public:
     static const char* StatusToString(Status);
-    static std::pair<Status, Json> parse(const std::string&);
+    static std::pair<Status, Json> parse(const std::string_view);
 
     Json(const Json&);
     Json(Json&&) noexcept;
@@ -219,6 +220,47 @@ class Json
     static void stringify(std::string&, const std::string&);
     static void serialize(std::string&, const std::string&);
     static Status parse(Json&, const char*&, const char*, int, int);
+
+    friend class JsonStream;
+};
+
+// pull parser for request bodies too large to materialize all at once.
+// the caller walks the document one value at a time, so a hundred
+// megabyte batch array never holds more than one element's parse tree
+// in memory. only the shapes our endpoints actually receive are
+// supported: a top-level object whose values may be scalars, small
+// subdocuments, or one directly nested array that's consumed element
+// by element. the underlying buffer must outlive the stream.
+class JsonStream
+{
+  public:
+    explicit JsonStream(const std::string_view);
+
+    // returns next non-whitespace character without consuming it, or
+    // -1 at end of input. lets the caller pick begin_array() versus
+    // next_value() when a key's type isn't known in advance.
+    int peek();
+
+    Json::Status begin_object();
+    Json::Status begin_array();
+
+    // parses next object key. sets *done when '}' is reached.
+    Json::Status next_key(std::string*, bool*);
+
+    // parses the value following next_key() as a complete tree.
+    Json::Status next_value(Json*);
+
+    // parses next array element. sets *done when ']' is reached.
+    Json::Status next_element(Json*, bool*);
+
+    // returns success if only trailing whitespace remains.
+    Json::Status end();
+
+  private:
+    const char* p_;
+    const char* e_;
+    int context_ = 0;
+    bool in_object_ = false;
 };
 
 } // namespace jt
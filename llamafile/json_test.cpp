@@ -153,6 +153,73 @@ parse_test()
         exit(7);
 }
 
+void
+stream_test()
+{
+    jt::JsonStream stream(R"({"model": "m", "input": ["a", "b", 3], "n": 1})");
+    if (stream.begin_object() != Json::success)
+        exit(20);
+    std::string key;
+    std::string inputs;
+    std::string model;
+    long long n = 0;
+    bool done;
+    Json value;
+    for (;;) {
+        if (stream.next_key(&key, &done) != Json::success)
+            exit(21);
+        if (done)
+            break;
+        if (key == "input") {
+            if (stream.peek() != '[')
+                exit(22);
+            if (stream.begin_array() != Json::success)
+                exit(23);
+            for (;;) {
+                if (stream.next_element(&value, &done) != Json::success)
+                    exit(24);
+                if (done)
+                    break;
+                inputs += value.toString();
+            }
+        } else if (stream.next_value(&value) != Json::success) {
+            exit(25);
+        } else if (key == "model") {
+            model = value.getString();
+        } else if (key == "n") {
+            n = value.getLong();
+        }
+    }
+    if (stream.end() != Json::success)
+        exit(26);
+    if (inputs != "\"a\"\"b\"3")
+        exit(27);
+    if (model != "m")
+        exit(28);
+    if (n != 1)
+        exit(29);
+    jt::JsonStream top("[1, [2], {\"x\": 3}] ");
+    if (top.begin_array() != Json::success)
+        exit(30);
+    std::string elems;
+    for (;;) {
+        if (top.next_element(&value, &done) != Json::success)
+            exit(31);
+        if (done)
+            break;
+        elems += value.toString();
+    }
+    if (top.end() != Json::success)
+        exit(32);
+    if (elems != "1[2]{\"x\":3}")
+        exit(33);
+    jt::JsonStream bad("{\"a\" 1}");
+    if (bad.begin_object() != Json::success)
+        exit(34);
+    if (bad.next_key(&key, &done) != Json::missing_colon)
+        exit(35);
+}
+
 static const struct
 {
     std::string before;
@@ -455,6 +522,7 @@ main()
     object_test();
     deep_test();
     parse_test();
+    stream_test();
     round_trip_test();
     afl_regression();
     json_test_suite();
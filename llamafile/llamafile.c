@@ -16,12 +16,14 @@
 // limitations under the License.
 
 #include "llamafile.h"
+#include "weightcache.h"
 #include "zip.h"
 #include <assert.h>
 #include <cosmo.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -58,6 +60,62 @@ struct llamafile {
     atomic_int refs;
 };
 
+struct llamafile_prefetcher {
+    struct llamafile *file;
+    int worker;
+    int workers;
+};
+
+static void *llamafile_prefetch_worker(void *arg) {
+    struct llamafile_prefetcher *pf = (struct llamafile_prefetcher *)arg;
+    struct llamafile *file = pf->file;
+    size_t pagesz = sysconf(_SC_PAGESIZE);
+    size_t window = 2 * 1024 * 1024;
+    size_t size = file->mapsize;
+    size_t beg = size * pf->worker / pf->workers & -pagesz;
+    size_t end = pf->worker + 1 == pf->workers ? size : size * (pf->worker + 1) / pf->workers & -pagesz;
+    volatile const char *p = (volatile const char *)file->mapping;
+    for (size_t off = beg; off < end; off += window) {
+        size_t got = Min(window, end - off);
+        madvise((char *)file->mapping + off, got, MADV_WILLNEED);
+        for (size_t i = 0; i < got; i += pagesz)
+            (void)p[off + i];
+    }
+    llamafile_unref(file);
+    free(pf);
+    return 0;
+}
+
+// starts faulting in weight pages behind the caller's back
+//
+// gguf tensors are laid out in layer order, so carving the mapping
+// into contiguous shards means the first worker pulls in the early
+// layers while prefill computation races it from layer zero, and the
+// rest of the workers keep the disk queue full for the later layers.
+// workers hold a reference so the mapping can't go away under them.
+static void llamafile_prefetch(struct llamafile *file, int workers) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 65536);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < workers; ++i) {
+        struct llamafile_prefetcher *pf;
+        if (!(pf = malloc(sizeof(struct llamafile_prefetcher))))
+            break;
+        pf->file = file;
+        pf->worker = i;
+        pf->workers = workers;
+        llamafile_ref(file);
+        pthread_t th;
+        if (pthread_create(&th, &attr, llamafile_prefetch_worker, pf)) {
+            llamafile_unref(file);
+            free(pf);
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
 static struct llamafile *llamafile_open_zip(const char *prog, const char *fname, const char *mode) {
     int fd = -1;
     uint8_t *bufdata = NULL;
@@ -211,21 +269,74 @@ static struct llamafile *llamafile_open_zip(const char *prog, const char *fname,
         fprintf(stderr, "%s: warning: use zipalign (rather than zip) to create llamafiles\n",
                 file->fname);
 
+    // when --weight-cache is set and zipalign stamped a content digest
+    // onto this entry, map the weights from the content-addressed cache
+    // file instead of the archive, so every process loading identical
+    // tensors from differently-packaged llamafiles shares one inode and
+    // therefore one set of physical pages. see weightcache.c
+    long skew = 0;
+    file->mapping = MAP_FAILED;
+    uint8_t digest[32];
+    if (FLAG_weight_cache && get_zip_cfile_sha256(cdirdata + cdir_offset, digest)) {
+        file->mapsize = file->size;
+        file->mapping = llamafile_weight_cache_map(digest, fd, off, file->size);
+        if (file->mapping != MAP_FAILED)
+            fprintf(stderr, "%s: mapping weights from shared cache\n", file->fname);
+    }
+
     // map the file into memory
-    long pagesz = sysconf(_SC_GRANSIZE);
-    off_t mapoff = off & -pagesz;
-    long skew = off - mapoff;
-    file->mapsize = skew + file->size;
-    file->mapping = mmap(0, file->mapsize, PROT_READ, MAP_SHARED, fd, mapoff);
     if (file->mapping == MAP_FAILED) {
-        fprintf(stderr, "%s: warning: failed to map zip file: %s\n", file->fname, strerror(errno));
-        goto Failure;
+        long pagesz = sysconf(_SC_GRANSIZE);
+        off_t mapoff = off & -pagesz;
+        skew = off - mapoff;
+        file->mapsize = skew + file->size;
+        file->mapping = mmap(0, file->mapsize, PROT_READ, MAP_SHARED, fd, mapoff);
+        if (file->mapping == MAP_FAILED) {
+            fprintf(stderr, "%s: warning: failed to map zip file: %s\n", file->fname,
+                    strerror(errno));
+            goto Failure;
+        }
+
+        errno_t err;
+        if ((err = posix_fadvise(fd, mapoff, file->mapsize, POSIX_FADV_SEQUENTIAL)) &&
+            err != ENOSYS)
+            fprintf(stderr, "%s: warning: posix_fadvise(.., POSIX_FADV_SEQUENTIAL) failed: %s\n",
+                    file->fname, strerror(err));
+    }
+
+    // ask the kernel to back the weights with huge pages, which cuts
+    // dtlb pressure considerably when decode strides over tens of
+    // gigabytes of tensors. promotion happens asynchronously as
+    // khugepaged collapses the read-only file pages behind us, so all
+    // we can report up front is that the request was accepted. needs
+    // CONFIG_READ_ONLY_THP_FOR_FS on linux; other systems say ENOSYS
+    // or EINVAL, which is fine, since this is only advice
+    if (FLAG_hugepages) {
+        if (!madvise(file->mapping, file->mapsize, MADV_HUGEPAGE))
+            fprintf(stderr, "%s: hugepage promotion requested for %zu MiB of weights\n",
+                    file->fname, file->mapsize >> 20);
+        else if (errno != ENOSYS && errno != EINVAL)
+            fprintf(stderr, "%s: warning: madvise(.., MADV_HUGEPAGE) failed: %s\n", file->fname,
+                    strerror(errno));
     }
 
-    errno_t err;
-    if ((err = posix_fadvise(fd, mapoff, file->mapsize, POSIX_FADV_SEQUENTIAL)) && err != ENOSYS)
-        fprintf(stderr, "%s: warning: posix_fadvise(.., POSIX_FADV_SEQUENTIAL) failed: %s\n",
-                file->fname, strerror(err));
+    // under --numa, weight placement is deliberately deferred to the
+    // first multiply of each tensor, where its row geometry is known;
+    // see llamafile_sgemm(). faulting the whole mapping here would
+    // fix every page on whichever socket happened to run the loader
+
+    // on cold caches the first prefill otherwise serializes on page
+    // faults, so start pulling tensor pages in layer order now. gpu
+    // offload copies the weights out layer by layer right after this
+    // returns, so there the default is on, letting disk reads overlap
+    // the uploads instead of each cudaMemcpy faulting its own pages.
+    // cpu-only runs keep it opt-in since a model bigger than ram
+    // would get pushed out of the page cache as fast as it came in
+    int prefetchers = FLAG_prefetch;
+    if (prefetchers < 0)
+        prefetchers = FLAG_gpu != LLAMAFILE_GPU_DISABLE && FLAG_n_gpu_layers ? 4 : 0;
+    if (prefetchers > 0)
+        llamafile_prefetch(file, prefetchers);
 
     // setup our synthetic file
     file->position = 0;
@@ -9,7 +9,11 @@ extern "C" {
 extern bool FLAGS_READY;
 extern bool FLAG_ascii;
 extern bool FLAG_completion_mode;
+extern bool FLAG_ecores;
+extern bool FLAG_embedding;
+extern bool FLAG_cold_tier;
 extern bool FLAG_fast;
+extern bool FLAG_hugepages;
 extern bool FLAG_iq;
 extern bool FLAG_log_disable;
 extern bool FLAG_mlock;
@@ -17,23 +21,38 @@ extern bool FLAG_mmap;
 extern bool FLAG_no_display_prompt;
 extern bool FLAG_nocompile;
 extern bool FLAG_nologo;
+extern bool FLAG_notune;
+extern bool FLAG_numa;
 extern bool FLAG_precise;
 extern bool FLAG_recompile;
+extern bool FLAG_repack;
+extern bool FLAG_supervise;
 extern bool FLAG_tinyblas;
 extern bool FLAG_trace;
 extern bool FLAG_trap;
 extern bool FLAG_unsecure;
 extern bool FLAG_v2;
+extern const char *FLAG_cache_type_k;
+extern const char *FLAG_cache_type_v;
 extern const char *FLAG_chat_template;
 extern const char *FLAG_db;
 extern const char *FLAG_db_startup_sql;
+extern const char *FLAG_dso_cache_dir;
+extern const char *FLAG_eventlog;
+extern const char *FLAG_extra_models[16];
 extern const char *FLAG_file;
 extern const char *FLAG_ip_header;
 extern const char *FLAG_listen;
+extern const char *FLAG_draft_model;
 extern const char *FLAG_mmproj;
 extern const char *FLAG_model;
+extern const char *FLAG_precision;
 extern const char *FLAG_prompt;
+extern const char *FLAG_record;
+extern const char *FLAG_slot_buckets;
+extern const char *FLAG_tensor_split;
 extern const char *FLAG_url_prefix;
+extern const char *FLAG_weight_cache;
 extern const char *FLAG_www_root;
 extern double FLAG_token_rate;
 extern float FLAG_decay_growth;
@@ -43,18 +62,36 @@ extern float FLAG_reserve_tokens;
 extern float FLAG_temperature;
 extern float FLAG_top_p;
 extern int FLAG_batch;
+extern int FLAG_batch_max_wait;
+extern int FLAG_completion_cache_size;
 extern int FLAG_ctx_size;
 extern int FLAG_decay_delay;
+extern int FLAG_draft_tokens;
+extern int FLAG_embedding_window;
+extern int FLAG_extra_model_count;
 extern int FLAG_flash_attn;
+extern bool FLAG_kv_snapshots;
+extern bool FLAG_modelfile;
 extern int FLAG_gpu;
+extern int FLAG_hibernate;
+extern int FLAG_hot_models;
 extern int FLAG_gpu;
 extern int FLAG_http_ibuf_size;
 extern int FLAG_http_obuf_size;
 extern int FLAG_keepalive;
+extern int FLAG_kv_cells;
 extern int FLAG_main_gpu;
+extern int FLAG_max_queue_time;
+extern int FLAG_meter_quota;
+extern int FLAG_modelfile_rate;
 extern int FLAG_n_gpu_layers;
+extern int FLAG_prefetch;
+extern int FLAG_request_timeout;
+extern int FLAG_send_backlog;
 extern int FLAG_slots;
 extern int FLAG_split_mode;
+extern int FLAG_sse_flush_ms;
+extern int FLAG_warm_models;
 extern int FLAG_threads;
 extern int FLAG_threads_batch;
 extern int FLAG_token_burst;
@@ -63,6 +100,7 @@ extern int FLAG_ubatch;
 extern int FLAG_verbose;
 extern int FLAG_warmup;
 extern int FLAG_workers;
+extern int FLAG_workers_max;
 extern unsigned FLAG_seed;
 
 struct llamafile;
@@ -91,6 +129,7 @@ bool llamafile_extract(const char *, const char *);
 int llamafile_is_file_newer_than(const char *, const char *);
 void llamafile_schlep(const void *, size_t);
 void llamafile_get_app_dir(char *, size_t);
+const char *llamafile_transcode_model(const char *, const char *);
 void llamafile_launch_browser(const char *);
 void llamafile_get_flags(int, char **);
 
@@ -100,11 +139,16 @@ void llamafile_get_flags(int, char **);
 #define LLAMAFILE_GPU_AMD 1
 #define LLAMAFILE_GPU_APPLE 2
 #define LLAMAFILE_GPU_NVIDIA 4
+#define LLAMAFILE_GPU_VULKAN 8
 bool llamafile_has_gpu(void);
 int llamafile_gpu_layers(int);
 bool llamafile_has_cuda(void);
 bool llamafile_has_metal(void);
+bool llamafile_has_vulkan(void);
 bool llamafile_has_amd_gpu(void);
+void llamafile_cuda_register_source(const char *, const char *);
+void llamafile_cuda_register_header(const char *, const char *);
+void *llamafile_cuda_dlsym(const char *);
 int llamafile_gpu_parse(const char *);
 const char *llamafile_describe_gpu(void);
 
@@ -0,0 +1,180 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "numa.h"
+
+#include <cosmo.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// numa topology support for multi-socket machines
+//
+// weight matrices get mapped into memory once, but on a dual socket
+// machine half the matmul threads end up reaching across the package
+// interconnect for every panel of every weight. the matmul work split
+// already hands thread ith a contiguous row band, so if the threads
+// serving the first band fault the corresponding pages in from the
+// socket that'll keep reading them, the kernel places each band of
+// the page cache on the socket that consumes it.
+
+#define MAX_NODES 64
+
+static int g_nodes;
+static cpu_set_t g_node_cpus[MAX_NODES];
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+// parses sysfs cpulist syntax, e.g. "0-15,32-47"
+static bool parse_cpulist(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    bool got = false;
+    while (*s && *s != '\n') {
+        char *ep;
+        long lo, hi;
+        lo = hi = strtol(s, &ep, 10);
+        if (ep == s)
+            return false;
+        s = ep;
+        if (*s == '-') {
+            hi = strtol(s + 1, &ep, 10);
+            if (ep == s + 1)
+                return false;
+            s = ep;
+        }
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+            return false;
+        for (long i = lo; i <= hi; ++i)
+            CPU_SET(i, set);
+        got = true;
+        if (*s == ',')
+            ++s;
+    }
+    return got;
+}
+
+static void detect_topology(void) {
+    g_nodes = 1;
+    if (!IsLinux())
+        return;
+    int n = 0;
+    for (int i = 0; i < MAX_NODES; ++i) {
+        FILE *f;
+        char buf[512];
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", i);
+        if (!(f = fopen(path, "re")))
+            break;
+        bool ok = fgets(buf, sizeof(buf), f) && parse_cpulist(buf, &g_node_cpus[n]);
+        fclose(f);
+        if (!ok)
+            break;
+        ++n;
+    }
+    if (n > 1)
+        g_nodes = n;
+}
+
+/**
+ * Returns number of NUMA nodes on this machine.
+ *
+ * Single socket machines, and platforms where the topology can't be
+ * discovered, report a single node, in which case the rest of this
+ * module turns into a no-op.
+ */
+int llamafile_numa_nodes(void) {
+    pthread_once(&g_once, detect_topology);
+    return g_nodes;
+}
+
+/**
+ * Pins calling thread to the node that owns its share of the work.
+ *
+ * Threads are assigned to sockets in band order, which lines up with
+ * the contiguous `duty * ith` row band each matmul thread consumes,
+ * so thread ith of nth mostly touches memory its own socket faulted.
+ */
+void llamafile_numa_pin(int ith, int nth) {
+    int nodes = llamafile_numa_nodes();
+    if (nodes < 2 || nth < 1 || ith >= nth)
+        return;
+    int node = (long)ith * nodes / nth;
+    sched_setaffinity(0, sizeof(cpu_set_t), &g_node_cpus[node]);
+}
+
+struct sharder {
+    const char *data;
+    size_t row;
+    long rows;
+    int node;
+    int nodes;
+};
+
+static void *shard_worker(void *arg) {
+    struct sharder *s = (struct sharder *)arg;
+    size_t pagesz = sysconf(_SC_PAGESIZE);
+    size_t beg = s->row * ((size_t)s->rows * s->node / s->nodes) & -pagesz;
+    size_t end = s->node + 1 == s->nodes
+                     ? s->row * s->rows
+                     : s->row * ((size_t)s->rows * (s->node + 1) / s->nodes) & -pagesz;
+    if (beg >= end)
+        return 0;
+    sched_setaffinity(0, sizeof(cpu_set_t), &g_node_cpus[s->node]);
+    madvise((void *)(s->data + beg), end - beg, MADV_WILLNEED);
+    volatile const char *p = s->data;
+    for (size_t i = beg; i < end; i += pagesz)
+        (void)p[i];
+    return 0;
+}
+
+/**
+ * Distributes the row bands of a weight matrix across NUMA nodes.
+ *
+ * The matmul work split hands thread ith a contiguous band of output
+ * rows, and llamafile_numa_pin() assigns threads to sockets in band
+ * order, so each node gets one thread, pinned to that node, faulting
+ * in rows [rows*node/nodes, rows*(node+1)/nodes) of the matrix. That
+ * leaves every socket holding exactly the band its threads keep
+ * reading. Banding the model file as a whole wouldn't do: a tensor
+ * in the middle of the file lands entirely on one socket, and every
+ * other socket reaches across the interconnect for its share of it.
+ * Pages that are already resident stay where they are, so only cold
+ * pages get placed; call this before anything else faults them.
+ */
+void llamafile_numa_shard(const void *data, size_t row, long rows) {
+    int nodes = llamafile_numa_nodes();
+    if (nodes < 2 || !data || !row || rows <= 0)
+        return;
+    pthread_t th[MAX_NODES];
+    struct sharder ss[MAX_NODES];
+    int spawned = 0;
+    for (int i = 0; i < nodes; ++i) {
+        ss[i].data = (const char *)data;
+        ss[i].row = row;
+        ss[i].rows = rows;
+        ss[i].node = i;
+        ss[i].nodes = nodes;
+        if (pthread_create(&th[i], 0, shard_worker, &ss[i]))
+            break;
+        ++spawned;
+    }
+    for (int i = 0; i < spawned; ++i)
+        pthread_join(th[i], 0);
+}
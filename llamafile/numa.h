@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int llamafile_numa_nodes(void);
+void llamafile_numa_pin(int, int);
+void llamafile_numa_shard(const void *, size_t, long);
+
+#ifdef __cplusplus
+}
+#endif
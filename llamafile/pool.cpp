@@ -22,9 +22,12 @@
 #include <pthread.h>
 #include <sched.h>
 #include <stdatomic.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "chaos.h"
 #include "threadlocal.h"
+#include "trace.h"
 
 struct llamafile_thread;
 static void llamafile_thread_canceled(llamafile_thread *);
@@ -37,6 +40,7 @@ struct llamafile_task {
     void *(*func)(void *);
     void *arg;
     void *res;
+    llamafile_task_context ctx;
 };
 
 struct llamafile_thread {
@@ -45,10 +49,36 @@ struct llamafile_thread {
     pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
     llamafile_task *task;
     llamafile_thread *next;
+    bool accounted = false; // counted in g_interactive
 };
 
 static atomic_int g_active;
-static atomic_uintptr_t g_idle;
+
+// request context travels with the work: whatever context the
+// spawning thread had installed when it called task_create is what
+// the task runs under, so a batch job's image decodes stay batch no
+// matter how many pool hops deep they happen
+static constexpr llamafile_task_context g_default_context = {
+    LLAMAFILE_PRIORITY_INTERACTIVE, 0};
+static thread_local llamafile_task_context g_context = g_default_context;
+
+// interactive tasks currently executing, which is what batch loops
+// poll to decide whether to get out of the way
+static atomic_int g_interactive;
+
+// the idle list is split across multiple aba-tagged treiber stacks so
+// threads dispatching tasks in bursts don't all cas the same cache
+// line. a parked thread goes onto the stripe its address hashes to,
+// and dispatchers rotate their starting stripe, stealing from the
+// other stripes whenever their first choice comes up empty.
+#define STRIPES 8
+
+struct idle_stack {
+    alignas(64) atomic_uintptr_t tip;
+};
+
+static idle_stack g_idle[STRIPES];
+static atomic_uint g_rotor;
 
 #define MASQUE 0x00fffffffffffff0
 #define PTR(x) ((uintptr_t)(x) & MASQUE)
@@ -57,30 +87,50 @@ static atomic_uintptr_t g_idle;
 #define ROL(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
 #define ROR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
 
+static unsigned idle_stripe(llamafile_thread *thread) {
+    return ((uintptr_t)thread >> 6) % STRIPES;
+}
+
 static void idle_push(llamafile_thread *thread) {
     uintptr_t tip;
     unassert(!TAG(thread));
-    tip = atomic_load_explicit(&g_idle, memory_order_relaxed);
+    idle_stack *stack = &g_idle[idle_stripe(thread)];
+    tip = atomic_load_explicit(&stack->tip, memory_order_relaxed);
     for (;;) {
         thread->next = (llamafile_thread *)PTR(tip);
-        if (atomic_compare_exchange_weak_explicit(&g_idle, &tip, ABA(thread, TAG(tip) + 1),
+        LLAMAFILE_CHAOS_POINT("pool_idle_push");
+        if (atomic_compare_exchange_weak_explicit(&stack->tip, &tip, ABA(thread, TAG(tip) + 1),
                                                   memory_order_release, memory_order_relaxed))
             break;
     }
 }
 
-static llamafile_thread *idle_pop(void) {
+static llamafile_thread *idle_pop_stripe(idle_stack *stack) {
     uintptr_t tip;
     llamafile_thread *thread;
-    tip = atomic_load_explicit(&g_idle, memory_order_relaxed);
-    while ((thread = (llamafile_thread *)PTR(tip)))
-        if (atomic_compare_exchange_weak_explicit(&g_idle, &tip, ABA(thread->next, TAG(tip) + 1),
+    tip = atomic_load_explicit(&stack->tip, memory_order_relaxed);
+    while ((thread = (llamafile_thread *)PTR(tip))) {
+        LLAMAFILE_CHAOS_POINT("pool_idle_pop");
+        if (atomic_compare_exchange_weak_explicit(&stack->tip, &tip,
+                                                  ABA(thread->next, TAG(tip) + 1),
                                                   memory_order_acquire, memory_order_relaxed))
             break;
+    }
     return thread;
 }
 
+static llamafile_thread *idle_pop(void) {
+    unsigned start = atomic_fetch_add_explicit(&g_rotor, 1, memory_order_relaxed);
+    for (unsigned i = 0; i < STRIPES; ++i) {
+        llamafile_thread *thread;
+        if ((thread = idle_pop_stripe(&g_idle[(start + i) % STRIPES])))
+            return thread;
+    }
+    return nullptr;
+}
+
 static void cancel_task(llamafile_task *task) {
+    LLAMAFILE_CHAOS_POINT("pool_cancel");
     pthread_mutex_lock(&task->mu);
     task->res = PTHREAD_CANCELED;
     atomic_store_explicit(&task->th, 0, memory_order_release);
@@ -90,6 +140,8 @@ static void cancel_task(llamafile_task *task) {
 
 static void llamafile_thread_canceled(llamafile_thread *thread) {
     atomic_store_explicit(&thread->th, 0, memory_order_release);
+    if (thread->accounted)
+        --g_interactive;
     cancel_task(thread->task);
     delete thread;
     --g_active;
@@ -102,9 +154,22 @@ static void *llamafile_thread_worker(void *arg) {
     ++g_active;
     g_key.set(thread);
     do {
+        g_context = thread->task->ctx;
+        thread->accounted =
+            g_context.priority == LLAMAFILE_PRIORITY_INTERACTIVE;
+        if (thread->accounted)
+            ++g_interactive;
+        llamafile_trace_begin_cat("task", "pool");
         void *res = thread->task->func(thread->task->arg);
+        llamafile_trace_end_cat("task", "pool");
+        if (thread->accounted) {
+            --g_interactive;
+            thread->accounted = false;
+        }
+        g_context = g_default_context;
         pthread_setcancelstate(PTHREAD_CANCEL_MASKED, 0);
 
+        LLAMAFILE_CHAOS_POINT("pool_result_handshake");
         for (;;)
             if (atomic_load_explicit(&thread->th, memory_order_acquire) != -1)
                 if (atomic_load_explicit(&thread->task->th, memory_order_acquire) != -1)
@@ -119,6 +184,7 @@ static void *llamafile_thread_worker(void *arg) {
         pthread_mutex_lock(&thread->mu);
         thread->task = nullptr;
         idle_push(thread);
+        LLAMAFILE_CHAOS_POINT("pool_park");
         while (!thread->task) {
             err = pthread_cond_wait(&thread->cv, &thread->mu);
             if (err == ECANCELED)
@@ -163,9 +229,11 @@ errno_t llamafile_task_create(llamafile_task **out_task, void *(*func)(void *),
     llamafile_task *task = new llamafile_task;
     task->func = func;
     task->arg = arg;
+    task->ctx = g_context;
     errno_t err;
     llamafile_thread *thread;
     if ((thread = idle_pop())) {
+        LLAMAFILE_CHAOS_POINT("pool_dispatch");
         pthread_mutex_lock(&thread->mu);
         atomic_store_explicit(&task->th, atomic_load_explicit(&thread->th, memory_order_relaxed),
                               memory_order_release);
@@ -212,6 +280,48 @@ errno_t llamafile_task_cancel(llamafile_task *task) {
     return err;
 }
 
+// installs a request context on the calling thread. tasks spawned
+// afterwards inherit a snapshot of it. on a pool thread this also
+// keeps the interactive accounting straight when a running task
+// reclassifies itself
+void llamafile_task_set_context(const llamafile_task_context *ctx) {
+    llamafile_thread *thread;
+    bool interactive = ctx->priority == LLAMAFILE_PRIORITY_INTERACTIVE;
+    if ((thread = g_key.get()) && thread->accounted != interactive) {
+        if (interactive)
+            ++g_interactive;
+        else
+            --g_interactive;
+        thread->accounted = interactive;
+    }
+    g_context = *ctx;
+}
+
+void llamafile_task_get_context(llamafile_task_context *out_ctx) {
+    *out_ctx = g_context;
+}
+
+// returns nonzero when a batch classified caller should get out of
+// the way, i.e. interactive work is executing somewhere in the pool.
+// long running batch loops poll this between strides and nap when it
+// fires, which is how priority is enforced in a pool that hands
+// every task a thread the moment it's created
+int llamafile_task_should_yield(void) {
+    return g_context.priority == LLAMAFILE_PRIORITY_BATCH &&
+           atomic_load_explicit(&g_interactive, memory_order_relaxed) > 0;
+}
+
+// returns nonzero once the calling thread's context deadline has
+// passed, so cooperative loops can stop burning cycles on a result
+// nobody is waiting for anymore
+int llamafile_task_past_deadline(void) {
+    if (!g_context.deadline)
+        return 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)timespec_tonanos(now) >= g_context.deadline;
+}
+
 void llamafile_task_shutdown(void) {
     pthread_t th;
     int backoff = 0;
@@ -222,7 +332,7 @@ void llamafile_task_shutdown(void) {
                 pthread_cancel(th);
         if (!g_active)
             break;
-        backoff = pthread_delay_np(&g_idle, backoff);
+        backoff = pthread_delay_np(g_idle, backoff);
     }
 }
 
@@ -5,10 +5,26 @@ extern "C" {
 
 typedef struct llamafile_task *llamafile_task_t;
 
+// priority classes for llamafile_task_context
+#define LLAMAFILE_PRIORITY_INTERACTIVE 0
+#define LLAMAFILE_PRIORITY_BATCH 1
+
+// request identity that tasks inherit from the thread that spawns
+// them. `deadline` is an absolute CLOCK_MONOTONIC nanosecond count,
+// or zero when the work has no deadline
+struct llamafile_task_context {
+    int priority;
+    unsigned long deadline;
+};
+
 errno_t llamafile_task_create(llamafile_task_t *, void *(*)(void *), void *);
 errno_t llamafile_task_join(llamafile_task_t, void **);
 errno_t llamafile_task_cancel(llamafile_task_t);
 void llamafile_task_shutdown(void);
+void llamafile_task_set_context(const struct llamafile_task_context *);
+void llamafile_task_get_context(struct llamafile_task_context *);
+int llamafile_task_should_yield(void);
+int llamafile_task_past_deadline(void);
 
 #ifdef __cplusplus
 }
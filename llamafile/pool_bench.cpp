@@ -0,0 +1,85 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pool.h"
+
+#include <assert.h>
+#include <cosmo.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+// measures task dispatch latency when many threads hand off work at
+// once, which is where contention on the idle thread list shows up
+
+#define BENCHMARK(ITERATIONS, WORK_PER_RUN, CODE) \
+    do { \
+        struct timespec start = timespec_real(); \
+        for (int __i = 0; __i < ITERATIONS; ++__i) { \
+            asm volatile("" ::: "memory"); \
+            CODE; \
+        } \
+        long long work = ((WORK_PER_RUN) ? (WORK_PER_RUN) : 1) * (ITERATIONS); \
+        double nanos = \
+            (timespec_tonanos(timespec_sub(timespec_real(), start)) + work - 1) / (double)work; \
+        if (nanos < 1000) { \
+            printf("%10g ns %2dx %s\n", nanos, (ITERATIONS), #CODE); \
+        } else { \
+            printf("%10lld ns %2dx %s\n", (long long)nanos, (ITERATIONS), #CODE); \
+        } \
+    } while (0)
+
+#define DISPATCHERS 8
+#define BURST 16
+
+void *noop(void *arg) {
+    return arg;
+}
+
+void dispatch_burst() {
+    llamafile_task_t task[BURST];
+    for (int i = 0; i < BURST; ++i)
+        npassert(!llamafile_task_create(&task[i], noop, 0));
+    for (int i = 0; i < BURST; ++i)
+        npassert(!llamafile_task_join(task[i], 0));
+}
+
+void *dispatcher(void *arg) {
+    for (int i = 0; i < 10; ++i)
+        dispatch_burst();
+    return 0;
+}
+
+void contended_dispatch() {
+    pthread_t th[DISPATCHERS];
+    for (int i = 0; i < DISPATCHERS; ++i)
+        npassert(!pthread_create(&th[i], 0, dispatcher, 0));
+    for (int i = 0; i < DISPATCHERS; ++i)
+        npassert(!pthread_join(th[i], 0));
+}
+
+int main(int argc, char *argv[]) {
+    ShowCrashReports();
+    dispatch_burst();
+    contended_dispatch();
+    BENCHMARK(100, BURST, dispatch_burst());
+    BENCHMARK(10, DISPATCHERS * 10 * BURST, contended_dispatch());
+    llamafile_task_shutdown();
+    while (!pthread_orphan_np())
+        pthread_decimate_np();
+    CheckForMemoryLeaks();
+}
@@ -0,0 +1,126 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "chaos.h"
+#include "pool.h"
+
+#include <assert.h>
+#include <cosmo.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// schedule perturbing stress test for the thread pool
+//
+// the pool sources are compiled with -DLLAMAFILE_CHAOS here, so
+// every LLAMAFILE_CHAOS_POINT inside pool.cpp becomes a randomized
+// delay. the invariants checked are the ones production races have
+// violated before: every dispatched task runs exactly once (a lost
+// wakeup shows up as a hung join, which the watchdog turns into a
+// crash report), results are never crossed between tasks, and
+// canceled tasks always report PTHREAD_CANCELED. when a seed fails,
+// the harness reruns it through llamafile_chaos_minimize() and
+// prints the fewest perturbation sites that still reproduce, which
+// names the racing code paths
+
+#define SEEDS 12
+#define DISPATCHERS 4
+#define TASKS_PER_DISPATCHER 50
+
+static atomic_int g_runs;
+
+static void *counting(void *arg) {
+    ++g_runs;
+    return arg;
+}
+
+static void *dispatcher(void *arg) {
+    int base = (int)(intptr_t)arg * TASKS_PER_DISPATCHER;
+    llamafile_task_t task[TASKS_PER_DISPATCHER];
+    for (int i = 0; i < TASKS_PER_DISPATCHER; ++i)
+        if (llamafile_task_create(&task[i], counting, (void *)(intptr_t)(base + i + 1)))
+            return (void *)1;
+    for (int i = 0; i < TASKS_PER_DISPATCHER; ++i) {
+        void *res;
+        if (llamafile_task_join(task[i], &res))
+            return (void *)1;
+        // results crossed between tasks mean the handoff raced
+        if (res != (void *)(intptr_t)(base + i + 1))
+            return (void *)1;
+    }
+    return 0;
+}
+
+static void *sleeper(void *arg) {
+    pause();
+    return 0;
+}
+
+// runs one dispatch storm plus one cancellation storm under the
+// given schedule disposition. returns nonzero on invariant failure
+static int storm(unsigned long seed, unsigned long mask) {
+    llamafile_chaos_setup(seed, mask);
+    g_runs = 0;
+    pthread_t th[DISPATCHERS];
+    for (int i = 0; i < DISPATCHERS; ++i)
+        npassert(!pthread_create(&th[i], 0, dispatcher, (void *)(intptr_t)i));
+    int failed = 0;
+    for (int i = 0; i < DISPATCHERS; ++i) {
+        void *res;
+        npassert(!pthread_join(th[i], &res));
+        failed |= !!res;
+    }
+    if (g_runs != DISPATCHERS * TASKS_PER_DISPATCHER)
+        failed = 1;
+    for (int i = 0; i < DISPATCHERS; ++i) {
+        void *res;
+        llamafile_task_t task;
+        npassert(!llamafile_task_create(&task, sleeper, 0));
+        npassert(!llamafile_task_cancel(task));
+        npassert(!llamafile_task_join(task, &res));
+        if (res != PTHREAD_CANCELED)
+            failed = 1;
+    }
+    llamafile_chaos_setup(0, 0);
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    ShowCrashReports();
+
+    // a lost wakeup hangs a join forever rather than failing, so
+    // convert that into a crash report instead of a stuck test
+    alarm(300);
+
+    for (unsigned long seed = 1; seed <= SEEDS; ++seed) {
+        if (storm(seed, ~0ul)) {
+            unsigned long mask = llamafile_chaos_minimize(storm, seed, ~0ul);
+            fprintf(stderr, "pool invariants failed under seed %lu; "
+                            "minimal failing sites:\n", seed);
+            for (int bit = 0; bit < 64; ++bit)
+                if (mask & (1ul << bit) && llamafile_chaos_sitename(bit))
+                    fprintf(stderr, "  %s\n", llamafile_chaos_sitename(bit));
+            return 1;
+        }
+    }
+
+    llamafile_task_shutdown();
+    while (!pthread_orphan_np())
+        pthread_decimate_np();
+    CheckForMemoryLeaks();
+}
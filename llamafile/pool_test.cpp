@@ -20,6 +20,8 @@
 #include <assert.h>
 #include <cosmo.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <time.h>
 
@@ -74,8 +76,81 @@ void run_many_threads() {
         npassert(!pthread_join(task[i], 0));
 }
 
+void *probe_context(void *arg) {
+    llamafile_task_get_context((struct llamafile_task_context *)arg);
+    return 0;
+}
+
+static atomic_int g_started;
+static atomic_int g_release;
+
+void *hold_task(void *arg) {
+    atomic_store(&g_started, 1);
+    while (!atomic_load(&g_release))
+        sched_yield();
+    return 0;
+}
+
+void *yield_probe(void *arg) {
+    *(int *)arg = llamafile_task_should_yield();
+    return 0;
+}
+
+void *deadline_probe(void *arg) {
+    *(int *)arg = llamafile_task_past_deadline();
+    return 0;
+}
+
+void test_context() {
+    llamafile_task_t task;
+
+    // tasks inherit the spawning thread's context, and workers reset
+    // to the interactive default between tasks
+    struct llamafile_task_context got = {-1, 0};
+    struct llamafile_task_context batch = {LLAMAFILE_PRIORITY_BATCH, 123};
+    llamafile_task_set_context(&batch);
+    npassert(!llamafile_task_create(&task, probe_context, &got));
+    npassert(!llamafile_task_join(task, 0));
+    npassert(got.priority == LLAMAFILE_PRIORITY_BATCH);
+    npassert(got.deadline == 123);
+    struct llamafile_task_context inter = {LLAMAFILE_PRIORITY_INTERACTIVE, 0};
+    llamafile_task_set_context(&inter);
+    npassert(!llamafile_task_create(&task, probe_context, &got));
+    npassert(!llamafile_task_join(task, 0));
+    npassert(got.priority == LLAMAFILE_PRIORITY_INTERACTIVE);
+
+    // batch tasks should yield exactly while interactive work runs
+    llamafile_task_t holder;
+    npassert(!llamafile_task_create(&holder, hold_task, 0));
+    while (!atomic_load(&g_started))
+        sched_yield();
+    int yielded = -1;
+    llamafile_task_set_context(&batch);
+    npassert(!llamafile_task_create(&task, yield_probe, &yielded));
+    npassert(!llamafile_task_join(task, 0));
+    npassert(yielded == 1);
+    atomic_store(&g_release, 1);
+    npassert(!llamafile_task_join(holder, 0));
+    npassert(!llamafile_task_create(&task, yield_probe, &yielded));
+    npassert(!llamafile_task_join(task, 0));
+    npassert(yielded == 0);
+
+    // a deadline in the past fires, no deadline never does
+    int expired = -1;
+    struct llamafile_task_context late = {LLAMAFILE_PRIORITY_BATCH, 1};
+    llamafile_task_set_context(&late);
+    npassert(!llamafile_task_create(&task, deadline_probe, &expired));
+    npassert(!llamafile_task_join(task, 0));
+    npassert(expired == 1);
+    llamafile_task_set_context(&inter);
+    npassert(!llamafile_task_create(&task, deadline_probe, &expired));
+    npassert(!llamafile_task_join(task, 0));
+    npassert(expired == 0);
+}
+
 int main(int argc, char *argv[]) {
     ShowCrashReports();
+    test_context();
     run_many_tasks();
     BENCHMARK(10, 1, run_task());
     BENCHMARK(10, 1, run_thread());
@@ -22,3 +22,19 @@ CREATE TABLE messages (
     frequency_penalty REAL,
     FOREIGN KEY (chat_id) REFERENCES chats(id)
 );
+
+-- id is the rowid, so this index orders each conversation's messages
+-- by insertion and lets windowed queries touch only the rows they
+-- return rather than scanning the whole table
+CREATE INDEX messages_by_chat ON messages (chat_id);
+
+-- message embeddings power /search. one normalized float32 vector per
+-- message, tagged with the model that produced it so vectors from
+-- different models never get compared. the server's background
+-- indexer fills in whichever messages have no vector yet
+CREATE TABLE embeddings (
+    message_id INTEGER PRIMARY KEY,
+    model TEXT,
+    embedding BLOB,
+    FOREIGN KEY (message_id) REFERENCES messages(id)
+);
@@ -13,7 +13,7 @@ LLAMAFILE_SERVER_ASSETS = $(wildcard llamafile/server/www/*)
 $(LLAMAFILE_SERVER_OBJS): private CCFLAGS += -g
 
 o/$(MODE)/llamafile/server/server.a:						\
-		$(filter-out %_test.o,$(LLAMAFILE_SERVER_OBJS))
+		$(filter-out %_test.o %/replay.o %/eventlogcat.o,$(LLAMAFILE_SERVER_OBJS))
 
 o/$(MODE)/llamafile/server/main:						\
 		o/$(MODE)/llamafile/server/main.o				\
@@ -22,6 +22,7 @@ o/$(MODE)/llamafile/server/main:						\
 		o/$(MODE)/llama.cpp/llama.cpp.a					\
 		o/$(MODE)/llama.cpp/llava/llava.a				\
 		o/$(MODE)/third_party/double-conversion/double-conversion.a	\
+		o/$(MODE)/third_party/mbedtls/mbedtls.a				\
 		o/$(MODE)/third_party/stb/stb.a					\
 		o/$(MODE)/third_party/sqlite/sqlite3.a				\
 		$(LLAMAFILE_SERVER_ASSETS:%=o/$(MODE)/%.zip.o)			\
@@ -46,16 +47,50 @@ o/$(MODE)/llamafile/server/fastjson_test:					\
 		o/$(MODE)/llamafile/server/fastjson.o				\
 		o/$(MODE)/double-conversion/double-conversion.a			\
 
+o/$(MODE)/llamafile/server/utf_test:						\
+		o/$(MODE)/llamafile/server/utf_test.o				\
+		o/$(MODE)/llamafile/server/utf.o				\
+
 o/$(MODE)/llamafile/server/tokenbucket_test:					\
 		o/$(MODE)/llamafile/server/tokenbucket_test.o			\
 		o/$(MODE)/llamafile/server/tokenbucket.o			\
 		o/$(MODE)/llamafile/server/log.o				\
 		o/$(MODE)/llama.cpp/llama.cpp.a					\
 
+o/$(MODE)/llamafile/server/tokencache_test:					\
+		o/$(MODE)/llamafile/server/tokencache_test.o			\
+		o/$(MODE)/llamafile/server/tokencache.o				\
+
+o/$(MODE)/llamafile/server/stop_matcher_test:					\
+		o/$(MODE)/llamafile/server/stop_matcher_test.o			\
+		o/$(MODE)/llamafile/server/stop_matcher.o			\
+
+o/$(MODE)/llamafile/server/philox_test:						\
+		o/$(MODE)/llamafile/server/philox_test.o			\
+
+o/$(MODE)/llamafile/server/recorder_test:					\
+		o/$(MODE)/llamafile/server/recorder_test.o			\
+		o/$(MODE)/llamafile/server/recorder.o				\
+		o/$(MODE)/llamafile/server/log.o				\
+		o/$(MODE)/llama.cpp/llama.cpp.a					\
+
+o/$(MODE)/llamafile/server/replay:						\
+		o/$(MODE)/llamafile/server/replay.o				\
+
+o/$(MODE)/llamafile/server/eventlogcat:						\
+		o/$(MODE)/llamafile/server/eventlogcat.o			\
+
 .PHONY: o/$(MODE)/llamafile/server
 o/$(MODE)/llamafile/server:							\
 		o/$(MODE)/llamafile/server/main					\
+		o/$(MODE)/llamafile/server/replay				\
+		o/$(MODE)/llamafile/server/eventlogcat				\
 		o/$(MODE)/llamafile/server/atom_test.runs			\
+		o/$(MODE)/llamafile/server/recorder_test.runs			\
 		o/$(MODE)/llamafile/server/fastjson_test.runs			\
 		o/$(MODE)/llamafile/server/image_test.runs			\
 		o/$(MODE)/llamafile/server/tokenbucket_test.runs		\
+		o/$(MODE)/llamafile/server/stop_matcher_test.runs		\
+		o/$(MODE)/llamafile/server/tokencache_test.runs			\
+		o/$(MODE)/llamafile/server/utf_test.runs			\
+		o/$(MODE)/llamafile/server/philox_test.runs			\
@@ -0,0 +1,152 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llamafile/json.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/slots.h"
+
+using jt::Json;
+
+namespace lf {
+namespace server {
+
+// endpoints for managing lora adapters at runtime
+//
+// adapters load and unload without the server restarting, so one
+// base model can serve many fine tunes while every warm slot and
+// render cache entry stays exactly as warm as it was. requests pick
+// an adapter with the `adapter` field of their completion body
+
+// parses the json object posted to the adapter management endpoints
+static bool
+get_adapter_params(Client* client, Json* json)
+{
+    if (client->msg_.method != kHttpPost) {
+        client->send_error(405);
+        return false;
+    }
+    if (!client->read_payload())
+        return false;
+    auto [status, parsed] = Json::parse(client->payload_);
+    if (status != Json::success) {
+        client->send_error(400, Json::StatusToString(status));
+        return false;
+    }
+    if (!parsed.isObject()) {
+        client->send_error(400, "JSON body must be an object");
+        return false;
+    }
+    if (!parsed["name"].isString()) {
+        client->send_error(400, "JSON missing name string");
+        return false;
+    }
+    *json = std::move(parsed);
+    return true;
+}
+
+// returns loaded adapters as json, e.g.
+//
+//     GET /adapters
+//     {"tenant1": {"path": "a.gguf", "scale": 1.0}}
+bool
+Client::adapterz()
+{
+    Json json;
+    json.setObject();
+    for (const auto& [name, adapter] : slots()->adapter_list()) {
+        json[name]["path"] = adapter.path;
+        json[name]["scale"] = adapter.scale;
+    }
+    dump_ = json.toStringPretty();
+    dump_ += '\n';
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+// loads a lora adapter from disk, e.g.
+//
+//     POST /adapters/load
+//     {"name": "tenant1", "path": "a.gguf", "scale": 1.0}
+bool
+Client::adapter_load()
+{
+    Json json;
+    if (!get_adapter_params(this, &json))
+        return false;
+    if (!json["path"].isString())
+        return send_error(400, "JSON missing path string");
+    float scale = 1;
+    if (!json["scale"].isNull()) {
+        if (!json["scale"].isNumber())
+            return send_error(400, "scale must be number");
+        scale = json["scale"].getNumber();
+    }
+    if (!slots()->adapter_load(
+          json["name"].getString(), json["path"].getString(), scale))
+        return send_error(500, "failed to load adapter");
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, "{\"status\": \"loaded\"}\n");
+}
+
+// unloads a lora adapter, e.g.
+//
+//     POST /adapters/unload
+//     {"name": "tenant1"}
+bool
+Client::adapter_unload()
+{
+    Json json;
+    if (!get_adapter_params(this, &json))
+        return false;
+    switch (slots()->adapter_unload(json["name"].getString())) {
+        case -1:
+            return send_error(404, "no such adapter is loaded");
+        case -2:
+            return send_error(409, "adapter is busy serving a request");
+        default:
+            break;
+    }
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, "{\"status\": \"unloaded\"}\n");
+}
+
+// changes the strength of a loaded lora adapter, e.g.
+//
+//     POST /adapters/scale
+//     {"name": "tenant1", "scale": 0.5}
+bool
+Client::adapter_scale()
+{
+    Json json;
+    if (!get_adapter_params(this, &json))
+        return false;
+    if (!json["scale"].isNumber())
+        return send_error(400, "JSON missing scale number");
+    if (!slots()->adapter_scale(json["name"].getString(),
+                                json["scale"].getNumber()))
+        return send_error(404, "no such adapter is loaded");
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, "{\"status\": \"scaled\"}\n");
+}
+
+} // namespace server
+} // namespace lf
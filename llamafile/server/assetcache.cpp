@@ -0,0 +1,156 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "assetcache.h"
+#include "llamafile/server/utils.h"
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <pthread.h>
+#include <string>
+#include <third_party/zlib/zlib.h>
+#include <unistd.h>
+
+// static asset cache
+//
+// every chat page load fetches the same few hundred kilobytes of www
+// bundle, which used to mean reading the files off the filesystem and
+// deflating the compressible ones again per request. the bytes can't
+// change behind our back often enough to matter, so each regular file
+// is slurped once into an immutable entry holding its body, a gzipped
+// copy, and a strong etag, and every later request serves views of
+// that entry. the etag lets clients revalidate for free: our standard
+// Cache-Control is max-age=0, so browsers ask every time, and a
+// matching If-None-Match costs a stat and a tiny 304.
+//
+// entries revalidate against the file's mtime and size, so editing a
+// file under --www-root takes effect on the next request. assets are
+// shared as immutable shared_ptr snapshots, which keeps a response
+// that's mid-send alive across a concurrent reload or eviction.
+//
+// worker threads handling requests are subject to pthread_cancel(),
+// so nothing that's a cancelation point may happen under the lock.
+
+#define MAX_ASSET_SIZE 8388608
+#define MAX_CACHE_BYTES (64 * 1024 * 1024)
+
+namespace lf {
+namespace server {
+
+struct AssetCacheEntry
+{
+    uint64_t stamp;
+    std::shared_ptr<const Asset> asset;
+};
+
+static uint64_t g_stamp;
+static size_t g_bytes;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, AssetCacheEntry> g_entries;
+
+static size_t
+asset_bytes(const Asset& asset)
+{
+    return asset.body.size() + asset.gzip.size();
+}
+
+// returns an immutable snapshot of a static asset, loading it on the
+// first request. returns null for files the cache won't hold, which
+// the caller should stream the old fashioned way
+std::shared_ptr<const Asset>
+assetcache_get(const std::string& path,
+               int fd,
+               const struct stat& st,
+               const char* content_type)
+{
+    if (!S_ISREG(st.st_mode) || st.st_size > MAX_ASSET_SIZE)
+        return nullptr;
+    pthread_mutex_lock(&g_lock);
+    auto e = g_entries.find(path);
+    if (e != g_entries.end()) {
+        const Asset& asset = *e->second.asset;
+        if (asset.mtim.tv_sec == st.st_mtim.tv_sec &&
+            asset.mtim.tv_nsec == st.st_mtim.tv_nsec &&
+            asset.body.size() == (size_t)st.st_size) {
+            e->second.stamp = ++g_stamp;
+            std::shared_ptr<const Asset> res = e->second.asset;
+            pthread_mutex_unlock(&g_lock);
+            return res;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    // the file is read and deflated outside the lock, since both can
+    // block and the read is a cancelation point
+    auto asset = std::make_shared<Asset>();
+    asset->body.resize(st.st_size);
+    size_t got = 0;
+    while (got < asset->body.size()) {
+        ssize_t rc =
+          pread(fd, asset->body.data() + got, asset->body.size() - got, got);
+        if (rc <= 0)
+            return nullptr;
+        got += rc;
+    }
+    char etag[64];
+    snprintf(etag,
+             sizeof(etag),
+             "\"%08lx-%zx\"",
+             (unsigned long)crc32(
+               0, (const Bytef*)asset->body.data(), asset->body.size()),
+             asset->body.size());
+    asset->etag = etag;
+    asset->content_type = content_type;
+    asset->mtim = st.st_mtim;
+    if (asset->body.size() >= 512 && is_compressible(content_type)) {
+        std::string gzipped;
+        if (gzip_all(asset->body, &gzipped) &&
+            gzipped.size() < asset->body.size())
+            asset->gzip = std::move(gzipped);
+    }
+
+    pthread_mutex_lock(&g_lock);
+    AssetCacheEntry& entry = g_entries[path];
+    if (entry.asset)
+        g_bytes -= asset_bytes(*entry.asset);
+    entry.stamp = ++g_stamp;
+    entry.asset = asset;
+    g_bytes += asset_bytes(*asset);
+    while (g_bytes > MAX_CACHE_BYTES && g_entries.size() > 1) {
+        auto oldest = g_entries.begin();
+        for (auto e = g_entries.begin(); e != g_entries.end(); ++e)
+            if (e->second.stamp < oldest->second.stamp)
+                oldest = e;
+        g_bytes -= asset_bytes(*oldest->second.asset);
+        g_entries.erase(oldest);
+    }
+    pthread_mutex_unlock(&g_lock);
+    return asset;
+}
+
+void
+assetcache_destroy()
+{
+    pthread_mutex_lock(&g_lock);
+    std::map<std::string, AssetCacheEntry>().swap(g_entries);
+    g_bytes = 0;
+    pthread_mutex_unlock(&g_lock);
+}
+
+} // namespace server
+} // namespace lf
@@ -18,6 +18,7 @@
 #include "atom.h"
 #include "image.h"
 #include <cassert>
+#include <vector>
 
 namespace lf {
 namespace server {
@@ -123,6 +124,60 @@ Atom::ctx_used() const
     }
 }
 
+// folds one atom into a rolling fnv digest. tokens hash by their
+// packed word; images hash by their bytes, so a history image and a
+// request image holding the same picture digest the same even though
+// they're separate allocations. see Slot::history_digest_
+uint64_t
+atom_digest(uint64_t state, const Atom& atom)
+{
+    uint64_t word = atom.word_;
+    if (atom.is_image()) {
+        word = 2ull << 56;
+        for (unsigned char c : atom.image().bytes()) {
+            word ^= c;
+            word *= 0x100000001b3;
+        }
+    }
+    return (state ^ word) * 0x100000001b3;
+}
+
+uint64_t
+atoms_digest(uint64_t state, const Atom* atoms, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        state = atom_digest(state, atoms[i]);
+    return state;
+}
+
+// returns how many leading atoms two vectors share. this is the inner
+// loop of slot selection, where dozens of candidate histories get
+// compared against the prompt while the slots lock is held, so the
+// bulk of the work is a block compare over the packed words that the
+// compiler turns into simd. equal words are always equal atoms;
+// unequal words still need the slow comparison, since two copies of
+// one image live at different addresses
+size_t
+atoms_common_prefix(const std::vector<Atom>& a, const std::vector<Atom>& b)
+{
+    size_t n = a.size() < b.size() ? a.size() : b.size();
+    const Atom* ap = a.data();
+    const Atom* bp = b.data();
+    size_t i = 0;
+    while (i + 4 <= n) {
+        uint64_t x = (ap[i + 0].word_ ^ bp[i + 0].word_) |
+                     (ap[i + 1].word_ ^ bp[i + 1].word_) |
+                     (ap[i + 2].word_ ^ bp[i + 2].word_) |
+                     (ap[i + 3].word_ ^ bp[i + 3].word_);
+        if (x)
+            break;
+        i += 4;
+    }
+    while (i < n && (ap[i].word_ == bp[i].word_ || ap[i] == bp[i]))
+        ++i;
+    return i;
+}
+
 bool
 operator<(const Atom& lhs, const Atom& rhs)
 {
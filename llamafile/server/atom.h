@@ -16,11 +16,24 @@
 // limitations under the License.
 
 #pragma once
+#include <__fwd/vector.h>
+#include <cstddef>
+#include <cstdint>
 
 namespace lf {
 namespace server {
 
 class Image;
+class Atom;
+
+uint64_t
+atom_digest(uint64_t, const Atom&);
+
+uint64_t
+atoms_digest(uint64_t, const Atom*, size_t);
+
+size_t
+atoms_common_prefix(const std::vector<Atom>&, const std::vector<Atom>&);
 
 class Atom
 {
@@ -40,6 +53,10 @@ class Atom
     const Image& image() const;
 
   private:
+    friend uint64_t atom_digest(uint64_t, const Atom&);
+    friend size_t atoms_common_prefix(const std::vector<Atom>&,
+                                      const std::vector<Atom>&);
+
     uint64_t word_ = 0;
 };
 
@@ -17,43 +17,164 @@
 
 #include "atom.h"
 #include "llama.cpp/base64.h"
+#include "llama.cpp/llama.h"
 #include "llamafile/chatbot.h"
 #include "llamafile/datauri.h"
 #include "llamafile/image.h"
 #include "llamafile/llama.h"
+#include "llamafile/macros.h"
+#include "llamafile/pool.h"
+#include "llamafile/server/atomstream.h"
 #include "llamafile/server/image.h"
+#include "llamafile/server/tokencache.h"
 #include "llamafile/string.h"
+#include <cctype>
+#include <cosmo.h>
 #include <string>
 #include <vector>
 
 namespace lf {
 namespace server {
 
+// chunks handed to parallel tokenization must begin at the start of a
+// whitespace run, because pretokenizers won't merge across whitespace
+// but may glue a leading space onto the following word, or group the
+// run itself into a single token, so a run mustn't be cut in half
+static size_t
+chunk_boundary(const std::string_view& s, size_t hint)
+{
+    for (size_t i = hint; i < s.size(); ++i)
+        if ((s[i] == ' ' || s[i] == '\n' || s[i] == '\t') &&
+            !isspace(s[i - 1] & 255))
+            return i;
+    return s.size();
+}
+
+// special token parsing can still be chunked when no special token
+// carries whitespace past its first byte: chunks split at the start
+// of a whitespace run, so a special straddling the cut would need
+// interior whitespace. control tokens are solid words like
+// <|im_start|> in practically every template, making this scan a
+// formality that's cheap next to tokenizing a quarter megabyte
+static bool
+specials_can_chunk(const llama_model* model)
+{
+    int n = llama_n_vocab(model);
+    for (int i = 0; i < n; ++i) {
+        if (!llama_token_is_control(model, i))
+            continue;
+        const char* text = llama_token_get_text(model, i);
+        for (int j = 1; text[j]; ++j)
+            if (isspace(text[j] & 255))
+                return false;
+    }
+    return true;
+}
+
+struct TokenizeChunk
+{
+    const llama_model* model;
+    bool parse_special;
+    std::string_view text;
+    std::vector<int> tokens;
+};
+
+static void*
+tokenize_chunk(void* arg)
+{
+    TokenizeChunk* chunk = (TokenizeChunk*)arg;
+    chunk->tokens = llamafile_tokenize(
+      chunk->model, chunk->text, DONT_ADD_SPECIAL, chunk->parse_special);
+    return nullptr;
+}
+
 static void
 append_tokens(const llama_model* model,
               std::vector<Atom>* result,
               const std::string_view& s,
               bool parse_special)
 {
-    std::vector<int> tokens = llamafile_tokenize(
-      model, std::string(s), DONT_ADD_SPECIAL, parse_special);
+    // tokenizing a big document is itself a pipeline stage that holds
+    // up prefill, so plain text gets split at safe boundaries and fed
+    // to the task pool. special token parsing only stays serial when
+    // a special token could actually straddle a chunk boundary.
+    if (s.size() >= 262144 &&
+        (!parse_special || specials_can_chunk(model))) {
+        size_t step = MAX(131072ul, s.size() / MIN(16, __get_cpu_count()));
+        std::vector<TokenizeChunk> chunks;
+        size_t start = 0;
+        while (start < s.size()) {
+            size_t end = chunk_boundary(s, MIN(start + step, s.size()));
+            chunks.push_back(
+              { model, parse_special, s.substr(start, end - start), {} });
+            start = end;
+        }
+        size_t m = chunks.size();
+        std::vector<llamafile_task_t> tasks(m);
+        std::vector<char> spawned(m, 0);
+        for (size_t i = 1; i < m; ++i)
+            spawned[i] =
+              !llamafile_task_create(&tasks[i], tokenize_chunk, &chunks[i]);
+        tokenize_chunk(&chunks[0]);
+        for (size_t i = 1; i < m; ++i) {
+            if (spawned[i])
+                llamafile_task_join(tasks[i], 0);
+            else
+                tokenize_chunk(&chunks[i]);
+        }
+        for (const TokenizeChunk& chunk : chunks)
+            for (int token : chunk.tokens)
+                result->emplace_back(token);
+        return;
+    }
+    // short autocomplete prompts repeat constantly, so their byte
+    // pair merges get memoized rather than redone every request
+    std::vector<int> tokens;
+    if (!tokencache_get(model, s, parse_special, &tokens)) {
+        tokens = llamafile_tokenize(
+          model, std::string(s), DONT_ADD_SPECIAL, parse_special);
+        tokencache_put(model, s, parse_special, tokens);
+    }
     for (int token : tokens)
         result->emplace_back(token);
 }
 
+struct DecodeImageJob
+{
+    size_t beg; // offset of "data:" in the atomized string
+    size_t end; // offset one past the data uri
+    DataUri uri;
+    std::string image;
+    bool ok;
+};
+
+static void*
+decode_image_job(void* arg)
+{
+    DecodeImageJob* job = (DecodeImageJob*)arg;
+    try {
+        job->image = job->uri.decode();
+        job->ok = !!get_image_type(job->image);
+    } catch (const base64_error& e) {
+        job->ok = false;
+    }
+    return nullptr;
+}
+
 void
 atomize(const llama_model* model,
         std::vector<Atom>* result,
         std::string_view s,
         bool parse_special)
 {
+    // find the image data uris up front, so their multi megabyte
+    // base64 payloads decode on pool threads while this thread is
+    // busy tokenizing, and so each decoded image gets moved into
+    // its atom instead of copied
+    std::vector<DecodeImageJob> jobs;
     size_t i = 0;
-    for (;;) {
-        size_t pos = s.find("data:", i);
-        if (pos == std::string_view::npos) {
-            append_tokens(model, result, s, parse_special);
-            return;
-        }
+    size_t pos;
+    while ((pos = s.find("data:", i)) != std::string_view::npos) {
         i = pos + 5;
         DataUri uri;
         size_t end = uri.parse(s.substr(i));
@@ -61,18 +182,119 @@ atomize(const llama_model* model,
             continue;
         if (!startscasewith(uri.mime, "image/"))
             continue;
-        std::string image;
-        try {
-            image = uri.decode();
-        } catch (const base64_error& e) {
-            continue;
+        jobs.push_back({ pos, i + end, uri, {}, false });
+        i = i + end;
+    }
+    size_t m = jobs.size();
+    std::vector<llamafile_task_t> tasks(m);
+    std::vector<char> spawned(m, 0);
+    for (size_t k = 0; k < m; ++k)
+        spawned[k] = !llamafile_task_create(&tasks[k], decode_image_job, &jobs[k]);
+    size_t done = 0;
+    for (size_t k = 0; k < m; ++k) {
+        if (spawned[k])
+            llamafile_task_join(tasks[k], 0);
+        else
+            decode_image_job(&jobs[k]);
+        if (!jobs[k].ok)
+            continue; // not an image after all; its text tokenizes
+        append_tokens(
+          model, result, s.substr(done, jobs[k].beg - done), parse_special);
+        result->emplace_back(new Image(std::move(jobs[k].image), -1));
+        done = jobs[k].end;
+    }
+    append_tokens(model, result, s.substr(done), parse_special);
+}
+
+void*
+AtomStream::tokenize(void* arg)
+{
+    Chunk* chunk = (Chunk*)arg;
+    chunk->tokens = llamafile_tokenize(
+      chunk->model, chunk->text, DONT_ADD_SPECIAL, chunk->parse_special);
+    return nullptr;
+}
+
+AtomStream::AtomStream(const llama_model* model,
+                       std::vector<Atom>* atoms,
+                       std::string_view text,
+                       bool parse_special)
+  : model_(model), atoms_(atoms), text_(text), parse_special_(parse_special)
+{
+}
+
+AtomStream::~AtomStream()
+{
+    for (size_t i = next_; i < chunks_.size(); ++i)
+        if (chunks_[i].spawned)
+            llamafile_task_join(chunks_[i].task, 0);
+}
+
+bool
+AtomStream::done() const
+{
+    return started_ && next_ >= chunks_.size();
+}
+
+// appends the next chunk of atoms to the caller's vector. the first
+// call tokenizes the leading chunk on the calling thread and hands
+// the rest to the task pool; later calls collect finished chunks in
+// order, usually without waiting, since the pool races ahead while
+// the caller is busy prefilling. returns false once everything has
+// been delivered
+bool
+AtomStream::pump()
+{
+    if (!started_) {
+        started_ = true;
+        // a document with image data uris interleaves token and image
+        // atoms, which atomize() already pipelines its own way, and
+        // chunking is only correct under the conditions append_tokens
+        // checks, so anything unsplittable tokenizes whole right here
+        if (text_.size() < 262144 ||
+            text_.find("data:") != std::string_view::npos ||
+            (parse_special_ && !specials_can_chunk(model_))) {
+            atomize(model_, atoms_, text_, parse_special_);
+            return true;
         }
-        if (!get_image_type(image))
-            continue;
-        append_tokens(model, result, s.substr(0, pos), parse_special);
-        result->emplace_back(new Image(image, -1));
-        s = s.substr(i + end);
-        i = 0;
+        size_t step =
+          MAX(131072ul, text_.size() / MIN(16, __get_cpu_count()));
+        size_t start = 0;
+        while (start < text_.size()) {
+            size_t end = chunk_boundary(text_, MIN(start + step, text_.size()));
+            chunks_.push_back({ model_,
+                                parse_special_,
+                                text_.substr(start, end - start),
+                                {},
+                                nullptr,
+                                false });
+            start = end;
+        }
+        for (size_t i = 1; i < chunks_.size(); ++i)
+            chunks_[i].spawned =
+              !llamafile_task_create(&chunks_[i].task, tokenize, &chunks_[i]);
+        tokenize(&chunks_[0]);
+        for (int token : chunks_[0].tokens)
+            atoms_->emplace_back(token);
+        next_ = 1;
+        return true;
+    }
+    if (next_ >= chunks_.size())
+        return false;
+    Chunk& chunk = chunks_[next_++];
+    if (chunk.spawned)
+        llamafile_task_join(chunk.task, 0);
+    else
+        tokenize(&chunk);
+    for (int token : chunk.tokens)
+        atoms_->emplace_back(token);
+    return true;
+}
+
+void
+AtomStream::drain()
+{
+    while (pump()) {
     }
 }
 
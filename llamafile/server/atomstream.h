@@ -0,0 +1,80 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "llamafile/pool.h"
+#include <string_view>
+#include <vector>
+
+struct llama_model;
+
+namespace lf {
+namespace server {
+
+class Atom;
+
+// tokenizes a document incrementally so prefill can start decoding
+// the first tokens while pool threads are still chewing on the rest.
+// atoms are appended to a caller owned vector, which may be seeded
+// (e.g. with a bos token) before the first pump() and must outlive
+// this object, as must the text. inputs that can't be split safely,
+// like small prompts, image data uris, or vocabularies whose special
+// tokens contain interior whitespace, tokenize whole on first pump()
+class AtomStream
+{
+  public:
+    AtomStream(const llama_model*,
+               std::vector<Atom>*,
+               std::string_view,
+               bool parse_special);
+    ~AtomStream();
+
+    // the atoms delivered so far
+    std::vector<Atom>&
+    atoms()
+    {
+        return *atoms_;
+    }
+
+    bool done() const;
+    bool pump();
+    void drain();
+
+  private:
+    struct Chunk
+    {
+        const llama_model* model;
+        bool parse_special;
+        std::string_view text;
+        std::vector<int> tokens;
+        llamafile_task_t task;
+        bool spawned;
+    };
+
+    static void* tokenize(void*);
+
+    const llama_model* model_;
+    std::vector<Atom>* atoms_;
+    std::string_view text_;
+    bool parse_special_;
+    bool started_ = false;
+    size_t next_ = 0;
+    std::vector<Chunk> chunks_;
+};
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,652 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "batcher.h"
+#include "llama.cpp/cores.h"
+#include "llama.cpp/llama.h"
+#include "llama.cpp/sampling.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/macros.h"
+#include "llamafile/server/log.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <vector>
+
+namespace lf {
+namespace server {
+
+static void*
+batcher_thread(void* arg)
+{
+    ((Batcher*)arg)->run();
+    return nullptr;
+}
+
+Batcher::Batcher(llama_context* ctx)
+  : ctx_(ctx),
+    governor_(FLAG_threads,
+              MIN(FLAG_threads, 20),
+              FLAG_threads,
+              MIN(FLAG_batch, FLAG_ubatch))
+{
+    pthread_cond_init(&work_cond_, 0);
+    pthread_cond_init(&done_cond_, 0);
+    pthread_mutex_init(&lock_, 0);
+    n_vocab_ = llama_n_vocab(llama_get_model(ctx));
+    batch_cap_ = MAX(FLAG_batch, FLAG_draft_tokens + 1);
+    batch_ = new llama_batch(llama_batch_init(batch_cap_, 0, 1));
+}
+
+Batcher::~Batcher()
+{
+    llama_batch_free(*batch_);
+    delete batch_;
+    pthread_mutex_destroy(&lock_);
+    pthread_cond_destroy(&done_cond_);
+    pthread_cond_destroy(&work_cond_);
+}
+
+errno_t
+Batcher::spawn()
+{
+    return pthread_create(&th_, 0, batcher_thread, this);
+}
+
+void
+Batcher::shutdown()
+{
+    pthread_mutex_lock(&lock_);
+    shutting_down_ = true;
+    pthread_cond_broadcast(&work_cond_);
+    pthread_mutex_unlock(&lock_);
+    if (th_)
+        pthread_join(th_, 0);
+    pthread_mutex_lock(&lock_);
+    Dll* e;
+    while ((e = dll_first(queue_))) {
+        dll_remove(&queue_, e);
+        WORK(e)->result_ = -1;
+        WORK(e)->done_ = true;
+    }
+    pthread_cond_broadcast(&done_cond_);
+    pthread_mutex_unlock(&lock_);
+}
+
+void
+Batcher::run()
+{
+    // confine decoding to the performance cores. ggml's worker team
+    // is spawned from this thread and inherits its affinity mask, so
+    // pinning here keeps the kv cache and activation buffers from
+    // migrating between cache domains halfway through a request.
+    // --ecores lets the decode team spill onto efficiency cores too,
+    // which can help batch throughput when latency doesn't matter
+    if (!FLAG_ecores) {
+        cpu_set_t mask;
+        int n = cpu_get_math_affinity(&mask);
+        if (n > 0 && !pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask))
+            SLOG("pinned decode threads to %d performance cores", n);
+    }
+
+    pthread_mutex_lock(&lock_);
+    while (!shutting_down_) {
+        if (!dll_first(queue_)) {
+            pthread_cond_wait(&work_cond_, &lock_);
+            continue;
+        }
+        step();
+    }
+    pthread_mutex_unlock(&lock_);
+}
+
+// returns the prefill span size the governor currently favors. read
+// without the lock since the batcher thread only ever stores small
+// aligned ints here, and a stale value just means one more chunk of
+// the old size
+int
+Batcher::chunk() const
+{
+    return governor_.chunk();
+}
+
+// issues one llama_decode() with the thread count the governor
+// currently favors for the phase, then reports the achieved rate
+// back so it can keep adapting. small batches are generation steps,
+// which are memory bound, while big ones are prefill or image
+// embeddings, which are compute bound and scale across more cores
+int
+Batcher::decode(const llama_batch& batch)
+{
+    bool is_prefill = batch.n_tokens >= 32;
+    int nth = governor_.choose(is_prefill);
+    llama_set_n_threads(ctx_, nth, nth);
+    timespec started, ended;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    int result = llama_decode(ctx_, batch);
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+    if (!result)
+        governor_.report(is_prefill,
+                         batch.n_tokens,
+                         timespec_tonanos(timespec_sub(ended, started)));
+    return result;
+}
+
+// drains a fifo prefix of the queue into one decode iteration
+//
+// token spans from multiple slots are merged into a single
+// llama_batch so prefill chunks and generation tokens share one
+// llama_decode() call. image embedding spans can't mix with text
+// tokens so they get an iteration to themselves. sampling work
+// runs here too, because logits rows only stay valid until the
+// next decode overwrites them.
+void
+Batcher::step()
+{
+    std::vector<Work*> decode_works;
+    std::vector<Work*> sample_works;
+    std::vector<Work*> kv_works;
+    Work* embd_work = nullptr;
+    Work* verify_work = nullptr;
+    int n_tokens = 0;
+    llama_lora_adapter* batch_adapter = nullptr;
+    float batch_scale = 0;
+    for (Dll* e = dll_first(queue_); e;) {
+        Dll* next = dll_next(queue_, e);
+        Work* work = WORK(e);
+        if (work->kv_op_) {
+            dll_remove(&queue_, e);
+            kv_works.emplace_back(work);
+        } else if (work->sampler_ && work->tokens_) {
+            // speculative verification needs every logits row of
+            // its own decode so it gets an iteration to itself
+            if (n_tokens)
+                break;
+            dll_remove(&queue_, e);
+            verify_work = work;
+            break;
+        } else if (work->sampler_) {
+            dll_remove(&queue_, e);
+            sample_works.emplace_back(work);
+        } else if (work->embd_) {
+            if (n_tokens)
+                break;
+            dll_remove(&queue_, e);
+            embd_work = work;
+            break;
+        } else {
+            if (n_tokens + work->count_ > FLAG_batch)
+                break;
+            // works wanting different lora configurations can't ride
+            // the same llama_decode(), since adapters apply to every
+            // sequence in the batch
+            if (n_tokens && (work->adapter_ != batch_adapter ||
+                             work->adapter_scale_ != batch_scale))
+                break;
+            dll_remove(&queue_, e);
+            decode_works.emplace_back(work);
+            batch_adapter = work->adapter_;
+            batch_scale = work->adapter_scale_;
+            n_tokens += work->count_;
+        }
+        e = next;
+    }
+    pthread_mutex_unlock(&lock_);
+
+    // kv cache mutations have to happen on this thread since
+    // they'd race against llama_decode() anywhere else
+    for (Work* work : kv_works) {
+        if (work->kv_op_ == kv_rm) {
+            work->result_ = llama_kv_cache_seq_rm(
+              ctx_, work->seq_id_, work->kv_p0_, work->kv_p1_);
+        } else if (work->kv_op_ == kv_add) {
+            llama_kv_cache_seq_add(ctx_,
+                                   work->seq_id_,
+                                   work->kv_p0_,
+                                   work->kv_p1_,
+                                   work->kv_delta_);
+            work->result_ = 0;
+        } else if (work->kv_op_ == kv_cp) {
+            llama_kv_cache_seq_cp(ctx_,
+                                  work->seq_id_,
+                                  work->kv_seq_dst_,
+                                  work->kv_p0_,
+                                  work->kv_p1_);
+            work->result_ = 0;
+        } else if (work->kv_op_ == kv_save) {
+            size_t size = llama_state_seq_get_size(ctx_, work->seq_id_);
+            work->state_save_->resize(size);
+            if (llama_state_seq_get_data(
+                  ctx_, work->state_save_->data(), work->seq_id_) == size) {
+                work->result_ = 0;
+            } else {
+                work->result_ = -1;
+            }
+        } else if (work->kv_op_ == kv_load) {
+            if (llama_state_seq_set_data(
+                  ctx_, work->state_load_, work->seq_id_)) {
+                work->result_ = 0;
+            } else {
+                work->result_ = -1;
+            }
+        } else {
+            // detach every adapter so the caller may free this one.
+            // the next decode reapplies whatever its works want
+            llama_lora_adapter_clear(ctx_);
+            applied_adapter_ = nullptr;
+            applied_scale_ = 0;
+            work->result_ = 0;
+        }
+    }
+
+    if (verify_work)
+        verify(verify_work);
+
+    if (embd_work) {
+        use_adapter(embd_work->adapter_, embd_work->adapter_scale_);
+        if (decode({ .n_tokens = embd_work->count_,
+                     .embd = (float*)embd_work->embd_,
+                     .all_pos_0 = embd_work->pos_,
+                     .all_pos_1 = 1,
+                     .all_seq_id = embd_work->seq_id_ })) {
+            embd_work->result_ = -1;
+        } else {
+            if (embd_work->wants_logits_)
+                save_logits(embd_work->seq_id_, llama_get_logits(ctx_));
+            embd_work->result_ = embd_work->count_;
+        }
+    }
+
+    if (n_tokens) {
+        unassert(n_tokens <= batch_cap_);
+        llama_batch& batch = *batch_;
+        int k = 0;
+        for (Work* work : decode_works) {
+            for (int i = 0; i < work->count_; ++i) {
+                batch.token[k] = work->tokens_[i];
+                if (work->seq_ids_) {
+                    // fan-out rows each belong to a different branch
+                    batch.pos[k] = work->positions_[i];
+                    batch.seq_id[k][0] = work->seq_ids_[i];
+                    batch.logits[k] = true;
+                } else {
+                    batch.pos[k] = work->pos_ + i;
+                    batch.seq_id[k][0] = work->seq_id_;
+                    batch.logits[k] =
+                      work->wants_logits_ && i == work->count_ - 1;
+                }
+                batch.n_seq_id[k] = 1;
+                ++k;
+            }
+        }
+        batch.n_tokens = n_tokens;
+        use_adapter(batch_adapter, batch_scale);
+        bool failed = !!decode(batch);
+        k = 0;
+        for (Work* work : decode_works) {
+            k += work->count_;
+            if (failed) {
+                work->result_ = -1;
+            } else {
+                if (work->seq_ids_) {
+                    for (int i = 0; i < work->count_; ++i)
+                        save_logits(
+                          work->seq_ids_[i],
+                          llama_get_logits_ith(ctx_, k - work->count_ + i));
+                } else if (work->wants_logits_) {
+                    save_logits(work->seq_id_,
+                                llama_get_logits_ith(ctx_, k - 1));
+                }
+                work->result_ = work->count_;
+            }
+        }
+    }
+
+    for (Work* work : sample_works) {
+        auto it = seq_logits_.find(work->seq_id_);
+        if (it == seq_logits_.end()) {
+            work->result_ = -1;
+            continue;
+        }
+        // sampling reads logits through the context so the saved
+        // row gets restored to where idx -1 will find it
+        memcpy(llama_get_logits(ctx_),
+               it->second.data(),
+               n_vocab_ * sizeof(float));
+        llama_token id = llama_sampling_sample(work->sampler_, ctx_, nullptr);
+        llama_sampling_accept(work->sampler_, ctx_, id, work->apply_grammar_);
+        if (work->probs_) {
+            work->probs_[0].token_ = id;
+            top_logprobs(it->second.data(), work->probs_, work->n_probs_);
+        }
+        work->result_ = id;
+    }
+
+    pthread_mutex_lock(&lock_);
+    if (embd_work)
+        embd_work->done_ = true;
+    if (verify_work)
+        verify_work->done_ = true;
+    for (Work* work : decode_works)
+        work->done_ = true;
+    for (Work* work : sample_works)
+        work->done_ = true;
+    for (Work* work : kv_works)
+        work->done_ = true;
+    pthread_cond_broadcast(&done_cond_);
+}
+
+// decodes a drafted continuation in one batch then replays the
+// sampler over its logits rows, accepting drafted tokens for as
+// long as the sampler agrees with the draft model. rejected tokens
+// are dropped from the kv cache before anyone else can see them.
+void
+Batcher::verify(Work* work)
+{
+    unassert(work->count_ <= batch_cap_);
+    use_adapter(work->adapter_, work->adapter_scale_);
+    llama_batch& batch = *batch_;
+    for (int i = 0; i < work->count_; ++i) {
+        batch.token[i] = work->tokens_[i];
+        batch.pos[i] = work->pos_ + i;
+        batch.n_seq_id[i] = 1;
+        batch.seq_id[i][0] = work->seq_id_;
+        batch.logits[i] = true;
+    }
+    batch.n_tokens = work->count_;
+    if (decode(batch)) {
+        work->result_ = -1;
+        return;
+    }
+    int emitted = 0;
+    for (int i = 0; i < work->count_; ++i) {
+        float* dst = llama_get_logits(ctx_);
+        const float* row = llama_get_logits_ith(ctx_, i);
+        if (dst != row)
+            memcpy(dst, row, n_vocab_ * sizeof(float));
+        llama_token id = llama_sampling_sample(work->sampler_, ctx_, nullptr);
+        llama_sampling_accept(work->sampler_, ctx_, id, work->apply_grammar_);
+        work->out_tokens_[emitted++] = id;
+        if (!(i + 1 < work->count_ && id == work->tokens_[i + 1]))
+            break;
+    }
+    llama_kv_cache_seq_rm(ctx_, work->seq_id_, work->pos_ + emitted, -1);
+    work->result_ = emitted;
+}
+
+// applies a lora configuration to the context unless it's already
+// what the last decode used. runs on the batcher thread only, since
+// adapter state feeds the decode graph
+void
+Batcher::use_adapter(llama_lora_adapter* adapter, float scale)
+{
+    if (adapter == applied_adapter_ && scale == applied_scale_)
+        return;
+    llama_lora_adapter_clear(ctx_);
+    if (adapter)
+        llama_lora_adapter_set(ctx_, adapter, scale);
+    applied_adapter_ = adapter;
+    applied_scale_ = scale;
+}
+
+void
+Batcher::save_logits(int seq_id, const float* row)
+{
+    std::vector<float>& saved = seq_logits_[seq_id];
+    saved.resize(n_vocab_);
+    memcpy(saved.data(), row, n_vocab_ * sizeof(float));
+}
+
+// fills fixed size logprob records from a saved logits row. the log
+// softmax is taken over the model's raw distribution, before samplers
+// reshape it, which is what evaluation harnesses expect. probs[0]
+// names the sampled token on entry and gets its logprob filled in;
+// the n likeliest candidates land in probs[1..n] sorted descending.
+// one pass finds the normalizer and a partial insertion sort keeps
+// the running top n, so cost stays linear in the vocabulary.
+void
+Batcher::top_logprobs(const float* logits, TokenProb* probs, int n)
+{
+    unassert(n < n_vocab_);
+    float max = logits[0];
+    for (int i = 1; i < n_vocab_; ++i)
+        if (logits[i] > max)
+            max = logits[i];
+    double sum = 0;
+    for (int i = 0; i < n_vocab_; ++i)
+        sum += expf(logits[i] - max);
+    float logz = max + logf(sum);
+    int have = 0;
+    for (int i = 0; n && i < n_vocab_; ++i) {
+        // logprob_ holds the raw logit until the subtraction below
+        if (have == n && logits[i] <= probs[have].logprob_)
+            continue;
+        int j = have < n ? ++have : have;
+        while (j > 1 && logits[i] > probs[j - 1].logprob_) {
+            probs[j] = probs[j - 1];
+            --j;
+        }
+        probs[j].token_ = i;
+        probs[j].logprob_ = logits[i];
+    }
+    for (int j = 1; j <= have; ++j)
+        probs[j].logprob_ -= logz;
+    probs[0].logprob_ = logits[probs[0].token_] - logz;
+}
+
+int
+Batcher::submit(Work* work)
+{
+    // a canceled client mustn't unwind out of this wait. the work
+    // item lives on the calling thread's stack and the batcher may
+    // be reading it, and letting the decode finish means the slot's
+    // history records it, so when a dropped client retries the same
+    // conversation Slots::take() resumes from the invested kv state
+    // instead of recomputing it. the cancellation gets acted on at
+    // the caller's next cancellation point
+    int cs;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cs);
+    pthread_mutex_lock(&lock_);
+    dll_init(&work->elem_);
+    dll_make_last(&queue_, &work->elem_);
+    pthread_cond_signal(&work_cond_);
+    while (!work->done_)
+        pthread_cond_wait(&done_cond_, &lock_);
+    pthread_mutex_unlock(&lock_);
+    pthread_setcancelstate(cs, 0);
+    return work->result_;
+}
+
+int
+Batcher::decode_tokens(int seq_id,
+                       const int* tokens,
+                       int count,
+                       int pos,
+                       bool wants_logits,
+                       llama_lora_adapter* adapter,
+                       float adapter_scale)
+{
+    Work work;
+    work.seq_id_ = seq_id;
+    work.tokens_ = tokens;
+    work.count_ = count;
+    work.pos_ = pos;
+    work.wants_logits_ = wants_logits;
+    work.adapter_ = adapter;
+    work.adapter_scale_ = adapter_scale;
+    return submit(&work);
+}
+
+int
+Batcher::decode_embd(int seq_id,
+                     const float* embd,
+                     int count,
+                     int pos,
+                     bool wants_logits,
+                     llama_lora_adapter* adapter,
+                     float adapter_scale)
+{
+    Work work;
+    work.seq_id_ = seq_id;
+    work.embd_ = embd;
+    work.count_ = count;
+    work.pos_ = pos;
+    work.wants_logits_ = wants_logits;
+    work.adapter_ = adapter;
+    work.adapter_scale_ = adapter_scale;
+    return submit(&work);
+}
+
+// decodes one token for each of `count` fan-out branches in a single
+// span, saving every branch's logits row. rides the merged batch so
+// other slots' generation tokens and prefill chunks come along too
+int
+Batcher::decode_fanout(const int* seq_ids,
+                       const int* tokens,
+                       const int* positions,
+                       int count,
+                       llama_lora_adapter* adapter,
+                       float adapter_scale)
+{
+    Work work;
+    work.seq_id_ = seq_ids[0];
+    work.seq_ids_ = seq_ids;
+    work.tokens_ = tokens;
+    work.positions_ = positions;
+    work.count_ = count;
+    work.adapter_ = adapter;
+    work.adapter_scale_ = adapter_scale;
+    return submit(&work);
+}
+
+int
+Batcher::sample(int seq_id,
+                llama_sampling_context* sampler,
+                bool apply_grammar,
+                TokenProb* probs,
+                int n_probs)
+{
+    Work work;
+    work.seq_id_ = seq_id;
+    work.sampler_ = sampler;
+    work.apply_grammar_ = apply_grammar;
+    work.probs_ = probs;
+    work.n_probs_ = n_probs;
+    return submit(&work);
+}
+
+int
+Batcher::speculate(int seq_id,
+                   const int* tokens,
+                   int count,
+                   int pos,
+                   llama_sampling_context* sampler,
+                   bool apply_grammar,
+                   int* out_tokens,
+                   llama_lora_adapter* adapter,
+                   float adapter_scale)
+{
+    Work work;
+    work.seq_id_ = seq_id;
+    work.tokens_ = tokens;
+    work.count_ = count;
+    work.pos_ = pos;
+    work.sampler_ = sampler;
+    work.apply_grammar_ = apply_grammar;
+    work.out_tokens_ = out_tokens;
+    work.adapter_ = adapter;
+    work.adapter_scale_ = adapter_scale;
+    return submit(&work);
+}
+
+int
+Batcher::kv_cache_seq_rm(int seq_id, int p0, int p1)
+{
+    Work work;
+    work.seq_id_ = seq_id;
+    work.kv_op_ = kv_rm;
+    work.kv_p0_ = p0;
+    work.kv_p1_ = p1;
+    return submit(&work);
+}
+
+void
+Batcher::kv_cache_seq_add(int seq_id, int p0, int p1, int delta)
+{
+    Work work;
+    work.seq_id_ = seq_id;
+    work.kv_op_ = kv_add;
+    work.kv_p0_ = p0;
+    work.kv_p1_ = p1;
+    work.kv_delta_ = delta;
+    submit(&work);
+}
+
+// shares a sequence's cells into another sequence id copy-on-write
+// style, which is how fan-out branches reuse one prompt prefill
+void
+Batcher::kv_cache_seq_cp(int seq_id_src, int seq_id_dst, int p0, int p1)
+{
+    Work work;
+    work.seq_id_ = seq_id_src;
+    work.kv_seq_dst_ = seq_id_dst;
+    work.kv_op_ = kv_cp;
+    work.kv_p0_ = p0;
+    work.kv_p1_ = p1;
+    submit(&work);
+}
+
+// detaches lora adapters from the context so the caller may free
+// one. rides the work queue like the kv mutations, since adapter
+// state feeds the decode graph
+int
+Batcher::lora_remove(llama_lora_adapter* adapter)
+{
+    Work work;
+    work.seq_id_ = -1;
+    work.kv_op_ = lora_rm;
+    work.adapter_ = adapter;
+    return submit(&work);
+}
+
+// serializes a sequence's kv state into `state`, which gets resized
+// to fit. has to ride the work queue like the other kv mutations,
+// since llama_state_seq_get_data() reads cells llama_decode() moves
+int
+Batcher::kv_state_save(int seq_id, std::vector<uint8_t>* state)
+{
+    Work work;
+    work.seq_id_ = seq_id;
+    work.kv_op_ = kv_save;
+    work.state_save_ = state;
+    return submit(&work);
+}
+
+int
+Batcher::kv_state_load(int seq_id, const uint8_t* state)
+{
+    Work work;
+    work.seq_id_ = seq_id;
+    work.kv_op_ = kv_load;
+    work.state_load_ = state;
+    return submit(&work);
+}
+
+} // namespace server
+} // namespace lf
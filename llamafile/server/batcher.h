@@ -0,0 +1,165 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "governor.h"
+#include <cosmo.h>
+#include <cstdint>
+#include <map>
+#include <pthread.h>
+#include <vector>
+
+#define WORK(e) DLL_CONTAINER(Batcher::Work, elem_, e)
+
+struct llama_batch;
+struct llama_context;
+struct llama_lora_adapter;
+struct llama_sampling_context;
+
+namespace lf {
+namespace server {
+
+// one candidate from a sampled token's distribution. records are
+// fixed size so logprob capture appends to a flat array without
+// allocating per token
+struct TokenProb
+{
+    int token_;
+    float logprob_;
+};
+
+// central decode scheduler for continuous batching
+//
+// slots no longer issue llama_decode() themselves. they submit spans
+// of tokens (or image embeddings) tagged with their sequence id, and
+// this module's thread coalesces everything pending into one batch
+// per iteration, so prefill chunks from one client ride along in the
+// same llama_decode() call as generation tokens from other clients.
+struct Batcher
+{
+    enum
+    {
+        kv_none,
+        kv_rm,
+        kv_add,
+        kv_cp,
+        kv_save,
+        kv_load,
+        lora_rm,
+    };
+
+    // one submitted span of work awaiting decode
+    struct Work
+    {
+        Dll elem_;
+        int seq_id_;
+        const int* tokens_ = nullptr;
+        const float* embd_ = nullptr;
+        llama_sampling_context* sampler_ = nullptr;
+        bool apply_grammar_ = false;
+        // logprob capture: probs_[0] receives the sampled token's
+        // record and probs_[1..n_probs_] the top candidates
+        TokenProb* probs_ = nullptr;
+        int n_probs_ = 0;
+        int* out_tokens_ = nullptr;
+        int kv_op_ = kv_none;
+        int kv_p0_ = 0;
+        int kv_p1_ = 0;
+        int kv_delta_ = 0;
+        int kv_seq_dst_ = -1;
+        // fan-out spans carry one row per branch instead of one
+        // span for one sequence, and every row wants its logits
+        const int* seq_ids_ = nullptr;
+        const int* positions_ = nullptr;
+        std::vector<uint8_t>* state_save_ = nullptr;
+        const uint8_t* state_load_ = nullptr;
+        llama_lora_adapter* adapter_ = nullptr;
+        float adapter_scale_ = 0;
+        int count_ = 0;
+        int pos_ = 0;
+        bool wants_logits_ = false;
+        bool done_ = false;
+        int result_ = -1;
+    };
+
+    llama_context* ctx_; // borrowed
+    int n_vocab_;
+    pthread_t th_ = 0;
+    pthread_cond_t work_cond_;
+    pthread_cond_t done_cond_;
+    pthread_mutex_t lock_;
+    Dll* queue_ = nullptr;
+    bool shutting_down_ = false;
+
+    // preallocated once and refilled every iteration, so decoding a
+    // token doesn't pay for llama_batch_init() and free()
+    llama_batch* batch_; // owned
+    int batch_cap_;
+
+    // adapts decode thread counts and the prefill chunk size from
+    // tokens per second feedback, since generation is memory bound
+    // and rarely wants every core, and the right chunk depends on
+    // how the layers split between the gpu and the cpu
+    Governor governor_;
+
+    // lora adapter configuration currently applied to the context.
+    // adapter state feeds the decode graph, so it's only ever
+    // touched on the batcher thread, right before a decode whose
+    // work items want a different configuration
+    llama_lora_adapter* applied_adapter_ = nullptr;
+    float applied_scale_ = 0;
+
+    // last logits row each sequence produced, copied aside so
+    // later decodes for other sequences can't clobber it before
+    // the owning slot gets to sample
+    std::map<int, std::vector<float>> seq_logits_;
+
+    explicit Batcher(llama_context*);
+    ~Batcher();
+    errno_t spawn();
+    void shutdown();
+    void run();
+    int chunk() const;
+    int decode_tokens(int, const int*, int, int, bool,
+                      llama_lora_adapter* = nullptr, float = 0);
+    int decode_embd(int, const float*, int, int, bool,
+                    llama_lora_adapter* = nullptr, float = 0);
+    int decode_fanout(const int*, const int*, const int*, int,
+                      llama_lora_adapter* = nullptr, float = 0);
+    int sample(int, llama_sampling_context*, bool, TokenProb* = nullptr,
+               int = 0);
+    int speculate(int, const int*, int, int, llama_sampling_context*, bool,
+                  int*, llama_lora_adapter* = nullptr, float = 0);
+    int kv_cache_seq_rm(int, int, int);
+    void kv_cache_seq_add(int, int, int, int);
+    void kv_cache_seq_cp(int, int, int, int);
+    int kv_state_save(int, std::vector<uint8_t>*);
+    int kv_state_load(int, const uint8_t*);
+    int lora_remove(llama_lora_adapter*);
+
+  private:
+    int submit(Work*);
+    void step();
+    void verify(Work*);
+    int decode(const llama_batch&);
+    void use_adapter(llama_lora_adapter*, float);
+    void save_logits(int, const float*);
+    void top_logprobs(const float*, TokenProb*, int);
+};
+
+} // namespace server
+} // namespace lf
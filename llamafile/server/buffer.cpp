@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #include "buffer.h"
+#include "memory.h"
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -41,12 +42,14 @@ Buffer::Buffer(size_t capacity) noexcept
         __builtin_trap();
     if (mprotect(p + c, pagesz, PROT_NONE))
         __builtin_trap();
+    memory_count(MEM_HTTP, capacity);
 }
 
 Buffer::~Buffer() noexcept
 {
     if (munmap(p, c + pagesz))
         __builtin_trap();
+    memory_count(MEM_HTTP, -(long)(c + pagesz));
 }
 
 } // namespace server
@@ -0,0 +1,265 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "embedding.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/json.h"
+#include "llamafile/server/cleanup.h"
+#include "llamafile/server/fastjson.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/utils.h"
+#include <cosmo.h>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+// prompt classification endpoint
+//
+// routing tiers want a cheap verdict about each prompt (language,
+// topic, safety) before committing to full generation. /classify
+// embeds the prompt together with a caller supplied list of labels in
+// one shared decode, then scores each label by cosine similarity
+// against the prompt, which is a dot product since the embeddings
+// come back normalized. the prompt is truncated to its leading tokens
+// because routing signals concentrate at the start of a prompt and
+// decode cost is linear in tokens, so classifying a long prompt costs
+// a small fraction of what generating from it would.
+
+#define DEFAULT_WINDOW 256
+#define MAX_LABELS 64
+
+using jt::Json;
+
+namespace lf {
+namespace server {
+
+struct ClassifyParams
+{
+    bool add_special;
+    bool parse_special;
+    int window;
+    std::string text;
+    std::vector<std::string> labels;
+};
+
+void
+cleanup_classify_params(void* arg)
+{
+    delete (ClassifyParams*)arg;
+}
+
+static void
+cleanup_token_vectors(void* arg)
+{
+    delete (std::vector<std::vector<llama_token>>*)arg;
+}
+
+static void
+cleanup_embedding_vectors(void* arg)
+{
+    delete (std::vector<std::vector<float>>*)arg;
+}
+
+bool
+Client::get_classify_params(ClassifyParams* params)
+{
+    params->add_special = true;
+    params->parse_special = false;
+    params->window = DEFAULT_WINDOW;
+    if (!HasHeader(kHttpContentType) ||
+        !IsMimeType(HeaderData(kHttpContentType),
+                    HeaderLength(kHttpContentType),
+                    "application/json"))
+        return send_error(400, "Content Type must be application/json");
+    std::pair<Json::Status, Json> json = Json::parse(payload_);
+    if (json.first != Json::success)
+        return send_error(400, Json::StatusToString(json.first));
+    if (!json.second.isObject())
+        return send_error(400, "JSON body must be an object");
+    Json* input = nullptr;
+    if (!json.second["text"].isNull())
+        input = &json.second["text"];
+    else if (!json.second["content"].isNull())
+        input = &json.second["content"];
+    else
+        return send_error(400, "JSON missing text/content key");
+    if (!input->isString())
+        return send_error(400, "text must be a string");
+    params->text = input->getString();
+    if (!json.second["labels"].isArray())
+        return send_error(400, "labels must be an array");
+    for (Json& label : json.second["labels"].getArray()) {
+        if (!label.isString())
+            return send_error(400, "labels array must hold strings");
+        if (label.getString().empty())
+            return send_error(400, "labels must not be empty strings");
+        params->labels.emplace_back(label.getString());
+    }
+    if (params->labels.size() < 2)
+        return send_error(400, "need at least two labels");
+    if (params->labels.size() > MAX_LABELS)
+        return send_error(400, "too many labels");
+    if (!json.second["window"].isNull()) {
+        if (!json.second["window"].isLong() ||
+            json.second["window"].getLong() <= 0)
+            return send_error(400, "window must be positive integer");
+        params->window = json.second["window"].getLong();
+    }
+    if (json.second["add_special"].isBool())
+        params->add_special = json.second["add_special"].getBool();
+    if (json.second["parse_special"].isBool())
+        params->parse_special = json.second["parse_special"].getBool();
+    return true;
+}
+
+bool
+Client::classify()
+{
+    if (msg_.method != kHttpGet && msg_.method != kHttpPost)
+        return send_error(405);
+
+    if (!read_payload())
+        return false;
+
+    // get parameters
+    auto params = new ClassifyParams;
+    defer_cleanup(cleanup_classify_params, params);
+    if (!get_classify_params(params))
+        return false;
+
+    // setup statistics
+    rusage rustart = {};
+    getrusage(RUSAGE_THREAD, &rustart);
+    timespec started = timespec_real();
+
+    // the documented contract says content is utf-8
+    if (!is_valid_utf8(params->text))
+        return send_error(400, "text must be valid UTF-8");
+    for (const std::string& label : params->labels)
+        if (!is_valid_utf8(label))
+            return send_error(400, "labels must be valid UTF-8");
+
+    // turn text into tokens; prompt first, then one sequence per label
+    const int n_ctx_train = llama_n_ctx_train(model_);
+    int window = MIN(params->window, n_ctx_train);
+    std::vector<std::string_view> prompts;
+    prompts.emplace_back(params->text);
+    for (const std::string& label : params->labels)
+        prompts.emplace_back(label);
+    auto toks_list =
+      new std::vector<std::vector<llama_token>>(prompts.size());
+    defer_cleanup(cleanup_token_vectors, toks_list);
+    size_t count = 0;
+    for (size_t j = 0; j < prompts.size(); ++j) {
+        std::vector<llama_token>& toks = (*toks_list)[j];
+        toks.resize(prompts[j].size() + 16);
+        int n = llama_tokenize(model_,
+                               prompts[j].data(),
+                               prompts[j].size(),
+                               &toks[0],
+                               toks.size(),
+                               params->add_special,
+                               params->parse_special);
+        if (n < 0) {
+            SLOG("llama_tokenize failed");
+            return send_error(405);
+        }
+        toks.resize(n);
+        if (toks.empty())
+            return send_error(400, "completely empty prompt disallowed");
+
+        // the prompt gets truncated to its leading window; labels are
+        // expected to be short but get clamped to the model all the same
+        if ((int)toks.size() > (j ? n_ctx_train : window))
+            toks.resize(j ? n_ctx_train : window);
+        count += toks.size();
+    }
+
+    // inference time, shared with whoever else is embedding
+    auto embeddings = new std::vector<std::vector<float>>(toks_list->size());
+    defer_cleanup(cleanup_embedding_vectors, embeddings);
+    if (!embed_inputs(model_, *toks_list, *embeddings))
+        return send_error(500);
+
+    // cosine similarity of each label against the prompt
+    const std::vector<float>& prompt = (*embeddings)[0];
+    std::vector<double> scores(params->labels.size());
+    size_t best = 0;
+    for (size_t j = 0; j < params->labels.size(); ++j) {
+        const std::vector<float>& label = (*embeddings)[j + 1];
+        double score = 0;
+        for (size_t i = 0; i < prompt.size(); ++i)
+            score += prompt[i] * label[i];
+        scores[j] = score;
+        if (score > scores[best])
+            best = j;
+    }
+
+    // serialize response json
+    char* p = obuf_.p;
+    p = stpcpy(p, "{\n");
+    p = stpcpy(p, "  \"best\": ");
+    p = encode_json(p, params->labels[best]);
+    p = stpcpy(p, ",\n");
+    p = stpcpy(p, "  \"labels\": [");
+    for (size_t j = 0; j < params->labels.size(); ++j) {
+        if (j)
+            p = stpcpy(p, ", ");
+        p = encode_json(p, params->labels[j]);
+    }
+    p = stpcpy(p, "],\n");
+    p = stpcpy(p, "  \"scores\": [");
+    for (size_t j = 0; j < scores.size(); ++j) {
+        if (j)
+            p = stpcpy(p, ", ");
+        p = encode_json(p, scores[j]);
+    }
+    p = stpcpy(p, "],\n");
+    p = stpcpy(p, "  \"tokens_used\": ");
+    p = encode_json(p, count);
+    p = stpcpy(p, "\n}\n");
+    std::string_view content(obuf_.p, p - obuf_.p);
+
+    // collect statistics
+    rusage ruend = {};
+    getrusage(RUSAGE_THREAD, &ruend);
+    timeval user = timeval_sub(ruend.ru_utime, rustart.ru_utime);
+    timeval system = timeval_sub(ruend.ru_stime, rustart.ru_stime);
+    timespec ended = timespec_real();
+    timespec wall = timespec_sub(ended, started);
+    long wall_us = timespec_tomicros(wall);
+    long user_us = timeval_tomicros(user);
+    long system_us = timeval_tomicros(system);
+
+    // send response
+    char* headers = p;
+    p = append_http_response_message(p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    p = stpcpy(p, "X-Wall-Micros: ");
+    p = FormatInt64(p, wall_us);
+    p = stpcpy(p, "\r\nX-User-Micros: ");
+    p = FormatInt64(p, user_us);
+    p = stpcpy(p, "\r\nX-System-Micros: ");
+    p = FormatInt64(p, system_us);
+    p = stpcpy(p, "\r\n");
+    return send_response(headers, p, content);
+}
+
+} // namespace server
+} // namespace lf
@@ -19,24 +19,38 @@
 #include "llama.cpp/llama.h"
 #include "llamafile/flags.h"
 #include "llamafile/llamafile.h"
+#include "llamafile/pool.h"
+#include "llamafile/server/assetcache.h"
 #include "llamafile/server/cleanup.h"
+#include "llamafile/server/deadline.h"
+#include "llamafile/server/eventlog.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/metering.h"
+#include "llamafile/server/models.h"
+#include "llamafile/server/recorder.h"
 #include "llamafile/server/server.h"
+#include "llamafile/server/slots.h"
 #include "llamafile/server/time.h"
 #include "llamafile/server/tokenbucket.h"
+#include "llamafile/server/tunables.h"
 #include "llamafile/server/utils.h"
 #include "llamafile/server/worker.h"
 #include "llamafile/string.h"
 #include "llamafile/threadlocal.h"
+#include "llamafile/trace.h"
 #include "llamafile/trust.h"
 #include "llamafile/version.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <memory>
+#include <poll.h>
 #include <string.h>
 #include <string>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <third_party/zlib/zlib.h>
 #include <time.h>
 #include <unistd.h>
 #include <vector>
@@ -82,6 +96,38 @@ pick_content_type(const std::string_view& path)
     return ct;
 }
 
+// returns true for content types that deflate meaningfully, which is
+// the text of the www bundle rather than images already packed tight
+bool
+is_compressible(const std::string_view content_type)
+{
+    return content_type.starts_with("text/") ||
+           content_type.starts_with("application/json") ||
+           content_type.starts_with("application/javascript") ||
+           content_type == "image/svg+xml";
+}
+
+// compresses an entire response body in one shot
+bool
+gzip_all(const std::string_view content, std::string* out)
+{
+    z_stream zs = {};
+    if (deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, MAX_WBITS + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    out->resize(deflateBound(&zs, content.size()));
+    zs.next_in = (Bytef*)content.data();
+    zs.avail_in = content.size();
+    zs.next_out = (Bytef*)out->data();
+    zs.avail_out = out->size();
+    int rc = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END)
+        return false;
+    out->resize(out->size() - zs.avail_out);
+    return true;
+}
+
 Client::Client(llama_model* model)
   : model_(model)
   , cleanups_(nullptr)
@@ -101,6 +147,7 @@ Client::close()
     if (fd_ != -1) {
         if (FLAG_verbose >= 2)
             SLOG("close");
+        recorder_close(fd_);
         rc = ::close(fd_);
         fd_ = -1;
     }
@@ -129,7 +176,14 @@ Client::clear()
     free(url_.params.p);
     url_.params.p = nullptr;
     close_connection_ = false;
+    chunked_ = false;
+    websocket_ = false;
+    if (gzip_) {
+        deflateEnd(&zs_);
+        gzip_ = false;
+    }
     payload_ = "";
+    sse_buf_.clear();
     unread_ = 0;
 }
 
@@ -147,6 +201,7 @@ void
 Client::run()
 {
     ibuf_.n = 0;
+    should_park_ = false;
     for (;;) {
 
         // read headers
@@ -171,6 +226,14 @@ Client::run()
             memmove(ibuf_.p, ibuf_.p + ibuf_.i, ibuf_.n - ibuf_.i);
             ibuf_.n -= ibuf_.i;
         }
+
+        // the next request hasn't arrived yet. rather than blocking
+        // this worker thread in read() until it does, hand the fd to
+        // the parker and let the thread go serve another connection.
+        if (!ibuf_.n) {
+            should_park_ = true;
+            return;
+        }
     }
 }
 
@@ -184,6 +247,7 @@ Client::read_request()
         if (inmsglen > 0) {
             message_started_ = timespec_real();
             ibuf_.i = inmsglen;
+            recorder_recv(fd_, std::string_view(ibuf_.p, inmsglen));
             return true;
         }
         if (inmsglen == -1) {
@@ -240,14 +304,20 @@ Client::transport()
         set_thread_name(name);
     }
 
+    // the request's priority class travels with any pool tasks this
+    // thread spawns on its behalf, e.g. image decodes, so batch work
+    // yields to interactive work inside the pool too
+    llamafile_task_context task_ctx = { LLAMAFILE_PRIORITY_INTERACTIVE, 0 };
     if (get_header("X-Priority") == "batch") {
+        task_ctx.priority = LLAMAFILE_PRIORITY_BATCH;
         worker_->deprioritize();
     } else if (!effective_ip_trusted_) {
-        if (tokenbucket_acquire(client_ip_) > FLAG_token_burst) {
+        if (tokenbucket_acquire(client_ip_) > tunables()->token_burst) {
             SLOG("deprioritizing");
             worker_->deprioritize();
         }
     }
+    llamafile_task_set_context(&task_ctx);
 
     if (msg_.version > 11) {
         close_connection_ = true;
@@ -266,8 +336,15 @@ Client::transport()
 
     if (HasHeader(kHttpTransferEncoding))
         if (!HeaderEqualCase(kHttpTransferEncoding, "identity")) {
-            close_connection_ = true;
-            return send_error(501, "Transfer-Encoding Not Implemented");
+            if (!HeaderEqualCase(kHttpTransferEncoding, "chunked")) {
+                close_connection_ = true;
+                return send_error(501, "Transfer-Encoding Not Implemented");
+            }
+            if (HasHeader(kHttpContentLength)) {
+                close_connection_ = true;
+                return send_error(400, "Chunked With Content-Length");
+            }
+            chunked_ = true;
         }
 
     if (HasHeader(kHttpContentLength)) {
@@ -283,7 +360,7 @@ Client::transport()
             return send_error(413);
         }
         unread_ = cl;
-    } else if (msg_.method == kHttpPost || msg_.method == kHttpPut) {
+    } else if (!chunked_ && (msg_.method == kHttpPost || msg_.method == kHttpPut)) {
         close_connection_ = true;
         return send_error(411);
     }
@@ -323,6 +400,99 @@ Client::send_error(int code, const char* reason)
     return false;
 }
 
+// sends 503 telling the client when it's worth trying again.
+//
+// after this function is called, the handler must return control.
+//
+// @param retry_after is the suggested backoff in seconds
+bool
+Client::send_too_busy(int retry_after)
+{
+    SLOG("shedding request; try again in %d seconds", retry_after);
+    char* p = append_http_response_message(obuf_.p, 503);
+    p = stpcpy(p, "Retry-After: ");
+    p = FormatInt32(p, retry_after);
+    p = stpcpy(p, "\r\n");
+    (void)!send_response(obuf_.p, p, "Service Unavailable\r\n");
+    return false;
+}
+
+static void
+cleanup_modelref(void* arg)
+{
+    Client* client = (Client*)arg;
+    if (client->modelref_) {
+        client->worker_->server_->models_->release(client->modelref_);
+        client->modelref_ = nullptr;
+        client->model_ = client->worker_->server_->model_;
+    }
+}
+
+// points this request at the model named by the openai model field.
+// unknown names resolve to the startup model like they always have.
+// loading happens lazily, so naming a cold model can take a while.
+//
+// returns false if the weights couldn't be loaded, in which case an
+// error response should be sent.
+bool
+Client::use_model(const std::string& name)
+{
+    Models* models = worker_->server_->models_;
+    if (!models)
+        return true;
+    Model* model = models->find(name);
+    if (!models->acquire(model))
+        return false;
+    modelref_ = model;
+    model_ = model->model;
+    defer_cleanup(cleanup_modelref, this);
+    return true;
+}
+
+// returns the slots serving this request's model
+Slots*
+Client::slots()
+{
+    if (modelref_ && modelref_->slots)
+        return modelref_->slots;
+    return worker_->server_->slots_;
+}
+
+// returns the slot id named by the request's x-slot affinity hint,
+// or -1 if there's no hint or it was minted elsewhere. the balancer
+// echoes this header from an earlier response, and the node token
+// check makes hints from other nodes (or prior boots of this one,
+// whose kv is gone) fall back to normal prefix scoring
+int
+Client::slot_hint()
+{
+    std::string_view h = get_header("X-Slot");
+    if (h.empty())
+        return -1;
+    const std::string& node = slots()->node_token_;
+    if (h.size() <= node.size() + 1 || //
+        h.substr(0, node.size()) != node || //
+        h[node.size()] != '.')
+        return -1;
+    int64_t id = atoi(h.substr(node.size() + 1));
+    if (id < 0 || id >= (int64_t)slots()->size())
+        return -1;
+    return id;
+}
+
+// appends the session affinity header naming this node and the slot
+// that served the request, so a load balancer can route the next
+// turn of the conversation back to its warm kv cache
+char*
+Client::append_slot_hint(char* p, int slot)
+{
+    p = stpcpy(p, "X-Slot: ");
+    p = stpcpy(p, slots()->node_token_.c_str());
+    *p++ = '.';
+    p = FormatInt32(p, slot);
+    return stpcpy(p, "\r\n");
+}
+
 // appends start of http response message to `p`
 //
 // after this function is called, more header lines may be appended.
@@ -355,6 +525,7 @@ Client::append_http_response_message(char* p, int code, const char* reason)
     p = stpcpy(p, reason);
     *p++ = '\r';
     *p++ = '\n';
+    eventlog_status(code);
 
     // append standard headers
     p = stpcpy(p, STANDARD_RESPONSE_HEADERS);
@@ -384,6 +555,17 @@ Client::append_http_response_message(char* p, int code, const char* reason)
     return p;
 }
 
+// returns true if the client said it can decode gzip responses
+bool
+Client::accepts_gzip()
+{
+    if (!HasHeader(kHttpAcceptEncoding))
+        return false;
+    return header_has_token(std::string_view(HeaderData(kHttpAcceptEncoding),
+                                             HeaderLength(kHttpAcceptEncoding)),
+                            "gzip");
+}
+
 // sends http response message and body in one shot
 //
 // after this function is called, the handler must return control.
@@ -397,6 +579,17 @@ Client::send_response(char* p0, char* p, std::string_view content)
     pthread_testcancel();
     should_send_error_if_canceled_ = false;
 
+    // bodies worth compressing go out gzipped for consenting clients,
+    // since a conversation dump or embedding array is json that
+    // deflates severalfold and egress is somebody's bill
+    std::string gzipped;
+    if (content.size() >= 512 && accepts_gzip() &&
+        gzip_all(content, &gzipped) && gzipped.size() < content.size()) {
+        p = stpcpy(p, "Content-Encoding: gzip\r\n");
+        p = stpcpy(p, "Vary: Accept-Encoding\r\n");
+        content = gzipped;
+    }
+
     // append content length
     p = stpcpy(p, "Content-Length: ");
     p = FormatInt64(p, content.size());
@@ -441,6 +634,20 @@ Client::send_response(char* p0, char* p, std::string_view content)
 bool
 Client::send_response_start(char* p0, char* p)
 {
+    // streamed bodies compress with a deflate stream that lives as
+    // long as the response, sync flushed at every event flush, so the
+    // window carries across events and the json keys every event
+    // repeats cost almost nothing after the first
+    if (accepts_gzip()) {
+        memset(&zs_, 0, sizeof(zs_));
+        if (deflateInit2(&zs_, Z_BEST_SPEED, Z_DEFLATED, MAX_WBITS + 16, 8,
+                         Z_DEFAULT_STRATEGY) == Z_OK) {
+            gzip_ = true;
+            p = stpcpy(p, "Content-Encoding: gzip\r\n");
+            p = stpcpy(p, "Vary: Accept-Encoding\r\n");
+        }
+    }
+
     // use chunked transfer encoding if http/1.1
     if (msg_.version >= 11)
         p = stpcpy(p, "Transfer-Encoding: chunked\r\n");
@@ -450,9 +657,137 @@ Client::send_response_start(char* p0, char* p)
     *p++ = '\n';
 
     should_send_error_if_canceled_ = false;
+    sse_buf_.clear();
+    sse_last_flush_ = 0;
     return send(std::string_view(p0, p - p0));
 }
 
+// appends one server-sent event to the outgoing event buffer.
+//
+// consecutive events that arrive within --sse-flush-ms of the last
+// flush get coalesced into one system call, since at hundreds of
+// tokens per second the per-event syscall cost would dominate. the
+// first event of a response always goes out immediately, so time to
+// first byte is unaffected. a buffered event waits at most one token
+// interval, because the flush happens when the next event (or the
+// response finish) comes along after the window has elapsed.
+bool
+Client::send_response_event(const std::string_view json)
+{
+    // frame event, inside a chunk envelope if http/1.1 and the body
+    // isn't being compressed, in which case flush_response_events()
+    // wraps each compressed flush in one envelope instead
+    if (!gzip_ && msg_.version >= 11) {
+        char start[32];
+        size_t event_size = 6 + json.size() + 2;
+        char* p = FormatHex64(start, event_size, 0);
+        *p++ = '\r';
+        *p++ = '\n';
+        sse_buf_.append(start, p - start);
+    }
+    sse_buf_ += "data: ";
+    sse_buf_ += json;
+    sse_buf_ += "\n\n";
+    if (!gzip_ && msg_.version >= 11)
+        sse_buf_ += "\r\n";
+
+    // nagle-style flush decision
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long us = now.tv_sec * 1000000L + now.tv_nsec / 1000;
+    if (FLAG_sse_flush_ms > 0 && //
+        us - sse_last_flush_ < FLAG_sse_flush_ms * 1000L &&
+        sse_buf_.size() < 16384)
+        return true;
+    return flush_response_events();
+}
+
+// how long a client may sit over the --send-backlog threshold
+// without draining a byte before we stop carrying its slot
+static constexpr long kSendStallMs = 30000;
+
+// pauses the decode loop for clients that aren't draining the stream.
+//
+// the kernel send buffer can absorb minutes' worth of tokens for a
+// client on a slow link, so the slot decodes at full speed for a
+// reader who may never catch up, and once the buffer finally fills
+// the worker wedges inside writev() holding its slot anyway. so when
+// a client's undelivered backlog exceeds --send-backlog, this worker
+// naps in poll() until the backlog drains. the batcher stops seeing
+// this slot's tokens for the duration, and the compute goes to the
+// clients that are actually consuming. a client that stays wedged
+// past the grace period is dropped like a failed send
+bool
+Client::pace_outbound()
+{
+    int outq;
+    if (FLAG_send_backlog <= 0)
+        return true;
+    if (ioctl(fd_, TIOCOUTQ, &outq))
+        return true; // transport won't say, so no pacing
+    if (outq <= FLAG_send_backlog)
+        return true;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long give_up = now.tv_sec * 1000L + now.tv_nsec / 1000000 + kSendStallMs;
+    do {
+        // zero requested events still reports errors and hangups, so
+        // this is a bounded nap that notices disconnection right away
+        pollfd pfd = { fd_, 0, 0 };
+        if (poll(&pfd, 1, 50) == -1 || (pfd.revents & (POLLERR | POLLHUP))) {
+            close_connection_ = true;
+            return false;
+        }
+        if (ioctl(fd_, TIOCOUTQ, &outq) || outq <= FLAG_send_backlog)
+            return true;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (now.tv_sec * 1000L + now.tv_nsec / 1000000 < give_up);
+    SLOG("client stalled with %d bytes undelivered; dropping", outq);
+    close_connection_ = true;
+    return false;
+}
+
+// transmits buffered server-sent events in a single system call
+bool
+Client::flush_response_events()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sse_last_flush_ = now.tv_sec * 1000000L + now.tv_nsec / 1000;
+    if (sse_buf_.empty())
+        return true;
+    if (!pace_outbound())
+        return false;
+    bool ok;
+    if (gzip_)
+        ok = send_gzip_chunk(sse_buf_, Z_SYNC_FLUSH);
+    else
+        ok = send(sse_buf_);
+    sse_buf_.clear();
+    return ok;
+}
+
+// deflates content onto the wire as one http chunk. sync flush hands
+// the client every compressed byte now; finish ends the gzip stream
+bool
+Client::send_gzip_chunk(const std::string_view content, int flush)
+{
+    gzip_buf_.clear();
+    zs_.next_in = (Bytef*)content.data();
+    zs_.avail_in = content.size();
+    do {
+        size_t off = gzip_buf_.size();
+        gzip_buf_.resize(off + 4096);
+        zs_.next_out = (Bytef*)(gzip_buf_.data() + off);
+        zs_.avail_out = 4096;
+        deflate(&zs_, flush);
+        gzip_buf_.resize(gzip_buf_.size() - zs_.avail_out);
+    } while (!zs_.avail_out);
+    if (gzip_buf_.empty())
+        return true;
+    return send_response_chunk(gzip_buf_);
+}
+
 // finishes sending chunked http response body.
 //
 // once you are finished sending chunks, call send_response_finish().
@@ -505,6 +840,15 @@ Client::send_response_chunk(const std::string_view content)
 bool
 Client::send_response_finish()
 {
+    if (!flush_response_events())
+        return false;
+    if (gzip_) {
+        bool ok = send_gzip_chunk("", Z_FINISH);
+        deflateEnd(&zs_);
+        gzip_ = false;
+        if (!ok)
+            return false;
+    }
     cleanup();
 
     // don't encode chunk boundaries for simple http client
@@ -619,6 +963,8 @@ Client::get_header(const std::string_view& key)
 bool
 Client::read_payload()
 {
+    if (chunked_)
+        return read_chunked_payload();
     while (ibuf_.n - ibuf_.i < unread_) {
         ssize_t got;
         if ((got = read(fd_, ibuf_.p + ibuf_.n, ibuf_.c - ibuf_.n)) <= 0) {
@@ -631,6 +977,7 @@ Client::read_payload()
         ibuf_.n += got;
     }
     payload_ = std::string_view(ibuf_.p + ibuf_.i, unread_);
+    recorder_recv(fd_, payload_);
     ibuf_.i += unread_;
     unread_ = 0;
     if (msg_.method == kHttpPost && //
@@ -644,13 +991,73 @@ Client::read_payload()
     return true;
 }
 
+// decodes chunked transfer coding in place
+//
+// chunk data gets compacted to the front of the body region of the
+// receive buffer as it's parsed, so the decoded payload ends up a
+// contiguous view into ibuf_ just like the content-length case, and
+// handlers needn't care which framing the client used. bytes beyond
+// the terminating chunk belong to the next pipelined request and are
+// moved down flush against the decoded payload.
+bool
+Client::read_chunked_payload()
+{
+    int rc;
+    size_t length;
+    HttpUnchunker unchunker = {};
+    for (;;) {
+        rc =
+          Unchunk(&unchunker, ibuf_.p + ibuf_.i, ibuf_.n - ibuf_.i, &length);
+        if (rc == -1) {
+            close_connection_ = true;
+            return send_error(400, "Bad Chunk Coding");
+        }
+        if (rc)
+            break;
+        if (ibuf_.n == ibuf_.c) {
+            close_connection_ = true;
+            return send_error(413);
+        }
+        ssize_t got;
+        if ((got = read(fd_, ibuf_.p + ibuf_.n, ibuf_.c - ibuf_.n)) <= 0) {
+            if (!got)
+                SLOG("unexpected eof");
+            if (got == -1)
+                SLOG("read failed %m");
+            return false;
+        }
+        ibuf_.n += got;
+    }
+    chunked_ = false;
+    payload_ = std::string_view(ibuf_.p + ibuf_.i, length);
+    recorder_recv(fd_, payload_);
+    memmove(ibuf_.p + ibuf_.i + length,
+            ibuf_.p + ibuf_.i + rc,
+            ibuf_.n - (ibuf_.i + rc));
+    ibuf_.n -= rc - length;
+    ibuf_.i += length;
+    if (msg_.method == kHttpPost && //
+        HasHeader(kHttpContentType) &&
+        IsMimeType(HeaderData(kHttpContentType),
+                   HeaderLength(kHttpContentType),
+                   "application/x-www-form-urlencoded")) {
+        params_memory_ =
+          ParseParams(payload_.data(), payload_.size(), &url_.params);
+    }
+    return true;
+}
+
 bool
 Client::dispatch()
 {
     bool res;
     should_send_error_if_canceled_ = true;
     g_http_cancel.set(this);
+    llamafile_trace_begin_cat("request", "server");
+    eventlog_begin(effective_ip_);
     res = dispatcher();
+    eventlog_commit();
+    llamafile_trace_end_cat("request", "server");
     g_http_cancel.set(nullptr);
     return res;
 }
@@ -688,13 +1095,39 @@ Client::dispatcher()
     }
     p1 = p1.substr(1);
 
+    // attribute this request's phase measurements to whatever tenant
+    // its credential names, before any phase can run
+    metering_bind(get_header("Authorization"));
+
+    // arm the end-to-end deadline every blocking stage checks.
+    // --request-timeout gives each request its default budget, and an
+    // X-Timeout-Ms header may tighten it but never extend it
+    long timeout_ms = FLAG_request_timeout * 1000L;
+    std::string_view xt = get_header("X-Timeout-Ms");
+    if (!xt.empty()) {
+        long ms = atol(std::string(xt).c_str());
+        if (ms > 0 && (!timeout_ms || ms < timeout_ms))
+            timeout_ms = ms;
+    }
+    deadline_set(timeout_ms);
+
     // look for dynamic endpoints
     if (p1 == "tokenize")
         return tokenize();
+    if (p1 == "tokenize/bulk")
+        return tokenize_bulk();
+    if (p1 == "detokenize/bulk")
+        return detokenize_bulk();
     if (p1 == "embedding")
         return embedding();
     if (p1 == "v1/embeddings")
         return embedding();
+    if (p1 == "classify")
+        return classify();
+    if (p1 == "compress")
+        return compress();
+    if (p1 == "search")
+        return search();
     if (p1 == "v1/completions")
         return v1_completions();
     if (p1 == "v1/chat/completions")
@@ -703,8 +1136,32 @@ Client::dispatcher()
         return v1_models();
     if (p1 == "slotz")
         return slotz();
+    if (p1 == "slot-state")
+        return slot_state();
     if (p1 == "flagz")
         return flagz();
+    if (p1 == "adapters")
+        return adapterz();
+    if (p1 == "adapters/load")
+        return adapter_load();
+    if (p1 == "adapters/unload")
+        return adapter_unload();
+    if (p1 == "adapters/scale")
+        return adapter_scale();
+    if (p1 == "metrics")
+        return metricz();
+    if (p1 == "meterz")
+        return meterz();
+    if (p1 == "memz")
+        return memz();
+    if (p1 == "modelfile")
+        return modelfile();
+    if (p1 == "timings")
+        return timings();
+    if (p1 == "warm")
+        return warm();
+    if (p1 == "trace")
+        return tracez();
 
 #if 0
     // TODO: implement frontend for database
@@ -730,6 +1187,7 @@ Client::dispatcher()
     // serve static endpoints
     int infd;
     size_t size;
+    struct stat st;
     resolved_ = resolve(FLAG_www_root, p1);
     for (;;) {
         infd = open(resolved_.c_str(), O_RDONLY);
@@ -745,7 +1203,6 @@ Client::dispatcher()
                 return send_error(500);
             }
         }
-        struct stat st;
         if (fstat(infd, &st)) {
             SLOG("%s: %s", strerror(errno), resolved_.c_str());
             ::close(infd);
@@ -764,9 +1221,55 @@ Client::dispatcher()
         }
     }
     defer_cleanup(cleanup_fildes, (void*)(intptr_t)infd);
+    const char* content_type = pick_content_type(resolved_);
+
+    // the www bundle is a few hundred kilobytes that every chat page
+    // load asks for again, so regular files are served from a shared
+    // immutable cache holding the body, a pre-deflated copy, and a
+    // strong etag. our standard Cache-Control makes browsers ask every
+    // time, so a matching If-None-Match answers with no body work
+    if (std::shared_ptr<const Asset> asset =
+          assetcache_get(resolved_, infd, st, content_type)) {
+        if (get_header("If-None-Match") == asset->etag) {
+            char* p = obuf_.p;
+            char* headers = p;
+            p = append_http_response_message(p, 304);
+            p = stpcpy(p, "ETag: ");
+            p = (char*)mempcpy(p, asset->etag.data(), asset->etag.size());
+            p = stpcpy(p, "\r\n");
+            return send_response(headers, p, "");
+        }
+        char* p = append_http_response_message(obuf_.p, 200, "OK");
+        p = stpcpy(p, "Content-Type: ");
+        p = stpcpy(p, asset->content_type);
+        p = stpcpy(p, "\r\n");
+        p = stpcpy(p, "ETag: ");
+        p = (char*)mempcpy(p, asset->etag.data(), asset->etag.size());
+        p = stpcpy(p, "\r\n");
+        const std::string* body = &asset->body;
+        if (!asset->gzip.empty()) {
+            p = stpcpy(p, "Vary: Accept-Encoding\r\n");
+            if (accepts_gzip()) {
+                body = &asset->gzip;
+                p = stpcpy(p, "Content-Encoding: gzip\r\n");
+            }
+        }
+        p = stpcpy(p, "Content-Length: ");
+        p = FormatInt64(p, body->size());
+        p = stpcpy(p, "\r\n");
+        p = stpcpy(p, "\r\n");
+        should_send_error_if_canceled_ = false;
+        if (!send2(std::string_view(obuf_.p, p - obuf_.p), *body))
+            return false;
+        if (FLAG_verbose >= 1)
+            SLOG("served %s", resolved_.c_str());
+        cleanup();
+        return true;
+    }
+
     char* p = append_http_response_message(obuf_.p, 200, "OK");
     p = stpcpy(p, "Content-Type: ");
-    p = stpcpy(p, pick_content_type(resolved_));
+    p = stpcpy(p, content_type);
     p = stpcpy(p, "\r\n");
     p = stpcpy(p, "Content-Length: ");
     p = FormatInt64(p, size);
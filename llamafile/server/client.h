@@ -25,6 +25,7 @@
 #include <optional>
 #include <string>
 #include <sys/resource.h>
+#include <third_party/zlib/zlib.h>
 
 #define HasHeader(H) (!!msg_.headers[H].a)
 #define HeaderData(H) (ibuf_.p + msg_.headers[H].a)
@@ -40,10 +41,14 @@ namespace lf {
 namespace server {
 
 struct Cleanup;
+struct Model;
 struct Slot;
+struct Slots;
 struct Worker;
 struct TokenizeParams;
 struct EmbeddingParams;
+struct ClassifyParams;
+struct CompressParams;
 struct V1CompletionParams;
 struct V1ChatCompletionParams;
 
@@ -55,11 +60,15 @@ struct Client
     bool client_ip_trusted_ = false;
     bool effective_ip_trusted_ = false;
     bool close_connection_ = false;
+    bool chunked_ = false;
+    bool websocket_ = false;
+    bool should_park_ = false;
     bool should_send_error_if_canceled_;
     size_t unread_ = 0;
     Worker* worker_; // borrowed
     Slot* slot_ = nullptr; // owned or null
     llama_model* model_; // borrowed
+    Model* modelref_ = nullptr; // held in Models registry or null
     timespec message_started_;
     HttpMessage msg_;
     Url url_ = {};
@@ -68,6 +77,13 @@ struct Client
     std::string_view payload_;
     std::string resolved_;
     std::string dump_;
+    std::string sse_buf_;
+    long sse_last_flush_ = 0;
+
+    // streaming gzip state while a response body is being compressed
+    bool gzip_ = false;
+    z_stream zs_;
+    std::string gzip_buf_;
     Cleanup* cleanups_;
     Buffer ibuf_;
     Buffer obuf_;
@@ -81,6 +97,7 @@ struct Client
     bool transport() __wur;
     bool synchronize() __wur;
     bool read_payload() __wur;
+    bool read_chunked_payload() __wur;
     bool read_request() __wur;
     bool read_content() __wur;
     bool send_continue() __wur;
@@ -88,11 +105,26 @@ struct Client
     bool send_binary(const void*, size_t) __wur;
     void defer_cleanup(void (*)(void*), void*);
     bool send_error(int, const char* = nullptr);
+    bool send_too_busy(int);
+    bool use_model(const std::string&);
+    Slots* slots();
+    int slot_hint();
+    char* append_slot_hint(char*, int);
     char* append_http_response_message(char*, int, const char* = nullptr);
     bool send_response(char*, char*, const std::string_view) __wur;
     bool send_response_start(char*, char*) __wur;
     bool send_response_chunk(const std::string_view) __wur;
+    bool send_response_event(const std::string_view) __wur;
+    bool flush_response_events() __wur;
+    bool pace_outbound() __wur;
+    bool accepts_gzip();
+    bool send_gzip_chunk(const std::string_view, int) __wur;
     bool send_response_finish() __wur;
+    bool is_websocket_upgrade();
+    bool send_websocket_upgrade() __wur;
+    bool send_websocket_frame(int, const std::string_view) __wur;
+    bool send_token_event(int, long) __wur;
+    bool send_websocket_finish(const char*) __wur;
     bool send2(const std::string_view, const std::string_view) __wur;
     char* append_header(const std::string_view, const std::string_view);
     bool has_at_most_this_element(int, const std::string_view);
@@ -107,10 +139,20 @@ struct Client
 
     bool tokenize() __wur;
     bool get_tokenize_params(TokenizeParams*) __wur;
+    bool tokenize_bulk() __wur;
+    bool detokenize_bulk() __wur;
 
     bool embedding() __wur;
     bool get_embedding_params(EmbeddingParams*) __wur;
 
+    bool classify() __wur;
+    bool get_classify_params(ClassifyParams*) __wur;
+
+    bool compress() __wur;
+    bool get_compress_params(CompressParams*) __wur;
+
+    bool search() __wur;
+
     bool v1_completions() __wur;
     bool get_v1_completions_params(V1CompletionParams*) __wur;
 
@@ -120,7 +162,20 @@ struct Client
     bool v1_models() __wur;
 
     bool slotz() __wur;
+    bool slot_state() __wur;
     bool flagz() __wur;
+    bool flagz_update() __wur;
+    bool adapterz() __wur;
+    bool adapter_load() __wur;
+    bool adapter_unload() __wur;
+    bool adapter_scale() __wur;
+    bool metricz() __wur;
+    bool meterz() __wur;
+    bool memz() __wur;
+    bool modelfile() __wur;
+    bool timings() __wur;
+    bool warm() __wur;
+    bool tracez() __wur;
     bool db_chat(int64_t) __wur;
     bool db_chats() __wur;
     bool db_message(int64_t) __wur;
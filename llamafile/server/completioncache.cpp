@@ -0,0 +1,147 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "completioncache.h"
+#include "llamafile/llamafile.h"
+#include "memory.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <pthread.h>
+#include <string>
+
+// exact match response cache for deterministic completions
+//
+// a surprising share of completion traffic is literal duplicates:
+// client retries, identical rag queries, and eval reruns at
+// temperature zero. a greedy request always produces the same
+// response, so serving the remembered bytes is indistinguishable
+// from decoding them again, except it doesn't occupy a slot. the
+// key is the canonicalized request json, and a hit is only trusted
+// after the stored request compares equal byte for byte, so a hash
+// collision degrades to a miss rather than a wrong answer.
+//
+// worker threads handling requests are subject to pthread_cancel(),
+// so nothing that's a cancelation point may happen under the lock.
+
+namespace lf {
+namespace server {
+
+struct CompletionCacheEntry
+{
+    uint64_t stamp;
+    std::string request;
+    std::string response;
+};
+
+static size_t g_bytes;
+static uint64_t g_stamp;
+static std::atomic_long g_hits;
+static std::atomic_long g_misses;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<uint64_t, CompletionCacheEntry> g_entries;
+
+static uint64_t
+completioncache_hash(const std::string& s)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < s.size(); ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+// copies the remembered response for `request` into `response`,
+// returning false on a miss. the copy happens under the lock so the
+// entry can't be evicted out from under the caller.
+bool
+completioncache_get(const std::string& request, std::string* response)
+{
+    bool hit = false;
+    pthread_mutex_lock(&g_lock);
+    auto e = g_entries.find(completioncache_hash(request));
+    if (e != g_entries.end() && e->second.request == request) {
+        e->second.stamp = ++g_stamp;
+        *response = e->second.response;
+        hit = true;
+    }
+    pthread_mutex_unlock(&g_lock);
+    if (hit)
+        g_hits.fetch_add(1, std::memory_order_relaxed);
+    else
+        g_misses.fetch_add(1, std::memory_order_relaxed);
+    return hit;
+}
+
+// remembers the response served for `request`. least recently used
+// entries are evicted once the arena exceeds its byte budget.
+void
+completioncache_put(const std::string& request, const std::string& response)
+{
+    pthread_mutex_lock(&g_lock);
+    size_t before = g_bytes;
+    CompletionCacheEntry& entry =
+      g_entries[completioncache_hash(request)];
+    g_bytes -= entry.request.size() + entry.response.size();
+    entry.stamp = ++g_stamp;
+    entry.request = request;
+    entry.response = response;
+    g_bytes += entry.request.size() + entry.response.size();
+    while (g_bytes > (size_t)FLAG_completion_cache_size &&
+           g_entries.size() > 1) {
+        auto oldest = g_entries.begin();
+        for (auto e = g_entries.begin(); e != g_entries.end(); ++e)
+            if (e->second.stamp < oldest->second.stamp)
+                oldest = e;
+        g_bytes -=
+          oldest->second.request.size() + oldest->second.response.size();
+        g_entries.erase(oldest);
+    }
+    memory_count(MEM_JSON, (long)g_bytes - (long)before);
+    pthread_mutex_unlock(&g_lock);
+}
+
+// appends hit and miss counters in prometheus text exposition format
+void
+completioncache_render(std::string* out)
+{
+    char buf[128];
+    snprintf(buf,
+             sizeof(buf),
+             "# TYPE llamafile_completion_cache_hits_total counter\n"
+             "llamafile_completion_cache_hits_total %ld\n"
+             "# TYPE llamafile_completion_cache_misses_total counter\n"
+             "llamafile_completion_cache_misses_total %ld\n",
+             g_hits.load(std::memory_order_relaxed),
+             g_misses.load(std::memory_order_relaxed));
+    *out += buf;
+}
+
+void
+completioncache_destroy()
+{
+    pthread_mutex_lock(&g_lock);
+    memory_count(MEM_JSON, -(long)g_bytes);
+    g_bytes = 0;
+    std::map<uint64_t, CompletionCacheEntry>().swap(g_entries);
+    pthread_mutex_unlock(&g_lock);
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,296 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "embedding.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/json.h"
+#include "llamafile/server/cleanup.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/utils.h"
+#include <algorithm>
+#include <cosmo.h>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+// context compression endpoint
+//
+// rag prompts carry thousands of tokens of retrieved passages, many
+// of marginal relevance, and prefill cost is linear in tokens.
+// /compress scores each passage against the query using the same
+// shared-decode embedding pass that /classify uses for labels, then
+// keeps the highest scoring passages up to a caller supplied token
+// budget, preserving their original order. the caller prefills the
+// compressed context instead of the raw retrieval dump, opting in
+// request by request. scoring a passage costs an embedding decode of
+// its tokens, a small fraction of prefilling it alongside a long
+// prompt and paying attention over the whole window.
+
+#define MAX_SEGMENTS 256
+
+using jt::Json;
+
+namespace lf {
+namespace server {
+
+struct CompressParams
+{
+    bool add_special;
+    bool parse_special;
+    long budget;
+    std::string query;
+    std::vector<std::string> segments;
+};
+
+void
+cleanup_compress_params(void* arg)
+{
+    delete (CompressParams*)arg;
+}
+
+static void
+cleanup_token_vectors(void* arg)
+{
+    delete (std::vector<std::vector<llama_token>>*)arg;
+}
+
+static void
+cleanup_embedding_vectors(void* arg)
+{
+    delete (std::vector<std::vector<float>>*)arg;
+}
+
+// splits retrieved context on blank lines, the natural passage
+// boundary in retrieval dumps. callers wanting different spans can
+// pass a segments array instead
+static void
+split_segments(const std::string& text, std::vector<std::string>* segments)
+{
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t j = text.find("\n\n", i);
+        if (j == std::string::npos)
+            j = text.size();
+        size_t beg = i;
+        size_t end = j;
+        while (beg < end && (text[beg] == '\n' || text[beg] == '\r'))
+            ++beg;
+        while (end > beg && (text[end - 1] == '\n' || text[end - 1] == '\r'))
+            --end;
+        if (end > beg)
+            segments->emplace_back(text.substr(beg, end - beg));
+        i = j + 2;
+    }
+}
+
+bool
+Client::get_compress_params(CompressParams* params)
+{
+    params->add_special = true;
+    params->parse_special = false;
+    params->budget = 0;
+    if (!HasHeader(kHttpContentType) ||
+        !IsMimeType(HeaderData(kHttpContentType),
+                    HeaderLength(kHttpContentType),
+                    "application/json"))
+        return send_error(400, "Content Type must be application/json");
+    std::pair<Json::Status, Json> json = Json::parse(payload_);
+    if (json.first != Json::success)
+        return send_error(400, Json::StatusToString(json.first));
+    if (!json.second.isObject())
+        return send_error(400, "JSON body must be an object");
+    if (!json.second["query"].isString())
+        return send_error(400, "JSON missing query key");
+    params->query = json.second["query"].getString();
+    if (json.second["segments"].isArray()) {
+        for (Json& segment : json.second["segments"].getArray()) {
+            if (!segment.isString())
+                return send_error(400, "segments array must hold strings");
+            if (segment.getString().empty())
+                return send_error(400, "segments must not be empty strings");
+            params->segments.emplace_back(segment.getString());
+        }
+    } else if (json.second["context"].isString()) {
+        split_segments(json.second["context"].getString(),
+                       &params->segments);
+    } else {
+        return send_error(400, "JSON missing segments/context key");
+    }
+    if (params->segments.empty())
+        return send_error(400, "no segments to compress");
+    if (params->segments.size() > MAX_SEGMENTS)
+        return send_error(400, "too many segments");
+    if (!json.second["budget"].isLong() ||
+        json.second["budget"].getLong() <= 0)
+        return send_error(400, "budget must be positive integer");
+    params->budget = json.second["budget"].getLong();
+    if (json.second["add_special"].isBool())
+        params->add_special = json.second["add_special"].getBool();
+    if (json.second["parse_special"].isBool())
+        params->parse_special = json.second["parse_special"].getBool();
+    return true;
+}
+
+bool
+Client::compress()
+{
+    if (msg_.method != kHttpGet && msg_.method != kHttpPost)
+        return send_error(405);
+
+    if (!read_payload())
+        return false;
+
+    // get parameters
+    auto params = new CompressParams;
+    defer_cleanup(cleanup_compress_params, params);
+    if (!get_compress_params(params))
+        return false;
+
+    // setup statistics
+    rusage rustart = {};
+    getrusage(RUSAGE_THREAD, &rustart);
+    timespec started = timespec_real();
+
+    // the documented contract says content is utf-8
+    if (!is_valid_utf8(params->query))
+        return send_error(400, "query must be valid UTF-8");
+    for (const std::string& segment : params->segments)
+        if (!is_valid_utf8(segment))
+            return send_error(400, "segments must be valid UTF-8");
+
+    // turn text into tokens; query first, then one sequence per segment
+    const int n_ctx_train = llama_n_ctx_train(model_);
+    std::vector<std::string_view> prompts;
+    prompts.emplace_back(params->query);
+    for (const std::string& segment : params->segments)
+        prompts.emplace_back(segment);
+    auto toks_list =
+      new std::vector<std::vector<llama_token>>(prompts.size());
+    defer_cleanup(cleanup_token_vectors, toks_list);
+    long tokens_before = 0;
+    for (size_t j = 0; j < prompts.size(); ++j) {
+        std::vector<llama_token>& toks = (*toks_list)[j];
+        toks.resize(prompts[j].size() + 16);
+        int n = llama_tokenize(model_,
+                               prompts[j].data(),
+                               prompts[j].size(),
+                               &toks[0],
+                               toks.size(),
+                               params->add_special,
+                               params->parse_special);
+        if (n < 0) {
+            SLOG("llama_tokenize failed");
+            return send_error(405);
+        }
+        toks.resize(n);
+        if (toks.empty())
+            return send_error(400, "completely empty prompt disallowed");
+        if ((int)toks.size() > n_ctx_train)
+            toks.resize(n_ctx_train);
+        if (j)
+            tokens_before += toks.size();
+    }
+
+    // inference time, shared with whoever else is embedding
+    auto embeddings = new std::vector<std::vector<float>>(toks_list->size());
+    defer_cleanup(cleanup_embedding_vectors, embeddings);
+    if (!embed_inputs(model_, *toks_list, *embeddings))
+        return send_error(500);
+
+    // cosine similarity of each segment against the query
+    const std::vector<float>& query = (*embeddings)[0];
+    std::vector<double> scores(params->segments.size());
+    for (size_t j = 0; j < params->segments.size(); ++j) {
+        const std::vector<float>& segment = (*embeddings)[j + 1];
+        double score = 0;
+        for (size_t i = 0; i < query.size(); ++i)
+            score += query[i] * segment[i];
+        scores[j] = score;
+    }
+
+    // keep the best scoring segments that fit the budget. the best
+    // segment always survives, since an empty context helps nobody,
+    // and survivors keep their original order so cross references
+    // between passages still read in sequence
+    std::vector<size_t> order(params->segments.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return scores[a] > scores[b];
+    });
+    std::vector<bool> keep(params->segments.size());
+    long tokens_after = 0;
+    for (size_t j : order) {
+        long cost = (*toks_list)[j + 1].size();
+        if (tokens_after && tokens_after + cost > params->budget)
+            continue;
+        keep[j] = true;
+        tokens_after += cost;
+    }
+
+    // serialize response json
+    std::string compressed;
+    for (size_t j = 0; j < params->segments.size(); ++j) {
+        if (!keep[j])
+            continue;
+        if (!compressed.empty())
+            compressed += "\n\n";
+        compressed += params->segments[j];
+    }
+    Json json;
+    json["content"] = std::move(compressed);
+    Json& kept = json["kept"];
+    int n_kept = 0;
+    for (size_t j = 0; j < keep.size(); ++j)
+        if (keep[j])
+            kept[n_kept++] = (long)j;
+    Json& score_list = json["scores"];
+    for (size_t j = 0; j < scores.size(); ++j)
+        score_list[(int)j] = scores[j];
+    json["tokens_before"] = tokens_before;
+    json["tokens_after"] = tokens_after;
+    dump_ = json.toStringPretty();
+    dump_ += '\n';
+
+    // collect statistics
+    rusage ruend = {};
+    getrusage(RUSAGE_THREAD, &ruend);
+    timeval user = timeval_sub(ruend.ru_utime, rustart.ru_utime);
+    timeval system = timeval_sub(ruend.ru_stime, rustart.ru_stime);
+    timespec ended = timespec_real();
+    timespec wall = timespec_sub(ended, started);
+    long wall_us = timespec_tomicros(wall);
+    long user_us = timeval_tomicros(user);
+    long system_us = timeval_tomicros(system);
+
+    // send response
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    p = stpcpy(p, "X-Wall-Micros: ");
+    p = FormatInt64(p, wall_us);
+    p = stpcpy(p, "\r\nX-User-Micros: ");
+    p = FormatInt64(p, user_us);
+    p = stpcpy(p, "\r\nX-System-Micros: ");
+    p = FormatInt64(p, system_us);
+    p = stpcpy(p, "\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+} // namespace server
+} // namespace lf
@@ -21,10 +21,24 @@
 #include "llamafile/llamafile.h"
 #include "llamafile/string.h"
 #include <string>
+#include <string_view>
 
 namespace lf {
 namespace server {
 
+static int64_t
+atoi(std::string_view s)
+{
+    int64_t n = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9')
+            return -1;
+        n *= 10;
+        n += c - '0';
+    }
+    return n;
+}
+
 bool
 Client::db_chats()
 {
@@ -48,7 +62,7 @@ Client::db_chats()
         }
         if (!read_payload())
             return false;
-        auto [status, json] = jt::Json::parse(std::string(payload_));
+        auto [status, json] = jt::Json::parse(payload_);
         if (status != jt::Json::success)
             return send_error(400, jt::Json::StatusToString(status));
         if (!json.isObject())
@@ -99,7 +113,7 @@ Client::db_chat(int64_t id)
         }
         if (!read_payload())
             return false;
-        auto [status, json] = jt::Json::parse(std::string(payload_));
+        auto [status, json] = jt::Json::parse(payload_);
         if (status != jt::Json::success)
             return send_error(400, jt::Json::StatusToString(status));
         if (!json.isObject())
@@ -129,10 +143,23 @@ bool
 Client::db_messages(int64_t chat_id)
 {
     if (msg_.method == kHttpGet) {
+        // ?limit=N returns only the newest N messages, and ?before=ID
+        // moves that window to messages older than ID, so clients can
+        // page through long conversations without fetching everything
+        int64_t limit = -1;
+        int64_t before = -1;
+        if (std::optional<std::string_view> v = param("limit")) {
+            if ((limit = atoi(*v)) <= 0)
+                return send_error(400, "limit must be positive integer");
+        }
+        if (std::optional<std::string_view> v = param("before")) {
+            if ((before = atoi(*v)) <= 0)
+                return send_error(400, "before must be positive integer");
+        }
         sqlite3* db = db::open();
         if (!db)
             return send_error(500, "db::open failed");
-        jt::Json json = db::get_messages(db, chat_id);
+        jt::Json json = db::get_messages(db, chat_id, limit, before);
         db::close(db);
         dump_ = json.toStringPretty();
         dump_ += '\n';
@@ -148,7 +175,7 @@ Client::db_messages(int64_t chat_id)
         }
         if (!read_payload())
             return false;
-        auto [status, json] = jt::Json::parse(std::string(payload_));
+        auto [status, json] = jt::Json::parse(payload_);
         if (status != jt::Json::success)
             return send_error(400, jt::Json::StatusToString(status));
         if (!json.isObject())
@@ -165,22 +192,21 @@ Client::db_messages(int64_t chat_id)
             return send_error(400, "presence_penalty must be a number");
         if (!json["frequency_penalty"].isNumber())
             return send_error(400, "frequency_penalty must be a number");
+        // the insert rides the background writer so the reply never
+        // waits on sqlite. the reply is the chat the message belongs
+        // to; it used to look the chat up with the new message's
+        // rowid, which is a different id space, so nothing can have
+        // depended on that body
+        db::add_message_async(chat_id,
+                              json["role"].getString(),
+                              json["content"].getString(),
+                              json["temperature"].getNumber(),
+                              json["top_p"].getNumber(),
+                              json["presence_penalty"].getNumber(),
+                              json["frequency_penalty"].getNumber());
         sqlite3* db = db::open();
         if (!db)
             return send_error(500, "db::open failed");
-        int64_t chat_id =
-          db::add_message(db,
-                          chat_id,
-                          json["role"].getString(),
-                          json["content"].getString(),
-                          json["temperature"].getNumber(),
-                          json["top_p"].getNumber(),
-                          json["presence_penalty"].getNumber(),
-                          json["frequency_penalty"].getNumber());
-        if (chat_id == -1) {
-            db::close(db);
-            return send_error(500, "db::add_chat failed");
-        }
         jt::Json json2 = db::get_chat(db, chat_id);
         db::close(db);
         dump_ = json2.toStringPretty();
@@ -0,0 +1,83 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/server/deadline.h"
+
+#include <ctime>
+
+// per-request deadlines
+//
+// a client that gives up doesn't take its server costs with it: the
+// prefill keeps evaluating, the decode loop keeps sampling, and the
+// slot stays claimed until generation runs its course. arming an
+// absolute deadline at dispatch and checking it at every blocking
+// boundary — take() while queued, eval_tokens() between ubatches, the
+// handlers between tokens — bounds how long any one request can
+// occupy a slot, no matter what its client does.
+//
+// the deadline rides a thread local because every stage of a request
+// runs on the worker thread that dispatched it, the same convention
+// the metering binding relies on. a check costs one coarse clock
+// read, cheap enough for the per-token path.
+
+namespace lf {
+namespace server {
+
+namespace {
+
+thread_local long g_deadline;
+
+long
+now_nanos()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+} // namespace
+
+// arms this thread's request deadline `timeout_ms` milliseconds from
+// now, or disarms it when given zero. called once per dispatch, so a
+// kept-alive connection's next request can't inherit a stale one.
+void
+deadline_set(long timeout_ms)
+{
+    if (timeout_ms > 0) {
+        g_deadline = now_nanos() + timeout_ms * 1000000L;
+    } else {
+        g_deadline = 0;
+    }
+}
+
+// returns this thread's deadline in absolute monotonic nanoseconds,
+// or zero when none is armed. blocking waits use it to bound their
+// sleeps, so expiry gets noticed without anyone signaling.
+long
+deadline_get()
+{
+    return g_deadline;
+}
+
+bool
+deadline_expired()
+{
+    return g_deadline && now_nanos() >= g_deadline;
+}
+
+} // namespace server
+} // namespace lf
@@ -16,31 +16,65 @@
 // limitations under the License.
 
 #include "client.h"
+#include "embedding.h"
 #include "llama.cpp/llama.h"
 #include "llamafile/json.h"
+#include "llamafile/macros.h"
 #include "llamafile/server/cleanup.h"
 #include "llamafile/server/fastjson.h"
 #include "llamafile/server/log.h"
 #include "llamafile/server/utils.h"
 #include <cmath>
+#include <cosmo.h>
 #include <cstring>
+#include <pthread.h>
 #include <sys/resource.h>
+#include <unistd.h>
 #include <vector>
 
+#define JOB(e) DLL_CONTAINER(EmbeddingJob, elem_, e)
+
 using jt::Json;
 
 namespace lf {
 namespace server {
 
+// openai's encoding_format option, extended with int8 and binary,
+// which quantize the normalized floats server side so vector
+// databases storing compact codes don't need a post-processing hop
+enum EncodingFormat
+{
+    format_float,
+    format_int8,
+    format_binary,
+};
+
 struct EmbeddingParams
 {
     bool add_special;
     bool parse_special;
+    int encoding_format;
+    int dimensions;
     std::string_view prompt;
     std::string content;
     std::string model;
+    std::vector<std::string> inputs;
 };
 
+static bool
+parse_encoding_format(const std::string_view& s, int* out)
+{
+    if (s == "float")
+        *out = format_float;
+    else if (s == "int8")
+        *out = format_int8;
+    else if (s == "binary")
+        *out = format_binary;
+    else
+        return false;
+    return true;
+}
+
 void
 normalize_embeddings(const float* inp, float* out, int n)
 {
@@ -75,11 +109,224 @@ cleanup_embedding_params(void* arg)
     delete (EmbeddingParams*)arg;
 }
 
+static void
+cleanup_token_vectors(void* arg)
+{
+    delete (std::vector<std::vector<llama_token>>*)arg;
+}
+
+static void
+cleanup_embedding_vectors(void* arg)
+{
+    delete (std::vector<std::vector<float>>*)arg;
+}
+
+// embeddings from concurrent clients ride shared decode calls
+//
+// each client pays the cost of spinning up a context sized for one
+// request, so a mass indexing workload with many connections spends
+// most of its time on per-request overhead. pending inputs queue up
+// here instead, and the first client to arrive becomes the leader:
+// it waits a few milliseconds for stragglers, then decodes every
+// queued input in one packed batch, with one sequence per input.
+//
+// the packing is ragged: sequences concatenate back to back with no
+// padding, and the attention mask is block diagonal per sequence id,
+// so mixed length inputs cost their actual tokens rather than every
+// input paying for the longest one.
+struct EmbeddingJob
+{
+    Dll elem_;
+    const std::vector<llama_token>* toks_;
+    std::vector<float>* out_;
+    bool done_ = false;
+    bool ok_ = false;
+};
+
+static Dll* g_embed_jobs;
+static bool g_embed_busy;
+static pthread_mutex_t g_embed_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_embed_cond = PTHREAD_COND_INITIALIZER;
+
+static void
+embed_jobs(llama_model* model, const std::vector<EmbeddingJob*>& jobs)
+{
+    size_t count = 0;
+    for (EmbeddingJob* job : jobs)
+        count += job->toks_->size();
+
+    // initialize context
+    llama_context_params cparams = {};
+    cparams.embeddings = true;
+    cparams.embeddings_only = true;
+    cparams.logits_all = true;
+    cparams.seed = _rand64();
+    cparams.n_ctx = count;
+    cparams.n_batch = count;
+    cparams.n_ubatch = count;
+    cparams.n_seq_max = jobs.size();
+    cparams.n_threads = 8;
+    cparams.n_threads_batch = 8;
+    cparams.attention_type = LLAMA_ATTENTION_TYPE_UNSPECIFIED;
+    cparams.rope_scaling_type = LLAMA_ROPE_SCALING_TYPE_NONE;
+    cparams.pooling_type = LLAMA_POOLING_TYPE_UNSPECIFIED;
+    cparams.type_k = GGML_TYPE_F16;
+    cparams.type_v = GGML_TYPE_F16;
+    cparams.flash_attn = FLAG_flash_attn;
+    llama_context* ctx = llama_new_context_with_model(model, cparams);
+    if (!ctx) {
+        SLOG("llama_new_context_with_model failed");
+        return;
+    }
+
+    // initialize batch with one sequence per input
+    llama_batch batch = llama_batch_init(count, 0, 1);
+    llama_seq_id seq = 0;
+    for (EmbeddingJob* job : jobs) {
+        size_t len = job->toks_->size();
+        for (size_t i = 0; i < len; ++i)
+            add_token_to_batch(
+              batch, (*job->toks_)[i], i, { seq }, i == len - 1);
+        ++seq;
+    }
+
+    // inference time
+    const int n_embd = llama_n_embd(model);
+    if (llama_decode(ctx, batch) < 0) {
+        SLOG("llama_decode failed");
+    } else {
+        for (int i = 0; i < batch.n_tokens; i++) {
+            if (!batch.logits[i])
+                continue;
+            // models with a pooling head (mean, cls) report a single
+            // pooled vector per sequence; causal models have no head,
+            // so the last token's hidden state stands in for it
+            const float* embd = llama_get_embeddings_seq(ctx, batch.seq_id[i][0]);
+            if (!embd)
+                embd = llama_get_embeddings_ith(ctx, i);
+            if (!embd) {
+                SLOG("llama_get_embeddings_ith failed");
+                continue;
+            }
+            EmbeddingJob* job = jobs[batch.seq_id[i][0]];
+            job->out_->resize(n_embd);
+            normalize_embeddings(embd, job->out_->data(), n_embd);
+            job->ok_ = true;
+        }
+    }
+    llama_batch_free(batch);
+    llama_free(ctx);
+}
+
+bool
+embed_inputs(llama_model* model,
+             const std::vector<std::vector<llama_token>>& toks_list,
+             std::vector<std::vector<float>>& out)
+{
+    std::vector<EmbeddingJob> jobs(toks_list.size());
+    pthread_mutex_lock(&g_embed_lock);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        jobs[i].toks_ = &toks_list[i];
+        jobs[i].out_ = &out[i];
+        dll_init(&jobs[i].elem_);
+        dll_make_last(&g_embed_jobs, &jobs[i].elem_);
+    }
+    while (!jobs.back().done_) {
+        if (g_embed_busy) {
+            pthread_cond_wait(&g_embed_cond, &g_embed_lock);
+            continue;
+        }
+
+        // this thread is now the leader. let concurrent clients
+        // pile onto the queue, then decode everything together
+        g_embed_busy = true;
+        pthread_mutex_unlock(&g_embed_lock);
+        if (FLAG_embedding_window)
+            usleep(FLAG_embedding_window * 1000L);
+        pthread_mutex_lock(&g_embed_lock);
+        std::vector<EmbeddingJob*> pending;
+        Dll* e;
+        while ((e = dll_first(g_embed_jobs))) {
+            dll_remove(&g_embed_jobs, e);
+            pending.emplace_back(JOB(e));
+        }
+        pthread_mutex_unlock(&g_embed_lock);
+        embed_jobs(model, pending);
+        pthread_mutex_lock(&g_embed_lock);
+        for (EmbeddingJob* job : pending)
+            job->done_ = true;
+        g_embed_busy = false;
+        pthread_cond_broadcast(&g_embed_cond);
+    }
+    pthread_mutex_unlock(&g_embed_lock);
+    for (const EmbeddingJob& job : jobs)
+        if (!job.ok_)
+            return false;
+    return true;
+}
+
+// serializes one embedding as a json array. float mode emits the
+// normalized values. int8 scales them onto [-127,127], which loses
+// little recall since normalization bounds every value by one.
+// binary packs the sign bit of every eight dimensions into a byte,
+// first dimension in the most significant bit
+static char*
+encode_embedding(char* p, const std::vector<float>& v, int format)
+{
+    if (format == format_int8) {
+        for (size_t i = 0; i < v.size(); ++i) {
+            if (i) {
+                *p++ = ',';
+                *p++ = ' ';
+            }
+            long q = lrintf(v[i] * 127);
+            p = FormatInt64(p, MAX(-127, MIN(127, q)));
+        }
+    } else if (format == format_binary) {
+        for (size_t i = 0; i < v.size(); i += 8) {
+            if (i) {
+                *p++ = ',';
+                *p++ = ' ';
+            }
+            int b = 0;
+            for (size_t j = i; j < i + 8; ++j)
+                b = b << 1 | (j < v.size() && v[j] > 0);
+            p = FormatInt64(p, b);
+        }
+    } else {
+        for (size_t i = 0; i < v.size(); ++i) {
+            if (i) {
+                *p++ = ',';
+                *p++ = ' ';
+            }
+            p = encode_json(p, v[i]);
+        }
+    }
+    return p;
+}
+
 bool
 Client::get_embedding_params(EmbeddingParams* params)
 {
     params->add_special = atob(or_empty(param("add_special")), true);
     params->parse_special = atob(or_empty(param("parse_special")), false);
+    params->encoding_format = format_float;
+    params->dimensions = 0;
+
+    std::optional<std::string_view> format = param("encoding_format");
+    if (format.has_value() &&
+        !parse_encoding_format(format.value(), &params->encoding_format))
+        return send_error(400, "encoding_format must be float/int8/binary");
+    std::optional<std::string_view> dims = param("dimensions");
+    if (dims.has_value()) {
+        for (char c : dims.value()) {
+            if (c < '0' || c > '9')
+                return send_error(400, "dimensions must be positive integer");
+            params->dimensions = params->dimensions * 10 + (c - '0');
+        }
+        if (params->dimensions <= 0)
+            return send_error(400, "dimensions must be positive integer");
+    }
 
     // try obtaining prompt (or its aliases) from request-uri
     std::optional<std::string_view> prompt = param("content");
@@ -110,27 +357,85 @@ Client::get_embedding_params(EmbeddingParams* params)
         } else if (IsMimeType(HeaderData(kHttpContentType),
                               HeaderLength(kHttpContentType),
                               "application/json")) {
-            std::pair<Json::Status, Json> json =
-              Json::parse(std::string(payload_));
-            if (json.first != Json::success)
-                return send_error(400, Json::StatusToString(json.first));
-            if (!json.second.isObject())
+            // the object is pulled apart one key at a time, so a giant
+            // batch input array only ever costs one element's parse
+            // tree rather than a materialized copy of the whole body
+            jt::JsonStream stream(payload_);
+            Json::Status status = stream.begin_object();
+            if (status != Json::success)
                 return send_error(400, "JSON body must be an object");
-            if (json.second["content"].isString())
-                params->content = json.second["content"].getString();
-            else if (json.second["prompt"].isString())
-                params->content = json.second["prompt"].getString();
-            else if (json.second["input"].isString())
-                params->content = json.second["input"].getString();
-            else
+            bool have_input = false;
+            bool done;
+            std::string key;
+            Json value;
+            for (;;) {
+                if ((status = stream.next_key(&key, &done)) != Json::success)
+                    return send_error(400, Json::StatusToString(status));
+                if (done)
+                    break;
+                bool is_input =
+                  key == "content" || key == "prompt" || key == "input";
+                if (is_input && !have_input && stream.peek() == '[') {
+                    // array inputs all ride in one packed batch
+                    if ((status = stream.begin_array()) != Json::success)
+                        return send_error(400, Json::StatusToString(status));
+                    for (;;) {
+                        if ((status = stream.next_element(&value, &done)) !=
+                            Json::success)
+                            return send_error(400,
+                                              Json::StatusToString(status));
+                        if (done)
+                            break;
+                        if (!value.isString())
+                            return send_error(400,
+                                              "input array must hold strings");
+                        params->inputs.emplace_back(
+                          std::move(value.getString()));
+                    }
+                    if (params->inputs.empty())
+                        return send_error(400, "input array must not be empty");
+                    have_input = true;
+                    continue;
+                }
+                if ((status = stream.next_value(&value)) != Json::success)
+                    return send_error(400, Json::StatusToString(status));
+                if (is_input) {
+                    if (have_input || value.isNull())
+                        continue;
+                    if (!value.isString())
+                        return send_error(
+                          400, "content/prompt/input must be string or array");
+                    params->content = std::move(value.getString());
+                    params->prompt = params->content;
+                    have_input = true;
+                } else if (key == "add_special") {
+                    if (value.isBool())
+                        params->add_special = value.getBool();
+                } else if (key == "parse_special") {
+                    if (value.isBool())
+                        params->parse_special = value.getBool();
+                } else if (key == "model") {
+                    if (value.isString())
+                        params->model = std::move(value.getString());
+                } else if (key == "encoding_format") {
+                    if (value.isString() &&
+                        !parse_encoding_format(value.getString(),
+                                               &params->encoding_format))
+                        return send_error(
+                          400, "encoding_format must be float/int8/binary");
+                } else if (key == "dimensions") {
+                    if (value.isNull())
+                        continue;
+                    if (!value.isLong() || value.getLong() <= 0)
+                        return send_error(
+                          400, "dimensions must be positive integer");
+                    params->dimensions = value.getLong();
+                }
+            }
+            if ((status = stream.end()) != Json::success)
+                return send_error(400, Json::StatusToString(status));
+            if (!have_input)
                 return send_error(400, "JSON missing content/prompt/input key");
-            params->prompt = params->content;
-            if (json.second["add_special"].isBool())
-                params->add_special = json.second["add_special"].getBool();
-            if (json.second["parse_special"].isBool())
-                params->parse_special = json.second["parse_special"].getBool();
-            if (json.second["model"].isString())
-                params->model = json.second["model"].getString();
         } else {
             return send_error(501, "Content Type Not Implemented");
         }
@@ -160,80 +465,66 @@ Client::embedding()
     getrusage(RUSAGE_THREAD, &rustart);
     timespec started = timespec_real();
 
-    // turn text into tokens
-    auto toks = new std::vector<llama_token>(params->prompt.size() + 16);
-    defer_cleanup(cleanup_token_vector, toks);
-    int count = llama_tokenize(model_,
-                               params->prompt.data(),
-                               params->prompt.size(),
-                               &(*toks)[0],
-                               toks->size(),
-                               params->add_special,
-                               params->parse_special);
-    if (count < 0) {
-        SLOG("llama_tokenize failed");
-        return send_error(405);
+    // turn text into tokens; each input gets its own sequence
+    std::vector<std::string_view> prompts;
+    if (!params->inputs.empty()) {
+        for (const std::string& input : params->inputs)
+            prompts.emplace_back(input);
+    } else {
+        prompts.emplace_back(params->prompt);
     }
-    toks->resize(count);
-
-    if (toks->empty())
-        return send_error(400, "completely empty prompt disallowed");
 
-    // truncate if exceeds model context size
+    // the documented contract says content is utf-8
+    for (const std::string_view& prompt : prompts)
+        if (!is_valid_utf8(prompt))
+            return send_error(400, "content must be valid UTF-8");
+    auto toks_list = new std::vector<std::vector<llama_token>>;
+    defer_cleanup(cleanup_token_vectors, toks_list);
     const int n_ctx_train = llama_n_ctx_train(model_);
-    if (count > n_ctx_train)
-        count = n_ctx_train;
+    size_t provided = 0;
+    size_t count = 0;
+    for (std::string_view prompt : prompts) {
+        std::vector<llama_token> toks(prompt.size() + 16);
+        int n = llama_tokenize(model_,
+                               prompt.data(),
+                               prompt.size(),
+                               &toks[0],
+                               toks.size(),
+                               params->add_special,
+                               params->parse_special);
+        if (n < 0) {
+            SLOG("llama_tokenize failed");
+            return send_error(405);
+        }
+        toks.resize(n);
 
-    // initialize context
-    llama_context_params cparams = {};
-    cparams.embeddings = true;
-    cparams.embeddings_only = true;
-    cparams.logits_all = true;
-    cparams.seed = _rand64();
-    cparams.n_ctx = count;
-    cparams.n_batch = count;
-    cparams.n_ubatch = count;
-    cparams.n_seq_max = 1;
-    cparams.n_threads = 8;
-    cparams.n_threads_batch = 8;
-    cparams.attention_type = LLAMA_ATTENTION_TYPE_UNSPECIFIED;
-    cparams.rope_scaling_type = LLAMA_ROPE_SCALING_TYPE_NONE;
-    cparams.pooling_type = LLAMA_POOLING_TYPE_NONE;
-    cparams.type_k = GGML_TYPE_F16;
-    cparams.type_v = GGML_TYPE_F16;
-    cparams.flash_attn = FLAG_flash_attn;
-    llama_context* ctx = llama_new_context_with_model(model_, cparams);
-    if (!ctx) {
-        SLOG("llama_new_context_with_model failed");
-        return send_error(500);
-    }
-    defer_cleanup(cleanup_llama_context, ctx);
+        if (toks.empty())
+            return send_error(400, "completely empty prompt disallowed");
+        provided += n;
 
-    // initialize batch
-    const int n_embd = llama_n_embd(model_);
-    llama_batch* batch = new llama_batch;
-    *batch = llama_batch_init(count, 0, 1);
-    defer_cleanup(cleanup_llama_batch, batch);
-    for (size_t i = 0; i < count; ++i)
-        add_token_to_batch(*batch, (*toks)[i], i, { 0 }, i == count - 1);
+        // truncate if exceeds model context size
+        if (n > n_ctx_train)
+            toks.resize(n_ctx_train);
+        count += toks.size();
+        toks_list->emplace_back(std::move(toks));
+    }
 
-    // inference time
-    if (llama_decode(ctx, *batch) < 0) {
-        SLOG("llama_decode failed");
+    // inference time, shared with whoever else is embedding
+    auto embeddings = new std::vector<std::vector<float>>(toks_list->size());
+    defer_cleanup(cleanup_embedding_vectors, embeddings);
+    if (!embed_inputs(model_, *toks_list, *embeddings))
         return send_error(500);
-    }
-    auto embeddings = new std::vector<float>(n_embd, 0);
-    defer_cleanup(cleanup_float_vector, embeddings);
-    for (int i = 0; i < batch->n_tokens; i++) {
-        if (!batch->logits[i])
-            continue;
-        const float* embd = llama_get_embeddings_ith(ctx, i);
-        if (!embd) {
-            SLOG("llama_get_embeddings_ith failed");
-            return send_error(500);
+
+    // matryoshka models front-load information, so truncating to the
+    // leading dimensions and renormalizing yields a smaller embedding
+    // that still ranks usefully
+    if (params->dimensions > 0) {
+        for (std::vector<float>& v : *embeddings) {
+            if ((size_t)params->dimensions < v.size()) {
+                v.resize(params->dimensions);
+                normalize_embeddings(v.data(), v.data(), v.size());
+            }
         }
-        normalize_embeddings(
-          embd, embeddings->data() + batch->seq_id[i][0] * n_embd, n_embd);
     }
 
     // determine how output json should look
@@ -278,11 +569,22 @@ Client::embedding()
         p = encode_json(p, count);
         p = stpcpy(p, ",\n");
         p = stpcpy(p, "    \"total_tokens\": ");
-        p = encode_json(p, toks->size());
+        p = encode_json(p, provided);
         p = stpcpy(p, "\n  },\n");
-        p = stpcpy(p, "  \"data\": [{\n");
-        p = stpcpy(p, "  \"object\": \"embedding\",\n");
-        p = stpcpy(p, "  \"index\": 0,\n");
+        p = stpcpy(p, "  \"data\": [");
+        for (size_t j = 0; j < embeddings->size(); ++j) {
+            if (j)
+                p = stpcpy(p, ", ");
+            p = stpcpy(p, "{\n");
+            p = stpcpy(p, "  \"object\": \"embedding\",\n");
+            p = stpcpy(p, "  \"index\": ");
+            p = encode_json(p, j);
+            p = stpcpy(p, ",\n");
+            p = stpcpy(p, "  \"embedding\": [");
+            p = encode_embedding(p, (*embeddings)[j], params->encoding_format);
+            p = stpcpy(p, "]\n  }");
+        }
+        p = stpcpy(p, "]\n");
     } else {
         p = stpcpy(p, "  \"add_special\": ");
         p = encode_bool(p, params->add_special);
@@ -291,24 +593,28 @@ Client::embedding()
         p = encode_bool(p, params->parse_special);
         p = stpcpy(p, ",\n");
         p = stpcpy(p, "  \"tokens_provided\": ");
-        p = encode_json(p, toks->size());
+        p = encode_json(p, provided);
         p = stpcpy(p, ",\n");
         p = stpcpy(p, "  \"tokens_used\": ");
         p = encode_json(p, count);
         p = stpcpy(p, ",\n");
-    }
-
-    p = stpcpy(p, "  \"embedding\": [");
-    for (size_t i = 0; i < embeddings->size(); ++i) {
-        if (i) {
-            *p++ = ',';
-            *p++ = ' ';
+        if (embeddings->size() == 1) {
+            p = stpcpy(p, "  \"embedding\": [");
+            p = encode_embedding(p, (*embeddings)[0], params->encoding_format);
+            p = stpcpy(p, "]\n");
+        } else {
+            p = stpcpy(p, "  \"embeddings\": [");
+            for (size_t j = 0; j < embeddings->size(); ++j) {
+                if (j)
+                    p = stpcpy(p, ", ");
+                p = stpcpy(p, "[");
+                p = encode_embedding(
+                  p, (*embeddings)[j], params->encoding_format);
+                p = stpcpy(p, "]");
+            }
+            p = stpcpy(p, "]\n");
         }
-        p = encode_json(p, (*embeddings)[i]);
     }
-    p = stpcpy(p, "]\n");
-    if (in_openai_mode)
-        p = stpcpy(p, "  }]\n");
     p = stpcpy(p, "}\n");
     std::string_view content(obuf_.p, p - obuf_.p);
 
@@ -0,0 +1,380 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/server/eventlog.h"
+#include "llama.cpp/cores.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/metrics.h"
+#include <atomic>
+#include <cosmo.h>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <third_party/zlib/zlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// binary request event log
+//
+// --verbose turns every request into multiple formatted text lines,
+// which is gigabytes a day at production rates, only to be parsed
+// back into structured form by the analytics pipeline. --eventlog
+// writes what the pipeline actually wants: one fixed size binary
+// record per request holding arrival time, client address, per phase
+// durations, token counts, and status. records ride the phase
+// instrumentation that's already on the hot path, so a request pays
+// a few thread local stores and one ring reservation, never a format
+// or a syscall.
+//
+// like the log ring, a background thread drains records to disk in
+// batches. when the active segment reaches the rotation size it's
+// renamed with a unix timestamp suffix and gzipped, so the directory
+// holds one mmap scannable active file plus compressed history. a
+// full ring drops the record and counts the drop rather than making
+// a worker wait; analytics tolerates a gap better than users
+// tolerate latency. producers have no cancellation points between
+// reserving a slot and committing it, so cancelled workers can't
+// wedge the drain.
+
+#define EVENTLOG_RING_RECORDS 4096
+#define EVENTLOG_RING_MASK (EVENTLOG_RING_RECORDS - 1)
+#define EVENTLOG_ROTATE_SIZE (64 * 1024 * 1024)
+
+namespace lf {
+namespace server {
+namespace {
+
+// per request accumulator. everything that observes a phase of this
+// request runs on its worker thread, the same reasoning that lets
+// metering bind tenants thread locally
+struct PendingEvent
+{
+    bool active;
+    EventLogRecord rec;
+};
+
+thread_local PendingEvent g_event;
+
+alignas(64) EventLogRecord g_ring[EVENTLOG_RING_RECORDS];
+std::atomic_ulong g_ring_head;
+std::atomic_ulong g_ring_tail;
+std::atomic_bool g_ring_active;
+std::atomic_long g_dropped;
+pthread_t g_drain_thread;
+const char* g_path;
+FILE* g_file;
+long g_size;
+
+// adds microseconds into a saturating uint32 field, so a pathological
+// phase can't wrap the column into nonsense
+void
+add_micros(uint32_t* field, long nanos)
+{
+    unsigned long sum = *field + (unsigned long)(nanos / 1000);
+    *field = sum > 0xffffffff ? 0xffffffff : sum;
+}
+
+// opens a fresh segment at the configured path and stamps its header
+bool
+open_segment()
+{
+    if (!(g_file = fopen(g_path, "wb")))
+        return false;
+    EventLogHeader header = {};
+    header.magic = EVENTLOG_MAGIC;
+    header.version = EVENTLOG_VERSION;
+    header.record_size = sizeof(EventLogRecord);
+    fwrite(&header, sizeof(header), 1, g_file);
+    fflush(g_file);
+    g_size = sizeof(header);
+    return true;
+}
+
+// gzips `path` into `path`.gz and unlinks the original. runs on the
+// drainer thread (or at boot for a leftover segment), never where a
+// request is waiting
+void
+compress_segment(const char* path)
+{
+    FILE* in = fopen(path, "rb");
+    if (!in)
+        return;
+    char gzpath[PATH_MAX];
+    snprintf(gzpath, sizeof(gzpath), "%s.gz", path);
+    gzFile out = gzopen(gzpath, "wb1");
+    if (!out) {
+        fclose(in);
+        return;
+    }
+    bool ok = true;
+    static char buf[65536];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), in)))
+        if (gzwrite(out, buf, got) != (int)got) {
+            ok = false;
+            break;
+        }
+    if (ferror(in))
+        ok = false;
+    fclose(in);
+    if (gzclose(out) != Z_OK)
+        ok = false;
+    if (ok) {
+        unlink(path);
+    } else {
+        SLOG("failed to compress %s", path);
+        unlink(gzpath);
+    }
+}
+
+// closes the active segment, renames it with a timestamp suffix, and
+// starts a new one before compressing the old, so producers drain
+// into the fresh file while the gzip pass runs
+void
+rotate_segment()
+{
+    fclose(g_file);
+    g_file = nullptr;
+    char old[PATH_MAX];
+    snprintf(old, sizeof(old), "%s.%ld", g_path, (long)time(0));
+    if (rename(g_path, old)) {
+        SLOG("failed to rotate %s", g_path);
+        old[0] = 0;
+    }
+    if (!open_segment()) {
+        SLOG("failed to reopen %s; event logging stopped", g_path);
+        g_ring_active.store(false, std::memory_order_release);
+        return;
+    }
+    if (old[0])
+        compress_segment(old);
+}
+
+// consumes committed records from the ring into batched writes
+size_t
+eventlog_drain()
+{
+    static EventLogRecord batch[512];
+    size_t got = 0;
+    size_t drained = 0;
+    unsigned long tail = g_ring_tail.load(std::memory_order_relaxed);
+    for (;;) {
+        EventLogRecord* slot = &g_ring[tail & EVENTLOG_RING_MASK];
+        if (!__atomic_load_n(&slot->nanos, __ATOMIC_ACQUIRE))
+            break;
+        batch[got++] = *slot;
+        // zero the commit flag so the slot reads as uncommitted when
+        // producers lap around and reuse it
+        __atomic_store_n(&slot->nanos, 0, __ATOMIC_RELEASE);
+        ++tail;
+        g_ring_tail.store(tail, std::memory_order_release);
+        ++drained;
+        if (got == sizeof(batch) / sizeof(*batch)) {
+            if (g_file)
+                fwrite(batch, sizeof(*batch), got, g_file);
+            g_size += got * sizeof(*batch);
+            got = 0;
+        }
+    }
+    if (got && g_file) {
+        fwrite(batch, sizeof(*batch), got, g_file);
+        g_size += got * sizeof(*batch);
+    }
+    if (g_file) {
+        fflush(g_file);
+        if (g_size >= EVENTLOG_ROTATE_SIZE)
+            rotate_segment();
+    }
+    return drained;
+}
+
+void*
+eventlog_worker(void* arg)
+{
+    sigset_t ss;
+    sigemptyset(&ss);
+    sigaddset(&ss, SIGHUP);
+    sigaddset(&ss, SIGINT);
+    sigaddset(&ss, SIGQUIT);
+    sigaddset(&ss, SIGTERM);
+    sigaddset(&ss, SIGUSR1);
+    sigaddset(&ss, SIGALRM);
+    pthread_sigmask(SIG_SETMASK, &ss, 0);
+    set_thread_name("eventlog");
+    // draining and gzipping never need a performance core
+    if (!FLAG_ecores) {
+        cpu_set_t mask;
+        if (cpu_get_efficiency_affinity(&mask) > 0)
+            pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    }
+    for (;;) {
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+        size_t n = eventlog_drain();
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+        pthread_testcancel();
+        if (!n)
+            usleep(10000);
+    }
+    return nullptr;
+}
+
+} // namespace
+
+bool
+eventlog_init(const char* path)
+{
+    g_path = path;
+
+    // a segment left behind by a previous boot gets rotated out, so
+    // its records survive and the header stays at offset zero
+    struct stat st;
+    if (!stat(path, &st) && st.st_size > (long)sizeof(EventLogHeader)) {
+        char old[PATH_MAX];
+        snprintf(old, sizeof(old), "%s.%ld", path, (long)time(0));
+        if (!rename(path, old))
+            compress_segment(old);
+    }
+
+    if (!open_segment())
+        return false;
+    if (pthread_create(&g_drain_thread, 0, eventlog_worker, 0))
+        __builtin_trap();
+    g_ring_active.store(true, std::memory_order_release);
+    SLOG("logging request events to %s", path);
+    return true;
+}
+
+// starts accumulating a record for the request this thread is about
+// to dispatch, stamping arrival time and the effective client address
+void
+eventlog_begin(unsigned ip)
+{
+    if (!g_ring_active.load(std::memory_order_acquire)) {
+        g_event.active = false;
+        return;
+    }
+    g_event.active = true;
+    memset(&g_event.rec, 0, sizeof(g_event.rec));
+    g_event.rec.nanos = timespec_tonanos(timespec_real());
+    g_event.rec.ip = ip;
+}
+
+// called by metrics_observe() on the request's worker thread. each
+// decode observation is one predicted token, so the completion count
+// falls out of the duration column for free
+void
+eventlog_account(int phase, long nanos)
+{
+    if (!g_event.active)
+        return;
+    switch (phase) {
+        case METRIC_QUEUE:
+            add_micros(&g_event.rec.queue_micros, nanos);
+            break;
+        case METRIC_PREFILL:
+            add_micros(&g_event.rec.prefill_micros, nanos);
+            break;
+        case METRIC_DECODE:
+            add_micros(&g_event.rec.decode_micros, nanos);
+            if (g_event.rec.completion_tokens < 0xffffffff)
+                ++g_event.rec.completion_tokens;
+            break;
+        case METRIC_WRITE:
+            add_micros(&g_event.rec.write_micros, nanos);
+            break;
+        default:
+            break;
+    }
+}
+
+// records how many prompt tokens the request's prefill covered,
+// including tokens satisfied from cached history
+void
+eventlog_tokens(long prompt_tokens)
+{
+    if (!g_event.active)
+        return;
+    if (prompt_tokens < 0)
+        return;
+    unsigned long sum = g_event.rec.prompt_tokens + (unsigned long)prompt_tokens;
+    g_event.rec.prompt_tokens = sum > 0xffffffff ? 0xffffffff : sum;
+}
+
+// records the status code of a response message. streaming responses
+// stamp their one header; error paths overwrite with the final word
+void
+eventlog_status(int code)
+{
+    if (!g_event.active)
+        return;
+    g_event.rec.status = code;
+}
+
+// posts the accumulated record to the ring once the dispatcher is
+// done with the request. a full ring drops the record over blocking
+void
+eventlog_commit()
+{
+    if (!g_event.active)
+        return;
+    g_event.active = false;
+    if (!g_ring_active.load(std::memory_order_acquire))
+        return;
+    unsigned long head = g_ring_head.load(std::memory_order_relaxed);
+    for (;;) {
+        unsigned long tail = g_ring_tail.load(std::memory_order_acquire);
+        if (head - tail >= EVENTLOG_RING_RECORDS) {
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (g_ring_head.compare_exchange_weak(head, head + 1,
+                                              std::memory_order_acq_rel))
+            break;
+    }
+    EventLogRecord* slot = &g_ring[head & EVENTLOG_RING_MASK];
+    uint64_t nanos = g_event.rec.nanos;
+    g_event.rec.nanos = 0;
+    *slot = g_event.rec;
+    // publish the record by storing its never-zero timestamp last
+    __atomic_store_n(&slot->nanos, nanos, __ATOMIC_RELEASE);
+}
+
+void
+eventlog_destroy()
+{
+    if (!g_path)
+        return;
+    g_ring_active.store(false, std::memory_order_release);
+    pthread_cancel(g_drain_thread);
+    if (pthread_join(g_drain_thread, 0))
+        __builtin_trap();
+    eventlog_drain();
+    long dropped = g_dropped.load(std::memory_order_relaxed);
+    if (dropped)
+        SLOG("event log dropped %ld records", dropped);
+    if (g_file) {
+        fclose(g_file);
+        g_file = nullptr;
+    }
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,76 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstdint>
+
+namespace lf {
+namespace server {
+
+// on disk format of an --eventlog analytics log. a fixed header, then
+// a dense array of fixed size records, one per request, so ingestion
+// is an mmap and a pointer walk. every field is little endian and the
+// magic reads "LLEVENTS" in a hexdump. rotated segments get a unix
+// timestamp suffix and a gzip pass, which typically shrinks them
+// several fold since most fields are small integers
+#define EVENTLOG_MAGIC 0x53544e4556454c4c
+#define EVENTLOG_VERSION 1
+
+struct EventLogHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size; // sizeof(EventLogRecord) when written
+};
+
+struct EventLogRecord
+{
+    uint64_t nanos; // request arrival, unix epoch; never zero
+    uint32_t ip; // effective client ipv4 address
+    uint32_t queue_micros; // waiting for a slot
+    uint32_t prefill_micros; // evaluating the prompt
+    uint32_t decode_micros; // predicting tokens
+    uint32_t write_micros; // writing response bytes
+    uint32_t prompt_tokens;
+    uint32_t completion_tokens;
+    uint16_t status; // http response status code
+    uint16_t pad;
+};
+
+bool
+eventlog_init(const char*);
+
+void
+eventlog_begin(unsigned);
+
+void
+eventlog_account(int, long);
+
+void
+eventlog_tokens(long);
+
+void
+eventlog_status(int);
+
+void
+eventlog_commit();
+
+void
+eventlog_destroy();
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,146 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "eventlog.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <third_party/zlib/zlib.h>
+#include <unistd.h>
+
+// converts --eventlog binary segments back into text
+//
+//     make -j o//llamafile/server/eventlogcat
+//     o//llamafile/server/main -m model.gguf --eventlog events.bin
+//     ... serve some traffic ...
+//     o//llamafile/server/eventlogcat events.bin
+//     o//llamafile/server/eventlogcat -c events.bin.*.gz
+//
+// emits one json object per line by default, or csv with -c, so the
+// binary format stays an implementation detail of the server and the
+// analytics pipeline. rotated segments are gzipped; zlib's gz layer
+// reads both compressed and plain files transparently.
+
+namespace lf {
+namespace server {
+namespace {
+
+const char* g_prog = "eventlogcat";
+bool g_csv;
+
+void
+print_usage(FILE* f)
+{
+    fprintf(f, "usage: %s [-c] FILE...\n", g_prog);
+}
+
+int
+cat(const char* path)
+{
+    gzFile f = gzopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    EventLogHeader header;
+    if (gzread(f, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != EVENTLOG_MAGIC ||
+        header.version != EVENTLOG_VERSION ||
+        header.record_size != sizeof(EventLogRecord)) {
+        fprintf(stderr, "%s: not an event log\n", path);
+        gzclose(f);
+        return 1;
+    }
+    EventLogRecord rec;
+    while (gzread(f, &rec, sizeof(rec)) == sizeof(rec)) {
+        char ip[16];
+        snprintf(ip,
+                 sizeof(ip),
+                 "%hhu.%hhu.%hhu.%hhu",
+                 (unsigned char)(rec.ip >> 24),
+                 (unsigned char)(rec.ip >> 16),
+                 (unsigned char)(rec.ip >> 8),
+                 (unsigned char)rec.ip);
+        if (g_csv) {
+            printf("%lu,%s,%d,%u,%u,%u,%u,%u,%u\n",
+                   (unsigned long)rec.nanos,
+                   ip,
+                   rec.status,
+                   rec.queue_micros,
+                   rec.prefill_micros,
+                   rec.decode_micros,
+                   rec.write_micros,
+                   rec.prompt_tokens,
+                   rec.completion_tokens);
+        } else {
+            printf("{\"nanos\":%lu,\"ip\":\"%s\",\"status\":%d,"
+                   "\"queue_micros\":%u,\"prefill_micros\":%u,"
+                   "\"decode_micros\":%u,\"write_micros\":%u,"
+                   "\"prompt_tokens\":%u,\"completion_tokens\":%u}\n",
+                   (unsigned long)rec.nanos,
+                   ip,
+                   rec.status,
+                   rec.queue_micros,
+                   rec.prefill_micros,
+                   rec.decode_micros,
+                   rec.write_micros,
+                   rec.prompt_tokens,
+                   rec.completion_tokens);
+        }
+    }
+    gzclose(f);
+    return 0;
+}
+
+int
+eventlogcat_main(int argc, char* argv[])
+{
+    g_prog = argv[0];
+    int opt;
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        switch (opt) {
+            case 'c':
+                g_csv = true;
+                break;
+            default:
+                print_usage(stderr);
+                return 1;
+        }
+    }
+    if (optind == argc) {
+        print_usage(stderr);
+        return 1;
+    }
+    if (g_csv)
+        printf("nanos,ip,status,queue_micros,prefill_micros,"
+               "decode_micros,write_micros,prompt_tokens,"
+               "completion_tokens\n");
+    int rc = 0;
+    for (int i = optind; i < argc; ++i)
+        rc |= cat(argv[i]);
+    return rc;
+}
+
+} // namespace
+} // namespace server
+} // namespace lf
+
+int
+main(int argc, char* argv[])
+{
+    return lf::server::eventlogcat_main(argc, argv);
+}
@@ -22,6 +22,12 @@
 #include <net/http/escape.h>
 #include <string>
 
+#ifdef __SSE2__
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace lf {
 namespace server {
 
@@ -112,6 +118,70 @@ encode_js_string_literal(char* p, const std::string_view s) noexcept
     size_t i, j, m;
     wint_t x, a, b;
     for (size_t i = 0; i < s.size();) {
+
+        // copy runs of plain ascii sixteen bytes at a time. any byte
+        // outside 0x20..0x7e or in the escape set hands control back
+        // to the scalar loop below, after the clean prefix is kept.
+        // the full vector is stored speculatively, which can't write
+        // past the caller's buffer since every remaining input byte
+        // encodes to at least one output byte.
+#ifdef __SSE2__
+        while (i + 16 <= s.size()) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(s.data() + i));
+            __m128i bad =
+              _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x20)),
+                           _mm_cmpgt_epi8(v, _mm_set1_epi8(0x7e)));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('=')));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+            _mm_storeu_si128((__m128i*)p, v);
+            int mask = _mm_movemask_epi8(bad);
+            if (mask) {
+                int n = __builtin_ctz(mask);
+                p += n;
+                i += n;
+                break;
+            }
+            p += 16;
+            i += 16;
+        }
+        if (i >= s.size())
+            break;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        while (i + 16 <= s.size()) {
+            uint8x16_t v = vld1q_u8((const uint8_t*)s.data() + i);
+            uint8x16_t bad = vorrq_u8(vcltq_u8(v, vdupq_n_u8(0x20)),
+                                      vcgtq_u8(v, vdupq_n_u8(0x7e)));
+            bad = vorrq_u8(bad, vceqq_u8(v, vdupq_n_u8('"')));
+            bad = vorrq_u8(bad, vceqq_u8(v, vdupq_n_u8('&')));
+            bad = vorrq_u8(bad, vceqq_u8(v, vdupq_n_u8('\'')));
+            bad = vorrq_u8(bad, vceqq_u8(v, vdupq_n_u8('/')));
+            bad = vorrq_u8(bad, vceqq_u8(v, vdupq_n_u8('<')));
+            bad = vorrq_u8(bad, vceqq_u8(v, vdupq_n_u8('=')));
+            bad = vorrq_u8(bad, vceqq_u8(v, vdupq_n_u8('>')));
+            bad = vorrq_u8(bad, vceqq_u8(v, vdupq_n_u8('\\')));
+            vst1q_u8((uint8_t*)p, v);
+            uint64_t lo = vgetq_lane_u64(vreinterpretq_u64_u8(bad), 0);
+            uint64_t hi = vgetq_lane_u64(vreinterpretq_u64_u8(bad), 1);
+            if (lo | hi) {
+                int n = lo ? __builtin_ctzll(lo) >> 3 //
+                           : 8 + (__builtin_ctzll(hi) >> 3);
+                p += n;
+                i += n;
+                break;
+            }
+            p += 16;
+            i += 16;
+        }
+        if (i >= s.size())
+            break;
+#endif
+
         x = s[i++] & 255;
         if (x >= 0300) {
             a = ThomPikeByte(x);
@@ -16,12 +16,15 @@
 // limitations under the License.
 
 #include "fastjson.h"
+#include "llamafile/bench.h"
 
 #include <climits>
 #include <cmath>
 #include <cstdio>
 #include <string>
 
+#define ITERATIONS 10000
+
 namespace lf {
 namespace server {
 
@@ -104,6 +107,15 @@ fastjson_test()
         return 12;
     if (encode_json("𐌰") != "\"\\ud800\\udf30\"")
         return 13;
+    if (encode_json("the quick brown fox jumps over the lazy dog") !=
+        "\"the quick brown fox jumps over the lazy dog\"")
+        return 22;
+    if (encode_json("0123456789abcdef\"after the vector boundary") !=
+        "\"0123456789abcdef\\\"after the vector boundary\"")
+        return 23;
+    if (encode_json("a clean ascii run and then µ some utf8") !=
+        "\"a clean ascii run and then \\u00b5 some utf8\"")
+        return 24;
 
     if (encode_json(3.) != "3")
         return 14;
@@ -127,11 +139,26 @@ fastjson_test()
     return 0;
 }
 
+void
+fastjson_bench()
+{
+    char buf[16384];
+    std::string ascii(1024, 'x');
+    std::string spicy;
+    for (int i = 0; i < 128; ++i)
+        spicy += "tokens \"quoted\" & <html> µ ";
+    BENCH(encode_js_string_literal(buf, ascii));
+    BENCH(encode_js_string_literal(buf, spicy));
+}
+
 } // namespace server
 } // namespace lf
 
 int
 main()
 {
-    return lf::server::fastjson_test();
+    int rc;
+    if ((rc = lf::server::fastjson_test()))
+        return rc;
+    lf::server::fastjson_bench();
 }
@@ -19,6 +19,8 @@
 #include "llama.cpp/llama.h"
 #include "llamafile/json.h"
 #include "llamafile/llamafile.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/tunables.h"
 #include "llamafile/string.h"
 
 namespace lf {
@@ -40,6 +42,9 @@ is_base_model(llama_model* model)
 bool
 Client::flagz()
 {
+    if (msg_.method == kHttpPost)
+        return flagz_update();
+    const Tunables* t = tunables();
     jt::Json json;
     json["model"] = stripext(basename(FLAG_model));
     json["prompt"] = FLAG_prompt;
@@ -47,10 +52,12 @@ Client::flagz()
     json["nologo"] = FLAG_nologo;
     json["completion_mode"] = FLAG_completion_mode;
     json["is_base_model"] = is_base_model(model_);
-    json["temperature"] = FLAG_temperature;
-    json["top_p"] = FLAG_top_p;
-    json["presence_penalty"] = FLAG_presence_penalty;
-    json["frequency_penalty"] = FLAG_frequency_penalty;
+    json["temperature"] = t->temperature;
+    json["top_p"] = t->top_p;
+    json["presence_penalty"] = t->presence_penalty;
+    json["frequency_penalty"] = t->frequency_penalty;
+    json["token_rate"] = t->token_rate;
+    json["token_burst"] = t->token_burst;
     if (FLAG_seed == LLAMA_DEFAULT_SEED) {
         json["seed"] = nullptr;
     } else {
@@ -63,5 +70,82 @@ Client::flagz()
     return send_response(obuf_.p, p, dump_);
 }
 
+// retunes runtime flags on a live server, e.g.
+//
+//     POST /flagz
+//     {"temperature": 0.4, "token_rate": 10}
+//
+// fields omitted from the body keep their current values. a new
+// snapshot is published atomically, so no request ever observes a
+// half applied update. only trusted addresses may post here, since
+// loosening rate limits is an operator action
+bool
+Client::flagz_update()
+{
+    if (!effective_ip_trusted_)
+        return send_error(403, "flagz updates require a trusted ip");
+    if (!read_payload())
+        return false;
+    auto [status, json] = jt::Json::parse(payload_);
+    if (status != jt::Json::success)
+        return send_error(400, jt::Json::StatusToString(status));
+    if (!json.isObject())
+        return send_error(400, "JSON body must be an object");
+    Tunables next = *tunables();
+    jt::Json& temperature = json["temperature"];
+    if (!temperature.isNull()) {
+        if (!temperature.isNumber())
+            return send_error(400, "temperature must be number");
+        next.temperature = temperature.getNumber();
+        if (!(0 <= next.temperature && next.temperature <= 2))
+            return send_error(400, "temperature must be between 0 and 2");
+    }
+    jt::Json& top_p = json["top_p"];
+    if (!top_p.isNull()) {
+        if (!top_p.isNumber())
+            return send_error(400, "top_p must be number");
+        next.top_p = top_p.getNumber();
+        if (!(0 <= next.top_p && next.top_p <= 1))
+            return send_error(400, "top_p must be between 0 and 1");
+    }
+    jt::Json& presence_penalty = json["presence_penalty"];
+    if (!presence_penalty.isNull()) {
+        if (!presence_penalty.isNumber())
+            return send_error(400, "presence_penalty must be number");
+        next.presence_penalty = presence_penalty.getNumber();
+        if (!(-2 <= next.presence_penalty && next.presence_penalty <= 2))
+            return send_error(400, "presence_penalty must be -2 through 2");
+    }
+    jt::Json& frequency_penalty = json["frequency_penalty"];
+    if (!frequency_penalty.isNull()) {
+        if (!frequency_penalty.isNumber())
+            return send_error(400, "frequency_penalty must be number");
+        next.frequency_penalty = frequency_penalty.getNumber();
+        if (!(-2 <= next.frequency_penalty && next.frequency_penalty <= 2))
+            return send_error(400, "frequency_penalty must be -2 through 2");
+    }
+    jt::Json& token_rate = json["token_rate"];
+    if (!token_rate.isNull()) {
+        if (!token_rate.isNumber())
+            return send_error(400, "token_rate must be number");
+        next.token_rate = token_rate.getNumber();
+        if (!(next.token_rate > 0))
+            return send_error(400, "token_rate must be positive");
+    }
+    jt::Json& token_burst = json["token_burst"];
+    if (!token_burst.isNull()) {
+        if (!token_burst.isLong())
+            return send_error(400, "token_burst must be integer");
+        next.token_burst = token_burst.getLong();
+        if (next.token_burst < 1)
+            return send_error(400, "token_burst must be positive");
+    }
+    tunables_set(next);
+    SLOG("flagz updated");
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, "{\"status\": \"updated\"}\n");
+}
+
 } // namespace server
 } // namespace lf
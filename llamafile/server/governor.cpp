@@ -0,0 +1,135 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "governor.h"
+#include "llamafile/macros.h"
+#include "llamafile/server/log.h"
+
+namespace lf {
+namespace server {
+
+// how much decode time a measurement window accumulates before the
+// achieved rate is considered trustworthy enough to act on
+static const long WINDOW_NANOS = 500000000;
+
+// how much faster a probed value needs to be before it's adopted,
+// so run to run noise can't make the climber wander
+static const double IMPROVEMENT = 1.05;
+
+// how many windows a converged climber sits still before probing
+// again, in case the workload changed underneath it
+static const int REPROBE_WINDOWS = 16;
+
+Governor::Governor(int prefill_threads,
+                   int decode_threads,
+                   int max_threads,
+                   int prefill_chunk)
+{
+    prefill_.name = "prefill threads";
+    prefill_.val = prefill_.best = MIN(prefill_threads, max_threads);
+    prefill_.best_rate = 0;
+    prefill_.lo = 1;
+    prefill_.hi = max_threads;
+    decode_.name = "decode threads";
+    decode_.val = decode_.best = MIN(decode_threads, max_threads);
+    decode_.best_rate = 0;
+    decode_.lo = 1;
+    decode_.hi = max_threads;
+    chunk_.name = "prefill chunk";
+    chunk_.val = chunk_.best = prefill_chunk;
+    chunk_.best_rate = 0;
+    chunk_.lo = MIN(32, prefill_chunk);
+    chunk_.hi = prefill_chunk;
+}
+
+int
+Governor::choose(bool is_prefill) const
+{
+    return is_prefill ? prefill_.val : decode_.val;
+}
+
+int
+Governor::chunk() const
+{
+    return chunk_.val;
+}
+
+void
+Governor::report(bool is_prefill, int token_count, long nanos)
+{
+    Phase& p = is_prefill ? *prefill_owner_ : decode_;
+    p.tokens += token_count;
+    p.nanos += nanos;
+    if (p.nanos >= WINDOW_NANOS) {
+        climb(p);
+        // hand the next window to the other prefill climber once
+        // this one is back at its best, so probes never overlap
+        if (is_prefill && p.val == p.best)
+            prefill_owner_ = prefill_owner_ == &prefill_ ? &chunk_ : &prefill_;
+    }
+}
+
+void
+Governor::climb(Phase& p)
+{
+    double rate = p.tokens / (p.nanos * 1e-9);
+    p.tokens = 0;
+    p.nanos = 0;
+    if (p.val != p.best) {
+        // we just measured a probe of a neighboring value
+        if (rate > p.best_rate * IMPROVEMENT) {
+            // it won, so adopt it and keep going the same direction
+            p.best = p.val;
+            p.best_rate = rate;
+            SLOG("%s converging on %d (%.1f tok/sec)", p.name, p.best, rate);
+            p.val = step(p);
+        } else {
+            // it lost, so go back and lean the other way next time
+            p.val = p.best;
+            p.dir = -p.dir;
+        }
+        p.windows = 0;
+    } else if (!p.best_rate) {
+        // first measurement at the starting value
+        p.best_rate = rate;
+        p.val = step(p);
+    } else {
+        // converged. track drift so a slow workload change doesn't
+        // leave best_rate unbeatable, and re-probe every so often
+        p.best_rate = p.best_rate * .7 + rate * .3;
+        if (++p.windows >= REPROBE_WINDOWS) {
+            p.best_rate = rate;
+            p.windows = 0;
+            p.val = step(p);
+        }
+    }
+}
+
+// returns next value to probe, bouncing off the bounds
+int
+Governor::step(const Phase& p) const
+{
+    int next = p.dir > 0 ? MIN(p.hi, p.best * 2) //
+                         : MAX(p.lo, p.best / 2);
+    if (next == p.best)
+        next = p.dir > 0 ? MAX(p.lo, p.best / 2) //
+                         : MIN(p.hi, p.best * 2);
+    return next;
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,83 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+namespace lf {
+namespace server {
+
+// adaptive decode tuning governor
+//
+// the best thread count for llama_decode() depends on the phase.
+// prefill is compute bound and usually wants every core, but token
+// generation is memory bound and often peaks at a fraction of them,
+// after which extra threads only add synchronization overhead. the
+// sweet spot varies by machine and model so it can't be hardcoded.
+//
+// the same goes for the span size slots use when chunking prefill.
+// with partial gpu offload an oversized chunk stalls whichever side
+// of the layer split is slower, and the balance point depends on the
+// model, the card, and how many layers fit, so that knob gets a
+// climber of its own rather than a hand-tuned flag.
+//
+// this keeps separate hill climbing state per knob. decodes are
+// accumulated into measurement windows, and once a window has enough
+// signal the achieved tokens per second either confirms the current
+// value or sends the climber up or down by powers of two. a
+// converged climber re-probes periodically in case the workload
+// changed underneath it.
+struct Governor
+{
+    // hill climbing state for one knob
+    struct Phase
+    {
+        const char* name; // for logging
+        int val; // value being measured
+        int best; // best known value
+        double best_rate; // tokens per second at best
+        int lo; // smallest value worth probing
+        int hi; // largest value worth probing
+        int dir = -1; // probe direction (+1 widens, -1 narrows)
+        int windows = 0; // windows measured since last probe
+        long tokens = 0; // accumulates until window is full
+        long nanos = 0;
+    };
+
+    Phase prefill_;
+    Phase decode_;
+    Phase chunk_;
+
+    // prefill measurements feed whichever climber owns the window,
+    // since the thread climber and the chunk climber would fight
+    // over credit for a rate change if both probed at once
+    Phase* prefill_owner_ = &prefill_;
+
+    Governor(int prefill_threads,
+             int decode_threads,
+             int max_threads,
+             int prefill_chunk);
+    int choose(bool is_prefill) const;
+    int chunk() const;
+    void report(bool is_prefill, int token_count, long nanos);
+
+  private:
+    void climb(Phase&);
+    int step(const Phase&) const;
+};
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,55 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils.h"
+#include <cctype>
+#include <string_view>
+
+namespace lf {
+namespace server {
+
+// returns true if `token` appears in the comma separated header
+// value `h`, ignoring case and whitespace, e.g. "keep-alive, Upgrade"
+bool
+header_has_token(std::string_view h, std::string_view token)
+{
+    size_t i = 0;
+    while (i < h.size()) {
+        size_t j = h.find(',', i);
+        if (j == std::string_view::npos)
+            j = h.size();
+        size_t beg = i;
+        size_t end = j;
+        while (beg < end && (h[beg] == ' ' || h[beg] == '\t'))
+            ++beg;
+        while (end > beg && (h[end - 1] == ' ' || h[end - 1] == '\t'))
+            --end;
+        if (end - beg == token.size()) {
+            size_t k;
+            for (k = 0; k < token.size(); ++k)
+                if (tolower(h[beg + k]) != tolower(token[k]))
+                    break;
+            if (k == token.size())
+                return true;
+        }
+        i = j + 1;
+    }
+    return false;
+}
+
+} // namespace server
+} // namespace lf
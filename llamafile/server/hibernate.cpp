@@ -0,0 +1,120 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hibernate.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/server/batcher.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/memory.h"
+#include "llamafile/server/slot.h"
+#include <third_party/zlib/zlib.h>
+#include <cstdint>
+#include <vector>
+
+namespace lf {
+namespace server {
+
+// hibernation squeezes idle conversations out of the kv cell pool
+//
+// a long idle conversation pins thousands of cells that mostly
+// consist of attention state with lots of redundancy, and quantized
+// kv compresses several fold with even the cheapest deflate level.
+// so when the pool is under pressure and a conversation has gone
+// cold, its serialized sequence gets compressed onto the heap and
+// its cells are given back. the history stays resident, so the
+// prefix tree still matches the conversation, and Slots::take()
+// rehydrates it on the next hit instead of recomputing the prefill
+
+// compresses the slot's kv state to the heap and frees its cells.
+// called with the slots lock held, like eviction
+bool
+hibernate_slot(Slot* slot)
+{
+    if (!slot->ctx_ || slot->history_.empty())
+        return false;
+    if (!slot->hibernated_.empty())
+        return true;
+    std::vector<uint8_t> state;
+    if (slot->batcher_->kv_state_save(slot->id_, &state)) {
+        SLOG("failed to serialize kv cache for slot #%d", slot->id_);
+        return false;
+    }
+    uLongf compressed_size = compressBound(state.size());
+    slot->hibernated_.resize(compressed_size);
+    if (compress2(slot->hibernated_.data(),
+                  &compressed_size,
+                  state.data(),
+                  state.size(),
+                  Z_BEST_SPEED) != Z_OK) {
+        slot->hibernated_.clear();
+        slot->hibernated_.shrink_to_fit();
+        return false;
+    }
+    slot->hibernated_.resize(compressed_size);
+    slot->hibernated_.shrink_to_fit();
+    slot->hibernated_size_ = state.size();
+    memory_count(MEM_KV, slot->hibernated_.size());
+    slot->batcher_->kv_cache_seq_rm(slot->id_, -1, -1);
+    SLOG("hibernated slot #%d (%zu kv bytes became %zu)",
+         slot->id_,
+         state.size(),
+         (size_t)compressed_size);
+    return true;
+}
+
+// decompresses a hibernated slot's kv state back into the cell pool.
+// on failure the slot is wiped down to an empty one, the same outcome
+// as eviction, so the caller just gets a cold slot. called with the
+// slots lock held and the slot already out of the prefix tree
+bool
+rehydrate_slot(Slot* slot)
+{
+    if (slot->hibernated_.empty())
+        return true;
+    std::vector<uint8_t> state(slot->hibernated_size_);
+    uLongf state_size = slot->hibernated_size_;
+    bool ok = uncompress(state.data(),
+                         &state_size,
+                         slot->hibernated_.data(),
+                         slot->hibernated_.size()) == Z_OK &&
+              state_size == slot->hibernated_size_;
+    if (ok)
+        ok = !slot->batcher_->kv_state_load(slot->id_, state.data());
+    memory_count(MEM_KV, -(long)slot->hibernated_.size());
+    slot->hibernated_.clear();
+    slot->hibernated_.shrink_to_fit();
+    slot->hibernated_size_ = 0;
+    if (!ok) {
+        SLOG("failed to rehydrate slot #%d", slot->id_);
+        slot->batcher_->kv_cache_seq_rm(slot->id_, -1, -1);
+        slot->history_.clear();
+        slot->history_digest_ = 0;
+        if (slot->draft_ctx_) {
+            llama_kv_cache_seq_rm(slot->draft_ctx_, 0, -1, -1);
+            slot->draft_used_ = 0;
+            slot->draft_dirty_ = false;
+        }
+        return false;
+    }
+    SLOG("rehydrated %zu token conversation into slot #%d",
+         slot->history_.size(),
+         slot->id_);
+    return true;
+}
+
+} // namespace server
+} // namespace lf
@@ -17,13 +17,17 @@
 
 #include "image.h"
 #include "llamafile/llamafile.h"
+#include "memory.h"
 #include <cassert>
 #include <utility>
 
 namespace lf {
 namespace server {
 
-Image::~Image() = default;
+Image::~Image()
+{
+    memory_count(MEM_IMAGE, -(long)bytes_.size());
+}
 
 Image::Image(const Image& old) : Image(old.bytes_, old.ctx_used_)
 {
@@ -32,6 +36,13 @@ Image::Image(const Image& old) : Image(old.bytes_, old.ctx_used_)
 Image::Image(const std::string_view& bytes, int ctx_used)
   : bytes_(bytes), ctx_used_(ctx_used)
 {
+    memory_count(MEM_IMAGE, bytes_.size());
+}
+
+Image::Image(std::string&& bytes, int ctx_used)
+  : bytes_(std::move(bytes)), ctx_used_(ctx_used)
+{
+    memory_count(MEM_IMAGE, bytes_.size());
 }
 
 const std::string&
@@ -27,6 +27,7 @@ class Image
     ~Image();
     Image(const Image&);
     Image(const std::string_view&, int);
+    Image(std::string&&, int);
     const std::string& bytes() const;
     int ctx_used() const;
 
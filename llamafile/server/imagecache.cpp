@@ -0,0 +1,163 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "imagecache.h"
+#include "llama.cpp/llava/llava.h"
+#include "llamafile/server/memory.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+// clip image embedding cache
+//
+// multi-turn vision chats resend the same screenshots and logos every
+// turn, and each time the image atom misses the slot's history it gets
+// stb decoded and pushed through the vision encoder again, which costs
+// whole seconds of gpu time for bytes we've already seen. the embed is
+// a pure function of the compressed image and the projector model, and
+// the projector is fixed for the life of the process (--mmproj), so
+// results are memoized here keyed by a content hash. a hit is only
+// trusted after the cached bytes compare equal, so a collision just
+// means a miss, never someone else's screenshot. hits skip the decode
+// and the encoder both.
+//
+// an embed weighs n_image_pos * n_embd floats, megabytes rather than
+// kilobytes, so the cache is bounded by bytes instead of entries and
+// evicts least recently used. cached memory is counted under MEM_IMAGE
+// where the atom copies of the same images already show up.
+//
+// worker threads handling requests are subject to pthread_cancel(),
+// so nothing that's a cancelation point may happen under the lock.
+
+#define MAX_IMAGE_SIZE (32 * 1024 * 1024)
+#define MAX_CACHE_BYTES (256 * 1024 * 1024)
+
+namespace lf {
+namespace server {
+
+struct ImageCacheEntry
+{
+    uint64_t stamp;
+    std::string bytes;
+    std::vector<float> embed;
+    int n_image_pos;
+};
+
+static uint64_t g_stamp;
+static size_t g_bytes;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<uint64_t, ImageCacheEntry> g_entries;
+
+static uint64_t
+imagecache_hash(const std::string_view& bytes)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        h ^= (unsigned char)bytes[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+static size_t
+entry_bytes(const ImageCacheEntry& entry)
+{
+    return entry.bytes.size() + entry.embed.size() * sizeof(float);
+}
+
+// looks up earlier embedding of image. on a hit a fresh copy is
+// returned, which the caller owns and frees with
+// llava_image_embed_free() just like one the encoder made
+llava_image_embed*
+imagecache_get(const std::string_view& bytes)
+{
+    if (bytes.size() > MAX_IMAGE_SIZE)
+        return nullptr;
+    uint64_t key = imagecache_hash(bytes);
+    llava_image_embed* res = nullptr;
+    pthread_mutex_lock(&g_lock);
+    auto e = g_entries.find(key);
+    if (e != g_entries.end()) {
+        ImageCacheEntry& entry = e->second;
+        if (entry.bytes.size() == bytes.size() &&
+            !memcmp(entry.bytes.data(), bytes.data(), bytes.size())) {
+            entry.stamp = ++g_stamp;
+            size_t len = entry.embed.size() * sizeof(float);
+            res = (llava_image_embed*)malloc(sizeof(llava_image_embed));
+            res->embed = (float*)malloc(len);
+            memcpy(res->embed, entry.embed.data(), len);
+            res->n_image_pos = entry.n_image_pos;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return res;
+}
+
+// remembers embedding of image. least recently used entries are
+// evicted once the cache exceeds its byte budget
+void
+imagecache_put(const std::string_view& bytes,
+               const llava_image_embed* embed,
+               int n_embd)
+{
+    if (bytes.size() > MAX_IMAGE_SIZE)
+        return;
+    size_t count = (size_t)embed->n_image_pos * n_embd;
+    if (bytes.size() + count * sizeof(float) > MAX_CACHE_BYTES)
+        return;
+    uint64_t key = imagecache_hash(bytes);
+    pthread_mutex_lock(&g_lock);
+    ImageCacheEntry& entry = g_entries[key];
+    if (entry.stamp) {
+        g_bytes -= entry_bytes(entry);
+        memory_count(MEM_IMAGE, -(long)entry_bytes(entry));
+    }
+    entry.stamp = ++g_stamp;
+    entry.bytes = bytes;
+    entry.embed.assign(embed->embed, embed->embed + count);
+    entry.n_image_pos = embed->n_image_pos;
+    g_bytes += entry_bytes(entry);
+    memory_count(MEM_IMAGE, entry_bytes(entry));
+    while (g_bytes > MAX_CACHE_BYTES && g_entries.size() > 1) {
+        auto oldest = g_entries.begin();
+        for (auto e = g_entries.begin(); e != g_entries.end(); ++e)
+            if (e->second.stamp < oldest->second.stamp)
+                oldest = e;
+        g_bytes -= entry_bytes(oldest->second);
+        memory_count(MEM_IMAGE, -(long)entry_bytes(oldest->second));
+        g_entries.erase(oldest);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void
+imagecache_destroy()
+{
+    pthread_mutex_lock(&g_lock);
+    for (const auto& e : g_entries)
+        memory_count(MEM_IMAGE, -(long)entry_bytes(e.second));
+    std::map<uint64_t, ImageCacheEntry>().swap(g_entries);
+    g_bytes = 0;
+    pthread_mutex_unlock(&g_lock);
+}
+
+} // namespace server
+} // namespace lf
@@ -25,6 +25,8 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 namespace lf {
 namespace server {
@@ -41,9 +43,49 @@ print_listening_url(unsigned ip, int port)
          FLAG_url_prefix);
 }
 
+// creates unix domain socket, e.g. --listen unix:/run/llamafile.sock
+//
+// same-host clients like sidecars can use this to skip the tcp stack,
+// which matters at high request rates. unix clients are treated like
+// loopback for trust and rate limiting purposes
+static int
+create_unix_socket(const char* path)
+{
+    struct sockaddr_un un = { .sun_family = AF_UNIX };
+    if (strlcpy(un.sun_path, path, sizeof(un.sun_path)) >=
+        sizeof(un.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        exit(1);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    unlink(path); // last run's socket file would make bind fail
+    if (bind(fd, (struct sockaddr*)&un, sizeof(un)) == -1) {
+        perror(path);
+        exit(1);
+    }
+    if (listen(fd, SOMAXCONN)) {
+        perror(path);
+        exit(1);
+    }
+    SLOG("listen unix:%s%s", path, FLAG_url_prefix);
+    return fd;
+}
+
 int
 create_listening_socket(const char* hostport, unsigned* out_ip, int* out_port)
 {
+    if (!strncmp(hostport, "unix:", 5)) {
+        if (out_ip)
+            *out_ip = 0x7f000001;
+        if (out_port)
+            *out_port = 0;
+        return create_unix_socket(hostport + 5);
+    }
+
     // parse hostname:port
     char* p;
     char addr[128];
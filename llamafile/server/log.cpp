@@ -16,9 +16,16 @@
 // limitations under the License.
 
 #include "log.h"
+#include "llama.cpp/cores.h"
+#include "llamafile/llamafile.h"
 #include "time.h"
+#include <atomic>
+#include <csignal>
+#include <cstdarg>
 #include <cstring>
+#include <libc/intrin/kprintf.h>
 #include <pthread.h>
+#include <unistd.h>
 
 namespace lf {
 namespace server {
@@ -92,5 +99,179 @@ get_log_timestamp(void)
     return s;
 }
 
+//
+// lock-free log ring
+//
+// every thread that logs formats its line and posts it to this ring,
+// and a background thread batches the lines into big write() calls on
+// standard error. that way enabling --verbose at high qps won't make
+// worker threads take turns sleeping inside the write() syscall. each
+// record is a four byte length followed by the line, rounded up to a
+// four byte boundary, so a length slot never straddles the wraparound
+// and can be loaded atomically. a zero length means the producer that
+// reserved the space hasn't committed it yet; the drainer zeroes each
+// region it consumes so that invariant holds after the cursors wrap.
+// producers have no cancellation points between reserving a slot and
+// committing its length, so cancelled workers can't wedge the drain.
+//
+
+#define LOG_RING_SIZE 1048576
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_LINE_MAX 2048
+
+alignas(64) static char g_ring[LOG_RING_SIZE];
+static std::atomic_ulong g_ring_head;
+static std::atomic_ulong g_ring_tail;
+static std::atomic_bool g_ring_active;
+static pthread_t g_log_thread;
+static pthread_mutex_t g_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t
+log_drain(void)
+{
+    static char batch[65536];
+    size_t got = 0;
+    size_t drained = 0;
+    pthread_mutex_lock(&g_drain_lock);
+    unsigned long tail = g_ring_tail.load(std::memory_order_relaxed);
+    for (;;) {
+        unsigned len = __atomic_load_n(
+          (unsigned*)(g_ring + (tail & LOG_RING_MASK)), __ATOMIC_ACQUIRE);
+        if (!len)
+            break;
+        if (got + len > sizeof(batch)) {
+            write(2, batch, got);
+            got = 0;
+        }
+        unsigned long off = (tail + 4) & LOG_RING_MASK;
+        unsigned long n = LOG_RING_SIZE - off;
+        if (len <= n) {
+            memcpy(batch + got, g_ring + off, len);
+        } else {
+            memcpy(batch + got, g_ring + off, n);
+            memcpy(batch + got + n, g_ring, len - n);
+        }
+        got += len;
+        drained += len;
+        // zero the consumed region so length slots inside it read as
+        // uncommitted when producers lap around and reuse the space
+        unsigned long total = (4 + (unsigned long)len + 3) & ~3ul;
+        off = tail & LOG_RING_MASK;
+        n = LOG_RING_SIZE - off;
+        if (total <= n) {
+            memset(g_ring + off, 0, total);
+        } else {
+            memset(g_ring + off, 0, n);
+            memset(g_ring, 0, total - n);
+        }
+        tail += total;
+        g_ring_tail.store(tail, std::memory_order_release);
+    }
+    if (got)
+        write(2, batch, got);
+    pthread_mutex_unlock(&g_drain_lock);
+    return drained;
+}
+
+static void*
+log_worker(void* arg)
+{
+    sigset_t ss;
+    sigemptyset(&ss);
+    sigaddset(&ss, SIGHUP);
+    sigaddset(&ss, SIGINT);
+    sigaddset(&ss, SIGQUIT);
+    sigaddset(&ss, SIGTERM);
+    sigaddset(&ss, SIGUSR1);
+    sigaddset(&ss, SIGALRM);
+    pthread_sigmask(SIG_SETMASK, &ss, 0);
+    set_thread_name("logger");
+    // draining the ring never needs a performance core, so on hybrid
+    // parts this thread lives with the efficiency cores, out of the
+    // way of the decode team's lockstep barriers
+    if (!FLAG_ecores) {
+        cpu_set_t mask;
+        if (cpu_get_efficiency_affinity(&mask) > 0)
+            pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    }
+    for (;;) {
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+        size_t n = log_drain();
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+        pthread_testcancel();
+        if (!n)
+            usleep(10000);
+    }
+    return nullptr;
+}
+
+void
+log_write(const char* fmt, ...)
+{
+    va_list va;
+    char buf[LOG_LINE_MAX];
+    va_start(va, fmt);
+    unsigned long len = kvsnprintf(buf, sizeof(buf), fmt, va);
+    va_end(va);
+    if (len >= sizeof(buf))
+        len = sizeof(buf) - 1;
+    if (!len)
+        return;
+
+    // binaries that never call log_init() log synchronously, which is
+    // also what crash reporting wants once the drainer has been torn
+    // down at shutdown time
+    if (!g_ring_active.load(std::memory_order_acquire)) {
+        write(2, buf, len);
+        return;
+    }
+
+    // reserve space in the ring. if the drainer can't keep up we take
+    // the ordering glitch of writing this line directly over making a
+    // worker thread wait for the ring to empty out.
+    unsigned long total = (4 + len + 3) & ~3ul;
+    unsigned long head = g_ring_head.load(std::memory_order_relaxed);
+    for (;;) {
+        unsigned long tail = g_ring_tail.load(std::memory_order_acquire);
+        if (head + total - tail > LOG_RING_SIZE) {
+            write(2, buf, len);
+            return;
+        }
+        if (g_ring_head.compare_exchange_weak(head, head + total,
+                                              std::memory_order_acq_rel))
+            break;
+    }
+
+    // copy in the line, then publish its length
+    unsigned long off = (head + 4) & LOG_RING_MASK;
+    unsigned long n = LOG_RING_SIZE - off;
+    if (len <= n) {
+        memcpy(g_ring + off, buf, len);
+    } else {
+        memcpy(g_ring + off, buf, n);
+        memcpy(g_ring, buf + n, len - n);
+    }
+    __atomic_store_n((unsigned*)(g_ring + (head & LOG_RING_MASK)),
+                     (unsigned)len, __ATOMIC_RELEASE);
+}
+
+void
+log_init(void)
+{
+    if (pthread_create(&g_log_thread, 0, log_worker, 0))
+        __builtin_trap();
+    g_ring_active.store(true, std::memory_order_release);
+}
+
+void
+log_destroy(void)
+{
+    g_ring_active.store(false, std::memory_order_release);
+    pthread_cancel(g_log_thread);
+    if (pthread_join(g_log_thread, 0))
+        __builtin_trap();
+    log_drain();
+}
+
 } // namespace server
 } // namespace lf
@@ -16,16 +16,16 @@
 // limitations under the License.
 
 #pragma once
-#include <libc/intrin/kprintf.h>
 
 #define SLOG(FMT, ...) \
-    (!lf::server::g_log_disable && (kprintf("%s %s:%d %s " FMT "\n", \
-                                            get_log_timestamp(), \
-                                            __FILE__, \
-                                            __LINE__, \
-                                            get_thread_name(), \
-                                            ##__VA_ARGS__), \
-                                    0))
+    (!lf::server::g_log_disable && \
+     (lf::server::log_write("%s %s:%d %s " FMT "\n", \
+                            get_log_timestamp(), \
+                            __FILE__, \
+                            __LINE__, \
+                            get_thread_name(), \
+                            ##__VA_ARGS__), \
+      0))
 
 namespace lf {
 namespace server {
@@ -41,5 +41,14 @@ get_log_timestamp(void);
 void
 set_thread_name(const char*);
 
+void
+log_write(const char*, ...);
+
+void
+log_init(void);
+
+void
+log_destroy(void);
+
 } // namespace server
 } // namespace lf
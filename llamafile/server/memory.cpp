@@ -0,0 +1,108 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/server/memory.h"
+
+#include <atomic>
+
+// memory accounting
+//
+// when the oom killer takes us out, the postmortem question is
+// always which of the big consumers grew: weights, kv, request
+// buffers, or cached json. each domain keeps a current byte count
+// and a highwater mark. counting goes through a thread-local
+// pending delta that only gets folded into the shared counters once
+// it exceeds a page, so fine-grained churn costs two thread-local
+// adds and no cache line bouncing, while anything big enough to
+// matter blows through the threshold and lands immediately. the
+// price is precision: up to a page per thread per domain sits
+// unreported, and a thread that exits takes its pending delta with
+// it, which is fine for a gauge that's read by humans during an
+// incident rather than subtracted from a budget
+
+#define PENDING_MAX 4096
+
+namespace lf {
+namespace server {
+
+namespace {
+
+struct Domain
+{
+    std::atomic_long current;
+    std::atomic_long highwater;
+};
+
+Domain g_domains[MEM_DOMAINS];
+thread_local long g_pending[MEM_DOMAINS];
+
+const char* const g_domain_names[MEM_DOMAINS] = {
+    "model", //
+    "kv", //
+    "http", //
+    "json", //
+    "image", //
+};
+
+void
+flush(int domain)
+{
+    long delta = g_pending[domain];
+    if (!delta)
+        return;
+    g_pending[domain] = 0;
+    Domain* d = &g_domains[domain];
+    long now = d->current.fetch_add(delta, std::memory_order_relaxed) + delta;
+    long hw = d->highwater.load(std::memory_order_relaxed);
+    while (now > hw &&
+           !d->highwater.compare_exchange_weak(
+             hw, now, std::memory_order_relaxed)) {
+    }
+}
+
+} // namespace
+
+const char*
+memory_name(int domain)
+{
+    return g_domain_names[domain];
+}
+
+// records that `bytes` more (or fewer, when negative) bytes are
+// resident in the given domain. safe to call from any thread,
+// including cancelable workers, since it takes no locks
+void
+memory_count(int domain, long bytes)
+{
+    g_pending[domain] += bytes;
+    if (g_pending[domain] >= PENDING_MAX || g_pending[domain] <= -PENDING_MAX)
+        flush(domain);
+}
+
+// reports current and highwater byte counts for the given domain.
+// the calling thread's pending delta is folded in first; other
+// threads' unflushed churn, at most a page each, isn't visible yet
+void
+memory_read(int domain, long* current, long* highwater)
+{
+    flush(domain);
+    *current = g_domains[domain].current.load(std::memory_order_relaxed);
+    *highwater = g_domains[domain].highwater.load(std::memory_order_relaxed);
+}
+
+} // namespace server
+} // namespace lf
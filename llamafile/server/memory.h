@@ -0,0 +1,44 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+namespace lf {
+namespace server {
+
+// allocation domains whose footprint we track
+enum
+{
+    MEM_MODEL, // weight tensors mapped from the gguf
+    MEM_KV, // llama context state, plus hibernated kv blobs
+    MEM_HTTP, // per-client request and response buffers
+    MEM_JSON, // remembered response json (completion cache)
+    MEM_IMAGE, // image bytes riding along in atoms, cached clip embeds
+    MEM_DOMAINS,
+};
+
+const char*
+memory_name(int);
+
+void
+memory_count(int, long);
+
+void
+memory_read(int, long*, long*);
+
+} // namespace server
+} // namespace lf
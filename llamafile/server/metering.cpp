@@ -0,0 +1,277 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/server/metering.h"
+
+#include "llamafile/llamafile.h"
+#include "llamafile/server/metrics.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <strings.h>
+#include <string>
+
+// per-tenant usage metering
+//
+// the token bucket throttles by source address, which is the wrong
+// key once several tenants share a gateway: they arrive from one ip
+// and a cheap request costs the same token as an expensive one. this
+// module meters the thing that's actually scarce, measured compute
+// time, keyed by whatever credential the client presents in its
+// Authorization header.
+//
+// accounting rides the phase instrumentation: metrics_observe() tells
+// us how long every prefill and decode took on the worker thread that
+// ran it, so a thread-local binding established at dispatch is all it
+// takes to attribute that time to a tenant. no new timers, no extra
+// clock reads on the token path.
+//
+// tenants live in an open addressed table like the cold tier's page
+// index: keys hash in, slots are claimed with a relaxed compare and
+// exchange, and nothing is ever evicted, so lookups are lock free and
+// o(1). the table shards by tenant naturally, which is what keeps
+// concurrent requests from bouncing one counter; within a tenant the
+// adds are plain relaxed atomics, same as the histograms.
+//
+// quotas are enforced over a sliding window of sixteen slices
+// covering the last hour. each slice is an (epoch, nanos) pair that
+// any thread can lazily reset when its epoch has passed, so there's
+// no sweeper thread and admission is a bounded loop over sixteen
+// loads.
+
+#define TENANTS 512 // power of two; ~quarter megabyte, never evicted
+#define PROBES 16 // open addressing gives up after this many slots
+#define NAMELEN 8 // leading key bytes kept so the export is readable
+                  // without republishing the whole secret
+#define SLICES 16
+#define WINDOW 3600 // seconds of sliding quota window
+#define SLICE_SECONDS (WINDOW / SLICES)
+
+namespace lf {
+namespace server {
+
+namespace {
+
+struct Slice
+{
+    std::atomic_long epoch;
+    std::atomic_long ns;
+};
+
+struct alignas(64) Tenant
+{
+    std::atomic_ulong hash;
+    char name[NAMELEN + 1];
+    std::atomic_long requests;
+    std::atomic_long total_ns[METRIC_PHASES];
+    Slice window[SLICES];
+};
+
+Tenant g_tenants[TENANTS];
+
+thread_local Tenant* g_bound;
+
+const char* const g_phase_names[METRIC_PHASES] = {
+    "queue",
+    "prefill",
+    "decode",
+    "write",
+};
+
+unsigned long
+fnv64(const char* p, size_t n)
+{
+    unsigned long h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (unsigned char)p[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+// strips the credential scheme so "Bearer sk-..." and a bare key
+// meter to the same tenant
+std::string_view
+strip_bearer(std::string_view key)
+{
+    if (key.size() >= 7 && !strncasecmp(key.data(), "bearer ", 7))
+        key = key.substr(7);
+    while (!key.empty() && key.front() == ' ')
+        key = key.substr(1);
+    return key;
+}
+
+// finds or creates the tenant record for a key. returns null when the
+// table region is full, in which case the request goes unmetered,
+// which beats turning a monitoring feature into an outage.
+Tenant*
+find_tenant(std::string_view key)
+{
+    unsigned long hash = fnv64(key.data(), key.size());
+    hash += !hash;
+    for (int i = 0; i < PROBES; ++i) {
+        Tenant* t = &g_tenants[(hash + i) & (TENANTS - 1)];
+        unsigned long have = t->hash.load(std::memory_order_relaxed);
+        if (have == hash)
+            return t;
+        if (!have) {
+            // two threads racing the same key write identical name
+            // bytes, so losing the claim below is harmless. different
+            // keys colliding on a 64-bit hash would share a record,
+            // which we don't lose sleep over.
+            size_t n = key.size() < NAMELEN ? key.size() : NAMELEN;
+            for (size_t j = 0; j < n; ++j) {
+                // keep the prometheus label well formed no matter
+                // what bytes the credential holds
+                char c = key[j];
+                if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\')
+                    c = '.';
+                t->name[j] = c;
+            }
+            t->name[n] = 0;
+            if (t->hash.compare_exchange_strong(
+                  have, hash, std::memory_order_relaxed))
+                return t;
+            if (have == hash)
+                return t;
+        }
+    }
+    return nullptr;
+}
+
+// sums window nanoseconds still inside the sliding hour
+long
+window_ns(Tenant* t, long now_epoch)
+{
+    long sum = 0;
+    for (int i = 0; i < SLICES; ++i) {
+        Slice* s = &t->window[i];
+        long e = s->epoch.load(std::memory_order_relaxed);
+        if (now_epoch - e < SLICES)
+            sum += s->ns.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+} // namespace
+
+// attributes this thread's subsequent phase observations to the
+// tenant identified by the given Authorization header. an empty or
+// unmatchable credential unbinds, so anonymous requests cost nothing
+// to pass through here. called at dispatch, before any phase runs.
+void
+metering_bind(std::string_view authorization)
+{
+    std::string_view key = strip_bearer(authorization);
+    if (key.empty()) {
+        g_bound = nullptr;
+        return;
+    }
+    g_bound = find_tenant(key);
+    if (g_bound)
+        g_bound->requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+// charges `nanos` of the given phase to the bound tenant, if any.
+// called by metrics_observe() on the request's worker thread. only
+// prefill and decode count against quota, since queueing and socket
+// writes aren't compute the tenant chose to spend.
+void
+metering_account(int phase, long nanos)
+{
+    Tenant* t = g_bound;
+    if (!t)
+        return;
+    t->total_ns[phase].fetch_add(nanos, std::memory_order_relaxed);
+    if (phase != METRIC_PREFILL && phase != METRIC_DECODE)
+        return;
+    long e = time(0) / SLICE_SECONDS;
+    Slice* s = &t->window[e % SLICES];
+    if (s->epoch.load(std::memory_order_relaxed) != e)
+        if (s->epoch.exchange(e, std::memory_order_relaxed) != e)
+            s->ns.store(0, std::memory_order_relaxed);
+    s->ns.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+// returns zero if the bound tenant may run another request, otherwise
+// a suggested retry delay in seconds. the quota is --meter-quota
+// seconds of measured prefill plus decode time per sliding hour; the
+// delay is when the oldest slice ages out of the window, since that's
+// the next moment usage can drop.
+int
+metering_admit()
+{
+    Tenant* t = g_bound;
+    if (!t)
+        return 0;
+    if (!FLAG_meter_quota)
+        return 0;
+    long now = time(0);
+    long e = now / SLICE_SECONDS;
+    if (window_ns(t, e) < FLAG_meter_quota * 1000000000L)
+        return 0;
+    int retry = SLICE_SECONDS - now % SLICE_SECONDS;
+    return retry > 0 ? retry : 1;
+}
+
+// appends per-tenant usage in prometheus text exposition format, for
+// scraping into whatever does the billing. the key label carries only
+// the stored prefix; the id label is the full 64-bit key hash, which
+// is what billing should join on.
+void
+metering_render(std::string* out)
+{
+    char buf[256];
+    long e = time(0) / SLICE_SECONDS;
+    *out += "# TYPE llamafile_tenant_requests counter\n";
+    *out += "# TYPE llamafile_tenant_phase_seconds counter\n";
+    *out += "# TYPE llamafile_tenant_window_seconds gauge\n";
+    for (int i = 0; i < TENANTS; ++i) {
+        Tenant* t = &g_tenants[i];
+        if (!t->hash.load(std::memory_order_relaxed))
+            continue;
+        unsigned long id = t->hash.load(std::memory_order_relaxed);
+        snprintf(buf,
+                 sizeof(buf),
+                 "llamafile_tenant_requests{id=\"%016lx\",key=\"%s\"} %ld\n",
+                 id,
+                 t->name,
+                 t->requests.load(std::memory_order_relaxed));
+        *out += buf;
+        for (int phase = 0; phase < METRIC_PHASES; ++phase) {
+            snprintf(buf,
+                     sizeof(buf),
+                     "llamafile_tenant_phase_seconds{id=\"%016lx\","
+                     "phase=\"%s\"} %g\n",
+                     id,
+                     g_phase_names[phase],
+                     t->total_ns[phase].load(std::memory_order_relaxed) *
+                       1e-9);
+            *out += buf;
+        }
+        snprintf(buf,
+                 sizeof(buf),
+                 "llamafile_tenant_window_seconds{id=\"%016lx\"} %g\n",
+                 id,
+                 window_ns(t, e) * 1e-9);
+        *out += buf;
+    }
+}
+
+} // namespace server
+} // namespace lf
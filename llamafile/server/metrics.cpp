@@ -0,0 +1,169 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/server/metrics.h"
+
+#include "llamafile/server/eventlog.h"
+#include "llamafile/server/metering.h"
+#include <atomic>
+#include <cstdio>
+#include <pthread.h>
+#include <string>
+
+// latency histograms
+//
+// each phase gets an hdr-style log-linear histogram: values below
+// sixteen nanoseconds index buckets directly, and every power of two
+// above that is split into sixteen linear sub-buckets, so buckets
+// stay within ~6% of the recorded value all the way up. recording a
+// sample is a couple of relaxed atomic increments, cheap enough to
+// leave on unconditionally, even on the per-token path.
+//
+// the histograms are striped the same way the thread pool stripes its
+// idle lists: each worker hashes to one of eight replicas, so bursts
+// of concurrent tokens don't all bounce the same cache lines. the
+// scrape path merges the stripes, which is the slow side, where slow
+// doesn't matter.
+
+#define STRIPES 8
+#define MAXMAJOR 40 // 2**40 nanos is ~18 minutes; clamp beyond that
+#define NBUCKETS ((MAXMAJOR - 3) << 4)
+
+namespace lf {
+namespace server {
+
+namespace {
+
+struct Histogram
+{
+    std::atomic_long buckets[NBUCKETS];
+    std::atomic_long count;
+    std::atomic_long sum;
+};
+
+struct alignas(64) Stripe
+{
+    Histogram phases[METRIC_PHASES];
+};
+
+Stripe g_stripes[STRIPES];
+
+const char* const g_phase_names[METRIC_PHASES] = {
+    "queue",
+    "prefill",
+    "decode",
+    "write",
+};
+
+// maps nanoseconds to a log-linear bucket index
+int
+bucket_index(long nanos)
+{
+    if (nanos < 0)
+        return 0;
+    if (nanos < 16)
+        return nanos;
+    int major = 63 - __builtin_clzl(nanos);
+    if (major >= MAXMAJOR)
+        return NBUCKETS - 1;
+    int minor = (nanos >> (major - 4)) & 15;
+    return ((major - 3) << 4) + minor;
+}
+
+// returns the exclusive upper bound of a bucket, in nanoseconds
+long
+bucket_limit(int i)
+{
+    ++i;
+    if (i <= 16)
+        return i;
+    int major = (i >> 4) + 3;
+    int minor = i & 15;
+    return (long)(16 + minor) << (major - 4);
+}
+
+} // namespace
+
+// records that `nanos` nanoseconds were spent in the given phase.
+// safe to call from any thread, including cancelable workers, since
+// it takes no locks and can't block.
+void
+metrics_observe(int phase, long nanos)
+{
+    Histogram* h =
+      &g_stripes[((uintptr_t)pthread_self() >> 8) % STRIPES].phases[phase];
+    h->buckets[bucket_index(nanos)].fetch_add(1, std::memory_order_relaxed);
+    h->count.fetch_add(1, std::memory_order_relaxed);
+    h->sum.fetch_add(nanos, std::memory_order_relaxed);
+    metering_account(phase, nanos);
+    eventlog_account(phase, nanos);
+}
+
+// appends all histograms in prometheus text exposition format. empty
+// buckets are skipped, which prometheus allows, since bucket counts
+// are cumulative and +Inf is always present.
+void
+metrics_render(std::string* out)
+{
+    char buf[128];
+    for (int phase = 0; phase < METRIC_PHASES; ++phase) {
+        long merged[NBUCKETS] = {};
+        long count = 0;
+        long sum = 0;
+        for (int s = 0; s < STRIPES; ++s) {
+            Histogram* h = &g_stripes[s].phases[phase];
+            for (int i = 0; i < NBUCKETS; ++i)
+                merged[i] +=
+                  h->buckets[i].load(std::memory_order_relaxed);
+            count += h->count.load(std::memory_order_relaxed);
+            sum += h->sum.load(std::memory_order_relaxed);
+        }
+        snprintf(buf,
+                 sizeof(buf),
+                 "# TYPE llamafile_%s_seconds histogram\n",
+                 g_phase_names[phase]);
+        *out += buf;
+        long cumulative = 0;
+        for (int i = 0; i < NBUCKETS; ++i) {
+            if (!merged[i])
+                continue;
+            cumulative += merged[i];
+            snprintf(buf,
+                     sizeof(buf),
+                     "llamafile_%s_seconds_bucket{le=\"%g\"} %ld\n",
+                     g_phase_names[phase],
+                     bucket_limit(i) * 1e-9,
+                     cumulative);
+            *out += buf;
+        }
+        snprintf(buf,
+                 sizeof(buf),
+                 "llamafile_%s_seconds_bucket{le=\"+Inf\"} %ld\n"
+                 "llamafile_%s_seconds_sum %g\n"
+                 "llamafile_%s_seconds_count %ld\n",
+                 g_phase_names[phase],
+                 count,
+                 g_phase_names[phase],
+                 sum * 1e-9,
+                 g_phase_names[phase],
+                 count);
+        *out += buf;
+    }
+}
+
+} // namespace server
+} // namespace lf
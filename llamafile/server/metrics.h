@@ -0,0 +1,41 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <__fwd/string.h>
+
+namespace lf {
+namespace server {
+
+// request phases whose latency distribution we track
+enum
+{
+    METRIC_QUEUE, // waiting for Slots::take() to yield a slot
+    METRIC_PREFILL, // Slot::prefill() evaluating the prompt
+    METRIC_DECODE, // predicting one token (sample + eval)
+    METRIC_WRITE, // writing response bytes to the socket
+    METRIC_PHASES,
+};
+
+void
+metrics_observe(int, long);
+
+void
+metrics_render(std::string*);
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,242 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/macros.h"
+#include "llamafile/server/cleanup.h"
+#include "llamafile/server/log.h"
+#include <cerrno>
+#include <cosmo.h>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace lf {
+namespace server {
+
+// serves the model file for intra-cluster distribution
+//
+// clusters that point nodes at a peer instead of the artifact store
+// need the peer to serve its own multi-gigabyte llamafile the way a
+// file server would: ranges so an interrupted fetch resumes where it
+// stopped, a strong validator so resumption across a model swap
+// restarts instead of splicing two different files together, and
+// sendfile() so the bytes go disk to socket without a round trip
+// through userspace. disabled unless --modelfile is given, since not
+// every operator wants their weights to be one GET away
+
+// parses a single "bytes=lo-hi" range, returning false when the
+// header is unsatisfiable or not understood. multiple ranges aren't
+// supported; a downloader resuming a file wants exactly one
+static bool
+parse_range(std::string_view range, long size, long* out_lo, long* out_hi)
+{
+    if (!range.starts_with("bytes="))
+        return false;
+    range = range.substr(strlen("bytes="));
+    if (range.find(',') != std::string_view::npos)
+        return false;
+    size_t dash = range.find('-');
+    if (dash == std::string_view::npos)
+        return false;
+    std::string_view a = range.substr(0, dash);
+    std::string_view b = range.substr(dash + 1);
+    long lo;
+    long hi;
+    if (a.empty()) {
+        // suffix form: last N bytes
+        if (b.empty())
+            return false;
+        long n = 0;
+        for (char c : b) {
+            if (c < '0' || c > '9')
+                return false;
+            n = n * 10 + (c - '0');
+        }
+        if (!n)
+            return false;
+        lo = size > n ? size - n : 0;
+        hi = size - 1;
+    } else {
+        lo = 0;
+        for (char c : a) {
+            if (c < '0' || c > '9')
+                return false;
+            lo = lo * 10 + (c - '0');
+        }
+        if (b.empty()) {
+            hi = size - 1;
+        } else {
+            hi = 0;
+            for (char c : b) {
+                if (c < '0' || c > '9')
+                    return false;
+                hi = hi * 10 + (c - '0');
+            }
+            if (hi > size - 1)
+                hi = size - 1;
+        }
+    }
+    if (lo > hi || lo >= size)
+        return false;
+    *out_lo = lo;
+    *out_hi = hi;
+    return true;
+}
+
+bool
+Client::modelfile()
+{
+    if (!FLAG_modelfile)
+        return send_error(404);
+    if (msg_.method != kHttpGet && msg_.method != kHttpHead)
+        return send_error(405);
+
+    int fd = open(FLAG_model, O_RDONLY);
+    if (fd == -1) {
+        SLOG("%s: %s", strerror(errno), FLAG_model);
+        return send_error(500);
+    }
+    defer_cleanup(cleanup_fildes, (void*)(intptr_t)fd);
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        SLOG("%s: not a servable file", FLAG_model);
+        return send_error(500);
+    }
+
+    // strong validator from the file's identity on disk. a model
+    // swap changes it, which is what the conditional headers need
+    char etag[64];
+    snprintf(etag,
+             sizeof(etag),
+             "\"%lx-%lx-%lx\"",
+             (long)st.st_ino,
+             (long)st.st_size,
+             (long)st.st_mtim.tv_sec);
+
+    if (get_header("If-None-Match") == etag) {
+        char* p = obuf_.p;
+        char* headers = p;
+        p = append_http_response_message(p, 304);
+        p = stpcpy(p, "ETag: ");
+        p = stpcpy(p, etag);
+        p = stpcpy(p, "\r\n");
+        return send_response(headers, p, "");
+    }
+
+    // byte range, guarded by If-Range: a stale validator means our
+    // bytes aren't the peer's bytes anymore, so resumption restarts
+    // with the full entity rather than splicing two files together
+    long lo = 0;
+    long hi = st.st_size - 1;
+    bool partial = false;
+    std::string_view range = get_header("Range");
+    if (!range.empty()) {
+        std::string_view ifrange = get_header("If-Range");
+        if (ifrange.empty() || ifrange == etag) {
+            if (!parse_range(range, st.st_size, &lo, &hi)) {
+                char* p = obuf_.p;
+                char* headers = p;
+                p = append_http_response_message(p, 416);
+                p = stpcpy(p, "Content-Range: bytes */");
+                p = FormatInt64(p, st.st_size);
+                p = stpcpy(p, "\r\n");
+                return send_response(headers, p, "");
+            }
+            partial = true;
+        }
+    }
+
+    char* p = append_http_response_message(obuf_.p, partial ? 206 : 200);
+    p = stpcpy(p, "Content-Type: application/octet-stream\r\n");
+    p = stpcpy(p, "Accept-Ranges: bytes\r\n");
+    p = stpcpy(p, "ETag: ");
+    p = stpcpy(p, etag);
+    p = stpcpy(p, "\r\n");
+    if (partial) {
+        p = stpcpy(p, "Content-Range: bytes ");
+        p = FormatInt64(p, lo);
+        *p++ = '-';
+        p = FormatInt64(p, hi);
+        *p++ = '/';
+        p = FormatInt64(p, st.st_size);
+        p = stpcpy(p, "\r\n");
+    }
+    p = stpcpy(p, "Content-Length: ");
+    p = FormatInt64(p, hi - lo + 1);
+    p = stpcpy(p, "\r\n");
+    p = stpcpy(p, "\r\n");
+    should_send_error_if_canceled_ = false;
+    if (!send(std::string_view(obuf_.p, p - obuf_.p)))
+        return false;
+    if (msg_.method == kHttpHead)
+        return true;
+
+    // disk to socket without copying through userspace. kernels and
+    // transports that can't splice get a pread loop at the same
+    // offsets. the per connection rate cap keeps a fleet of resuming
+    // peers from starving the inference traffic this server is for
+    timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    off_t off = lo;
+    long remain = hi - lo + 1;
+    long streamed = 0;
+    while (remain) {
+        ssize_t rc;
+        size_t chunk = MIN(remain, 2097152);
+        if ((rc = sendfile(fd_, fd, &off, chunk)) <= 0) {
+            if (rc == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                char buf[65536];
+                if ((rc = pread(fd, buf, MIN(remain, 65536), off)) <= 0) {
+                    close_connection_ = true;
+                    return false;
+                }
+                if (!send_binary(buf, rc))
+                    return false;
+                off += rc;
+            } else {
+                if (rc == -1 && errno != EPIPE && errno != ECONNRESET)
+                    SLOG("sendfile failed %m");
+                close_connection_ = true;
+                return false;
+            }
+        }
+        remain -= rc;
+        streamed += rc;
+        if (FLAG_modelfile_rate > 0) {
+            double target =
+              streamed / (FLAG_modelfile_rate * 1048576.);
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            double actual =
+              timespec_tonanos(timespec_sub(now, started)) * 1e-9;
+            if (actual < target)
+                usleep(MIN((target - actual) * 1e6, 250000.));
+        }
+    }
+    if (FLAG_verbose >= 1)
+        SLOG("served %ld bytes of %s", streamed, FLAG_model);
+    return true;
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,346 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "models.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/macros.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/slots.h"
+#include "llamafile/server/tokencache.h"
+#include "llamafile/string.h"
+#include <cassert>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lf {
+namespace server {
+
+Models::Models()
+{
+    pthread_cond_init(&cond_, 0);
+    pthread_mutex_init(&lock_, 0);
+}
+
+Models::~Models()
+{
+    // drain warmer threads before tearing anything down they touch
+    pthread_mutex_lock(&lock_);
+    dying_ = true;
+    while (warmers_)
+        pthread_cond_wait(&cond_, &lock_);
+    pthread_mutex_unlock(&lock_);
+    for (auto& model : models_) {
+        if (model->pinned)
+            continue; // main() frees the startup model
+        delete model->slots;
+        if (model->model)
+            llama_free_model(model->model);
+    }
+    pthread_mutex_destroy(&lock_);
+    pthread_cond_destroy(&cond_);
+}
+
+// registers the startup model that main() already loaded. it stays
+// pinned hot forever, since main() owns its weights and slots.
+void
+Models::adopt(const char* path, llama_model* model, Slots* slots)
+{
+    auto entry = std::make_unique<Model>();
+    entry->name = stripext(basename(path));
+    entry->path = path;
+    entry->model = model;
+    entry->slots = slots;
+    entry->pinned = true;
+    entry->last_use = ++uses_;
+    models_.emplace_back(std::move(entry));
+}
+
+// registers an extra model without loading anything. it starts out
+// cold and gets promoted the first time a request names it. returns
+// false if the name is already taken.
+bool
+Models::add(const char* path)
+{
+    std::string name = stripext(basename(path));
+    for (auto& other : models_)
+        if (other->name == name)
+            return false;
+    auto entry = std::make_unique<Model>();
+    entry->name = std::move(name);
+    entry->path = path;
+    models_.emplace_back(std::move(entry));
+    return true;
+}
+
+// resolves the openai model field. unknown names (e.g. gpt-3.5-turbo)
+// have always been served by the startup model, so only exact matches
+// on a registered name or path switch a request to another model.
+Model*
+Models::find(const std::string& name)
+{
+    for (auto& model : models_)
+        if (name == model->name || name == model->path)
+            return model.get();
+    return models_[0].get();
+}
+
+// loads weights and creates contexts for a model. this runs outside
+// the registry lock since it can take the better part of a minute.
+// only the thread that set Model::loading may call this.
+static bool
+promote(Model* model)
+{
+    if (!model->model) {
+        llama_model_params mparams = {
+            .n_gpu_layers = FLAG_n_gpu_layers,
+            .split_mode = (enum llama_split_mode)FLAG_split_mode,
+            .main_gpu = FLAG_main_gpu,
+            .tensor_split = nullptr,
+            .rpc_servers = nullptr,
+            .progress_callback = nullptr,
+            .progress_callback_user_data = nullptr,
+            .kv_overrides = nullptr,
+            .vocab_only = false,
+            .use_mmap = true,
+            .use_mlock = false,
+            .check_tensors = false,
+        };
+        SLOG("loading %s", model->path.c_str());
+        model->model =
+          llama_load_model_from_file(model->path.c_str(), mparams);
+        if (!model->model) {
+            SLOG("%s: failed to load model", model->path.c_str());
+            return false;
+        }
+    }
+    if (!model->slots) {
+        Slots* slots = new Slots(model->model);
+        if (!slots->start(FLAG_slots)) {
+            SLOG("%s: failed to create slots", model->path.c_str());
+            delete slots;
+            return false; // model stays warm so a retry skips the load
+        }
+        model->slots = slots;
+    }
+    return true;
+}
+
+struct Warmer
+{
+    Models* models;
+    Model* model;
+};
+
+// faults a model's file into page cache from a background thread.
+// posix_fadvise issues the reads asynchronously through the kernel's
+// readahead path, and the pause between windows keeps this i/o from
+// competing with a hot model's own reads, standing in for the idle
+// i/o priority class that isn't portable. a promote() racing this is
+// fine, since both are just populating the same page cache
+static void*
+warm_worker(void* arg)
+{
+    Warmer* warmer = (Warmer*)arg;
+    Models* models = warmer->models;
+    Model* model = warmer->model;
+    int fd = open(model->path.c_str(), O_RDONLY);
+    if (fd != -1) {
+        struct stat st = {};
+        if (!fstat(fd, &st)) {
+            long window = 2 * 1024 * 1024;
+            for (long off = 0; off < st.st_size; off += window) {
+                if (models->dying_)
+                    break;
+                posix_fadvise(
+                  fd, off, MIN(window, st.st_size - off), POSIX_FADV_WILLNEED);
+                usleep(2000);
+            }
+        }
+        close(fd);
+    }
+    pthread_mutex_lock(&models->lock_);
+    model->warming = false;
+    --models->warmers_;
+    pthread_cond_broadcast(&models->cond_);
+    pthread_mutex_unlock(&models->lock_);
+    delete warmer;
+    return 0;
+}
+
+// starts background readahead of a model's file, so promoting it
+// later faults against warm page cache instead of cold disk. hot
+// models are already resident and loading ones are being read at
+// full speed, so both are left alone. caller must hold lock_
+void
+Models::warm_locked(Model* model)
+{
+    if (model->warming || model->loading || model->slots)
+        return;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 65536);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    Warmer* warmer = new Warmer{ this, model };
+    pthread_t th;
+    if (!pthread_create(&th, &attr, warm_worker, warmer)) {
+        model->warming = true;
+        ++warmers_;
+        SLOG("warming %s", model->name.c_str());
+    } else {
+        delete warmer;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+// hints that a model is about to receive traffic, e.g. from the
+// /warm endpoint when an external scheduler knows a switch is coming
+void
+Models::warm(Model* model)
+{
+    pthread_mutex_lock(&lock_);
+    warm_locked(model);
+    pthread_mutex_unlock(&lock_);
+}
+
+// records that a request for `model` arrived while `prev` was the
+// most recently acquired model
+static void
+bump_follower(Model* prev, Model* model)
+{
+    for (auto& f : prev->followers)
+        if (f.first == model) {
+            ++f.second;
+            return;
+        }
+    prev->followers.emplace_back(model, 1);
+}
+
+// returns the model that has most often been requested right after
+// this one, if the pattern is strong enough to bet readahead on: at
+// least two sightings and a majority of this model's follower votes
+static Model*
+successor(Model* model)
+{
+    Model* best = nullptr;
+    long votes = 0;
+    long total = 0;
+    for (auto& f : model->followers) {
+        total += f.second;
+        if (f.second > votes) {
+            votes = f.second;
+            best = f.first;
+        }
+    }
+    if (votes < 2 || votes * 2 <= total)
+        return nullptr;
+    return best;
+}
+
+// makes a model hot and holds a reference that keeps it that way
+// until release(). returns false if its weights couldn't be loaded.
+// models over budget are then demoted in least recently used order:
+// hot models lose their contexts first, and warm models after that
+// get unloaded, skipping any that are pinned, loading, or in use.
+bool
+Models::acquire(Model* model)
+{
+    pthread_mutex_lock(&lock_);
+    while (model->loading)
+        pthread_cond_wait(&cond_, &lock_);
+    if (!model->slots) {
+        model->loading = true;
+        pthread_mutex_unlock(&lock_);
+        bool ok = promote(model);
+        pthread_mutex_lock(&lock_);
+        model->loading = false;
+        pthread_cond_broadcast(&cond_);
+        if (!ok) {
+            pthread_mutex_unlock(&lock_);
+            return false;
+        }
+    }
+    ++model->refs;
+    model->last_use = ++uses_;
+    // arrivals for one model tend to foreshadow arrivals for another
+    // when a scheduler rotates traffic between them, so remember who
+    // followed whom and start reading the likely successor's weights
+    // off disk before the switch actually happens
+    if (last_ && last_ != model)
+        bump_follower(last_, model);
+    last_ = model;
+    if (Model* next = successor(model))
+        warm_locked(next);
+    std::vector<Slots*> doomed_slots;
+    std::vector<llama_model*> doomed_models;
+    for (;;) {
+        int hot = 0;
+        Model* victim = nullptr;
+        for (auto& other : models_)
+            if (other->slots) {
+                ++hot;
+                if (!other->pinned && !other->refs && !other->loading &&
+                    (!victim || other->last_use < victim->last_use))
+                    victim = other.get();
+            }
+        if (hot <= MAX(1, FLAG_hot_models) || !victim)
+            break;
+        doomed_slots.emplace_back(victim->slots);
+        victim->slots = nullptr;
+        SLOG("demoting %s to warm", victim->name.c_str());
+    }
+    for (;;) {
+        int warm = 0;
+        Model* victim = nullptr;
+        for (auto& other : models_)
+            if (other->model && !other->slots) {
+                ++warm;
+                if (!other->pinned && !other->refs && !other->loading &&
+                    (!victim || other->last_use < victim->last_use))
+                    victim = other.get();
+            }
+        if (warm <= MAX(0, FLAG_warm_models) || !victim)
+            break;
+        doomed_models.emplace_back(victim->model);
+        victim->model = nullptr;
+        SLOG("dropping %s from memory", victim->name.c_str());
+    }
+    pthread_mutex_unlock(&lock_);
+
+    // freeing contexts and weights can block, so it happens after
+    // the lock is dropped. nobody can reach these pointers anymore
+    for (Slots* slots : doomed_slots)
+        delete slots;
+    for (llama_model* weights : doomed_models) {
+        tokencache_invalidate(weights);
+        llama_free_model(weights);
+    }
+    return true;
+}
+
+void
+Models::release(Model* model)
+{
+    pthread_mutex_lock(&lock_);
+    unassert(model->refs > 0);
+    --model->refs;
+    pthread_mutex_unlock(&lock_);
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,79 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+struct llama_model;
+
+namespace lf {
+namespace server {
+
+struct Slots;
+
+// a model this process can serve, with tiered residency. hot models
+// have their weights loaded and a Slots pool with llama contexts.
+// warm models keep their weights mmap'd but give up their contexts,
+// which is where most of the anonymous memory goes. cold models are
+// unloaded entirely, so their weights fall back to the page cache.
+struct Model
+{
+    std::string name;
+    std::string path;
+    llama_model* model = nullptr; // null when cold
+    Slots* slots = nullptr; // null unless hot
+    bool pinned = false; // startup model is owned by main()
+    bool loading = false; // some thread is promoting this model
+    int refs = 0; // requests currently using this model
+    long last_use = 0;
+    bool warming = false; // a readahead thread is faulting this in
+
+    // how often each other model was the next one requested after
+    // this one; feeds the predictive readahead in acquire()
+    std::vector<std::pair<Model*, long>> followers;
+};
+
+// registry of models served from one process. requests select one
+// via the openai model field. FLAG_hot_models and FLAG_warm_models
+// bound how many may occupy each residency tier at the same time.
+struct Models
+{
+    pthread_cond_t cond_;
+    pthread_mutex_t lock_;
+    std::vector<std::unique_ptr<Model>> models_;
+    long uses_ = 0;
+    Model* last_ = nullptr; // most recently acquired model
+    int warmers_ = 0; // readahead threads in flight
+    std::atomic_bool dying_{ false }; // tells warmers to bail
+
+    Models();
+    ~Models();
+    void adopt(const char*, llama_model*, Slots*);
+    bool add(const char*);
+    Model* find(const std::string&);
+    bool acquire(Model*);
+    void release(Model*);
+    void warm(Model*);
+    void warm_locked(Model*);
+};
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,203 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parker.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/server.h"
+#include "llamafile/server/worker.h"
+#include <cerrno>
+#include <cosmo.h>
+#include <csignal>
+#include <poll.h>
+#include <unistd.h>
+
+namespace lf {
+namespace server {
+
+// workers blocked in accept(2) get poked with SIGUSR1 when a parked
+// connection becomes readable. the handler exists only so the signal
+// interrupts the syscall instead of killing the process, and it's
+// installed without SA_RESTART so accept() actually returns EINTR.
+static void
+on_unpark_signal(int sig)
+{
+}
+
+static void*
+parker_thread(void* arg)
+{
+    sigset_t mask;
+    sigfillset(&mask);
+    sigdelset(&mask, SIGSEGV);
+    sigdelset(&mask, SIGBUS);
+    sigdelset(&mask, SIGFPE);
+    sigdelset(&mask, SIGILL);
+    pthread_sigmask(SIG_SETMASK, &mask, 0);
+    set_thread_name("parker");
+    ((Parker*)arg)->run();
+    return nullptr;
+}
+
+Parker::Parker(Server* server) : server_(server)
+{
+    pthread_mutex_init(&lock_, 0);
+    if (pipe(wake_))
+        __builtin_trap();
+}
+
+Parker::~Parker()
+{
+    npassert(parked_.empty());
+    npassert(ready_.empty());
+    ::close(wake_[0]);
+    ::close(wake_[1]);
+    pthread_mutex_destroy(&lock_);
+}
+
+errno_t
+Parker::spawn()
+{
+    struct sigaction sa = {};
+    sa.sa_handler = on_unpark_signal;
+    sigaction(SIGUSR1, &sa, 0);
+    return pthread_create(&th_, 0, parker_thread, this);
+}
+
+void
+Parker::shutdown()
+{
+    pthread_mutex_lock(&lock_);
+    shutting_down_ = true;
+    for (const Conn& conn : parked_)
+        ::close(conn.fd);
+    for (const Conn& conn : ready_)
+        ::close(conn.fd);
+    parked_.clear();
+    ready_.clear();
+    pthread_mutex_unlock(&lock_);
+    poke();
+    if (th_)
+        pthread_join(th_, 0);
+}
+
+// takes custody of an idle keep-alive connection
+//
+// called by a worker whose client finished a transaction with no
+// pipelined bytes left over. the worker goes back to accept() and
+// the fd sits in our poll set until the next request shows up.
+void
+Parker::park(int fd, unsigned ip)
+{
+    pthread_mutex_lock(&lock_);
+    parked_.push_back({ fd, ip });
+    pthread_mutex_unlock(&lock_);
+    poke();
+}
+
+// hands out a parked connection that has bytes waiting
+//
+// returns its fd, or -1 if none are ready. workers check this before
+// blocking on the listening socket, so resumed connections and fresh
+// ones compete for the same pool.
+int
+Parker::unpark(unsigned* out_ip)
+{
+    int fd = -1;
+    pthread_mutex_lock(&lock_);
+    if (!ready_.empty()) {
+        fd = ready_.front().fd;
+        *out_ip = ready_.front().ip;
+        ready_.erase(ready_.begin());
+    }
+    pthread_mutex_unlock(&lock_);
+    return fd;
+}
+
+void
+Parker::poke()
+{
+    char b = 0;
+    write(wake_[1], &b, 1);
+}
+
+// pokes an idle worker out of accept() so it'll notice ready_
+//
+// the signal is lost if the worker hasn't entered accept() yet, so
+// run() re-pokes on every poll timeout while work remains queued.
+void
+Parker::wake_worker()
+{
+    server_->lock();
+    Dll* e;
+    if ((e = dll_first(server_->idle_workers)))
+        pthread_kill(WORKER(e)->th_, SIGUSR1);
+    server_->unlock();
+}
+
+void
+Parker::run()
+{
+    std::vector<Conn> polled;
+    std::vector<pollfd> fds;
+    for (;;) {
+        fds.clear();
+        polled.clear();
+        fds.push_back({ wake_[0], POLLIN, 0 });
+        pthread_mutex_lock(&lock_);
+        if (shutting_down_) {
+            pthread_mutex_unlock(&lock_);
+            break;
+        }
+        for (const Conn& conn : parked_) {
+            fds.push_back({ conn.fd, POLLIN, 0 });
+            polled.push_back(conn);
+        }
+        pthread_mutex_unlock(&lock_);
+        if (poll(fds.data(), fds.size(), 1000) == -1) {
+            if (errno != EINTR)
+                SLOG("poll returned %m");
+            continue;
+        }
+        if (fds[0].revents) {
+            char drain[512];
+            read(wake_[0], drain, sizeof(drain));
+        }
+        bool have_work;
+        pthread_mutex_lock(&lock_);
+        for (size_t i = 1; i < fds.size(); ++i) {
+            if (!fds[i].revents)
+                continue;
+            // any event gets dispatched to a worker, including
+            // hangups, so the client read path decides what eof
+            // or errors mean like it always has
+            for (auto it = parked_.begin(); it != parked_.end(); ++it) {
+                if (it->fd == polled[i - 1].fd) {
+                    parked_.erase(it);
+                    ready_.push_back(polled[i - 1]);
+                    break;
+                }
+            }
+        }
+        have_work = !ready_.empty();
+        pthread_mutex_unlock(&lock_);
+        if (have_work)
+            wake_worker();
+    }
+}
+
+} // namespace server
+} // namespace lf
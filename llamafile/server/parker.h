@@ -0,0 +1,64 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <pthread.h>
+#include <vector>
+
+namespace lf {
+namespace server {
+
+struct Server;
+
+// holds idle keep-alive connections between requests
+//
+// without this, every connection from a gateway that keeps sockets
+// open occupies a worker thread blocked in read() even while nothing
+// is happening on the wire. idle fds get parked here instead, where
+// one thread poll()s the lot of them, and a worker is only tied up
+// again once bytes actually arrive. active requests keep the thread
+// per request model they have today.
+struct Parker
+{
+    // a connection with no worker attached
+    struct Conn
+    {
+        int fd;
+        unsigned ip;
+    };
+
+    Server* server_; // borrowed
+    pthread_t th_ = 0;
+    pthread_mutex_t lock_;
+    int wake_[2] = { -1, -1 };
+    bool shutting_down_ = false;
+    std::vector<Conn> parked_; // fds waiting for bytes
+    std::vector<Conn> ready_; // fds with bytes awaiting a worker
+
+    explicit Parker(Server*);
+    ~Parker();
+    errno_t spawn();
+    void shutdown();
+    void run();
+    void park(int, unsigned);
+    int unpark(unsigned*);
+    void poke();
+    void wake_worker();
+};
+
+} // namespace server
+} // namespace lf
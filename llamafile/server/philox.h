@@ -0,0 +1,49 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstdint>
+
+namespace lf {
+namespace server {
+
+// counter based rng, after salmon et al's philox2x64
+//
+// unlike the mersenne twister the sampling layer keeps per sequence,
+// a counter based generator has no state at all: value n of stream k
+// is a pure function of (k, n), so any lane can compute any value of
+// its stream independently and reproducibly. the server uses it to
+// derive the seeds of parallel sampling streams, where handing out
+// adjacent integers would start the downstream twisters in nearly
+// identical states.
+inline uint64_t
+philox64(uint64_t key, uint64_t counter)
+{
+    uint64_t x0 = counter;
+    uint64_t x1 = 0;
+    for (int round = 0; round < 10; ++round) {
+        unsigned __int128 product =
+          (unsigned __int128)0xd2b74407b1ce6e93 * x0;
+        x0 = (uint64_t)(product >> 64) ^ key ^ x1;
+        x1 = (uint64_t)product;
+        key += 0x9e3779b97f4a7c15;
+    }
+    return x0;
+}
+
+} // namespace server
+} // namespace lf
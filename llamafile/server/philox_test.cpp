@@ -0,0 +1,77 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "philox.h"
+#include <cstdlib>
+#include <set>
+
+namespace lf {
+namespace server {
+namespace {
+
+void
+test_philox_deterministic()
+{
+    // same key and counter always produce the same value
+    for (uint64_t k = 0; k < 8; ++k)
+        for (uint64_t c = 0; c < 8; ++c)
+            if (philox64(k, c) != philox64(k, c))
+                exit(1);
+}
+
+void
+test_philox_streams_diverge()
+{
+    // a request's lane seeds must all differ: no collisions among
+    // nearby counters of one key, and none between nearby keys,
+    // which is what adjacent-integer seeding gets wrong
+    std::set<uint64_t> seen;
+    for (uint64_t k = 0; k < 64; ++k)
+        for (uint64_t c = 0; c < 64; ++c)
+            if (!seen.insert(philox64(k, c)).second)
+                exit(2);
+}
+
+void
+test_philox_bits_balanced()
+{
+    // each output bit should be set about half the time. a coarse
+    // sanity bound catches a broken round function without being a
+    // statistical test suite
+    int ones[64] = {};
+    int trials = 4096;
+    for (int i = 0; i < trials; ++i) {
+        uint64_t x = philox64(0x5eed, i);
+        for (int b = 0; b < 64; ++b)
+            ones[b] += x >> b & 1;
+    }
+    for (int b = 0; b < 64; ++b)
+        if (ones[b] < trials / 4 || ones[b] > trials - trials / 4)
+            exit(3);
+}
+
+} // namespace
+} // namespace server
+} // namespace lf
+
+int
+main()
+{
+    lf::server::test_philox_deterministic();
+    lf::server::test_philox_streams_diverge();
+    lf::server::test_philox_bits_balanced();
+}
@@ -0,0 +1,89 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pieces.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llama.h"
+#include "llamafile/server/snapshot.h"
+#include "llamafile/server/utils.h"
+#include <cassert>
+
+namespace lf {
+namespace server {
+
+// renders one token the way the completion handlers render sampled
+// tokens, i.e. without special token text, so control tokens come
+// out as empty strings and contribute nothing to the stream
+static void
+render_piece(const llama_model* model, int id, std::string* piece)
+{
+    char buf[128];
+    int n = llama_token_to_piece(
+      model, id, buf, sizeof(buf), 0, DONT_RENDER_SPECIAL_TOKENS);
+    if (n < 0) {
+        piece->resize(-n);
+        int check = llama_token_to_piece(
+          model, id, &(*piece)[0], piece->size(), 0,
+          DONT_RENDER_SPECIAL_TOKENS);
+        unassert(check == -n);
+    } else {
+        piece->assign(buf, n);
+    }
+}
+
+// the table is pure function of an unchanging vocab, which makes it
+// a perfect candidate for the snapshot file: later starts of the
+// same model map it back instead of walking the vocab metadata again
+Pieces::Pieces(const llama_model* model)
+{
+    if (snapshot_pieces_restore(model, this))
+        return;
+    build(model);
+    snapshot_pieces_save(model, this);
+}
+
+void
+Pieces::build(const llama_model* model)
+{
+    int n_vocab = llama_n_vocab(model);
+    offsets_.reserve(n_vocab + 1);
+    incomplete_.resize(n_vocab);
+    offsets_.push_back(0);
+    std::string piece;
+    for (int id = 0; id < n_vocab; ++id) {
+        render_piece(model, id, &piece);
+        bytes_ += piece;
+        offsets_.push_back(bytes_.size());
+        incomplete_[id] = ends_with_incomplete_utf8(piece);
+    }
+}
+
+// reports whether the table entry for `token` agrees with what the
+// model would render right now, which is how a restored snapshot
+// proves it belongs to this tokenizer rather than another model
+// that happens to share a vocab size
+bool
+Pieces::matches(const llama_model* model, int token) const
+{
+    std::string piece;
+    render_piece(model, token, &piece);
+    return piece == view(token) &&
+           incomplete_[token] == ends_with_incomplete_utf8(piece);
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,61 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct llama_model;
+
+namespace lf {
+namespace server {
+
+// per model detokenization table
+//
+// token pieces never change once a model is loaded, yet the streaming
+// output path used to call llama_token_to_piece() for every sampled
+// token, walking vocab metadata and allocating a fresh string each
+// time. this bakes every piece into one arena up front, along with
+// whether the piece ends inside a multibyte utf-8 sequence, which is
+// all the event flush logic needs to know, so detokenizing a token
+// becomes a table lookup
+struct Pieces
+{
+    explicit Pieces(const llama_model*);
+
+    void build(const llama_model*);
+    bool matches(const llama_model*, int token) const;
+
+    std::string_view view(int token) const
+    {
+        return std::string_view(bytes_.data() + offsets_[token],
+                                offsets_[token + 1] - offsets_[token]);
+    }
+
+    bool ends_incomplete(int token) const
+    {
+        return incomplete_[token];
+    }
+
+    std::string bytes_; // every piece back to back
+    std::vector<unsigned> offsets_; // n_vocab + 1 entries
+    std::vector<bool> incomplete_; // piece ends mid utf-8 sequence
+};
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,155 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "prefix_tree.h"
+#include "llamafile/server/slot.h"
+#include <algorithm>
+#include <cassert>
+
+namespace lf {
+namespace server {
+
+static void
+collect(const PrefixTree::Node* node, std::vector<Slot*>* slots)
+{
+    for (Slot* slot : node->slots_)
+        slots->emplace_back(slot);
+    for (const auto& child : node->children_)
+        collect(child.second, slots);
+}
+
+PrefixTree::Node::~Node()
+{
+    for (const auto& child : children_)
+        delete child.second;
+}
+
+void
+PrefixTree::insert(Slot* slot)
+{
+    Node* node = &root_;
+    const std::vector<Atom>& atoms = slot->history_;
+    size_t i = 0;
+    for (;;) {
+        if (i == atoms.size()) {
+            node->slots_.emplace_back(slot);
+            return;
+        }
+        auto it = node->children_.find(atoms[i]);
+        if (it == node->children_.end()) {
+            Node* child = new Node;
+            child->label_.assign(atoms.begin() + i, atoms.end());
+            child->slots_.emplace_back(slot);
+            node->children_[atoms[i]] = child;
+            return;
+        }
+        Node* child = it->second;
+        size_t j = 0;
+        while (j < child->label_.size() && i < atoms.size() &&
+               child->label_[j] == atoms[i]) {
+            ++j;
+            ++i;
+        }
+        if (j == child->label_.size()) {
+            node = child;
+            continue;
+        }
+        // atoms diverge in the middle of this edge so we
+        // split it into a parent holding the shared piece
+        Node* mid = new Node;
+        mid->label_.assign(child->label_.begin(), child->label_.begin() + j);
+        child->label_.erase(child->label_.begin(), child->label_.begin() + j);
+        mid->children_[child->label_[0]] = child;
+        it->second = mid;
+        node = mid;
+    }
+}
+
+void
+PrefixTree::remove(Slot* slot)
+{
+    Node* node = &root_;
+    const std::vector<Atom>& atoms = slot->history_;
+    size_t i = 0;
+    std::vector<std::pair<Node*, Atom>> path;
+    while (i < atoms.size()) {
+        auto it = node->children_.find(atoms[i]);
+        if (it == node->children_.end())
+            return;
+        Node* child = it->second;
+        if (child->label_.size() > atoms.size() - i)
+            return;
+        if (!std::equal(child->label_.begin(),
+                        child->label_.end(),
+                        atoms.begin() + i))
+            return;
+        path.emplace_back(node, atoms[i]);
+        i += child->label_.size();
+        node = child;
+    }
+    auto it = std::find(node->slots_.begin(), node->slots_.end(), slot);
+    if (it == node->slots_.end())
+        return;
+    node->slots_.erase(it);
+    while (node != &root_ && node->slots_.empty() &&
+           node->children_.empty()) {
+        Node* parent = path.back().first;
+        parent->children_.erase(path.back().second);
+        path.pop_back();
+        delete node;
+        node = parent;
+    }
+}
+
+// descends as deep as incoming atoms will go and gathers the
+// slots sharing the longest common prefix, along with the slots
+// parked at shallower nodes on the path whose shorter histories
+// might cost fewer discarded atoms. returns depth of the match.
+size_t
+PrefixTree::match(const std::vector<Atom>& atoms,
+                  std::vector<Slot*>* slots) const
+{
+    const Node* node = &root_;
+    size_t i = 0;
+    for (;;) {
+        for (Slot* slot : node->slots_)
+            slots->emplace_back(slot);
+        if (i == atoms.size())
+            break;
+        auto it = node->children_.find(atoms[i]);
+        if (it == node->children_.end())
+            break;
+        const Node* child = it->second;
+        size_t j = 0;
+        while (j < child->label_.size() && i < atoms.size() &&
+               child->label_[j] == atoms[i]) {
+            ++j;
+            ++i;
+        }
+        if (j < child->label_.size()) {
+            collect(child, slots);
+            return i;
+        }
+        node = child;
+    }
+    for (const auto& child : node->children_)
+        collect(child.second, slots);
+    return i;
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,52 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "atom.h"
+#include <map>
+#include <vector>
+
+namespace lf {
+namespace server {
+
+struct Slot;
+
+// compressed trie indexing free slots by their atom histories
+//
+// every free slot is keyed on its entire history so Slots::take() can
+// find slots sharing the longest common prefix with incoming atoms in
+// time proportional to the prefix length rather than having to scan
+// the history of every free slot
+struct PrefixTree
+{
+    struct Node
+    {
+        std::vector<Atom> label_;
+        std::map<Atom, Node*> children_;
+        std::vector<Slot*> slots_;
+        ~Node();
+    };
+
+    Node root_;
+
+    void insert(Slot*);
+    void remove(Slot*);
+    size_t match(const std::vector<Atom>&, std::vector<Slot*>*) const;
+};
+
+} // namespace server
+} // namespace lf
@@ -16,18 +16,32 @@
 // limitations under the License.
 
 #include "llama.cpp/llama.h"
+#include "llamafile/db.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/pool.h"
+#include "llamafile/server/assetcache.h"
+#include "llamafile/server/completioncache.h"
+#include "llamafile/server/eventlog.h"
+#include "llamafile/server/imagecache.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/memory.h"
+#include "llamafile/server/models.h"
+#include "llamafile/server/parker.h"
+#include "llamafile/server/recorder.h"
+#include "llamafile/server/rendercache.h"
+#include "llamafile/server/searchindex.h"
 #include "llamafile/server/server.h"
 #include "llamafile/server/signals.h"
 #include "llamafile/server/slots.h"
+#include "llamafile/server/supervisor.h"
 #include "llamafile/server/time.h"
 #include "llamafile/server/tokenbucket.h"
+#include "llamafile/server/tokencache.h"
 #include "llamafile/server/utils.h"
 #include "llamafile/version.h"
 #include <cassert>
 #include <cosmo.h>
+#include <cstdlib>
 
 namespace lf {
 namespace server {
@@ -60,8 +74,27 @@ main(int argc, char* argv[])
     llamafile_get_flags(argc, argv);
 
     // initialize subsystems
+    log_init();
     time_init();
+
+    // fork into a supervisor and a serving child, so a crash respawns
+    // the server against still-warm page cache instead of a cold load
+    supervise();
+
     tokenbucket_init();
+    db::init();
+
+    // record traffic for the replay harness
+    if (FLAG_record && !recorder_init(FLAG_record)) {
+        fprintf(stderr, "%s: failed to create recording\n", FLAG_record);
+        exit(1);
+    }
+
+    // log binary request events for the analytics pipeline
+    if (FLAG_eventlog && !eventlog_init(FLAG_eventlog)) {
+        fprintf(stderr, "%s: failed to create event log\n", FLAG_eventlog);
+        exit(1);
+    }
 
     // we must disable the llama.cpp logger
     // otherwise pthread_cancel() will cause deadlocks
@@ -83,27 +116,92 @@ main(int argc, char* argv[])
         .use_mlock = false,
         .check_tensors = false,
     };
+
+    // when layers are sharded across multiple gpus the backend
+    // proportions them by free vram unless the user says otherwise
+    float tensor_split[16] = {};
+    if (FLAG_tensor_split) {
+        const char* s = FLAG_tensor_split;
+        for (int j = 0; j < 16 && *s; ++j) {
+            tensor_split[j] = strtof(s, (char**)&s);
+            if (*s == ',')
+                ++s;
+        }
+        mparams.tensor_split = tensor_split;
+    }
+
     llama_model* model = llama_load_model_from_file(FLAG_model, mparams);
     if (!model) {
         fprintf(stderr, "%s: failed to load model\n", FLAG_model);
         exit(1);
     }
+    memory_count(MEM_MODEL, llama_model_size(model));
+
+    // load draft model for speculative decoding
+    llama_model* draft_model = nullptr;
+    if (FLAG_draft_model) {
+        draft_model = llama_load_model_from_file(FLAG_draft_model, mparams);
+        if (!draft_model) {
+            fprintf(stderr, "%s: failed to load draft model\n",
+                    FLAG_draft_model);
+            exit(1);
+        }
+        memory_count(MEM_MODEL, llama_model_size(draft_model));
+        if (llama_n_vocab(draft_model) != llama_n_vocab(model)) {
+            fprintf(stderr, "%s: draft model vocabulary doesn't match\n",
+                    FLAG_draft_model);
+            exit(1);
+        }
+    }
 
     // create slots
-    Slots* slots = new Slots(model);
+    Slots* slots = new Slots(model, draft_model);
     if (!slots->start(FLAG_slots)) {
         SLOG("no slots could be created");
         exit(1);
     }
 
+    // pre-fault weights and jit caches with a synthetic decode, so
+    // the first real request doesn't pay the cold start cost. this
+    // happens before the listening socket opens, keeping it out of
+    // the load balancer's health checks
+    slots->warmup();
+
+    // warm up slots from the previous run
+    if (FLAG_kv_snapshots)
+        slots->restore_snapshots();
+
+    // register models served under the openai model field. the
+    // startup model stays pinned hot; extras load on first use
+    Models* models = new Models;
+    models->adopt(FLAG_model, model, slots);
+    for (int i = 0; i < FLAG_extra_model_count; ++i)
+        if (!models->add(FLAG_extra_models[i])) {
+            fprintf(stderr, "%s: model name already registered\n",
+                    FLAG_extra_models[i]);
+            exit(1);
+        }
+
+    // embed stored chat messages in the background so /search works
+    searchindex_init(model);
+
     // create server
     if (FLAG_workers <= 0)
         FLAG_workers = __get_cpu_count() + 4;
     if (FLAG_workers <= 0)
         FLAG_workers = 16;
+
+    // --workers is a floor, not a wall: handler threads spend long
+    // generations blocked on the batcher, so the pool stretches up
+    // to this ceiling before anyone's stream gets dropped
+    if (FLAG_workers_max <= 0)
+        FLAG_workers_max = 1024;
+    if (FLAG_workers_max < FLAG_workers)
+        FLAG_workers_max = FLAG_workers;
     set_thread_name("server");
-    g_server =
-      new Server(create_listening_socket(FLAG_listen, 0, 0), slots, model);
+    g_server = new Server(
+      create_listening_socket(FLAG_listen, 0, 0), slots, model, models);
+    npassert(!g_server->parker_->spawn());
     for (int i = 0; i < FLAG_workers; ++i)
         npassert(!g_server->spawn());
 
@@ -119,10 +217,25 @@ main(int argc, char* argv[])
     g_server->shutdown();
     g_server->close();
     delete g_server;
+    if (FLAG_kv_snapshots)
+        slots->save_snapshots();
     delete slots;
+    delete models;
+    searchindex_destroy();
+    if (draft_model)
+        llama_free_model(draft_model);
     llama_free_model(model);
+    db::destroy();
+    recorder_destroy();
+    eventlog_destroy();
+    assetcache_destroy();
+    completioncache_destroy();
+    imagecache_destroy();
+    rendercache_destroy();
+    tokencache_destroy();
     tokenbucket_destroy();
     time_destroy();
+    log_destroy();
     SLOG("exit");
 
     // quality assurance
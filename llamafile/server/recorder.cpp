@@ -0,0 +1,115 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "recorder.h"
+#include "llamafile/server/log.h"
+#include <cosmo.h>
+#include <cstdio>
+#include <pthread.h>
+#include <string_view>
+#include <time.h>
+
+// production traffic recorder
+//
+// concurrency bugs like slot races and cache eviction pathologies
+// only reproduce under the arrival patterns that provoked them, so
+// --record captures what this server actually saw: when connections
+// arrived, every byte they sent, and when they hung up, all stamped
+// with a monotonic clock. the replay tool can then re-inject the
+// same traffic against a lab server with the original timing, or
+// faster, until the bug falls out.
+//
+// connections are identified by file descriptor, which is unique
+// between its connect and close events, so replay just mirrors the
+// bracketing. response bytes aren't recorded since replay discards
+// them; only arrival timing matters for scheduling bugs.
+//
+// worker threads handling requests are subject to pthread_cancel(),
+// so nothing that's a cancelation point may happen under the lock.
+
+namespace lf {
+namespace server {
+
+static FILE* g_file;
+static timespec g_started;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+bool
+recorder_init(const char* path)
+{
+    if (!(g_file = fopen(path, "wb")))
+        return false;
+    clock_gettime(CLOCK_MONOTONIC, &g_started);
+    RecorderHeader header = {};
+    header.magic = RECORDER_MAGIC;
+    header.version = RECORDER_VERSION;
+    fwrite(&header, sizeof(header), 1, g_file);
+    SLOG("recording traffic to %s", path);
+    return true;
+}
+
+static void
+recorder_event(uint32_t type, uint32_t conn, const std::string_view& data)
+{
+    if (!g_file)
+        return;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    RecorderEvent event = {};
+    event.type = type;
+    event.conn = conn;
+    event.nanos = timespec_tonanos(timespec_sub(now, g_started));
+    event.size = data.size();
+    pthread_mutex_lock(&g_lock);
+    fwrite(&event, sizeof(event), 1, g_file);
+    if (!data.empty())
+        fwrite(data.data(), 1, data.size(), g_file);
+    pthread_mutex_unlock(&g_lock);
+}
+
+void
+recorder_connect(int conn)
+{
+    recorder_event(RECORDER_CONNECT, conn, {});
+}
+
+void
+recorder_recv(int conn, const std::string_view& data)
+{
+    if (!data.empty())
+        recorder_event(RECORDER_RECV, conn, data);
+}
+
+void
+recorder_close(int conn)
+{
+    recorder_event(RECORDER_CLOSE, conn, {});
+}
+
+void
+recorder_destroy()
+{
+    pthread_mutex_lock(&g_lock);
+    if (g_file) {
+        fclose(g_file);
+        g_file = nullptr;
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+} // namespace server
+} // namespace lf
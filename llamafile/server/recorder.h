@@ -0,0 +1,70 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <__fwd/string_view.h>
+#include <cstdint>
+
+namespace lf {
+namespace server {
+
+// on disk format of a --record traffic log. a fixed header, then a
+// stream of events each followed by `size` bytes of raw data. every
+// field is little endian and the magic reads "LLREPLAY" in a hexdump
+#define RECORDER_MAGIC 0x59414c5045524c4c
+#define RECORDER_VERSION 1
+
+enum RecorderEventType
+{
+    RECORDER_CONNECT = 1, // client connection accepted
+    RECORDER_RECV = 2, // bytes received from client
+    RECORDER_CLOSE = 3, // client connection closed
+};
+
+struct RecorderHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t pad;
+};
+
+struct RecorderEvent
+{
+    uint32_t type;
+    uint32_t conn;
+    uint64_t nanos; // monotonic, from start of recording
+    uint32_t size; // bytes of data that follow
+    uint32_t pad;
+};
+
+bool
+recorder_init(const char*);
+
+void
+recorder_connect(int);
+
+void
+recorder_recv(int, const std::string_view&);
+
+void
+recorder_close(int);
+
+void
+recorder_destroy();
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,118 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/server/recorder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <unistd.h>
+
+namespace lf {
+namespace server {
+namespace {
+
+// writes a recording the way the server does and reads it back the
+// way the replay tool does, so the two can't drift apart silently
+void
+recorder_test()
+{
+    char path[] = "/tmp/recorder_test.XXXXXX";
+    int tmpfd = mkstemp(path);
+    if (tmpfd == -1)
+        exit(1);
+    close(tmpfd);
+
+    if (!recorder_init(path))
+        exit(1);
+    recorder_connect(4);
+    recorder_recv(4, "GET /tokenize HTTP/1.1\r\n\r\n");
+    recorder_recv(4, ""); // empty payloads aren't events
+    recorder_connect(5);
+    recorder_recv(5, std::string_view("\0\1\2", 3)); // binary safe
+    recorder_close(5);
+    recorder_close(4);
+    recorder_destroy();
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        exit(2);
+    RecorderHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1)
+        exit(2);
+    if (header.magic != RECORDER_MAGIC)
+        exit(2);
+    if (header.version != RECORDER_VERSION)
+        exit(2);
+
+    uint32_t want_type[] = { RECORDER_CONNECT, RECORDER_RECV,
+                             RECORDER_CONNECT, RECORDER_RECV,
+                             RECORDER_CLOSE,   RECORDER_CLOSE };
+    uint32_t want_conn[] = { 4, 4, 5, 5, 5, 4 };
+    uint32_t want_size[] = { 0, 26, 0, 3, 0, 0 };
+    uint64_t last_nanos = 0;
+    for (int i = 0; i < 6; ++i) {
+        RecorderEvent event;
+        if (fread(&event, sizeof(event), 1, file) != 1)
+            exit(3);
+        if (event.type != want_type[i])
+            exit(3);
+        if (event.conn != want_conn[i])
+            exit(3);
+        if (event.size != want_size[i])
+            exit(3);
+        if (event.nanos < last_nanos)
+            exit(3);
+        last_nanos = event.nanos;
+        char data[32];
+        if (event.size) {
+            if (fread(data, 1, event.size, file) != event.size)
+                exit(3);
+        }
+        if (i == 1 && memcmp(data, "GET /tokenize HTTP/1.1\r\n\r\n", 26))
+            exit(3);
+        if (i == 3 && memcmp(data, "\0\1\2", 3))
+            exit(3);
+    }
+    RecorderEvent event;
+    if (fread(&event, sizeof(event), 1, file) != 0)
+        exit(4);
+    fclose(file);
+    unlink(path);
+}
+
+// recording must be off by default, and events sent while it's off
+// must be swallowed rather than crash
+void
+recorder_off_test()
+{
+    recorder_connect(4);
+    recorder_recv(4, "hello");
+    recorder_close(4);
+    recorder_destroy();
+}
+
+} // namespace
+} // namespace server
+} // namespace lf
+
+int
+main()
+{
+    lf::server::recorder_off_test();
+    lf::server::recorder_test();
+}
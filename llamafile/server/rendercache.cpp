@@ -0,0 +1,140 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rendercache.h"
+#include "llamafile/server/atom.h"
+#include <cstring>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// incremental chat template render cache
+//
+// chat clients resend the entire conversation history on every turn,
+// which means v1_chat_completions() used to retokenize fifty messages
+// in order to discover one new one. this cache remembers the rendered
+// text and atoms of conversations it's seen, keyed by a rolling hash
+// over the message history, so the next turn can look up its longest
+// previously seen prefix and only tokenize what comes after it.
+//
+// a hit is only trusted after the cached text is confirmed to be a
+// byte prefix of the newly rendered prompt, and the caller only makes
+// entries that end flush with a control token, a boundary the
+// tokenizer's byte pair merges can't cross. a hash collision or an
+// edited history therefore can't change what a conversation tokenizes
+// to; it just falls back to tokenizing the whole prompt.
+//
+// worker threads handling requests are subject to pthread_cancel(),
+// so nothing that's a cancelation point may happen under the lock.
+
+#define MAX_ENTRIES 32
+
+namespace lf {
+namespace server {
+
+struct RenderCacheEntry
+{
+    uint64_t stamp;
+    std::string body;
+    std::vector<Atom> atoms;
+};
+
+static uint64_t g_stamp;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<uint64_t, RenderCacheEntry> g_entries;
+
+// folds a string into a rolling fnv1a hash
+uint64_t
+rendercache_hash(uint64_t h, const std::string& s)
+{
+    for (size_t i = 0; i < s.size(); ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3;
+    }
+    h ^= s.size();
+    h *= 0x100000001b3;
+    return h;
+}
+
+// finds atoms for longest previously rendered conversation prefix
+//
+// `keys` holds the rolling hash of each message history prefix, from
+// shortest to longest, and `prompt` is the full rendered template. on
+// a hit, the entry's atoms are appended to `result` and the number of
+// prompt bytes they cover is returned, so the caller need only
+// tokenize the rest. returns zero if no trustworthy entry exists.
+size_t
+rendercache_get(const std::vector<uint64_t>& keys,
+                const std::string& prompt,
+                std::vector<Atom>* result)
+{
+    size_t got = 0;
+    pthread_mutex_lock(&g_lock);
+    for (size_t i = keys.size(); i--;) {
+        auto e = g_entries.find(keys[i]);
+        if (e == g_entries.end())
+            continue;
+        RenderCacheEntry& entry = e->second;
+        if (entry.body.size() > prompt.size())
+            continue;
+        if (memcmp(entry.body.data(), prompt.data(), entry.body.size()))
+            continue;
+        entry.stamp = ++g_stamp;
+        result->insert(result->end(), entry.atoms.begin(), entry.atoms.end());
+        got = entry.body.size();
+        break;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return got;
+}
+
+// remembers rendered text and atoms of a conversation
+//
+// `body` must be the rendered template for the hashed messages and
+// `atoms` must be its exact tokenization, ending flush with a control
+// token and holding no bos or image atoms. the least recently used
+// entry is evicted once the cache is full.
+void
+rendercache_put(uint64_t key, std::string body, std::vector<Atom> atoms)
+{
+    pthread_mutex_lock(&g_lock);
+    RenderCacheEntry& entry = g_entries[key];
+    entry.stamp = ++g_stamp;
+    entry.body = std::move(body);
+    entry.atoms = std::move(atoms);
+    while (g_entries.size() > MAX_ENTRIES) {
+        auto oldest = g_entries.begin();
+        for (auto e = g_entries.begin(); e != g_entries.end(); ++e)
+            if (e->second.stamp < oldest->second.stamp)
+                oldest = e;
+        g_entries.erase(oldest);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void
+rendercache_destroy()
+{
+    pthread_mutex_lock(&g_lock);
+    std::map<uint64_t, RenderCacheEntry>().swap(g_entries);
+    pthread_mutex_unlock(&g_lock);
+}
+
+} // namespace server
+} // namespace lf
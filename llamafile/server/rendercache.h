@@ -0,0 +1,44 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <__fwd/string.h>
+#include <__fwd/vector.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace lf {
+namespace server {
+
+class Atom;
+
+uint64_t
+rendercache_hash(uint64_t, const std::string&);
+
+size_t
+rendercache_get(const std::vector<uint64_t>&,
+                const std::string&,
+                std::vector<Atom>*);
+
+void
+rendercache_put(uint64_t, std::string, std::vector<Atom>);
+
+void
+rendercache_destroy();
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,256 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "recorder.h"
+#include <arpa/inet.h>
+#include <cosmo.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// replays a --record traffic log against a server
+//
+//     make -j o//llamafile/server/replay
+//     o//llamafile/server/main -m model.gguf --record traffic.bin
+//     ... reproduce the interesting traffic ...
+//     o//llamafile/server/main -m model.gguf -l 127.0.0.1:8080
+//     o//llamafile/server/replay -x 10 traffic.bin
+//
+// every recorded connection is re-established against the target and
+// fed its original bytes with its original timing, so slot races and
+// eviction pathologies that only show up under production arrival
+// patterns can be provoked on a lab machine. the -x flag divides the
+// recorded gaps by a speedup factor, compressing an hour of traffic
+// into minutes, which usually makes races likelier, not less.
+//
+// responses are drained and discarded; correctness is checked by the
+// server's own logging and by whatever the bug being hunted does.
+
+namespace lf {
+namespace server {
+namespace {
+
+struct ReplayConn
+{
+    int fd;
+    bool dead;
+    pthread_t drainer;
+};
+
+const char* g_prog = "replay";
+const char* g_host = "127.0.0.1";
+int g_port = 8080;
+double g_speed = 1;
+
+void
+print_usage(FILE* f)
+{
+    fprintf(f, "usage: %s [-h HOST] [-p PORT] [-x SPEED] FILE\n", g_prog);
+}
+
+// discards whatever the server sends until the connection dies, so
+// kernel buffers can't fill up and stall the server's writes
+void*
+drain(void* arg)
+{
+    char buf[4096];
+    int fd = (intptr_t)arg;
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+    return nullptr;
+}
+
+int
+dial()
+{
+    int fd;
+    if ((fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+        perror("socket");
+        exit(1);
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    if (inet_pton(AF_INET, g_host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "%s: bad host (ipv4 address required)\n", g_host);
+        exit(1);
+    }
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        perror(g_host);
+        exit(1);
+    }
+    return fd;
+}
+
+int
+replay_main(int argc, char* argv[])
+{
+    g_prog = argv[0];
+    int opt;
+    while ((opt = getopt(argc, argv, "H:h:p:x:")) != -1) {
+        switch (opt) {
+            case 'H':
+            case 'h':
+                g_host = optarg;
+                break;
+            case 'p':
+                g_port = atoi(optarg);
+                break;
+            case 'x':
+                g_speed = atof(optarg);
+                if (!(g_speed > 0)) {
+                    fprintf(stderr, "-x SPEED must be greater than 0\n");
+                    return 1;
+                }
+                break;
+            default:
+                print_usage(stderr);
+                return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        print_usage(stderr);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[optind], "rb");
+    if (!file) {
+        perror(argv[optind]);
+        return 1;
+    }
+    RecorderHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != RECORDER_MAGIC ||
+        header.version != RECORDER_VERSION) {
+        fprintf(stderr, "%s: not a recording\n", argv[optind]);
+        return 1;
+    }
+
+    timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    std::map<uint32_t, ReplayConn> conns;
+    long connections = 0;
+    long requests = 0;
+    RecorderEvent event;
+    while (fread(&event, sizeof(event), 1, file) == 1) {
+
+        // the recorded gap from start of capture, compressed by the
+        // speedup factor, is how long after start of replay this
+        // event should fire
+        int64_t due = event.nanos / g_speed;
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t elapsed = timespec_tonanos(timespec_sub(now, started));
+        if (due > elapsed)
+            usleep((due - elapsed) / 1000);
+
+        char* data = nullptr;
+        if (event.size) {
+            data = (char*)malloc(event.size);
+            if (fread(data, 1, event.size, file) != event.size) {
+                fprintf(stderr, "%s: truncated recording\n", argv[optind]);
+                free(data);
+                break;
+            }
+        }
+
+        switch (event.type) {
+            case RECORDER_CONNECT: {
+                ReplayConn conn;
+                conn.fd = dial();
+                conn.dead = false;
+                pthread_create(
+                  &conn.drainer, 0, drain, (void*)(intptr_t)conn.fd);
+                conns[event.conn] = conn;
+                ++connections;
+                break;
+            }
+            case RECORDER_RECV: {
+                auto it = conns.find(event.conn);
+                if (it != conns.end() && !it->second.dead) {
+                    const char* p = data;
+                    size_t left = event.size;
+                    while (left) {
+                        ssize_t sent = write(it->second.fd, p, left);
+                        if (sent <= 0) {
+                            // server hung up early; keep replaying the
+                            // other connections on schedule
+                            it->second.dead = true;
+                            break;
+                        }
+                        p += sent;
+                        left -= sent;
+                    }
+                    ++requests;
+                }
+                break;
+            }
+            case RECORDER_CLOSE: {
+                auto it = conns.find(event.conn);
+                if (it != conns.end()) {
+                    // shutdown first so the drainer's blocked read
+                    // wakes up and the thread can be joined
+                    shutdown(it->second.fd, SHUT_RDWR);
+                    pthread_join(it->second.drainer, 0);
+                    close(it->second.fd);
+                    conns.erase(it);
+                }
+                break;
+            }
+            default:
+                fprintf(stderr, "%s: corrupt recording\n", argv[optind]);
+                free(data);
+                fclose(file);
+                return 1;
+        }
+        free(data);
+    }
+    fclose(file);
+
+    // recordings cut off by server shutdown can leave connections
+    // without close events
+    for (auto& [id, conn] : conns) {
+        shutdown(conn.fd, SHUT_RDWR);
+        pthread_join(conn.drainer, 0);
+        close(conn.fd);
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(stderr,
+            "replayed %ld messages over %ld connections in %.3f seconds\n",
+            requests,
+            connections,
+            timespec_tonanos(timespec_sub(now, started)) * 1e-9);
+    return 0;
+}
+
+} // namespace
+} // namespace server
+} // namespace lf
+
+int
+main(int argc, char* argv[])
+{
+    return lf::server::replay_main(argc, argv);
+}
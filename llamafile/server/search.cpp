@@ -0,0 +1,136 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "embedding.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/db.h"
+#include "llamafile/json.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/macros.h"
+#include "llamafile/server/utils.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// semantic search endpoint over the conversation database
+//
+// /search?q=...&limit=N embeds the query through the same shared
+// decode path that /embedding uses, then ranks stored messages by
+// cosine similarity against the vectors the background indexer
+// maintains. both sides are normalized, so scores land in [-1, 1].
+// messages the indexer hasn't reached yet simply don't match, and it
+// runs within seconds of a write, so the window is small.
+
+namespace lf {
+namespace server {
+
+static int64_t
+atoi(std::string_view s)
+{
+    int64_t n = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9')
+            return -1;
+        n *= 10;
+        n += c - '0';
+    }
+    return n;
+}
+
+bool
+Client::search()
+{
+    if (msg_.method != kHttpGet && msg_.method != kHttpPost)
+        return send_error(405);
+
+    if (!read_payload())
+        return false;
+
+    // the query rides the request-uri or a json body, like /embedding
+    int64_t limit = 10;
+    std::string query;
+    if (std::optional<std::string_view> q = param("q")) {
+        query = *q;
+    } else if (HasHeader(kHttpContentType) &&
+               IsMimeType(HeaderData(kHttpContentType),
+                          HeaderLength(kHttpContentType),
+                          "application/json")) {
+        auto [status, json] = jt::Json::parse(payload_);
+        if (status != jt::Json::success)
+            return send_error(400, jt::Json::StatusToString(status));
+        if (!json.isObject())
+            return send_error(400, "JSON body must be an object");
+        if (json["query"].isString())
+            query = std::move(json["query"].getString());
+        else if (json["q"].isString())
+            query = std::move(json["q"].getString());
+        if (json["limit"].isLong())
+            limit = json["limit"].getLong();
+    }
+    if (std::optional<std::string_view> v = param("limit"))
+        limit = atoi(*v);
+    if (query.empty())
+        return send_error(400, "missing search query");
+    if (limit <= 0 || limit > 100)
+        return send_error(400, "limit must be between 1 and 100");
+    if (!is_valid_utf8(query))
+        return send_error(400, "query must be valid UTF-8");
+
+    // embed the query
+    std::vector<std::vector<int>> toks_list(1);
+    std::vector<int> toks(query.size() + 16);
+    int n = llama_tokenize(model_,
+                           query.data(),
+                           query.size(),
+                           &toks[0],
+                           toks.size(),
+                           true,
+                           false);
+    if (n <= 0)
+        return send_error(400, "query didn't tokenize");
+    toks.resize(MIN(n, llama_n_ctx_train(model_)));
+    toks_list[0] = std::move(toks);
+    std::vector<std::vector<float>> embeddings(1);
+    if (!embed_inputs(model_, toks_list, embeddings))
+        return send_error(500, "embedding failed");
+
+    // rank the stored messages. a database that was never created
+    // means nothing was ever stored, which is an empty result, not
+    // an error, and not a reason to create the file now
+    jt::Json result;
+    result.setObject();
+    result["results"].setArray();
+    if (db::exists()) {
+        if (sqlite3* db = db::open()) {
+            result["results"] = db::search_embeddings(db,
+                                                      FLAG_model,
+                                                      embeddings[0].data(),
+                                                      embeddings[0].size(),
+                                                      limit);
+            db::close(db);
+        }
+    }
+    dump_ = result.toStringPretty();
+    dump_ += '\n';
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+} // namespace server
+} // namespace lf
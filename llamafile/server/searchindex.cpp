@@ -0,0 +1,174 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "searchindex.h"
+#include "llama.cpp/cores.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/db.h"
+#include "llamafile/json.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/macros.h"
+#include "llamafile/server/embedding.h"
+#include <cosmo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+
+// background semantic indexer for the conversation database
+//
+// stored chat messages get embedded so /search can rank them, but
+// that work has no caller waiting on it, so it happens here at the
+// lowest possible priority: banished to efficiency cores like the
+// database writer, a small batch at a time, riding the same shared
+// decode path that /embedding clients use and the async writer for
+// its inserts. messages embed newest first, so a fresh conversation
+// becomes searchable within seconds of being stored while a deep
+// backlog catches up quietly.
+
+#define INDEX_INTERVAL_MS 5000
+#define INDEX_BATCH 32
+
+namespace lf {
+namespace server {
+
+static pthread_t g_indexer;
+static bool g_indexer_running;
+static bool g_indexer_quitting;
+static pthread_mutex_t g_indexer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_indexer_cond = PTHREAD_COND_INITIALIZER;
+static llama_model* g_indexer_model;
+
+// embeds one batch of unindexed messages. returns how many messages
+// got a vector, or -1 if the decode failed and the caller should
+// back off rather than spin against a model that can't embed
+static int
+index_batch()
+{
+    // never cause the database file to exist; an installation that
+    // stored no chats has nothing to index
+    if (!db::exists())
+        return 0;
+    sqlite3* db = db::open();
+    if (!db)
+        return 0;
+    jt::Json batch = db::get_unembedded_messages(db, FLAG_model, INDEX_BATCH);
+    db::close(db);
+    if (!batch.isArray() || batch.getArray().empty())
+        return 0;
+    int n_ctx_train = llama_n_ctx_train(g_indexer_model);
+    std::vector<int64_t> ids;
+    std::vector<std::vector<int>> toks_list;
+    for (jt::Json& msg : batch.getArray()) {
+        if (!msg["id"].isLong() || !msg["content"].isString())
+            continue;
+        std::string& content = msg["content"].getString();
+        std::vector<int> toks(content.size() + 16);
+        int n = llama_tokenize(g_indexer_model,
+                               content.data(),
+                               content.size(),
+                               &toks[0],
+                               toks.size(),
+                               true,
+                               false);
+        if (n <= 0) {
+            // an empty vector marks the message done without ever
+            // matching a query, so it can't come back forever
+            db::set_embedding_async(msg["id"].getLong(), FLAG_model, "");
+            continue;
+        }
+        toks.resize(MIN(n, n_ctx_train));
+        ids.push_back(msg["id"].getLong());
+        toks_list.emplace_back(std::move(toks));
+    }
+    if (ids.empty())
+        return batch.getArray().size();
+    std::vector<std::vector<float>> outs(toks_list.size());
+    if (!embed_inputs(g_indexer_model, toks_list, outs))
+        return -1;
+    for (size_t i = 0; i < ids.size(); ++i)
+        db::set_embedding_async(
+          ids[i],
+          FLAG_model,
+          std::string((const char*)outs[i].data(),
+                      outs[i].size() * sizeof(float)));
+    return batch.getArray().size();
+}
+
+static void*
+indexer_thread(void* arg)
+{
+    sigset_t mask;
+    sigfillset(&mask);
+    sigdelset(&mask, SIGSEGV);
+    sigdelset(&mask, SIGBUS);
+    sigdelset(&mask, SIGFPE);
+    sigdelset(&mask, SIGILL);
+    pthread_sigmask(SIG_SETMASK, &mask, 0);
+    pthread_setname_np(pthread_self(), "searchindex");
+    if (!FLAG_ecores) {
+        cpu_set_t ecores;
+        if (cpu_get_efficiency_affinity(&ecores) > 0)
+            pthread_setaffinity_np(pthread_self(), sizeof(ecores), &ecores);
+    }
+    long wait_ms = INDEX_INTERVAL_MS;
+    pthread_mutex_lock(&g_indexer_lock);
+    while (!g_indexer_quitting) {
+        timespec deadline =
+          timespec_add(timespec_real(), timespec_frommillis(wait_ms));
+        pthread_cond_timedwait(&g_indexer_cond, &g_indexer_lock, &deadline);
+        if (g_indexer_quitting)
+            break;
+        pthread_mutex_unlock(&g_indexer_lock);
+        int n = index_batch();
+        if (n == -1)
+            // the model can't embed right now, or can't embed at
+            // all; retreat exponentially so this never becomes a
+            // five second heartbeat of failed decodes
+            wait_ms = MIN(wait_ms * 2, 600000);
+        else if (n == INDEX_BATCH)
+            wait_ms = 0; // there's a backlog; keep draining
+        else
+            wait_ms = INDEX_INTERVAL_MS;
+        pthread_mutex_lock(&g_indexer_lock);
+    }
+    pthread_mutex_unlock(&g_indexer_lock);
+    return nullptr;
+}
+
+void
+searchindex_init(llama_model* model)
+{
+    g_indexer_model = model;
+    g_indexer_running = !pthread_create(&g_indexer, 0, indexer_thread, 0);
+}
+
+void
+searchindex_destroy()
+{
+    if (!g_indexer_running)
+        return;
+    pthread_mutex_lock(&g_indexer_lock);
+    g_indexer_quitting = true;
+    pthread_cond_signal(&g_indexer_cond);
+    pthread_mutex_unlock(&g_indexer_lock);
+    pthread_join(g_indexer, 0);
+    g_indexer_running = false;
+}
+
+} // namespace server
+} // namespace lf
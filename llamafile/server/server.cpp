@@ -16,9 +16,12 @@
 // limitations under the License.
 
 #include "server.h"
+#include "llamafile/chaos.h"
 #include "llamafile/crash.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/parker.h"
+#include "llamafile/server/recorder.h"
 #include "llamafile/server/server.h"
 #include "llamafile/server/slots.h"
 #include "llamafile/server/worker.h"
@@ -33,14 +36,16 @@
 namespace lf {
 namespace server {
 
-Server::Server(int fd, Slots* slots, llama_model* model)
-  : fd(fd), slots_(slots), model_(model)
+Server::Server(int fd, Slots* slots, llama_model* model, Models* models)
+  : fd(fd), slots_(slots), model_(model), models_(models)
 {
+    parker_ = new Parker(this);
 }
 
 Server::~Server()
 {
     npassert(fd == -1);
+    delete parker_;
     npassert(!worker_count.load(std::memory_order_relaxed));
     npassert(dll_is_empty(active_workers));
     npassert(dll_is_empty(idle_workers));
@@ -119,7 +124,7 @@ int
 Server::accept(unsigned* out_ip)
 {
     // accept connection
-    sockaddr_in clientaddr;
+    sockaddr_storage clientaddr;
     set_thread_name("listen");
     uint32_t clientsize = sizeof(clientaddr);
     int clifd = ::accept(fd, (sockaddr*)&clientaddr, &clientsize);
@@ -128,8 +133,18 @@ Server::accept(unsigned* out_ip)
 
     // set name
     char name[17];
-    int port = ntohs(clientaddr.sin_port);
-    unsigned ip = ntohl(clientaddr.sin_addr.s_addr);
+    int port;
+    unsigned ip;
+    if (clientaddr.ss_family == AF_INET) {
+        sockaddr_in* in = (sockaddr_in*)&clientaddr;
+        port = ntohs(in->sin_port);
+        ip = ntohl(in->sin_addr.s_addr);
+    } else {
+        // unix domain clients are same-host by definition, so they
+        // get loopback's trust and rate limiting treatment
+        port = 0;
+        ip = 0x7f000001;
+    }
     if (ip == 0x7f000001) {
         snprintf(name, sizeof(name), "%hu", port);
     } else {
@@ -155,6 +170,7 @@ Server::accept(unsigned* out_ip)
 
     if (FLAG_verbose >= 2)
         SLOG("accept");
+    recorder_connect(clifd);
     if (out_ip)
         *out_ip = ip;
     return clifd;
@@ -185,6 +201,7 @@ Server::shutdown()
         close();
 
     // kill workers
+    LLAMAFILE_CHAOS_POINT("server_shutdown");
     lock();
     for (Dll* e = dll_first(idle_workers); e; e = dll_next(idle_workers, e))
         WORKER(e)->kill();
@@ -199,6 +216,9 @@ Server::shutdown()
             wait();
         unlock();
     }
+
+    // close connections parked between keep-alive requests
+    parker_->shutdown();
 }
 
 } // namespace server
@@ -25,11 +25,13 @@ struct llama_model;
 namespace lf {
 namespace server {
 
+struct Models;
+struct Parker;
 struct Slots;
 
 struct Server
 {
-    Server(int, Slots*, llama_model*);
+    Server(int, Slots*, llama_model*, Models* = nullptr);
     ~Server();
 
     int accept(unsigned*);
@@ -46,6 +48,8 @@ struct Server
     int fd;
     Slots* slots_;
     llama_model* model_;
+    Models* models_; // borrowed or null
+    Parker* parker_; // owned
     Dll* idle_workers = nullptr;
     Dll* active_workers = nullptr;
     pthread_cond_t cond_ = PTHREAD_COND_INITIALIZER;
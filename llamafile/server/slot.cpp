@@ -22,42 +22,32 @@
 #include "llamafile/llama.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/macros.h"
+#include "llamafile/pool.h"
 #include "llamafile/server/atom.h"
+#include "llamafile/server/atomstream.h"
+#include "llamafile/server/batcher.h"
+#include "llamafile/server/deadline.h"
+#include "llamafile/server/eventlog.h"
 #include "llamafile/server/image.h"
+#include "llamafile/server/imagecache.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/metrics.h"
 #include "llamafile/server/utils.h"
+#include "llamafile/trace.h"
 #include "llamafile/vector.h"
 #include "llamafile/version.h"
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cosmo.h>
+#include <cstdint>
+
+// seconds for a slot's prefix hit rate to decay by 1/e
+#define HIT_DECAY 300
 
 namespace lf {
 namespace server {
 
-static int
-choose_ctx_size(llama_model* model)
-{
-    int n_ctx_train = llama_n_ctx_train(model);
-    if (FLAG_ctx_size <= 0 || FLAG_ctx_size > n_ctx_train)
-        return n_ctx_train;
-    return FLAG_ctx_size;
-}
-
-static std::string
-generate_system_fingerprint(const llama_context_params* cparams)
-{
-    uint64_t h = 0;
-    h ^= __fnv(LLAMAFILE_VERSION_STRING, sizeof(LLAMAFILE_VERSION_STRING));
-    h ^= __fnv(cparams, sizeof(*cparams));
-    std::string b = "fp_";
-    for (int j = 0; j < 64 / 5; ++j) {
-        b += "abcdefghijklmnopqrstuvwxyz012345"[h & 31];
-        h >>= 5;
-    }
-    return b;
-}
-
 const char*
 Slot::describe_error(int err)
 {
@@ -74,6 +64,8 @@ Slot::describe_error(int err)
             return "decode_image_failed";
         case encode_image_failed:
             return "encode_image_failed";
+        case canceled:
+            return "canceled";
         default:
             return "bad_error_code";
     }
@@ -87,54 +79,195 @@ Slot::Slot(int id, llama_model* model) : id_(id), model_(model)
 
 Slot::~Slot()
 {
-    if (ctx_)
-        llama_free(ctx_);
+    if (draft_ctx_)
+        llama_free(draft_ctx_);
     if (clip_ctx_)
         clip_free(clip_ctx_);
 }
 
 bool
-Slot::start()
+Slot::start(llama_context* ctx,
+            Batcher* batcher,
+            int ctx_size,
+            const std::string& system_fingerprint)
 {
     unassert(!ctx_);
-    llama_context_params cparams = {};
-    cparams.embeddings = false;
-    cparams.embeddings_only = false;
-    cparams.logits_all = false;
-    cparams.seed = 12345;
-    cparams.n_ctx = choose_ctx_size(model_);
-    cparams.n_batch = FLAG_batch;
-    cparams.n_ubatch = FLAG_ubatch;
-    cparams.n_seq_max = 1;
-    cparams.n_threads = MIN(FLAG_threads, 20);
-    cparams.n_threads_batch = FLAG_threads;
-    cparams.rope_scaling_type = LLAMA_ROPE_SCALING_TYPE_UNSPECIFIED;
-    cparams.pooling_type = LLAMA_POOLING_TYPE_UNSPECIFIED;
-    cparams.attention_type = LLAMA_ATTENTION_TYPE_UNSPECIFIED;
-    cparams.rope_freq_base = 0;
-    cparams.yarn_ext_factor = -1;
-    cparams.yarn_attn_factor = 1;
-    cparams.yarn_beta_fast = 32;
-    cparams.yarn_beta_slow = 1;
-    cparams.yarn_orig_ctx = 0;
-    cparams.defrag_thold = -1;
-    cparams.offload_kqv = true;
-    cparams.type_k = GGML_TYPE_F16;
-    cparams.type_v = GGML_TYPE_F16;
-    cparams.flash_attn = FLAG_flash_attn;
-    system_fingerprint_ = generate_system_fingerprint(&cparams);
-    if (!(ctx_ = llama_new_context_with_model(model_, cparams)))
-        return false;
+    ctx_ = ctx;
+    batcher_ = batcher;
+    ctx_size_ = ctx_size;
+    system_fingerprint_ = system_fingerprint;
     if (FLAG_mmproj)
         if (!(clip_ctx_ = clip_model_load(FLAG_mmproj, FLAG_verbose)))
             return false;
+    if (draft_model_) {
+        llama_context_params dparams = {};
+        dparams.seed = 12345;
+        dparams.n_ctx = ctx_size_;
+        dparams.n_batch = FLAG_batch;
+        dparams.n_ubatch = FLAG_ubatch;
+        dparams.n_seq_max = 1;
+        dparams.n_threads = MIN(FLAG_threads, 20);
+        dparams.n_threads_batch = FLAG_threads;
+        dparams.rope_scaling_type = LLAMA_ROPE_SCALING_TYPE_UNSPECIFIED;
+        dparams.pooling_type = LLAMA_POOLING_TYPE_UNSPECIFIED;
+        dparams.attention_type = LLAMA_ATTENTION_TYPE_UNSPECIFIED;
+        dparams.rope_freq_base = 0;
+        dparams.yarn_ext_factor = -1;
+        dparams.yarn_attn_factor = 1;
+        dparams.yarn_beta_fast = 32;
+        dparams.yarn_beta_slow = 1;
+        dparams.defrag_thold = -1;
+        dparams.offload_kqv = true;
+        dparams.type_k = GGML_TYPE_F16;
+        dparams.type_v = GGML_TYPE_F16;
+        dparams.flash_attn = FLAG_flash_attn;
+        if (!(draft_ctx_ =
+                llama_new_context_with_model(draft_model_, dparams)))
+            SLOG("slot #%d couldn't create draft context", id_);
+    }
     return true;
 }
 
 int
 Slot::ctx_size() const
 {
-    return llama_n_ctx(ctx_);
+    return ctx_size_;
+}
+
+int
+Slot::sample(llama_sampling_context* sampler,
+             bool apply_grammar,
+             TokenProb* probs,
+             int n_probs)
+{
+    sampler_ = sampler;
+    apply_grammar_ = apply_grammar;
+    if (!speculated_.empty()) {
+        int id = speculated_.front();
+        speculated_.erase(speculated_.begin());
+        return id;
+    }
+    return batcher_->sample(id_, sampler, apply_grammar, probs, n_probs);
+}
+
+bool
+Slot::can_speculate() const
+{
+    return draft_ctx_ && !draft_dirty_ && !logprobs_ && sampler_ &&
+           FLAG_draft_tokens > 0;
+}
+
+// mirrors tokens the main model evaluated onto the draft context,
+// skipping whatever the draft already decoded while speculating
+void
+Slot::draft_eval(const int* tokens, int count, int pos)
+{
+    if (!draft_ctx_ || draft_dirty_)
+        return;
+    while (count && pos < draft_used_) {
+        ++tokens;
+        ++pos;
+        --count;
+    }
+    if (!count)
+        return;
+    if (pos != draft_used_) {
+        draft_dirty_ = true;
+        return;
+    }
+    std::vector<int> toks(tokens, tokens + count);
+    if (llama_decode(draft_ctx_,
+                     { .n_tokens = count,
+                       .token = toks.data(),
+                       .all_pos_0 = pos,
+                       .all_pos_1 = 1 })) {
+        draft_dirty_ = true;
+        return;
+    }
+    draft_used_ += count;
+}
+
+// discards verified-but-unclaimed draft tokens, e.g. because the
+// client stopped generating or forced an eot mid stream
+void
+Slot::flush_speculation()
+{
+    if (speculated_.empty() && predecoded_.empty())
+        return;
+    if (!predecoded_.empty()) {
+        batcher_->kv_cache_seq_rm(id_, ctx_used(), -1);
+        if (draft_ctx_ && !draft_dirty_) {
+            llama_kv_cache_seq_rm(draft_ctx_, 0, ctx_used(), -1);
+            draft_used_ = MIN(draft_used_, ctx_used());
+        }
+    }
+    speculated_.clear();
+    predecoded_.clear();
+}
+
+// guesses FLAG_draft_tokens continuations with the draft model then
+// has the batcher verify the whole guess in one llama_decode. on a
+// memory bandwidth bound model this trades a little compute for up
+// to FLAG_draft_tokens tokens per forward pass.
+int
+Slot::speculate_token(int token)
+{
+    int used = ctx_used();
+    int n_draft = FLAG_draft_tokens;
+    if (used + 1 + n_draft > ctx_size())
+        return eval_tokens({ token });
+    if (draft_used_ != used || llama_token_is_eog(model_, token))
+        return eval_tokens({ token });
+
+    // let the draft model guess what comes next
+    std::vector<int> tokens;
+    tokens.reserve(1 + n_draft);
+    tokens.emplace_back(token);
+    int n_vocab = llama_n_vocab(draft_model_);
+    for (int i = 0; i < n_draft; ++i) {
+        int tok = tokens.back();
+        if (llama_decode(draft_ctx_,
+                         { .n_tokens = 1,
+                           .token = &tok,
+                           .all_pos_0 = used + i,
+                           .all_pos_1 = 1 })) {
+            draft_dirty_ = true;
+            return eval_tokens({ token });
+        }
+        const float* logits = llama_get_logits(draft_ctx_);
+        int best = 0;
+        for (int j = 1; j < n_vocab; ++j)
+            if (logits[j] > logits[best])
+                best = j;
+        tokens.emplace_back(best);
+    }
+    draft_used_ = used + n_draft;
+
+    // verify the guess with the main model
+    std::vector<int> sampled(tokens.size());
+    int emitted = batcher_->speculate(id_,
+                                      tokens.data(),
+                                      tokens.size(),
+                                      used,
+                                      sampler_,
+                                      apply_grammar_,
+                                      sampled.data(),
+                                      adapter_,
+                                      adapter_scale_);
+    if (emitted < 0) {
+        llama_kv_cache_seq_rm(draft_ctx_, 0, used, -1);
+        draft_used_ = used;
+        return decode_token_failed;
+    }
+    int accepted = emitted - 1;
+    history_.emplace_back(token);
+    history_digest_ = atom_digest(history_digest_, history_.back());
+    llama_kv_cache_seq_rm(draft_ctx_, 0, used + 1 + accepted, -1);
+    draft_used_ = MIN(draft_used_, used + 1 + accepted);
+    for (int i = 0; i < accepted; ++i)
+        predecoded_.emplace_back(tokens[1 + i]);
+    speculated_.assign(sampled.begin(), sampled.begin() + emitted);
+    return 1;
 }
 
 int
@@ -146,16 +279,61 @@ Slot::ctx_used() const
     return tokens;
 }
 
+// records that take() reused this slot's cached prefix. hits decay
+// exponentially with a five minute time constant, so the rate tracks
+// recent traffic rather than lifetime popularity
+void
+Slot::record_hit(time_t now)
+{
+    hit_rate_ = hit_rate(now) + 1;
+    hit_rated_ = now;
+}
+
+// returns decayed hit count as of `now`
+double
+Slot::hit_rate(time_t now) const
+{
+    if (!hit_rate_)
+        return 0;
+    return hit_rate_ * exp((hit_rated_ - now) / (double)HIT_DECAY);
+}
+
+// returns how expensive this slot's kv cache would be to throw away:
+// the tokens that would need prefilling again, weighted by how often
+// the prefix actually gets reused. the plus one means cold caches
+// still compete on their size
+double
+Slot::cache_value(time_t now) const
+{
+    return count_tokens(history_) * (1 + hit_rate(now));
+}
+
 int
 Slot::eval_token(int token)
 {
+    if (!predecoded_.empty()) {
+        if (token == predecoded_.front()) {
+            // speculative verification already decoded this token
+            predecoded_.erase(predecoded_.begin());
+            history_.emplace_back(token);
+            history_digest_ = atom_digest(history_digest_, history_.back());
+            return 1;
+        }
+        flush_speculation();
+    } else if (!speculated_.empty()) {
+        flush_speculation();
+    }
+    if (can_speculate())
+        return speculate_token(token);
     return eval_tokens({ token });
 }
 
 int
 Slot::eval_tokens(const std::vector<int>& tokens,
-                  const ProgressCallback& progress)
+                  const ProgressCallback& progress,
+                  bool wants_logits)
 {
+    LLAMAFILE_TRACE("eval_tokens", "slot");
     if (!ctx_)
         return uninitialized;
     if (tokens.empty())
@@ -166,39 +344,76 @@ Slot::eval_tokens(const std::vector<int>& tokens,
         return out_of_context;
     std::vector<int> toks(tokens);
     int processed = 0;
-    for (int i = 0; i < N; i += FLAG_batch) {
+    // the governor tunes this span size from decode rate feedback,
+    // so setups with partial gpu offload find their balance point
+    // rather than stalling on a hand-picked flag value
+    int chunk = batcher_->chunk();
+    for (int i = 0; i < N; i += chunk) {
+        // a request past its deadline stops evaluating between
+        // ubatches, the granularity at which history and kv stay
+        // consistent, so the slot frees with a reusable prefix
+        if (deadline_expired())
+            return canceled;
         int n_eval = N - i;
-        if (n_eval > FLAG_batch)
-            n_eval = FLAG_batch;
-        if (llama_decode(ctx_,
-                         { .n_tokens = n_eval,
-                           .token = &toks[i],
-                           .all_pos_0 = used,
-                           .all_pos_1 = 1 }))
+        if (n_eval > chunk)
+            n_eval = chunk;
+        if (batcher_->decode_tokens(id_, &toks[i], n_eval, used,
+                                    wants_logits && i + n_eval == N, adapter_,
+                                    adapter_scale_) < 0)
             return decode_token_failed;
-        for (int j = 0; j < n_eval; ++j)
+        draft_eval(&toks[i], n_eval, used);
+        // the chunk goes into history before the progress callback
+        // runs, so a request that cancels here (or a thread canceled
+        // inside the callback's send) leaves history_ matching the kv
+        // cache and a retry resumes from the evaluated prefix
+        for (int j = 0; j < n_eval; ++j) {
             history_.emplace_back(toks[i + j]);
+            history_digest_ = atom_digest(history_digest_, history_.back());
+        }
         used += n_eval;
         processed += n_eval;
-        if (progress)
-            progress(processed, N);
+        if (progress && !progress(processed, N))
+            return canceled;
     }
     return N;
 }
 
+// encodes an image with clip, reusing an earlier embedding when the
+// same bytes were seen before, since multi-turn vision chats resend
+// identical images every turn
+static llava_image_embed*
+encode_image(clip_ctx* clip, const std::string_view& bytes)
+{
+    llava_image_embed* embed;
+    if ((embed = imagecache_get(bytes)))
+        return embed;
+    embed = llava_image_embed_make_with_bytes(
+      clip, FLAG_threads_batch, (const unsigned char*)bytes.data(),
+      bytes.size());
+    if (embed)
+        imagecache_put(bytes, embed, clip_n_mmproj_embd(clip));
+    return embed;
+}
+
 int
 Slot::eval_image(const std::string_view& bytes,
-                 const ProgressCallback& progress)
+                 const ProgressCallback& progress,
+                 bool wants_logits)
 {
     if (!ctx_)
         return uninitialized;
     if (!clip_ctx_)
         return no_vision_model;
-    llava_image_embed* image_embed =
-      llava_image_embed_make_with_bytes(clip_ctx_,
-                                        FLAG_threads_batch,
-                                        (const unsigned char*)bytes.data(),
-                                        bytes.size());
+    return eval_embed(
+      bytes, encode_image(clip_ctx_, bytes), progress, wants_logits);
+}
+
+int
+Slot::eval_embed(const std::string_view& bytes,
+                 llava_image_embed* image_embed,
+                 const ProgressCallback& progress,
+                 bool wants_logits)
+{
     if (!image_embed)
         return encode_image_failed;
     int used = ctx_used();
@@ -209,128 +424,236 @@ Slot::eval_image(const std::string_view& bytes,
     }
     int processed = 0;
     int n_embd = llama_n_embd(llama_get_model(ctx_));
-    for (int i = 0; i < N; i += FLAG_batch) {
+    int chunk = batcher_->chunk();
+    for (int i = 0; i < N; i += chunk) {
         int n_eval = N - i;
-        if (n_eval > FLAG_batch)
-            n_eval = FLAG_batch;
-        if (llama_decode(ctx_,
-                         { .n_tokens = n_eval,
-                           .embd = image_embed->embed + i * n_embd,
-                           .all_pos_0 = used,
-                           .all_pos_1 = 1 })) {
+        if (n_eval > chunk)
+            n_eval = chunk;
+        if (batcher_->decode_embd(id_,
+                                  image_embed->embed + i * n_embd,
+                                  n_eval,
+                                  used,
+                                  wants_logits && i + n_eval == N,
+                                  adapter_,
+                                  adapter_scale_) < 0) {
             llava_image_embed_free(image_embed);
             return decode_image_failed;
         }
         used += n_eval;
         processed += n_eval;
-        if (progress)
-            progress(processed, N);
+        if (progress && !progress(processed, N)) {
+            llava_image_embed_free(image_embed);
+            return canceled;
+        }
     }
     llava_image_embed_free(image_embed);
     history_.emplace_back(new Image(bytes, N));
+    history_digest_ = atom_digest(history_digest_, history_.back());
+    draft_dirty_ = true; // draft model can't see images
     return N;
 }
 
+namespace {
+
+// encodes image atoms using clip. the encode runs on a pool thread,
+// one image at a time since clip_ctx isn't thread safe, which lets
+// the worker keep the batcher busy with text tokens while the next
+// image's embedding is computed. embeds may also be parked here for
+// later pickup, which the progress path in eval_atoms() relies on.
+// unclaimed embeds are reclaimed on destruction, e.g. when a text
+// segment halfway through the atom sequence fails to decode.
+class ImageEncoder
+{
+  public:
+    explicit ImageEncoder(clip_ctx* clip) : clip_(clip)
+    {
+    }
+
+    ~ImageEncoder()
+    {
+        while (has_work())
+            if (llava_image_embed* embed = take())
+                llava_image_embed_free(embed);
+    }
+
+    bool
+    has_work() const
+    {
+        return busy_ || next_ < ready_.size();
+    }
+
+    void
+    park(llava_image_embed* embed)
+    {
+        ready_.emplace_back(embed);
+    }
+
+    void
+    start(const std::string_view& bytes)
+    {
+        unassert(!busy_);
+        bytes_ = bytes;
+        busy_ = !llamafile_task_create(&task_, encode, this);
+    }
+
+    llava_image_embed*
+    take()
+    {
+        if (next_ < ready_.size())
+            return ready_[next_++];
+        if (busy_) {
+            busy_ = false;
+            void* res;
+            if (llamafile_task_join(task_, &res))
+                return nullptr;
+            return (llava_image_embed*)res;
+        }
+        // start() couldn't spawn a task, so encode synchronously
+        return (llava_image_embed*)encode(this);
+    }
+
+  private:
+    static void*
+    encode(void* arg)
+    {
+        ImageEncoder* self = (ImageEncoder*)arg;
+        return encode_image(self->clip_, self->bytes_);
+    }
+
+    clip_ctx* clip_;
+    llamafile_task_t task_;
+    std::string_view bytes_;
+    std::vector<llava_image_embed*> ready_;
+    size_t next_ = 0;
+    bool busy_ = false;
+};
+
+} // namespace
+
 int
 Slot::eval_atoms(const std::vector<Atom>& atoms,
-                 const ProgressCallback& progress)
+                 const ProgressCallback& progress,
+                 bool wants_logits)
 {
+    std::vector<const Image*> images;
+    for (const Atom& atom : atoms)
+        if (atom.is_image()) {
+            if (!clip_ctx_)
+                return no_vision_model;
+            images.emplace_back(&atom.image());
+        }
+    ImageEncoder encoder(clip_ctx_);
+    size_t next_image = 0;
     int total_work = 0;
     if (progress) {
-        for (const Atom& atom : atoms) {
-            if (atom.is_token()) {
-                total_work += 1;
-            } else if (atom.is_image()) {
-                if (!clip_ctx_)
-                    return no_vision_model;
-                llava_image_embed* image_embed =
-                  llava_image_embed_make_with_bytes(
-                    clip_ctx_,
-                    FLAG_threads_batch,
-                    (const unsigned char*)atom.image().bytes().data(),
-                    atom.image().bytes().size());
-                if (image_embed) {
-                    total_work += image_embed->n_image_pos;
-                    llava_image_embed_free(image_embed);
-                }
-            }
+        // progress totals must be exact, so when the client wants
+        // updates, every image gets encoded before evaluation can
+        // start. the embeds are parked for reuse below, whereas they
+        // used to be thrown away and computed again by eval_image()
+        for (const Image* image : images) {
+            llava_image_embed* embed =
+              encode_image(clip_ctx_, image->bytes());
+            if (embed)
+                total_work += embed->n_image_pos;
+            encoder.park(embed);
         }
-        if (total_work > FLAG_batch)
-            progress(0, total_work);
+        for (const Atom& atom : atoms)
+            if (atom.is_token())
+                total_work += 1;
+        if (total_work > FLAG_ubatch)
+            if (!progress(0, total_work))
+                return canceled;
+    } else if (!images.empty()) {
+        // otherwise the first image can be encoded in the background
+        // while the text tokens preceding it are being decoded
+        encoder.start(images[next_image]->bytes());
     }
     int processed = 0;
     auto wrap_progress = [&](int curr, int subtotal) {
         if (progress)
-            progress(processed + curr, total_work);
+            return progress(processed + curr, total_work);
+        return true;
     };
+    // only the decode that ends the prefill needs lm_head output, so
+    // the logits of earlier text runs and images are never requested,
+    // rather than computed and thrown away
+    size_t last_atom = SIZE_MAX;
+    if (wants_logits)
+        for (size_t i = atoms.size(); i--;)
+            if (atoms[i].is_token() || atoms[i].is_image()) {
+                last_atom = i;
+                break;
+            }
     int rc;
     int token_count = 0;
     std::vector<int> tokens;
-    for (const Atom& atom : atoms) {
+    for (size_t i = 0; i < atoms.size(); ++i) {
+        const Atom& atom = atoms[i];
         if (atom.is_token()) {
             tokens.emplace_back(atom.token());
         } else if (atom.is_image()) {
-            if ((rc = eval_tokens(tokens, wrap_progress)) < 0)
+            if ((rc = eval_tokens(tokens, wrap_progress, false)) < 0)
                 return rc;
             token_count += rc;
             processed += rc;
             tokens.clear();
-            if ((rc = eval_image(atom.image().bytes(), wrap_progress)) < 0)
+            llava_image_embed* embed = encoder.take();
+            if (++next_image < images.size() && !encoder.has_work())
+                encoder.start(images[next_image]->bytes());
+            if ((rc = eval_embed(atom.image().bytes(), embed, //
+                                 wrap_progress, i == last_atom)) < 0)
                 return rc;
             token_count += rc;
             processed += rc;
         }
     }
-    if ((rc = eval_tokens(tokens, wrap_progress)) < 0)
+    if ((rc = eval_tokens(tokens, wrap_progress, wants_logits)) < 0)
         return rc;
     token_count += rc;
     return token_count;
 }
 
+// reconciles atoms against the slot's history, discarding and
+// relocating kv cells so only genuinely new content gets evaluated.
+// returns how many leading atoms evaluation should skip. complete is
+// false when the atom vector is still growing under a tokenization
+// stream, in which case the caller guarantees enough of a prefix is
+// present for this analysis to reach the same conclusions it would
+// on the finished vector.
+//
+// when a prefill request comes in, chances are the system prompt
+// will already be loaded and the unique user request in atoms is
+// going to have something different that follows. in such a case
+// we'll rapidly delete the latter portion from the KV cache, and
+// then we won't need the cost of prefilling the earlier portion.
+//
+//     "hello world how are you" <-- atoms
+//     "hello world i love you!" <-- history
+//     "hello world "            <-- keep
+//                 "how are you" <-- evaluated
+//
+// when context runs out the completions interface or user client
+// might delete content in the middle, in which case we can shift
+// content backwards based on the matching suffix.
+//
+//     "sysprompt msg2 msg3 msg4" <-- atoms
+//      └──┬────┘ └──────┬┘
+//         │             │
+//      ┌──┴────┐      ┌─┴─────┐
+//     "sysprompt msg1 msg2 msg3" <-- history
+//     "sysprompt "               <-- keep
+//               "msg1 "          <-- discard
+//                    "msg2 msg3" <-- relocate
+//     "sysprompt      msg2 msg3" <-- llama_kv_cache_seq_rm
+//     "sysprompt msg2 msg3"      <-- llama_kv_cache_seq_add
+//                         "msg4" <-- evaluated
+//
 int
-Slot::prefill(const std::vector<Atom>& atoms, const ProgressCallback& progress)
+Slot::prepare_prefill(const std::vector<Atom>& atoms,
+                      bool complete,
+                      PrefillStats* stats)
 {
-    if (!ctx_)
-        return uninitialized;
-
-    // handle special case of empty prefill
-    if (atoms.empty()) {
-        llama_kv_cache_clear(ctx_);
-        history_.clear();
-        return 0;
-    }
-
-    // when a prefill request comes in, chances are the system prompt
-    // will already be loaded and the unique user request in atoms is
-    // going to have something different that follows. in such a case
-    // we'll rapidly delete the latter portion from the KV cache, and
-    // then we won't need the cost of prefilling the earlier portion.
-    //
-    //     "hello world how are you" <-- atoms
-    //     "hello world i love you!" <-- history
-    //     "hello world "            <-- keep
-    //                 "how are you" <-- evaluated
-    //
-    // when context runs out the completions interface or user client
-    // might delete content in the middle, in which case we can shift
-    // content backwards based on the matching suffix.
-    //
-    //     "sysprompt msg2 msg3 msg4" <-- atoms
-    //      └──┬────┘ └──────┬┘
-    //         │             │
-    //      ┌──┴────┐      ┌─┴─────┐
-    //     "sysprompt msg1 msg2 msg3" <-- history
-    //     "sysprompt "               <-- keep
-    //               "msg1 "          <-- discard
-    //                    "msg2 msg3" <-- relocate
-    //     "sysprompt      msg2 msg3" <-- llama_kv_cache_seq_rm
-    //     "sysprompt msg2 msg3"      <-- llama_kv_cache_seq_add
-    //                         "msg4" <-- evaluated
-    //
-    int keep = 0;
-    int n = std::min(atoms.size(), history_.size());
-    for (int i = 0; i < n && atoms[i] == history_[i]; ++i)
-        ++keep;
+    int keep = atoms_common_prefix(atoms, history_);
     int relocate_p0 = -1;
     int relocate_p1 = -1;
     int skipped = keep;
@@ -349,7 +672,9 @@ Slot::prefill(const std::vector<Atom>& atoms, const ProgressCallback& progress)
 
     // xxx: ensure we eval at least one token
     //      this prevents an observed badness
-    if (skipped == atoms.size()) {
+    //      an incomplete stream has new atoms on the way, so there's
+    //      always something left to evaluate
+    if (complete && skipped == atoms.size()) {
         if (relocate_p0 != -1) {
             --relocate_p1;
         } else {
@@ -380,10 +705,32 @@ Slot::prefill(const std::vector<Atom>& atoms, const ProgressCallback& progress)
     // discard tokens from kv cache
     int discarded_tokens;
     int relocated_tokens = 0;
-    if (llama_kv_cache_seq_rm(ctx_, 0, keep_tokens, relocate_p0_tokens)) {
+    if (batcher_->kv_cache_seq_rm(id_, keep_tokens, relocate_p0_tokens)) {
+        if (draft_ctx_ && !draft_dirty_) {
+            // draft kv tracks the same positions as the main kv
+            if (llama_kv_cache_seq_rm(
+                  draft_ctx_, 0, keep_tokens, relocate_p0_tokens)) {
+                if (relocate_p0 != -1)
+                    llama_kv_cache_seq_add(
+                      draft_ctx_,
+                      0,
+                      relocate_p0_tokens,
+                      relocate_p1_tokens,
+                      -(relocate_p0_tokens - keep_tokens));
+                draft_used_ = keep_tokens;
+                if (relocate_p0 != -1)
+                    draft_used_ += relocate_p1_tokens - relocate_p0_tokens;
+            } else {
+                llama_kv_cache_seq_rm(draft_ctx_, 0, -1, -1);
+                draft_used_ = 0;
+                draft_dirty_ = true;
+            }
+        }
         if (relocate_p0 == -1) {
             discarded_tokens = history_tokens - keep_tokens;
             history_.resize(keep);
+            history_digest_ =
+              atoms_digest(0, history_.data(), history_.size());
         } else {
             discarded_tokens = (history_tokens - relocate_p1_tokens) +
                                (relocate_p0_tokens - keep_tokens);
@@ -391,38 +738,288 @@ Slot::prefill(const std::vector<Atom>& atoms, const ProgressCallback& progress)
             history_.resize(relocate_p1);
             history_.erase(history_.begin() + keep,
                            history_.begin() + relocate_p0);
+            history_digest_ =
+              atoms_digest(0, history_.data(), history_.size());
             // memmove relocated tokens in kv cache
-            llama_kv_cache_seq_add(ctx_,
-                                   0,
-                                   relocate_p0_tokens,
-                                   relocate_p1_tokens,
-                                   -(relocate_p0_tokens - keep_tokens));
+            batcher_->kv_cache_seq_add(id_,
+                                       relocate_p0_tokens,
+                                       relocate_p1_tokens,
+                                       -(relocate_p0_tokens - keep_tokens));
         }
     } else {
         // models like Mamba can't be partially erased
         SLOG("failed to remove tokens from KV cache");
         discarded_tokens = history_tokens;
-        llama_kv_cache_clear(ctx_);
+        batcher_->kv_cache_seq_rm(id_, -1, -1);
         history_.clear();
+        history_digest_ = 0;
         skipped = 0;
+        if (draft_ctx_) {
+            llama_kv_cache_seq_rm(draft_ctx_, 0, -1, -1);
+            draft_used_ = 0;
+            draft_dirty_ = false;
+        }
     }
 
+    stats->keep_tokens = keep_tokens;
+    stats->discarded_tokens = discarded_tokens;
+    stats->relocated_tokens = relocated_tokens;
+    return skipped;
+}
+
+int
+Slot::prefill(const std::vector<Atom>& atoms, const ProgressCallback& progress)
+{
+    LLAMAFILE_TRACE("prefill", "slot");
+    if (!ctx_)
+        return uninitialized;
+
+    // drop any leftover speculative state from the last request
+    flush_speculation();
+
+    // handle special case of empty prefill
+    if (atoms.empty()) {
+        batcher_->kv_cache_seq_rm(id_, -1, -1);
+        history_.clear();
+        history_digest_ = 0;
+        if (draft_ctx_) {
+            llama_kv_cache_seq_rm(draft_ctx_, 0, -1, -1);
+            draft_used_ = 0;
+            draft_dirty_ = false;
+        }
+        return 0;
+    }
+
+    state_ = state_prefilling;
+    PrefillStats stats;
+    int skipped = prepare_prefill(atoms, true, &stats);
+
     // evaluate tokens
+    timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
     std::vector<Atom> new_atoms(atoms.begin() + skipped, atoms.end());
     int rc;
     if ((rc = eval_atoms(new_atoms, progress)) < 0)
         return rc;
-    int total_tokens = keep_tokens + relocated_tokens + rc;
+    state_ = state_generating;
+    timespec ended;
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+    metrics_observe(METRIC_PREFILL,
+                    timespec_tonanos(timespec_sub(ended, started)));
+    int total_tokens = stats.keep_tokens + stats.relocated_tokens + rc;
+    eventlog_tokens(total_tokens);
     SLOG("prefilled %d tokens (after keeping %d, discarding %d, "
          "relocating %d, and evaluating %d)",
          total_tokens,
-         keep_tokens,
-         discarded_tokens,
-         relocated_tokens,
+         stats.keep_tokens,
+         stats.discarded_tokens,
+         stats.relocated_tokens,
          count_tokens(new_atoms));
     return total_tokens;
 }
 
+// prefills from a tokenization stream, so the first ubatches hit the
+// batcher while pool threads are still turning the rest of a big
+// document into tokens, hiding nearly all tokenization latency for
+// ingestion requests behind prefill compute
+int
+Slot::prefill(AtomStream& stream, const ProgressCallback& progress)
+{
+    LLAMAFILE_TRACE("prefill", "slot");
+    if (!ctx_)
+        return uninitialized;
+
+    // the keep/relocate analysis compares atoms against history, so
+    // enough of them have to be on hand for it to reach the verdicts
+    // it would reach on the finished vector. exact progress totals
+    // need the whole document tokenized up front, the same bargain
+    // eval_atoms() strikes for image encoding
+    while (!stream.done() &&
+           stream.atoms().size() < 2 * history_.size() + 1)
+        stream.pump();
+    if (progress || stream.done()) {
+        stream.drain();
+        return prefill(stream.atoms(), progress);
+    }
+
+    flush_speculation();
+    state_ = state_prefilling;
+    PrefillStats stats;
+    int skipped = prepare_prefill(stream.atoms(), false, &stats);
+
+    // evaluate tokens chunk by chunk as the tokenizer delivers them
+    timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    int rc;
+    int evaluated = 0;
+    size_t next = skipped;
+    do {
+        std::vector<Atom> chunk(stream.atoms().begin() + next,
+                                stream.atoms().end());
+        next = stream.atoms().size();
+        // pump() returns false exactly when the stream was already
+        // done here, so the chunk that ends the prefill is the only
+        // one whose logits get computed
+        if ((rc = eval_atoms(chunk, nullptr, stream.done())) < 0)
+            return rc;
+        evaluated += rc;
+    } while (stream.pump());
+    state_ = state_generating;
+    timespec ended;
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+    metrics_observe(METRIC_PREFILL,
+                    timespec_tonanos(timespec_sub(ended, started)));
+    int total_tokens = stats.keep_tokens + stats.relocated_tokens + evaluated;
+    eventlog_tokens(total_tokens);
+    SLOG("prefilled %d tokens (after keeping %d, discarding %d, "
+         "relocating %d, and evaluating %d)",
+         total_tokens,
+         stats.keep_tokens,
+         stats.discarded_tokens,
+         stats.relocated_tokens,
+         evaluated);
+    return total_tokens;
+}
+
+// frees up room in the context window so generation can continue,
+// by discarding the oldest half of the conversation from kv cache.
+// the leading bos token survives, since the model was trained to
+// attend from one, and everything after the hole shifts backwards
+// so positions stay dense. history_ is trimmed the same way, which
+// keeps it consistent with the cache, so the next prefill can still
+// reuse the shifted prefix. returns the number of tokens discarded,
+// or zero when nothing further can be evicted
+int
+Slot::shift_context()
+{
+    if (!ctx_)
+        return uninitialized;
+    flush_speculation();
+
+    // choose atoms to discard. we count whole atoms, rather than
+    // tokens, so an image embedding never gets chopped in half
+    int keep = llama_should_add_bos_token(model_);
+    int n = history_.size();
+    if (n - keep < 2)
+        return 0;
+    int discard = keep + (n - keep) / 2;
+    int keep_tokens = 0;
+    for (int i = 0; i < keep; ++i)
+        keep_tokens += history_[i].ctx_used();
+    int discard_tokens = 0;
+    for (int i = keep; i < discard; ++i)
+        discard_tokens += history_[i].ctx_used();
+    if (!discard_tokens)
+        return 0;
+
+    // models like Mamba can't be partially erased
+    int used = ctx_used();
+    if (!batcher_->kv_cache_seq_rm(
+          id_, keep_tokens, keep_tokens + discard_tokens))
+        return 0;
+    batcher_->kv_cache_seq_add(
+      id_, keep_tokens + discard_tokens, used, -discard_tokens);
+
+    // the draft kv no longer mirrors the main kv; nuke it so the
+    // next speculation round rebuilds from the shifted history
+    if (draft_ctx_) {
+        llama_kv_cache_seq_rm(draft_ctx_, 0, -1, -1);
+        draft_used_ = 0;
+        draft_dirty_ = false;
+    }
+
+    history_.erase(history_.begin() + keep, history_.begin() + discard);
+    history_digest_ = atoms_digest(0, history_.data(), history_.size());
+    SLOG("shifted context window back %d tokens", discard_tokens);
+    return discard_tokens;
+}
+
+// keeps the attended context within `window` tokens by evicting the
+// middle of the conversation from kv cache, in the manner of
+// streaming attention: the leading atoms survive because softmax
+// leans on them as attention sinks, the most recent tokens survive
+// because they carry the local context generation actually uses,
+// and everything between stops being attended. the mechanics are
+// those of shift_context(), but driven by a per-request quality
+// knob instead of by running out of context. returns the number of
+// tokens discarded, or zero when nothing needed evicting
+int
+Slot::bound_context(int window)
+{
+    if (!ctx_)
+        return uninitialized;
+    if (ctx_used() <= window)
+        return 0;
+    flush_speculation();
+
+    // the bos token counts among the sinks when the model wants one
+    int keep = llama_should_add_bos_token(model_);
+    if (keep < 4)
+        keep = 4;
+    int n = history_.size();
+    if (n - keep < 2)
+        return 0;
+
+    // evict an extra eighth below the cap, so a generating slot
+    // isn't paying for an eviction on every token it samples
+    int target = window - window / 8;
+    int keep_tokens = 0;
+    for (int i = 0; i < keep; ++i)
+        keep_tokens += history_[i].ctx_used();
+    int used = ctx_used();
+    int discard = keep;
+    int discard_tokens = 0;
+    while (discard < n - 1 && used - discard_tokens > target)
+        discard_tokens += history_[discard++].ctx_used();
+    if (!discard_tokens)
+        return 0;
+
+    // models like Mamba can't be partially erased
+    if (!batcher_->kv_cache_seq_rm(
+          id_, keep_tokens, keep_tokens + discard_tokens))
+        return 0;
+    batcher_->kv_cache_seq_add(
+      id_, keep_tokens + discard_tokens, used, -discard_tokens);
+
+    // the draft kv no longer mirrors the main kv; nuke it so the
+    // next speculation round rebuilds from the shifted history
+    if (draft_ctx_) {
+        llama_kv_cache_seq_rm(draft_ctx_, 0, -1, -1);
+        draft_used_ = 0;
+        draft_dirty_ = false;
+    }
+
+    history_.erase(history_.begin() + keep, history_.begin() + discard);
+    history_digest_ = atoms_digest(0, history_.data(), history_.size());
+    SLOG("bounded attended context to %d tokens by evicting %d",
+         window,
+         discard_tokens);
+    return discard_tokens;
+}
+
+// stamps a predicted token into the timing ring. single writer: only
+// the thread that holds the slot calls this, so a plain store is
+// enough, and /timings readers tolerate the racing oldest entry
+void
+Slot::record_timing(long stamp_us, int decode_us)
+{
+    TokenTiming& t = timings_[timings_count_ % kTimings];
+    t.stamp_us = stamp_us;
+    t.decode_us = decode_us;
+    t.write_us = 0;
+    ++timings_count_;
+}
+
+// charges time spent writing a streamed delta to the newest ring
+// entry. deltas that buffer several tokens charge the last one
+void
+Slot::record_write_us(int write_us)
+{
+    if (!timings_count_)
+        return;
+    timings_[(timings_count_ - 1) % kTimings].write_us += write_us;
+}
+
 void
 Slot::dump(std::string* result)
 {
@@ -17,6 +17,7 @@
 
 #pragma once
 #include <cosmo.h>
+#include <cstdint>
 #include <ctime>
 #include <functional>
 #include <string>
@@ -25,16 +26,23 @@
 #define SLOT(e) DLL_CONTAINER(Slot, elem_, e)
 
 struct llama_context;
+struct llama_lora_adapter;
 struct llama_model;
+struct llama_sampling_context;
+struct llava_image_embed;
 struct clip_ctx;
 
 namespace lf {
 namespace server {
 
-using ProgressCallback = std::function<void(int processed, int total)>;
+// returns false to cancel evaluation, e.g. when the client hung up
+using ProgressCallback = std::function<bool(int processed, int total)>;
 
+class AtomStream;
 struct Atom;
+struct Batcher;
 struct Image;
+struct TokenProb;
 
 struct Slot
 {
@@ -46,6 +54,15 @@ struct Slot
         decode_token_failed,
         decode_image_failed,
         encode_image_failed,
+        canceled,
+    };
+
+    // lifecycle as the batch scheduler advances this slot
+    enum State
+    {
+        state_idle,
+        state_prefilling,
+        state_generating,
     };
 
     static const char* describe_error(int);
@@ -55,22 +72,113 @@ struct Slot
     time_t last_used_;
     llama_model* model_;
     clip_ctx* clip_ctx_ = nullptr;
-    llama_context* ctx_ = nullptr;
+    llama_context* ctx_ = nullptr; // borrowed from Slots
+    Batcher* batcher_ = nullptr; // borrowed from Slots
+    int ctx_size_ = 0;
+    State state_ = state_idle;
     std::vector<Atom> history_;
     std::string system_fingerprint_;
 
+    // rolling fnv digest of history_, so take() can recognize that a
+    // whole history prefixes a prompt without scanning it. appends
+    // fold atoms in with atom_digest(); every other mutation must
+    // recompute with atoms_digest() or zero it alongside a clear()
+    uint64_t history_digest_ = 0;
+
+    // exponentially decayed count of times take() reused this slot's
+    // cached prefix; the recency half of cache_value()
+    double hit_rate_ = 0;
+    time_t hit_rated_ = 0;
+
+    // predicted follow-up window. give() extends it using the gaps
+    // observed between this conversation's turns, and while it's open
+    // the slot looks expensive to strangers and gets passed over for
+    // eviction and hibernation
+    time_t retained_until_ = 0;
+    double followup_gap_ = 0;
+
+    // lora adapter this slot's kv state was computed under. an empty
+    // name means the base model. history built with one adapter can
+    // never seed a conversation under another, so take() wipes the
+    // slot when the selections disagree
+    llama_lora_adapter* adapter_ = nullptr; // borrowed from Slots
+    float adapter_scale_ = 0;
+    std::string adapter_name_;
+
+    // compressed kv state while the conversation is hibernating. the
+    // history stays resident so the prefix tree keeps matching it; the
+    // cells go back to the shared pool until take() rehydrates
+    std::vector<uint8_t> hibernated_;
+    size_t hibernated_size_ = 0;
+
+    // draft model state for speculative decoding
+    llama_model* draft_model_ = nullptr; // borrowed from Slots
+    llama_context* draft_ctx_ = nullptr;
+    bool draft_dirty_ = false;
+    int draft_used_ = 0;
+    llama_sampling_context* sampler_ = nullptr; // borrowed from Client
+    bool apply_grammar_ = false;
+
+    // request wants per-token logprob records. disables speculative
+    // decoding for the duration, since accepted draft tokens never
+    // get a logits row of their own
+    bool logprobs_ = false;
+    std::vector<int> predecoded_;
+    std::vector<int> speculated_;
+
+    // timing ring for the last kTimings predicted tokens, overwritten
+    // circularly, so a stutter reported after the fact still has its
+    // neighborhood on record for the /timings endpoint
+    struct TokenTiming
+    {
+        long stamp_us; // CLOCK_MONOTONIC when the token finished
+        int decode_us; // sampling plus evaluation
+        int write_us; // handing the token to the client, if streamed
+    };
+    static constexpr int kTimings = 256;
+    TokenTiming timings_[kTimings] = {};
+    unsigned timings_count_ = 0;
+
     ~Slot();
     Slot(int, llama_model*);
     int ctx_size() const;
     int ctx_used() const;
-    bool start();
+    void record_hit(time_t);
+    double hit_rate(time_t) const;
+    double cache_value(time_t) const;
+    bool start(llama_context*, Batcher*, int, const std::string&);
+    int sample(llama_sampling_context*, bool, TokenProb* = nullptr, int = 0);
+    bool can_speculate() const;
+    int speculate_token(int);
+    void draft_eval(const int*, int, int);
+    void flush_speculation();
     int eval_token(int);
-    int eval_tokens(const std::vector<int>&, const ProgressCallback& = nullptr);
-    int eval_image(const std::string_view&, const ProgressCallback& = nullptr);
-    int eval_atoms(const std::vector<Atom>&, const ProgressCallback& = nullptr);
+    int eval_tokens(const std::vector<int>&, const ProgressCallback& = nullptr,
+                    bool = true);
+    int eval_image(const std::string_view&, const ProgressCallback& = nullptr,
+                   bool = true);
+    int eval_embed(const std::string_view&, llava_image_embed*,
+                   const ProgressCallback& = nullptr, bool = true);
+    int eval_atoms(const std::vector<Atom>&, const ProgressCallback& = nullptr,
+                   bool = true);
     int prefill(const std::vector<Atom>&, const ProgressCallback& = nullptr);
+    int prefill(AtomStream&, const ProgressCallback& = nullptr);
+    int shift_context();
+    int bound_context(int);
+    void record_timing(long, int);
+    void record_write_us(int);
     void tokenize(std::vector<Atom>*, std::string_view, bool);
     void dump(std::string*);
+
+    // token counts from reconciling a prefill against cached history
+    struct PrefillStats
+    {
+        int keep_tokens;
+        int discarded_tokens;
+        int relocated_tokens;
+    };
+
+    int prepare_prefill(const std::vector<Atom>&, bool, PrefillStats*);
 };
 
 } // namespace server
@@ -16,29 +16,105 @@
 // limitations under the License.
 
 #include "slots.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llama.h"
+#include "llamafile/chaos.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/macros.h"
 #include "llamafile/server/atom.h"
+#include "llamafile/server/batcher.h"
+#include "llamafile/server/deadline.h"
+#include "llamafile/server/hibernate.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/memory.h"
+#include "llamafile/server/metrics.h"
+#include "llamafile/server/pieces.h"
 #include "llamafile/server/slot.h"
 #include "llamafile/server/slot_entry.h"
-#include "llamafile/vector.h"
+#include "llamafile/server/snapshot.h"
+#include "llamafile/server/utils.h"
+#include "llamafile/version.h"
 #include <algorithm>
 #include <cassert>
 #include <climits>
 #include <cmath>
+#include <cosmo.h>
+#include <cstring>
+
+// bounds on the predicted follow-up window, in seconds. most clients
+// that are going to follow up do so within half a minute, which is
+// the window a conversation starts with before its own rhythm is known
+#define RETAIN_DEFAULT 30
+#define RETAIN_MIN 5
+#define RETAIN_MAX 120
 
 namespace lf {
 namespace server {
 
-Slots::Slots(llama_model* model) : model_(model)
+static int
+choose_ctx_size(llama_model* model)
+{
+    int n_ctx_train = llama_n_ctx_train(model);
+    if (FLAG_ctx_size <= 0 || FLAG_ctx_size > n_ctx_train)
+        return n_ctx_train;
+    return FLAG_ctx_size;
+}
+
+static ggml_type
+kv_cache_type(const char* name)
+{
+    if (!strcmp(name, "f32"))
+        return GGML_TYPE_F32;
+    if (!strcmp(name, "bf16"))
+        return GGML_TYPE_BF16;
+    if (!strcmp(name, "q8_0"))
+        return GGML_TYPE_Q8_0;
+    if (!strcmp(name, "q4_0"))
+        return GGML_TYPE_Q4_0;
+    return GGML_TYPE_F16;
+}
+
+static std::string
+generate_system_fingerprint(const llama_context_params* cparams)
 {
+    uint64_t h = 0;
+    h ^= __fnv(LLAMAFILE_VERSION_STRING, sizeof(LLAMAFILE_VERSION_STRING));
+    h ^= __fnv(cparams, sizeof(*cparams));
+    std::string b = "fp_";
+    for (int j = 0; j < 64 / 5; ++j) {
+        b += "abcdefghijklmnopqrstuvwxyz012345"[h & 31];
+        h >>= 5;
+    }
+    return b;
+}
+
+Slots::Slots(llama_model* model, llama_model* draft_model)
+  : model_(model), draft_model_(draft_model)
+{
+    uint64_t w = _rand64();
+    node_token_ = "node_";
+    for (int j = 0; j < 64 / 5; ++j) {
+        node_token_ += "abcdefghijklmnopqrstuvwxyz012345"[w & 31];
+        w >>= 5;
+    }
     pthread_cond_init(&cond_, 0);
     pthread_mutex_init(&lock_, 0);
 }
 
 Slots::~Slots()
 {
+    if (batcher_) {
+        batcher_->shutdown();
+        delete batcher_;
+    }
+    slots_.clear();
+    delete pieces_;
+    if (ctx_) {
+        memory_count(MEM_KV, -(long)llama_state_get_size(ctx_));
+        llama_free(ctx_);
+    }
+    for (const auto& [name, adapter] : adapters_)
+        llama_lora_adapter_free(adapter.handle);
     pthread_mutex_destroy(&lock_);
     pthread_cond_destroy(&cond_);
 }
@@ -52,18 +128,160 @@ Slots::size()
 int
 Slots::start(int count)
 {
+    // bake the detokenization table while the model is being brought
+    // up, so the streaming handlers never pay for it per token
+    if (!pieces_)
+        pieces_ = new Pieces(model_);
+
+    // likewise the tokens that open every follow-up turn
+    if (next_turn_.empty())
+        prepare_next_turn_prefetch();
+
+    // all slots share one context so the batcher can coalesce
+    // their work into a single llama_decode() per iteration,
+    // with each slot owning one of its sequences
+    int slot_ctx_size = choose_ctx_size(model_);
+
+    // real traffic is rarely uniform: most chats stay short while a
+    // few want the whole training window. --slot-buckets 28x2k,4x32k
+    // builds size classes in place of --slots, here 28 slots whose
+    // conversations cap at 2048 tokens plus 4 that go to 32768, and
+    // take() steers each prompt to the smallest adequate class. the
+    // classes bound logical windows, not memory: all buckets draw
+    // cells from the one shared pool below
+    std::vector<int> bucket_sizes;
+    if (FLAG_slot_buckets) {
+        int n_ctx_train = llama_n_ctx_train(model_);
+        const char* s = FLAG_slot_buckets;
+        while (*s) {
+            char* ep;
+            long bucket_count = strtol(s, &ep, 10);
+            if (ep == s || *ep != 'x')
+                break;
+            long bucket_size = strtol(ep + 1, &ep, 10);
+            if (*ep == 'k') {
+                bucket_size *= 1024;
+                ++ep;
+            }
+            if (bucket_count < 1 || bucket_size < 1)
+                break;
+            bucket_size = MIN(bucket_size, (long)n_ctx_train);
+            while (bucket_count--)
+                bucket_sizes.push_back(bucket_size);
+            s = ep;
+            if (*s != ',')
+                break;
+            ++s;
+        }
+        if (*s || bucket_sizes.empty()) {
+            SLOG("bad --slot-buckets spec %s; using %d uniform slots",
+                 FLAG_slot_buckets,
+                 count);
+            bucket_sizes.clear();
+        } else {
+            count = bucket_sizes.size();
+        }
+    }
+    if (bucket_sizes.empty())
+        bucket_sizes.assign(count, slot_ctx_size);
+    int biggest_bucket =
+      *std::max_element(bucket_sizes.begin(), bucket_sizes.end());
+
+    // the kv cache is a pool of cells that sequences claim as they
+    // grow, so it needn't be sized for every slot maxing out at the
+    // same time. when --kv-cells caps the pool below that worst case
+    // take() evicts idle histories to make room, letting many mostly
+    // idle sessions share the memory of a few contexts
+    long kv_cells = 0;
+    for (int bucket_size : bucket_sizes)
+        kv_cells += bucket_size;
+    if (FLAG_kv_cells > 0)
+        kv_cells = MAX((long)biggest_bucket, MIN(kv_cells, (long)FLAG_kv_cells));
+
+    // an embedding fleet (--embedding) never generates, so the slot
+    // pool exists only to satisfy the machinery around it. the cell
+    // pool shrinks to a single batch and the context gets created in
+    // embeddings only mode, which skips the n_vocab sized logits
+    // buffer in favor of the much smaller n_embd one
+    if (FLAG_embedding)
+        kv_cells = MIN(kv_cells, (long)MAX(FLAG_batch, FLAG_ubatch));
+    kv_cells_ = kv_cells;
+
+    // models with a sliding attention window (mistral, gemma) mask off
+    // cells beyond the window rather than freeing them, and their global
+    // attention layers still read the full history, so the pool must be
+    // sized for full context. a windowed kv layout that actually returns
+    // the memory has to live in the attention implementation itself. in
+    // the meantime --kv-cells is the lever for packing in more slots
+    int n_swa = llama_n_swa(model_);
+    if (n_swa > 0)
+        SLOG("model has %d token sliding window; kv cells are still "
+             "allocated for the full %ld cell pool",
+             n_swa,
+             kv_cells);
+
+    llama_context_params cparams = {};
+    cparams.embeddings = FLAG_embedding;
+    cparams.embeddings_only = FLAG_embedding;
+    cparams.logits_all = false;
+    cparams.seed = 12345;
+    cparams.n_ctx = kv_cells;
+    cparams.n_batch = FLAG_batch;
+    cparams.n_ubatch = FLAG_ubatch;
+    cparams.n_seq_max = count + FANOUT_MAX - 1;
+    cparams.n_threads = MIN(FLAG_threads, 20);
+    cparams.n_threads_batch = FLAG_threads;
+    cparams.rope_scaling_type = LLAMA_ROPE_SCALING_TYPE_UNSPECIFIED;
+    cparams.pooling_type = LLAMA_POOLING_TYPE_UNSPECIFIED;
+    cparams.attention_type = LLAMA_ATTENTION_TYPE_UNSPECIFIED;
+    cparams.rope_freq_base = 0;
+    cparams.yarn_ext_factor = -1;
+    cparams.yarn_attn_factor = 1;
+    cparams.yarn_beta_fast = 32;
+    cparams.yarn_beta_slow = 1;
+    cparams.yarn_orig_ctx = 0;
+    cparams.defrag_thold = -1;
+    cparams.offload_kqv = true;
+    cparams.type_k = kv_cache_type(FLAG_cache_type_k);
+    cparams.type_v = kv_cache_type(FLAG_cache_type_v);
+    cparams.flash_attn = FLAG_flash_attn;
+
+    // the transposed value cache can only be quantized when flash
+    // attention reads it through the quantized dot kernels
+    if (ggml_is_quantized(cparams.type_v) && !FLAG_flash_attn) {
+        SLOG("quantized value cache requires --flash-attn; using f16");
+        cparams.type_v = GGML_TYPE_F16;
+    }
+    std::string system_fingerprint = generate_system_fingerprint(&cparams);
+    if (!(ctx_ = llama_new_context_with_model(model_, cparams))) {
+        SLOG("failed to create slots context");
+        return 0;
+    }
+    // mostly kv cells; the logits and embeddings buffers ride along
+    memory_count(MEM_KV, llama_state_get_size(ctx_));
+    batcher_ = new Batcher(ctx_);
+    if (batcher_->spawn()) {
+        SLOG("failed to spawn batcher thread");
+        return 0;
+    }
     int made = 0;
     pthread_mutex_lock(&lock_);
+    for (int i = 0; i < FANOUT_MAX - 1; ++i)
+        branch_ids_.emplace_back(count + i);
     for (int i = 0; i < count; ++i) {
         Slot* slot = new Slot(i, model_);
-        if (slot->start()) {
+        slot->draft_model_ = draft_model_;
+        if (slot->start(ctx_, batcher_, bucket_sizes[i], system_fingerprint)) {
             ++made;
             slots_.emplace_back(slot);
             dll_make_last(&free_slots_, &slot->elem_);
+            tree_.insert(slot);
         } else {
             delete slot;
         }
     }
+    state_.resize(slots_.size());
+    publish_state_locked();
     if (made)
         pthread_cond_broadcast(&cond_);
     pthread_mutex_unlock(&lock_);
@@ -72,70 +290,643 @@ Slots::start(int count)
     return made;
 }
 
+void
+Slots::save_snapshots()
+{
+    pthread_mutex_lock(&lock_);
+    for (const auto& slot : slots_) {
+        // snapshots serialize the live sequence, so a hibernating
+        // conversation has to come back to the cell pool first
+        rehydrate_slot(slot.get());
+        snapshot_save(slot.get());
+    }
+    pthread_mutex_unlock(&lock_);
+}
+
+void
+Slots::restore_snapshots()
+{
+    pthread_mutex_lock(&lock_);
+    for (const auto& slot : slots_) {
+        tree_.remove(slot.get());
+        snapshot_restore(slot.get());
+        tree_.insert(slot.get());
+    }
+    pthread_mutex_unlock(&lock_);
+}
+
+// runs a short synthetic decode through the shared context before the
+// server starts listening. the first decode otherwise pays for page
+// faulting weights off disk and lazily linking the gpu module, which
+// made request #1 several times slower than request #2 and let load
+// balancer health checks eat the cold start cost at random
+void
+Slots::warmup()
+{
+    if (!FLAG_warmup)
+        return;
+    timespec started = timespec_real();
+    std::vector<Atom> atoms;
+    atomize(model_,
+            &atoms,
+            "The quick brown fox jumped over the lazy dog",
+            DONT_PARSE_SPECIAL);
+    if (atoms.size() < 2)
+        return;
+
+    // feed most of the prompt as one batch to touch every layer via
+    // the prefill kernels, then the leftover tokens one at a time,
+    // since decode kernels specialize on batch size
+    size_t split = atoms.size() > 4 ? atoms.size() - 4 : 1;
+    std::vector<Atom> prompt(atoms.begin(), atoms.begin() + split);
+    Slot* slot = take(prompt);
+    int rc;
+    if ((rc = slot->prefill(prompt)) < 0) {
+        SLOG("warmup prefill failed: %s", Slot::describe_error(rc));
+        give(slot);
+        return;
+    }
+    if (!FLAG_embedding)
+        for (size_t i = split; i < atoms.size(); ++i)
+            if ((rc = slot->eval_token(atoms[i].token())) < 0) {
+                SLOG("warmup decode failed: %s", Slot::describe_error(rc));
+                break;
+            }
+    give(slot);
+    timespec wall = timespec_sub(timespec_real(), started);
+    SLOG("warmup took %.3f seconds", timespec_tonanos(wall) * 1e-9);
+}
+
+// figures out the tokens that deterministically open the next chat
+// turn under the active template: the text between the assistant
+// turn's end-of-generation token and the spot where the user's next
+// words would go, e.g. "\n<|im_start|>user\n" for chatml. rendering a
+// dummy conversation with two different follow-up messages and
+// keeping only their common prefix isolates what can't depend on
+// anything the user will actually say
+void
+Slots::prepare_next_turn_prefetch()
+{
+    std::vector<llama_chat_msg> first = {
+        { "user", "a" },
+        { "assistant", "b" },
+        { "user", "c" },
+    };
+    std::vector<llama_chat_msg> second = first;
+    second.back().content = "d";
+    std::string r1 = llama_chat_apply_template(
+      model_, FLAG_chat_template, first, DONT_ADD_ASSISTANT);
+    std::string r2 = llama_chat_apply_template(
+      model_, FLAG_chat_template, second, DONT_ADD_ASSISTANT);
+    size_t n = 0;
+    while (n < r1.size() && n < r2.size() && r1[n] == r2[n])
+        ++n;
+    std::vector<Atom> atoms;
+    atomize(model_, &atoms, std::string_view(r1.data(), n), PARSE_SPECIAL);
+    size_t last = atoms.size();
+    for (size_t i = atoms.size(); i--;)
+        if (atoms[i].is_token() &&
+            llama_token_is_eog(model_, atoms[i].token())) {
+            last = i;
+            break;
+        }
+    // a template that doesn't close turns with an end-of-generation
+    // token gives finished histories no boundary to prefetch from
+    if (last == atoms.size())
+        return;
+    next_turn_.assign(atoms.begin() + last + 1, atoms.end());
+    SLOG("next turn opens with %zu deterministic tokens",
+         next_turn_.size());
+}
+
+// decodes the next turn's deterministic header into a freshly
+// finished conversation's kv cache while the caller still owns the
+// slot, so the anticipated follow-up's prefill starts past the
+// template boilerplate. the history grows by the same atoms the next
+// request's prompt will open with, which is how the prefix matcher
+// gives the work back
+void
+Slots::prefetch_next_turn(Slot* slot)
+{
+    if (next_turn_.empty())
+        return;
+    if (slot->history_.empty())
+        return;
+    const Atom& tail = slot->history_.back();
+    if (!tail.is_token() || !llama_token_is_eog(model_, tail.token()))
+        return;
+    if (slot->ctx_used() + (int)next_turn_.size() > slot->ctx_size())
+        return;
+    int rc;
+    if ((rc = slot->eval_atoms(next_turn_)) < 0)
+        SLOG("next turn prefetch failed: %s", Slot::describe_error(rc));
+}
+
+// tells the cpu a busy wait is in progress, so it eases off the
+// pipeline and yields decode bandwidth to the sibling hyperthread
+static inline void
+cpu_relax()
+{
+#if defined(__x86_64__)
+    __asm__ volatile("pause");
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// briefly busy waits for give() before take() commits to sleeping in
+// the condition variable, whose wakeup goes through the kernel and
+// lands well over 100µs after the slot actually freed. the spin only
+// happens when the observed release interval says a handoff is
+// probably imminent, i.e. the server is saturated and slots are
+// turning over quickly; a quiet server parks right away. the budget
+// grows exponentially and is capped around the cost of one park.
+// called with lock_ held; returns with it held either way. a true
+// return means a give happened, so the caller should rescore rather
+// than sleep. the final seq check happens back under the lock, and
+// give() bumps the counter under it too, so a handoff can't slip
+// between this returning false and the wait that follows
+bool
+Slots::spin_for_give()
+{
+    if (!avg_release_interval_ || avg_release_interval_ > 1e-3)
+        return false;
+    unsigned long seq = give_seq_.load(std::memory_order_relaxed);
+    pthread_mutex_unlock(&lock_);
+    LLAMAFILE_CHAOS_POINT("slots_spin_unlocked");
+    for (int backoff = 1; backoff <= 1024; backoff *= 2) {
+        for (int i = 0; i < backoff; ++i)
+            cpu_relax();
+        if (give_seq_.load(std::memory_order_relaxed) != seq)
+            break;
+    }
+    pthread_mutex_lock(&lock_);
+    return give_seq_.load(std::memory_order_relaxed) != seq;
+}
+
+// unwinds take()'s bookkeeping when the waiting thread gets canceled,
+// e.g. because its client hung up. pthread_cond_wait() reacquires the
+// lock before cancellation proceeds, so it's held here
+struct TakeWaiter
+{
+    Slots* slots;
+    int priority;
+};
+
+static void
+take_unwind(void* arg)
+{
+    TakeWaiter* waiter = (TakeWaiter*)arg;
+    --waiter->slots->waiters_;
+    if (waiter->priority == Slots::PRIORITY_INTERACTIVE)
+        --waiter->slots->urgent_waiters_;
+    waiter->slots->publish_state_locked();
+    pthread_mutex_unlock(&waiter->slots->lock_);
+}
+
 Slot*
-Slots::take(const std::vector<Atom>& atoms)
+Slots::take(const std::vector<Atom>& atoms, const std::string& adapter,
+            int priority, int hint)
 {
+    timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    int need = count_tokens(atoms);
     pthread_mutex_lock(&lock_);
+    ++waiters_;
+    if (priority == PRIORITY_INTERACTIVE)
+        ++urgent_waiters_;
+    publish_state_locked();
+    TakeWaiter waiter = { this, priority };
+
+    // rolling digests of every prompt prefix, computed once, so the
+    // scoring loop can recognize a candidate whose entire history
+    // prefixes this prompt with one comparison instead of a scan
+    std::vector<uint64_t> prefix_digests(atoms.size() + 1);
+    prefix_digests[0] = 0;
+    for (size_t i = 0; i < atoms.size(); ++i)
+        prefix_digests[i + 1] = atom_digest(prefix_digests[i], atoms[i]);
+
+    pthread_cleanup_push(take_unwind, &waiter);
+    Slot* chosen = nullptr;
+    double chosen_score = INT_MIN;
+    long deadline = deadline_get();
     for (;;) {
 
-        // find best slot
-        // iteration order favors lru
+        // a request whose deadline lapsed while it queued must not
+        // claim a slot it can no longer use. the handler turns the
+        // null return into a timeout response
+        if (deadline && deadline_expired())
+            break;
+
+        // batch requests stand aside while interactive requests are
+        // queued, but only up to --batch-max-wait seconds, so a long
+        // interactive burst can't starve them forever. the timed wait
+        // is how a waiter that stood aside notices it has aged out
+        if (priority == PRIORITY_BATCH && urgent_waiters_) {
+            timespec waited;
+            clock_gettime(CLOCK_MONOTONIC, &waited);
+            if (timespec_sub(waited, started).tv_sec < FLAG_batch_max_wait) {
+                timespec deadline = timespec_real();
+                deadline.tv_sec += 1;
+                pthread_cond_timedwait(&cond_, &lock_, &deadline);
+                continue;
+            }
+        }
+
+        // ask prefix tree for the slots sharing the longest
+        // common prefix, so only candidates get scored below
         time_t now = time(0);
-        Dll* best_slot = nullptr;
+        std::vector<Slot*> candidates;
+        tree_.match(atoms, &candidates);
+
+        // find best candidate
+        Slot* best_slot = nullptr;
         double best_score = INT_MIN;
-        for (Dll* e = dll_first(free_slots_); e; e = dll_next(free_slots_, e)) {
+        int best_reuse = 0;
+        for (Slot* slot : candidates) {
 
             // least recently used is good
-            int age = now - SLOT(e)->last_used_;
+            int age = now - slot->last_used_;
             double decay =
               age + exp(FLAG_decay_growth * (age - FLAG_decay_delay));
 
-            // common prefix length is good
-            int cpl = vector_common_prefix_length(SLOT(e)->history_, atoms);
-
-            // common suffix length is good
+            // history computed under a different lora adapter went
+            // through different weights, so none of it can seed this
+            // conversation. such candidates compete on recency alone
+            int cpl = 0;
             int csl = 0;
-            int size = SLOT(e)->history_.size();
-            for (int i = cpl + 1; i < size; ++i) {
-                if (size - i > atoms.size() - cpl)
-                    continue;
-                if (std::equal(SLOT(e)->history_.begin() + i,
-                               SLOT(e)->history_.end(),
-                               atoms.begin() + cpl)) {
-                    csl = size - i;
-                    break;
+            int size = slot->history_.size();
+            if (slot->adapter_name_ == adapter) {
+
+                // common prefix length is good. when the digest says
+                // the whole history prefixes the prompt (the usual
+                // case for a conversation's next turn) the scan is
+                // skipped; a digest collision only mis-scores this
+                // candidate, since prepare_prefill() rechecks the
+                // prefix element-wise before any kv gets reused
+                if ((size_t)size <= atoms.size() &&
+                    slot->history_digest_ == prefix_digests[size]) {
+                    cpl = size;
+                } else {
+                    cpl = atoms_common_prefix(slot->history_, atoms);
+                }
+
+                // common suffix length is good
+                for (int i = cpl + 1; i < size; ++i) {
+                    if (size - i > atoms.size() - cpl)
+                        continue;
+                    if (std::equal(slot->history_.begin() + i,
+                                   slot->history_.end(),
+                                   atoms.begin() + cpl)) {
+                        csl = size - i;
+                        break;
+                    }
                 }
             }
 
-            // discarded atoms is bad
-            int discard;
+            // discarded atoms is bad, and discarding a prefix that
+            // requests keep hitting is worse: it'll just have to be
+            // prefilled back while a cold slot could have taken this
+            // request instead
+            double discard;
             if (csl) {
                 discard = 0;
             } else {
-                discard = size - cpl;
+                discard = (size - cpl) * (1 + slot->hit_rate(now));
+            }
+
+            // a slot whose conversation probably isn't over (its
+            // client has been following up quickly) shouldn't go to a
+            // stranger while cheaper slots exist, so inside the
+            // predicted window its history weighs double against
+            // requests that share none of it
+            double retain = 0;
+            if (!(cpl + csl) && now < slot->retained_until_)
+                retain = size * (1 + slot->hit_rate(now));
+
+            // a load balancer affinity hint names the slot an earlier
+            // response in this conversation came from. when its
+            // history still matches, double the match weight so the
+            // hinted slot wins ties against other slots sharing the
+            // same prefix, without beating a strictly longer match
+            int affinity = 0;
+            if (slot->id_ == hint)
+                affinity = cpl + csl;
+
+            // when contexts come in size classes (--slot-buckets), a
+            // slot too small for this prompt is a last resort, since
+            // landing there means forgetting turns just to fit. among
+            // adequate slots a faint rent on capacity steers short
+            // prompts away from the big contexts, keeping those free
+            // for the prompts that actually need them
+            double misfit;
+            if (need <= slot->ctx_size_) {
+                misfit = slot->ctx_size_ * 1e-6;
+            } else {
+                misfit = 1e9;
             }
 
             // tally up score to determine best
-            double score = cpl + csl + decay - discard;
+            double score =
+              cpl + csl + affinity + decay - discard - retain - misfit;
             if (score >= best_score) {
                 best_score = score;
-                best_slot = e;
+                best_slot = slot;
+                best_reuse = cpl + csl;
             }
         }
 
-        // return borrowed pointer to best slot
+        // claim best slot while the lock is still held
         if (best_slot) {
-            dll_remove(&free_slots_, best_slot);
-            pthread_mutex_unlock(&lock_);
-            SLOG("acquired slot #%d with score %d",
-                 SLOT(best_slot)->id_,
-                 (int)MIN(INT_MAX, best_score));
-            return SLOT(best_slot);
+            tree_.remove(best_slot);
+            dll_remove(&free_slots_, &best_slot->elem_);
+            // switching adapters (or scales) invalidates whatever kv
+            // the slot held, since those cells went through different
+            // weights. resolve the requested configuration under the
+            // lock so it can't be unloaded out from under us
+            llama_lora_adapter* handle = nullptr;
+            float scale = 0;
+            if (!adapter.empty()) {
+                const auto it = adapters_.find(adapter);
+                if (it != adapters_.end()) {
+                    handle = it->second.handle;
+                    scale = it->second.scale;
+                }
+            }
+            if (best_slot->adapter_name_ != adapter ||
+                best_slot->adapter_ != handle ||
+                best_slot->adapter_scale_ != scale) {
+                if (!best_slot->history_.empty())
+                    batcher_->kv_cache_seq_rm(best_slot->id_, -1, -1);
+                best_slot->history_.clear();
+                best_slot->history_digest_ = 0;
+                memory_count(MEM_KV, -(long)best_slot->hibernated_.size());
+                best_slot->hibernated_.clear();
+                best_slot->hibernated_.shrink_to_fit();
+                best_slot->hibernated_size_ = 0;
+                if (best_slot->draft_ctx_) {
+                    llama_kv_cache_seq_rm(best_slot->draft_ctx_, 0, -1, -1);
+                    best_slot->draft_used_ = 0;
+                    best_slot->draft_dirty_ = false;
+                }
+                best_slot->adapter_name_ = adapter;
+                best_slot->adapter_ = handle;
+                best_slot->adapter_scale_ = scale;
+            }
+            // a conversation moving in cold can still adopt whatever
+            // prefix an idle slot already holds, typically the system
+            // prompt every conversation opens with. the graft is left
+            // out of best_reuse on purpose: hit accounting and the
+            // retention window belong to the donor's conversation,
+            // not this one
+            if (!best_reuse)
+                graft_prefix(best_slot, atoms, prefix_digests);
+            reclaim(need);
+            // a hibernating winner needs its kv back before prefill can
+            // reuse the prefix it was chosen for. failure wipes it down
+            // to an empty slot, which prefill handles like any cold one
+            if (!best_slot->hibernated_.empty()) {
+                reclaim(best_slot->history_.size());
+                rehydrate_slot(best_slot);
+            }
+            if (best_reuse > 0) {
+                best_slot->record_hit(now);
+                // the gap since this conversation's last turn feeds
+                // the adaptive retention window give() opens on
+                // release
+                double gap = now - best_slot->last_used_;
+                if (best_slot->followup_gap_) {
+                    best_slot->followup_gap_ =
+                      best_slot->followup_gap_ * .875 + gap * .125;
+                } else {
+                    best_slot->followup_gap_ = gap;
+                }
+            } else {
+                // a different conversation is moving in, so its
+                // client's rhythm starts from scratch
+                best_slot->followup_gap_ = 0;
+                best_slot->retained_until_ = 0;
+            }
+            chosen = best_slot;
+            chosen_score = best_score;
+            break;
         }
 
         // all slots are being used
         SLOG("waiting for slot to be relinquished...");
-        pthread_cond_wait(&cond_, &lock_);
+        LLAMAFILE_CHAOS_POINT("slots_take_wait");
+        if (!spin_for_give()) {
+            if (deadline) {
+                // bound the sleep so expiry gets noticed even when no
+                // slot ever frees up. the condvar runs on realtime,
+                // so the monotonic remainder converts at the last
+                // moment
+                timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                long left = deadline - timespec_tonanos(now);
+                if (left < 1)
+                    left = 1;
+                timespec until =
+                  timespec_add(timespec_real(), timespec_fromnanos(left));
+                pthread_cond_timedwait(&cond_, &lock_, &until);
+            } else {
+                pthread_cond_wait(&cond_, &lock_);
+            }
+        }
+    }
+    pthread_cleanup_pop(false);
+    --waiters_;
+    if (priority == PRIORITY_INTERACTIVE)
+        --urgent_waiters_;
+    // captures the claim itself plus whatever reclaim() and
+    // rehydration did to the other slots under this same hold
+    publish_state_locked();
+    pthread_mutex_unlock(&lock_);
+
+    // return borrowed pointer to chosen slot
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    metrics_observe(METRIC_QUEUE,
+                    timespec_tonanos(timespec_sub(now, started)));
+    if (!chosen) {
+        SLOG("deadline expired while waiting for slot");
+        return nullptr;
+    }
+    SLOG("acquired slot #%d with score %d",
+         chosen->id_,
+         (int)MIN(INT_MAX, chosen_score));
+    return chosen;
+}
+
+// grafts the longest prefix of `atoms` that some idle slot already
+// holds onto a freshly claimed slot whose own history was useless, so
+// a prompt opening with a prefix the pool has already computed never
+// prefills those kv cells again. the unified cache lets one cell
+// belong to many sequences, the same aliasing fan-out branches use to
+// share their prompt, so the graft costs bookkeeping rather than
+// decode work: a system prompt shared by every conversation gets
+// computed once and referenced wherever it's needed. divergence later
+// needs nothing special, since prepare_prefill() truncates history at
+// the first mismatch and kv_cache_seq_rm() merely detaches this
+// sequence from cells other sequences still reference, which is
+// copy-on-write in effect. must be called with lock_ held so the
+// donor stays idle for the duration
+void
+Slots::graft_prefix(Slot* slot,
+                    const std::vector<Atom>& atoms,
+                    const std::vector<uint64_t>& prefix_digests)
+{
+    Slot* donor = nullptr;
+    int donor_cpl = 0;
+    for (Dll* e = dll_first(free_slots_); e; e = dll_next(free_slots_, e)) {
+        Slot* cand = SLOT(e);
+        // kv built under a different adapter went through different
+        // weights, and hibernated kv isn't resident to alias
+        if (cand->adapter_name_ != slot->adapter_name_ ||
+            cand->adapter_ != slot->adapter_ ||
+            cand->adapter_scale_ != slot->adapter_scale_)
+            continue;
+        if (!cand->hibernated_.empty())
+            continue;
+        // same digest fast path and collision tolerance as take():
+        // a collision only mis-picks the donor, and prepare_prefill()
+        // rechecks the grafted prefix element-wise before reusing it
+        int cpl;
+        int size = cand->history_.size();
+        if ((size_t)size <= atoms.size() &&
+            cand->history_digest_ == prefix_digests[size]) {
+            cpl = size;
+        } else {
+            cpl = atoms_common_prefix(cand->history_, atoms);
+        }
+        if (cpl > donor_cpl) {
+            donor_cpl = cpl;
+            donor = cand;
+        }
+    }
+    if (!donor)
+        return;
+
+    // the claimed slot's old conversation gives way entirely, its
+    // compressed copy included, since rehydrating that later would
+    // collide with the grafted cells
+    if (!slot->history_.empty())
+        batcher_->kv_cache_seq_rm(slot->id_, -1, -1);
+    slot->history_.clear();
+    slot->history_digest_ = 0;
+    memory_count(MEM_KV, -(long)slot->hibernated_.size());
+    slot->hibernated_.clear();
+    slot->hibernated_.shrink_to_fit();
+    slot->hibernated_size_ = 0;
+    if (slot->draft_ctx_) {
+        llama_kv_cache_seq_rm(slot->draft_ctx_, 0, -1, -1);
+        slot->draft_used_ = 0;
+        slot->draft_dirty_ = false;
+    }
+
+    // seq_cp positions are token offsets, and image atoms occupy more
+    // than one position each
+    int donor_tokens = 0;
+    for (int i = 0; i < donor_cpl; ++i)
+        donor_tokens += donor->history_[i].ctx_used();
+    batcher_->kv_cache_seq_cp(donor->id_, slot->id_, 0, donor_tokens);
+
+    // models like Mamba copy their whole recurrent state whatever the
+    // range, which is only sound when the histories match in full.
+    // partial erasure failing is how the rest of this code detects
+    // such caches, so probe with the erase divergence would need and
+    // roll the graft back where it isn't supported
+    if (!batcher_->kv_cache_seq_rm(slot->id_, donor_tokens, -1)) {
+        batcher_->kv_cache_seq_rm(slot->id_, -1, -1);
+        return;
+    }
+
+    slot->history_.assign(donor->history_.begin(),
+                          donor->history_.begin() + donor_cpl);
+    slot->history_digest_ =
+      atoms_digest(0, slot->history_.data(), slot->history_.size());
+    SLOG("grafted %d shared prefix tokens from slot #%d onto slot #%d",
+         donor_tokens,
+         donor->id_,
+         slot->id_);
+}
+
+// evicts least recently used idle histories until the shared pool of
+// kv cells has room for `needed` more. must be called with lock_ held
+// which is fine since the batcher thread never takes it. `needed` is
+// an upper bound because prefill reuses whatever prefix the chosen
+// slot already has, so at worst we evict a little too eagerly
+void
+Slots::reclaim(long needed)
+{
+    long used = llama_get_kv_cache_used_cells(ctx_);
+
+    // before throwing anyone's conversation away, conversations that
+    // idled past --hibernate get their kv compressed onto the heap.
+    // their histories stay matchable, so unlike eviction this only
+    // costs a decompression when the client comes back
+    if (FLAG_hibernate > 0) {
+        time_t now = time(0);
+        for (Dll* e = dll_last(free_slots_); e && used + needed > kv_cells_;
+             e = dll_prev(free_slots_, e)) {
+            Slot* slot = SLOT(e);
+            if (slot->history_.empty() || !slot->hibernated_.empty())
+                continue;
+            if (now - slot->last_used_ < FLAG_hibernate)
+                continue;
+            // a follow-up predicted within the retention window would
+            // just pay the decompression right back
+            if (now < slot->retained_until_)
+                continue;
+            if (hibernate_slot(slot))
+                used = llama_get_kv_cache_used_cells(ctx_);
+        }
+    }
+
+    // pure lru here regularly threw away an 8k token system prompt
+    // hit every few seconds while a stale 50 token chat idled one
+    // place ahead of it in the list, so victims are picked by how
+    // cheap their cache is to rebuild rather than by age alone
+    time_t now = time(0);
+    while (used + needed > kv_cells_) {
+        Slot* victim = nullptr;
+        double victim_value = 0;
+        // slots expecting a follow-up within their retention window
+        // are only victimized when nobody else can free the cells
+        for (int pass = 0; pass < 2 && !victim; ++pass) {
+            for (Dll* e = dll_last(free_slots_); e;
+                 e = dll_prev(free_slots_, e)) {
+                // hibernated slots hold no cells so evicting them
+                // frees nothing
+                Slot* slot = SLOT(e);
+                if (slot->history_.empty() || !slot->hibernated_.empty())
+                    continue;
+                if (!pass && now < slot->retained_until_)
+                    continue;
+                double value = slot->cache_value(now);
+                if (!victim || value < victim_value) {
+                    victim = slot;
+                    victim_value = value;
+                }
+            }
+        }
+        if (!victim)
+            break;
+        SLOG("evicting %d kv cells worth %g from slot #%d",
+             victim->ctx_used(),
+             victim_value,
+             victim->id_);
+        tree_.remove(victim);
+        batcher_->kv_cache_seq_rm(victim->id_, -1, -1);
+        victim->history_.clear();
+        victim->history_digest_ = 0;
+        if (victim->draft_ctx_) {
+            llama_kv_cache_seq_rm(victim->draft_ctx_, 0, -1, -1);
+            victim->draft_used_ = 0;
+            victim->draft_dirty_ = false;
+        }
+        tree_.insert(victim);
+        used = llama_get_kv_cache_used_cells(ctx_);
     }
 }
 
@@ -145,10 +936,297 @@ Slots::give(Slot* slot)
     unassert(slot);
     SLOG("relinquishing slot #%d", slot->id_);
     slot->last_used_ = time(0);
+    // the client who just got a response usually sends a follow-up
+    // within half a minute, so the slot is retained for a window
+    // learned from this conversation's own turn gaps, during which
+    // take() and reclaim() treat its kv as about to be needed
+    if (!slot->history_.empty()) {
+        time_t window = RETAIN_DEFAULT;
+        if (slot->followup_gap_)
+            window = MIN(RETAIN_MAX,
+                         MAX(RETAIN_MIN, (time_t)(slot->followup_gap_ * 2)));
+        slot->retained_until_ = slot->last_used_ + window;
+    }
+    slot->state_ = Slot::state_idle;
+    slot->flush_speculation();
+    slot->sampler_ = nullptr;
+    slot->logprobs_ = false;
     pthread_mutex_lock(&lock_);
     dll_make_first(&free_slots_, &slot->elem_);
-    pthread_cond_signal(&cond_);
+    tree_.insert(slot);
+    if (waiters_) {
+        // sample how often slots free up while requests are queued,
+        // which is what a new arrival's wait time actually depends on
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (last_give_.tv_sec | last_give_.tv_nsec) {
+            double interval =
+              timespec_tonanos(timespec_sub(now, last_give_)) * 1e-9;
+            if (avg_release_interval_) {
+                avg_release_interval_ =
+                  avg_release_interval_ * .875 + interval * .125;
+            } else {
+                avg_release_interval_ = interval;
+            }
+        }
+        last_give_ = now;
+    } else {
+        last_give_ = {};
+    }
+    // a single signal could land on a batch waiter that's standing
+    // aside, which would strand the interactive waiter it was meant
+    // for, so everybody gets woken and the loop in take() sorts out
+    // who actually claims the slot. the counter bump is what spinning
+    // waiters notice long before the broadcast reaches them
+    give_seq_.fetch_add(1, std::memory_order_relaxed);
+    publish_state_locked();
+    LLAMAFILE_CHAOS_POINT("slots_give");
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+}
+
+// hands out a spare sequence id for a fan-out branch, or -1 when
+// they're all in use, in which case the caller runs its remaining
+// samples through branches that finish earlier
+int
+Slots::branch_take()
+{
+    pthread_mutex_lock(&lock_);
+    int seq = -1;
+    if (!branch_ids_.empty()) {
+        seq = branch_ids_.back();
+        branch_ids_.pop_back();
+    }
     pthread_mutex_unlock(&lock_);
+    return seq;
+}
+
+void
+Slots::branch_give(int seq)
+{
+    pthread_mutex_lock(&lock_);
+    branch_ids_.emplace_back(seq);
+    pthread_mutex_unlock(&lock_);
+}
+
+// loads a lora adapter from disk and registers it under `name` so
+// requests can select it without a server restart. reading the file
+// happens before the lock is taken since it can be slow. the shared
+// context isn't touched here at all; the batcher applies the adapter
+// ahead of the first decode that selects it, so every other slot's
+// kv cache stays exactly as warm as it was
+bool
+Slots::adapter_load(const std::string& name,
+                    const std::string& path,
+                    float scale)
+{
+    if (name.empty())
+        return false;
+    llama_lora_adapter* handle =
+      llama_lora_adapter_init(model_, path.c_str());
+    if (!handle) {
+        SLOG("%s: failed to load lora adapter", path.c_str());
+        return false;
+    }
+    pthread_mutex_lock(&lock_);
+    if (adapters_.count(name)) {
+        pthread_mutex_unlock(&lock_);
+        llama_lora_adapter_free(handle);
+        SLOG("lora adapter %s already loaded", name.c_str());
+        return false;
+    }
+    adapters_[name] = { handle, scale, path };
+    pthread_mutex_unlock(&lock_);
+    SLOG("loaded lora adapter %s from %s", name.c_str(), path.c_str());
+    return true;
+}
+
+// unregisters a lora adapter and frees its tensors. returns 0 on
+// success, -1 if no such adapter is loaded, or -2 if a request is
+// busy decoding through it right now. idle histories built with the
+// adapter get evicted here, so the prefix tree can't hand stale kv
+// to a future request after the name gets reused
+int
+Slots::adapter_unload(const std::string& name)
+{
+    pthread_mutex_lock(&lock_);
+    auto it = adapters_.find(name);
+    if (it == adapters_.end()) {
+        pthread_mutex_unlock(&lock_);
+        return -1;
+    }
+    llama_lora_adapter* handle = it->second.handle;
+    for (const auto& slot : slots_) {
+        if (slot->adapter_ != handle)
+            continue;
+        // a claimed slot is any slot absent from the free list, and
+        // its owner may be mid decode through these tensors
+        bool idle = false;
+        for (Dll* e = dll_first(free_slots_); e; e = dll_next(free_slots_, e))
+            if (SLOT(e) == slot.get()) {
+                idle = true;
+                break;
+            }
+        if (!idle) {
+            pthread_mutex_unlock(&lock_);
+            return -2;
+        }
+    }
+    for (const auto& slot : slots_) {
+        if (slot->adapter_ != handle)
+            continue;
+        tree_.remove(slot.get());
+        if (!slot->history_.empty() && slot->hibernated_.empty())
+            batcher_->kv_cache_seq_rm(slot->id_, -1, -1);
+        slot->history_.clear();
+        slot->history_digest_ = 0;
+        memory_count(MEM_KV, -(long)slot->hibernated_.size());
+        slot->hibernated_.clear();
+        slot->hibernated_.shrink_to_fit();
+        slot->hibernated_size_ = 0;
+        if (slot->draft_ctx_) {
+            llama_kv_cache_seq_rm(slot->draft_ctx_, 0, -1, -1);
+            slot->draft_used_ = 0;
+            slot->draft_dirty_ = false;
+        }
+        slot->adapter_ = nullptr;
+        slot->adapter_scale_ = 0;
+        slot->adapter_name_.clear();
+        tree_.insert(slot.get());
+    }
+    adapters_.erase(it);
+    pthread_mutex_unlock(&lock_);
+    // the context must let go of the tensors before they're freed,
+    // and that has to happen on the batcher thread
+    batcher_->lora_remove(handle);
+    llama_lora_adapter_free(handle);
+    SLOG("unloaded lora adapter %s", name.c_str());
+    return 0;
+}
+
+// changes the strength a lora adapter gets applied with. conversations
+// already underway keep the scale they started with, since their kv
+// was computed under it; requests claimed after this call get the new
+// one
+bool
+Slots::adapter_scale(const std::string& name, float scale)
+{
+    pthread_mutex_lock(&lock_);
+    auto it = adapters_.find(name);
+    bool found = it != adapters_.end();
+    if (found)
+        it->second.scale = scale;
+    pthread_mutex_unlock(&lock_);
+    return found;
+}
+
+bool
+Slots::adapter_exists(const std::string& name)
+{
+    pthread_mutex_lock(&lock_);
+    bool found = !!adapters_.count(name);
+    pthread_mutex_unlock(&lock_);
+    return found;
+}
+
+std::map<std::string, Slots::Adapter>
+Slots::adapter_list()
+{
+    pthread_mutex_lock(&lock_);
+    std::map<std::string, Adapter> res = adapters_;
+    pthread_mutex_unlock(&lock_);
+    return res;
+}
+
+// implements admission control. returns zero if a request arriving
+// now should be allowed to wait its turn in take(), otherwise the
+// number of seconds the client should be told to come back in. the
+// expected wait is the line length times a moving average of how
+// often busy slots have been freeing up under load
+int
+Slots::admission_delay()
+{
+    if (!FLAG_max_queue_time)
+        return 0;
+    pthread_mutex_lock(&lock_);
+    double estimate = 0;
+    if (!free_slots_)
+        estimate = (waiters_ + 1) * avg_release_interval_;
+    pthread_mutex_unlock(&lock_);
+    if (estimate <= FLAG_max_queue_time)
+        return 0;
+    return ceil(estimate);
+}
+
+// returns whether an interactive request is waiting for a slot. batch
+// requests poll this between tokens so they know when to hand back
+// the slot they're holding
+bool
+Slots::interactive_queued()
+{
+    pthread_mutex_lock(&lock_);
+    bool queued = urgent_waiters_ > 0;
+    pthread_mutex_unlock(&lock_);
+    return queued;
+}
+
+// returns how many requests are waiting in take()
+int
+Slots::queue_depth()
+{
+    pthread_mutex_lock(&lock_);
+    int depth = waiters_;
+    pthread_mutex_unlock(&lock_);
+    return depth;
+}
+
+// refreshes the monitoring snapshot that read_state() serves without
+// the lock. must be called with lock_ held, which makes this the
+// seqlock's only writer: the sequence goes odd, the rows get
+// rewritten in place, and it goes even again, so a reader that raced
+// a rewrite sees an odd or changed sequence and retries instead of
+// trusting torn rows
+void
+Slots::publish_state_locked()
+{
+    time_t now = time(0);
+    state_seq_.fetch_add(1, std::memory_order_acq_rel);
+    state_queue_depth_ = waiters_;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        Slot* slot = slots_[i].get();
+        bool idle = false;
+        for (Dll* e = dll_first(free_slots_); e; e = dll_next(free_slots_, e))
+            if (SLOT(e) == slot) {
+                idle = true;
+                break;
+            }
+        state_[i].id = slot->id_;
+        state_[i].idle = idle;
+        state_[i].hibernated = !slot->hibernated_.empty();
+        state_[i].tokens = count_tokens(slot->history_);
+        state_[i].last_used = slot->last_used_;
+        state_[i].cache_value = slot->cache_value(now);
+    }
+    state_seq_.fetch_add(1, std::memory_order_release);
+}
+
+// copies the monitoring snapshot without touching lock_, so load
+// balancer probes can poll as hard as they like while take() and
+// give() fight over the operational lock. returns the queue depth
+// the snapshot was published with
+int
+Slots::read_state(std::vector<SlotState>* out)
+{
+    for (;;) {
+        unsigned seq = state_seq_.load(std::memory_order_acquire);
+        if (seq & 1)
+            continue;
+        int depth = state_queue_depth_;
+        *out = state_;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (state_seq_.load(std::memory_order_relaxed) == seq)
+            return depth;
+    }
 }
 
 } // namespace server
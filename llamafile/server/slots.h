@@ -16,10 +16,17 @@
 // limitations under the License.
 
 #pragma once
+#include "prefix_tree.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <pthread.h>
+#include <string>
 #include <vector>
 
+struct llama_context;
+struct llama_lora_adapter;
 struct llama_model;
 struct Dll;
 
@@ -28,11 +35,38 @@ namespace server {
 
 class Atom;
 class SlotEntry;
+struct Batcher;
+struct Pieces;
 struct Slot;
 
 struct Slots
 {
+    // scheduling classes for take(). interactive waiters always go to
+    // the front of the line. batch waiters yield until the interactive
+    // queue drains or they've aged past --batch-max-wait seconds
+    enum Priority
+    {
+        PRIORITY_BATCH,
+        PRIORITY_INTERACTIVE,
+    };
+
+    // how many completions one request may sample from a single
+    // prompt. the context reserves FANOUT_MAX - 1 sequence ids
+    // beyond the slot pool so branches can share the prompt's kv
+    // cells copy-on-write
+    enum
+    {
+        FANOUT_MAX = 8,
+    };
+
     llama_model* model_;
+    llama_model* draft_model_; // borrowed or null
+    Pieces* pieces_ = nullptr; // owned detokenization table
+
+    // context and scheduler shared by every slot
+    llama_context* ctx_ = nullptr;
+    Batcher* batcher_ = nullptr;
+    long kv_cells_ = 0;
     pthread_cond_t cond_;
     pthread_mutex_t lock_;
     std::vector<std::unique_ptr<Slot>> slots_;
@@ -41,13 +75,91 @@ struct Slots
     // last elements are least recently used
     Dll* free_slots_ = nullptr;
 
-    explicit Slots(llama_model*);
+    // admission control state guarded by lock_. the interval average
+    // only samples releases that happened while requests were queued,
+    // so idle stretches don't pollute the estimate
+    int waiters_ = 0;
+    int urgent_waiters_ = 0;
+    timespec last_give_ = {};
+    double avg_release_interval_ = 0;
+
+    // handoff generation, bumped by give() under lock_ and watched
+    // without it by the spin phase in take(); see spin_for_give()
+    std::atomic<unsigned long> give_seq_{ 0 };
+
+    // monitoring snapshot published by take()/give() while they hold
+    // lock_ anyway, and read through a seqlock, so introspection
+    // endpoints polled by load balancers never touch the operational
+    // lock; see publish_state_locked()
+    struct SlotState
+    {
+        int id;
+        bool idle;
+        bool hibernated;
+        int tokens;
+        long last_used;
+        double cache_value;
+    };
+    std::atomic<unsigned> state_seq_{ 0 }; // odd while being rewritten
+    int state_queue_depth_ = 0;
+    std::vector<SlotState> state_; // sized once by start()
+
+    // indexes free slot histories for prefix matching
+    PrefixTree tree_;
+
+    // opaque identity stapled to session affinity hints. regenerated
+    // every boot, so a hint minted against kv state that no longer
+    // exists can't validate
+    std::string node_token_;
+
+    // spare sequence ids for fan-out branches, guarded by lock_
+    std::vector<int> branch_ids_;
+
+    // tokens that deterministically open the next chat turn under the
+    // active template, e.g. the user header; see prefetch_next_turn()
+    std::vector<Atom> next_turn_;
+
+    // lora adapters loaded at runtime, keyed by the name requests
+    // select with their adapter field. guarded by lock_. handles
+    // stay valid until adapter_unload(), which refuses while any
+    // busy slot still decodes through one
+    struct Adapter
+    {
+        llama_lora_adapter* handle;
+        float scale;
+        std::string path;
+    };
+    std::map<std::string, Adapter> adapters_;
+
+    explicit Slots(llama_model*, llama_model* = nullptr);
     ~Slots();
     size_t size();
     int start(int);
+    void save_snapshots();
+    void restore_snapshots();
+    void warmup();
+    void prefetch_next_turn(Slot*);
     void tokenize(std::vector<Atom>*, std::string_view, bool);
-    Slot* take(const std::vector<Atom>&);
+    Slot* take(const std::vector<Atom>&, const std::string& = "",
+               int = PRIORITY_INTERACTIVE, int = -1);
+    void graft_prefix(Slot*, const std::vector<Atom>&,
+                      const std::vector<uint64_t>&);
+    bool spin_for_give();
     void give(Slot*);
+    int branch_take();
+    void branch_give(int);
+    bool adapter_load(const std::string&, const std::string&, float);
+    int adapter_unload(const std::string&);
+    bool adapter_scale(const std::string&, float);
+    bool adapter_exists(const std::string&);
+    std::map<std::string, Adapter> adapter_list();
+    void reclaim(long);
+    void prepare_next_turn_prefetch();
+    int admission_delay();
+    int queue_depth();
+    bool interactive_queued();
+    void publish_state_locked();
+    int read_state(std::vector<SlotState>*);
 };
 
 } // namespace server
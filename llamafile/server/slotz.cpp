@@ -16,11 +16,16 @@
 // limitations under the License.
 
 #include "client.h"
+#include "llamafile/json.h"
 #include "server.h"
 #include "slot.h"
 #include "slots.h"
 #include "utils.h"
 #include "worker.h"
+#include <cstdio>
+#include <ctime>
+
+using jt::Json;
 
 namespace lf {
 namespace server {
@@ -34,13 +39,66 @@ Client::slotz()
         return send_error(400);
     if (id >= worker_->server_->slots_->size())
         return send_error(404);
-    Slot* slot = worker_->server_->slots_->slots_[id].get();
+    Slots* slots = worker_->server_->slots_;
+    Slot* slot = slots->slots_[id].get();
+    std::vector<Slots::SlotState> state;
+    int depth = slots->read_state(&state);
     std::string dump;
+    char buf[128];
+    snprintf(buf,
+             sizeof(buf),
+             "queue_depth %d\n"
+             "cache_value %g\n\n",
+             depth,
+             state[id].cache_value);
+    dump += buf;
     slot->dump(&dump);
     char* p = append_http_response_message(obuf_.p, 200);
     p = stpcpy(p, "Content-Type: text/plain\r\n");
     return send_response(obuf_.p, p, dump);
 }
 
+// reports which conversations are warm on this node, e.g.
+//
+//     GET /slot-state
+//     {"node": "node_swvjuk3fi3sm",
+//      "queue_depth": 0,
+//      "slots": [{"id": 0,
+//                 "idle": true,
+//                 "tokens": 512,
+//                 "last_used": 1725000000,
+//                 "hibernated": false}]}
+//
+// a load balancer probes this before routing a request that carries
+// an x-slot affinity hint, so returning users only get pinned to the
+// node where their kv cache is actually still warm. load balancers
+// poll this hard, so it reads the snapshot take() and give() publish
+// rather than contending on the lock they hold; see read_state()
+bool
+Client::slot_state()
+{
+    Slots* slots = worker_->server_->slots_;
+    std::vector<Slots::SlotState> state;
+    int depth = slots->read_state(&state);
+    Json json;
+    json["node"] = slots->node_token_;
+    json["queue_depth"] = depth;
+    Json& list = json["slots"];
+    list.setArray();
+    for (const Slots::SlotState& slot : state) {
+        Json& entry = list[list.getArray().size()];
+        entry["id"] = slot.id;
+        entry["idle"] = slot.idle;
+        entry["tokens"] = slot.tokens;
+        entry["last_used"] = slot.last_used;
+        entry["hibernated"] = slot.hibernated;
+    }
+    dump_ = json.toStringPretty();
+    dump_ += '\n';
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
 } // namespace server
 } // namespace lf
@@ -0,0 +1,293 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "snapshot.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/server/atom.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/pieces.h"
+#include "llamafile/server/slot.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace lf {
+namespace server {
+
+std::string
+snapshot_path(int id)
+{
+    std::string base;
+    if (FLAG_db) {
+        base = FLAG_db;
+    } else {
+        const char* home = getenv("HOME");
+        if (home) {
+            base = std::string(home) + "/.llamafile/llamafile.sqlite3";
+        } else {
+            base = "llamafile.sqlite3";
+        }
+    }
+    return base + ".slot" + std::to_string(id) + ".kv";
+}
+
+bool
+snapshot_save(Slot* slot)
+{
+    if (!slot->ctx_)
+        return false;
+
+    // image atoms hold references to request memory and can't be
+    // serialized, so slots that saw images don't get snapshotted
+    for (const Atom& atom : slot->history_)
+        if (!atom.is_token())
+            return false;
+
+    SnapshotHeader header = {};
+    header.magic = SnapshotHeader::kMagic;
+    header.version = SnapshotHeader::kVersion;
+    header.slot_id = slot->id_;
+    strlcpy(header.system_fingerprint,
+            slot->system_fingerprint_.c_str(),
+            sizeof(header.system_fingerprint));
+    header.token_count = slot->history_.size();
+    header.state_size = llama_state_seq_get_size(slot->ctx_, slot->id_);
+
+    std::vector<int> tokens;
+    tokens.reserve(slot->history_.size());
+    for (const Atom& atom : slot->history_)
+        tokens.emplace_back(atom.token());
+
+    std::vector<uint8_t> state(header.state_size);
+    if (llama_state_seq_get_data(slot->ctx_, state.data(), slot->id_) !=
+        header.state_size) {
+        SLOG("failed to serialize kv cache for slot #%d", slot->id_);
+        return false;
+    }
+
+    std::string path = snapshot_path(slot->id_);
+    std::string temp = path + ".tmp";
+    int fd = open(temp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1) {
+        SLOG("%s: failed to create snapshot file", temp.c_str());
+        return false;
+    }
+    bool ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+              write(fd, tokens.data(), tokens.size() * sizeof(int)) ==
+                (ssize_t)(tokens.size() * sizeof(int)) &&
+              write(fd, state.data(), state.size()) == (ssize_t)state.size();
+    ok &= !close(fd);
+    if (!ok || rename(temp.c_str(), path.c_str())) {
+        SLOG("%s: failed to write snapshot file", temp.c_str());
+        unlink(temp.c_str());
+        return false;
+    }
+    SLOG("saved %zu token snapshot for slot #%d",
+         (size_t)header.token_count,
+         slot->id_);
+    return true;
+}
+
+bool
+snapshot_restore(Slot* slot)
+{
+    if (!slot->ctx_)
+        return false;
+    std::string path = snapshot_path(slot->id_);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    // validate mapped snapshot before touching the kv cache
+    const SnapshotHeader* header = (const SnapshotHeader*)map;
+    size_t need = sizeof(*header);
+    bool ok = (size_t)st.st_size >= need &&
+              header->magic == SnapshotHeader::kMagic &&
+              header->version == SnapshotHeader::kVersion &&
+              header->slot_id == (uint32_t)slot->id_ &&
+              !strncmp(header->system_fingerprint,
+                       slot->system_fingerprint_.c_str(),
+                       sizeof(header->system_fingerprint));
+    if (ok) {
+        need += header->token_count * sizeof(int) + header->state_size;
+        ok = (size_t)st.st_size >= need;
+    }
+    if (!ok) {
+        SLOG("%s: ignoring stale snapshot", path.c_str());
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    // kv pages fault in lazily from the mapping as they're copied
+    const int* tokens = (const int*)((const char*)map + sizeof(*header));
+    const uint8_t* state =
+      (const uint8_t*)(tokens + header->token_count);
+    if (!llama_state_seq_set_data(slot->ctx_, state, slot->id_)) {
+        SLOG("%s: failed to restore kv cache", path.c_str());
+        llama_kv_cache_seq_rm(slot->ctx_, slot->id_, -1, -1);
+        munmap(map, st.st_size);
+        return false;
+    }
+    slot->history_.clear();
+    for (uint64_t i = 0; i < header->token_count; ++i)
+        slot->history_.emplace_back(tokens[i]);
+    slot->history_digest_ =
+      atoms_digest(0, slot->history_.data(), slot->history_.size());
+    munmap(map, st.st_size);
+    SLOG("restored %zu token snapshot for slot #%d",
+         (size_t)header->token_count,
+         slot->id_);
+    return true;
+}
+
+// vocabularies of the same size usually are the same tokenizer, and
+// when they aren't the spot check in restore catches it, so the
+// size is enough to keep different model families out of each
+// other's files
+static std::string
+snapshot_pieces_path(int n_vocab)
+{
+    std::string base = snapshot_path(0);
+    base.resize(base.size() - strlen(".slot0.kv"));
+    return base + ".pieces" + std::to_string(n_vocab);
+}
+
+bool
+snapshot_pieces_save(const llama_model* model, const Pieces* pieces)
+{
+    int n_vocab = llama_n_vocab(model);
+
+    PiecesSnapshotHeader header = {};
+    header.magic = PiecesSnapshotHeader::kMagic;
+    header.version = PiecesSnapshotHeader::kVersion;
+    header.n_vocab = n_vocab;
+    header.bytes_size = pieces->bytes_.size();
+
+    // vector<bool> has no storage to point write() at
+    std::vector<char> incomplete(n_vocab);
+    for (int id = 0; id < n_vocab; ++id)
+        incomplete[id] = pieces->incomplete_[id];
+
+    std::string path = snapshot_pieces_path(n_vocab);
+    std::string temp = path + ".tmp";
+    int fd = open(temp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1)
+        return false;
+    ssize_t offsets_size = (n_vocab + 1) * sizeof(unsigned);
+    bool ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+              write(fd, pieces->offsets_.data(), offsets_size) ==
+                offsets_size &&
+              write(fd, incomplete.data(), incomplete.size()) ==
+                (ssize_t)incomplete.size() &&
+              write(fd, pieces->bytes_.data(), pieces->bytes_.size()) ==
+                (ssize_t)pieces->bytes_.size();
+    ok &= !close(fd);
+    if (!ok || rename(temp.c_str(), path.c_str())) {
+        SLOG("%s: failed to write detokenizer snapshot", temp.c_str());
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool
+snapshot_pieces_restore(const llama_model* model, Pieces* pieces)
+{
+    int n_vocab = llama_n_vocab(model);
+    std::string path = snapshot_pieces_path(n_vocab);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    // validate the layout before trusting any of it
+    const PiecesSnapshotHeader* header = (const PiecesSnapshotHeader*)map;
+    size_t need = sizeof(*header);
+    bool ok = (size_t)st.st_size >= need &&
+              header->magic == PiecesSnapshotHeader::kMagic &&
+              header->version == PiecesSnapshotHeader::kVersion &&
+              header->n_vocab == (uint32_t)n_vocab;
+    if (ok) {
+        need += (n_vocab + 1) * sizeof(unsigned) + n_vocab +
+                header->bytes_size;
+        ok = (size_t)st.st_size >= need;
+    }
+    const unsigned* offsets = (const unsigned*)(header + 1);
+    if (ok) {
+        ok = offsets[0] == 0 && offsets[n_vocab] == header->bytes_size;
+        for (int id = 0; ok && id < n_vocab; ++id)
+            ok = offsets[id] <= offsets[id + 1];
+    }
+    if (!ok) {
+        SLOG("%s: ignoring stale detokenizer snapshot", path.c_str());
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    const char* incomplete = (const char*)(offsets + n_vocab + 1);
+    const char* bytes = incomplete + n_vocab;
+    pieces->bytes_.assign(bytes, header->bytes_size);
+    pieces->offsets_.assign(offsets, offsets + n_vocab + 1);
+    pieces->incomplete_.resize(n_vocab);
+    for (int id = 0; id < n_vocab; ++id)
+        pieces->incomplete_[id] = incomplete[id];
+    munmap(map, st.st_size);
+
+    // spot check scattered entries against the live tokenizer. a
+    // table from a different model with the same vocab size renders
+    // differently somewhere in any sample this wide, and identical
+    // tokenizers produce identical tables, so a false match is
+    // harmless by construction
+    for (int i = 0; i < 64; ++i) {
+        int id = (long)i * (n_vocab - 1) / 63;
+        if (!pieces->matches(model, id)) {
+            SLOG("%s: detokenizer snapshot is for another model",
+                 path.c_str());
+            pieces->bytes_.clear();
+            pieces->offsets_.clear();
+            pieces->incomplete_.clear();
+            return false;
+        }
+    }
+    SLOG("restored detokenizer table for %d token vocab", n_vocab);
+    return true;
+}
+
+} // namespace server
+} // namespace lf
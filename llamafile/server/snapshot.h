@@ -0,0 +1,84 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+struct llama_model;
+
+namespace lf {
+namespace server {
+
+struct Pieces;
+struct Slot;
+
+// on disk layout of a slot kv snapshot
+//
+// the header and token list are followed by the blob that
+// llama_state_seq_get_data() produced for the slot's sequence.
+// restore maps the file so warm kv pages fault in lazily.
+struct SnapshotHeader
+{
+    static constexpr uint64_t kMagic = 0x50414e53564bull; // "KVSNAP"
+    static constexpr uint32_t kVersion = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_id;
+    char system_fingerprint[64];
+    uint64_t token_count;
+    uint64_t state_size;
+};
+
+// on disk layout of a detokenization table snapshot
+//
+// startup rebuilds the same derived tables on every boot even
+// though nothing they depend on changed, which an autoscaler pays
+// for on every node it adds. the header is followed by the offset
+// array (n_vocab + 1 entries), one incompleteness byte per token,
+// and the piece arena. restore validates it by spot checking
+// entries against the live tokenizer rather than trusting a path
+// or timestamp, so a table from a different model gets rebuilt
+struct PiecesSnapshotHeader
+{
+    static constexpr uint64_t kMagic = 0x534543454950ull; // "PIECES"
+    static constexpr uint32_t kVersion = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t n_vocab;
+    uint64_t bytes_size;
+};
+
+std::string
+snapshot_path(int);
+
+bool
+snapshot_save(Slot*);
+
+bool
+snapshot_restore(Slot*);
+
+bool
+snapshot_pieces_save(const llama_model*, const Pieces*);
+
+bool
+snapshot_pieces_restore(const llama_model*, Pieces*);
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,140 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stop_matcher.h"
+#include <cstdint>
+#include <map>
+#include <pthread.h>
+
+namespace lf {
+namespace server {
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<uint64_t, std::shared_ptr<const StopMatcher>> g_cache;
+
+// builds the trie of stop sequences, then runs the classic breadth
+// first pass that both computes fail links and folds them into the
+// transition table, so feed() is exactly one lookup per byte
+void
+StopMatcher::compile(const std::vector<std::string>& stops)
+{
+    std::vector<std::vector<int>> node;
+    std::vector<int> fail;
+    node.emplace_back(256, -1);
+    fail.emplace_back(0);
+    match_.emplace_back(false);
+    for (const std::string& stop : stops) {
+        int s = 0;
+        for (char ch : stop) {
+            int c = ch & 255;
+            if (node[s][c] == -1) {
+                node[s][c] = node.size();
+                node.emplace_back(256, -1);
+                fail.emplace_back(0);
+                match_.emplace_back(false);
+            }
+            s = node[s][c];
+        }
+        if (!stop.empty())
+            match_[s] = true;
+    }
+    std::vector<int> bfs;
+    for (int c = 0; c < 256; ++c) {
+        if (node[0][c] == -1) {
+            node[0][c] = 0;
+        } else {
+            bfs.push_back(node[0][c]);
+        }
+    }
+    for (size_t i = 0; i < bfs.size(); ++i) {
+        int s = bfs[i];
+        // a match anywhere along the fail chain is a match here,
+        // which is how stops that are suffixes of other stops fire
+        if (match_[fail[s]])
+            match_[s] = true;
+        for (int c = 0; c < 256; ++c) {
+            if (node[s][c] == -1) {
+                node[s][c] = node[fail[s]][c];
+            } else {
+                fail[node[s][c]] = node[fail[s]][c];
+                bfs.push_back(node[s][c]);
+            }
+        }
+    }
+    next_.resize(node.size() * 256);
+    for (size_t s = 0; s < node.size(); ++s)
+        for (int c = 0; c < 256; ++c)
+            next_[s * 256 + c] = node[s][c];
+    stops_ = stops;
+}
+
+int
+StopMatcher::feed(int state, std::string_view bytes) const
+{
+    for (char ch : bytes) {
+        state = next_[state * 256 + (ch & 255)];
+        if (match_[state])
+            return -1;
+    }
+    return state;
+}
+
+std::shared_ptr<const StopMatcher>
+StopMatcher::get(const std::vector<std::string>& stops)
+{
+    // hash lengths along with bytes so ["ab","c"] and ["a","bc"]
+    // can't collide into the same stop set
+    uint64_t key = 0xcbf29ce484222325;
+    for (const std::string& stop : stops) {
+        for (char ch : stop) {
+            key ^= ch & 255;
+            key *= 0x100000001b3;
+        }
+        key ^= stop.size();
+        key *= 0x100000001b3;
+    }
+    pthread_mutex_lock(&g_lock);
+    auto it = g_cache.find(key);
+    // the key comes straight from request json, so a hit is only
+    // trusted after the stored stop set compares equal: a collision,
+    // engineered or not, degrades to a recompile rather than running
+    // some other request's automaton
+    if (it != g_cache.end() && it->second->stops_ == stops) {
+        std::shared_ptr<const StopMatcher> hit = it->second;
+        pthread_mutex_unlock(&g_lock);
+        return hit;
+    }
+    pthread_mutex_unlock(&g_lock);
+    std::shared_ptr<StopMatcher> made(new StopMatcher);
+    made->compile(stops);
+    pthread_mutex_lock(&g_lock);
+    // templating setups cycle through a small closed set of stop
+    // sets, so the cache should never get near the cap in practice
+    if (g_cache.size() >= 64)
+        g_cache.clear();
+    std::shared_ptr<const StopMatcher>& slot = g_cache[key];
+    // colliding sets take turns owning the entry, which is still
+    // never a wrong answer, just a recompile per turn
+    if (!slot || slot->stops_ != stops)
+        slot = std::move(made);
+    std::shared_ptr<const StopMatcher> res = slot;
+    pthread_mutex_unlock(&g_lock);
+    return res;
+}
+
+} // namespace server
+} // namespace lf
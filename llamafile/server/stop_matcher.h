@@ -0,0 +1,64 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lf {
+namespace server {
+
+// aho-corasick matcher for stop sequences
+//
+// the completion loop used to rescan the tail of its history against
+// every stop sequence after each emitted token. this automaton does
+// one table lookup per emitted byte no matter how many stops a
+// request registers, and stops that straddle token boundaries fall
+// out of the byte level feed for free, with no tokenizer alignment
+// games. fail links are folded into the transition table at compile
+// time, so feeding never loops.
+//
+// compiled automata are immutable, shared, and cached by a hash of
+// the stop set, since templating setups register the same handful of
+// stops on every request. a hit is only trusted after the stored
+// stop set compares equal, so a hash collision degrades to a
+// recompile, never to running some other request's automaton
+struct StopMatcher
+{
+    // returns the automaton for a stop set, compiling it on cache
+    // miss. safe to share across requests and threads
+    static std::shared_ptr<const StopMatcher> get(
+      const std::vector<std::string>&);
+
+    // advances the matcher over emitted bytes. pass 0 at the start
+    // of a stream. returns -1 the moment some stop sequence has
+    // completed, otherwise the state to pass on the next call
+    int feed(int, std::string_view) const;
+
+  private:
+    StopMatcher() = default;
+    void compile(const std::vector<std::string>&);
+
+    std::vector<int> next_; // dense nodes x 256 transition table
+    std::vector<bool> match_; // node ends some stop sequence
+    std::vector<std::string> stops_; // source set, verified on hit
+};
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,91 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/server/stop_matcher.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace lf {
+namespace server {
+namespace {
+
+// feeds the text one byte at a time, like the completion loop does
+// with worst case tokenization, and returns how many bytes it took
+// to hit a stop, or -1 when the text never stops
+int
+stops_after(const StopMatcher& m, std::string_view text)
+{
+    int state = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        state = m.feed(state, text.substr(i, 1));
+        if (state < 0)
+            return i + 1;
+    }
+    return -1;
+}
+
+void
+stop_matcher_test()
+{
+    auto m = StopMatcher::get({ "\n\n", "###", "</s>" });
+
+    if (stops_after(*m, "hello world") != -1)
+        exit(1);
+    if (stops_after(*m, "one\n\ntwo") != 5)
+        exit(1);
+    if (stops_after(*m, "x##y###z") != 7)
+        exit(1);
+    if (stops_after(*m, "a</s>") != 5)
+        exit(1);
+
+    // spanning a token boundary is the same as spanning any byte
+    // boundary, so feeding "<\n" then "\n>" must still fire
+    int state = 0;
+    state = m->feed(state, "<\n");
+    if (state < 0)
+        exit(2);
+    if (m->feed(state, "\n>") >= 0)
+        exit(2);
+
+    // a stop that's a suffix of a longer near miss must still fire
+    auto m2 = StopMatcher::get({ "aab" });
+    if (stops_after(*m2, "aaaab") != 5)
+        exit(3);
+
+    // one stop being a suffix of another fires on the shorter one
+    auto m3 = StopMatcher::get({ "abcd", "cd" });
+    if (stops_after(*m3, "xxcd") != 4)
+        exit(4);
+
+    // the cache hands back the same automaton for the same stop set
+    if (StopMatcher::get({ "\n\n", "###", "</s>" }).get() != m.get())
+        exit(5);
+    if (StopMatcher::get({ "ab", "c" }).get() ==
+        StopMatcher::get({ "a", "bc" }).get())
+        exit(5);
+}
+
+} // namespace
+} // namespace server
+} // namespace lf
+
+int
+main()
+{
+    lf::server::stop_matcher_test();
+}
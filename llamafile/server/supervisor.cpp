@@ -0,0 +1,138 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "supervisor.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/server/log.h"
+#include <cerrno>
+#include <cosmo.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// supervisor mode
+//
+// when --supervise is passed the server forks at startup into a tiny
+// supervisor and a serving child. the supervisor holds a read-only
+// mapping of the model weights and does nothing but wait. if the child
+// exits on purpose the supervisor propagates its status. if the child
+// dies from a signal, the crash report has already been written by the
+// dying process, and the supervisor forks a replacement right away.
+// because the supervisor's mapping keeps the weights referenced in the
+// kernel page cache, the replacement faults them back in from memory
+// rather than disk, turning a crash outage from a full cold model load
+// into one ordinary startup. pairing this with --kv-snapshots lets the
+// replacement also restore its slot contexts from the previous run.
+
+#define FAST_CRASH_SECONDS 30
+#define MAX_FAST_CRASHES 5
+
+namespace lf {
+namespace server {
+
+static volatile pid_t g_child;
+
+static void
+forward_signal(int sig)
+{
+    pid_t child = g_child;
+    if (child > 0)
+        kill(child, sig);
+}
+
+void
+supervise()
+{
+    if (!FLAG_supervise)
+        return;
+
+    // hold the weights in the page cache across child generations.
+    // this mapping is never read; its only job is keeping a live
+    // reference on the file so the kernel won't evict its pages
+    // between the death of one child and the birth of the next
+    if (FLAG_model) {
+        int fd = open(FLAG_model, O_RDONLY);
+        if (fd != -1) {
+            struct stat st;
+            if (!fstat(fd, &st) && st.st_size > 0)
+                mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+    }
+
+    // ctrl-c and service managers signal the supervisor, since it's
+    // the process they spawned, so relay those to whichever child is
+    // currently serving
+    signal(SIGHUP, forward_signal);
+    signal(SIGINT, forward_signal);
+    signal(SIGTERM, forward_signal);
+
+    int fast_crashes = 0;
+    set_thread_name("supervisor");
+    for (;;) {
+        timespec born = timespec_real();
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            exit(1);
+        }
+        if (!pid) {
+            // the child goes on to be the actual server
+            signal(SIGHUP, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            return;
+        }
+        g_child = pid;
+        int ws;
+        while (waitpid(pid, &ws, 0) == -1)
+            if (errno != EINTR) {
+                perror("waitpid");
+                exit(1);
+            }
+        g_child = 0;
+
+        // clean exits are deliberate and don't get respawned
+        if (WIFEXITED(ws))
+            exit(WEXITSTATUS(ws));
+
+        // a server that can't survive startup will crash in a tight
+        // loop forever, which is worse than being down, so give up
+        // once that pattern becomes clear
+        timespec lived = timespec_sub(timespec_real(), born);
+        if (lived.tv_sec < FAST_CRASH_SECONDS) {
+            if (++fast_crashes >= MAX_FAST_CRASHES) {
+                SLOG("server crashed %d times shortly after starting; giving up",
+                     fast_crashes);
+                exit(1);
+            }
+        } else {
+            fast_crashes = 0;
+        }
+        char signame[21];
+        SLOG("server died with %s; forking replacement",
+             strsignal_r(WTERMSIG(ws), signame));
+    }
+}
+
+} // namespace server
+} // namespace lf
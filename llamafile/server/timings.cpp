@@ -0,0 +1,81 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llamafile/json.h"
+#include "server.h"
+#include "slot.h"
+#include "slots.h"
+#include "worker.h"
+
+using jt::Json;
+
+namespace lf {
+namespace server {
+
+// reports the per-token timing rings of every slot, e.g.
+//
+//     GET /timings
+//     {"slots": [{"id": 0,
+//                 "tokens": [{"t": 181818181,
+//                             "decode_us": 9120,
+//                             "write_us": 42}]}]}
+//
+// "t" is a CLOCK_MONOTONIC microsecond stamp taken when the token
+// finished decoding, so a gap between consecutive stamps that dwarfs
+// decode_us + write_us points at scheduling or client backpressure
+// rather than the model. entries run oldest to newest, and the db's
+// per-message aggregates can't answer these questions because a
+// mid-sentence pause averages away
+bool
+Client::timings()
+{
+    Slots* slots = worker_->server_->slots_;
+    Json json;
+    Json& list = json["slots"];
+    list.setArray();
+    pthread_mutex_lock(&slots->lock_);
+    for (const auto& slot : slots->slots_) {
+        Json& entry = list[list.getArray().size()];
+        entry["id"] = slot->id_;
+        Json& toks = entry["tokens"];
+        toks.setArray();
+        // the predicting thread stamps its ring without taking the
+        // slots lock, so on a busy slot the oldest record here may be
+        // mid overwrite; one garbled entry beats a lock in the loop
+        unsigned count = slot->timings_count_;
+        unsigned n = count < (unsigned)Slot::kTimings
+                       ? count
+                       : (unsigned)Slot::kTimings;
+        for (unsigned i = count - n; i != count; ++i) {
+            const Slot::TokenTiming& t = slot->timings_[i % Slot::kTimings];
+            Json& rec = toks[toks.getArray().size()];
+            rec["t"] = t.stamp_us;
+            rec["decode_us"] = t.decode_us;
+            rec["write_us"] = t.write_us;
+        }
+    }
+    pthread_mutex_unlock(&slots->lock_);
+    dump_ = json.toString();
+    dump_ += '\n';
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+} // namespace server
+} // namespace lf
@@ -18,10 +18,15 @@
 #include "tokenbucket.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/tunables.h"
+#include "llamafile/trust.h"
+#include <algorithm>
 #include <assert.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdatomic.h>
+#include <utility>
+#include <vector>
 
 namespace lf {
 namespace server {
@@ -32,9 +37,20 @@ union TokenBucket
     atomic_schar* b;
 };
 
+// buckets covered by a --token-rate-override prefix, which replenish
+// on their own schedule instead of the base one
+struct Tier
+{
+    timespec interval;
+    timespec next;
+    std::vector<std::pair<size_t, size_t>> spans;
+};
+
 static size_t g_words;
 static pthread_t g_thread;
 static TokenBucket g_tokens;
+static std::vector<Tier> g_tiers;
+static std::vector<std::pair<size_t, size_t>> g_base_spans;
 
 static void
 replenish_tokens(atomic_uint_fast64_t* w, size_t n)
@@ -60,23 +76,133 @@ acquire_token(atomic_schar* b, uint32_t x, int c)
     return -t + 127;
 }
 
+static void
+replenish_bucket(size_t i)
+{
+    int t = atomic_load_explicit(g_tokens.b + i, memory_order_relaxed);
+    if (t < 127)
+        atomic_fetch_add_explicit(g_tokens.b + i, 1, memory_order_relaxed);
+}
+
+// adds one token to every bucket in [lo, hi)
+//
+// the interior goes eight buckets at a time with the same saturating
+// swar trick as the full sweep. spans carved out by an override that
+// doesn't fall on a word boundary get their edges topped up a byte
+// at a time.
+static void
+replenish_span(size_t lo, size_t hi)
+{
+    while (lo < hi && (lo & 7))
+        replenish_bucket(lo++);
+    size_t words = (hi - lo) >> 3;
+    if (words) {
+        replenish_tokens(g_tokens.w + (lo >> 3), words);
+        lo += words << 3;
+    }
+    while (lo < hi)
+        replenish_bucket(lo++);
+}
+
+// carves the bucket table into spans owned by the base rate or by
+// the longest matching --token-rate-override prefix, so overlapping
+// overrides nest the way routing tables do
+static void
+plan_tiers()
+{
+    struct Claim
+    {
+        size_t lo;
+        size_t hi;
+        unsigned bits;
+        size_t tier;
+    };
+    g_tiers.clear();
+    g_base_spans.clear();
+    size_t nbuckets = (size_t)1 << FLAG_token_cidr;
+    std::vector<Claim> claims;
+    for (const cidr_rate& o : FLAG_token_rate_overrides) {
+        Tier tier;
+        tier.interval = timespec_frommicros(1e6 / o.rate);
+        size_t lo = (size_t)(o.prefix.ip & (-1u << (32 - o.prefix.bits))) >>
+                    (32 - FLAG_token_cidr);
+        size_t width = o.prefix.bits >= (unsigned)FLAG_token_cidr
+                         ? 1
+                         : (size_t)1 << (FLAG_token_cidr - o.prefix.bits);
+        claims.push_back({ lo, lo + width, o.prefix.bits, g_tiers.size() });
+        g_tiers.emplace_back(std::move(tier));
+    }
+    std::vector<size_t> points{ 0, nbuckets };
+    for (const Claim& claim : claims) {
+        points.push_back(claim.lo);
+        points.push_back(claim.hi);
+    }
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+        size_t lo = points[i];
+        size_t hi = points[i + 1];
+        const Claim* owner = nullptr;
+        for (const Claim& claim : claims)
+            if (claim.lo <= lo && hi <= claim.hi)
+                if (!owner || claim.bits > owner->bits)
+                    owner = &claim;
+        auto& spans = owner ? g_tiers[owner->tier].spans : g_base_spans;
+        if (!spans.empty() && spans.back().second == lo)
+            spans.back().second = hi;
+        else
+            spans.emplace_back(lo, hi);
+    }
+}
+
 void
 tokenbucket_replenish()
 {
-    replenish_tokens(g_tokens.w, g_words);
+    for (const auto& span : g_base_spans)
+        replenish_span(span.first, span.second);
+}
+
+size_t
+tokenbucket_tiers()
+{
+    return g_tiers.size();
+}
+
+void
+tokenbucket_replenish_tier(size_t i)
+{
+    for (const auto& span : g_tiers[i].spans)
+        replenish_span(span.first, span.second);
 }
 
 static void
 tokenbucket_replenisher()
 {
-    timespec rate = timespec_frommicros(1e6 / FLAG_token_rate);
-    timespec next = timespec_add(timespec_real(), rate);
+    timespec now = timespec_real();
+    timespec rate = timespec_frommicros(1e6 / tunables()->token_rate);
+    timespec next = timespec_add(now, rate);
+    for (Tier& tier : g_tiers)
+        tier.next = timespec_add(now, tier.interval);
     for (;;) {
+        // the rate is runtime tunable, so refresh it each wakeup and
+        // a POST /flagz change takes effect within one replenish
+        rate = timespec_frommicros(1e6 / tunables()->token_rate);
         while (timespec_cmp(timespec_real(), next) > 0) {
             tokenbucket_replenish();
             next = timespec_add(next, rate);
         }
-        clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &next, 0);
+        for (size_t i = 0; i < g_tiers.size(); ++i) {
+            while (timespec_cmp(timespec_real(), g_tiers[i].next) > 0) {
+                tokenbucket_replenish_tier(i);
+                g_tiers[i].next =
+                  timespec_add(g_tiers[i].next, g_tiers[i].interval);
+            }
+        }
+        timespec wake = next;
+        for (const Tier& tier : g_tiers)
+            if (timespec_cmp(tier.next, wake) < 0)
+                wake = tier.next;
+        clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wake, 0);
     }
 }
 
@@ -106,6 +232,7 @@ tokenbucket_init()
     if (!(g_tokens.b = (atomic_schar*)malloc(bytes)))
         __builtin_trap();
     memset(g_tokens.b, 127, bytes);
+    plan_tiers();
     if (pthread_create(&g_thread, 0, tokenbucket_thread, 0))
         __builtin_trap();
 }
@@ -117,6 +244,8 @@ tokenbucket_destroy()
     if (pthread_join(g_thread, 0))
         __builtin_trap();
     free(g_tokens.b);
+    std::vector<Tier>().swap(g_tiers);
+    std::vector<std::pair<size_t, size_t>>().swap(g_base_spans);
 }
 
 int
@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #pragma once
+#include <cstddef>
 
 namespace lf {
 namespace server {
@@ -32,5 +33,11 @@ tokenbucket_acquire(unsigned);
 void
 tokenbucket_replenish();
 
+size_t
+tokenbucket_tiers();
+
+void
+tokenbucket_replenish_tier(size_t);
+
 } // namespace server
 } // namespace lf
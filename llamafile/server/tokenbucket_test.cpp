@@ -17,9 +17,11 @@
 
 #include "llamafile/llamafile.h"
 #include "llamafile/server/tokenbucket.h"
+#include "llamafile/trust.h"
 #include <climits>
 #include <cosmo.h>
 #include <cstdlib>
+#include <vector>
 
 namespace lf {
 namespace server {
@@ -66,6 +68,56 @@ tokenbucket_test()
     CheckForMemoryLeaks();
 }
 
+void
+drain(unsigned ip)
+{
+    for (int i = 0; i < 127; ++i)
+        tokenbucket_acquire(ip);
+}
+
+void
+tokenbucket_tier_test()
+{
+    FLAG_token_rate = .0001;
+    FLAG_token_cidr = 24;
+    FLAG_token_rate_overrides.push_back({ { 0x7f000000, 16 }, .0001 });
+    FLAG_token_rate_overrides.push_back({ { 0x7f000100, 24 }, .0001 });
+    tokenbucket_init();
+
+    if (tokenbucket_tiers() != 2)
+        exit(2);
+
+    // one bucket inside the /16, one inside the /24 it carves out,
+    // and one outside both
+    drain(0x7f000201);
+    drain(0x7f000101);
+    drain(0x7e000001);
+
+    // the base sweep only refills buckets no override owns
+    tokenbucket_replenish();
+    if (tokenbucket_acquire(0x7e000001) != 126)
+        exit(2);
+    if (tokenbucket_acquire(0x7f000201) != 127)
+        exit(2);
+    if (tokenbucket_acquire(0x7f000101) != 127)
+        exit(2);
+
+    // the /16 tier's spans skip the more specific /24 inside it
+    tokenbucket_replenish_tier(0);
+    if (tokenbucket_acquire(0x7f000201) != 126)
+        exit(2);
+    if (tokenbucket_acquire(0x7f000101) != 127)
+        exit(2);
+
+    tokenbucket_replenish_tier(1);
+    if (tokenbucket_acquire(0x7f000101) != 126)
+        exit(2);
+
+    tokenbucket_destroy();
+    std::vector<cidr_rate>().swap(FLAG_token_rate_overrides);
+    CheckForMemoryLeaks();
+}
+
 } // namespace
 } // namespace server
 } // namespace lf
@@ -74,4 +126,5 @@ int
 main()
 {
     lf::server::tokenbucket_test();
+    lf::server::tokenbucket_tier_test();
 }
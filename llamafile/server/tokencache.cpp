@@ -0,0 +1,162 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tokencache.h"
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// short prompt tokenization cache
+//
+// high qps autocomplete traffic sends the same short prompts over and
+// over, and each one walks the byte pair merge loop from scratch. the
+// merge rank tables live inside the vocab where this layer can't see
+// them, but the result of tokenizing a given byte string is a pure
+// function of the model, the text, and the special token flag, so the
+// whole answer can be memoized up here. entries are keyed by an fnv1a
+// hash and a hit is only trusted after the cached text compares equal
+// byte for byte, so a collision just means a miss, never wrong tokens.
+//
+// only small texts are cached since big documents don't repeat and
+// already go through the parallel chunked path.
+//
+// worker threads handling requests are subject to pthread_cancel(),
+// so nothing that's a cancelation point may happen under the lock.
+
+#define MAX_ENTRIES 256
+#define MAX_TEXT 4096
+
+namespace lf {
+namespace server {
+
+struct TokenCacheEntry
+{
+    uint64_t stamp;
+    const llama_model* model;
+    bool parse_special;
+    std::string text;
+    std::vector<int> tokens;
+};
+
+static uint64_t g_stamp;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<uint64_t, TokenCacheEntry> g_entries;
+
+static uint64_t
+tokencache_hash(const llama_model* model,
+                const std::string_view& text,
+                bool parse_special)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < text.size(); ++i) {
+        h ^= (unsigned char)text[i];
+        h *= 0x100000001b3;
+    }
+    h ^= (uintptr_t)model;
+    h *= 0x100000001b3;
+    h ^= parse_special;
+    h *= 0x100000001b3;
+    return h;
+}
+
+// looks up earlier tokenization of text. on a hit the cached tokens
+// are appended to `result` and true is returned
+bool
+tokencache_get(const llama_model* model,
+               const std::string_view& text,
+               bool parse_special,
+               std::vector<int>* result)
+{
+    if (text.size() > MAX_TEXT)
+        return false;
+    uint64_t key = tokencache_hash(model, text, parse_special);
+    bool got = false;
+    pthread_mutex_lock(&g_lock);
+    auto e = g_entries.find(key);
+    if (e != g_entries.end()) {
+        TokenCacheEntry& entry = e->second;
+        if (entry.model == model && //
+            entry.parse_special == parse_special &&
+            entry.text.size() == text.size() &&
+            !memcmp(entry.text.data(), text.data(), text.size())) {
+            entry.stamp = ++g_stamp;
+            result->insert(
+              result->end(), entry.tokens.begin(), entry.tokens.end());
+            got = true;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return got;
+}
+
+// remembers tokenization of text. the least recently used entry is
+// evicted once the cache is full
+void
+tokencache_put(const llama_model* model,
+               const std::string_view& text,
+               bool parse_special,
+               const std::vector<int>& tokens)
+{
+    if (text.size() > MAX_TEXT)
+        return;
+    uint64_t key = tokencache_hash(model, text, parse_special);
+    pthread_mutex_lock(&g_lock);
+    TokenCacheEntry& entry = g_entries[key];
+    entry.stamp = ++g_stamp;
+    entry.model = model;
+    entry.parse_special = parse_special;
+    entry.text = text;
+    entry.tokens = tokens;
+    while (g_entries.size() > MAX_ENTRIES) {
+        auto oldest = g_entries.begin();
+        for (auto e = g_entries.begin(); e != g_entries.end(); ++e)
+            if (e->second.stamp < oldest->second.stamp)
+                oldest = e;
+        g_entries.erase(oldest);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+// forgets tokenizations of a model that's being unloaded, since the
+// allocator could hand a future model the same address
+void
+tokencache_invalidate(const llama_model* model)
+{
+    pthread_mutex_lock(&g_lock);
+    for (auto e = g_entries.begin(); e != g_entries.end();) {
+        if (e->second.model == model)
+            e = g_entries.erase(e);
+        else
+            ++e;
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void
+tokencache_destroy()
+{
+    pthread_mutex_lock(&g_lock);
+    std::map<uint64_t, TokenCacheEntry>().swap(g_entries);
+    pthread_mutex_unlock(&g_lock);
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,74 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/server/tokencache.h"
+#include <cosmo.h>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+namespace lf {
+namespace server {
+namespace {
+
+void
+tokencache_test()
+{
+    llama_model* model_a = (llama_model*)1;
+    llama_model* model_b = (llama_model*)2;
+    std::vector<int> tokens = { 1, 2, 3 };
+    std::vector<int> got;
+
+    // miss before put, hit after, appending to what's there
+    if (tokencache_get(model_a, "hello", false, &got))
+        exit(1);
+    tokencache_put(model_a, "hello", false, tokens);
+    got = { 9 };
+    if (!tokencache_get(model_a, "hello", false, &got))
+        exit(1);
+    if (got != std::vector<int>{ 9, 1, 2, 3 })
+        exit(1);
+
+    // the flag and the model are part of the key
+    got.clear();
+    if (tokencache_get(model_a, "hello", true, &got))
+        exit(2);
+    if (tokencache_get(model_b, "hello", false, &got))
+        exit(2);
+
+    // unloading a model takes its entries with it
+    tokencache_put(model_b, "hello", false, tokens);
+    tokencache_invalidate(model_a);
+    got.clear();
+    if (tokencache_get(model_a, "hello", false, &got))
+        exit(3);
+    if (!tokencache_get(model_b, "hello", false, &got))
+        exit(3);
+
+    tokencache_destroy();
+    CheckForMemoryLeaks();
+}
+
+} // namespace
+} // namespace server
+} // namespace lf
+
+int
+main()
+{
+    lf::server::tokencache_test();
+}
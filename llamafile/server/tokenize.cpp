@@ -63,7 +63,7 @@ Client::get_tokenize_params(TokenizeParams* params)
         } else if (IsMimeType(HeaderData(kHttpContentType),
                               HeaderLength(kHttpContentType),
                               "application/json")) {
-            auto [status, json] = Json::parse(std::string(payload_));
+            auto [status, json] = Json::parse(payload_);
             if (status != Json::success)
                 return send_error(400, Json::StatusToString(status));
             if (!json.isObject())
@@ -100,6 +100,10 @@ Client::tokenize()
     if (!get_tokenize_params(params))
         return false;
 
+    // the documented contract says prompts are utf-8
+    if (!is_valid_utf8(params->prompt))
+        return send_error(400, "prompt must be valid UTF-8");
+
     // setup statistics
     rusage rustart = {};
     getrusage(RUSAGE_THREAD, &rustart);
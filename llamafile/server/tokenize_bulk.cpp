@@ -0,0 +1,242 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/json.h"
+#include "llamafile/pool.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/utils.h"
+#include <cosmo.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using jt::Json;
+
+namespace lf {
+namespace server {
+namespace {
+
+// one element of a bulk tokenize request. `out` points into a batch
+// arena sized for the worst case, so workers never allocate
+struct BulkJob
+{
+    const llama_model* model;
+    std::string_view text;
+    llama_token* out;
+    int cap;
+    int count;
+    bool add_special;
+    bool parse_special;
+};
+
+void*
+bulk_tokenize_job(void* arg)
+{
+    BulkJob* job = (BulkJob*)arg;
+    job->count = llama_tokenize(job->model,
+                                job->text.data(),
+                                job->text.size(),
+                                job->out,
+                                job->cap,
+                                job->add_special,
+                                job->parse_special);
+    return nullptr;
+}
+
+} // namespace
+
+// handles POST /tokenize/bulk
+//
+// takes {"input": ["...", ...]} and tokenizes the elements across
+// pool threads, through the exact same tokenizer the serving path
+// uses. token ids come back as {"tokens": [[...], ...]}, or with
+// "format": "binary" as little-endian packed words: a uint32 element
+// count, that many uint32 lengths, then the int32 token ids of every
+// element concatenated, which spares both sides the cost of pushing
+// billions of numbers through json for dataset preparation
+bool
+Client::tokenize_bulk()
+{
+    if (msg_.method != kHttpPost)
+        return send_error(405);
+
+    if (!read_payload())
+        return false;
+
+    auto [status, json] = Json::parse(payload_);
+    if (status != Json::success)
+        return send_error(400, Json::StatusToString(status));
+    if (!json.isObject())
+        return send_error(400, "JSON body must be an object");
+    if (!json["input"].isArray())
+        return send_error(400, "JSON missing \"input\" array");
+    bool add_special = true;
+    bool parse_special = false;
+    if (json["add_special"].isBool())
+        add_special = json["add_special"].getBool();
+    if (json["parse_special"].isBool())
+        parse_special = json["parse_special"].getBool();
+    bool binary = json["format"].isString() && //
+                  json["format"].getString() == "binary";
+
+    // check inputs and size the arena before anything gets spawned
+    std::vector<Json>& input = json["input"].getArray();
+    size_t n = input.size();
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!input[i].isString())
+            return send_error(400, "input elements must be strings");
+        std::string& text = input[i].getString();
+        if (!is_valid_utf8(text))
+            return send_error(400, "input must be valid UTF-8");
+        total += text.size() + 16;
+    }
+
+    // tokenize elements across pool threads, keeping a window of
+    // tasks in flight so huge batches don't spawn a thread apiece
+    std::vector<llama_token> arena(total);
+    std::vector<BulkJob> jobs(n);
+    std::vector<llamafile_task_t> tasks(n);
+    std::vector<char> live(n, 0);
+    size_t window = __get_cpu_count();
+    size_t off = 0;
+    for (size_t i = 0; i < n; ++i) {
+        std::string& text = input[i].getString();
+        jobs[i].model = model_;
+        jobs[i].text = text;
+        jobs[i].out = &arena[off];
+        jobs[i].cap = text.size() + 16;
+        jobs[i].add_special = add_special;
+        jobs[i].parse_special = parse_special;
+        off += jobs[i].cap;
+        if (i >= window && live[i - window]) {
+            llamafile_task_join(tasks[i - window], 0);
+            live[i - window] = 0;
+        }
+        if (!llamafile_task_create(&tasks[i], bulk_tokenize_job, &jobs[i]))
+            live[i] = 1;
+        else
+            bulk_tokenize_job(&jobs[i]);
+    }
+    for (size_t i = 0; i < n; ++i)
+        if (live[i])
+            llamafile_task_join(tasks[i], 0);
+    for (size_t i = 0; i < n; ++i)
+        if (jobs[i].count < 0) {
+            SLOG("llama_tokenize failed");
+            return send_error(405);
+        }
+
+    // serialize response
+    dump_.clear();
+    if (binary) {
+        uint32_t word = n;
+        dump_.append((char*)&word, sizeof(word));
+        for (size_t i = 0; i < n; ++i) {
+            word = jobs[i].count;
+            dump_.append((char*)&word, sizeof(word));
+        }
+        for (size_t i = 0; i < n; ++i)
+            dump_.append((char*)jobs[i].out,
+                         jobs[i].count * sizeof(llama_token));
+    } else {
+        dump_ += "{\"tokens\": [";
+        for (size_t i = 0; i < n; ++i) {
+            if (i)
+                dump_ += ',';
+            dump_ += '[';
+            char ibuf[21];
+            for (int j = 0; j < jobs[i].count; ++j) {
+                if (j)
+                    dump_ += ',';
+                dump_.append(ibuf, FormatInt32(ibuf, jobs[i].out[j]) - ibuf);
+            }
+            dump_ += ']';
+        }
+        dump_ += "]}\n";
+    }
+
+    // send response
+    char* p = append_http_response_message(obuf_.p, 200);
+    if (binary)
+        p = stpcpy(p, "Content-Type: application/octet-stream\r\n");
+    else
+        p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+// handles POST /detokenize/bulk
+//
+// takes {"input": [[token ids...], ...]} and renders each element
+// back into text, as {"content": ["...", ...]}. pieces are rendered
+// the same way /tokenize renders its token strings
+bool
+Client::detokenize_bulk()
+{
+    if (msg_.method != kHttpPost)
+        return send_error(405);
+
+    if (!read_payload())
+        return false;
+
+    auto [status, json] = Json::parse(payload_);
+    if (status != Json::success)
+        return send_error(400, Json::StatusToString(status));
+    if (!json.isObject())
+        return send_error(400, "JSON body must be an object");
+    if (!json["input"].isArray())
+        return send_error(400, "JSON missing \"input\" array");
+
+    int n_vocab = llama_n_vocab(model_);
+    std::vector<Json>& input = json["input"].getArray();
+    Json response;
+    Json& content = response["content"];
+    content.setArray();
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (!input[i].isArray())
+            return send_error(400, "input elements must be arrays");
+        std::string text;
+        std::vector<Json>& toks = input[i].getArray();
+        for (size_t j = 0; j < toks.size(); ++j) {
+            if (!toks[j].isLong())
+                return send_error(400, "tokens must be integers");
+            long tok = toks[j].getLong();
+            if (tok < 0 || tok >= n_vocab)
+                return send_error(400, "token id out of range");
+            char s[32];
+            int len = llama_token_to_piece(model_, tok, s, sizeof(s), //
+                                           false, true);
+            if (len < 0) {
+                SLOG("failed to turn token into string");
+                return send_error(405);
+            }
+            text.append(s, len);
+        }
+        content.getArray().emplace_back(std::move(text));
+    }
+    dump_ = response.toString();
+    dump_ += '\n';
+
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,46 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llamafile/trace.h"
+#include <cstdlib>
+
+namespace lf {
+namespace server {
+
+// serves the trace buffer as chrome trace event json, so a timeline
+// of a live server under --trace can be pulled with curl and dropped
+// straight into chrome://tracing/ or ui.perfetto.dev
+bool
+Client::tracez()
+{
+    char* buf = nullptr;
+    size_t size = 0;
+    FILE* file = open_memstream(&buf, &size);
+    if (!file)
+        return send_error(500);
+    llamafile_trace_dump(file);
+    fclose(file);
+    dump_.assign(buf, size);
+    free(buf);
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+} // namespace server
+} // namespace lf
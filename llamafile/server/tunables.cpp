@@ -0,0 +1,81 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tunables.h"
+#include "llamafile/llamafile.h"
+#include <atomic>
+#include <pthread.h>
+#include <vector>
+
+namespace lf {
+namespace server {
+
+static std::atomic<const Tunables*> g_current;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<const Tunables*> g_retired;
+
+// seeds the first snapshot from the flag globals the parser filled
+// in. lazy so flag parsing always finishes first no matter which
+// thread reads a tunable earliest
+static const Tunables*
+tunables_boot()
+{
+    pthread_mutex_lock(&g_lock);
+    const Tunables* t = g_current.load(std::memory_order_relaxed);
+    if (!t) {
+        Tunables* boot = new Tunables;
+        boot->temperature = FLAG_temperature;
+        boot->top_p = FLAG_top_p;
+        boot->presence_penalty = FLAG_presence_penalty;
+        boot->frequency_penalty = FLAG_frequency_penalty;
+        boot->token_rate = FLAG_token_rate;
+        boot->token_burst = FLAG_token_burst;
+        g_retired.push_back(boot);
+        g_current.store(boot, std::memory_order_release);
+        t = boot;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return t;
+}
+
+// returns the current snapshot. the pointer stays valid for as long
+// as the caller holds it, so reading several fields of one snapshot
+// always sees one consistent configuration
+const Tunables*
+tunables()
+{
+    const Tunables* t = g_current.load(std::memory_order_acquire);
+    if (!t)
+        t = tunables_boot();
+    return t;
+}
+
+// publishes a new snapshot. readers holding the old one keep it;
+// new reads see the new one
+void
+tunables_set(const Tunables& next)
+{
+    tunables(); // force boot so next can't be the first snapshot
+    pthread_mutex_lock(&g_lock);
+    const Tunables* t = new Tunables(next);
+    g_retired.push_back(t);
+    g_current.store(t, std::memory_order_release);
+    pthread_mutex_unlock(&g_lock);
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,48 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+namespace lf {
+namespace server {
+
+// server parameters that may be retuned on a live server
+//
+// flag globals are plain variables the parser fills in before any
+// worker exists, so they can't change safely once traffic starts,
+// and restarting just to adjust one dumps every warm kv cache. the
+// few an operator actually wants to turn at runtime live here
+// instead. readers take one immutable snapshot with an acquire
+// load; POST /flagz builds a new snapshot and publishes it with a
+// release store. retired snapshots are parked until exit rather
+// than reference counted, since updates are rare operator actions
+// and a snapshot is a few dozen bytes
+struct Tunables
+{
+    float temperature;
+    float top_p;
+    float presence_penalty;
+    float frequency_penalty;
+    double token_rate;
+    int token_burst;
+};
+
+const Tunables* tunables();
+void tunables_set(const Tunables&);
+
+} // namespace server
+} // namespace lf
@@ -18,9 +18,94 @@
 #include "utils.h"
 #include <string>
 
+#ifdef __SSE2__
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace lf {
 namespace server {
 
+// checks that a buffer holds well-formed utf-8
+//
+// this runs over request bodies before they're handed to the
+// tokenizer, so ascii (the overwhelmingly common case) is skipped
+// sixteen bytes per iteration with the same vector guards fastjson
+// uses, and only the multibyte sequences fall through to the scalar
+// checks for continuation bytes, overlongs, surrogates, and code
+// points past u+10ffff.
+bool is_valid_utf8(const std::string_view s) {
+    size_t i = 0;
+    size_t n = s.size();
+    while (i < n) {
+        unsigned char c = s[i];
+
+        // the vector skip only engages from an ascii byte, so dense
+        // runs of multibyte text don't pay for a wasted load and
+        // branch before every sequence they decode
+        if (c < 0x80) {
+            ++i;
+#ifdef __SSE2__
+            while (i + 16 <= n) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(s.data() + i));
+                int mask = _mm_movemask_epi8(v);
+                if (mask) {
+                    i += __builtin_ctz(mask); // keep the clean prefix
+                    break;
+                }
+                i += 16;
+            }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            while (i + 16 <= n) {
+                uint8x16_t v = vld1q_u8((const uint8_t*)s.data() + i);
+                uint8x16_t bad = vcgtq_u8(v, vdupq_n_u8(127));
+                uint64_t lo = vgetq_lane_u64(vreinterpretq_u64_u8(bad), 0);
+                uint64_t hi = vgetq_lane_u64(vreinterpretq_u64_u8(bad), 1);
+                if (lo | hi) {
+                    i += lo ? __builtin_ctzll(lo) >> 3 // clean prefix
+                            : 8 + (__builtin_ctzll(hi) >> 3);
+                    break;
+                }
+                i += 16;
+            }
+#endif
+            continue;
+        }
+        unsigned need, cp;
+        if ((c & 0xE0) == 0xC0) {
+            if (c < 0xC2)
+                return false; // overlong two byte form
+            need = 1;
+            cp = c & 0x1F;
+        } else if ((c & 0xF0) == 0xE0) {
+            need = 2;
+            cp = c & 0x0F;
+        } else if ((c & 0xF8) == 0xF0) {
+            if (c > 0xF4)
+                return false; // would exceed u+10ffff
+            need = 3;
+            cp = c & 0x07;
+        } else {
+            return false; // continuation or invalid lead byte
+        }
+        if (n - i <= need)
+            return false; // truncated sequence
+        for (unsigned j = 1; j <= need; ++j) {
+            unsigned char b = s[i + j];
+            if ((b & 0xC0) != 0x80)
+                return false;
+            cp = cp << 6 | (b & 0x3F);
+        }
+        if (need == 2 && (cp < 0x800 || (0xD800 <= cp && cp <= 0xDFFF)))
+            return false;
+        if (need == 3 && (cp < 0x10000 || cp > 0x10FFFF))
+            return false;
+        i += need + 1;
+    }
+    return true;
+}
+
 bool ends_with_incomplete_utf8(const std::string& str) {
     for (unsigned i = 1; i <= 4 && i <= str.size(); ++i) {
         unsigned char c = str[str.size() - i];
@@ -0,0 +1,158 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/bench.h"
+#include "llamafile/server/utils.h"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#define ITERATIONS 10000
+
+namespace lf {
+namespace server {
+
+// scalar reference used to keep the benchmark honest
+static bool is_valid_utf8_scalar(const std::string_view s) {
+    size_t i = 0;
+    while (i < s.size()) {
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        unsigned need;
+        if ((c & 0xE0) == 0xC0 && c >= 0xC2)
+            need = 1;
+        else if ((c & 0xF0) == 0xE0)
+            need = 2;
+        else if ((c & 0xF8) == 0xF0 && c <= 0xF4)
+            need = 3;
+        else
+            return false;
+        if (s.size() - i <= need)
+            return false;
+        unsigned cp = c & (0x3F >> need);
+        for (unsigned j = 1; j <= need; ++j) {
+            unsigned char b = s[i + j];
+            if ((b & 0xC0) != 0x80)
+                return false;
+            cp = cp << 6 | (b & 0x3F);
+        }
+        if (need == 2 && (cp < 0x800 || (0xD800 <= cp && cp <= 0xDFFF)))
+            return false;
+        if (need == 3 && (cp < 0x10000 || cp > 0x10FFFF))
+            return false;
+        i += need + 1;
+    }
+    return true;
+}
+
+int utf_test() {
+    if (!is_valid_utf8(""))
+        return 1;
+    if (!is_valid_utf8("the quick brown fox jumps over the lazy dog"))
+        return 2;
+    if (!is_valid_utf8("naïve café résumé"))
+        return 3;
+    if (!is_valid_utf8("日本語のテキスト"))
+        return 4;
+    if (!is_valid_utf8("𐌰𐌱𐌲 gothic beyond the bmp"))
+        return 5;
+    if (!is_valid_utf8(std::string_view("nul \0 byte is fine", 18)))
+        return 6;
+
+    // a bad byte after more than sixteen clean ascii bytes, so the
+    // vector loop has to hand off at the right position
+    if (is_valid_utf8("0123456789abcdefgh\xff"))
+        return 7;
+
+    // lone continuation and lead bytes
+    if (is_valid_utf8("\x80"))
+        return 8;
+    if (is_valid_utf8("\xc3"))
+        return 9;
+    if (is_valid_utf8("\xe2\x82"))
+        return 10;
+    if (is_valid_utf8("\xf0\x9f\x98"))
+        return 11;
+
+    // overlong encodings
+    if (is_valid_utf8("\xc0\xaf"))
+        return 12;
+    if (is_valid_utf8("\xc1\xbf"))
+        return 13;
+    if (is_valid_utf8("\xe0\x80\xaf"))
+        return 14;
+    if (is_valid_utf8("\xf0\x80\x80\xaf"))
+        return 15;
+
+    // utf-16 surrogates are not code points
+    if (is_valid_utf8("\xed\xa0\x80"))
+        return 16;
+    if (is_valid_utf8("\xed\xbf\xbf"))
+        return 17;
+
+    // u+10ffff is the last code point
+    if (!is_valid_utf8("\xf4\x8f\xbf\xbf"))
+        return 18;
+    if (is_valid_utf8("\xf4\x90\x80\x80"))
+        return 19;
+    if (is_valid_utf8("\xf5\x80\x80\x80"))
+        return 20;
+
+    // continuation byte can't follow a complete sequence
+    if (is_valid_utf8("\xc3\xa9\xa9"))
+        return 21;
+
+    // agreement with the scalar reference over every two byte prefix
+    for (int a = 0; a < 256; ++a) {
+        for (int b = 0; b < 256; ++b) {
+            char buf[2] = { (char)a, (char)b };
+            std::string_view sv(buf, 2);
+            if (is_valid_utf8(sv) != is_valid_utf8_scalar(sv))
+                return 22;
+        }
+    }
+
+    return 0;
+}
+
+// keeps the optimizer from discarding the pure calls under test
+static volatile bool g_sink;
+
+void utf_bench() {
+    std::string ascii(8192, 'x');
+    std::string mixed;
+    for (int i = 0; i < 256; ++i)
+        mixed += "mostly ascii with some µ and 日本語 mixed in ";
+    BENCH(g_sink = is_valid_utf8(ascii));
+    BENCH(g_sink = is_valid_utf8_scalar(ascii));
+    BENCH(g_sink = is_valid_utf8(mixed));
+    BENCH(g_sink = is_valid_utf8_scalar(mixed));
+}
+
+} // namespace server
+} // namespace lf
+
+int main() {
+    int rc;
+    if ((rc = lf::server::utf_test()))
+        return rc;
+    lf::server::utf_bench();
+}
@@ -38,6 +38,15 @@ atob(std::string_view, bool);
 std::string_view
 or_empty(std::optional<std::string_view> x);
 
+bool
+header_has_token(std::string_view, std::string_view);
+
+bool
+is_compressible(std::string_view);
+
+bool
+gzip_all(std::string_view, std::string*);
+
 void
 atomize(const llama_model* model,
         std::vector<Atom>* result,
@@ -53,5 +62,8 @@ count_tokens(const std::vector<Atom>&);
 bool
 ends_with_incomplete_utf8(const std::string& str);
 
+bool
+is_valid_utf8(const std::string_view);
+
 } // namespace server
 } // namespace lf
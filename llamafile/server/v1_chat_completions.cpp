@@ -18,13 +18,22 @@
 #include "client.h"
 #include "llama.cpp/llama.h"
 #include "llama.cpp/sampling.h"
+#include "llamafile/b64.h"
 #include "llamafile/json.h"
 #include "llamafile/llama.h"
+#include "llamafile/llamafile.h"
 #include "llamafile/macros.h"
 #include "llamafile/server/atom.h"
+#include "llamafile/server/batcher.h"
 #include "llamafile/server/cleanup.h"
+#include "llamafile/server/completioncache.h"
+#include "llamafile/server/deadline.h"
 #include "llamafile/server/fastjson.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/metering.h"
+#include "llamafile/server/metrics.h"
+#include "llamafile/server/pieces.h"
+#include "llamafile/server/rendercache.h"
 #include "llamafile/server/server.h"
 #include "llamafile/server/slot.h"
 #include "llamafile/server/slots.h"
@@ -47,7 +56,11 @@ struct V1ChatCompletionParams
 {
     bool stream = false;
     bool stream_include_usage = false;
+    bool logprobs = false;
+    bool logprobs_binary = false;
+    long top_logprobs = 0;
     long max_tokens = -1;
+    long context_window = 0;
     long seed = _rand64();
     double top_p = 1;
     double temperature = 1;
@@ -55,9 +68,11 @@ struct V1ChatCompletionParams
     double frequency_penalty = 0;
     std::string user;
     std::string model;
+    std::string adapter;
     std::vector<llama_chat_msg> messages;
     std::vector<std::vector<Atom>> stop;
     std::string grammar;
+    std::string cache_key;
 
     void add_stop(llama_model* model, const std::string& text)
     {
@@ -116,7 +131,7 @@ cleanup_slot(void* arg)
 {
     Client* client = (Client*)arg;
     if (client->slot_) {
-        client->worker_->server_->slots_->give(client->slot_);
+        client->slots()->give(client->slot_);
         client->slot_ = nullptr;
     }
 }
@@ -156,15 +171,6 @@ create_sampler(const V1ChatCompletionParams* params)
     return llama_sampling_init(sparams);
 }
 
-static std::string
-make_event(const Json& json)
-{
-    std::string s = "data: ";
-    s += json.toString();
-    s += "\n\n";
-    return s;
-}
-
 static int
 has_images(const std::vector<Atom>& atoms)
 {
@@ -183,6 +189,80 @@ count_bytes(const std::vector<llama_chat_msg>& messages)
     return n;
 }
 
+// renders the records for one sampled token into the response shape
+// openai documents for logprobs. recs[0] is the token that actually
+// got sampled; recs[1..n_probs] are the likeliest alternatives
+static void
+append_logprob_entry(Json& content,
+                     const Pieces* pieces,
+                     const TokenProb* recs,
+                     int n_probs)
+{
+    Json& entry = content[content.getArray().size()];
+    entry["token"] = std::string(pieces->view(recs[0].token_));
+    entry["logprob"] = recs[0].logprob_;
+    Json& top = entry["top_logprobs"];
+    top.setArray();
+    for (int i = 1; i <= n_probs; ++i) {
+        Json& alt = top[top.getArray().size()];
+        alt["token"] = std::string(pieces->view(recs[i].token_));
+        alt["logprob"] = recs[i].logprob_;
+    }
+}
+
+// appends a json string literal using the simd escaper in fastjson,
+// which needs room for the worst case where every byte goes \uXXXX
+static void
+append_json_string(std::string* b, const std::string_view s)
+{
+    size_t off = b->size();
+    b->resize(off + s.size() * 6 + 8);
+    b->resize(encode_json(b->data() + off, s) - b->data());
+}
+
+// streaming resends the same chunk json hundreds of times per second
+// with only the token text and the timestamp changing, so the fixed
+// spans (keys, punctuation, id, model, fingerprint) get laid down once
+// when the response starts, and each event is two span copies plus the
+// escaped delta and a formatted integer. requests that want logprobs
+// carry a variable subtree in every chunk and stay on the json tree.
+// the spans mirror the std::map key order Json::toString() would emit
+struct ChunkTemplate
+{
+    std::string head_; // opens the object through "content":
+    std::string mid_; // closes the delta through "created":
+    std::string tail_; // constant trailer after the timestamp
+    std::string event_; // rendered chunk, reused across tokens
+
+    void init(const std::string_view id,
+              const std::string_view model,
+              const std::string_view fingerprint)
+    {
+        head_ = "{\"choices\":[{\"delta\":{\"content\":";
+        mid_ = "},\"finish_reason\":null,\"index\":0,"
+               "\"logprobs\":null}],\"created\":";
+        tail_ = ",\"id\":";
+        append_json_string(&tail_, id);
+        tail_ += ",\"model\":";
+        append_json_string(&tail_, model);
+        tail_ += ",\"object\":\"chat.completion\",\"system_fingerprint\":";
+        append_json_string(&tail_, fingerprint);
+        tail_ += '}';
+    }
+
+    const std::string& render(const std::string_view piece, long created)
+    {
+        char num[24];
+        event_.clear();
+        event_ += head_;
+        append_json_string(&event_, piece);
+        event_ += mid_;
+        event_.append(num, encode_json(num, created) - num);
+        event_ += tail_;
+        return event_;
+    }
+};
+
 bool
 Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
 {
@@ -199,7 +279,7 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
         return false;
 
     // object<model, messages, ...>
-    auto [status, json] = Json::parse(std::string(payload_));
+    auto [status, json] = Json::parse(payload_);
     if (status != Json::success)
         return send_error(400, Json::StatusToString(status));
     if (!json.isObject())
@@ -210,16 +290,12 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
         return send_error(400, "OpenAI tools field not supported yet");
     if (json.contains("audio"))
         return send_error(400, "OpenAI audio field not supported yet");
-    if (json.contains("logprobs"))
-        return send_error(400, "OpenAI logprobs field not supported yet");
     if (json.contains("functions"))
         return send_error(400, "OpenAI functions field not supported yet");
     if (json.contains("modalities"))
         return send_error(400, "OpenAI modalities field not supported yet");
     if (json.contains("tool_choice"))
         return send_error(400, "OpenAI tool_choice field not supported yet");
-    if (json.contains("top_logprobs"))
-        return send_error(400, "OpenAI top_logprobs field not supported yet");
     if (json.contains("function_call"))
         return send_error(400, "OpenAI function_call field not supported yet");
     if (json.contains("parallel_tool_calls"))
@@ -230,6 +306,8 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
     if (!model.isString())
         return send_error(400, "JSON missing model string");
     params->model = model.getString();
+    if (!use_model(params->model))
+        return send_error(500, "failed to load model");
 
     // messages: array<object<role:string, content:string>>
     if (!json["messages"].isArray())
@@ -295,6 +373,53 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
             return send_error(400, "n field must be 1 if specified");
     }
 
+    // logprobs: bool|null
+    //
+    // Whether to return log probabilities of the output tokens or not.
+    // If true, returns the log probabilities of each output token
+    // returned in the content of message.
+    Json& logprobs = json["logprobs"];
+    if (!logprobs.isNull()) {
+        if (!logprobs.isBool())
+            return send_error(400, "logprobs field must be boolean");
+        params->logprobs = logprobs.getBool();
+    }
+
+    // top_logprobs: integer|null
+    //
+    // An integer between 0 and 20 specifying the number of most likely
+    // tokens to return at each token position, each with an associated
+    // log probability. logprobs must be set to true if this parameter
+    // is used.
+    Json& top_logprobs = json["top_logprobs"];
+    if (!top_logprobs.isNull()) {
+        if (!top_logprobs.isLong())
+            return send_error(400, "top_logprobs field must be integer");
+        if (!params->logprobs)
+            return send_error(400, "top_logprobs requires logprobs true");
+        params->top_logprobs = top_logprobs.getLong();
+        if (!(0 <= params->top_logprobs && params->top_logprobs <= 20))
+            return send_error(400, "top_logprobs must be between 0 and 20");
+    }
+
+    // x_logprobs_binary: bool|null
+    //
+    // Extension for bulk consumers like evaluation harnesses. When
+    // set, the response carries its logprob records as one base64
+    // string of little endian (int32 token, float32 logprob) pairs,
+    // 1 + top_logprobs records per generated token, in place of the
+    // per-token object tree, which costs far less to encode and
+    // parse when millions of tokens are being scored. Requires
+    // logprobs and can't be combined with streaming.
+    Json& logprobs_binary = json["x_logprobs_binary"];
+    if (!logprobs_binary.isNull()) {
+        if (!logprobs_binary.isBool())
+            return send_error(400, "x_logprobs_binary field must be boolean");
+        if (!params->logprobs)
+            return send_error(400, "x_logprobs_binary requires logprobs true");
+        params->logprobs_binary = logprobs_binary.getBool();
+    }
+
     // stream: bool|null
     //
     // If set, partial message deltas will be sent, like in ChatGPT.
@@ -306,6 +431,8 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
         if (!stream.isBool())
             return send_error(400, "stream field must be boolean");
         params->stream = stream.getBool();
+        if (params->stream && params->logprobs_binary)
+            return send_error(400, "x_logprobs_binary requires stream false");
 
         // stream_options: object|null
         //
@@ -345,6 +472,25 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
         params->max_tokens = max_completion_tokens.getNumber();
     }
 
+    // context_window: integer|null
+    //
+    // Extension. Caps how many tokens of history the model attends
+    // to while generating. When the conversation is longer, the
+    // middle is evicted from kv cache, keeping the leading attention
+    // sinks and the most recent tokens, in the manner of streaming
+    // attention. Quality tolerant long document traffic gets decode
+    // speed that stops degrading with total context length, since
+    // attention no longer scans kv entries that would receive near
+    // zero weight anyway. Omitted or 0 means full attention.
+    Json& context_window = json["context_window"];
+    if (!context_window.isNull()) {
+        if (!context_window.isLong())
+            return send_error(400, "context_window must be integer");
+        if (context_window.getLong() && context_window.getLong() < 256)
+            return send_error(400, "context_window must be at least 256");
+        params->context_window = context_window.getLong();
+    }
+
     // top_p: number|null
     //
     // An alternative to sampling with temperature, called nucleus
@@ -421,6 +567,21 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
             return send_error(400, "frequency_penalty must be -2 through 2");
     }
 
+    // adapter: string|null
+    //
+    // Selects a LoRA adapter previously loaded through the /adapters
+    // endpoints, letting tenants share one base model with different
+    // fine-tunes. Conversations never share kv cache state across
+    // adapters. Omitted means the base model.
+    Json& adapter = json["adapter"];
+    if (!adapter.isNull()) {
+        if (!adapter.isString())
+            return send_error(400, "adapter must be string");
+        params->adapter = adapter.getString();
+        if (!slots()->adapter_exists(params->adapter))
+            return send_error(404, "no such adapter is loaded");
+    }
+
     // user: string|null
     //
     // A unique identifier representing your end-user, which can help
@@ -509,18 +670,43 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
         }
     }
 
+    // a greedy request always decodes the same answer, so the exact
+    // request json (minus the stream flag) can key a response cache.
+    // sampled requests stay uncached, since redrawing is their point
+    if (params->temperature == 0 && !params->stream) {
+        json.getObject().erase("stream");
+        json.getObject().erase("stream_options");
+        params->cache_key = json.toString();
+    }
+
     return true;
 }
 
 bool
 Client::v1_chat_completions()
 {
+    // the slots can't decode when the server is an embedding fleet
+    if (FLAG_embedding)
+        return send_error(403, "server is in embedding only mode");
+
     // get parameters
     auto params = new V1ChatCompletionParams;
     defer_cleanup(cleanup_params, params);
     if (!get_v1_chat_completions_params(params))
         return false;
 
+    // deterministic duplicates (retries, identical rag queries, eval
+    // reruns) serve straight from the response cache without touching
+    // a slot. the replayed body keeps the original id and timestamp
+    if (!params->cache_key.empty()) {
+        std::string cached;
+        if (completioncache_get(params->cache_key, &cached)) {
+            char* p = append_http_response_message(obuf_.p, 200);
+            p = stpcpy(p, "Content-Type: application/json\r\n");
+            return send_response(obuf_.p, p, cached);
+        }
+    }
+
     // create state and response objects
     V1ChatCompletionState* state = new V1ChatCompletionState;
     defer_cleanup(cleanup_state, state);
@@ -528,22 +714,51 @@ Client::v1_chat_completions()
     defer_cleanup(cleanup_response, response);
 
     // turn prompt into atom array that'll fit in context window
+    std::vector<uint64_t> keys;
     for (;;) {
         // add bos token if it's needed
         if (llama_should_add_bos_token(model_))
             state->atoms.emplace_back(llama_token_bos(model_));
 
-        // turn text into tokens
+        // hash each prefix of the message history. the rolling hashes
+        // let the render cache find the longest prefix of this
+        // conversation it's already tokenized, which is normally
+        // everything up to the newest exchange
+        keys.clear();
+        uint64_t key = 0xcbf29ce484222325;
+        for (const llama_chat_msg& msg : params->messages) {
+            key = rendercache_hash(key, msg.role);
+            key = rendercache_hash(key, msg.content);
+            keys.push_back(key);
+        }
+
+        // turn text into tokens. conversations we've seen before get
+        // their old atoms from the render cache, so only the newest
+        // messages need to be tokenized
         state->prompt = llama_chat_apply_template(
           model_, FLAG_chat_template, params->messages, ADD_ASSISTANT);
-        atomize(model_, &state->atoms, state->prompt, PARSE_SPECIAL);
+        size_t cached = rendercache_get(keys, state->prompt, &state->atoms);
+        atomize(model_,
+                &state->atoms,
+                std::string_view(state->prompt).substr(cached),
+                PARSE_SPECIAL);
 
         // we don't support multiple images yet
         state->atoms = remove_old_image_atoms(state->atoms);
 
         // acquire best slot
         if (!slot_) {
-            slot_ = worker_->server_->slots_->take(state->atoms);
+            int retry_after;
+            if ((retry_after = metering_admit()))
+                return send_too_busy(retry_after);
+            if ((retry_after = slots()->admission_delay()))
+                return send_too_busy(retry_after);
+            slot_ = slots()->take(state->atoms,
+                                  params->adapter,
+                                  Slots::PRIORITY_INTERACTIVE,
+                                  slot_hint());
+            if (!slot_)
+                return send_error(408, "deadline exceeded");
             defer_cleanup(cleanup_slot, this);
         }
 
@@ -595,6 +810,36 @@ Client::v1_chat_completions()
         params->messages.erase(first, last);
     }
 
+    // remember this conversation's atoms so its next turn only has to
+    // tokenize its newest messages. the entry must end flush with a
+    // control token, since token merges can't cross one: cutting at
+    // the assistant prologue the template appended gives a boundary
+    // that's still a boundary after the reply becomes a message.
+    // templates that don't open assistant turns with a control token
+    // can't be cached this way, so they're skipped
+    if (!has_images(state->atoms)) {
+        std::string body = llama_chat_apply_template(
+          model_, FLAG_chat_template, params->messages, DONT_ADD_ASSISTANT);
+        if (!body.empty() && //
+            state->prompt.size() > body.size() &&
+            !memcmp(state->prompt.data(), body.data(), body.size())) {
+            std::vector<Atom> prologue;
+            atomize(model_,
+                    &prologue,
+                    std::string_view(state->prompt).substr(body.size()),
+                    PARSE_SPECIAL);
+            if (!prologue.empty() && //
+                prologue[0].is_token() &&
+                llama_token_is_control(model_, prologue[0].token()) &&
+                vector_ends_with(state->atoms, prologue)) {
+                std::vector<Atom> atoms(
+                  state->atoms.begin() + llama_should_add_bos_token(model_),
+                  state->atoms.end() - prologue.size());
+                rendercache_put(keys.back(), std::move(body), std::move(atoms));
+            }
+        }
+    }
+
     // init sampling
     llama_sampling_context* sampler = create_sampler(params);
     if (!sampler)
@@ -602,7 +847,8 @@ Client::v1_chat_completions()
     defer_cleanup(cleanup_sampler, sampler);
 
     // setup response json
-    response->json["id"] = generate_id();
+    std::string completion_id = generate_id();
+    response->json["id"] = completion_id;
     response->json["object"] = "chat.completion";
     response->json["model"] = params->model;
     response->json["x_prefill_progress"] = nullptr;
@@ -613,30 +859,43 @@ Client::v1_chat_completions()
     choice["finish_reason"] = nullptr;
 
     // initialize response
+    ChunkTemplate chunk;
     if (params->stream) {
-        char* p = append_http_response_message(obuf_.p, 200);
-        p = stpcpy(p, "Content-Type: text/event-stream\r\n");
-        if (!send_response_start(obuf_.p, p))
-            return false;
-        choice["delta"]["role"] = "assistant";
-        choice["delta"]["content"] = "";
-        if (params->stream_include_usage)
-            response->json["usage"] = nullptr;
+        // binary token frames can't carry logprob records, so those
+        // requests stay on server-sent events; see websocket.cpp
+        if (is_websocket_upgrade() && !params->logprobs) {
+            if (!send_websocket_upgrade())
+                return false;
+        } else {
+            char* p = append_http_response_message(obuf_.p, 200);
+            p = stpcpy(p, "Content-Type: text/event-stream\r\n");
+            p = append_slot_hint(p, slot_->id_);
+            if (!send_response_start(obuf_.p, p))
+                return false;
+            choice["delta"]["role"] = "assistant";
+            choice["delta"]["content"] = "";
+            if (params->stream_include_usage)
+                response->json["usage"] = nullptr;
+            chunk.init(completion_id, params->model, slot_->system_fingerprint_);
+        }
     }
 
-    // prefill time
+    // prefill time. websocket clients skip progress events since the
+    // binary protocol only frames tokens
     int prompt_tokens = 0;
-    if (params->stream) {
-        auto progress_callback = [&](int processed, int total) {
+    if (params->stream && !websocket_) {
+        auto progress_callback = [&](int processed, int total) -> bool {
             if (processed < total) {
                 response->json["x_prefill_progress"] =
                   static_cast<float>(processed) / total;
                 response->json["created"] = timespec_real().tv_sec;
-                response->content = make_event(response->json);
-                if (!send_response_chunk(response->content)) {
-                    return; // Note: Can't properly handle error in callback
-                }
+                response->content = response->json.toString();
+                // a failed send means the client hung up, in which case
+                // returning false cancels the rest of the prefill so the
+                // slot isn't held hostage evaluating an abandoned prompt
+                return send_response_event(response->content);
             }
+            return true;
         };
         prompt_tokens = slot_->prefill(state->atoms, progress_callback);
     } else {
@@ -645,7 +904,10 @@ Client::v1_chat_completions()
 
     if (prompt_tokens < 0) {
         SLOG("slot prefill failed: %s", Slot::describe_error(prompt_tokens));
-        if (!params->stream) {
+        if (prompt_tokens == Slot::canceled && deadline_expired() &&
+            !params->stream) {
+            return send_error(408, "deadline exceeded");
+        } else if (!params->stream) {
             return send_error(500, Slot::describe_error(prompt_tokens));
         } else {
             close_connection_ = true;
@@ -654,30 +916,86 @@ Client::v1_chat_completions()
     }
 
     // initialize response
-    if (params->stream) {
+    if (params->stream && !websocket_) {
         response->json.getObject().erase("x_prefill_progress");
-        response->content = make_event(response->json);
+        response->content = response->json.toString();
         choice.getObject().erase("delta");
-        if (!send_response_chunk(response->content))
+        if (!send_response_event(response->content))
             return false;
     }
 
+    // logprob capture buffers. records are fixed size, so each token
+    // lands in a scratch span that only gets kept once the token is
+    // known to be part of the message content, and the kept records
+    // grow a flat array with no per-token structure
+    int n_probs = 0;
+    size_t lp_sent = 0;
+    std::vector<TokenProb> lp;
+    std::vector<TokenProb> rec;
+    if (params->logprobs) {
+        n_probs = params->top_logprobs;
+        rec.resize(1 + n_probs);
+        slot_->logprobs_ = true; // rules out speculative decoding
+    }
+
     // prediction time
     int completion_tokens = 0;
     const char* finish_reason = "length";
+    const Pieces* pieces = slots()->pieces_;
+    bool incomplete = false;
     for (;;) {
+        // a request past its deadline keeps whatever it generated;
+        // ending here, before any more blocking work, is what bounds
+        // how long this slot stays occupied
+        if (deadline_expired())
+            break;
         if (params->max_tokens >= 0 &&
             completion_tokens >= params->max_tokens) {
             slot_->eval_token(llamafile_token_eot(model_));
             break;
         }
-        llama_token id = llama_sampling_sample(sampler, slot_->ctx_, NULL);
-        llama_sampling_accept(sampler, slot_->ctx_, id, APPLY_GRAMMAR);
-        ++completion_tokens;
-        if (slot_->eval_token(id) < 0) {
-            SLOG("ran out of context window");
+        // approximate attention opt-in: past the requested window
+        // the middle of the conversation stops being attended
+        if (params->context_window &&
+            slot_->ctx_used() > params->context_window)
+            slot_->bound_context(params->context_window);
+        timespec decode_started;
+        clock_gettime(CLOCK_MONOTONIC, &decode_started);
+        llama_token id = slot_->sample(
+          sampler, APPLY_GRAMMAR, params->logprobs ? rec.data() : nullptr,
+          n_probs);
+        if (id < 0) {
+            SLOG("failed to sample token");
             break;
         }
+        ++completion_tokens;
+        int err;
+        if ((err = slot_->eval_token(id)) < 0) {
+            // when generation overflows the context window, shift the
+            // oldest conversation turns out of kv cache and push on,
+            // rather than ending the response mid-sentence
+            if (err != Slot::out_of_context || //
+                slot_->shift_context() <= 0 || //
+                slot_->eval_token(id) < 0) {
+                SLOG("ran out of context window");
+                break;
+            }
+        }
+        timespec decode_ended;
+        clock_gettime(CLOCK_MONOTONIC, &decode_ended);
+        metrics_observe(
+          METRIC_DECODE,
+          timespec_tonanos(timespec_sub(decode_ended, decode_started)));
+        slot_->record_timing(
+          timespec_tomicros(decode_ended),
+          timespec_tomicros(timespec_sub(decode_ended, decode_started)));
+        // websocket clients get every sampled token, eog included,
+        // since they do their own detokenizing
+        if (websocket_ &&
+            !send_token_event(
+              id, timespec_tomicros(timespec_sub(decode_ended,
+                                                 decode_started))))
+            return false;
         if (llama_token_is_eog(model_, id)) {
             finish_reason = "stop";
             break;
@@ -687,17 +1005,50 @@ Client::v1_chat_completions()
             finish_reason = "stop";
             break;
         }
-        state->piece +=
-          llamafile_token_to_piece(slot_->ctx_, id, DONT_RENDER_SPECIAL_TOKENS);
+        if (params->logprobs)
+            lp.insert(lp.end(), rec.begin(), rec.end());
+        // the precomputed table makes detokenizing a lookup and its
+        // completeness flag tells us whether the buffered delta still
+        // dangles mid utf-8 sequence; empty pieces leave the verdict
+        // of the last byte producing token in place
+        std::string_view piece = pieces->view(id);
+        if (!piece.empty())
+            incomplete = pieces->ends_incomplete(id);
+        state->piece += piece;
         if (!state->piece.empty()) {
-            if (params->stream) {
-                if (!ends_with_incomplete_utf8(state->piece)) {
-                    char* p = append_http_response_message(obuf_.p, 200);
+            if (websocket_) {
+                state->piece.clear(); // token frames already sent
+            } else if (params->stream) {
+                if (!incomplete) {
+                    if (!params->logprobs) {
+                        // the common case renders from the precomputed
+                        // skeleton instead of reserializing a json tree
+                        timespec write_started;
+                        clock_gettime(CLOCK_MONOTONIC, &write_started);
+                        if (!send_response_event(chunk.render(
+                              state->piece, timespec_real().tv_sec)))
+                            return false;
+                        timespec write_ended;
+                        clock_gettime(CLOCK_MONOTONIC, &write_ended);
+                        slot_->record_write_us(timespec_tomicros(
+                          timespec_sub(write_ended, write_started)));
+                        state->piece.clear();
+                        continue;
+                    }
                     choice["delta"]["content"] = state->piece;
+                    // records for every token buffered into this
+                    // delta, including ones still mid utf-8 when
+                    // earlier deltas flushed
+                    Json& content = choice["logprobs"]["content"];
+                    content.setArray();
+                    for (; lp_sent < lp.size(); lp_sent += 1 + n_probs)
+                        append_logprob_entry(
+                          content, pieces, &lp[lp_sent], n_probs);
                     response->json["created"] = timespec_real().tv_sec;
-                    response->content = make_event(response->json);
+                    response->content = response->json.toString();
                     choice.getObject().erase("delta");
-                    if (!send_response_chunk(response->content))
+                    choice["logprobs"] = nullptr;
+                    if (!send_response_event(response->content))
                         return false;
                     state->piece.clear();
                 }
@@ -712,8 +1063,38 @@ Client::v1_chat_completions()
          completion_tokens,
          finish_reason);
 
+    // attach logprob records to the response. streaming already sent
+    // its records chunk by chunk
+    if (params->logprobs && !params->stream) {
+        Json& logprobs = choice["logprobs"];
+        if (params->logprobs_binary) {
+            // one flat base64 block of fixed size records; see the
+            // x_logprobs_binary doc comment above
+            std::string_view bytes((const char*)lp.data(),
+                                   lp.size() * sizeof(TokenProb));
+            std::string blob;
+            lf::base64_encode(bytes, &blob);
+            logprobs["x_records_per_token"] = 1 + n_probs;
+            logprobs["x_binary"] = std::move(blob);
+        } else {
+            Json& content = logprobs["content"];
+            content.setArray();
+            for (size_t i = 0; i < lp.size(); i += 1 + n_probs)
+                append_logprob_entry(content, pieces, &lp[i], n_probs);
+        }
+    }
+
+    // the follow-up to this response will probably arrive within
+    // seconds, and its prompt opens with tokens the chat template
+    // already determines, so decode those into kv before the slot
+    // goes back to the pool
+    slots()->prefetch_next_turn(slot_);
+
     // finalize response
+    int took_slot = slot_->id_;
     cleanup_slot(this);
+    if (websocket_)
+        return send_websocket_finish(finish_reason);
     if (params->stream) {
         choice["delta"]["content"] = "";
         response->json["created"] = timespec_real().tv_sec;
@@ -723,11 +1104,11 @@ Client::v1_chat_completions()
             usage["completion_tokens"] = completion_tokens;
             usage["total_tokens"] = completion_tokens + prompt_tokens;
         }
-        response->content = make_event(response->json);
+        response->content = response->json.toString();
         choice.getObject().erase("delta");
-        if (!send_response_chunk(response->content))
+        if (!send_response_event(response->content))
             return false;
-        if (!send_response_chunk("data: [DONE]\n\n"))
+        if (!send_response_event("[DONE]"))
             return false;
         return send_response_finish();
     } else {
@@ -740,8 +1121,11 @@ Client::v1_chat_completions()
         response->json["created"] = timespec_real().tv_sec;
         char* p = append_http_response_message(obuf_.p, 200);
         p = stpcpy(p, "Content-Type: application/json\r\n");
+        p = append_slot_hint(p, took_slot);
         response->content = response->json.toStringPretty();
         response->content += '\n';
+        if (!params->cache_key.empty())
+            completioncache_put(params->cache_key, response->content);
         return send_response(obuf_.p, p, response->content);
     }
 }
@@ -20,18 +20,29 @@
 #include "llama.cpp/sampling.h"
 #include "llamafile/json.h"
 #include "llamafile/llama.h"
+#include "llamafile/llamafile.h"
 #include "llamafile/macros.h"
 #include "llamafile/server/atom.h"
+#include "llamafile/server/atomstream.h"
+#include "llamafile/server/batcher.h"
 #include "llamafile/server/cleanup.h"
+#include "llamafile/server/completioncache.h"
+#include "llamafile/server/deadline.h"
 #include "llamafile/server/fastjson.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/metering.h"
+#include "llamafile/server/metrics.h"
+#include "llamafile/server/philox.h"
+#include "llamafile/server/pieces.h"
 #include "llamafile/server/server.h"
 #include "llamafile/server/slot.h"
 #include "llamafile/server/slots.h"
+#include "llamafile/server/stop_matcher.h"
 #include "llamafile/server/utils.h"
 #include "llamafile/server/worker.h"
 #include "llamafile/string.h"
-#include "llamafile/vector.h"
+#include "llamafile/threadlocal.h"
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <sys/resource.h>
@@ -47,7 +58,11 @@ struct V1CompletionParams
     bool echo = false;
     bool stream = false;
     bool stream_include_usage = false;
+    int priority = Slots::PRIORITY_INTERACTIVE;
+    long n = 1;
+    long beam_width = 0;
     long max_tokens = -1;
+    long context_window = 0;
     long seed = _rand64();
     double top_p = 1;
     double temperature = 1;
@@ -56,20 +71,13 @@ struct V1CompletionParams
     std::string user;
     std::string model;
     std::string prompt;
-    std::vector<std::vector<Atom>> stop;
+    std::vector<std::string> stop;
+    std::shared_ptr<const StopMatcher> stop_matcher;
+    std::string cache_key;
 
-    void add_stop(llama_model* model, const std::string& text)
+    void add_stop(const std::string& text)
     {
-        stop.emplace_back();
-        atomize(model, &stop.back(), text, DONT_PARSE_SPECIAL);
-    }
-
-    bool should_stop(const std::vector<Atom>& history)
-    {
-        for (const auto& s : stop)
-            if (vector_ends_with(history, s))
-                return true;
-        return false;
+        stop.emplace_back(text);
     }
 };
 
@@ -103,10 +111,23 @@ cleanup_response(void* arg)
     delete (V1CompletionResponse*)arg;
 }
 
+// short autocomplete style requests spend a visible share of their
+// time building and tearing down the sampler chain, so each worker
+// thread keeps one sampler that gets its parameters swapped and its
+// state reset in place between requests. reuse also retains the
+// candidate array's n_vocab sized allocation. the chat handler can't
+// share this since its samplers may hold compiled grammar state.
+static ThreadLocal<llama_sampling_context> g_sampler_pool(
+  [](llama_sampling_context* sampler) { llama_sampling_free(sampler); });
+
 static void
 cleanup_sampler(void* arg)
 {
-    llama_sampling_free((llama_sampling_context*)arg);
+    llama_sampling_context* sampler = (llama_sampling_context*)arg;
+    if (!g_sampler_pool.get())
+        g_sampler_pool.set(sampler);
+    else
+        llama_sampling_free(sampler);
 }
 
 static void
@@ -114,7 +135,7 @@ cleanup_slot(void* arg)
 {
     Client* client = (Client*)arg;
     if (client->slot_) {
-        client->worker_->server_->slots_->give(client->slot_);
+        client->slots()->give(client->slot_);
         client->slot_ = nullptr;
     }
 }
@@ -150,16 +171,639 @@ create_sampler(const V1CompletionParams* params)
     sparams.penalty_freq = params->frequency_penalty;
     sparams.penalty_present = params->presence_penalty;
     sparams.seed = params->seed;
+    llama_sampling_context* sampler;
+    if ((sampler = g_sampler_pool.get())) {
+        g_sampler_pool.set(nullptr);
+        sampler->params = sparams;
+        llama_sampling_reset(sampler);
+        llama_sampling_set_rng_seed(sampler, sparams.seed);
+        return sampler;
+    }
     return llama_sampling_init(sparams);
 }
 
-static std::string
-make_event(const Json& json)
+// tracks fan-out branches so their spare sequence ids always come
+// back to the pool, even when the client disconnects mid stream and
+// the handler unwinds through the cleanup chain
+struct FanLanes
+{
+    struct Lane
+    {
+        int seq; // sequence id holding this branch's kv
+        int index; // which choice this branch is producing
+        int pos; // next decode position
+        int sampled; // sampled token awaiting decode
+        bool borrowed; // seq goes back to the branch pool
+        bool incomplete = false;
+        int stop_state = 0; // stop automaton state for this branch
+        std::vector<Atom> history;
+        std::string content;
+        std::string piece;
+    };
+
+    Slots* slots;
+    Slot* slot;
+    int prompt_used;
+    std::vector<Lane> lanes;
+
+    void release(const Lane& lane)
+    {
+        if (lane.borrowed) {
+            slot->batcher_->kv_cache_seq_rm(lane.seq, -1, -1);
+            slots->branch_give(lane.seq);
+        } else {
+            // the slot keeps its prompt cells so the next request
+            // with this prefix resumes from the invested prefill
+            slot->batcher_->kv_cache_seq_rm(lane.seq, prompt_used, -1);
+        }
+    }
+};
+
+static void
+cleanup_fanout(void* arg)
+{
+    FanLanes* fan = (FanLanes*)arg;
+    for (const auto& lane : fan->lanes)
+        fan->release(lane);
+    delete fan;
+}
+
+// generates params->n completions from a single prompt prefill. the
+// prompt's kv cells are shared into spare sequence ids copy-on-write
+// style, so each branch only pays cells for the tokens it samples,
+// and every active branch's next token rides in one llama_decode.
+// reranking pipelines that fan out n=8 used to pay the prefill cost
+// eight times over
+static bool
+fanout_completions(Client* client,
+                   V1CompletionParams* params,
+                   V1CompletionState* state,
+                   V1CompletionResponse* response)
+{
+    Slot* slot = client->slot_;
+    Slots* slots = client->slots();
+    int n = params->n;
+
+    // prefill time
+    int prompt_tokens;
+    if ((prompt_tokens = slot->prefill(state->atoms)) < 0) {
+        SLOG("slot prefill failed: %s", Slot::describe_error(prompt_tokens));
+        return client->send_error(500, Slot::describe_error(prompt_tokens));
+    }
+    int prompt_used = slot->ctx_used();
+
+    // branch decodes don't mirror onto the draft context
+    if (slot->draft_ctx_)
+        slot->draft_dirty_ = true;
+
+    // each sample gets its own sampler, seeded apart, so the streams
+    // explore independently rather than replaying one rng. lane
+    // seeds come off a counter based generator keyed by the request
+    // seed: still deterministic per request, but lanes land far
+    // apart in seed space instead of on adjacent integers
+    long seed = params->seed;
+    std::vector<llama_sampling_context*> samplers(n);
+    for (int i = 0; i < n; ++i) {
+        params->seed = philox64(seed, i);
+        if (!(samplers[i] = create_sampler(params)))
+            return client->send_error(500, "failed to create sampler");
+        client->defer_cleanup(cleanup_sampler, samplers[i]);
+    }
+
+    // every branch's opening token comes from the prompt logits, so
+    // they all get sampled before any branch decodes over that row
+    std::vector<int> first(n);
+    for (int i = 0; i < n; ++i) {
+        if ((first[i] = slot->batcher_->sample(
+               slot->id_, samplers[i], DONT_APPLY_GRAMMAR)) < 0) {
+            SLOG("failed to sample token");
+            return client->send_error(500, "failed to sample token");
+        }
+    }
+
+    // open as many parallel branches as spare sequence ids allow.
+    // the slot's own sequence always serves the first branch, and
+    // pending samples reuse whichever branch finishes earliest
+    FanLanes* fan = new FanLanes;
+    fan->slots = slots;
+    fan->slot = slot;
+    fan->prompt_used = prompt_used;
+    client->defer_cleanup(cleanup_fanout, fan);
+    int next_sample = 0;
+    auto open_lane = [&](int seq, bool borrowed) {
+        FanLanes::Lane lane;
+        lane.seq = seq;
+        lane.index = next_sample;
+        lane.pos = prompt_used;
+        lane.sampled = first[next_sample];
+        lane.borrowed = borrowed;
+        lane.history = state->atoms;
+        fan->lanes.emplace_back(std::move(lane));
+        ++next_sample;
+    };
+    open_lane(slot->id_, false);
+    int seq;
+    while (next_sample < n && (seq = slots->branch_take()) != -1) {
+        slot->batcher_->kv_cache_seq_cp(slot->id_, seq, 0, prompt_used);
+        open_lane(seq, true);
+    }
+
+    // setup response json
+    response->json["id"] = generate_id();
+    response->json["object"] = "text_completion";
+    response->json["model"] = params->model;
+    response->json["system_fingerprint"] = slot->system_fingerprint_;
+
+    // initialize response
+    Json& choice = response->json["choices"][0];
+    if (params->stream) {
+        char* p = client->append_http_response_message(client->obuf_.p, 200);
+        p = stpcpy(p, "Content-Type: text/event-stream\r\n");
+        if (!client->send_response_start(client->obuf_.p, p))
+            return false;
+        choice["logprobs"] = nullptr;
+        choice["finish_reason"] = nullptr;
+        choice["delta"]["role"] = "assistant";
+        choice["delta"]["content"] = "";
+        response->json["created"] = timespec_real().tv_sec;
+        if (params->stream_include_usage)
+            response->json["usage"] = nullptr;
+        for (int i = 0; i < n; ++i) {
+            choice["index"] = i;
+            if (!client->send_response_event(response->json.toString()))
+                return false;
+        }
+        choice.getObject().erase("delta");
+    }
+
+    // prediction time
+    int completion_tokens = 0;
+    std::vector<const char*> finish(n, "length");
+    std::vector<std::string> texts(n);
+    const Pieces* pieces = slots->pieces_;
+    bool failed = false;
+    std::vector<int> seq_ids;
+    std::vector<int> tokens;
+    std::vector<int> positions;
+    while (!fan->lanes.empty() && !failed) {
+        // deadline expiry ends every branch with what it has; the
+        // wind-down below returns their sequences either way
+        if (deadline_expired())
+            break;
+        // decode every branch's pending token in one batch
+        seq_ids.clear();
+        tokens.clear();
+        positions.clear();
+        for (const auto& lane : fan->lanes) {
+            seq_ids.emplace_back(lane.seq);
+            tokens.emplace_back(lane.sampled);
+            positions.emplace_back(lane.pos);
+        }
+        timespec decode_started;
+        clock_gettime(CLOCK_MONOTONIC, &decode_started);
+        if (slot->batcher_->decode_fanout(seq_ids.data(),
+                                          tokens.data(),
+                                          positions.data(),
+                                          fan->lanes.size(),
+                                          slot->adapter_,
+                                          slot->adapter_scale_) < 0) {
+            SLOG("failed to decode fan-out batch");
+            break;
+        }
+        timespec decode_ended;
+        clock_gettime(CLOCK_MONOTONIC, &decode_ended);
+        metrics_observe(
+          METRIC_DECODE,
+          timespec_tonanos(timespec_sub(decode_ended, decode_started)));
+        for (size_t i = 0; i < fan->lanes.size() && !failed;) {
+            FanLanes::Lane& lane = fan->lanes[i];
+            int id = lane.sampled;
+            lane.history.emplace_back(id);
+            ++lane.pos;
+            ++completion_tokens;
+            const char* reason = nullptr;
+            std::string_view piece = pieces->view(id);
+            if (llama_token_is_eog(client->model_, id)) {
+                reason = "stop";
+            } else if (params->stop_matcher &&
+                       (lane.stop_state = params->stop_matcher->feed(
+                          lane.stop_state, piece)) < 0) {
+                reason = "stop";
+            } else {
+                if (!piece.empty())
+                    lane.incomplete = pieces->ends_incomplete(id);
+                lane.piece += piece;
+                if (!lane.piece.empty()) {
+                    if (params->stream) {
+                        if (!lane.incomplete) {
+                            choice["index"] = lane.index;
+                            choice["text"] = lane.piece;
+                            response->json["created"] = timespec_real().tv_sec;
+                            if (!client->send_response_event(
+                                  response->json.toString()))
+                                return false;
+                            lane.piece.clear();
+                        }
+                    } else {
+                        lane.content += lane.piece;
+                        lane.piece.clear();
+                    }
+                }
+                if (params->max_tokens >= 0 &&
+                    lane.pos - prompt_used >= params->max_tokens) {
+                    reason = "length";
+                } else if (lane.pos >= slot->ctx_size()) {
+                    // a branch can't shift its context window since
+                    // the prompt cells are shared with its siblings
+                    reason = "length";
+                } else {
+                    int tok = slot->batcher_->sample(
+                      lane.seq, samplers[lane.index], DONT_APPLY_GRAMMAR);
+                    if (tok < 0) {
+                        SLOG("failed to sample token");
+                        failed = true;
+                        break;
+                    }
+                    lane.sampled = tok;
+                }
+            }
+            if (!reason) {
+                ++i;
+                continue;
+            }
+            finish[lane.index] = reason;
+            texts[lane.index] = std::move(lane.content);
+            if (next_sample < n) {
+                // hand this branch's sequence to the next sample. the
+                // prompt cells stay; only the generated tail goes
+                slot->batcher_->kv_cache_seq_rm(lane.seq, prompt_used, -1);
+                lane.index = next_sample;
+                lane.pos = prompt_used;
+                lane.sampled = first[next_sample];
+                lane.history = state->atoms;
+                lane.content.clear();
+                lane.piece.clear();
+                lane.incomplete = false;
+                lane.stop_state = 0;
+                ++next_sample;
+                ++i;
+            } else {
+                fan->release(lane);
+                fan->lanes.erase(fan->lanes.begin() + i);
+            }
+        }
+    }
+
+    // wind down whatever branches remain, e.g. after a decode error,
+    // before the slot goes back to the pool, so a later claimant of
+    // this slot can't race the branch teardown
+    for (const auto& lane : fan->lanes) {
+        if (!lane.content.empty())
+            texts[lane.index] = lane.content;
+        fan->release(lane);
+    }
+    fan->lanes.clear();
+
+    // finalize response
+    cleanup_slot(client);
+    if (params->stream) {
+        response->json["created"] = timespec_real().tv_sec;
+        if (params->stream_include_usage) {
+            Json& usage = response->json["usage"];
+            usage["prompt_tokens"] = prompt_tokens;
+            usage["completion_tokens"] = completion_tokens;
+            usage["total_tokens"] = completion_tokens + prompt_tokens;
+        }
+        choice["text"] = "";
+        for (int i = 0; i < n; ++i) {
+            choice["index"] = i;
+            choice["finish_reason"] = finish[i];
+            if (!client->send_response_event(response->json.toString()))
+                return false;
+        }
+        if (!client->send_response_event("[DONE]"))
+            return false;
+        return client->send_response_finish();
+    } else {
+        Json& usage = response->json["usage"];
+        usage["prompt_tokens"] = prompt_tokens;
+        usage["completion_tokens"] = completion_tokens;
+        usage["total_tokens"] = completion_tokens + prompt_tokens;
+        for (int i = 0; i < n; ++i) {
+            Json& c = response->json["choices"][i];
+            c["index"] = i;
+            c["logprobs"] = nullptr;
+            c["text"] = std::move(texts[i]);
+            c["finish_reason"] = finish[i];
+        }
+        response->json["created"] = timespec_real().tv_sec;
+        char* p = client->append_http_response_message(client->obuf_.p, 200);
+        p = stpcpy(p, "Content-Type: application/json\r\n");
+        response->content = response->json.toStringPretty();
+        response->content += '\n';
+        return client->send_response(client->obuf_.p, p, response->content);
+    }
+}
+
+// finds the params->beam_width highest scoring continuations of the
+// prompt at once, in place of sampling one. the prompt is prefilled a
+// single time and shared into every beam's sequence copy-on-write, so
+// a beam only pays kv cells for tokens past its divergence point, and
+// every live beam's next token rides in one llama_decode(). a beam
+// that drops out of the top set has its generated cells removed the
+// same step, so pruning returns memory at the rate expansion takes
+// it. beams rank by the model's raw log probabilities, which is why
+// the sampler knobs don't apply here
+static bool
+beam_search_completions(Client* client,
+                        V1CompletionParams* params,
+                        V1CompletionState* state,
+                        V1CompletionResponse* response)
 {
-    std::string s = "data: ";
-    s += json.toString();
-    s += "\n\n";
-    return s;
+    Slot* slot = client->slot_;
+    Slots* slots = client->slots();
+
+    // prefill time
+    int prompt_tokens;
+    if ((prompt_tokens = slot->prefill(state->atoms)) < 0) {
+        SLOG("slot prefill failed: %s", Slot::describe_error(prompt_tokens));
+        return client->send_error(500, Slot::describe_error(prompt_tokens));
+    }
+    int prompt_used = slot->ctx_used();
+
+    // branch decodes don't mirror onto the draft context
+    if (slot->draft_ctx_)
+        slot->draft_dirty_ = true;
+
+    // one sampler satisfies the batcher's sampling interface. the
+    // tokens it draws get discarded; only the top candidate logprob
+    // records it captures alongside them matter
+    llama_sampling_context* sampler = create_sampler(params);
+    if (!sampler)
+        return client->send_error(500, "failed to create sampler");
+    client->defer_cleanup(cleanup_sampler, sampler);
+
+    // claim a lane per beam. the slot's own sequence hosts the first
+    // one and spare sequence ids host the rest; when the pool can't
+    // cover the requested width the search just runs narrower
+    FanLanes* fan = new FanLanes;
+    fan->slots = slots;
+    fan->slot = slot;
+    fan->prompt_used = prompt_used;
+    client->defer_cleanup(cleanup_fanout, fan);
+    auto open_lane = [&](int seq, bool borrowed) {
+        FanLanes::Lane lane;
+        lane.seq = seq;
+        lane.index = 0;
+        lane.pos = prompt_used;
+        lane.sampled = -1;
+        lane.borrowed = borrowed;
+        fan->lanes.emplace_back(std::move(lane));
+    };
+    open_lane(slot->id_, false);
+    int seq;
+    while (fan->lanes.size() < (size_t)params->beam_width &&
+           (seq = slots->branch_take()) != -1) {
+        slot->batcher_->kv_cache_seq_cp(slot->id_, seq, 0, prompt_used);
+        open_lane(seq, true);
+    }
+    int width = fan->lanes.size();
+    if (width < params->beam_width)
+        SLOG("beam search narrowed to %d lanes", width);
+
+    // per-beam search state, indexed like fan->lanes, which never
+    // shrinks while the search runs. the first beam starts alone,
+    // holding the prompt that every candidate extends
+    std::vector<double> scores(width, 0);
+    std::vector<char> alive(width, 0);
+    std::vector<std::vector<int>> tokens(width);
+    alive[0] = 1;
+
+    // a completed continuation, ranked at the end
+    struct Hypothesis
+    {
+        double score;
+        const char* finish;
+        std::vector<int> tokens;
+    };
+    std::vector<Hypothesis> finished;
+
+    // one continuation of one live beam
+    struct Candidate
+    {
+        int parent;
+        int token;
+        double score;
+    };
+    std::vector<Candidate> cands;
+    std::vector<Candidate> survivors;
+    std::vector<TokenProb> probs(width + 1);
+
+    int pos = prompt_used;
+    int completion_tokens = 0;
+    bool failed = false;
+    std::vector<int> seq_ids;
+    std::vector<int> toks;
+    std::vector<int> positions;
+    for (;;) {
+
+        // deadline expiry ends the search; the best live beams below
+        // stand in for any hypotheses still missing
+        if (deadline_expired())
+            break;
+
+        // expand each live beam into its top width continuations
+        cands.clear();
+        for (int i = 0; i < width && !failed; ++i) {
+            if (!alive[i])
+                continue;
+            if (slot->batcher_->sample(fan->lanes[i].seq,
+                                       sampler,
+                                       DONT_APPLY_GRAMMAR,
+                                       probs.data(),
+                                       width) < 0) {
+                SLOG("failed to score beam candidates");
+                failed = true;
+            }
+            for (int j = 1; j <= width && !failed; ++j)
+                cands.push_back(
+                  { i, probs[j].token_, scores[i] + probs[j].logprob_ });
+        }
+        if (failed)
+            break;
+        std::sort(cands.begin(),
+                  cands.end(),
+                  [](const Candidate& a, const Candidate& b) {
+                      return a.score > b.score;
+                  });
+
+        // keep the top width continuations overall. ones that end
+        // generation become finished hypotheses instead of beams
+        survivors.clear();
+        int picks = 0;
+        for (const Candidate& cand : cands) {
+            if (picks == width)
+                break;
+            ++picks;
+            if (llama_token_is_eog(client->model_, cand.token)) {
+                Hypothesis hyp;
+                hyp.score = cand.score;
+                hyp.finish = "stop";
+                hyp.tokens = tokens[cand.parent];
+                finished.emplace_back(std::move(hyp));
+            } else {
+                survivors.emplace_back(cand);
+            }
+        }
+        if (survivors.empty() || (int)finished.size() >= width)
+            break;
+
+        // seat the survivors. a survivor stays on its parent's lane
+        // when it can, so its kv is already in place. the rest copy
+        // their parent's generated span into a lane nobody kept, and
+        // an in place survivor never reads a lane a mover writes,
+        // since every surviving parent keeps its first child
+        std::vector<char> seated(width, 0);
+        std::vector<int> next_tok(width, -1);
+        std::vector<double> next_score(width, 0);
+        std::vector<const Candidate*> movers;
+        for (const Candidate& cand : survivors) {
+            if (!seated[cand.parent]) {
+                seated[cand.parent] = 1;
+                next_tok[cand.parent] = cand.token;
+                next_score[cand.parent] = cand.score;
+            } else {
+                movers.emplace_back(&cand);
+            }
+        }
+        int fl = 0;
+        for (const Candidate* cand : movers) {
+            while (seated[fl])
+                ++fl;
+            FanLanes::Lane& lane = fan->lanes[fl];
+            if (alive[fl])
+                slot->batcher_->kv_cache_seq_rm(lane.seq, prompt_used, -1);
+            slot->batcher_->kv_cache_seq_cp(
+              fan->lanes[cand->parent].seq, lane.seq, prompt_used, pos);
+            tokens[fl] = tokens[cand->parent];
+            next_tok[fl] = cand->token;
+            next_score[fl] = cand->score;
+            seated[fl] = 1;
+        }
+        for (int i = 0; i < width; ++i) {
+            if (seated[i]) {
+                tokens[i].emplace_back(next_tok[i]);
+                scores[i] = next_score[i];
+                fan->lanes[i].sampled = next_tok[i];
+                alive[i] = 1;
+            } else {
+                // pruned: its generated cells go back to the pool now
+                if (alive[i])
+                    slot->batcher_->kv_cache_seq_rm(
+                      fan->lanes[i].seq, prompt_used, -1);
+                alive[i] = 0;
+                tokens[i].clear();
+            }
+        }
+
+        // decode every live beam's chosen token in one batch
+        seq_ids.clear();
+        toks.clear();
+        positions.clear();
+        for (int i = 0; i < width; ++i)
+            if (alive[i]) {
+                seq_ids.emplace_back(fan->lanes[i].seq);
+                toks.emplace_back(fan->lanes[i].sampled);
+                positions.emplace_back(pos);
+            }
+        timespec decode_started;
+        clock_gettime(CLOCK_MONOTONIC, &decode_started);
+        if (slot->batcher_->decode_fanout(seq_ids.data(),
+                                          toks.data(),
+                                          positions.data(),
+                                          seq_ids.size(),
+                                          slot->adapter_,
+                                          slot->adapter_scale_) < 0) {
+            SLOG("failed to decode beam batch");
+            break;
+        }
+        timespec decode_ended;
+        clock_gettime(CLOCK_MONOTONIC, &decode_ended);
+        metrics_observe(
+          METRIC_DECODE,
+          timespec_tonanos(timespec_sub(decode_ended, decode_started)));
+        ++pos;
+        completion_tokens += seq_ids.size();
+
+        // length bounds end the search with whatever beams are live.
+        // beams can't shift their context window, since the prompt
+        // cells are shared with their siblings
+        if ((params->max_tokens >= 0 &&
+             pos - prompt_used >= params->max_tokens) ||
+            pos >= slot->ctx_size()) {
+            for (int i = 0; i < width; ++i)
+                if (alive[i]) {
+                    finished.push_back(
+                      { scores[i], "length", std::move(tokens[i]) });
+                    alive[i] = 0;
+                }
+            break;
+        }
+    }
+
+    // when the finish set comes up short, e.g. after a decode error,
+    // the best live beams stand in for the missing hypotheses
+    for (int i = 0; i < width && (int)finished.size() < params->n; ++i)
+        if (alive[i])
+            finished.push_back({ scores[i], "length", std::move(tokens[i]) });
+
+    // wind down the lanes before the slot goes back to the pool, so a
+    // later claimant of this slot can't race the branch teardown
+    for (const auto& lane : fan->lanes)
+        fan->release(lane);
+    fan->lanes.clear();
+    cleanup_slot(client);
+
+    if (finished.empty())
+        return client->send_error(500, "beam search failed");
+
+    // rank by mean logprob per token, so a hypothesis that finished
+    // early doesn't win merely by having had fewer chances to shed
+    // probability mass than a longer rival
+    std::sort(finished.begin(),
+              finished.end(),
+              [](const Hypothesis& a, const Hypothesis& b) {
+                  return a.score / MAX(1., (double)a.tokens.size()) >
+                         b.score / MAX(1., (double)b.tokens.size());
+              });
+
+    // finalize response
+    const Pieces* pieces = slots->pieces_;
+    int n_out = MIN((long)finished.size(), params->n);
+    response->json["id"] = generate_id();
+    response->json["object"] = "text_completion";
+    response->json["model"] = params->model;
+    response->json["system_fingerprint"] = slot->system_fingerprint_;
+    Json& usage = response->json["usage"];
+    usage["prompt_tokens"] = prompt_tokens;
+    usage["completion_tokens"] = completion_tokens;
+    usage["total_tokens"] = completion_tokens + prompt_tokens;
+    for (int i = 0; i < n_out; ++i) {
+        std::string text;
+        for (int id : finished[i].tokens)
+            text += pieces->view(id);
+        Json& c = response->json["choices"][i];
+        c["index"] = i;
+        c["logprobs"] = nullptr;
+        c["text"] = std::move(text);
+        c["finish_reason"] = finished[i].finish;
+    }
+    response->json["created"] = timespec_real().tv_sec;
+    char* p = client->append_http_response_message(client->obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    response->content = response->json.toStringPretty();
+    response->content += '\n';
+    return client->send_response(client->obuf_.p, p, response->content);
 }
 
 bool
@@ -178,7 +822,7 @@ Client::get_v1_completions_params(V1CompletionParams* params)
         return false;
 
     // object<model, messages, ...>
-    auto [status, json] = Json::parse(std::string(payload_));
+    auto [status, json] = Json::parse(payload_);
     if (status != Json::success)
         return send_error(400, Json::StatusToString(status));
     if (!json.isObject())
@@ -193,6 +837,8 @@ Client::get_v1_completions_params(V1CompletionParams* params)
     if (!model.isString())
         return send_error(400, "JSON missing model string");
     params->model = model.getString();
+    if (!use_model(params->model))
+        return send_error(500, "failed to load model");
 
     // prompt: string
     if (!json["prompt"].isString())
@@ -201,16 +847,19 @@ Client::get_v1_completions_params(V1CompletionParams* params)
 
     // n: integer|null
     //
-    // How many chat completion choices to generate for each input
-    // message. Note that you will be charged based on the number of
-    // generated tokens across all of the choices. Keep n as 1 to
-    // minimize costs.
+    // How many completion choices to generate for the input prompt.
+    // The prompt gets prefilled once and its kv cells are shared into
+    // every sample's decode branch, so asking for more completions
+    // doesn't multiply the prompt processing cost. Note that you will
+    // be charged based on the number of generated tokens across all
+    // of the choices.
     Json& n = json["n"];
     if (!n.isNull()) {
         if (!n.isLong())
             return send_error(400, "n field must be integer");
-        if (n.getLong() != 1)
-            return send_error(400, "n field must be 1 if specified");
+        params->n = n.getLong();
+        if (params->n < 1 || params->n > Slots::FANOUT_MAX)
+            return send_error(400, "n field must be between 1 and 8");
     }
 
     // best_of: integer|null
@@ -224,8 +873,8 @@ Client::get_v1_completions_params(V1CompletionParams* params)
     if (!best_of.isNull()) {
         if (!best_of.isLong())
             return send_error(400, "best_of field must be integer");
-        if (best_of.getLong() != 1)
-            return send_error(400, "best_of field must be 1 if specified");
+        if (best_of.getLong() != params->n)
+            return send_error(400, "best_of field must equal n if specified");
     }
 
     // echo: bool|null
@@ -288,6 +937,23 @@ Client::get_v1_completions_params(V1CompletionParams* params)
         params->max_tokens = max_completion_tokens.getNumber();
     }
 
+    // context_window: integer|null
+    //
+    // Extension. Caps how many tokens of history the model attends
+    // to while generating, evicting the middle of the context in the
+    // manner of streaming attention. See the chat completion endpoint
+    // for details. Fan-out requests (n > 1) keep full attention,
+    // since their lanes share kv state. Omitted or 0 means full
+    // attention.
+    Json& context_window = json["context_window"];
+    if (!context_window.isNull()) {
+        if (!context_window.isLong())
+            return send_error(400, "context_window must be integer");
+        if (context_window.getLong() && context_window.getLong() < 256)
+            return send_error(400, "context_window must be at least 256");
+        params->context_window = context_window.getLong();
+    }
+
     // top_p: number|null
     //
     // An alternative to sampling with temperature, called nucleus
@@ -364,6 +1030,27 @@ Client::get_v1_completions_params(V1CompletionParams* params)
             return send_error(400, "frequency_penalty must be -2 through 2");
     }
 
+    // priority: string|null
+    //
+    // Scheduling class for this request. "interactive" (the default)
+    // is for latency sensitive traffic and goes to the front of the
+    // slot queue. "batch" is for offline throughput work: it waits
+    // for interactive traffic to drain before claiming a slot, and
+    // hands its slot back between tokens whenever interactive work
+    // is queued, aging out after --batch-max-wait seconds so a long
+    // interactive burst can't starve it.
+    Json& priority = json["priority"];
+    if (!priority.isNull()) {
+        if (!priority.isString())
+            return send_error(400, "priority field must be string");
+        if (priority.getString() == "interactive")
+            params->priority = Slots::PRIORITY_INTERACTIVE;
+        else if (priority.getString() == "batch")
+            params->priority = Slots::PRIORITY_BATCH;
+        else
+            return send_error(400, "priority must be interactive or batch");
+    }
+
     // user: string|null
     //
     // A unique identifier representing your end-user, which can help
@@ -381,7 +1068,7 @@ Client::get_v1_completions_params(V1CompletionParams* params)
     Json& stop = json["stop"];
     if (!stop.isNull()) {
         if (stop.isString()) {
-            params->add_stop(model_, stop.getString());
+            params->add_stop(stop.getString());
         } else if (stop.isArray()) {
             std::vector<Json>& stops = stop.getArray();
             if (stops.size() > 4)
@@ -391,11 +1078,46 @@ Client::get_v1_completions_params(V1CompletionParams* params)
                     return send_error(400, "stop array item must be string");
                 if (stop2.getString().size() > 50)
                     return send_error(400, "stop array string too long");
-                params->add_stop(model_, stop2.getString());
+                params->add_stop(stop2.getString());
             }
         } else {
             return send_error(400, "stop field must be string or string array");
         }
+        params->stop_matcher = StopMatcher::get(params->stop);
+    }
+
+    // beam_width: integer|null
+    //
+    // Extension. When this is 2 or more, sampling is replaced with
+    // beam search: the server keeps beam_width highest scoring
+    // continuations alive in parallel decode lanes that share the
+    // prompt's kv cells copy-on-write, prunes the rest each step, and
+    // returns the n best finished hypotheses. Beams score the model's
+    // raw log probabilities, so temperature, penalties, and seed have
+    // no effect. Results cannot be streamed, since a beam's tokens
+    // aren't final until the search ends.
+    Json& beam_width = json["beam_width"];
+    if (!beam_width.isNull()) {
+        if (!beam_width.isLong())
+            return send_error(400, "beam_width field must be integer");
+        params->beam_width = beam_width.getLong();
+        if (params->beam_width < 2 || params->beam_width > Slots::FANOUT_MAX)
+            return send_error(400, "beam_width must be between 2 and 8");
+        if (params->stream)
+            return send_error(400, "beam_width can't stream");
+        if (params->n > params->beam_width)
+            return send_error(400, "n must not exceed beam_width");
+        if (params->stop_matcher)
+            return send_error(400, "stop isn't supported with beam_width");
+    }
+
+    // a greedy request always decodes the same answer, so the exact
+    // request json (minus the stream flag) can key a response cache.
+    // sampled requests stay uncached, since redrawing is their point
+    if (params->temperature == 0 && !params->stream && params->n == 1) {
+        json.getObject().erase("stream");
+        json.getObject().erase("stream_options");
+        params->cache_key = json.toString();
     }
 
     return true;
@@ -404,12 +1126,28 @@ Client::get_v1_completions_params(V1CompletionParams* params)
 bool
 Client::v1_completions()
 {
+    // the slots can't decode when the server is an embedding fleet
+    if (FLAG_embedding)
+        return send_error(403, "server is in embedding only mode");
+
     // get parameters
     auto params = new V1CompletionParams;
     defer_cleanup(cleanup_params, params);
     if (!get_v1_completions_params(params))
         return false;
 
+    // deterministic duplicates (retries, identical rag queries, eval
+    // reruns) serve straight from the response cache without touching
+    // a slot. the replayed body keeps the original id and timestamp
+    if (!params->cache_key.empty()) {
+        std::string cached;
+        if (completioncache_get(params->cache_key, &cached)) {
+            char* p = append_http_response_message(obuf_.p, 200);
+            p = stpcpy(p, "Content-Type: application/json\r\n");
+            return send_response(obuf_.p, p, cached);
+        }
+    }
+
     // create state and response objects
     V1CompletionState* state = new V1CompletionState;
     defer_cleanup(cleanup_state, state);
@@ -420,16 +1158,44 @@ Client::v1_completions()
     if (llama_should_add_bos_token(model_))
         state->atoms.emplace_back(llama_token_bos(model_));
 
-    // turn text into tokens
-    atomize(model_, &state->atoms, params->prompt, PARSE_SPECIAL);
+    // turn text into tokens. a big document starts prefilling as soon
+    // as its first chunk of tokens is ready, while pool threads keep
+    // tokenizing the rest
+    AtomStream stream(model_, &state->atoms, params->prompt, PARSE_SPECIAL);
+    stream.pump();
 
-    // we don't support multiple images yet
-    state->atoms = remove_old_image_atoms(state->atoms);
+    // we don't support multiple images yet. a stream that isn't done
+    // after one pump holds plain text with no images in it
+    if (stream.done())
+        state->atoms = remove_old_image_atoms(state->atoms);
 
     // find appropriate slot
-    slot_ = worker_->server_->slots_->take(state->atoms);
+    int retry_after;
+    if ((retry_after = metering_admit()))
+        return send_too_busy(retry_after);
+    if ((retry_after = slots()->admission_delay()))
+        return send_too_busy(retry_after);
+    slot_ = slots()->take(state->atoms, "", params->priority, slot_hint());
+    if (!slot_)
+        return send_error(408, "deadline exceeded");
     defer_cleanup(cleanup_slot, this);
 
+    // beam search advances every candidate continuation through the
+    // same forked decode lanes fan-out uses, picking tokens by score
+    // instead of sampling them
+    if (params->beam_width) {
+        stream.drain();
+        return beam_search_completions(this, params, state, response);
+    }
+
+    // requests wanting several samples fork the prompt's kv cells
+    // into parallel decode branches after a single prefill. fanout
+    // lanes copy the atom vector, so it has to be whole first
+    if (params->n > 1) {
+        stream.drain();
+        return fanout_completions(this, params, state, response);
+    }
+
     // init sampling
     llama_sampling_context* sampler = create_sampler(params);
     if (!sampler)
@@ -438,8 +1204,10 @@ Client::v1_completions()
 
     // prefill time
     int prompt_tokens = 0;
-    if ((prompt_tokens = slot_->prefill(state->atoms)) < 0) {
+    if ((prompt_tokens = slot_->prefill(stream)) < 0) {
         SLOG("slot prefill failed: %s", Slot::describe_error(prompt_tokens));
+        if (prompt_tokens == Slot::canceled && deadline_expired())
+            return send_error(408, "deadline exceeded");
         return send_error(500, Slot::describe_error(prompt_tokens));
     }
 
@@ -455,57 +1223,141 @@ Client::v1_completions()
 
     // initialize response
     if (params->stream) {
-        char* p = append_http_response_message(obuf_.p, 200);
-        p = stpcpy(p, "Content-Type: text/event-stream\r\n");
-        if (!send_response_start(obuf_.p, p))
-            return false;
-        choice["delta"]["role"] = "assistant";
-        choice["delta"]["content"] = "";
-        response->json["created"] = timespec_real().tv_sec;
-        if (params->stream_include_usage)
-            response->json["usage"] = nullptr;
-        response->content = make_event(response->json);
-        choice.getObject().erase("delta");
-        if (!send_response_chunk(response->content))
-            return false;
+        if (is_websocket_upgrade()) {
+            // binary token frames; see websocket.cpp
+            if (!send_websocket_upgrade())
+                return false;
+        } else {
+            char* p = append_http_response_message(obuf_.p, 200);
+            p = stpcpy(p, "Content-Type: text/event-stream\r\n");
+            p = append_slot_hint(p, slot_->id_);
+            if (!send_response_start(obuf_.p, p))
+                return false;
+            choice["delta"]["role"] = "assistant";
+            choice["delta"]["content"] = "";
+            response->json["created"] = timespec_real().tv_sec;
+            if (params->stream_include_usage)
+                response->json["usage"] = nullptr;
+            response->content = response->json.toString();
+            choice.getObject().erase("delta");
+            if (!send_response_event(response->content))
+                return false;
+        }
     }
 
     // prediction time
     int completion_tokens = 0;
     const char* finish_reason = "length";
+    const Pieces* pieces = slots()->pieces_;
+    bool incomplete = false;
+    int stop_state = 0;
     for (;;) {
+        // a request past its deadline keeps whatever it generated;
+        // ending here, before any more blocking work, is what bounds
+        // how long this slot stays occupied
+        if (deadline_expired())
+            break;
+        // batch requests get preempted at token boundaries: when an
+        // interactive request is queued, the slot goes back to the
+        // pool, and once the burst drains the prefix tree usually
+        // hands back the same slot with its kv cache intact, so
+        // resuming mostly just costs the wait
+        if (params->priority == Slots::PRIORITY_BATCH &&
+            slots()->interactive_queued()) {
+            SLOG("batch request yielding slot #%d to interactive work",
+                 slot_->id_);
+            std::vector<Atom> resume = slot_->history_;
+            cleanup_slot(this);
+            slot_ = slots()->take(resume, "", Slots::PRIORITY_BATCH);
+            if (!slot_)
+                return false; // deadline lapsed while standing aside
+            int err;
+            if ((err = slot_->prefill(resume)) < 0) {
+                SLOG("slot prefill failed resuming batch request: %s",
+                     Slot::describe_error(err));
+                break;
+            }
+        }
         if (params->max_tokens >= 0 &&
             completion_tokens >= params->max_tokens) {
             slot_->eval_token(llamafile_token_eot(model_));
             break;
         }
-        llama_token id = llama_sampling_sample(sampler, slot_->ctx_, NULL);
-        llama_sampling_accept(sampler, slot_->ctx_, id, DONT_APPLY_GRAMMAR);
-        ++completion_tokens;
-        if (slot_->eval_token(id) < 0) {
-            SLOG("ran out of context window");
+        // approximate attention opt-in: past the requested window
+        // the middle of the context stops being attended
+        if (params->context_window &&
+            slot_->ctx_used() > params->context_window)
+            slot_->bound_context(params->context_window);
+        timespec decode_started;
+        clock_gettime(CLOCK_MONOTONIC, &decode_started);
+        llama_token id = slot_->sample(sampler, DONT_APPLY_GRAMMAR);
+        if (id < 0) {
+            SLOG("failed to sample token");
             break;
         }
+        ++completion_tokens;
+        int err;
+        if ((err = slot_->eval_token(id)) < 0) {
+            // when generation overflows the context window, shift the
+            // oldest prompt out of kv cache and push on, rather than
+            // ending the response mid-sentence
+            if (err != Slot::out_of_context || //
+                slot_->shift_context() <= 0 || //
+                slot_->eval_token(id) < 0) {
+                SLOG("ran out of context window");
+                break;
+            }
+        }
+        timespec decode_ended;
+        clock_gettime(CLOCK_MONOTONIC, &decode_ended);
+        metrics_observe(
+          METRIC_DECODE,
+          timespec_tonanos(timespec_sub(decode_ended, decode_started)));
+        slot_->record_timing(
+          timespec_tomicros(decode_ended),
+          timespec_tomicros(timespec_sub(decode_ended, decode_started)));
+        // websocket clients get every sampled token, eog included,
+        // since they do their own detokenizing
+        if (websocket_ &&
+            !send_token_event(
+              id, timespec_tomicros(timespec_sub(decode_ended,
+                                                 decode_started))))
+            return false;
         if (llama_token_is_eog(model_, id)) {
             finish_reason = "stop";
             break;
         }
-        if (params->should_stop(slot_->history_)) {
+        // the precomputed table makes detokenizing a lookup and its
+        // completeness flag tells us whether the buffered delta still
+        // dangles mid utf-8 sequence; empty pieces leave the verdict
+        // of the last byte producing token in place
+        std::string_view piece = pieces->view(id);
+        if (params->stop_matcher &&
+            (stop_state = params->stop_matcher->feed(stop_state, piece)) < 0) {
             slot_->eval_token(llamafile_token_eot(model_));
             finish_reason = "stop";
             break;
         }
-        state->piece +=
-          llamafile_token_to_piece(slot_->ctx_, id, DONT_RENDER_SPECIAL_TOKENS);
+        if (!piece.empty())
+            incomplete = pieces->ends_incomplete(id);
+        state->piece += piece;
         if (!state->piece.empty()) {
-            if (params->stream) {
-                if (!ends_with_incomplete_utf8(state->piece)) {
+            if (websocket_) {
+                state->piece.clear(); // token frames already sent
+            } else if (params->stream) {
+                if (!incomplete) {
                     char* p = append_http_response_message(obuf_.p, 200);
                     choice["text"] = state->piece;
                     response->json["created"] = timespec_real().tv_sec;
-                    response->content = make_event(response->json);
-                    if (!send_response_chunk(response->content))
+                    response->content = response->json.toString();
+                    timespec write_started;
+                    clock_gettime(CLOCK_MONOTONIC, &write_started);
+                    if (!send_response_event(response->content))
                         return false;
+                    timespec write_ended;
+                    clock_gettime(CLOCK_MONOTONIC, &write_ended);
+                    slot_->record_write_us(timespec_tomicros(
+                      timespec_sub(write_ended, write_started)));
                     state->piece.clear();
                 }
             } else {
@@ -517,7 +1369,10 @@ Client::v1_completions()
     choice["finish_reason"] = finish_reason;
 
     // finalize response
+    int took_slot = slot_->id_;
     cleanup_slot(this);
+    if (websocket_)
+        return send_websocket_finish(finish_reason);
     if (params->stream) {
         choice["text"] = "";
         response->json["created"] = timespec_real().tv_sec;
@@ -527,10 +1382,10 @@ Client::v1_completions()
             usage["completion_tokens"] = completion_tokens;
             usage["total_tokens"] = completion_tokens + prompt_tokens;
         }
-        response->content = make_event(response->json);
-        if (!send_response_chunk(response->content))
+        response->content = response->json.toString();
+        if (!send_response_event(response->content))
             return false;
-        if (!send_response_chunk("data: [DONE]\n\n"))
+        if (!send_response_event("[DONE]"))
             return false;
         return send_response_finish();
     } else {
@@ -542,8 +1397,11 @@ Client::v1_completions()
         response->json["created"] = timespec_real().tv_sec;
         char* p = append_http_response_message(obuf_.p, 200);
         p = stpcpy(p, "Content-Type: application/json\r\n");
+        p = append_slot_hint(p, took_slot);
         response->content = response->json.toStringPretty();
         response->content += '\n';
+        if (!params->cache_key.empty())
+            completioncache_put(params->cache_key, response->content);
         return send_response(obuf_.p, p, response->content);
     }
 }
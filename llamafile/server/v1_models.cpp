@@ -19,6 +19,9 @@
 #include "llama.cpp/llama.h"
 #include "llamafile/json.h"
 #include "llamafile/llamafile.h"
+#include "llamafile/server/models.h"
+#include "llamafile/server/server.h"
+#include "llamafile/server/worker.h"
 #include "llamafile/string.h"
 #include <ctime>
 
@@ -35,11 +38,23 @@ Client::v1_models()
 {
     jt::Json json;
     json["object"] = "list";
-    Json& model = json["data"][0];
-    model["id"] = stripext(basename(FLAG_model));
-    model["object"] = "model";
-    model["created"] = model_creation_time;
-    model["owned_by"] = "llamafile";
+    Json& data = json["data"];
+    Models* models = worker_->server_->models_;
+    if (models) {
+        for (size_t i = 0; i < models->models_.size(); ++i) {
+            Json& model = data[i];
+            model["id"] = models->models_[i]->name;
+            model["object"] = "model";
+            model["created"] = model_creation_time;
+            model["owned_by"] = "llamafile";
+        }
+    } else {
+        Json& model = data[0];
+        model["id"] = stripext(basename(FLAG_model));
+        model["object"] = "model";
+        model["created"] = model_creation_time;
+        model["owned_by"] = "llamafile";
+    }
     char* p = append_http_response_message(obuf_.p, 200);
     p = stpcpy(p, "Content-Type: application/json\r\n");
     return send_response(obuf_.p, p, json.toString());
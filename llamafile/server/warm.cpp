@@ -0,0 +1,53 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "models.h"
+#include "server.h"
+#include "utils.h"
+#include "worker.h"
+
+namespace lf {
+namespace server {
+
+// hints that a model is about to receive traffic, e.g.
+//
+//     GET /warm?model=mistral-7b-instruct-v0.2.Q4_K_M
+//     {"status": "warming"}
+//
+// an external scheduler that knows a switch is coming calls this so
+// the weights start coming off disk before the first request lands.
+// unknown names resolve to the startup model, like they do for the
+// openai model field, and warming a model that's already hot is a
+// no-op, so a stale hint is harmless
+bool
+Client::warm()
+{
+    Models* models = worker_->server_->models_;
+    if (!models)
+        return send_error(404, "no model registry");
+    std::string name(or_empty(param("model")));
+    if (name.empty())
+        return send_error(400, "missing model parameter");
+    models->warm(models->find(name));
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, "{\"status\": \"warming\"}\n");
+}
+
+} // namespace server
+} // namespace lf
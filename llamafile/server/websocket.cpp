@@ -0,0 +1,200 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llama.cpp/base64.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/slot.h"
+#include "llamafile/server/utils.h"
+#include "third_party/mbedtls/sha1.h"
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <time.h>
+
+// websocket transport for token streaming
+//
+// server-sent events spend ~60 bytes of framing and json on every
+// token, which matters once decode speed reaches hundreds of tokens
+// per second. a completion request that carries websocket upgrade
+// headers gets a 101 response instead, and each token goes out as one
+// binary frame holding a varint token id and a varint decode time in
+// microseconds: two header bytes plus typically four of payload. the
+// client detokenizes with its own copy of the piece table, which it
+// can fetch once via /v1/tokenize. frames share the server-sent event
+// nagle buffer, so the writev coalescing behavior and --sse-flush-ms
+// batching window are identical across both transports.
+//
+// rfc 6455 frames the handshake as a get request, but the completion
+// parameters ride in the request body and the interactive clients this
+// serves aren't browsers, so the upgrade is honored on post too. the
+// server may also decline an upgrade and answer with ordinary
+// server-sent events, which the rfc permits; fan-out requests and
+// logprob requests do this since their payloads have no binary
+// framing. permessage-deflate is never negotiated by design: deflate
+// state costs memory per connection and buys nothing on frames this
+// small.
+//
+// the stream is one way. the client sends nothing between the
+// handshake and the close handshake, and the connection always closes
+// when the response is finished, so control frames from the client are
+// never read. the finish reason travels in the close frame's reason
+// text.
+
+namespace lf {
+namespace server {
+
+static const char kWebsocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// appends unsigned leb128 varint to frame buffer
+static void
+append_varint(std::string& buf, unsigned long x)
+{
+    while (x >= 0x80) {
+        buf += (char)(0x80 | (x & 0x7f));
+        x >>= 7;
+    }
+    buf += (char)x;
+}
+
+// appends websocket frame header for a server frame, which is never
+// masked. all our frames are final and tiny, but the two larger
+// length encodings are handled anyway so this stays correct if a
+// bigger payload ever goes through it
+static void
+append_frame_header(std::string& buf, int opcode, size_t len)
+{
+    buf += (char)(0x80 | opcode);
+    if (len < 126) {
+        buf += (char)len;
+    } else if (len < 65536) {
+        buf += (char)126;
+        buf += (char)(len >> 8);
+        buf += (char)len;
+    } else {
+        buf += (char)127;
+        for (int i = 7; i >= 0; --i)
+            buf += (char)(len >> (i * 8));
+    }
+}
+
+// returns true if this request asks to upgrade to websocket
+bool
+Client::is_websocket_upgrade()
+{
+    return msg_.version >= 11 &&
+           header_has_token(get_header("Connection"), "upgrade") &&
+           header_has_token(get_header("Upgrade"), "websocket") &&
+           get_header("Sec-WebSocket-Version") == "13" &&
+           !get_header("Sec-WebSocket-Key").empty();
+}
+
+// sends 101 response switching this connection to websocket framing.
+//
+// after this function is called, send_token_event() may be called to
+// stream tokens. when you're done, you must call
+// send_websocket_finish() to complete the response.
+bool
+Client::send_websocket_upgrade()
+{
+    // the accept token proves to the client that the server it shook
+    // hands with actually speaks websocket rather than echoing
+    std::string key(get_header("Sec-WebSocket-Key"));
+    key += kWebsocketGuid;
+    unsigned char digest[20];
+    mbedtls_sha1_ret(key.data(), key.size(), digest);
+    std::string accept;
+    accept.resize(base64::required_encode_size(sizeof(digest)));
+    accept.resize(base64::encode(digest, digest + sizeof(digest),
+                                 accept.begin()) -
+                  accept.begin());
+
+    char* p = append_http_response_message(obuf_.p, 101);
+    p = stpcpy(p, "Upgrade: websocket\r\n");
+    p = stpcpy(p, "Connection: Upgrade\r\n");
+    p = stpcpy(p, "Sec-WebSocket-Accept: ");
+    p = (char*)mempcpy(p, accept.data(), accept.size());
+    p = stpcpy(p, "\r\n");
+    if (slot_)
+        p = append_slot_hint(p, slot_->id_);
+    p = stpcpy(p, "\r\n");
+
+    // once frames flow there's no http message boundary to resume
+    // from, so the connection can't be kept alive afterwards
+    close_connection_ = true;
+    websocket_ = true;
+    should_send_error_if_canceled_ = false;
+    sse_buf_.clear();
+    sse_last_flush_ = 0;
+    return send(std::string_view(obuf_.p, p - obuf_.p));
+}
+
+// sends one websocket frame immediately, bypassing the nagle buffer
+bool
+Client::send_websocket_frame(int opcode, const std::string_view payload)
+{
+    std::string header;
+    append_frame_header(header, opcode, payload.size());
+    return send2(header, payload);
+}
+
+// appends one binary token frame to the outgoing event buffer.
+//
+// the flush policy is the same nagle-style window send_response_event()
+// uses, since the syscall economics don't care which transport the
+// bytes wear. see that function for the reasoning
+bool
+Client::send_token_event(int token, long micros)
+{
+    std::string payload;
+    append_varint(payload, token);
+    append_varint(payload, micros);
+    append_frame_header(sse_buf_, 0x2, payload.size());
+    sse_buf_ += payload;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long us = now.tv_sec * 1000000L + now.tv_nsec / 1000;
+    if (FLAG_sse_flush_ms > 0 && //
+        us - sse_last_flush_ < FLAG_sse_flush_ms * 1000L &&
+        sse_buf_.size() < 16384)
+        return true;
+    return flush_response_events();
+}
+
+// finishes websocket response with a close frame carrying the finish
+// reason, e.g. "stop" or "length".
+//
+// after this function is called, the handler must return control. the
+// connection tears down without waiting on the client's answering
+// close frame, which rfc 6455 tolerates and which keeps a slow client
+// from holding the worker thread
+bool
+Client::send_websocket_finish(const char* reason)
+{
+    if (!flush_response_events())
+        return false;
+    cleanup();
+    std::string payload;
+    payload += (char)(1000 >> 8); // normal closure
+    payload += (char)(1000 & 255);
+    payload += reason;
+    return send_websocket_frame(0x8, payload);
+}
+
+} // namespace server
+} // namespace lf
@@ -16,17 +16,21 @@
 // limitations under the License.
 
 #include "worker.h"
+#include "llamafile/chaos.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/server/client.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/parker.h"
 #include "llamafile/server/server.h"
 #include "llamafile/server/signals.h"
 #include "llamafile/server/tokenbucket.h"
+#include "llamafile/server/tunables.h"
 #include "llamafile/threadlocal.h"
 #include "llamafile/trust.h"
 #include <atomic>
 #include <cassert>
 #include <cosmo.h>
+#include <cstdio>
 #include <exception>
 #include <pthread.h>
 
@@ -56,20 +60,34 @@ Worker::begin()
         tokens = tokenbucket_acquire(client_.client_ip_);
     server_->lock();
     dll_remove(&server_->idle_workers, &elem_);
+    bool stretch = false;
     if (dll_is_empty(server_->idle_workers)) {
-        Dll* slowbro;
-        if ((slowbro = dll_last(server_->active_workers))) {
-            SLOG("all threads active! dropping oldest client");
-            WORKER(slowbro)->kill();
+        if (server_->worker_count.load(std::memory_order_acquire) <
+            FLAG_workers_max) {
+            // every handler just went busy, but busy mostly means
+            // blocked on the batcher or the socket, not computing, so
+            // the pool stretches with another thread rather than
+            // capping the number of streams in flight
+            stretch = true;
+        } else {
+            Dll* slowbro;
+            if ((slowbro = dll_last(server_->active_workers))) {
+                SLOG("all %d threads active! dropping oldest client",
+                     FLAG_workers_max);
+                WORKER(slowbro)->kill();
+            }
         }
     }
     working_ = true;
-    if (tokens > FLAG_token_burst) {
+    if (tokens > tunables()->token_burst) {
         dll_make_last(&server_->active_workers, &elem_);
     } else {
         dll_make_first(&server_->active_workers, &elem_);
     }
     server_->unlock();
+    LLAMAFILE_CHAOS_POINT("worker_begin_unlocked");
+    if (stretch)
+        server_->spawn();
 }
 
 void
@@ -96,6 +114,7 @@ Worker::deprioritize()
 void
 Worker::retire()
 {
+    LLAMAFILE_CHAOS_POINT("worker_retire");
     server_->lock();
     if (working_)
         dll_remove(&server_->active_workers, &elem_);
@@ -110,14 +129,42 @@ Worker::retire()
 void
 Worker::handle()
 {
-    if ((client_.fd_ = server_->accept(&client_.client_ip_)) == -1) {
-        if (IsWindows() && errno == ENOTSOCK) {
+    // parked keep-alive connections with bytes waiting take priority
+    // over blocking this thread on the listening socket
+    int clifd;
+    unsigned clientip;
+    if ((clifd = server_->parker_->unpark(&clientip)) != -1) {
+        // resumed connections already went through Server::accept()
+        // once, so only the thread name needs refreshing
+        char name[17];
+        snprintf(name,
+                 sizeof(name),
+                 "%hhu.%hhu.%hhu.%hhu",
+                 clientip >> 24,
+                 clientip >> 16,
+                 clientip >> 8,
+                 clientip);
+        set_thread_name(name);
+    } else if ((clifd = server_->accept(&clientip)) == -1) {
+        if (errno == EINTR) {
+            // the parker poked us because a connection unparked
+        } else if (IsWindows() && errno == ENOTSOCK) {
             // Server::shutdown() calls close() on the listening socket
         } else {
             SLOG("accept returned %m");
         }
         return;
     }
+    client_.fd_ = clifd;
+    client_.client_ip_ = clientip;
+
+    // reblock the parker's wake signal so it can't EINTR this
+    // client's own i/o while the thread is busy with a request.
+    // Worker::run() unblocks it again before the next accept().
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, 0);
 
     begin();
 
@@ -129,7 +176,18 @@ Worker::handle()
         SLOG("caught unknown exception");
     }
 
-    client_.close();
+    if (client_.should_park_) {
+        // the connection went idle between keep-alive requests. hand
+        // the fd to the parker so this thread can serve someone else
+        // rather than blocking in read() until the next request.
+        int fd = client_.fd_;
+        unsigned ip = client_.client_ip_;
+        client_.fd_ = -1;
+        client_.close();
+        server_->parker_->park(fd, ip);
+    } else {
+        client_.close();
+    }
     end();
 }
 
@@ -178,10 +236,29 @@ Worker::run()
         sigaddset(&mask, SIGHUP);
         sigaddset(&mask, SIGINT);
         sigaddset(&mask, SIGTERM);
-        sigaddset(&mask, SIGUSR1);
         sigaddset(&mask, SIGALRM);
+        // SIGUSR1 stays unblocked so the parker can interrupt
+        // accept() when a parked connection becomes readable
         pthread_sigmask(SIG_SETMASK, &mask, 0);
         handle();
+        // once a burst passes, threads stretched beyond the --workers
+        // floor retire as they come up idle, so long as another idle
+        // thread remains to guard the listening socket. shrinking is
+        // opportunistic: a surplus thread parked in accept() costs
+        // nothing and stays until its next turn comes around
+        if (server_->worker_count.load(std::memory_order_acquire) >
+            FLAG_workers) {
+            bool surplus;
+            server_->lock();
+            surplus = server_->worker_count.load(std::memory_order_relaxed) >
+                        FLAG_workers &&
+                      !working_ &&
+                      dll_first(server_->idle_workers) !=
+                        dll_last(server_->idle_workers);
+            server_->unlock();
+            if (surplus)
+                break;
+        }
     }
 
     cleanup.set(nullptr);
@@ -16,8 +16,10 @@
 // limitations under the License.
 
 #include "llamafile/server/log.h"
+#include "llamafile/server/metrics.h"
 #include "utils.h"
 #include <cerrno>
+#include <cosmo.h>
 #include <string_view>
 
 namespace lf {
@@ -39,7 +41,14 @@ safe_writev(int fd, const iovec* iov, int iovcnt)
             return -1;
         }
     }
-    return writev(fd, iov, iovcnt);
+    timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    ssize_t rc = writev(fd, iov, iovcnt);
+    timespec ended;
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+    metrics_observe(METRIC_WRITE,
+                    timespec_tonanos(timespec_sub(ended, started)));
+    return rc;
 }
 
 } // namespace server
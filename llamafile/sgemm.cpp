@@ -16,17 +16,55 @@
 // limitations under the License.
 
 #include "sgemm.h"
+#include "coldtier.h"
 #include "llamafile.h"
+#include "numa.h"
+#include "trace.h"
+#include "llama.cpp/ggml.h"
+#include <atomic>
 #include <cassert>
 #include <cosmo.h>
 #include <cpuid.h>
 #include <libc/sysv/consts/hwcap.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/auxv.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#ifdef __aarch64__
+#ifndef HWCAP2_BF16
+#define HWCAP2_BF16 (1ul << 14)
+#endif
+#endif // __aarch64__
+
+#ifdef __x86_64__
+// the kernel hides the amx tile registers from processes until they
+// ask for them, so this must succeed before the amx kernels may run
+static bool llamafile_amx_enable(void) {
+    if (!IsLinux())
+        return false;
+    long rc;
+    asm volatile("syscall"
+                 : "=a"(rc)
+                 : "0"(158 /* arch_prctl */), //
+                   "D"(0x1023 /* ARCH_REQ_XCOMP_PERM */), //
+                   "S"(18 /* XFEATURE_XTILEDATA */)
+                 : "rcx", "r11", "memory");
+    return !rc;
+}
+#endif // __x86_64__
 
 static const struct GemmFuncs {
     typeof(llamafile_sgemm) *sgemm;
     typeof(llamafile_mixmul) *mixmul;
     typeof(llamafile_mixmul_iqk) *iqk_mixmul = iqk_mul_mat_moe_unsupported;
+    const char *arch; // names the tier for the sgemm plan file
     GemmFuncs() {
 #ifdef __x86_64__
         if (X86_HAVE(AVX)) {
@@ -38,25 +76,37 @@ static const struct GemmFuncs {
                             X86_HAVE(AVX512DQ) && //
                             X86_HAVE(AVX512_VNNI) && //
                             X86_HAVE(AVX512_BF16)) {
-                            // AMD Zen4+ (2023-)
-                            sgemm = llamafile_sgemm_amd_zen4;
+                            if (X86_HAVE(AMX_TILE) && //
+                                X86_HAVE(AMX_INT8) && //
+                                llamafile_amx_enable()) {
+                                // Intel Sapphire Rapids+ (2023-)
+                                sgemm = llamafile_sgemm_amd_amx;
+                                arch = "amx";
+                            } else {
+                                // AMD Zen4+ (2023-)
+                                sgemm = llamafile_sgemm_amd_zen4;
+                                arch = "zen4";
+                            }
                             mixmul = llamafile_mixmul_amd_zen4;
                             iqk_mixmul = iqk_mul_mat_moe_zen4;
                         } else {
                             // Intel Xeon Skylake+ (2015-)
                             sgemm = llamafile_sgemm_amd_avx512f;
+                            arch = "avx512f";
                             mixmul = llamafile_mixmul_amd_avx512f;
                             iqk_mixmul = iqk_mul_mat_moe;
                         }
                     } else if (X86_HAVE(AVXVNNI)) {
                         // Intel Alderlake (2021-)
                         sgemm = llamafile_sgemm_amd_avxvnni;
+                        arch = "avxvnni";
                         mixmul = llamafile_mixmul_amd_avxvnni;
                         iqk_mixmul = iqk_mul_mat_moe;
                     } else {
                         // Intel Haswell/Broadwell/Skylake (2013-2020)
                         // AMD Excavator (2015-2022)
                         sgemm = llamafile_sgemm_amd_avx2;
+                        arch = "avx2";
                         mixmul = llamafile_mixmul_amd_avx2;
                         if (X86_HAVE(F16C))
                             iqk_mixmul = iqk_mul_mat_moe;
@@ -64,6 +114,7 @@ static const struct GemmFuncs {
                 } else {
                     // AMD Piledriver (2011-2014)
                     sgemm = llamafile_sgemm_amd_fma;
+                    arch = "fma";
                     mixmul = llamafile_mixmul_amd_fma;
                     if (X86_HAVE(F16C))
                         iqk_mixmul = iqk_mul_mat_moe;
@@ -72,6 +123,7 @@ static const struct GemmFuncs {
                 // Intel Sandybridge/Ivybridge (2010-2012)
                 // AMD Bulldozer (2011)
                 sgemm = llamafile_sgemm_amd_avx;
+                arch = "avx";
                 mixmul = llamafile_mixmul_amd_avx;
             }
         } else {
@@ -79,24 +131,38 @@ static const struct GemmFuncs {
             // Intel Core/Nehalem (2006-2009)
             sgemm = llamafile_sgemm_unsupported;
             mixmul = llamafile_mixmul_unsupported;
+            arch = "none";
         }
 #elif defined(__aarch64__)
         long hwcap = getauxval(AT_HWCAP);
+        long hwcap2 = getauxval(AT_HWCAP2);
         if ((hwcap & HWCAP_FPHP) && // fp16 scalar isa (ID_AA64PFR0_EL1.FP == 1)
             (hwcap & HWCAP_ASIMDHP) && // fp16 vector isa (ID_AA64PFR0_EL1.AdvSIMD == 1)
-            (hwcap & HWCAP_ASIMDDP)) { // dotprod isa (ID_AA64ISAR0_EL1.DP == 1)
+            (hwcap & HWCAP_ASIMDDP) && // dotprod isa (ID_AA64ISAR0_EL1.DP == 1)
+            (hwcap2 & HWCAP2_BF16)) { // bf16 isa (ID_AA64ISAR1_EL1.BF16 == 1)
+            // e.g. AWS Graviton4, NVIDIA Grace
+            sgemm = llamafile_sgemm_arm86;
+            arch = "arm86";
+            mixmul = llamafile_mixmul_arm86;
+            iqk_mixmul = iqk_mul_mat_moe_arm82;
+        } else if ((hwcap & HWCAP_FPHP) && // fp16 scalar isa (ID_AA64PFR0_EL1.FP == 1)
+                   (hwcap & HWCAP_ASIMDHP) && // fp16 vector isa (ID_AA64PFR0_EL1.AdvSIMD == 1)
+                   (hwcap & HWCAP_ASIMDDP)) { // dotprod isa (ID_AA64ISAR0_EL1.DP == 1)
             // e.g. Apple M1, Raspberry Pi 5
             sgemm = llamafile_sgemm_arm82;
+            arch = "arm82";
             mixmul = llamafile_mixmul_arm82;
             iqk_mixmul = iqk_mul_mat_moe_arm82;
         } else {
             // ARM64 baseline ISA
             sgemm = llamafile_sgemm_arm80;
+            arch = "arm80";
             mixmul = llamafile_mixmul_arm80;
         }
 #else
         sgemm = llamafile_sgemm_unsupported;
         mixmul = llamafile_mixmul_unsupported;
+        arch = "none";
 #endif
     }
 } funcs;
@@ -125,9 +191,397 @@ static const struct GemmFuncs {
  * @param Ctype is GGML data type of `C`
  * @return true if this function was able to service the matmul request
  */
+// weight tensors sit at arbitrary offsets inside the model mapping,
+// so banding the whole file across sockets would hand each socket a
+// few whole tensors rather than its row band of every tensor. the
+// first multiply is the first point where row geometry is known, so
+// placement happens here, once per tensor. `lda` counts elements for
+// float types and blocks for quantized ones, and ggml_type_size() is
+// bytes per element or per block to match, so their product is the
+// byte stride between rows either way
+static void numa_shard(const void *A, long m, long lda, int Atype) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static std::unordered_set<const void *> seen;
+    pthread_mutex_lock(&lock);
+    bool fresh = seen.insert(A).second;
+    pthread_mutex_unlock(&lock);
+    if (fresh)
+        llamafile_numa_shard(A, lda * ggml_type_size((enum ggml_type)Atype), m);
+}
+
+// decode-time matvecs can be so small that handing every thread its
+// sliver costs more in cache line traffic and barrier latency than the
+// arithmetic itself, which shows up painfully on little 4-core parts.
+// below these sizes (in multiply-adds) the dispatcher shrinks the team:
+// one thread computes the whole product, or two split it, and the
+// surplus threads head straight for the barrier ggml runs after every
+// op anyway. 2^16 madds is a 16x4096 matvec, comfortably inside one
+// core's cache and memory bandwidth
+#define GEMM_1T_MADDS (1L << 16)
+#define GEMM_2T_MADDS (1L << 18)
+
+// whether a kernel services a request is a pure function of the shapes
+// and types, but only the kernel knows the answer, and every thread of
+// an op must both give ggml the same answer and agree on how the rows
+// were split, or some band of the output never gets written. a verdict
+// therefore can't go live mid-op: a fast thread recording it after
+// computing its 1/nth sliver would let a staggered sibling read it and
+// shrink, tearing the partitioning. instead the first thread to meet a
+// signature claims its slot and computes the whole product alone while
+// every sibling waits on the verdict, so one partitioning governs each
+// occurrence of each signature. entries hold the exact signature,
+// since a collision here would corrupt inference. decode reuses a
+// handful of signatures per model, so the table warms on the first
+// token and never needs eviction
+#define SUPPORT_SLOTS 256
+#define SUPPORT_PENDING 0
+#define SUPPORT_OK 1
+#define SUPPORT_REFUSED 2
+
+static std::atomic<uint64_t> g_support[SUPPORT_SLOTS];
+static std::atomic<int> g_support_state[SUPPORT_SLOTS];
+
+// packs the signature into 63 bits (6/6/6 for the types, 8 for n, 18
+// each for m and k) so claiming a slot is one atomic word swap; the
+// dispatcher checks the fields fit before calling
+static uint64_t support_key(long m, long n, long k, int Atype, int Btype, int Ctype) {
+    return (uint64_t)Atype << 57 | (uint64_t)Btype << 51 | (uint64_t)Ctype << 45 |
+           (uint64_t)n << 37 | (uint64_t)m << 18 | (uint64_t)k;
+}
+
+// finds or claims the slot for a signature. sets *claimed when the
+// caller won the race to install the key and now owes the verdict in
+// g_support_state. returns -1 when the table is full, in which case
+// the signature keeps the full team forever, which is at least a
+// consistent answer across threads
+static int support_find(uint64_t key, bool *claimed) {
+    *claimed = false;
+    unsigned h = key * 0x9E3779B97F4A7C15ull >> 56;
+    for (int i = 0; i < SUPPORT_SLOTS; ++i) {
+        int j = (h + i) % SUPPORT_SLOTS;
+        uint64_t e = g_support[j].load(std::memory_order_relaxed);
+        if (!e) {
+            if (g_support[j].compare_exchange_strong(e, key, std::memory_order_acq_rel)) {
+                *claimed = true;
+                return j;
+            }
+            // lost the race; whoever won may have installed our key
+        }
+        if (e == key)
+            return j;
+    }
+    return -1;
+}
+
+// the iqk and tinyblas kernel families overlap on quantized weights,
+// and which one wins depends on the shape and the machine's cache
+// hierarchy. today the crossover is baked in as "iqk first", which
+// leaves measurable speed on the table for shapes that straddle it.
+// rather than move the hardcoded line around, the winner is measured:
+// the first time a run services an overlapping signature, both
+// families get timed single-threaded against the live operands, and
+// the verdict lands in a small plan file under the app dir keyed by
+// (shape, types) with the kernel tier stamped in the header. the plan
+// is consulted from the *next* run on, never the one that measured
+// it, so the binding a thread reads is immutable for the life of the
+// process and every thread of an op is guaranteed the same answer,
+// which matters because the two families partition work differently
+// and a split verdict would tear the output
+
+#define PLAN_FILE "sgemm.plan"
+#define PLAN_VERSION 1
+#define PLAN_SLOTS 512
+
+// a once-per-signature trial stalls the op team behind it, so the
+// single-threaded work it may take on has to be bounded. this budget
+// covers every matvec and small-batch decode shape of a 70b model,
+// which is where the crossover actually bites; giant prefill gemms
+// are bandwidth-bound in either family and aren't worth measuring
+#define PLAN_TRIAL_MADDS (1L << 23)
+
+// set during trials so the dispatch in tinyblas_cpu_sgemm.inc runs
+// exactly the family being timed; zero means dispatch normally
+__thread int llamafile_sgemm_kernel;
+
+struct PlanEntry {
+    uint64_t key;
+    long m, n, k;
+    int Atype, Btype, Ctype;
+    int kernel;
+};
+
+static int g_plan_known; // entries loaded from disk; immutable once loaded
+static int g_plan_fresh; // entries measured this run; saved at exit, not consulted
+static PlanEntry g_plan[PLAN_SLOTS];
+static pthread_once_t g_plan_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// same field packing as support_key(), so one word identifies a
+// signature exactly; zero means the fields didn't fit
+static uint64_t plan_key(long m, long n, long k, int Atype, int Btype, int Ctype) {
+    if (m < 1 || m >= (1L << 18))
+        return 0;
+    if (n < 1 || n >= (1L << 8))
+        return 0;
+    if (k < 1 || k >= (1L << 18))
+        return 0;
+    return (uint64_t)Atype << 57 | (uint64_t)Btype << 51 | (uint64_t)Ctype << 45 |
+           (uint64_t)n << 37 | (uint64_t)m << 18 | (uint64_t)k;
+}
+
+static void plan_path(char *path, size_t size) {
+    llamafile_get_app_dir(path, size);
+    strlcat(path, PLAN_FILE, size);
+}
+
+static void plan_load(void) {
+    char path[PATH_MAX];
+    plan_path(path, sizeof(path));
+    FILE *f = fopen(path, "re");
+    if (!f)
+        return;
+    // the header names the kernel tier the winners were measured
+    // under. binding another tier's winners would be meaningless, so
+    // a mismatch (new cpu, migrated home directory) drops the file
+    char arch[32];
+    int version;
+    if (fscanf(f, "sgemm-plan %d %31s", &version, arch) != 2 || //
+        version != PLAN_VERSION || strcmp(arch, funcs.arch)) {
+        fclose(f);
+        return;
+    }
+    long m, n, k;
+    int Atype, Btype, Ctype;
+    char kernel[16];
+    while (g_plan_known < PLAN_SLOTS && //
+           fscanf(f, "%ld %ld %ld %d %d %d %15s", &m, &n, &k, &Atype, &Btype, &Ctype, kernel) ==
+               7) {
+        uint64_t key = plan_key(m, n, k, Atype, Btype, Ctype);
+        if (!key)
+            continue;
+        PlanEntry *e = &g_plan[g_plan_known];
+        e->key = key;
+        e->m = m;
+        e->n = n;
+        e->k = k;
+        e->Atype = Atype;
+        e->Btype = Btype;
+        e->Ctype = Ctype;
+        e->kernel = !strcmp(kernel, "tinyblas") ? LLAMAFILE_SGEMM_TINYBLAS : LLAMAFILE_SGEMM_IQK;
+        ++g_plan_known;
+    }
+    fclose(f);
+}
+
+static void plan_save(void) {
+    char dir[PATH_MAX];
+    llamafile_get_app_dir(dir, sizeof(dir));
+    if (makedirs(dir, 0755))
+        return;
+    char path[PATH_MAX];
+    char temp[PATH_MAX];
+    plan_path(path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.%d", path, getpid());
+    FILE *f = fopen(temp, "we");
+    if (!f)
+        return;
+    fprintf(f, "sgemm-plan %d %s\n", PLAN_VERSION, funcs.arch);
+    for (int i = 0; i < g_plan_known + g_plan_fresh; ++i) {
+        PlanEntry *e = &g_plan[i];
+        fprintf(f, "%ld %ld %ld %d %d %d %s\n", e->m, e->n, e->k, e->Atype, e->Btype, e->Ctype,
+                e->kernel == LLAMAFILE_SGEMM_TINYBLAS ? "tinyblas" : "iqk");
+    }
+    if (fclose(f)) {
+        unlink(temp);
+        return;
+    }
+    rename(temp, path);
+}
+
+// times one family over the live operands into scratch output. one
+// warmup run faults the scratch in, then the better of two timed runs
+// rides out scheduler noise. returns -1 if the family refuses
+static long plan_trial(int kernel, long m, long n, long k, const void *A, long lda, const void *B,
+                       long ldb, float *C, int Atype, int Btype, int Ctype) {
+    long best = -1;
+    llamafile_sgemm_kernel = kernel;
+    for (int i = 0; i < 3; ++i) {
+        timespec beg, end;
+        clock_gettime(CLOCK_MONOTONIC, &beg);
+        if (!llamafile_sgemm(m, n, k, A, lda, B, ldb, C, m, 0, 1, Atype, Btype, Ctype)) {
+            best = -1;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long nanos = (end.tv_sec - beg.tv_sec) * 1000000000L + (end.tv_nsec - beg.tv_nsec);
+        if (i && (best < 0 || nanos < best))
+            best = nanos;
+    }
+    llamafile_sgemm_kernel = 0;
+    return best;
+}
+
+// measures which kernel family is faster for a signature the
+// dispatcher just serviced. signatures outside the iqk/tinyblas
+// overlap return immediately; new overlapping ones get both families
+// timed once and the winner recorded for the plan file saved at exit.
+// the caller must be thread zero of its op, since the trial runs
+// while the rest of the team drains toward the barrier
+static void plan_probe(long m, long n, long k, const void *A, long lda, const void *B, long ldb,
+                       int Atype, int Btype, int Ctype) {
+    if (llamafile_sgemm_kernel) // a trial must not probe itself
+        return;
+    if (FLAG_notune)
+        return;
+    if (Ctype != GGML_TYPE_F32)
+        return;
+    if (Btype != GGML_TYPE_Q8_0 && Btype != GGML_TYPE_Q8_1 && Btype != GGML_TYPE_Q8_K)
+        return;
+    switch (Atype) {
+        case GGML_TYPE_F32:
+        case GGML_TYPE_F16:
+        case GGML_TYPE_BF16:
+            return; // float weights have no iqk kernels to race
+        default:
+            break;
+    }
+    if (m * n * k > PLAN_TRIAL_MADDS) // k counts blocks for quants
+        return;
+    uint64_t key = plan_key(m, n, k, Atype, Btype, Ctype);
+    if (!key)
+        return;
+    pthread_once(&g_plan_once, plan_load);
+    pthread_mutex_lock(&g_plan_lock);
+    if (g_plan_known + g_plan_fresh == PLAN_SLOTS) {
+        pthread_mutex_unlock(&g_plan_lock);
+        return;
+    }
+    for (int i = 0; i < g_plan_known + g_plan_fresh; ++i) {
+        if (g_plan[i].key == key) {
+            pthread_mutex_unlock(&g_plan_lock);
+            return;
+        }
+    }
+    float *C = (float *)malloc(sizeof(float) * m * n);
+    if (!C) {
+        pthread_mutex_unlock(&g_plan_lock);
+        return;
+    }
+    long iqk = plan_trial(LLAMAFILE_SGEMM_IQK, m, n, k, A, lda, B, ldb, C, Atype, Btype, Ctype);
+    long tb =
+        plan_trial(LLAMAFILE_SGEMM_TINYBLAS, m, n, k, A, lda, B, ldb, C, Atype, Btype, Ctype);
+    free(C);
+    if (iqk < 0 && tb < 0) {
+        pthread_mutex_unlock(&g_plan_lock);
+        return;
+    }
+    PlanEntry *e = &g_plan[g_plan_known + g_plan_fresh];
+    e->key = key;
+    e->m = m;
+    e->n = n;
+    e->k = k;
+    e->Atype = Atype;
+    e->Btype = Btype;
+    e->Ctype = Ctype;
+    e->kernel = tb >= 0 && (iqk < 0 || tb < iqk) ? LLAMAFILE_SGEMM_TINYBLAS : LLAMAFILE_SGEMM_IQK;
+    if (!g_plan_fresh++)
+        atexit(plan_save);
+    pthread_mutex_unlock(&g_plan_lock);
+}
+
+// returns which kernel family should service a signature, or zero to
+// keep the dispatch order as written. verdicts come from the plan
+// measured by earlier runs on this machine; the current run's own
+// measurements are never returned, so the answer is stable for the
+// life of the process
+int llamafile_sgemm_plan(long m, long n, long k, int Atype, int Btype, int Ctype) {
+    if (FLAG_notune)
+        return 0;
+    pthread_once(&g_plan_once, plan_load);
+    if (!g_plan_known)
+        return 0;
+    uint64_t key = plan_key(m, n, k, Atype, Btype, Ctype);
+    if (!key)
+        return 0;
+    for (int i = 0; i < g_plan_known; ++i)
+        if (g_plan[i].key == key)
+            return g_plan[i].kernel;
+    return 0;
+}
+
 bool llamafile_sgemm(long m, long n, long k, const void *A, long lda, const void *B, long ldb,
                      void *C, long ldc, int ith, int nth, int Atype, int Btype, int Ctype) {
-    return funcs.sgemm(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype);
+    LLAMAFILE_TRACE("sgemm", "gemm");
+
+    // on multi-socket machines the `duty * ith` work split hands each
+    // thread a contiguous row band, so pinning thread ith to the node
+    // owning its band keeps weight reads off the socket interconnect
+    if (FLAG_numa) {
+        static thread_local bool pinned;
+        if (!pinned) {
+            llamafile_numa_pin(ith, nth);
+            pinned = true;
+        }
+        // activations are f32 and get placed by whichever pinned
+        // thread computes them, so only weights and kv cells (the
+        // operands that persist across calls) are worth sharding
+        if (!ith && Atype != GGML_TYPE_F32)
+            numa_shard(A, m, lda, Atype);
+    }
+
+    // with --cold-tier, every weight read stamps its 2mb regions so
+    // the sweeper can demote the tensors that stopped earning their
+    // residency. activations churn through fresh addresses and would
+    // only pollute the table, hence the same f32 exclusion as numa
+    if (FLAG_cold_tier && !ith && Atype != GGML_TYPE_F32)
+        llamafile_coldtier_touch(A, m * lda * ggml_type_size((enum ggml_type)Atype));
+
+    // small products get computed by a shrunken team once the kernel's
+    // verdict for their signature is on record. surplus threads return
+    // right away and park at ggml's post-op barrier; the guards keep
+    // the signature inside support_key()'s field widths
+    long work = m * n * k;
+    if (nth > 1 && work <= GEMM_2T_MADDS && //
+        m < (1L << 18) && n < (1L << 8) && k < (1L << 18)) {
+        uint64_t key = support_key(m, n, k, Atype, Btype, Ctype);
+        bool claimed;
+        int slot = support_find(key, &claimed);
+        if (slot >= 0) {
+            if (claimed) {
+                // first occurrence: compute the whole product alone so
+                // the siblings spinning below never mix partitionings
+                // with us, then publish the verdict they're waiting on
+                bool ok = funcs.sgemm(m, n, k, A, lda, B, ldb, C, ldc, 0, 1, Atype, Btype, Ctype);
+                g_support_state[slot].store(ok ? SUPPORT_OK : SUPPORT_REFUSED,
+                                            std::memory_order_release);
+                return ok;
+            }
+            int verdict;
+            while ((verdict = g_support_state[slot].load(std::memory_order_acquire)) ==
+                   SUPPORT_PENDING)
+                sched_yield();
+            if (verdict == SUPPORT_REFUSED)
+                // known refusal: the whole team reports false together
+                // so the fallback path splits the op as usual
+                return false;
+            int team = work <= GEMM_1T_MADDS ? 1 : 2;
+            if (ith >= team)
+                return true;
+            nth = team;
+            // siblings of the claiming op redo its team shares here,
+            // writing the same bytes the solo pass already wrote
+        }
+    }
+
+    bool ok = funcs.sgemm(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype);
+
+    // signatures both kernel families could service get measured once
+    // per machine, so the next run can bind the faster family to each
+    // shape instead of trusting the hardcoded order
+    if (ok && !ith)
+        plan_probe(m, n, k, A, lda, B, ldb, Atype, Btype, Ctype);
+
+    return ok;
 }
 
 /**
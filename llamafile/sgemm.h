@@ -20,8 +20,22 @@ bool iqk_mul_mat_moe_arm82(long, long, long, int, int, const void *, const void
 bool iqk_mul_mat_moe_unsupported(long, long, long, int, int, const void *, const void *, float *,
                                  long, long, const void *, int, int);
 
+// multiplies matrices, computing C = Aᵀ * B with no epilogue: bias
+// and activation stay separate ggml graph ops. fusing them here would
+// need the caller in ggml.c to know its consumer nodes, and ggml
+// schedules nodes independently across threads, so the fusion
+// decision belongs to the graph layer, not this kernel boundary
 bool llamafile_sgemm(long, long, long, const void *, long, const void *, long, void *, long, int,
                      int, int, int, int);
+
+// per-signature choice between the iqk and tinyblas kernel families,
+// measured on this machine and remembered on disk; see the plan code
+// in sgemm.cpp. the thread local pins dispatch to one family while a
+// measurement trial is in flight
+#define LLAMAFILE_SGEMM_IQK 1
+#define LLAMAFILE_SGEMM_TINYBLAS 2
+extern __thread int llamafile_sgemm_kernel;
+int llamafile_sgemm_plan(long, long, long, int, int, int);
 bool llamafile_mixmul(const struct ggml_compute_params *, const struct ggml_tensor *,
                       const struct ggml_tensor *, const struct ggml_tensor *, struct ggml_tensor *);
 size_t llamafile_mixmul_needs(const struct ggml_tensor *, const struct ggml_tensor *,
@@ -41,10 +55,14 @@ bool llamafile_sgemm_amd_avx512f(long, long, long, const void *, long, const voi
                                  long, int, int, int, int, int);
 bool llamafile_sgemm_amd_zen4(long, long, long, const void *, long, const void *, long, void *,
                               long, int, int, int, int, int);
+bool llamafile_sgemm_amd_amx(long, long, long, const void *, long, const void *, long, void *,
+                             long, int, int, int, int, int);
 bool llamafile_sgemm_arm80(long, long, long, const void *, long, const void *, long, void *, long,
                            int, int, int, int, int);
 bool llamafile_sgemm_arm82(long, long, long, const void *, long, const void *, long, void *, long,
                            int, int, int, int, int);
+bool llamafile_sgemm_arm86(long, long, long, const void *, long, const void *, long, void *, long,
+                           int, int, int, int, int);
 
 bool llamafile_mixmul_unsupported(const struct ggml_compute_params *, const struct ggml_tensor *,
                                   const struct ggml_tensor *, const struct ggml_tensor *,
@@ -73,6 +91,9 @@ bool llamafile_mixmul_arm80(const struct ggml_compute_params *, const struct ggm
 bool llamafile_mixmul_arm82(const struct ggml_compute_params *, const struct ggml_tensor *,
                             const struct ggml_tensor *, const struct ggml_tensor *,
                             struct ggml_tensor *);
+bool llamafile_mixmul_arm86(const struct ggml_compute_params *, const struct ggml_tensor *,
+                            const struct ggml_tensor *, const struct ggml_tensor *,
+                            struct ggml_tensor *);
 bool llamafile_mixmul_iqk(long, long, long, int, int, const void *, const void *, float *, long,
                           long, const void *, int, int);
 
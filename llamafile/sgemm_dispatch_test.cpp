@@ -0,0 +1,379 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ansiblas.h"
+#include "float.h"
+#include "llama.cpp/ggml-quants.h"
+#include "llama.cpp/ggml.h"
+#include "macros.h"
+#include "numba.h"
+#include "sgemm.h"
+#include <assert.h>
+#include <cosmo.h>
+#include <cpuid.h>
+#include <libc/sysv/consts/hwcap.h>
+#include <sys/auxv.h>
+
+// cross-isa validation of the sgemm dispatch chain
+//
+// one llamafile binary carries every per-arch kernel tier, but the
+// runtime dispatcher only ever exercises the one matching the host,
+// so a corrupted lower tier ships silently until it meets the old
+// hardware that selects it. this test calls each compiled tier
+// directly, skipping the dispatcher, on whatever subset the host
+// silicon can execute: every x86 tier is a feature subset of the one
+// above it, so a zen4 or sapphire rapids box validates the whole amd
+// chain, and an armv8.6 box the whole arm chain. shapes mirror real
+// model layers (decode matvecs, the n<=2 conversion fast path, and
+// prefill tiles), and every accepting tier must agree with the
+// dequantized ansi reference within a per-type ulp budget. tiers may
+// legitimately refuse a combination; refusing is reported, computing
+// it wrong is not tolerated.
+
+#define ALLOC(n) (float *)memalign(4096, sizeof(float) * (n))
+
+typedef bool sgemm_fn(long, long, long, const void *, long, const void *, long, void *, long, int,
+                      int, int, int, int);
+
+#ifdef __x86_64__
+
+// the kernel hides the amx tile registers from processes until they
+// ask for them, same dance the dispatcher does in sgemm.cpp
+static bool amx_enable(void) {
+    if (!IsLinux())
+        return false;
+    long rc;
+    asm volatile("syscall"
+                 : "=a"(rc)
+                 : "0"(158 /* arch_prctl */), //
+                   "D"(0x1023 /* ARCH_REQ_XCOMP_PERM */), //
+                   "S"(18 /* XFEATURE_XTILEDATA */)
+                 : "rcx", "r11", "memory");
+    return !rc;
+}
+
+static bool have_avx(void) {
+    return X86_HAVE(AVX);
+}
+static bool have_fma(void) {
+    return have_avx() && X86_HAVE(FMA);
+}
+static bool have_avx2(void) {
+    return have_fma() && X86_HAVE(AVX2);
+}
+static bool have_avxvnni(void) {
+    return have_avx2() && X86_HAVE(AVXVNNI);
+}
+static bool have_avx512f(void) {
+    return have_avx2() && X86_HAVE(AVX512F);
+}
+static bool have_zen4(void) {
+    return have_avx512f() && X86_HAVE(AVX512VL) && X86_HAVE(AVX512BW) && X86_HAVE(AVX512DQ) &&
+           X86_HAVE(AVX512_VNNI) && X86_HAVE(AVX512_BF16);
+}
+static bool have_amx(void) {
+    return have_zen4() && X86_HAVE(AMX_TILE) && X86_HAVE(AMX_INT8) && amx_enable();
+}
+
+#elif defined(__aarch64__)
+
+#ifndef HWCAP2_BF16
+#define HWCAP2_BF16 (1ul << 14)
+#endif
+
+static bool have_arm80(void) {
+    return true;
+}
+static bool have_arm82(void) {
+    long hwcap = getauxval(AT_HWCAP);
+    return (hwcap & HWCAP_FPHP) && (hwcap & HWCAP_ASIMDHP) && (hwcap & HWCAP_ASIMDDP);
+}
+static bool have_arm86(void) {
+    return have_arm82() && (getauxval(AT_HWCAP2) & HWCAP2_BF16);
+}
+
+#endif
+
+struct Variant {
+    const char *name;
+    sgemm_fn *fn;
+    bool (*avail)(void);
+};
+
+static const Variant kVariants[] = {
+#ifdef __x86_64__
+    {"amd_avx", llamafile_sgemm_amd_avx, have_avx},
+    {"amd_fma", llamafile_sgemm_amd_fma, have_fma},
+    {"amd_avx2", llamafile_sgemm_amd_avx2, have_avx2},
+    {"amd_avxvnni", llamafile_sgemm_amd_avxvnni, have_avxvnni},
+    {"amd_avx512f", llamafile_sgemm_amd_avx512f, have_avx512f},
+    {"amd_zen4", llamafile_sgemm_amd_zen4, have_zen4},
+    {"amd_amx", llamafile_sgemm_amd_amx, have_amx},
+#elif defined(__aarch64__)
+    {"arm80", llamafile_sgemm_arm80, have_arm80},
+    {"arm82", llamafile_sgemm_arm82, have_arm82},
+    {"arm86", llamafile_sgemm_arm86, have_arm86},
+#endif
+};
+
+#define NVARIANTS (sizeof(kVariants) / sizeof(kVariants[0]))
+
+// quantization noise is canceled by dequantizing the operands before
+// the reference multiply, so these budgets only cover the summation
+// order freedom each tier's register width buys it, with slack for
+// low precision accumulation in the half float paths. a corrupted
+// kernel misses them by orders of magnitude
+struct Tolerance {
+    double avg;
+    long long worst;
+};
+
+static Tolerance tolerance(int Atype) {
+    switch (Atype) {
+    case GGML_TYPE_F32:
+        return {16, 4096};
+    case GGML_TYPE_F16:
+    case GGML_TYPE_BF16:
+        return {64, 16384};
+    default:
+        return {128, 16384};
+    }
+}
+
+static bool variant_openmp(sgemm_fn *fn, long m, long n, long k, const void *A, long lda,
+                           const void *B, long ldb, void *C, long ldc, int Atype, int Btype,
+                           int Ctype) {
+    static int nth = cpu_get_num_math();
+    bool ok = true;
+#pragma omp parallel for
+    for (int ith = 0; ith < nth; ++ith)
+        if (!fn(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype))
+            ok = false;
+    return ok;
+}
+
+static int check(const char *name, int Atype, long m, long n, const float *C, const float *G,
+                 long ldc) {
+    Tolerance tol = tolerance(Atype);
+    double err_sum = 0;
+    long long err_worst = 0;
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < n; ++j) {
+            float g = G[ldc * j + i];
+            float c = C[ldc * j + i];
+            if (flt::isnan(g)) {
+                fprintf(stderr, "%s:%d: found nan in reference matrix: i=%d j=%d\n", __FILE__,
+                        __LINE__, i, j);
+                return 3;
+            }
+            if (flt::isnan(c)) {
+                fprintf(stderr, "%s:%d: %s produced nan: i=%d j=%d\n", __FILE__, __LINE__, name, i,
+                        j);
+                return 4;
+            }
+            long long gi = flt::toint(g);
+            long long ci = flt::toint(c);
+            long long err = gi - ci;
+            if (err < 0)
+                err = -err;
+            err_sum += err;
+            if (err > err_worst)
+                err_worst = err;
+        }
+    double err_avg = err_sum / (m * n);
+    fprintf(stderr, "%16s %12g ulp average %12lld ulp worst\n", name, err_avg, err_worst);
+    if (err_avg > tol.avg || err_worst > tol.worst) {
+        fprintf(stderr, "%s:%d: %s exceeded the type %d ulp budget\n", __FILE__, __LINE__, name,
+                Atype);
+        return 5;
+    }
+    return 0;
+}
+
+// runs every available tier on one shape and type signature. returns
+// nonzero if a tier that accepted the signature computed it wrong
+static int test(int Atype, int Btype, long m, long n, long k) {
+    printf("Atype=%d Btype=%d m=%ld n=%ld k=%ld\n", Atype, Btype, m, n, k);
+    int rc = 0;
+    long lda = k;
+    long ldb = k;
+    long ldc = ROUNDUP(m, 16);
+    float *A = ALLOC(lda * m);
+    float *B = ALLOC(ldb * n);
+    float *C = ALLOC(ldc * n);
+    float *G = ALLOC(ldc * n);
+    char *Qa = nullptr;
+    char *Qb = nullptr;
+    broadcast(G, ldc * n, NAN);
+    randomize(k, m, A, lda);
+    randomize(k, n, B, ldb);
+
+    // convert the operands to the tested type, then dequantize them
+    // back so the reference sees exactly what the kernels see
+    const void *Ak = A;
+    const void *Bk = B;
+    long klda = lda;
+    long kldb = ldb;
+    switch (Atype) {
+    case GGML_TYPE_F32:
+        break;
+    case GGML_TYPE_F16: {
+        size_t arow = ggml_row_size(GGML_TYPE_F16, k);
+        size_t brow = ggml_row_size(GGML_TYPE_F16, k);
+        Qa = (char *)memalign(4096, arow * m);
+        Qb = (char *)memalign(4096, brow * n);
+        for (int i = 0; i < m; ++i)
+            ggml_fp32_to_fp16_row(A + lda * i, (ggml_fp16_t *)(Qa + arow * i), k);
+        for (int j = 0; j < n; ++j)
+            ggml_fp32_to_fp16_row(B + ldb * j, (ggml_fp16_t *)(Qb + brow * j), k);
+        for (int i = 0; i < m; ++i)
+            ggml_fp16_to_fp32_row((const ggml_fp16_t *)(Qa + arow * i), A + lda * i, k);
+        for (int j = 0; j < n; ++j)
+            ggml_fp16_to_fp32_row((const ggml_fp16_t *)(Qb + brow * j), B + ldb * j, k);
+        Ak = Qa;
+        Bk = Qb;
+        break;
+    }
+    case GGML_TYPE_BF16: {
+        size_t arow = ggml_row_size(GGML_TYPE_BF16, k);
+        size_t brow = ggml_row_size(GGML_TYPE_BF16, k);
+        Qa = (char *)memalign(4096, arow * m);
+        Qb = (char *)memalign(4096, brow * n);
+        for (int i = 0; i < m; ++i)
+            ggml_fp32_to_bf16_row(A + lda * i, (ggml_bf16_t *)(Qa + arow * i), k);
+        for (int j = 0; j < n; ++j)
+            ggml_fp32_to_bf16_row(B + ldb * j, (ggml_bf16_t *)(Qb + brow * j), k);
+        for (int i = 0; i < m; ++i)
+            ggml_bf16_to_fp32_row((const ggml_bf16_t *)(Qa + arow * i), A + lda * i, k);
+        for (int j = 0; j < n; ++j)
+            ggml_bf16_to_fp32_row((const ggml_bf16_t *)(Qb + brow * j), B + ldb * j, k);
+        Ak = Qa;
+        Bk = Qb;
+        break;
+    }
+    case GGML_TYPE_Q8_0: {
+        size_t arow = ggml_row_size(GGML_TYPE_Q8_0, k);
+        size_t brow = ggml_row_size(GGML_TYPE_Q8_0, k);
+        Qa = (char *)memalign(4096, arow * m);
+        Qb = (char *)memalign(4096, brow * n);
+        for (int i = 0; i < m; ++i)
+            quantize_row_q8_0(A + lda * i, (block_q8_0 *)(Qa + arow * i), k);
+        for (int j = 0; j < n; ++j)
+            quantize_row_q8_0(B + ldb * j, (block_q8_0 *)(Qb + brow * j), k);
+        for (int i = 0; i < m; ++i)
+            dequantize_row_q8_0((const block_q8_0 *)(Qa + arow * i), A + lda * i, k);
+        for (int j = 0; j < n; ++j)
+            dequantize_row_q8_0((const block_q8_0 *)(Qb + brow * j), B + ldb * j, k);
+        Ak = Qa;
+        Bk = Qb;
+        klda = k / QK8_0;
+        kldb = k / QK8_0;
+        break;
+    }
+    case GGML_TYPE_Q4_0: {
+        size_t arow = ggml_row_size(GGML_TYPE_Q4_0, k);
+        size_t brow = ggml_row_size(GGML_TYPE_Q8_0, k);
+        Qa = (char *)memalign(4096, arow * m);
+        Qb = (char *)memalign(4096, brow * n);
+        quantize_q4_0(A, Qa, m, k, 0);
+        for (int j = 0; j < n; ++j)
+            quantize_row_q8_0(B + ldb * j, (block_q8_0 *)(Qb + brow * j), k);
+        for (int i = 0; i < m; ++i)
+            dequantize_row_q4_0((const block_q4_0 *)(Qa + arow * i), A + lda * i, k);
+        for (int j = 0; j < n; ++j)
+            dequantize_row_q8_0((const block_q8_0 *)(Qb + brow * j), B + ldb * j, k);
+        Ak = Qa;
+        Bk = Qb;
+        klda = k / QK4_0;
+        kldb = k / QK8_0;
+        break;
+    }
+    default:
+        assert(!"unsupported type");
+    }
+
+    ansiBLAS::sgemm(m, n, k, A, lda, B, ldb, G, ldc);
+
+    int accepted = 0;
+    for (size_t v = 0; v < NVARIANTS; ++v) {
+        if (!kVariants[v].avail()) {
+            fprintf(stderr, "%16s unavailable on this cpu; skipping\n", kVariants[v].name);
+            continue;
+        }
+        broadcast(C, ldc * n, NAN);
+        if (!variant_openmp(kVariants[v].fn, m, n, k, Ak, klda, Bk, kldb, C, ldc, Atype, Btype,
+                            GGML_TYPE_F32)) {
+            fprintf(stderr, "%16s refused this signature\n", kVariants[v].name);
+            continue;
+        }
+        ++accepted;
+        int err;
+        if ((err = check(kVariants[v].name, Atype, m, n, C, G, ldc)))
+            rc = err;
+    }
+    if (!accepted)
+        fprintf(stderr, "note: no tier serviced Atype=%d Btype=%d on this cpu\n", Atype, Btype);
+
+    free(Qb);
+    free(Qa);
+    free(G);
+    free(C);
+    free(B);
+    free(A);
+
+    return rc;
+}
+
+// one signature per layer family: decode matvecs, the n<=2 fast path
+// that converts instead of tiling, and a prefill tile
+static int test_shapes(int Atype, int Btype) {
+    int rc;
+    if ((rc = test(Atype, Btype, 4096, 1, 4096)))
+        return rc;
+    if ((rc = test(Atype, Btype, 4096, 2, 11008)))
+        return rc;
+    if ((rc = test(Atype, Btype, 4096, 64, 4096)))
+        return rc;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+
+    printf("\n");
+    if ((rc = test_shapes(GGML_TYPE_F32, GGML_TYPE_F32)))
+        return rc;
+
+    printf("\n");
+    if ((rc = test_shapes(GGML_TYPE_F16, GGML_TYPE_F16)))
+        return rc;
+
+    printf("\n");
+    if ((rc = test_shapes(GGML_TYPE_BF16, GGML_TYPE_BF16)))
+        return rc;
+
+    printf("\n");
+    if ((rc = test_shapes(GGML_TYPE_Q8_0, GGML_TYPE_Q8_0)))
+        return rc;
+
+    printf("\n");
+    if ((rc = test_shapes(GGML_TYPE_Q4_0, GGML_TYPE_Q8_0)))
+        return rc;
+
+    printf("\n");
+    return 0;
+}
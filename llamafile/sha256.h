@@ -0,0 +1,22 @@
+#ifndef LLAMAFILE_SHA256_H_
+#define LLAMAFILE_SHA256_H_
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Sha256 {
+    uint32_t state[8];
+    uint64_t count;
+    uint8_t buf[64];
+};
+
+void llamafile_sha256_init(struct Sha256 *);
+void llamafile_sha256_update(struct Sha256 *, const void *, size_t);
+void llamafile_sha256_final(struct Sha256 *, uint8_t[32]);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LLAMAFILE_SHA256_H_ */
@@ -17,15 +17,41 @@
 
 #include <cosmo.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+// streaming surgery for huggingface model files
+//
+//     slicehf FILE...                  split files over 50gb into parts
+//     slicehf --layers LO-HI IN OUT    extract a block range from a gguf
+//     slicehf --merge OUT SHARD...     join gguf shards into one file
+//
+// a gguf file is a small metadata header followed by a huge flat data
+// section, so surgery never needs to buffer weights: the header (a few
+// megabytes at worst) is parsed and rewritten in memory, and the kept
+// tensor data moves from input to output with copy_file_range(), which
+// stays in the kernel and on the same filesystem doesn't even lift the
+// bytes into the page cache. memory use is bounded by the header size
+// no matter how big the model is.
+
 #define MIN(X, Y) ((Y) > (X) ? (X) : (Y))
 
 #define MAX_SIZE (50L * 1000 * 1000 * 1000)
 
+#define GGUF_MAGIC 0x46554747u
+#define GGUF_TYPE_UINT32 4
+#define GGUF_TYPE_STRING 8
+#define GGUF_TYPE_ARRAY 9
+#define GGUF_TYPE_UINT64 10
+
+// byte widths of the scalar metadata value types; strings and arrays
+// are variable and handled in skip_value()
+static const int kGgufScalarSize[13] = {1, 1, 2, 2, 4, 4, 4, 1, -1, -1, 8, 8, 8};
+
 static char in_path_noext[PATH_MAX + 1];
 
 static wontreturn void Die(const char *thing, const char *reason) {
@@ -38,6 +64,508 @@ static wontreturn void DieSys(const char *thing) {
     exit(1);
 }
 
+static void *Malloc(size_t n) {
+    void *p = malloc(n);
+    if (!p && n)
+        DieSys("malloc");
+    return p;
+}
+
+static void *Calloc(size_t n, size_t z) {
+    void *p = calloc(n, z);
+    if (!p && n && z)
+        DieSys("calloc");
+    return p;
+}
+
+static uint64_t align_up(uint64_t x, uint64_t a) {
+    return (x + a - 1) & -a;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// bounded input buffering
+//
+// only the prefix of the file that's been parsed so far is resident.
+// the buffer stops growing once the tensor info section ends, so the
+// recorded offsets into it stay stable from then on.
+
+struct In {
+    const char *path;
+    int fd;
+    off_t size;
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    size_t cur;
+};
+
+static void in_open(struct In *in, const char *path) {
+    struct stat st;
+    memset(in, 0, sizeof(*in));
+    in->path = path;
+    if ((in->fd = open(path, O_RDONLY)) == -1)
+        DieSys(path);
+    if (fstat(in->fd, &st) == -1)
+        DieSys(path);
+    in->size = st.st_size;
+    posix_fadvise(in->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+static void in_fill(struct In *in, size_t end) {
+    if (end <= in->len)
+        return;
+    if ((off_t)end > in->size)
+        Die(in->path, "truncated gguf header");
+    size_t want = MIN((off_t)align_up(end, 1048576), in->size);
+    if (want > in->cap) {
+        size_t cap = in->cap ? in->cap : 1048576;
+        while (cap < want)
+            cap *= 2;
+        if (!(in->buf = realloc(in->buf, cap)))
+            DieSys("realloc");
+        in->cap = cap;
+    }
+    while (in->len < want) {
+        ssize_t got = pread(in->fd, in->buf + in->len, want - in->len, in->len);
+        if (got == -1)
+            DieSys(in->path);
+        if (!got)
+            Die(in->path, "unexpected eof");
+        in->len += got;
+    }
+}
+
+static const uint8_t *in_at(struct In *in, size_t off, size_t n) {
+    in_fill(in, off + n);
+    return in->buf + off;
+}
+
+static uint32_t rd_u32(struct In *in) {
+    uint32_t v;
+    memcpy(&v, in_at(in, in->cur, 4), 4);
+    in->cur += 4;
+    return v;
+}
+
+static uint64_t rd_u64(struct In *in) {
+    uint64_t v;
+    memcpy(&v, in_at(in, in->cur, 8), 8);
+    in->cur += 8;
+    return v;
+}
+
+static void rd_skip(struct In *in, uint64_t n) {
+    if ((off_t)(in->cur + n) > in->size)
+        Die(in->path, "truncated gguf header");
+    in->cur += n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// gguf header parsing
+
+struct Kv {
+    size_t start; // byte span within the file
+    size_t end;
+    size_t key_off;
+    uint64_t key_len;
+    uint32_t type;
+    size_t val_off;
+};
+
+struct Tensor {
+    char name[256];
+    uint32_t ndims;
+    uint64_t dims[4];
+    uint32_t type;
+    uint64_t offset; // relative to data_base
+    uint64_t span; // bytes through the start of the next tensor
+    int keep;
+    long newblk;
+    uint64_t newoff;
+};
+
+struct Gguf {
+    struct In in;
+    uint32_t version;
+    uint64_t n_tensors;
+    uint64_t n_kv;
+    struct Kv *kvs;
+    struct Tensor *tensors;
+    long *order; // tensor indices sorted by data offset
+    size_t kv_start;
+    size_t kv_end;
+    size_t info_end;
+    uint32_t alignment;
+    char arch[64];
+    off_t data_base;
+};
+
+static void skip_value(struct In *in, uint32_t type) {
+    switch (type) {
+        case GGUF_TYPE_STRING:
+            rd_skip(in, rd_u64(in));
+            break;
+        case GGUF_TYPE_ARRAY: {
+            uint32_t t = rd_u32(in);
+            uint64_t n = rd_u64(in);
+            if (t == GGUF_TYPE_STRING) {
+                while (n--)
+                    rd_skip(in, rd_u64(in));
+            } else if (t < 13 && kGgufScalarSize[t] > 0) {
+                rd_skip(in, kGgufScalarSize[t] * n);
+            } else {
+                Die(in->path, "unsupported gguf array element type");
+            }
+            break;
+        }
+        default:
+            if (type < 13 && kGgufScalarSize[type] > 0) {
+                rd_skip(in, kGgufScalarSize[type]);
+            } else {
+                Die(in->path, "unsupported gguf value type");
+            }
+    }
+}
+
+static int kv_is(const struct Gguf *g, const struct Kv *kv, const char *key) {
+    size_t n = strlen(key);
+    return kv->key_len == n && !memcmp(g->in.buf + kv->key_off, key, n);
+}
+
+static struct Kv *find_kv(struct Gguf *g, const char *key) {
+    for (uint64_t i = 0; i < g->n_kv; ++i)
+        if (kv_is(g, &g->kvs[i], key))
+            return &g->kvs[i];
+    return 0;
+}
+
+static int cmp_offset(const void *a, const void *b, void *arg) {
+    const struct Tensor *t = arg;
+    uint64_t x = t[*(const long *)a].offset;
+    uint64_t y = t[*(const long *)b].offset;
+    return (x > y) - (x < y);
+}
+
+static void gguf_parse(struct Gguf *g, const char *path) {
+    memset(g, 0, sizeof(*g));
+    in_open(&g->in, path);
+    struct In *in = &g->in;
+    if (rd_u32(in) != GGUF_MAGIC)
+        Die(path, "not a gguf file");
+    g->version = rd_u32(in);
+    if (g->version < 2 || g->version > 3)
+        Die(path, "unsupported gguf version");
+    g->n_tensors = rd_u64(in);
+    g->n_kv = rd_u64(in);
+    if (g->n_tensors > 1048576 || g->n_kv > 1048576)
+        Die(path, "implausible gguf header");
+    g->alignment = 32;
+    g->kvs = Calloc(g->n_kv, sizeof(struct Kv));
+    g->kv_start = in->cur;
+    for (uint64_t i = 0; i < g->n_kv; ++i) {
+        struct Kv *kv = &g->kvs[i];
+        kv->start = in->cur;
+        kv->key_len = rd_u64(in);
+        kv->key_off = in->cur;
+        rd_skip(in, kv->key_len);
+        kv->type = rd_u32(in);
+        kv->val_off = in->cur;
+        skip_value(in, kv->type);
+        kv->end = in->cur;
+    }
+    g->kv_end = in->cur;
+    g->tensors = Calloc(g->n_tensors, sizeof(struct Tensor));
+    for (uint64_t i = 0; i < g->n_tensors; ++i) {
+        struct Tensor *t = &g->tensors[i];
+        uint64_t len = rd_u64(in);
+        if (len >= sizeof(t->name))
+            Die(path, "tensor name too long");
+        memcpy(t->name, in_at(in, in->cur, len), len);
+        in->cur += len;
+        t->ndims = rd_u32(in);
+        if (t->ndims > 4)
+            Die(path, "tensor has too many dimensions");
+        for (uint32_t j = 0; j < t->ndims; ++j)
+            t->dims[j] = rd_u64(in);
+        t->type = rd_u32(in);
+        t->offset = rd_u64(in);
+    }
+    g->info_end = in->cur;
+
+    // the buffer is stable now, so metadata can be interpreted
+    struct Kv *kv;
+    if ((kv = find_kv(g, "general.alignment")) && kv->type == GGUF_TYPE_UINT32)
+        memcpy(&g->alignment, g->in.buf + kv->val_off, 4);
+    if (!g->alignment || (g->alignment & (g->alignment - 1)))
+        Die(path, "invalid gguf alignment");
+    if ((kv = find_kv(g, "general.architecture")) && kv->type == GGUF_TYPE_STRING) {
+        uint64_t len;
+        memcpy(&len, g->in.buf + kv->val_off, 8);
+        if (len < sizeof(g->arch)) {
+            memcpy(g->arch, g->in.buf + kv->val_off + 8, len);
+            g->arch[len] = 0;
+        }
+    }
+    g->data_base = align_up(g->info_end, g->alignment);
+    if (g->data_base > g->in.size)
+        Die(path, "truncated gguf");
+
+    // tensor sizes aren't written down anywhere; each one reaches to
+    // the start of the next by file order, and the last to end of file
+    g->order = Malloc(g->n_tensors * sizeof(long));
+    for (uint64_t i = 0; i < g->n_tensors; ++i)
+        g->order[i] = i;
+    qsort_r(g->order, g->n_tensors, sizeof(long), cmp_offset, g->tensors);
+    for (uint64_t i = 0; i < g->n_tensors; ++i) {
+        struct Tensor *t = &g->tensors[g->order[i]];
+        uint64_t limit = i + 1 < g->n_tensors
+                             ? g->tensors[g->order[i + 1]].offset
+                             : (uint64_t)(g->in.size - g->data_base);
+        if (limit < t->offset)
+            Die(path, "tensor data exceeds file size");
+        t->span = limit - t->offset;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// output
+
+struct Buf {
+    uint8_t *p;
+    size_t n;
+    size_t c;
+};
+
+static void buf_put(struct Buf *b, const void *d, size_t n) {
+    if (b->n + n > b->c) {
+        b->c = b->c ? b->c : 65536;
+        while (b->n + n > b->c)
+            b->c *= 2;
+        if (!(b->p = realloc(b->p, b->c)))
+            DieSys("realloc");
+    }
+    if (d) {
+        memcpy(b->p + b->n, d, n);
+    } else {
+        memset(b->p + b->n, 0, n);
+    }
+    b->n += n;
+}
+
+static void buf_u32(struct Buf *b, uint32_t v) {
+    buf_put(b, &v, 4);
+}
+
+static void buf_u64(struct Buf *b, uint64_t v) {
+    buf_put(b, &v, 8);
+}
+
+static void put_tensor_info(struct Buf *b, const struct Tensor *t, const char *name) {
+    buf_u64(b, strlen(name));
+    buf_put(b, name, strlen(name));
+    buf_u32(b, t->ndims);
+    for (uint32_t j = 0; j < t->ndims; ++j)
+        buf_u64(b, t->dims[j]);
+    buf_u32(b, t->type);
+    buf_u64(b, t->newoff);
+}
+
+static int create_output(const char *path) {
+    int fd = open(path, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+    if (fd == -1)
+        DieSys(path);
+    return fd;
+}
+
+static void write_all(int fd, const void *data, size_t n, const char *path) {
+    const char *p = data;
+    while (n) {
+        ssize_t wrote = write(fd, p, n);
+        if (wrote == -1)
+            DieSys(path);
+        p += wrote;
+        n -= wrote;
+    }
+}
+
+static void stream_copy(struct In *in, off_t in_off, int out_fd, off_t out_off,
+                        uint64_t amount, const char *out_path) {
+    while (amount) {
+        long chunk = MIN(amount, 2097152);
+        long copied = copy_file_range(in->fd, &in_off, out_fd, &out_off, chunk, 0);
+        if (copied == -1)
+            DieSys(out_path);
+        if (!copied)
+            Die(in->path, "unexpected eof");
+        posix_fadvise(in->fd, in_off - copied, copied, POSIX_FADV_DONTNEED);
+        amount -= copied;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// layer range extraction
+//
+// keeps every tensor outside the transformer stack (embeddings, output
+// head, norms) plus the blocks in [lo,hi], renumbers the kept blocks
+// from zero, and patches <arch>.block_count so the result loads like a
+// model that was trained this shallow. this is how layer-pruned draft
+// models get made.
+
+static void slice_layers(const char *range, const char *in_path, const char *out_path) {
+    char *ep;
+    long lo, hi;
+    lo = hi = strtol(range, &ep, 10);
+    if (*ep == '-')
+        hi = strtol(ep + 1, &ep, 10);
+    if (*ep || lo < 0 || hi < lo)
+        Die(range, "bad layer range (want LO-HI)");
+
+    struct Gguf g;
+    gguf_parse(&g, in_path);
+
+    char bc_key[96];
+    snprintf(bc_key, sizeof(bc_key), "%s.block_count", g.arch[0] ? g.arch : "llama");
+    struct Kv *bc = find_kv(&g, bc_key);
+    if (!bc || (bc->type != GGUF_TYPE_UINT32 && bc->type != GGUF_TYPE_UINT64))
+        Die(in_path, "missing block_count metadata");
+    uint64_t blocks = 0;
+    memcpy(&blocks, g.in.buf + bc->val_off, bc->type == GGUF_TYPE_UINT32 ? 4 : 8);
+    if ((uint64_t)hi >= blocks)
+        Die(range, "layer range exceeds block count");
+
+    uint64_t kept = 0;
+    for (uint64_t i = 0; i < g.n_tensors; ++i) {
+        struct Tensor *t = &g.tensors[i];
+        t->keep = 1;
+        t->newblk = -1;
+        if (!strncmp(t->name, "blk.", 4)) {
+            long blk = strtol(t->name + 4, &ep, 10);
+            if (*ep == '.') {
+                t->keep = blk >= lo && blk <= hi;
+                t->newblk = blk - lo;
+            }
+        }
+        kept += t->keep;
+    }
+
+    // kept tensors pack into the data section in their original file
+    // order, with their original trailing padding, so every offset
+    // stays aligned and the copy below is one sequential pass
+    uint64_t cursor = 0;
+    for (uint64_t i = 0; i < g.n_tensors; ++i) {
+        struct Tensor *t = &g.tensors[g.order[i]];
+        if (!t->keep)
+            continue;
+        t->newoff = cursor;
+        cursor += t->span;
+    }
+
+    struct Buf b = {0};
+    buf_u32(&b, GGUF_MAGIC);
+    buf_u32(&b, g.version);
+    buf_u64(&b, kept);
+    buf_u64(&b, g.n_kv);
+    size_t kv_off = b.n;
+    buf_put(&b, g.in.buf + g.kv_start, g.kv_end - g.kv_start);
+    uint64_t newblocks = hi - lo + 1;
+    memcpy(b.p + kv_off + (bc->val_off - g.kv_start), &newblocks,
+           bc->type == GGUF_TYPE_UINT32 ? 4 : 8);
+    for (uint64_t i = 0; i < g.n_tensors; ++i) {
+        struct Tensor *t = &g.tensors[i];
+        if (!t->keep)
+            continue;
+        char name[sizeof(t->name) + 16];
+        if (t->newblk >= 0) {
+            snprintf(name, sizeof(name), "blk.%ld.%s", t->newblk,
+                     strchr(t->name + 4, '.') + 1);
+        } else {
+            strlcpy(name, t->name, sizeof(name));
+        }
+        put_tensor_info(&b, t, name);
+    }
+    buf_put(&b, 0, align_up(b.n, g.alignment) - b.n);
+
+    int out_fd = create_output(out_path);
+    write_all(out_fd, b.p, b.n, out_path);
+    for (uint64_t i = 0; i < g.n_tensors; ++i) {
+        struct Tensor *t = &g.tensors[g.order[i]];
+        if (!t->keep)
+            continue;
+        stream_copy(&g.in, g.data_base + t->offset, out_fd, b.n + t->newoff,
+                    t->span, out_path);
+    }
+    close(out_fd);
+    printf("%s: kept blocks %ld-%ld of %llu (%llu of %llu tensors)\n", out_path,
+           lo, hi, (unsigned long long)blocks, (unsigned long long)kept,
+           (unsigned long long)g.n_tensors);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// shard merging
+//
+// joins the output of gguf-split (or any ggufs whose tensors disjoint)
+// back into one file. the metadata of the first shard wins, minus the
+// split.* bookkeeping keys; later shards contribute only tensors. each
+// shard's data section is already laid out and padded, so it's moved
+// wholesale with one streaming copy per shard.
+
+static void merge_shards(const char *out_path, int n, char *paths[]) {
+    struct Gguf *gs = Calloc(n, sizeof(struct Gguf));
+    uint64_t total = 0;
+    for (int s = 0; s < n; ++s) {
+        gguf_parse(&gs[s], paths[s]);
+        if (gs[s].version != gs[0].version || gs[s].alignment != gs[0].alignment)
+            Die(paths[s], "shard version or alignment mismatch");
+        total += gs[s].n_tensors;
+    }
+
+    uint64_t kept_kv = 0;
+    for (uint64_t i = 0; i < gs[0].n_kv; ++i)
+        if (strncmp((char *)gs[0].in.buf + gs[0].kvs[i].key_off, "split.",
+                    MIN(gs[0].kvs[i].key_len, 6)))
+            ++kept_kv;
+
+    // stack the shards' data sections end to end, realigning at each
+    // seam since a shard's final tensor carries no trailing padding
+    uint64_t cursor = 0;
+    uint64_t *base = Malloc(n * sizeof(uint64_t));
+    for (int s = 0; s < n; ++s) {
+        base[s] = cursor = align_up(cursor, gs[0].alignment);
+        for (uint64_t i = 0; i < gs[s].n_tensors; ++i)
+            gs[s].tensors[i].newoff = base[s] + gs[s].tensors[i].offset;
+        cursor += gs[s].in.size - gs[s].data_base;
+    }
+
+    struct Buf b = {0};
+    buf_u32(&b, GGUF_MAGIC);
+    buf_u32(&b, gs[0].version);
+    buf_u64(&b, total);
+    buf_u64(&b, kept_kv);
+    for (uint64_t i = 0; i < gs[0].n_kv; ++i) {
+        struct Kv *kv = &gs[0].kvs[i];
+        if (!strncmp((char *)gs[0].in.buf + kv->key_off, "split.",
+                     MIN(kv->key_len, 6)))
+            continue;
+        buf_put(&b, gs[0].in.buf + kv->start, kv->end - kv->start);
+    }
+    for (int s = 0; s < n; ++s)
+        for (uint64_t i = 0; i < gs[s].n_tensors; ++i)
+            put_tensor_info(&b, &gs[s].tensors[i], gs[s].tensors[i].name);
+    buf_put(&b, 0, align_up(b.n, gs[0].alignment) - b.n);
+
+    int out_fd = create_output(out_path);
+    write_all(out_fd, b.p, b.n, out_path);
+    for (int s = 0; s < n; ++s)
+        stream_copy(&gs[s].in, gs[s].data_base, out_fd, b.n + base[s],
+                    gs[s].in.size - gs[s].data_base, out_path);
+    close(out_fd);
+    printf("%s: merged %d shards (%llu tensors)\n", out_path, n,
+           (unsigned long long)total);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// legacy splitting
+
 void slicehf(const char *in_path) {
 
     off_t in_off = 0;
@@ -93,6 +621,20 @@ int main(int argc, char *argv[]) {
     // use idle scheduling priority
     verynice();
 
+    if (argc >= 2 && !strcmp(argv[1], "--layers")) {
+        if (argc != 5)
+            Die(argv[0], "usage: slicehf --layers LO-HI IN OUT");
+        slice_layers(argv[2], argv[3], argv[4]);
+        return 0;
+    }
+
+    if (argc >= 2 && !strcmp(argv[1], "--merge")) {
+        if (argc < 4)
+            Die(argv[0], "usage: slicehf --merge OUT SHARD...");
+        merge_shards(argv[2], argc - 3, argv + 3);
+        return 0;
+    }
+
     for (int i = 1; i < argc; ++i)
         slicehf(argv[i]);
 }
@@ -0,0 +1,337 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "splitplan.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "llama.cpp/ggml-cuda.h"
+#include "llamafile.h"
+#include "llamafile/log.h"
+
+// plans the cpu/gpu layer split from measured machine numbers
+//
+// `-ngl` makes the user guess a layer count, and a wrong guess
+// either ooms the gpu or strands capacity on it. this module sniffs
+// the model's shape out of its gguf metadata, measures how fast the
+// host can stream weights and how much device memory is actually
+// free, then sizes the offload so every layer that fits goes to the
+// gpu with its kv cache, and no layer that doesn't.
+//
+// decoding one token is memory bound: it reads every resident
+// weight once. so predicted time per token is just layer bytes over
+// bandwidth, summed across the two pools. device bandwidth can't be
+// measured before the backend loads, so it's the one assumed number
+// in the report; it only affects the prediction, not the split,
+// since the gpu is faster than the host either way.
+
+#define CAP_META (32 * 1024 * 1024)
+#define RESERVE (512LL * 1024 * 1024)
+#define ASSUMED_GPU_GBPS 400
+
+struct ggufmeta {
+    long long file_size;
+    long long n_layers;
+    long long embd;
+    long long heads;
+    long long heads_kv;
+};
+
+struct ggufreader {
+    const unsigned char *p;
+    size_t n;
+    size_t i;
+    bool ok;
+};
+
+static bool gr_get(struct ggufreader *r, void *out, size_t n) {
+    if (!r->ok || r->n - r->i < n) {
+        r->ok = false;
+        return false;
+    }
+    memcpy(out, r->p + r->i, n);
+    r->i += n;
+    return true;
+}
+
+static uint32_t gr_u32(struct ggufreader *r) {
+    uint32_t v = 0;
+    gr_get(r, &v, 4);
+    return v;
+}
+
+static uint64_t gr_u64(struct ggufreader *r) {
+    uint64_t v = 0;
+    gr_get(r, &v, 8);
+    return v;
+}
+
+static bool gr_skip(struct ggufreader *r, uint64_t n) {
+    if (!r->ok || r->n - r->i < n) {
+        r->ok = false;
+        return false;
+    }
+    r->i += n;
+    return true;
+}
+
+// reads a gguf metadata value of the given type as an integer, or
+// skips it when it isn't one of the scalar types we care about
+static long long gr_value(struct ggufreader *r, uint32_t type, bool *is_int) {
+    *is_int = false;
+    switch (type) {
+    case 0: // uint8
+    case 1: // int8
+    case 7: { // bool
+        uint8_t v = 0;
+        gr_get(r, &v, 1);
+        *is_int = true;
+        return v;
+    }
+    case 2: // uint16
+    case 3: { // int16
+        uint16_t v = 0;
+        gr_get(r, &v, 2);
+        *is_int = true;
+        return v;
+    }
+    case 4: // uint32
+    case 5: { // int32
+        uint32_t v = gr_u32(r);
+        *is_int = true;
+        return v;
+    }
+    case 10: // uint64
+    case 11: { // int64
+        uint64_t v = gr_u64(r);
+        *is_int = true;
+        return v;
+    }
+    case 6: // float32
+        gr_skip(r, 4);
+        return 0;
+    case 12: // float64
+        gr_skip(r, 8);
+        return 0;
+    case 8: // string
+        gr_skip(r, gr_u64(r));
+        return 0;
+    case 9: { // array
+        uint32_t etype = gr_u32(r);
+        uint64_t count = gr_u64(r);
+        if (etype == 8) {
+            for (uint64_t j = 0; j < count && r->ok; ++j)
+                gr_skip(r, gr_u64(r));
+        } else {
+            static const char width[] = {1, 1, 2, 2, 4, 4, 4, 1, 0, 0, 8, 8, 8};
+            if (etype < sizeof(width) && width[etype]) {
+                gr_skip(r, count * width[etype]);
+            } else {
+                r->ok = false;
+            }
+        }
+        return 0;
+    }
+    default:
+        r->ok = false;
+        return 0;
+    }
+}
+
+static bool key_ends_with(const char *key, uint64_t len, const char *suffix) {
+    size_t n = strlen(suffix);
+    return len >= n && !memcmp(key + len - n, suffix, n);
+}
+
+// walks the gguf key/value section looking for the handful of shape
+// keys the planner needs. keys are matched by suffix, so the
+// architecture prefix doesn't need to be known in advance
+static bool read_gguf_meta(const char *path, struct ggufmeta *m) {
+    memset(m, 0, sizeof(*m));
+    struct llamafile *file;
+    if (!(file = llamafile_open_gguf(path, "rbe")))
+        return false;
+    bool res = false;
+    unsigned char *owned = 0;
+    const unsigned char *buf;
+    size_t size = llamafile_size(file);
+    size_t n = size < CAP_META ? size : CAP_META;
+    if (llamafile_content(file)) {
+        buf = llamafile_content(file);
+    } else if (llamafile_fp(file)) {
+        if (!(owned = malloc(n)))
+            goto done;
+        ssize_t rc = pread(fileno(llamafile_fp(file)), owned, n, 0);
+        if (rc <= 0)
+            goto done;
+        n = rc;
+        buf = owned;
+    } else {
+        goto done;
+    }
+    struct ggufreader r = {buf, n, 0, true};
+    if (gr_u32(&r) != 0x46554747) // "GGUF"
+        goto done;
+    uint32_t version = gr_u32(&r);
+    if (version < 2 || version > 3)
+        goto done;
+    gr_u64(&r); // tensor count
+    uint64_t n_kv = gr_u64(&r);
+    for (uint64_t k = 0; k < n_kv && r.ok; ++k) {
+        uint64_t keylen = gr_u64(&r);
+        if (!r.ok || r.n - r.i < keylen)
+            break;
+        const char *key = (const char *)(r.p + r.i);
+        r.i += keylen;
+        uint32_t type = gr_u32(&r);
+        bool is_int;
+        long long value = gr_value(&r, type, &is_int);
+        if (!is_int)
+            continue;
+        if (key_ends_with(key, keylen, ".block_count"))
+            m->n_layers = value;
+        else if (key_ends_with(key, keylen, ".embedding_length"))
+            m->embd = value;
+        else if (key_ends_with(key, keylen, ".attention.head_count"))
+            m->heads = value;
+        else if (key_ends_with(key, keylen, ".attention.head_count_kv"))
+            m->heads_kv = value;
+    }
+    m->file_size = size;
+    res = m->n_layers > 0 && m->embd > 0;
+done:
+    free(owned);
+    llamafile_close(file);
+    return res;
+}
+
+static char g_bwsink;
+
+// measures how fast this host can stream memory, which is what
+// bounds decoding the layers that stay on the cpu. best of a few
+// memcpy passes over a buffer much bigger than cache
+static double measure_cpu_gbps(void) {
+    size_t n = 32 * 1024 * 1024;
+    char *a = malloc(n);
+    char *b = malloc(n);
+    double best = 0;
+    if (a && b) {
+        memset(a, 1, n);
+        memset(b, 2, n);
+        for (int i = 0; i < 4; ++i) {
+            struct timespec t1, t2;
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            memcpy(b, a, n);
+            clock_gettime(CLOCK_MONOTONIC, &t2);
+            double s = (t2.tv_sec - t1.tv_sec) + //
+                       (t2.tv_nsec - t1.tv_nsec) * 1e-9;
+            // memcpy reads n bytes and writes n bytes
+            double gbps = s > 0 ? 2.0 * n / s * 1e-9 : 0;
+            if (gbps > best)
+                best = gbps;
+        }
+        g_bwsink = b[n / 2];
+    }
+    free(b);
+    free(a);
+    return best;
+}
+
+/**
+ * Computes a layer split plan for the model at `path`.
+ *
+ * Returns false when the plan can't be computed, e.g. because the
+ * gguf metadata is unreadable or no cuda device is present.
+ */
+bool llamafile_split_plan_compute(const char *path, struct llamafile_split_plan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    if (!llamafile_has_cuda())
+        return false;
+    struct ggufmeta meta;
+    if (!read_gguf_meta(path, &meta))
+        return false;
+    plan->n_layers = meta.n_layers;
+
+    // the token embeddings and output head cost roughly another
+    // layer's worth of weights, which matches how -ngl counts
+    plan->layer_bytes = meta.file_size / (meta.n_layers + 1);
+
+    // kv cells for a layer must live wherever the layer's attention
+    // runs, so an offloaded layer buys its kv residency too
+    long long kvd = meta.embd;
+    if (meta.heads > 0 && meta.heads_kv > 0)
+        kvd = meta.embd / meta.heads * meta.heads_kv;
+    long ctx = FLAG_ctx_size > 0 ? FLAG_ctx_size : 8192;
+    plan->kv_layer_bytes = 2LL * ctx * kvd * 2; // k and v halves, f16
+
+    size_t vram_free = 0, vram_total = 0;
+    ggml_backend_cuda_get_device_memory(FLAG_main_gpu, &vram_free, &vram_total);
+    plan->vram_free = vram_free;
+    plan->cpu_gbps = measure_cpu_gbps();
+    plan->gpu_gbps = ASSUMED_GPU_GBPS;
+
+    long long budget = plan->vram_free - RESERVE;
+    long long per = plan->layer_bytes + plan->kv_layer_bytes;
+    long long fit = budget > 0 && per > 0 ? budget / per : 0;
+    if (fit > meta.n_layers)
+        fit = meta.n_layers;
+    plan->gpu_layers = fit;
+
+    double cpu_ms = plan->cpu_gbps > 0
+                      ? (meta.n_layers - fit + 1) * plan->layer_bytes / //
+                          (plan->cpu_gbps * 1e9) * 1e3
+                      : 0;
+    double gpu_ms = fit * plan->layer_bytes / (plan->gpu_gbps * 1e9) * 1e3;
+    plan->predicted_ms = cpu_ms + gpu_ms;
+    return true;
+}
+
+/**
+ * Right sizes an implicit full gpu offload.
+ *
+ * This only fires for `--gpu` without an explicit `-ngl`, where the
+ * old behavior offloaded everything and oomed models bigger than
+ * vram. An explicit `-ngl`, including the `-ngl 9999` idiom, is
+ * always respected. Returns `n_gpu_layers` unchanged whenever no
+ * plan can be computed.
+ */
+int llamafile_split_plan(const char *path, int n_gpu_layers) {
+    struct llamafile_split_plan plan;
+    if (!path)
+        return n_gpu_layers;
+    if (!llamafile_split_plan_compute(path, &plan))
+        return n_gpu_layers;
+    if (plan.gpu_layers >= plan.n_layers)
+        // everything fits, so keep the full offload including the
+        // output layer rather than returning n_layers exactly
+        return n_gpu_layers;
+    tinylogf("note: split planner: %ld layers of ~%lld mb, kv %lld mb per layer\n",
+             plan.n_layers, plan.layer_bytes >> 20, plan.kv_layer_bytes >> 20);
+    tinylogf("note: split planner: vram %lld mb free, cpu %.1f gb/s measured, "
+             "gpu %.0f gb/s assumed\n",
+             plan.vram_free >> 20, plan.cpu_gbps, plan.gpu_gbps);
+    tinylogf("note: split planner: offloading %d/%ld layers, predicting %.1f "
+             "ms per token (pass -ngl to override)\n",
+             plan.gpu_layers, plan.n_layers, plan.predicted_ms);
+    return plan.gpu_layers;
+}
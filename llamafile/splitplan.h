@@ -0,0 +1,44 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LLAMAFILE_SPLITPLAN_H_
+#define LLAMAFILE_SPLITPLAN_H_
+#include <stdbool.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// model shape sniffed from gguf metadata, plus the machine numbers
+// the planner based its layer split on
+struct llamafile_split_plan {
+    long n_layers; // transformer blocks in the model
+    long long layer_bytes; // approximate weight bytes per block
+    long long kv_layer_bytes; // kv cache bytes per offloaded block
+    long long vram_free; // measured free gpu memory
+    double cpu_gbps; // measured host memory read bandwidth
+    double gpu_gbps; // assumed device memory bandwidth
+    int gpu_layers; // blocks the plan offloads
+    double predicted_ms; // predicted decode milliseconds per token
+};
+
+int llamafile_split_plan(const char *, int);
+bool llamafile_split_plan_compute(const char *, struct llamafile_split_plan *);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LLAMAFILE_SPLITPLAN_H_ */
@@ -16,19 +16,52 @@
 // limitations under the License.
 
 #include "string.h"
+#include <algorithm>
 #include <cctype>
 #include <cosmo.h>
+#include <cstdint>
 #include <cstdio>
 #include <string>
 #include <utility>
 #include <vector>
 
+#ifdef __SSE2__
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace lf {
 
 std::string tolower(const std::string_view &s) {
     std::string b;
-    for (char c : s)
-        b += std::tolower(c);
+    b.resize(s.size());
+    size_t i = 0;
+#ifdef __SSE2__
+    // uppercase detection is an unsigned range check, which sse2 can
+    // phrase as a saturating subtract, so this folds sixteen bytes per
+    // iteration rather than calling tolower() on each one. bytes past
+    // 0x7f aren't in the range so multibyte utf-8 passes through
+    for (; i + 16 <= s.size(); i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s.data() + i));
+        __m128i m = _mm_cmpeq_epi8(
+            _mm_subs_epu8(_mm_sub_epi8(v, _mm_set1_epi8('A')), _mm_set1_epi8(25)),
+            _mm_setzero_si128());
+        v = _mm_add_epi8(v, _mm_and_si128(m, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128((__m128i *)(b.data() + i), v);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 16 <= s.size(); i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)s.data() + i);
+        uint8x16_t m = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(26));
+        v = vaddq_u8(v, vandq_u8(m, vdupq_n_u8(0x20)));
+        vst1q_u8((uint8_t *)b.data() + i, v);
+    }
+#endif
+    for (; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        b[i] = 'A' <= c && c <= 'Z' ? c + 0x20 : c;
+    }
     return b;
 }
 
@@ -52,6 +85,61 @@ bool startscasewith(const std::string_view &str, const std::string_view &prefix)
     return true;
 }
 
+// computes levenshtein distance between two strings
+//
+// this is the minimum number of single character insertions, deletions,
+// and substitutions that turn one string into the other. the bit-parallel
+// formulation [myers, j.acm 1999] advances a whole column of the classic
+// dynamic program per input byte using word-sized logic, so scoring a
+// typed command or filename against a large candidate list costs about a
+// cycle per candidate byte. when the shorter string exceeds the 64-bit
+// word a scalar two row fallback is used, which completion strings never
+// hit in practice
+size_t edit_distance(const std::string_view &a, const std::string_view &b) {
+    const std::string_view &pat = a.size() <= b.size() ? a : b;
+    const std::string_view &txt = a.size() <= b.size() ? b : a;
+    if (pat.empty())
+        return txt.size();
+    if (pat.size() <= 64) {
+        uint64_t peq[256] = {};
+        for (size_t i = 0; i < pat.size(); ++i)
+            peq[pat[i] & 255] |= (uint64_t)1 << i;
+        uint64_t pv = -1;
+        uint64_t mv = 0;
+        uint64_t hbit = (uint64_t)1 << (pat.size() - 1);
+        size_t score = pat.size();
+        for (size_t i = 0; i < txt.size(); ++i) {
+            uint64_t eq = peq[txt[i] & 255];
+            uint64_t xv = eq | mv;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & hbit)
+                ++score;
+            if (mh & hbit)
+                --score;
+            ph = ph << 1 | 1;
+            pv = mh << 1 | ~(xv | ph);
+            mv = ph & xv;
+        }
+        return score;
+    }
+    std::vector<size_t> row(pat.size() + 1);
+    for (size_t j = 0; j <= pat.size(); ++j)
+        row[j] = j;
+    for (size_t i = 0; i < txt.size(); ++i) {
+        size_t diag = row[0];
+        row[0] = i + 1;
+        for (size_t j = 0; j < pat.size(); ++j) {
+            size_t next = std::min(std::min(row[j + 1], row[j]) + 1,
+                                   diag + (pat[j] != txt[i]));
+            diag = row[j + 1];
+            row[j + 1] = next;
+        }
+    }
+    return row[pat.size()];
+}
+
 std::string format(const char *fmt, ...) {
     va_list ap, ap2;
     va_start(ap, fmt);
@@ -155,7 +243,38 @@ std::string collapse(const std::string_view &input) {
     std::string result;
     result.reserve(end - start + 1);
     bool lastWasSpace = false;
-    for (size_t i = start; i <= end; ++i) {
+    size_t i = start;
+    while (i <= end) {
+#ifdef __SSE2__
+        // chunks without any whitespace get copied sixteen bytes at a
+        // time, since only the spaces matter to the state machine
+        while (i + 16 <= end + 1) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(input.data() + i));
+            __m128i ws = _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                _mm_cmpeq_epi8(
+                    _mm_subs_epu8(_mm_sub_epi8(v, _mm_set1_epi8('\t')), _mm_set1_epi8(4)),
+                    _mm_setzero_si128()));
+            if (_mm_movemask_epi8(ws))
+                break;
+            result.append(input.data() + i, 16);
+            lastWasSpace = false;
+            i += 16;
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        while (i + 16 <= end + 1) {
+            uint8x16_t v = vld1q_u8((const uint8_t *)input.data() + i);
+            uint8x16_t ws = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                                     vcltq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(5)));
+            if (vmaxvq_u8(ws))
+                break;
+            result.append(input.data() + i, 16);
+            lastWasSpace = false;
+            i += 16;
+        }
+#endif
+        if (i > end)
+            break;
         if (std::isspace(input[i])) {
             if (!lastWasSpace) {
                 result += ' ';
@@ -165,6 +284,7 @@ std::string collapse(const std::string_view &input) {
             result += input[i];
             lastWasSpace = false;
         }
+        ++i;
     }
     return result;
 }
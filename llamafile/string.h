@@ -19,12 +19,14 @@
 #include <__fwd/string.h>
 #include <__fwd/string_view.h>
 #include <__fwd/vector.h>
+#include <cstddef>
 #include <ctime>
 
 namespace lf {
 
 bool startscasewith(const std::string_view &, const std::string_view &);
 int strcasecmp(const std::string_view &, const std::string_view &);
+size_t edit_distance(const std::string_view &, const std::string_view &);
 ssize_t slurp(std::string *, const char *);
 std::string basename(const std::string_view &);
 std::string collapse(const std::string_view &);
@@ -0,0 +1,190 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile/bench.h"
+#include "llamafile/string.h"
+
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define ITERATIONS 10000
+
+namespace lf {
+
+// scalar references used to check the vector paths and keep the
+// benchmarks honest
+
+static std::string tolower_scalar(const std::string_view &s) {
+    std::string b;
+    for (char c : s)
+        b += std::tolower(c & 255);
+    return b;
+}
+
+static std::string collapse_scalar(const std::string_view &input) {
+    size_t start = 0;
+    while (start < input.length() && std::isspace(input[start] & 255))
+        ++start;
+    if (start == input.length())
+        return "";
+    size_t end = input.length() - 1;
+    while (end > start && std::isspace(input[end] & 255))
+        --end;
+    std::string result;
+    bool lastWasSpace = false;
+    for (size_t i = start; i <= end; ++i) {
+        if (std::isspace(input[i] & 255)) {
+            if (!lastWasSpace) {
+                result += ' ';
+                lastWasSpace = true;
+            }
+        } else {
+            result += input[i];
+            lastWasSpace = false;
+        }
+    }
+    return result;
+}
+
+static size_t edit_distance_scalar(const std::string_view &a,
+                                   const std::string_view &b) {
+    std::vector<size_t> row(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j)
+        row[j] = j;
+    for (size_t i = 0; i < a.size(); ++i) {
+        size_t diag = row[0];
+        row[0] = i + 1;
+        for (size_t j = 0; j < b.size(); ++j) {
+            size_t next = row[j + 1] + 1;
+            if (row[j] + 1 < next)
+                next = row[j] + 1;
+            if (diag + (a[i] != b[j]) < next)
+                next = diag + (a[i] != b[j]);
+            diag = row[j + 1];
+            row[j + 1] = next;
+        }
+    }
+    return row[b.size()];
+}
+
+static int string_test() {
+    if (tolower("") != "")
+        return 1;
+    if (tolower("Hello, World!") != "hello, world!")
+        return 2;
+    if (tolower("SHOUTING IN ALL CAPS FOR MORE THAN SIXTEEN BYTES") !=
+        "shouting in all caps for more than sixteen bytes")
+        return 3;
+    if (tolower("Grüße, Welt") != "grüße, welt") // utf-8 passes through
+        return 4;
+
+    // agreement with the scalar reference for every byte value at
+    // every lane position, so the vector tail handoff is covered
+    for (int c = 0; c < 256; ++c) {
+        std::string s(37, (char)c);
+        for (size_t n = 0; n <= s.size(); ++n)
+            if (tolower(std::string_view(s.data(), n)) !=
+                tolower_scalar(std::string_view(s.data(), n)))
+                return 5;
+    }
+
+    if (collapse("") != "")
+        return 6;
+    if (collapse(" \t\r\n") != "")
+        return 7;
+    if (collapse("  hello   world  ") != "hello world")
+        return 8;
+    if (collapse("no extra spaces here") != "no extra spaces here")
+        return 9;
+    if (collapse("tabs\t\tand\nnewlines\r\n眉毛") != "tabs and newlines 眉毛")
+        return 10;
+
+    // whitespace at every position of a buffer long enough to engage
+    // the vector copy loop
+    std::string base(48, 'x');
+    for (size_t i = 0; i < base.size(); ++i)
+        for (char ws : {' ', '\t', '\n'}) {
+            std::string s = base;
+            s[i] = ws;
+            if (collapse(s) != collapse_scalar(s))
+                return 11;
+        }
+
+    if (edit_distance("", "") != 0)
+        return 12;
+    if (edit_distance("", "abc") != 3)
+        return 13;
+    if (edit_distance("same", "same") != 0)
+        return 14;
+    if (edit_distance("kitten", "sitting") != 3)
+        return 15;
+    if (edit_distance("/hlep", "/help") != 2)
+        return 16;
+    if (edit_distance("/upload", "/undo") != 4)
+        return 17;
+
+    // agreement with the scalar reference at lengths straddling the
+    // 64-bit word boundary, so the fallback handoff is covered
+    for (size_t n : {1, 7, 33, 63, 64, 65, 71}) {
+        std::string s, t;
+        for (size_t i = 0; i < n; ++i) {
+            s += "abcab"[i % 5];
+            t += "ababc"[i % 5];
+        }
+        t.erase(t.size() / 2, 1);
+        if (edit_distance(s, t) != edit_distance_scalar(s, t))
+            return 18;
+        if (edit_distance(t, s) != edit_distance_scalar(t, s))
+            return 19;
+    }
+
+    return 0;
+}
+
+// keeps the optimizer from discarding the pure calls under test
+static volatile size_t g_sink;
+
+static void string_bench() {
+    std::string text;
+    for (int i = 0; i < 256; ++i)
+        text += "The Quick Brown Fox Jumped Over The LAZY DOG ";
+    BENCH(g_sink = tolower(text).size());
+    BENCH(g_sink = tolower_scalar(text).size());
+    BENCH(g_sink = collapse(text).size());
+    BENCH(g_sink = collapse_scalar(text).size());
+
+    // a tab completion pass over a directory of four hundred models
+    std::vector<std::string> models;
+    for (int i = 0; i < 400; ++i)
+        models.push_back(format("llama-3.2-%03db-instruct.Q4_K_M.gguf", i));
+    BENCH(for (const std::string &m : models) //
+          g_sink += edit_distance("lama-3.2-242b.gguf", m));
+    BENCH(for (const std::string &m : models) //
+          g_sink += edit_distance_scalar("lama-3.2-242b.gguf", m));
+}
+
+} // namespace lf
+
+int main() {
+    int rc;
+    if ((rc = lf::string_test()))
+        return rc;
+    lf::string_bench();
+}
@@ -33,6 +33,18 @@
 // multiplication, that are API compatible with NVIDIA's cuBLAS library
 // and implement similar tricks[1] for performance.
 //
+// Every kernel here is allocation free: tiles are staged through
+// statically sized __shared__ arrays and the strided batched fallbacks
+// index directly into caller memory, so no code path ever touches
+// cudaMalloc(). That's a property worth keeping, because the legacy
+// allocator synchronizes the whole device, which would serialize
+// callers that fan work out across multiple streams sharing a handle
+// apiece. A kernel that someday needs a device spill buffer should
+// take it from the caller or use the stream-ordered allocator, never
+// allocate per call. The transfer ring is the one exception on the
+// host side: it pins its staging memory once when the ring is
+// created, never per transfer.
+//
 // [1] S. Boehm, ‘How to Optimize a CUDA Matmul Kernel for cuBLAS-like
 //     Performance’, 2022. [Online]. Available:
 //     https://siboehm.com/articles/22/CUDA-MMM. [Accessed:
@@ -40,18 +52,32 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <type_traits>
 
 #ifndef __HIP__
 #include <cuda_fp16.h>
 #include <cuda_runtime.h>
 #define __shfl_down(var, srcLane, warpSize) __shfl_down_sync(-1u, var, srcLane, warpSize)
+#define __shfl(var, srcLane, warpSize) __shfl_sync(-1u, var, srcLane, warpSize)
 #else
 #include <hip/hip_fp16.h>
 #include <hip/hip_runtime.h>
 #define cudaSuccess hipSuccess
 #define cudaStream_t hipStream_t
 #define cudaGetLastError hipGetLastError
+#define cudaStreamSynchronize hipStreamSynchronize
+#define cudaEvent_t hipEvent_t
+#define cudaEventCreateWithFlags hipEventCreateWithFlags
+#define cudaEventDisableTiming hipEventDisableTiming
+#define cudaEventDestroy hipEventDestroy
+#define cudaEventRecord hipEventRecord
+#define cudaEventSynchronize hipEventSynchronize
+#define cudaMemcpyAsync hipMemcpyAsync
+#define cudaMemcpyHostToDevice hipMemcpyHostToDevice
+#define cudaMemcpyDeviceToHost hipMemcpyDeviceToHost
+#define cudaMallocHost(ptr, size) hipHostMalloc(ptr, size, hipHostMallocNonCoherent)
+#define cudaFreeHost hipHostFree
 #endif
 
 #define WARPSIZE 32
@@ -69,8 +95,17 @@
 #define ASSUME_A_OP_T 128
 #define ASSUME_B_OP_N 256
 
+struct tinyblasXferRing {
+    char *base; // one pinned allocation carved into equal slots
+    size_t slot_size;
+    int depth;
+    unsigned next;
+    cudaEvent_t *events; // records each slot's last use on the stream
+};
+
 struct tinyblasContext {
     cudaStream_t stream;
+    struct tinyblasXferRing *ring;
 };
 
 inline bool isone(float x) {
@@ -372,6 +407,7 @@ static __device__ void matmul_warp2d(tinyblasOperation_t aT, //
 tinyblasStatus_t tinyblasCreate(tinyblasHandle_t *out_handle) {
     tinyblasHandle_t handle;
     if ((handle = (tinyblasHandle_t)malloc(sizeof(struct tinyblasContext)))) {
+        handle->ring = 0;
         *out_handle = handle;
         return TINYBLAS_STATUS_SUCCESS;
     } else {
@@ -386,10 +422,170 @@ tinyblasStatus_t tinyblasCreate(tinyblasHandle_t *out_handle) {
  * @return TINYBLAS_STATUS_SUCCESS on success otherwise error
  */
 tinyblasStatus_t tinyblasDestroy(tinyblasHandle_t handle) {
+    tinyblasXferRingDestroy(handle);
     free(handle);
     return TINYBLAS_STATUS_SUCCESS;
 }
 
+/**
+ * Creates pinned staging ring for host transfers.
+ *
+ * Copies between pageable host memory and the device make the driver
+ * stage bytes through its own pinned bounce buffer, which roughly
+ * halves transfer throughput over PCIe and rules out overlapping the
+ * DMA with compute. This allocates a ring of `depth` pinned buffers
+ * of `slot_size` bytes each, which tinyblasCopyToDevice() and
+ * tinyblasCopyFromDevice() cycle through. Size slots to the largest
+ * activation that crosses the bus; a depth of two already overlaps
+ * one transfer's staging with the previous transfer's DMA.
+ *
+ * Pinned memory is a scarce system resource, so the ring is created
+ * once up front rather than grown on demand, and any transfer larger
+ * than a slot quietly falls back to the driver's pageable path.
+ *
+ * @param handle is pointer to handle created by tinyblasCreate()
+ * @param slot_size is byte capacity of each staging buffer
+ * @param depth is number of staging buffers in the ring
+ * @return TINYBLAS_STATUS_SUCCESS on success otherwise error
+ */
+tinyblasStatus_t tinyblasXferRingCreate(tinyblasHandle_t handle, unsigned long slot_size,
+                                        int depth) {
+    if (!slot_size || depth < 1)
+        return TINYBLAS_STATUS_INVALID_VALUE;
+    if (handle->ring)
+        return TINYBLAS_STATUS_INVALID_VALUE;
+    struct tinyblasXferRing *ring;
+    if (!(ring = (struct tinyblasXferRing *)calloc(1, sizeof(*ring))))
+        return TINYBLAS_STATUS_ALLOC_FAILED;
+    ring->slot_size = slot_size;
+    ring->depth = depth;
+    if (!(ring->events = (cudaEvent_t *)calloc(depth, sizeof(cudaEvent_t)))) {
+        free(ring);
+        return TINYBLAS_STATUS_ALLOC_FAILED;
+    }
+    if (cudaMallocHost((void **)&ring->base, slot_size * depth) != cudaSuccess) {
+        free(ring->events);
+        free(ring);
+        return TINYBLAS_STATUS_ALLOC_FAILED;
+    }
+    for (int i = 0; i < depth; ++i) {
+        if (cudaEventCreateWithFlags(&ring->events[i], cudaEventDisableTiming) != cudaSuccess) {
+            while (i--)
+                cudaEventDestroy(ring->events[i]);
+            cudaFreeHost(ring->base);
+            free(ring->events);
+            free(ring);
+            return TINYBLAS_STATUS_ALLOC_FAILED;
+        }
+    }
+    handle->ring = ring;
+    return TINYBLAS_STATUS_SUCCESS;
+}
+
+/**
+ * Destroys pinned staging ring, if one exists.
+ *
+ * The caller is responsible for making sure no transfer that used the
+ * ring is still in flight, e.g. by synchronizing the stream.
+ *
+ * @param handle is pointer to handle created by tinyblasCreate()
+ * @return TINYBLAS_STATUS_SUCCESS on success otherwise error
+ */
+tinyblasStatus_t tinyblasXferRingDestroy(tinyblasHandle_t handle) {
+    struct tinyblasXferRing *ring = handle->ring;
+    if (!ring)
+        return TINYBLAS_STATUS_SUCCESS;
+    for (int i = 0; i < ring->depth; ++i)
+        cudaEventDestroy(ring->events[i]);
+    cudaFreeHost(ring->base);
+    free(ring->events);
+    free(ring);
+    handle->ring = 0;
+    return TINYBLAS_STATUS_SUCCESS;
+}
+
+static char *xfer_ring_claim(tinyblasHandle_t handle, size_t size, int *out_slot) {
+    struct tinyblasXferRing *ring = handle->ring;
+    if (!ring || size > ring->slot_size)
+        return 0;
+    int slot = ring->next++ % ring->depth;
+    // a slot can't be reused while its previous transfer's dma is
+    // still reading it, so wait on the event recorded after that
+    // transfer. with depth sized to the pipeline this never blocks
+    if (cudaEventSynchronize(ring->events[slot]) != cudaSuccess)
+        return 0;
+    *out_slot = slot;
+    return ring->base + (size_t)slot * ring->slot_size;
+}
+
+/**
+ * Copies host memory to device through the pinned staging ring.
+ *
+ * The copy is staged through a pinned slot so the device transfer is
+ * a true async DMA on the handle's stream: this call returns after
+ * the CPU memcpy into the slot, with the device copy still in flight
+ * behind whatever work precedes it on the stream. Without a ring, or
+ * for transfers bigger than a slot, this degrades to a plain async
+ * copy from pageable memory.
+ *
+ * @param handle is pointer to handle created by tinyblasCreate()
+ * @param dst is device memory receiving the bytes
+ * @param src is host memory supplying the bytes
+ * @param size is number of bytes to copy
+ * @return TINYBLAS_STATUS_SUCCESS on success otherwise error
+ */
+tinyblasStatus_t tinyblasCopyToDevice(tinyblasHandle_t handle, void *dst, const void *src,
+                                      unsigned long size) {
+    int slot;
+    char *stage = xfer_ring_claim(handle, size, &slot);
+    if (stage) {
+        memcpy(stage, src, size);
+        src = stage;
+    }
+    if (cudaMemcpyAsync(dst, src, size, cudaMemcpyHostToDevice, handle->stream) != cudaSuccess)
+        return TINYBLAS_STATUS_EXECUTION_FAILED;
+    if (stage && cudaEventRecord(handle->ring->events[slot], handle->stream) != cudaSuccess)
+        return TINYBLAS_STATUS_EXECUTION_FAILED;
+    return TINYBLAS_STATUS_SUCCESS;
+}
+
+/**
+ * Copies device memory to host through the pinned staging ring.
+ *
+ * The device copy lands in a pinned slot at full DMA speed, then gets
+ * handed to the caller's buffer once the stream reaches it, so this
+ * call observes everything previously queued on the handle's stream.
+ * Unlike tinyblasCopyToDevice() it returns with the bytes delivered,
+ * since the caller is about to read them. Without a ring, or for
+ * transfers bigger than a slot, this degrades to a synchronized async
+ * copy into pageable memory.
+ *
+ * @param handle is pointer to handle created by tinyblasCreate()
+ * @param dst is host memory receiving the bytes
+ * @param src is device memory supplying the bytes
+ * @param size is number of bytes to copy
+ * @return TINYBLAS_STATUS_SUCCESS on success otherwise error
+ */
+tinyblasStatus_t tinyblasCopyFromDevice(tinyblasHandle_t handle, void *dst, const void *src,
+                                        unsigned long size) {
+    int slot;
+    char *stage = xfer_ring_claim(handle, size, &slot);
+    void *land = stage ? stage : dst;
+    if (cudaMemcpyAsync(land, src, size, cudaMemcpyDeviceToHost, handle->stream) != cudaSuccess)
+        return TINYBLAS_STATUS_EXECUTION_FAILED;
+    if (!stage) {
+        if (cudaStreamSynchronize(handle->stream) != cudaSuccess)
+            return TINYBLAS_STATUS_EXECUTION_FAILED;
+        return TINYBLAS_STATUS_SUCCESS;
+    }
+    if (cudaEventRecord(handle->ring->events[slot], handle->stream) != cudaSuccess)
+        return TINYBLAS_STATUS_EXECUTION_FAILED;
+    if (cudaEventSynchronize(handle->ring->events[slot]) != cudaSuccess)
+        return TINYBLAS_STATUS_EXECUTION_FAILED;
+    memcpy(dst, stage, size);
+    return TINYBLAS_STATUS_SUCCESS;
+}
+
 /**
  * Associates CUDA handle with tinyBLAS handle.
  *
@@ -979,3 +1175,528 @@ tinyblasStatus_t tinyblasGemmStridedBatchedEx(tinyblasHandle_t handle, //
         return TINYBLAS_STATUS_INVALID_VALUE;
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// tinyBLAS fused attention kernel
+
+#define ATT_TT 256
+#define ATT_WARPS (ATT_TT / WARPSIZE)
+#define ATT_CHUNK 16
+#define ATT_DMAX 128
+
+template <typename WORD, typename SRC, typename DST>
+static __device__ void attention_block(int d, int qlen, int klen, WORD scale, bool causal,
+                                       const SRC *Q, int ldq, const SRC *K, int ldk, const SRC *V,
+                                       int ldv, DST *O, int ldo) {
+
+    constexpr int DR = ATT_DMAX / WARPSIZE;
+
+    __shared__ SRC Ks[ATT_CHUNK * ATT_DMAX];
+    __shared__ SRC Vs[ATT_CHUNK * ATT_DMAX];
+
+    const int lane = threadIdx.x % WARPSIZE;
+    const int warp = threadIdx.x / WARPSIZE;
+    const int i = blockIdx.x * ATT_WARPS + warp;
+
+    WORD q[DR];
+    WORD acc[DR] = {0};
+    for (int j = 0; j < DR; ++j) {
+        int c = lane + WARPSIZE * j;
+        q[j] = i < qlen && c < d ? (WORD)Q[ldq * i + c] * scale : 0;
+    }
+    WORD maxs = -INFINITY;
+    WORD sums = 0;
+
+    // queries may not attend to keys from their future
+    const int limit = causal && i < qlen ? klen - qlen + i + 1 : klen;
+
+    for (int tt = 0; tt < klen; tt += ATT_CHUNK) {
+        int nt = min(ATT_CHUNK, klen - tt);
+
+        // every warp reads the same keys and values, so the whole
+        // block stages each chunk through shared memory together
+        __syncthreads();
+        for (int idx = threadIdx.x; idx < nt * d; idx += ATT_TT) {
+            Ks[idx] = K[ldk * (tt + idx / d) + idx % d];
+            Vs[idx] = V[ldv * (tt + idx / d) + idx % d];
+        }
+        __syncthreads();
+
+        if (i >= qlen)
+            continue;
+        for (int t = 0; t < nt && tt + t < limit; ++t) {
+            WORD s = 0;
+            for (int j = 0; j < DR; ++j) {
+                int c = lane + WARPSIZE * j;
+                if (c < d)
+                    s += q[j] * (WORD)Ks[d * t + c];
+            }
+            s = warpSum(s);
+            s = __shfl(s, 0, WARPSIZE);
+
+            // online softmax rescales the running numerator and
+            // denominator whenever a bigger score shows up, so the
+            // score matrix never needs to be materialized
+            WORD m = max(maxs, s);
+            WORD c0 = exp(maxs - m);
+            WORD p = exp(s - m);
+            sums = sums * c0 + p;
+            for (int j = 0; j < DR; ++j) {
+                int c = lane + WARPSIZE * j;
+                if (c < d)
+                    acc[j] = acc[j] * c0 + p * (WORD)Vs[d * t + c];
+            }
+            maxs = m;
+        }
+    }
+
+    if (i < qlen)
+        for (int j = 0; j < DR; ++j) {
+            int c = lane + WARPSIZE * j;
+            if (c < d)
+                O[ldo * i + c] = sums > 0 ? acc[j] / sums : 0;
+        }
+}
+
+template <typename WORD, typename SRC, typename DST>
+static __global__ void __launch_bounds__(ATT_TT) tinyblasATT_entry(
+    int d, int qlen, int klen, WORD scale, bool causal, const SRC *Q, int ldq, long long strideQ,
+    const SRC *K, int ldk, long long strideK, const SRC *V, int ldv, long long strideV, DST *O,
+    int ldo, long long strideO) {
+    attention_block<WORD>(d, qlen, klen, scale, causal, Q + strideQ * blockIdx.y, ldq,
+                          K + strideK * blockIdx.y, ldk, V + strideV * blockIdx.y, ldv,
+                          O + strideO * blockIdx.y, ldo);
+}
+
+template <typename WORD, typename SRC, typename DST>
+static tinyblasStatus_t tinyblasATT_launch(tinyblasHandle_t handle, int d, int qlen, int klen,
+                                           WORD scale, bool causal, const SRC *Q, int ldq,
+                                           long long strideQ, const SRC *K, int ldk,
+                                           long long strideK, const SRC *V, int ldv,
+                                           long long strideV, DST *O, int ldo, long long strideO,
+                                           int batchCount) {
+    dim3 blocks(CEIL_DIV(qlen, ATT_WARPS), batchCount);
+    tinyblasATT_entry<WORD><<<blocks, ATT_TT, 0, handle->stream>>>(
+        d, qlen, klen, scale, causal, Q, ldq, strideQ, K, ldk, strideK, V, ldv, strideV, O, ldo,
+        strideO);
+    if (cudaGetLastError() != cudaSuccess)
+        return TINYBLAS_STATUS_EXECUTION_FAILED;
+    return TINYBLAS_STATUS_SUCCESS;
+}
+
+/**
+ * Computes fused scaled dot product attention.
+ *
+ * This subroutine computes O = softmax(α*Q*Kᵀ)*V for a strided batch
+ * of attention heads, without ever materializing the full Q*Kᵀ score
+ * matrix, using the online softmax recurrence. Memory usage is O(1)
+ * in the sequence length, whereas doing the same thing with separate
+ * tinyblasGemmStridedBatchedEx() calls needs a qlen by klen buffer
+ * per head. Rows of Q, K, V, and O hold one head-dimension vector
+ * each, with the head dimension contiguous.
+ *
+ * @param handle was created by tinyblasCreate()
+ * @param d is the head dimension (may not exceed 128)
+ * @param qlen is number of query vectors
+ * @param klen is number of key and value vectors
+ * @param Q is input array of query matrices
+ * @param Qtype is data type of `Q`
+ * @param ldq is row stride of `Q`
+ * @param strideQ is distance between matrices in `Q`
+ * @param K is input array of key matrices
+ * @param Ktype is data type of `K`
+ * @param ldk is row stride of `K`
+ * @param strideK is distance between matrices in `K`
+ * @param V is input array of value matrices
+ * @param Vtype is data type of `V`
+ * @param ldv is row stride of `V`
+ * @param strideV is distance between matrices in `V`
+ * @param scale is multiplied against each dot product score
+ * @param causal if nonzero masks keys beyond each query's position
+ * @param O is output array of attention matrices
+ * @param Otype is data type of `O`
+ * @param ldo is row stride of `O`
+ * @param strideO is distance between matrices in `O`
+ * @param batchCount is number of heads to attend to
+ */
+tinyblasStatus_t tinyblasAttention(tinyblasHandle_t handle, //
+                                   int d, int qlen, int klen, //
+                                   const void *Q, tinyblasDataType_t Qtype, int ldq,
+                                   long long strideQ, //
+                                   const void *K, tinyblasDataType_t Ktype, int ldk,
+                                   long long strideK, //
+                                   const void *V, tinyblasDataType_t Vtype, int ldv,
+                                   long long strideV, //
+                                   float scale, int causal, //
+                                   void *O, tinyblasDataType_t Otype, int ldo, long long strideO, //
+                                   int batchCount) {
+
+    if (d < 0 || qlen < 0 || klen < 0 || batchCount < 0)
+        return TINYBLAS_STATUS_INVALID_VALUE;
+    if (ldq < std::max(1, d) || ldk < std::max(1, d) || ldv < std::max(1, d))
+        return TINYBLAS_STATUS_INVALID_VALUE;
+    if (ldo < std::max(1, d))
+        return TINYBLAS_STATUS_INVALID_VALUE;
+    if (d > ATT_DMAX)
+        return TINYBLAS_STATUS_NOT_SUPPORTED;
+    if (Qtype != Ktype || Ktype != Vtype)
+        return TINYBLAS_STATUS_NOT_SUPPORTED;
+    if (1ll * ldq * (qlen - 1) + (d - 1) > INT_MAX)
+        return TINYBLAS_STATUS_DIMENSION_OVERFLOW;
+    if (1ll * ldk * (klen - 1) + (d - 1) > INT_MAX)
+        return TINYBLAS_STATUS_DIMENSION_OVERFLOW;
+    if (1ll * ldv * (klen - 1) + (d - 1) > INT_MAX)
+        return TINYBLAS_STATUS_DIMENSION_OVERFLOW;
+    if (1ll * ldo * (qlen - 1) + (d - 1) > INT_MAX)
+        return TINYBLAS_STATUS_DIMENSION_OVERFLOW;
+
+    switch (Qtype) {
+    case TINYBLAS_R_16F:
+        switch (Otype) {
+        case TINYBLAS_R_16F:
+            return tinyblasATT_launch(handle, d, qlen, klen, scale, !!causal, (const half *)Q, ldq,
+                                      strideQ, (const half *)K, ldk, strideK, (const half *)V, ldv,
+                                      strideV, (half *)O, ldo, strideO, batchCount);
+        case TINYBLAS_R_32F:
+            return tinyblasATT_launch(handle, d, qlen, klen, scale, !!causal, (const half *)Q, ldq,
+                                      strideQ, (const half *)K, ldk, strideK, (const half *)V, ldv,
+                                      strideV, (float *)O, ldo, strideO, batchCount);
+        default:
+            return TINYBLAS_STATUS_INVALID_VALUE;
+        }
+    case TINYBLAS_R_32F:
+        switch (Otype) {
+        case TINYBLAS_R_16F:
+            return TINYBLAS_STATUS_NOT_SUPPORTED;
+        case TINYBLAS_R_32F:
+            return tinyblasATT_launch(handle, d, qlen, klen, scale, !!causal, (const float *)Q, ldq,
+                                      strideQ, (const float *)K, ldk, strideK, (const float *)V,
+                                      ldv, strideV, (float *)O, ldo, strideO, batchCount);
+        default:
+            return TINYBLAS_STATUS_INVALID_VALUE;
+        }
+    default:
+        return TINYBLAS_STATUS_INVALID_VALUE;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// tinyBLAS on-device sampling kernels
+
+#define SMP_TT 1024
+#define SMP_KMAX 1024
+
+// maps ieee floats onto unsigned ints that compare the same way, so
+// radix machinery can order logits without a floating point sort
+static __device__ __forceinline__ unsigned sample_ord(float x) {
+    unsigned u = __float_as_uint(x);
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+// turns the caller's seed into a uniform deviate in [0,1)
+static __device__ __forceinline__ float sample_rng(unsigned long long z) {
+    z += 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    return (z >> 40) * (1.f / (1 << 24));
+}
+
+static __global__ __launch_bounds__(SMP_TT) void sample_greedy_entry(int n, const float *logits,
+                                                                     int *token, float *logprob) {
+    __shared__ float vals[SMP_TT];
+    __shared__ int idxs[SMP_TT];
+    __shared__ float best_val;
+    int t = threadIdx.x;
+
+    // block-wide argmax with index as tiebreaker for determinism
+    float best = -INFINITY;
+    int bi = 0;
+    for (int i = t; i < n; i += SMP_TT)
+        if (logits[i] > best) {
+            best = logits[i];
+            bi = i;
+        }
+    vals[t] = best;
+    idxs[t] = bi;
+    for (int s = SMP_TT / 2; s; s >>= 1) {
+        __syncthreads();
+        if (t < s)
+            if (vals[t + s] > vals[t] || (vals[t + s] == vals[t] && idxs[t + s] < idxs[t])) {
+                vals[t] = vals[t + s];
+                idxs[t] = idxs[t + s];
+            }
+    }
+    __syncthreads();
+    if (!t) {
+        best_val = vals[0];
+        *token = idxs[0];
+    }
+    if (!logprob)
+        return;
+    __syncthreads();
+
+    // second sweep gets the softmax denominator for the logprob
+    float z = 0;
+    for (int i = t; i < n; i += SMP_TT)
+        z += expf(logits[i] - best_val);
+    vals[t] = z;
+    for (int s = SMP_TT / 2; s; s >>= 1) {
+        __syncthreads();
+        if (t < s)
+            vals[t] += vals[t + s];
+    }
+    __syncthreads();
+    if (!t)
+        *logprob = -logf(vals[0]);
+}
+
+static __global__ __launch_bounds__(SMP_TT) void sample_softmax_entry(int n, const float *logits,
+                                                                      float temp,
+                                                                      unsigned long long seed,
+                                                                      int *token, float *logprob) {
+    __shared__ float shard[SMP_TT];
+    __shared__ float smax;
+    int t = threadIdx.x;
+    int len = CEIL_DIV(n, SMP_TT);
+    int lo = t * len;
+    int hi = min(n, lo + len);
+
+    // block-wide max keeps the exponentials from overflowing
+    float m = -INFINITY;
+    for (int i = lo; i < hi; ++i)
+        m = max(m, logits[i]);
+    shard[t] = m;
+    for (int s = SMP_TT / 2; s; s >>= 1) {
+        __syncthreads();
+        if (t < s)
+            shard[t] = max(shard[t], shard[t + s]);
+    }
+    __syncthreads();
+    if (!t)
+        smax = shard[0];
+    __syncthreads();
+
+    // each thread sums the tempered weights of its contiguous chunk
+    float z = 0;
+    for (int i = lo; i < hi; ++i)
+        z += expf((logits[i] - smax) / temp);
+    shard[t] = z;
+    __syncthreads();
+
+    // the categorical draw walks chunk sums then one chunk's weights.
+    // recomputing the chunk's exponentials in the same order as above
+    // makes the arithmetic identical, so the walk can't overshoot
+    if (!t) {
+        float total = 0;
+        for (int i = 0; i < SMP_TT; ++i)
+            total += shard[i];
+        float target = sample_rng(seed) * total;
+        int chunk = SMP_TT - 1;
+        float before = 0;
+        for (int i = 0; i < SMP_TT; ++i) {
+            if (before + shard[i] > target) {
+                chunk = i;
+                break;
+            }
+            before += shard[i];
+        }
+        int clo = chunk * len;
+        int chi = min(n, clo + len);
+        int pick = chi - 1;
+        float w = 0;
+        for (int i = clo; i < chi; ++i) {
+            w = expf((logits[i] - smax) / temp);
+            if (before + w > target) {
+                pick = i;
+                break;
+            }
+            before += w;
+        }
+        *token = pick;
+        if (logprob)
+            *logprob = (logits[pick] - smax) / temp - logf(total);
+    }
+}
+
+static __global__ __launch_bounds__(SMP_TT) void sample_topk_entry(int n, const float *logits,
+                                                                   int k, float topp, float temp,
+                                                                   unsigned long long seed,
+                                                                   int *token, float *logprob) {
+    __shared__ int hist[256];
+    __shared__ float cand_val[SMP_KMAX];
+    __shared__ int cand_idx[SMP_KMAX];
+    __shared__ int sel_byte, above, nabove, nties;
+    int t = threadIdx.x;
+
+    // radix select the kth largest logit one byte at a time. each
+    // round histograms the elements still matching the chosen prefix
+    // and descends into the bucket holding the kth biggest value
+    unsigned prefix = 0;
+    unsigned himask = 0;
+    int remaining = k;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        if (t < 256)
+            hist[t] = 0;
+        __syncthreads();
+        for (int i = t; i < n; i += SMP_TT) {
+            unsigned u = sample_ord(logits[i]);
+            if ((u & himask) == prefix)
+                atomicAdd(&hist[(u >> shift) & 255], 1);
+        }
+        __syncthreads();
+        if (!t) {
+            int c = 0;
+            int b = 255;
+            while (c + hist[b] < remaining)
+                c += hist[b--];
+            sel_byte = b;
+            above = c;
+        }
+        __syncthreads();
+        remaining -= above;
+        prefix |= (unsigned)sel_byte << shift;
+        himask |= 255u << shift;
+        __syncthreads();
+    }
+
+    // compact the winners into shared memory: everything above the
+    // threshold, then just enough threshold ties to reach k exactly
+    if (!t) {
+        nabove = 0;
+        nties = 0;
+    }
+    __syncthreads();
+    for (int i = t; i < n; i += SMP_TT) {
+        unsigned u = sample_ord(logits[i]);
+        if (u > prefix) {
+            int s = atomicAdd(&nabove, 1);
+            cand_val[s] = logits[i];
+            cand_idx[s] = i;
+        } else if (u == prefix) {
+            int r = atomicAdd(&nties, 1);
+            if (r < remaining) {
+                int s = k - remaining + r;
+                cand_val[s] = logits[i];
+                cand_idx[s] = i;
+            }
+        }
+    }
+    int K2 = 1;
+    while (K2 < k)
+        K2 <<= 1;
+    for (int i = k + t; i < K2; i += SMP_TT)
+        cand_val[i] = -INFINITY;
+    __syncthreads();
+
+    // bitonic sort the candidates into descending order
+    for (int size = 2; size <= K2; size <<= 1)
+        for (int stride = size >> 1; stride; stride >>= 1) {
+            if (t < K2) {
+                int j = t ^ stride;
+                if (j > t) {
+                    bool up = !(t & size);
+                    if (up ? cand_val[t] < cand_val[j] : cand_val[t] > cand_val[j]) {
+                        float v = cand_val[t];
+                        cand_val[t] = cand_val[j];
+                        cand_val[j] = v;
+                        int x = cand_idx[t];
+                        cand_idx[t] = cand_idx[j];
+                        cand_idx[j] = x;
+                    }
+                }
+            }
+            __syncthreads();
+        }
+
+    if (!t) {
+        // the top-p cut uses temperature-one probabilities, matching
+        // the order the cpu sampler applies its constraints in
+        int kk = k;
+        if (topp < 1) {
+            float z = 0;
+            for (int i = 0; i < k; ++i)
+                z += expf(cand_val[i] - cand_val[0]);
+            float run = 0;
+            for (int i = 0; i < k; ++i) {
+                run += expf(cand_val[i] - cand_val[0]);
+                if (run >= topp * z) {
+                    kk = i + 1;
+                    break;
+                }
+            }
+        }
+
+        // tempered softmax and categorical draw over the survivors
+        float z = 0;
+        for (int i = 0; i < kk; ++i)
+            z += expf((cand_val[i] - cand_val[0]) / temp);
+        float target = sample_rng(seed) * z;
+        int pick = kk - 1;
+        float before = 0;
+        for (int i = 0; i < kk; ++i) {
+            float w = expf((cand_val[i] - cand_val[0]) / temp);
+            if (before + w > target) {
+                pick = i;
+                break;
+            }
+            before += w;
+        }
+        *token = cand_idx[pick];
+        if (logprob)
+            *logprob = (cand_val[pick] - cand_val[0]) / temp - logf(z);
+    }
+}
+
+/**
+ * Samples next token from logits without leaving the GPU.
+ *
+ * This subroutine applies top-k truncation, top-p truncation,
+ * temperature, and the final categorical draw to a logits row that's
+ * already resident in device memory, so the only thing that ever needs
+ * to cross the bus afterward is the chosen token id and, if requested,
+ * its log probability. That replaces the classic pattern of copying
+ * the full vocabulary row back to the host every decode step just so
+ * the CPU can throw most of it away. Constraints are applied in the
+ * same order as the CPU sampler: top-k first, then top-p over
+ * temperature-one probabilities of the survivors, then temperature,
+ * then the draw. A non-positive temperature or a top-k of one selects
+ * the argmax. The draw is a pure function of `seed`, so streams that
+ * pass their own rng state get reproducible results.
+ *
+ * @param handle was created by tinyblasCreate()
+ * @param logits is device pointer to row of `n` raw model outputs
+ * @param n is vocabulary size
+ * @param topk keeps only this many highest logits, if it's ≥ 2; zero
+ *     or negative disables truncation, which is only supported when
+ *     `topp` is ≥ 1 or the vocabulary fits the candidate buffer
+ * @param topp keeps the smallest set of candidates whose cumulative
+ *     probability reaches this value, if it's < 1
+ * @param temperature divides the logits before the final softmax; if
+ *     it's ≤ 0 then the highest logit is chosen deterministically
+ * @param seed drives the categorical draw
+ * @param token is device pointer that receives the sampled id
+ * @param logprob optionally receives the token's log probability
+ */
+tinyblasStatus_t tinyblasSample(tinyblasHandle_t handle, const float *logits, int n, int topk,
+                                float topp, float temperature, unsigned long long seed, int *token,
+                                float *logprob) {
+    if (n <= 0 || !logits || !token)
+        return TINYBLAS_STATUS_INVALID_VALUE;
+    if (temperature <= 0 || topk == 1) {
+        sample_greedy_entry<<<1, SMP_TT, 0, handle->stream>>>(n, logits, token, logprob);
+    } else {
+        int k = topk >= 2 ? std::min(topk, n) : topp < 1 ? n : 0;
+        if (k > SMP_KMAX)
+            return TINYBLAS_STATUS_NOT_SUPPORTED;
+        if (k)
+            sample_topk_entry<<<1, SMP_TT, 0, handle->stream>>>(n, logits, k, topp, temperature,
+                                                               seed, token, logprob);
+        else
+            sample_softmax_entry<<<1, SMP_TT, 0, handle->stream>>>(n, logits, temperature, seed,
+                                                                  token, logprob);
+    }
+    if (cudaGetLastError() != cudaSuccess)
+        return TINYBLAS_STATUS_EXECUTION_FAILED;
+    return TINYBLAS_STATUS_SUCCESS;
+}
@@ -41,6 +41,11 @@ tinyblasStatus_t tinyblasDestroy(tinyblasHandle_t);
 tinyblasStatus_t tinyblasSetStream(tinyblasHandle_t, void *);
 tinyblasStatus_t tinyblasGetStream(tinyblasHandle_t, void **);
 
+tinyblasStatus_t tinyblasXferRingCreate(tinyblasHandle_t, unsigned long, int);
+tinyblasStatus_t tinyblasXferRingDestroy(tinyblasHandle_t);
+tinyblasStatus_t tinyblasCopyToDevice(tinyblasHandle_t, void *, const void *, unsigned long);
+tinyblasStatus_t tinyblasCopyFromDevice(tinyblasHandle_t, void *, const void *, unsigned long);
+
 tinyblasStatus_t tinyblasSgemm(tinyblasHandle_t, tinyblasOperation_t, tinyblasOperation_t, int, int,
                                int, const float *, const float *, int, const float *, int,
                                const float *, float *, int);
@@ -64,3 +69,12 @@ tinyblasStatus_t tinyblasGemmStridedBatchedEx(tinyblasHandle_t, tinyblasOperatio
                                               const void *, void *, tinyblasDataType_t, int,
                                               long long, int, tinyblasComputeType_t,
                                               tinyblasGemmAlgo_t);
+
+tinyblasStatus_t tinyblasAttention(tinyblasHandle_t, int, int, int, const void *,
+                                   tinyblasDataType_t, int, long long, const void *,
+                                   tinyblasDataType_t, int, long long, const void *,
+                                   tinyblasDataType_t, int, long long, float, int, void *,
+                                   tinyblasDataType_t, int, long long, int);
+
+tinyblasStatus_t tinyblasSample(tinyblasHandle_t, const float *, int, int, float, float,
+                                unsigned long long, int *, float *);
@@ -44,7 +44,11 @@
 #include "llama.cpp/ggml-quants.h"
 #include "log.h"
 #include "sgemm.h"
+#include <atomic>
 #include <cosmo.h>
+#include <map>
+#include <stdlib.h>
+#include <time.h>
 
 #pragma GCC diagnostic ignored "-Wpedantic"
 #pragma GCC diagnostic ignored "-Wignored-attributes"
@@ -258,6 +262,17 @@ inline __m512 madder(__m512bh x, __m512bh y, __m512 z, __m512 *_) {
 }
 #endif
 
+#if defined(__ARM_FEATURE_BF16_VECTOR_ARITHMETIC) && !defined(_MSC_VER)
+template <>
+inline float32x4_t madd(bfloat16x8_t x, bfloat16x8_t y, float32x4_t z) {
+    return vbfdotq_f32(z, x, y);
+}
+template <>
+inline float32x4_t madder(bfloat16x8_t x, bfloat16x8_t y, float32x4_t z, float32x4_t *_) {
+    return vbfdotq_f32(z, x, y);
+}
+#endif // __ARM_FEATURE_BF16_VECTOR_ARITHMETIC
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // VECTORIZED HORIZONTAL SUM
 
@@ -274,6 +289,34 @@ inline float hsum(float16x8_t x) {
 }
 #endif // __ARM_FEATURE_FP16_VECTOR_ARITHMETIC
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// ACCUMULATOR SPILLING
+
+// the ruler stack in tinyBLAS::gemm carries chunk sums in this type.
+// half precision accumulators spill into fp32 vectors between chunks
+// so their roundoff is bounded by the chunk length rather than the
+// whole inner dimension, while the hot loop keeps running fp16 math
+
+template <typename T>
+struct carry {
+    using type = T;
+};
+
+template <typename T>
+inline T spill(T x) {
+    return x;
+}
+
+#if defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC) && !defined(_MSC_VER)
+template <>
+struct carry<float16x8_t> {
+    using type = float32x4_t;
+};
+inline float32x4_t spill(float16x8_t x) {
+    return vaddq_f32(vcvt_f32_f16(vget_low_f16(x)), vcvt_f32_f16(vget_high_f16(x)));
+}
+#endif // __ARM_FEATURE_FP16_VECTOR_ARITHMETIC
+
 #if defined(__SSE__) || defined(__AVX__) || defined(__AVX2__) || defined(__AVX512F__)
 inline float hsum(__m128 x) {
 #if defined(__AVX__) || defined(__AVX2__) || defined(__AVX512F__)
@@ -339,6 +382,12 @@ template <>
 inline float32x4_t load(const ggml_fp16_t *p) {
     return vcvt_f32_f16(vld1_f16((const float16_t *)p));
 }
+#if defined(__ARM_FEATURE_BF16_VECTOR_ARITHMETIC)
+template <>
+inline bfloat16x8_t load(const ggml_bf16_t *p) {
+    return vld1q_bf16((const bfloat16_t *)p);
+}
+#endif // __ARM_FEATURE_BF16_VECTOR_ARITHMETIC
 #endif // _MSC_VER
 #endif // __ARM_NEON
 
@@ -413,6 +462,29 @@ inline void store(ggml_bf16_t *p, float f) {
     *p = GGML_FP32_TO_BF16(f);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// THREAD SYNCHRONIZATION
+
+/**
+ * Waits for all threads computing a matmul to arrive here.
+ *
+ * Every thread passes through the kernels below the same number of
+ * times with the same arguments, which is what makes it possible to
+ * rendezvous without any help from the caller's thread pool.
+ */
+inline void syncthreads(int nth) {
+    static std::atomic_int count;
+    static std::atomic_uint phase;
+    unsigned ph = phase.load(std::memory_order_relaxed);
+    if (count.fetch_add(1, std::memory_order_acq_rel) + 1 == nth) {
+        count.store(0, std::memory_order_relaxed);
+        phase.fetch_add(1, std::memory_order_release);
+    } else {
+        while (phase.load(std::memory_order_acquire) == ph) {
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // FLOATING POINT MATRIX MULTIPLICATION
 
@@ -425,19 +497,139 @@ class tinyBLAS {
     }
 
     void matmul(long m, long n) {
+        // during single token prediction most matmuls have one column
+        // so tiling over output rows alone may not produce enough work
+        // to cover a big multicore chip. when that happens each thread
+        // reduces a slice of the inner dimension instead.
+        if (nth > 1 && m * n < nth && k >= 2 * KN * nth)
+            return splitk(m, n);
         mnpack(0, m, 0, n);
     }
 
   private:
+    NOINLINE void splitk(long m, long n) {
+        static float *scratch;
+        static long capacity;
+        long slice = (m * n + 15) & -16l;
+        if (!ith && capacity < slice * nth) {
+            free(scratch);
+            scratch = (float *)memalign(ROW_ALIGN, sizeof(float) * slice * nth);
+            capacity = scratch ? slice * nth : 0;
+        }
+        syncthreads(nth);
+        if (!scratch)
+            return mnpack(0, m, 0, n);
+
+        // each thread accumulates partial dot products over a vector
+        // aligned slice of the k dimension, so only the last one ever
+        // needs to touch the scalar tail
+        long kc = (k / KN + nth - 1) / nth * KN;
+        long k0 = MIN(kc * ith, k);
+        long k1 = ith + 1 == nth ? k : MIN(k0 + kc, k);
+        float *part = scratch + slice * ith;
+        for (long j = 0; j < n; ++j)
+            for (long i = 0; i < m; ++i) {
+                long l = k0;
+                D Cv = {};
+                for (; l + KN <= k1; l += KN)
+                    Cv = madd(load<V>(INDEX(A, lda, i, l)), //
+                              load<V>(INDEX(B, ldb, j, l)), //
+                              Cv);
+                float Cf = hsum(Cv);
+                for (; l < k1; ++l)
+                    Cf = fmaf(load<float>(INDEX(A, lda, i, l)), //
+                              load<float>(INDEX(B, ldb, j, l)), //
+                              Cf);
+                part[j * m + i] = Cf;
+            }
+        syncthreads(nth);
+
+        // partial sums are then combined by a log2(nth) tree reduction
+        for (int peer = 1; peer < nth; peer <<= 1) {
+            if (!(ith & (2 * peer - 1)) && ith + peer < nth)
+                for (long x = 0; x < m * n; ++x)
+                    part[x] += part[slice * peer + x];
+            syncthreads(nth);
+        }
+        if (!ith)
+            for (long j = 0; j < n; ++j)
+                for (long i = 0; i < m; ++i)
+                    store(INDEX(C, ldc, j, i), scratch[j * m + i]);
+    }
+
+    // candidate tile shapes for the dominant inner kernel. index zero
+    // is what the hand scheduled dispatch below always used. the rest
+    // trade register reuse for a smaller working set, which sometimes
+    // wins on parts with a different cache hierarchy, so the first few
+    // big matmuls of a process are timed to decide which one sticks.
+#if VECTOR_REGISTERS == 32
+    static constexpr int TILES[3][2] = {{5, 5}, {4, 4}, {3, 3}};
+#else
+    static constexpr int TILES[3][2] = {{4, 3}, {3, 3}, {2, 2}};
+#endif
+
+    void gemm_tile(int c, long m0, long m, long n0, long n) {
+        switch (c) {
+        case 0:
+            return gemm<TILES[0][0], TILES[0][1]>(m0, m, n0, n);
+        case 1:
+            return gemm<TILES[1][0], TILES[1][1]>(m0, m, n0, n);
+        case 2:
+            return gemm<TILES[2][0], TILES[2][1]>(m0, m, n0, n);
+        default:
+            __builtin_unreachable();
+        }
+    }
+
+    NOINLINE void bigmul(long m0, long m, long n0, long n, long *mc, long *nc) {
+        static std::atomic_int chosen{-1};
+        static int trial, samples;
+        static double elapsed[3], work[3];
+        static struct timespec t0;
+        int c = chosen.load(std::memory_order_relaxed);
+        if (c < 0) {
+            // the threads rendezvous so thread zero can time the whole
+            // team running the trial tile against the model's very own
+            // matmul shapes. nothing is thrown away while tuning since
+            // every sample is an op the caller wanted computed anyway.
+            syncthreads(nth);
+            int t = trial;
+            if (!ith)
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+            gemm_tile(t, m0, m, n0, n);
+            syncthreads(nth);
+            if (!ith) {
+                struct timespec t1;
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                elapsed[t] += (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+                work[t] += (double)(m - m0) * (n - n0) * k;
+                if (++samples == 3) {
+                    samples = 0;
+                    if (++trial == 3) {
+                        int best = 0;
+                        for (int i = 1; i < 3; ++i)
+                            if (work[i] * elapsed[best] > work[best] * elapsed[i])
+                                best = i;
+                        chosen.store(best, std::memory_order_relaxed);
+                    }
+                }
+            }
+            syncthreads(nth);
+            c = t;
+        } else {
+            gemm_tile(c, m0, m, n0, n);
+        }
+        *mc = TILES[c][0];
+        *nc = TILES[c][1];
+    }
+
     NOINLINE void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
 #if VECTOR_REGISTERS == 32
         switch ((MIN(m - m0, 5) << 4) | MIN(n - n0, 5)) {
         case 0x55:
-            mc = 5;
-            nc = 5;
-            gemm<5, 5>(m0, m, n0, n);
+            bigmul(m0, m, n0, n, &mc, &nc);
             break;
         case 0x54:
         case 0x53:
@@ -487,9 +679,7 @@ class tinyBLAS {
 #if VECTOR_REGISTERS == 16
         switch ((MIN(m - m0, 4) << 4) | MIN(n - n0, 3)) {
         case 0x43:
-            mc = 4;
-            nc = 3;
-            gemm<4, 3>(m0, m, n0, n);
+            bigmul(m0, m, n0, n, &mc, &nc);
             break;
         case 0x42:
         case 0x33:
@@ -531,7 +721,8 @@ class tinyBLAS {
 
     template <int RM, int RN>
     NOINLINE void gemm(long m0, long m, long n0, long n) {
-        D stack[bsr(k / CHUNK + 1) + 1][RN][RM];
+        using W = typename carry<D>::type;
+        W stack[bsr(k / CHUNK + 1) + 1][RN][RM];
         long ytiles = RM > 1 ? (m - m0) / RM : 1;
         long xtiles = RN > 1 ? (n - n0) / RN : 1;
         long tiles = xtiles * ytiles;
@@ -558,14 +749,19 @@ class tinyBLAS {
                                             load<V>(INDEX(B, ldb, jj + j, chunk + l)), //
                                             Cv[j][i]);
 
+                W Cw[RN][RM];
+                for (j = 0; j < RN; ++j)
+                    for (i = 0; i < RM; ++i)
+                        Cw[j][i] = spill(Cv[j][i]);
+
                 for (rule = bsr(step & -step); --rule;)
                     for (--sp, j = 0; j < RN; ++j)
                         for (i = 0; i < RM; ++i)
-                            Cv[j][i] += stack[sp][j][i];
+                            Cw[j][i] += stack[sp][j][i];
 
                 for (j = 0; j < RN; ++j)
                     for (i = 0; i < RM; ++i)
-                        stack[sp][j][i] = Cv[j][i];
+                        stack[sp][j][i] = Cw[j][i];
             }
 
             D Cv[RN][RM] = {};
@@ -578,15 +774,20 @@ class tinyBLAS {
                                         load<V>(INDEX(B, ldb, jj + j, chunk)), //
                                         Cv[j][i]);
 
+            W Cw[RN][RM];
+            for (j = 0; j < RN; ++j)
+                for (i = 0; i < RM; ++i)
+                    Cw[j][i] = spill(Cv[j][i]);
+
             while (sp--)
                 for (j = 0; j < RN; ++j)
                     for (i = 0; i < RM; ++i)
-                        Cv[j][i] += stack[sp][j][i];
+                        Cw[j][i] += stack[sp][j][i];
 
             float Cf[RN][RM];
             for (j = 0; j < RN; ++j)
                 for (i = 0; i < RM; ++i)
-                    Cf[j][i] = hsum(Cv[j][i]);
+                    Cf[j][i] = hsum(Cw[j][i]);
 
             for (; chunk < k; ++chunk)
                 for (j = 0; j < RN; ++j)
@@ -625,10 +826,63 @@ class tinyBLAS_Q0_ARM {
     }
 
     void matmul(long m, long n) {
+        if (n == 1) {
+            if (FLAG_precise)
+                gemv<true>(m);
+            else
+                gemv<false>(m);
+            return;
+        }
         mnpack(0, m, 0, n);
     }
 
   private:
+    // dedicated matvec kernel for the output projection and anywhere
+    // else decode multiplies a vocabulary sized weight matrix against a
+    // single activation vector. the tiled kernel reloads the activation
+    // block for every weight row it touches; a matvec visits every row
+    // with the same activations, so those loads are hoisted here and
+    // shared by four rows at a time. threads take contiguous row ranges
+    // to keep the weight stream sequential for the prefetcher.
+    template <int PRECISE>
+    NOINLINE void gemv(long m) {
+        long duty = (m + nth - 1) / nth;
+        long start = duty * ith;
+        long end = start + duty;
+        if (end > m)
+            end = m;
+        long ii = start;
+        for (; ii + 4 <= end; ii += 4)
+            gemv_rows<4, PRECISE>(ii);
+        for (; ii < end; ++ii)
+            gemv_rows<1, PRECISE>(ii);
+    }
+
+    template <int RM, int PRECISE>
+    inline void gemv_rows(long ii) {
+        float32x4_t Cv[RM] = {};
+        float32x4_t Ce[RM] = {};
+        for (long l = 0; l < k; ++l) {
+            int8x16_t blo = load_lo(INDEX(B, ldb, 0, l));
+            int8x16_t bhi = load_hi(INDEX(B, ldb, 0, l));
+            float db = unhalf(INDEX(B, ldb, 0, l)->d);
+#pragma GCC unroll 100
+            for (int i = 0; i < RM; ++i) {
+                float32x4_t a = vcvtq_f32_s32(
+                    vdotq_s32(vdotq_s32(vdupq_n_s32(0), load_lo(INDEX(A, lda, ii + i, l)), blo),
+                              load_hi(INDEX(A, lda, ii + i, l)), bhi));
+                float b = unhalf(INDEX(A, lda, ii + i, l)->d) * db;
+                if (PRECISE)
+                    Cv[i] = badder(a, b, Cv[i], &Ce[i]);
+                else
+                    Cv[i] = vmlaq_n_f32(Cv[i], a, b);
+            }
+        }
+#pragma GCC unroll 100
+        for (int i = 0; i < RM; ++i)
+            store(INDEX(C, ldc, 0, ii + i), hsum(Cv[i]));
+    }
+
     NOINLINE void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
@@ -786,10 +1040,55 @@ class tinyBLAS_Q0_AVX2 {
     }
 
     void matmul(long m, long n) {
+        if (n == 1)
+            return gemv(m);
         mnpack(0, m, 0, n);
     }
 
   private:
+    // dedicated matvec kernel for the output projection and anywhere
+    // else decode multiplies a vocabulary sized weight matrix against a
+    // single activation vector. the tiled kernel re-derives the signs
+    // and magnitudes of the activation block for every weight row it
+    // touches; a matvec visits every row with the same activations, so
+    // that work is hoisted here and shared by four rows at a time,
+    // leaving one load, one sign, and one dot product per weight block.
+    // threads take contiguous row ranges to keep the weight stream
+    // sequential for the prefetcher, and summation is always
+    // compensated since a matvec is memory bound anyway.
+    NOINLINE void gemv(long m) {
+        long duty = (m + nth - 1) / nth;
+        long start = duty * ith;
+        long end = start + duty;
+        if (end > m)
+            end = m;
+        long ii = start;
+        for (; ii + 4 <= end; ii += 4)
+            gemv_rows<4>(ii);
+        for (; ii < end; ++ii)
+            gemv_rows<1>(ii);
+    }
+
+    template <int RM>
+    inline void gemv_rows(long ii) {
+        __m256 Cv[RM] = {};
+        __m256 Ce[RM] = {};
+        for (long l = 0; l < k; ++l) {
+            __m256i b = load(INDEX(B, ldb, 0, l));
+            __m256i bu = _mm256_sign_epi8(b, b);
+            float db = unhalf(INDEX(B, ldb, 0, l)->d);
+#pragma GCC unroll 100
+            for (int i = 0; i < RM; ++i) {
+                __m256 d = _mm256_set1_ps(unhalf(INDEX(A, lda, ii + i, l)->d) * db);
+                __m256 u = updot(bu, _mm256_sign_epi8(load(INDEX(A, lda, ii + i, l)), b));
+                Cv[i] = madder(d, u, Cv[i], &Ce[i]);
+            }
+        }
+#pragma GCC unroll 100
+        for (int i = 0; i < RM; ++i)
+            store(INDEX(C, ldc, 0, ii + i), hsum(Cv[i]));
+    }
+
     void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
@@ -1004,4 +1303,178 @@ class tinyBLAS_Q0_AVX2 {
 };
 #endif // __AVX2__
 
+//////////////////////////////////////////////////////////////////////////////////////////
+// QUANT ZERO MATRIX MULTIPLICATION FOR INTEL AMX
+
+#if defined(__AMX_INT8__) && defined(__AVX512F__)
+
+struct amx_tile_config {
+    unsigned char palette;
+    unsigned char start_row;
+    unsigned char reserved[14];
+    unsigned short colsb[16];
+    unsigned char rows[16];
+};
+
+inline void configure_amx(void) {
+    static thread_local bool once;
+    if (!once) {
+        static const amx_tile_config config = {
+            .palette = 1,
+            .colsb = {64, 32, 64},
+            .rows = {16, 16, 8},
+        };
+        _tile_loadconfig(&config);
+        once = true;
+    }
+}
+
+// sixteen weight rows of one q8_0 block rewritten into the vnni
+// doubleword format tdpbssd expects, with the block scales pulled
+// out in front so they can be loaded with a single vmovaps
+struct amx_q8_0_group {
+    alignas(64) float d[16];
+    signed char vnni[8][64];
+};
+
+// tile register layout: tmm0 collects a 16x16 i32 dot product, tmm1
+// streams sixteen rows of activation bytes straight out of memory,
+// and tmm2 holds one q8_0 block of sixteen weight rows repacked into
+// the vnni doubleword format tdpbssd expects. accumulation across
+// blocks happens in f32 vector registers so the scales of every
+// block are honored exactly.
+template <int CONFIG, typename TA, typename TB, typename TC>
+class tinyBLAS_Q0_AMX {
+  public:
+    tinyBLAS_Q0_AMX(long k, const TA *A, long lda, const TB *B, long ldb, TC *C, long ldc, int ith,
+                    int nth)
+        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth) {
+    }
+
+    void matmul(long m, long n) {
+        configure_amx();
+        const amx_q8_0_group *W = nullptr;
+        if (FLAG_repack)
+            W = repack(m);
+        long ytiles = m / 16;
+        long xtiles = n / 16;
+        long tiles = xtiles * ytiles;
+        long duty = (tiles + nth - 1) / nth;
+        long start = duty * ith;
+        long end = start + duty;
+        if (end > tiles)
+            end = tiles;
+        for (long job = start; job < end; ++job) {
+            long ii = job / xtiles * 16;
+            long jj = job % xtiles * 16;
+            gemm_tile(W, ii, jj);
+        }
+    }
+
+  private:
+    // rewriting weight tiles into vnni order on every call costs o(m·k)
+    // byte shuffles that decode no faster the second time around, so the
+    // --repack flag trades memory for it: the first matmul to see a
+    // weight matrix rewrites the whole thing and the copy is kept for
+    // the life of the process, letting later calls stream tiles into
+    // tmm2 untouched. every compute thread reaches this function with
+    // identical arguments, which is what makes the barriers sound.
+    const amx_q8_0_group *repack(long m) {
+        static std::map<const TA *, amx_q8_0_group *> cache;
+        static amx_q8_0_group *shared;
+        static bool fresh;
+        if (!ith) {
+            auto it = cache.find(A);
+            if (it != cache.end()) {
+                shared = it->second;
+                fresh = false;
+            } else {
+                shared = (amx_q8_0_group *)memalign(
+                    64, sizeof(amx_q8_0_group) * (m / 16) * k);
+                fresh = shared != nullptr;
+                if (shared)
+                    cache[A] = shared;
+            }
+        }
+        syncthreads(nth);
+        amx_q8_0_group *W = shared;
+        if (!W)
+            return nullptr;
+        if (fresh) {
+            long groups = m / 16 * k;
+            long duty = (groups + nth - 1) / nth;
+            long start = duty * ith;
+            long end = start + duty;
+            if (end > groups)
+                end = groups;
+            for (long g = start; g < end; ++g) {
+                long ii = g / k * 16;
+                long l = g % k;
+                amx_q8_0_group *p = W + g;
+                for (int i = 0; i < 16; ++i) {
+                    const signed char *q = (const signed char *)INDEX(A, lda, ii + i, l)->qs;
+                    for (int w = 0; w < 32; ++w)
+                        p->vnni[w >> 2][i * 4 + (w & 3)] = q[w];
+                    p->d[i] = unhalf(INDEX(A, lda, ii + i, l)->d);
+                }
+            }
+            syncthreads(nth);
+        }
+        return W;
+    }
+
+    NOINLINE void gemm_tile(const amx_q8_0_group *W, long ii, long jj) {
+        alignas(64) signed char vnni[8][64];
+        alignas(64) int dots[16][16];
+        alignas(64) float scales[16];
+        __m512 Cv[16] = {};
+        for (long l = 0; l < k; ++l) {
+
+            __m512 da;
+            if (W) {
+                const amx_q8_0_group *p = W + ii / 16 * k + l;
+                _tile_loadd(2, p->vnni, 64);
+                da = _mm512_load_ps(p->d);
+            } else {
+                for (int i = 0; i < 16; ++i) {
+                    const signed char *q = (const signed char *)INDEX(A, lda, ii + i, l)->qs;
+                    for (int w = 0; w < 32; ++w)
+                        vnni[w >> 2][i * 4 + (w & 3)] = q[w];
+                    scales[i] = unhalf(INDEX(A, lda, ii + i, l)->d);
+                }
+                _tile_loadd(2, vnni, 64);
+                da = _mm512_load_ps(scales);
+            }
+
+            _tile_loadd(1, INDEX(B, ldb, jj, l)->qs, ldb * sizeof(TB));
+            _tile_zero(0);
+            _tile_dpbssd(0, 1, 2);
+            _tile_stored(0, dots, 64);
+
+            for (int j = 0; j < 16; ++j) {
+                __m512 f = _mm512_cvtepi32_ps(_mm512_load_si512(dots[j]));
+                __m512 db = _mm512_set1_ps(unhalf(INDEX(B, ldb, jj + j, l)->d));
+                Cv[j] = _mm512_fmadd_ps(f, _mm512_mul_ps(da, db), Cv[j]);
+            }
+        }
+        alignas(64) float buf[16];
+        for (int j = 0; j < 16; ++j) {
+            _mm512_store_ps(buf, Cv[j]);
+            for (int i = 0; i < 16; ++i)
+                store(INDEX(C, ldc, jj + j, ii + i), buf[i]);
+        }
+    }
+
+    const TA *const A;
+    const TB *const B;
+    TC *const C;
+    const long k;
+    const long lda;
+    const long ldb;
+    const long ldc;
+    const int ith;
+    const int nth;
+};
+#endif // __AMX_INT8__
+
 } // namespace
@@ -0,0 +1,5 @@
+#ifdef __x86_64__
+#define llamafile_sgemm llamafile_sgemm_amd_amx
+#define iqk_mul_mat iqk_mul_mat_zen4
+#include "tinyblas_cpu_sgemm.inc"
+#endif // __x86_64__
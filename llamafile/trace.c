@@ -78,7 +78,7 @@ void llamafile_trace_set_tid(int tid) {
     g_tid = tid + 1;
 }
 
-void llamafile_trace_begin(const char *name) {
+void llamafile_trace_begin_cat(const char *name, const char *cat) {
     if (!FLAG_trace)
         return;
     if (g_ids < 2) {
@@ -89,29 +89,31 @@ void llamafile_trace_begin(const char *name) {
             return;
         }
     }
-    llamafile_trace_event(g_id++, name, "category", 'B');
+    llamafile_trace_event(g_id++, name, cat, 'B');
     --g_ids;
 }
 
-void llamafile_trace_end(const char *name) {
+void llamafile_trace_end_cat(const char *name, const char *cat) {
     if (!FLAG_trace)
         return;
     if (g_ids < 1)
         return;
-    llamafile_trace_event(g_id++, name, "category", 'E');
+    llamafile_trace_event(g_id++, name, cat, 'E');
     --g_ids;
 }
 
-static void llamafile_trace_save(const char *filename) {
+void llamafile_trace_begin(const char *name) {
+    llamafile_trace_begin_cat(name, "app");
+}
+
+void llamafile_trace_end(const char *name) {
+    llamafile_trace_end_cat(name, "app");
+}
+
+// writes everything recorded so far as a chrome trace event array,
+// which chrome://tracing/ and ui.perfetto.dev both load directly
+void llamafile_trace_dump(FILE *file) {
     int count = atomic_load_explicit(&g_count, memory_order_relaxed);
-    if (!count)
-        return;
-    tinylog("saving trace to ", filename, "...\n", NULL);
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        perror(filename);
-        return;
-    }
     fprintf(file, "[\n");
     bool once = false;
     for (int i = 0; i < count; i++) {
@@ -129,6 +131,18 @@ static void llamafile_trace_save(const char *filename) {
                 (g_events[i].ts - kStartTsc) / 3000., g_events[i].pid, g_events[i].tid);
     }
     fprintf(file, "\n]\n");
+}
+
+void llamafile_trace_save(const char *filename) {
+    if (!atomic_load_explicit(&g_count, memory_order_relaxed))
+        return;
+    tinylog("saving trace to ", filename, "...\n", NULL);
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror(filename);
+        return;
+    }
+    llamafile_trace_dump(file);
     fclose(file);
 }
 
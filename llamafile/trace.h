@@ -1,4 +1,5 @@
 #pragma once
+#include <stdio.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -7,7 +8,31 @@ void llamafile_trace_set_pid(int);
 void llamafile_trace_set_tid(int);
 void llamafile_trace_begin(const char *);
 void llamafile_trace_end(const char *);
+void llamafile_trace_begin_cat(const char *, const char *);
+void llamafile_trace_end_cat(const char *, const char *);
+void llamafile_trace_dump(FILE *);
+void llamafile_trace_save(const char *);
 
 #ifdef __cplusplus
 }
+
+// records a begin/end event pair bracketing the enclosing scope. the
+// name and category must be string literals, since the trace buffer
+// only stores their pointers
+struct llamafile_trace_span {
+    const char *name_;
+    const char *cat_;
+    llamafile_trace_span(const char *name, const char *cat) : name_(name), cat_(cat) {
+        llamafile_trace_begin_cat(name, cat);
+    }
+    ~llamafile_trace_span() {
+        llamafile_trace_end_cat(name_, cat_);
+    }
+};
+
+#define LLAMAFILE_TRACE_CAT_(a, b) a##b
+#define LLAMAFILE_TRACE_CAT(a, b) LLAMAFILE_TRACE_CAT_(a, b)
+#define LLAMAFILE_TRACE(name, cat) \
+    llamafile_trace_span LLAMAFILE_TRACE_CAT(llamafile_trace_span_, __LINE__)(name, cat)
+
 #endif
@@ -0,0 +1,162 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile.h"
+
+#include <cosmo.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "llama.cpp/cores.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/macros.h"
+
+struct Precision {
+    const char *name;
+    enum llama_ftype ftype;
+};
+
+static const Precision kPrecisions[] = {
+    {"Q2_K", LLAMA_FTYPE_MOSTLY_Q2_K},
+    {"Q3_K_S", LLAMA_FTYPE_MOSTLY_Q3_K_S},
+    {"Q3_K_M", LLAMA_FTYPE_MOSTLY_Q3_K_M},
+    {"Q3_K", LLAMA_FTYPE_MOSTLY_Q3_K_M},
+    {"Q3_K_L", LLAMA_FTYPE_MOSTLY_Q3_K_L},
+    {"Q4_0", LLAMA_FTYPE_MOSTLY_Q4_0},
+    {"Q4_1", LLAMA_FTYPE_MOSTLY_Q4_1},
+    {"Q4_K_S", LLAMA_FTYPE_MOSTLY_Q4_K_S},
+    {"Q4_K_M", LLAMA_FTYPE_MOSTLY_Q4_K_M},
+    {"Q4_K", LLAMA_FTYPE_MOSTLY_Q4_K_M},
+    {"Q5_0", LLAMA_FTYPE_MOSTLY_Q5_0},
+    {"Q5_1", LLAMA_FTYPE_MOSTLY_Q5_1},
+    {"Q5_K_S", LLAMA_FTYPE_MOSTLY_Q5_K_S},
+    {"Q5_K_M", LLAMA_FTYPE_MOSTLY_Q5_K_M},
+    {"Q5_K", LLAMA_FTYPE_MOSTLY_Q5_K_M},
+    {"Q6_K", LLAMA_FTYPE_MOSTLY_Q6_K},
+    {"Q8_0", LLAMA_FTYPE_MOSTLY_Q8_0},
+    {"F16", LLAMA_FTYPE_MOSTLY_F16},
+    {"BF16", LLAMA_FTYPE_MOSTLY_BF16},
+};
+
+static uint64_t fnv1a(const void *data, size_t size, uint64_t hash) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+/**
+ * Transcodes model weights to a different quantization format.
+ *
+ * This lets one distribution artifact serve machines with different
+ * memory budgets. The first boot with `--precision` pays for a full
+ * requantization pass, run across every core, and the result lands in
+ * the app directory keyed by a fingerprint of the source weights, so
+ * later boots mmap the cached artifact straight away.
+ *
+ * Returns path of weights the caller should load instead. Exits on
+ * unknown precision names and transcode failures, since silently
+ * serving the wrong quant would be worse.
+ */
+const char *llamafile_transcode_model(const char *path, const char *precision) {
+
+    // resolve requested quantization format
+    const Precision *prec = nullptr;
+    for (size_t i = 0; i < ARRAYLEN(kPrecisions); ++i)
+        if (!strcasecmp(precision, kPrecisions[i].name))
+            prec = &kPrecisions[i];
+    if (!prec) {
+        fprintf(stderr, "%s: unknown --precision value (try Q4_K_M)\n", precision);
+        exit(1);
+    }
+
+    // fingerprint the source weights. hashing many gigabytes on every
+    // boot would defeat the point of the cache, so the key covers the
+    // gguf header region (metadata, tensor names, shapes, and source
+    // quant types all live there) plus the exact file size, which is
+    // enough to tell apart any retrain or requant worth caching
+    // separately
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    static char buf[65536];
+    size_t got = fread(buf, 1, sizeof(buf), f);
+    struct stat st;
+    if (fstat(fileno(f), &st)) {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    uint64_t hash = 0xcbf29ce484222325;
+    hash = fnv1a(buf, got, hash);
+    hash = fnv1a(&st.st_size, sizeof(st.st_size), hash);
+    hash = fnv1a(&prec->ftype, sizeof(prec->ftype), hash);
+
+    // derive cache artifact path
+    char dir[PATH_MAX];
+    llamafile_get_app_dir(dir, sizeof(dir));
+    strlcat(dir, "weights/", sizeof(dir));
+    if (makedirs(dir, 0755)) {
+        perror(dir);
+        exit(1);
+    }
+    strlcpy(buf, path, sizeof(buf));
+    char *stem = basename(buf);
+    char *dot = strrchr(stem, '.');
+    if (dot && dot != stem)
+        *dot = 0;
+    char out[PATH_MAX];
+    snprintf(out, sizeof(out), "%s%s.%s.%016llx.gguf", dir, stem, prec->name,
+             (unsigned long long)hash);
+
+    // reuse cached transcode from an earlier boot
+    if (!access(out, R_OK))
+        return strdup(out);
+
+    // transcode into a temporary file that's renamed into place, so a
+    // crash or a second instance racing us can't leave a torn artifact
+    // where the next boot would mmap it
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", out, getpid());
+    llama_backend_init();
+    llama_model_quantize_params qparams = llama_model_quantize_default_params();
+    qparams.nthread = cpu_get_num_math();
+    qparams.ftype = prec->ftype;
+    qparams.allow_requantize = true;
+    fprintf(stderr, "%s: transcoding weights to %s (first boot only)...\n", path, prec->name);
+    if (llama_model_quantize(path, tmp, &qparams)) {
+        fprintf(stderr, "%s: failed to transcode weights\n", path);
+        unlink(tmp);
+        exit(1);
+    }
+    if (rename(tmp, out)) {
+        perror(out);
+        unlink(tmp);
+        exit(1);
+    }
+    fprintf(stderr, "%s: transcoded weights cached\n", out);
+    return strdup(out);
+}
@@ -20,6 +20,7 @@
 #include <vector>
 
 std::vector<cidr> FLAG_trust;
+std::vector<cidr_rate> FLAG_token_rate_overrides;
 
 bool is_trusted_ip(unsigned ip) noexcept {
     for (auto c : FLAG_trust)
@@ -29,7 +29,13 @@ struct cidr {
     }
 };
 
+struct cidr_rate {
+    cidr prefix;
+    double rate;
+};
+
 extern std::vector<cidr> FLAG_trust;
+extern std::vector<cidr_rate> FLAG_token_rate_overrides;
 
 bool is_trusted_ip(unsigned) noexcept;
 bool is_loopback_ip(unsigned) noexcept;
@@ -51,6 +51,42 @@ extern "C" void ggml_vec_silu_f32_amd_k8(const int n, float *y, const float *x);
 extern "C" void ggml_vec_silu_f32_arm82(const int n, float *y, const float *x);
 extern "C" void ggml_vec_silu_f32_arm80(const int n, float *y, const float *x);
 
+extern "C" void ggml_vec_tanh_f32_amd_avx512bf16(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_amd_avx512vl(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_amd_avx512(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_amd_avx2(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_amd_f16c(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_amd_fma(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_amd_avx(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_amd_ssse3(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_amd_k8(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_arm82(const int n, float *y, const float *x);
+extern "C" void ggml_vec_tanh_f32_arm80(const int n, float *y, const float *x);
+
+extern "C" void ggml_vec_sigmoid_f32_amd_avx512bf16(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_amd_avx512vl(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_amd_avx512(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_amd_avx2(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_amd_f16c(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_amd_fma(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_amd_avx(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_amd_ssse3(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_amd_k8(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_arm82(const int n, float *y, const float *x);
+extern "C" void ggml_vec_sigmoid_f32_arm80(const int n, float *y, const float *x);
+
+extern "C" void ggml_vec_gelu_quick_f32_amd_avx512bf16(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_amd_avx512vl(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_amd_avx512(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_amd_avx2(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_amd_f16c(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_amd_fma(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_amd_avx(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_amd_ssse3(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_amd_k8(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_arm82(const int n, float *y, const float *x);
+extern "C" void ggml_vec_gelu_quick_f32_arm80(const int n, float *y, const float *x);
+
 #define N 256
 
 float mathf(void vmathf(int, float *, const float *), float x) {
@@ -112,6 +148,9 @@ int main(int argc, char *argv[]) {
 
     test_vmathf(ggml_vec_gelu_f32);
     test_vmathf(ggml_vec_silu_f32);
+    test_vmathf(ggml_vec_tanh_f32);
+    test_vmathf(ggml_vec_sigmoid_f32);
+    test_vmathf(ggml_vec_gelu_quick_f32);
 
 #ifdef __x86_64__
 
@@ -119,56 +158,89 @@ int main(int argc, char *argv[]) {
         X86_HAVE(AVX512BW) && X86_HAVE(AVX512DQ) && X86_HAVE(AVX512VL) && X86_HAVE(AVX512_BF16)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx512bf16);
         test_vmathf(ggml_vec_silu_f32_amd_avx512bf16);
+        test_vmathf(ggml_vec_tanh_f32_amd_avx512bf16);
+        test_vmathf(ggml_vec_sigmoid_f32_amd_avx512bf16);
+        test_vmathf(ggml_vec_gelu_quick_f32_amd_avx512bf16);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2) && X86_HAVE(AVX512F) &&
         X86_HAVE(AVX512BW) && X86_HAVE(AVX512DQ) && X86_HAVE(AVX512VL)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx512vl);
         test_vmathf(ggml_vec_silu_f32_amd_avx512vl);
+        test_vmathf(ggml_vec_tanh_f32_amd_avx512vl);
+        test_vmathf(ggml_vec_sigmoid_f32_amd_avx512vl);
+        test_vmathf(ggml_vec_gelu_quick_f32_amd_avx512vl);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2) && X86_HAVE(AVX512F)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx512);
         test_vmathf(ggml_vec_silu_f32_amd_avx512);
+        test_vmathf(ggml_vec_tanh_f32_amd_avx512);
+        test_vmathf(ggml_vec_sigmoid_f32_amd_avx512);
+        test_vmathf(ggml_vec_gelu_quick_f32_amd_avx512);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx2);
         test_vmathf(ggml_vec_silu_f32_amd_avx2);
+        test_vmathf(ggml_vec_tanh_f32_amd_avx2);
+        test_vmathf(ggml_vec_sigmoid_f32_amd_avx2);
+        test_vmathf(ggml_vec_gelu_quick_f32_amd_avx2);
     }
 
     if (X86_HAVE(AVX) && X86_HAVE(F16C)) {
         test_vmathf(ggml_vec_gelu_f32_amd_f16c);
         test_vmathf(ggml_vec_silu_f32_amd_f16c);
+        test_vmathf(ggml_vec_tanh_f32_amd_f16c);
+        test_vmathf(ggml_vec_sigmoid_f32_amd_f16c);
+        test_vmathf(ggml_vec_gelu_quick_f32_amd_f16c);
     }
 
     if (X86_HAVE(AVX) && X86_HAVE(FMA)) {
         test_vmathf(ggml_vec_gelu_f32_amd_fma);
         test_vmathf(ggml_vec_silu_f32_amd_fma);
+        test_vmathf(ggml_vec_tanh_f32_amd_fma);
+        test_vmathf(ggml_vec_sigmoid_f32_amd_fma);
+        test_vmathf(ggml_vec_gelu_quick_f32_amd_fma);
     }
 
     if (X86_HAVE(AVX)) {
         test_vmathf(ggml_vec_gelu_f32_amd_avx);
         test_vmathf(ggml_vec_silu_f32_amd_avx);
+        test_vmathf(ggml_vec_tanh_f32_amd_avx);
+        test_vmathf(ggml_vec_sigmoid_f32_amd_avx);
+        test_vmathf(ggml_vec_gelu_quick_f32_amd_avx);
     }
 
     if (X86_HAVE(SSSE3)) {
         test_vmathf(ggml_vec_gelu_f32_amd_ssse3);
         test_vmathf(ggml_vec_silu_f32_amd_ssse3);
+        test_vmathf(ggml_vec_tanh_f32_amd_ssse3);
+        test_vmathf(ggml_vec_sigmoid_f32_amd_ssse3);
+        test_vmathf(ggml_vec_gelu_quick_f32_amd_ssse3);
     }
 
     test_vmathf(ggml_vec_gelu_f32_amd_k8);
     test_vmathf(ggml_vec_silu_f32_amd_k8);
+    test_vmathf(ggml_vec_tanh_f32_amd_k8);
+    test_vmathf(ggml_vec_sigmoid_f32_amd_k8);
+    test_vmathf(ggml_vec_gelu_quick_f32_amd_k8);
 
 #elif defined(__aarch64__)
 
     if ((getauxval(AT_HWCAP) & HWCAP_FPHP) && (getauxval(AT_HWCAP) & HWCAP_ASIMDHP)) {
         test_vmathf(ggml_vec_gelu_f32_arm82);
         test_vmathf(ggml_vec_silu_f32_arm82);
+        test_vmathf(ggml_vec_tanh_f32_arm82);
+        test_vmathf(ggml_vec_sigmoid_f32_arm82);
+        test_vmathf(ggml_vec_gelu_quick_f32_arm82);
     }
 
     test_vmathf(ggml_vec_gelu_f32_arm80);
     test_vmathf(ggml_vec_silu_f32_arm80);
+    test_vmathf(ggml_vec_tanh_f32_arm80);
+    test_vmathf(ggml_vec_sigmoid_f32_arm80);
+    test_vmathf(ggml_vec_gelu_quick_f32_arm80);
 
 #endif
 
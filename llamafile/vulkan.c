@@ -0,0 +1,370 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llama.cpp/ggml-backend-impl.h"
+#include "llama.cpp/ggml-vulkan.h"
+#include "llamafile.h"
+#include "log.h"
+#include <assert.h>
+#include <cosmo.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+__static_yoink("llama.cpp/ggml.h");
+__static_yoink("llamafile/llamafile.h");
+__static_yoink("llama.cpp/ggml-impl.h");
+__static_yoink("llama.cpp/ggml-alloc.h");
+__static_yoink("llama.cpp/ggml-common.h");
+__static_yoink("llama.cpp/ggml-quants.h");
+__static_yoink("llama.cpp/ggml-backend.h");
+__static_yoink("llama.cpp/ggml-vulkan.h");
+__static_yoink("llama.cpp/ggml-vulkan.cpp");
+__static_yoink("llama.cpp/ggml-backend-impl.h");
+__static_yoink("llama.cpp/ggml-vulkan-shaders.hpp");
+
+static const struct Source {
+    const char *zip;
+    const char *name;
+} srcs[] = {
+    {"/zip/llama.cpp/ggml.h", "ggml.h"},
+    {"/zip/llamafile/llamafile.h", "llamafile.h"},
+    {"/zip/llama.cpp/ggml-impl.h", "ggml-impl.h"},
+    {"/zip/llama.cpp/ggml-alloc.h", "ggml-alloc.h"},
+    {"/zip/llama.cpp/ggml-common.h", "ggml-common.h"},
+    {"/zip/llama.cpp/ggml-quants.h", "ggml-quants.h"},
+    {"/zip/llama.cpp/ggml-vulkan.h", "ggml-vulkan.h"},
+    {"/zip/llama.cpp/ggml-backend.h", "ggml-backend.h"},
+    {"/zip/llama.cpp/ggml-backend-impl.h", "ggml-backend-impl.h"},
+    {"/zip/llama.cpp/ggml-vulkan-shaders.hpp", "ggml-vulkan-shaders.hpp"},
+    {"/zip/llama.cpp/ggml-vulkan.cpp", "ggml-vulkan.cpp"}, // must come last
+};
+
+static struct Vulkan {
+    bool supported;
+    atomic_uint once;
+    typeof(ggml_vk_link) *link;
+    typeof(ggml_backend_vk_init) *GGML_CALL backend_init;
+    typeof(ggml_backend_is_vk) *GGML_CALL backend_is_vk;
+    typeof(ggml_backend_vk_buffer_type) *GGML_CALL buffer_type;
+    typeof(ggml_backend_vk_host_buffer_type) *GGML_CALL host_buffer_type;
+    typeof(ggml_backend_vk_get_device_count) *GGML_CALL get_device_count;
+    typeof(ggml_backend_vk_get_device_memory) *GGML_CALL get_device_memory;
+    typeof(ggml_backend_vk_get_device_description) *GGML_CALL get_description;
+} ggml_vk;
+
+static const char *Dlerror(void) {
+    const char *msg;
+    msg = cosmo_dlerror();
+    if (!msg)
+        msg = "null dlopen error";
+    return msg;
+}
+
+static const char *GetDsoExtension(void) {
+    if (IsWindows())
+        return "dll";
+    else if (IsXnu())
+        return "dylib";
+    else
+        return "so";
+}
+
+static bool FileExists(const char *path) {
+    struct stat st;
+    return !stat(path, &st);
+}
+
+static bool ExtractVulkanDso(const char *dso) {
+
+    // see if prebuilt dso is bundled in zip assets. this is the only
+    // path that works on windows machines without a c++ compiler, so
+    // distributors targeting amd/intel desktops should bundle one
+    char zip[80];
+    strlcpy(zip, "/zip/ggml-vulkan.", sizeof(zip));
+    strlcat(zip, GetDsoExtension(), sizeof(zip));
+    if (!FileExists(zip)) {
+        tinylog(__func__, ": note: prebuilt binary ", zip, " not found\n", NULL);
+        return false;
+    }
+    return llamafile_extract(zip, dso);
+}
+
+static bool BuildVulkan(const char *dso) {
+
+    // extract source code
+    char src[PATH_MAX];
+    bool needs_rebuild = FLAG_recompile;
+    for (int i = 0; i < sizeof(srcs) / sizeof(*srcs); ++i) {
+        llamafile_get_app_dir(src, PATH_MAX);
+        if (!i && makedirs(src, 0755)) {
+            perror(src);
+            return false;
+        }
+        strlcat(src, srcs[i].name, sizeof(src));
+        switch (llamafile_is_file_newer_than(srcs[i].zip, src)) {
+        case -1:
+            return false;
+        case 0:
+            break;
+        case 1:
+            needs_rebuild = true;
+            if (!llamafile_extract(srcs[i].zip, src)) {
+                return false;
+            }
+            break;
+        default:
+            __builtin_unreachable();
+        }
+    }
+
+    // determine if we need to build
+    if (!needs_rebuild) {
+        switch (llamafile_is_file_newer_than(src, dso)) {
+        case -1:
+            return false;
+        case 0:
+            break;
+        case 1:
+            needs_rebuild = true;
+            break;
+        default:
+            __builtin_unreachable();
+        }
+    }
+
+    // compile dynamic shared object. the spir-v shaders are already
+    // baked into ggml-vulkan-shaders.hpp so the host c++ compiler and
+    // the vulkan loader library are the only dependencies
+    if (needs_rebuild || FLAG_recompile) {
+        tinylog("building ggml-vulkan with host c++ compiler...\n", NULL);
+        int fd;
+        char tmpdso[PATH_MAX];
+        strlcpy(tmpdso, dso, sizeof(tmpdso));
+        strlcat(tmpdso, ".XXXXXX", sizeof(tmpdso));
+        if ((fd = mkostemp(tmpdso, O_CLOEXEC)) != -1) {
+            close(fd);
+        } else {
+            perror(tmpdso);
+            return false;
+        }
+        char *args[] = {
+            "c++",
+            "-I.",
+            "-O2",
+            "-fPIC",
+            "-shared",
+            "-pthread",
+            "-DNDEBUG",
+            "-std=c++17",
+            "-march=native",
+            "-mtune=native",
+            "-DGGML_BUILD=1",
+            "-DGGML_SHARED=1",
+            "-DGGML_USE_VULKAN",
+            "-DGGML_MULTIPLATFORM",
+            "-Wno-return-type",
+            "-Wno-unused-result",
+            "-Wno-unused-function",
+            !IsAarch64() ? "-DIGNORE0" : "-ffixed-x28", // cosmo's tls register
+            src,
+            "-o",
+            tmpdso,
+            "-lvulkan",
+            NULL,
+        };
+        int pid, ws;
+        llamafile_log_command(args);
+        errno_t err = posix_spawnp(&pid, "c++", NULL, NULL, args, environ);
+        if (err) {
+            perror("c++");
+            unlink(tmpdso);
+            return false;
+        }
+        while (waitpid(pid, &ws, 0) == -1) {
+            if (errno != EINTR) {
+                perror("c++");
+                unlink(tmpdso);
+                return false;
+            }
+        }
+        if (ws) {
+            tinylog("compiler returned nonzero exit status\n", NULL);
+            unlink(tmpdso);
+            return false;
+        }
+        if (rename(tmpdso, dso)) {
+            perror(dso);
+            unlink(tmpdso);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool LinkVulkan(const char *dso) {
+
+    // runtime link dynamic shared object
+    void *lib;
+    tinylog(__func__, ": note: dynamically linking ", dso, "\n", NULL);
+    lib = cosmo_dlopen(dso, RTLD_LAZY);
+    if (!lib) {
+        tinylog(Dlerror(), ": failed to load library\n", NULL);
+        return false;
+    }
+
+    // import functions
+    bool ok = true;
+    ok &= !!(ggml_vk.link = cosmo_dlsym(lib, "ggml_vk_link"));
+    ok &= !!(ggml_vk.backend_init = cosmo_dlsym(lib, "ggml_backend_vk_init"));
+    ok &= !!(ggml_vk.backend_is_vk = cosmo_dlsym(lib, "ggml_backend_is_vk"));
+    ok &= !!(ggml_vk.buffer_type = cosmo_dlsym(lib, "ggml_backend_vk_buffer_type"));
+    ok &= !!(ggml_vk.host_buffer_type = cosmo_dlsym(lib, "ggml_backend_vk_host_buffer_type"));
+    ok &= !!(ggml_vk.get_device_count = cosmo_dlsym(lib, "ggml_backend_vk_get_device_count"));
+    ok &= !!(ggml_vk.get_device_memory = cosmo_dlsym(lib, "ggml_backend_vk_get_device_memory"));
+    ok &= !!(ggml_vk.get_description = cosmo_dlsym(lib, "ggml_backend_vk_get_device_description"));
+    if (!ok) {
+        tinylog(Dlerror(), ": not all vulkan symbols could be imported\n", NULL);
+        cosmo_dlclose(lib);
+        return false;
+    }
+
+    // ask the library if actual gpu devices exist
+    if (ggml_vk.link(ggml_backend_api())) {
+        tinylog(__func__, ": Vulkan GPU support loaded\n", NULL);
+        return true;
+    } else {
+        tinylog(__func__, ": No Vulkan devices found\n", NULL);
+        cosmo_dlclose(lib);
+        return false;
+    }
+}
+
+static bool ImportVulkanImpl(void) {
+
+    // No dynamic linking support on OpenBSD yet.
+    if (IsOpenbsd())
+        return false;
+
+    // Check if we're allowed to even try.
+    switch (FLAG_gpu) {
+    case LLAMAFILE_GPU_AUTO:
+    case LLAMAFILE_GPU_VULKAN:
+        break;
+    default:
+        return false;
+    }
+
+    // In auto mode vulkan is the fallback for gpus the cuda module
+    // can't drive, e.g. amd/intel cards on machines without rocm.
+    if (FLAG_gpu == LLAMAFILE_GPU_AUTO && llamafile_has_cuda())
+        return false;
+
+    npassert(FLAGS_READY);
+
+    // Get path of DSO.
+    char dso[PATH_MAX];
+    llamafile_get_app_dir(dso, PATH_MAX);
+    strlcat(dso, "ggml-vulkan.", sizeof(dso));
+    strlcat(dso, GetDsoExtension(), sizeof(dso));
+    if (FLAG_nocompile || !FLAG_recompile) {
+        if ((FileExists(dso) || ExtractVulkanDso(dso)) && LinkVulkan(dso))
+            return true;
+        else if (FLAG_nocompile)
+            return false;
+    }
+
+    // Try building Vulkan support from source.
+    if (BuildVulkan(dso))
+        return LinkVulkan(dso);
+
+    // Try extracting prebuilt DSO from PKZIP.
+    if (ExtractVulkanDso(dso))
+        return LinkVulkan(dso);
+
+    // too bad
+    return false;
+}
+
+static void ImportVulkan(void) {
+    if (llamafile_has_metal())
+        return;
+    if (ImportVulkanImpl()) {
+        ggml_vk.supported = true;
+    } else if (FLAG_gpu == LLAMAFILE_GPU_VULKAN) {
+        tinyprint(2, "fatal error: support for --gpu ", llamafile_describe_gpu(),
+                  " was explicitly requested, but it wasn't available\n", NULL);
+        exit(1);
+    }
+}
+
+bool llamafile_has_vulkan(void) {
+    cosmo_once(&ggml_vk.once, ImportVulkan);
+    return ggml_vk.supported;
+}
+
+GGML_CALL ggml_backend_t ggml_backend_vk_init(size_t dev_num) {
+    if (!llamafile_has_vulkan())
+        return 0;
+    return ggml_vk.backend_init(dev_num);
+}
+
+GGML_CALL bool ggml_backend_is_vk(ggml_backend_t backend) {
+    if (!llamafile_has_vulkan())
+        return false;
+    return ggml_vk.backend_is_vk(backend);
+}
+
+GGML_CALL ggml_backend_buffer_type_t ggml_backend_vk_buffer_type(size_t dev_num) {
+    if (!llamafile_has_vulkan())
+        return 0;
+    return ggml_vk.buffer_type(dev_num);
+}
+
+GGML_CALL ggml_backend_buffer_type_t ggml_backend_vk_host_buffer_type(void) {
+    if (!llamafile_has_vulkan())
+        return 0;
+    return ggml_vk.host_buffer_type();
+}
+
+GGML_CALL int ggml_backend_vk_get_device_count(void) {
+    if (!llamafile_has_vulkan())
+        return 0;
+    return ggml_vk.get_device_count();
+}
+
+GGML_CALL void ggml_backend_vk_get_device_memory(int device, size_t *free, size_t *total) {
+    if (!llamafile_has_vulkan())
+        return;
+    return ggml_vk.get_device_memory(device, free, total);
+}
+
+GGML_CALL void ggml_backend_vk_get_device_description(int device, char *description,
+                                                      size_t description_size) {
+    if (!llamafile_has_vulkan())
+        return;
+    return ggml_vk.get_description(device, description, description_size);
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+
+TMP=$(mktemp -d) || exit
+
+cp llama.cpp/ggml-vulkan.cpp \
+   llama.cpp/ggml-vulkan.h \
+   llama.cpp/ggml-vulkan-shaders.hpp \
+   llama.cpp/ggml-impl.h \
+   llama.cpp/ggml-alloc.h \
+   llama.cpp/ggml-common.h \
+   llama.cpp/ggml-quants.h \
+   llama.cpp/ggml-backend.h \
+   llama.cpp/ggml-backend-impl.h \
+   llama.cpp/ggml.h \
+   llamafile/llamafile.h \
+   llamafile/vulkan.sh \
+   "$TMP" || exit
+
+cd "$TMP"
+
+c++ \
+  -I. \
+  -O2 \
+  -fPIC \
+  -shared \
+  -pthread \
+  -DNDEBUG \
+  -std=c++17 \
+  -DGGML_BUILD=1 \
+  -DGGML_SHARED=1 \
+  -DGGML_USE_VULKAN \
+  -DGGML_MULTIPLATFORM \
+  -o ~/ggml-vulkan.so \
+  ggml-vulkan.cpp \
+  -lvulkan
@@ -0,0 +1,125 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "weightcache.h"
+#include "llamafile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// content-addressed weight sharing across processes
+//
+// several server processes running different llamafiles of the same
+// base model each map their own copy of the weights, because the page
+// cache keys on the inode and the archives are distinct files even
+// when the tensor bytes inside are identical. so when --weight-cache
+// names a directory, weights get mapped from a file in it named after
+// the digest zipalign stamped into the archive. every process whose
+// archive carries the same digest maps the same inode, and the kernel
+// backs them all with one set of physical pages. the first process to
+// want a digest pays one streaming copy to create the cache entry;
+// on filesystems with reflink that copy shares extents with nothing
+// and costs almost nothing. failure of any kind just means the caller
+// falls back to mapping its own archive like before.
+
+// copies the weight span out of the archive into the cache file. a
+// temporary name plus rename makes concurrent loaders racing on the
+// same digest converge on one complete file, never a partial one
+static int fill_cache_file(const char *dir, const char *path, int zfd, off_t off, size_t size) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/%s.tmp.%d", dir, path + strlen(dir) + 1, getpid());
+    int fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1)
+        return -1;
+    off_t in = off;
+    off_t out = 0;
+    while (size) {
+        ssize_t rc = copy_file_range(zfd, &in, fd, &out, size, 0);
+        if (rc <= 0) {
+            // filesystems and kernels without copy_file_range get a
+            // plain read/write loop at the same offsets
+            char buf[65536];
+            if ((rc = pread(zfd, buf, size < sizeof(buf) ? size : sizeof(buf), in)) <= 0) {
+                close(fd);
+                unlink(tmp);
+                return -1;
+            }
+            if (pwrite(fd, buf, rc, out) != rc) {
+                close(fd);
+                unlink(tmp);
+                return -1;
+            }
+            in += rc;
+            out += rc;
+        }
+        size -= rc;
+    }
+    if (close(fd)) {
+        unlink(tmp);
+        return -1;
+    }
+    if (rename(tmp, path)) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// returns a shared read-only mapping of the weights whose digest is
+// `digest`, which span `size` bytes at `off` in the archive open on
+// `zfd`, or MAP_FAILED if the cache can't serve them. the cache file
+// starts at offset zero, so the mapping satisfies the 16kb alignment
+// apple metal wants without any skew
+void *llamafile_weight_cache_map(const uint8_t digest[32], int zfd, off_t off, size_t size) {
+    if (!FLAG_weight_cache)
+        return MAP_FAILED;
+
+    char path[PATH_MAX];
+    char hex[65];
+    for (int i = 0; i < 32; ++i)
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    snprintf(path, sizeof(path), "%s/%s.weights", FLAG_weight_cache, hex);
+
+    for (int tries = 0; tries < 2; ++tries) {
+        int fd = open(path, O_RDONLY);
+        if (fd != -1) {
+            struct stat st;
+            if (fstat(fd, &st) || (size_t)st.st_size != size) {
+                // truncated or stale entry, e.g. a digest collision
+                // with an older format. don't trust it
+                close(fd);
+                return MAP_FAILED;
+            }
+            void *map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            return map;
+        }
+        if (errno != ENOENT)
+            return MAP_FAILED;
+        if (fill_cache_file(FLAG_weight_cache, path, zfd, off, size)) {
+            fprintf(stderr, "warning: %s: could not populate weight cache: %s\n", path,
+                    strerror(errno));
+            return MAP_FAILED;
+        }
+    }
+    return MAP_FAILED;
+}
@@ -0,0 +1,15 @@
+#ifndef LLAMAFILE_WEIGHTCACHE_H_
+#define LLAMAFILE_WEIGHTCACHE_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *llamafile_weight_cache_map(const uint8_t[32], int, off_t, size_t);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LLAMAFILE_WEIGHTCACHE_H_ */
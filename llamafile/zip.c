@@ -17,6 +17,7 @@
 
 #include "zip.h"
 #include <stdint.h>
+#include <string.h>
 
 int64_t get_zip_cfile_uncompressed_size(const uint8_t *z) {
     if (ZIP_CFILE_UNCOMPRESSEDSIZE(z) != 0xFFFFFFFFu)
@@ -63,3 +64,17 @@ int64_t get_zip_cfile_offset(const uint8_t *z) {
         }
     return -1;
 }
+
+// returns nonzero and fills `digest` when the central directory entry
+// carries the content digest zipalign stamps onto stored gguf assets
+int get_zip_cfile_sha256(const uint8_t *z, uint8_t digest[32]) {
+    const uint8_t *p = ZIP_CFILE_EXTRA(z);
+    const uint8_t *pe = p + ZIP_CFILE_EXTRASIZE(z);
+    for (; p + ZIP_EXTRA_SIZE(p) <= pe; p += ZIP_EXTRA_SIZE(p))
+        if (ZIP_EXTRA_HEADERID(p) == kZipExtraLlamafileSha256)
+            if (ZIP_EXTRA_CONTENTSIZE(p) == 32) {
+                memcpy(digest, ZIP_EXTRA_CONTENT(p), 32);
+                return 1;
+            }
+    return 0;
+}
@@ -116,6 +116,7 @@
 #define kZipExtraUnix 0x000d
 #define kZipExtraExtendedTimestamp 0x5455
 #define kZipExtraInfoZipNewUnixExtra 0x7875
+#define kZipExtraLlamafileSha256 0x464c /* "LF": content digest of stored weights */
 
 #define kZipCfileMagic "PK\001\002"
 
@@ -259,5 +260,7 @@
 
 int64_t get_zip_cfile_offset(const uint8_t *);
 int64_t get_zip_cfile_compressed_size(const uint8_t *);
+int64_t get_zip_cfile_uncompressed_size(const uint8_t *);
+int get_zip_cfile_sha256(const uint8_t *, uint8_t[32]);
 
 #endif /* COSMO_ZIP_ */
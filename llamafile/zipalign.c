@@ -15,7 +15,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "crc32.h"
 #include "llamafile.h"
+#include "pool.h"
+#include "sha256.h"
 #include "zip.h"
 
 #include <assert.h>
@@ -23,6 +26,7 @@
 #include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -44,6 +48,7 @@
 
 static const char *prog;
 static int flag_junk;
+static int flag_sort;
 static int flag_level;
 static int flag_verbose;
 static int flag_alignment = 65536;
@@ -97,6 +102,467 @@ static int NormalizeMode(int mode) {
     return res | 0644;
 }
 
+static bool IsGguf(const char *name) {
+    size_t n = strlen(name);
+    return n > 5 && !strcmp(name + n - 5, ".gguf");
+}
+
+// gguf metadata sidecar
+//
+// inspecting a model means walking the gguf key-value section, which
+// on a big file drags in megabytes of tokenizer vocab before the keys
+// anyone cares about. so every gguf input also gets a small stored
+// json entry named <asset>.meta.json holding the scalar metadata, the
+// chat template, the tensor table, and a quant type histogram. tools
+// listing a dozen models can then read a few kilobytes per archive
+// instead of churning the page cache through the weights.
+
+struct Buf {
+    char *p;
+    size_t i;
+    size_t n;
+};
+
+static void BufCat(struct Buf *b, const char *s, size_t n) {
+    if (b->i + n + 1 > b->n) {
+        b->n = (b->i + n + 1) * 2;
+        b->p = Realloc(b->p, b->n);
+    }
+    memcpy(b->p + b->i, s, n);
+    b->i += n;
+    b->p[b->i] = 0;
+}
+
+static void BufStr(struct Buf *b, const char *s) {
+    BufCat(b, s, strlen(s));
+}
+
+static void BufFmt(struct Buf *b, const char *fmt, ...) {
+    char tmp[128];
+    va_list va;
+    va_start(va, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, va);
+    va_end(va);
+    BufCat(b, tmp, n);
+}
+
+static void BufJsonStr(struct Buf *b, const char *s, size_t n) {
+    BufCat(b, "\"", 1);
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char)c};
+            BufCat(b, esc, 2);
+        } else if (c == '\n') {
+            BufStr(b, "\\n");
+        } else if (c == '\r') {
+            BufStr(b, "\\r");
+        } else if (c == '\t') {
+            BufStr(b, "\\t");
+        } else if (c < 0x20) {
+            BufFmt(b, "\\u%04x", c);
+        } else {
+            BufCat(b, (const char *)s + i, 1);
+        }
+    }
+    BufCat(b, "\"", 1);
+}
+
+static const char *const kGgmlTypeNames[] = {
+    "f32",     "f16",    "q4_0",   "q4_1",    "q4_2",  "q4_3",   "q5_0",
+    "q5_1",    "q8_0",   "q8_1",   "q2_k",    "q3_k",  "q4_k",   "q5_k",
+    "q6_k",    "q8_k",   "iq2_xxs", "iq2_xs", "iq3_xxs", "iq1_s", "iq4_nl",
+    "iq3_s",   "iq2_s",  "iq4_xs", "i8",      "i16",   "i32",    "i64",
+    "f64",     "iq1_m",  "bf16",
+};
+
+#define GGML_TYPE_COUNT (sizeof(kGgmlTypeNames) / sizeof(*kGgmlTypeNames))
+
+static const char *GgmlTypeName(uint32_t type, char tmp[32]) {
+    if (type < GGML_TYPE_COUNT)
+        return kGgmlTypeNames[type];
+    snprintf(tmp, 32, "type%u", type);
+    return tmp;
+}
+
+// gguf value types; 9 is array and 8 is string, everything else is a
+// fixed width scalar whose size is tabulated here
+static const int8_t kGgufScalarSize[13] = {1, 1, 2, 2, 4, 4, 4, 1, -1, -1, 8, 8, 8};
+
+struct GgufReader {
+    int fd;
+    uint64_t off;
+};
+
+static bool GgufRead(struct GgufReader *r, void *buf, uint64_t n) {
+    if (n > INT_MAX)
+        return false;
+    if (pread(r->fd, buf, n, r->off) != (ssize_t)n)
+        return false;
+    r->off += n;
+    return true;
+}
+
+static bool GgufU32(struct GgufReader *r, uint32_t *x) {
+    return GgufRead(r, x, 4);
+}
+
+static bool GgufU64(struct GgufReader *r, uint64_t *x) {
+    return GgufRead(r, x, 8);
+}
+
+static bool GgufString(struct GgufReader *r, char **out, uint64_t *out_len, uint64_t max) {
+    uint64_t len;
+    if (!GgufU64(r, &len) || len > max)
+        return false;
+    char *s = Malloc(len + 1);
+    if (!GgufRead(r, s, len)) {
+        free(s);
+        return false;
+    }
+    s[len] = 0;
+    *out = s;
+    *out_len = len;
+    return true;
+}
+
+// seeks past a value without reading it. arrays of strings have to be
+// walked length by length, since their extent isn't recorded anywhere
+static bool GgufSkipValue(struct GgufReader *r, uint32_t type) {
+    uint64_t len;
+    if (type == 8) {
+        if (!GgufU64(r, &len) || len > (1ull << 40))
+            return false;
+        r->off += len;
+        return true;
+    }
+    if (type == 9) {
+        uint32_t etype;
+        uint64_t count;
+        if (!GgufU32(r, &etype) || !GgufU64(r, &count) || count > (1ull << 32))
+            return false;
+        if (etype == 8) {
+            while (count--) {
+                if (!GgufU64(r, &len) || len > (1ull << 40))
+                    return false;
+                r->off += len;
+            }
+            return true;
+        }
+        if (etype < 13 && kGgufScalarSize[etype] > 0) {
+            r->off += count * kGgufScalarSize[etype];
+            return true;
+        }
+        return false;
+    }
+    if (type < 13 && kGgufScalarSize[type] > 0) {
+        r->off += kGgufScalarSize[type];
+        return true;
+    }
+    return false;
+}
+
+static bool GgufEmitScalar(struct GgufReader *r, struct Buf *b, uint32_t type) {
+    union {
+        uint8_t u8;
+        int8_t i8;
+        uint16_t u16;
+        int16_t i16;
+        uint32_t u32;
+        int32_t i32;
+        float f32;
+        uint64_t u64;
+        int64_t i64;
+        double f64;
+    } v;
+    if (type >= 13 || kGgufScalarSize[type] < 0)
+        return false;
+    if (!GgufRead(r, &v, kGgufScalarSize[type]))
+        return false;
+    switch (type) {
+    case 0:
+        BufFmt(b, "%u", v.u8);
+        return true;
+    case 1:
+        BufFmt(b, "%d", v.i8);
+        return true;
+    case 2:
+        BufFmt(b, "%u", v.u16);
+        return true;
+    case 3:
+        BufFmt(b, "%d", v.i16);
+        return true;
+    case 4:
+        BufFmt(b, "%u", v.u32);
+        return true;
+    case 5:
+        BufFmt(b, "%d", v.i32);
+        return true;
+    case 6:
+        BufFmt(b, "%g", v.f32);
+        return true;
+    case 7:
+        BufStr(b, v.u8 ? "true" : "false");
+        return true;
+    case 10:
+        BufFmt(b, "%llu", (unsigned long long)v.u64);
+        return true;
+    case 11:
+        BufFmt(b, "%lld", (long long)v.i64);
+        return true;
+    case 12:
+        BufFmt(b, "%g", v.f64);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// builds the json sidecar for a gguf file, or returns NULL if the
+// file doesn't parse as gguf, in which case no sidecar gets emitted.
+// arrays (i.e. the vocab) are skipped over, and strings longer than
+// 64kb (embedded tokenizer configs) are dropped, which still leaves
+// the chat template and every scalar hyperparameter
+static char *MakeGgufMeta(int fd, size_t *out_size) {
+    struct GgufReader r = {fd, 0};
+    uint32_t magic, version;
+    uint64_t ntensors, nkv;
+    if (!GgufU32(&r, &magic) || magic != 0x46554747u)
+        return NULL;
+    if (!GgufU32(&r, &version) || version < 2 || version > 3)
+        return NULL;
+    if (!GgufU64(&r, &ntensors) || ntensors > (1 << 20))
+        return NULL;
+    if (!GgufU64(&r, &nkv) || nkv > (1 << 20))
+        return NULL;
+    struct Buf b = {0};
+    BufFmt(&b, "{\n \"version\": %u,\n \"tensor_count\": %llu,\n \"metadata\": {", version,
+           (unsigned long long)ntensors);
+    int kept = 0;
+    for (uint64_t k = 0; k < nkv; ++k) {
+        char *key;
+        uint32_t type;
+        uint64_t keylen;
+        if (!GgufString(&r, &key, &keylen, 1024))
+            goto Fail;
+        if (!GgufU32(&r, &type)) {
+            free(key);
+            goto Fail;
+        }
+        if (type == 9) {
+            bool ok = GgufSkipValue(&r, type);
+            free(key);
+            if (!ok)
+                goto Fail;
+            continue;
+        }
+        if (type == 8) {
+            char *val;
+            uint64_t vallen;
+            if (!GgufU64(&r, &vallen) || vallen > (1ull << 40)) {
+                free(key);
+                goto Fail;
+            }
+            if (vallen > 65536) {
+                r.off += vallen;
+                free(key);
+                continue;
+            }
+            val = Malloc(vallen + 1);
+            if (!GgufRead(&r, val, vallen)) {
+                free(val);
+                free(key);
+                goto Fail;
+            }
+            if (kept++)
+                BufStr(&b, ",");
+            BufStr(&b, "\n  ");
+            BufJsonStr(&b, key, keylen);
+            BufStr(&b, ": ");
+            BufJsonStr(&b, val, vallen);
+            free(val);
+            free(key);
+            continue;
+        }
+        if (kept++)
+            BufStr(&b, ",");
+        BufStr(&b, "\n  ");
+        BufJsonStr(&b, key, keylen);
+        BufStr(&b, ": ");
+        if (!GgufEmitScalar(&r, &b, type)) {
+            free(key);
+            goto Fail;
+        }
+        free(key);
+    }
+    BufStr(&b, "\n },\n \"tensors\": [");
+    uint64_t counts[GGML_TYPE_COUNT + 1] = {0};
+    for (uint64_t t = 0; t < ntensors; ++t) {
+        char tmp[32];
+        char *tname;
+        uint32_t ndims, ttype;
+        uint64_t tlen, toffset, dims[8];
+        if (!GgufString(&r, &tname, &tlen, 1024))
+            goto Fail;
+        if (!GgufU32(&r, &ndims) || ndims > 8) {
+            free(tname);
+            goto Fail;
+        }
+        for (uint32_t d = 0; d < ndims; ++d) {
+            if (!GgufU64(&r, &dims[d])) {
+                free(tname);
+                goto Fail;
+            }
+        }
+        if (!GgufU32(&r, &ttype) || !GgufU64(&r, &toffset)) {
+            free(tname);
+            goto Fail;
+        }
+        if (t)
+            BufStr(&b, ",");
+        BufStr(&b, "\n  {\"name\": ");
+        BufJsonStr(&b, tname, tlen);
+        BufFmt(&b, ", \"type\": \"%s\", \"shape\": [", GgmlTypeName(ttype, tmp));
+        for (uint32_t d = 0; d < ndims; ++d)
+            BufFmt(&b, d ? ",%llu" : "%llu", (unsigned long long)dims[d]);
+        BufStr(&b, "]}");
+        ++counts[ttype < GGML_TYPE_COUNT ? ttype : GGML_TYPE_COUNT];
+        free(tname);
+    }
+    BufStr(&b, "\n ],\n \"quant_types\": {");
+    kept = 0;
+    for (uint32_t i = 0; i <= GGML_TYPE_COUNT; ++i) {
+        char tmp[32];
+        if (!counts[i])
+            continue;
+        if (kept++)
+            BufStr(&b, ",");
+        BufFmt(&b, "\n  \"%s\": %llu", i < GGML_TYPE_COUNT ? kGgmlTypeNames[i] : "unknown",
+               (unsigned long long)counts[i]);
+    }
+    BufStr(&b, "\n }\n}\n");
+    *out_size = b.i;
+    return b.p;
+Fail:
+    free(b.p);
+    return NULL;
+}
+
+// appends a small stored entry to the output zip, mirroring the zip64
+// record layout the main copy loop writes for its input files
+static void AddStored(int zfd, const char *zpath, const char *name, const uint8_t *data,
+                      size_t size, uint16_t mtime, uint16_t mdate, uint8_t **cdirp,
+                      size_t *cdirsizep, unsigned *cntp, ssize_t *zsizep) {
+    ssize_t zsize = *zsizep;
+    size_t namlen = strlen(name);
+    size_t extlen = (2 + 2 + 8 + 8);
+    size_t hdrlen = kZipLfileHdrMinSize + namlen + extlen;
+    while ((zsize + hdrlen) & (flag_alignment - 1))
+        ++zsize;
+    uint32_t crc = llamafile_crc32(0, data, size);
+    if (pwrite(zfd, data, size, zsize + hdrlen) != (ssize_t)size)
+        DieSys(zpath);
+
+    // write local file header
+    uint8_t *lochdr = Malloc(hdrlen);
+    uint8_t *p = lochdr;
+    p = ZIP_WRITE32(p, kZipLfileHdrMagic);
+    p = ZIP_WRITE16(p, kZipEra2001);
+    p = ZIP_WRITE16(p, kZipGflagUtf8);
+    p = ZIP_WRITE16(p, kZipCompressionNone);
+    p = ZIP_WRITE16(p, mtime);
+    p = ZIP_WRITE16(p, mdate);
+    p = ZIP_WRITE32(p, crc);
+    p = ZIP_WRITE32(p, 0xffffffffu); // compressed size
+    p = ZIP_WRITE32(p, 0xffffffffu); // uncompressed size
+    p = ZIP_WRITE16(p, namlen);
+    p = ZIP_WRITE16(p, extlen);
+    p = mempcpy(p, name, namlen);
+    p = ZIP_WRITE16(p, kZipExtraZip64);
+    p = ZIP_WRITE16(p, 8 + 8);
+    p = ZIP_WRITE64(p, size); // uncompressed size
+    p = ZIP_WRITE64(p, size); // compressed size
+    npassert(p == lochdr + hdrlen);
+    if (pwrite(zfd, lochdr, hdrlen, zsize) != (ssize_t)hdrlen)
+        DieSys(zpath);
+    free(lochdr);
+
+    // create central directory entry
+    extlen = (2 + 2 + 8 + 8 + 8);
+    size_t cdirhdrlen = kZipCfileHdrMinSize + namlen + extlen;
+    *cdirp = Realloc(*cdirp, *cdirsizep + cdirhdrlen);
+    uint8_t *cdirhdr = *cdirp + *cdirsizep;
+    *cdirsizep += cdirhdrlen;
+    p = cdirhdr;
+    p = ZIP_WRITE32(p, kZipCfileHdrMagic);
+    p = ZIP_WRITE16(p, kZipOsUnix << 8 | kZipEra2001); // version made by
+    p = ZIP_WRITE16(p, kZipEra2001); // version needed to extract
+    p = ZIP_WRITE16(p, kZipGflagUtf8);
+    p = ZIP_WRITE16(p, kZipCompressionNone);
+    p = ZIP_WRITE16(p, mtime);
+    p = ZIP_WRITE16(p, mdate);
+    p = ZIP_WRITE32(p, crc);
+    p = ZIP_WRITE32(p, 0xffffffffu); // compressed size
+    p = ZIP_WRITE32(p, 0xffffffffu); // uncompressed size
+    p = ZIP_WRITE16(p, namlen);
+    p = ZIP_WRITE16(p, extlen);
+    p = ZIP_WRITE16(p, 0); // comment length
+    p = ZIP_WRITE16(p, 0); // disk number start
+    p = ZIP_WRITE16(p, kZipIattrBinary);
+    p = ZIP_WRITE32(p, NormalizeMode(S_IFREG | 0644) << 16); // external file attributes
+    p = ZIP_WRITE32(p, 0xffffffffu); // lfile offset
+    p = mempcpy(p, name, namlen);
+    p = ZIP_WRITE16(p, kZipExtraZip64);
+    p = ZIP_WRITE16(p, 8 + 8 + 8);
+    p = ZIP_WRITE64(p, size); // uncompressed size
+    p = ZIP_WRITE64(p, size); // compressed size
+    p = ZIP_WRITE64(p, zsize); // lfile offset
+    npassert(p == cdirhdr + cdirhdrlen);
+
+    ++*cntp;
+    *zsizep = zsize + hdrlen + size;
+}
+
+// one chunk of an input file being deflated on a pool thread
+//
+// chunks compress independently, which is lossless for the output
+// format, because the serial code already issued Z_FULL_FLUSH at
+// every chunk boundary and a full flush resets the dictionary. the
+// z_stream is initialized once on the main thread and recycled with
+// deflateReset() so workers never touch the malloc arena, which is
+// tinymalloc and therefore not something threads may share.
+struct DeflateJob {
+    z_stream zs;
+    uint8_t *in;
+    uint8_t *out;
+    size_t insize;
+    size_t outsize;
+    size_t outcap;
+    uint32_t crc;
+    bool final;
+};
+
+static void *DeflateChunk(void *arg) {
+    struct DeflateJob *job = arg;
+    job->crc = llamafile_crc32(0, job->in, job->insize);
+    npassert(deflateReset(&job->zs) == Z_OK);
+    job->zs.next_in = job->in;
+    job->zs.avail_in = job->insize;
+    job->zs.next_out = job->out;
+    job->zs.avail_out = job->outcap;
+    switch (deflate(&job->zs, job->final ? Z_FINISH : Z_FULL_FLUSH)) {
+    case Z_MEM_ERROR:
+        DieOom();
+    case Z_STREAM_ERROR:
+        npassert(!"deflate() stream error");
+    default:
+        break;
+    }
+    npassert(!job->zs.avail_in);
+    job->outsize = job->outcap - job->zs.avail_out;
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
 
     if (llamafile_has(argv, "-h") || llamafile_has(argv, "-help") ||
@@ -112,7 +578,7 @@ int main(int argc, char *argv[]) {
 
     // parse flags
     int opt;
-    while ((opt = getopt(argc, argv, "0123456789vjNa:")) != -1) {
+    while ((opt = getopt(argc, argv, "0123456789vjNSa:")) != -1) {
         switch (opt) {
         case '0':
         case '1':
@@ -135,6 +601,9 @@ int main(int argc, char *argv[]) {
         case 'N':
             flag_nondeterministic = true;
             break;
+        case 'S':
+            flag_sort = true;
+            break;
         case 'a':
             flag_alignment = atoi(optarg);
             if (flag_alignment < 1)
@@ -228,6 +697,84 @@ int main(int argc, char *argv[]) {
             if (!strcmp(names[i], names[j]))
                 Die(names[i], "zip asset name specified multiple times");
 
+    // gguf inputs also get a generated <name>.meta.json sidecar
+    char **metanames = Malloc(sizeof(char *) * argc);
+    for (int i = optind; i < argc; ++i) {
+        metanames[i] = NULL;
+        if (IsGguf(names[i])) {
+            metanames[i] = Malloc(strlen(names[i]) + sizeof(".meta.json"));
+            stpcpy(stpcpy(metanames[i], names[i]), ".meta.json");
+        }
+    }
+    for (int i = optind; i < argc; ++i)
+        if (metanames[i])
+            for (int j = optind; j < argc; ++j)
+                if (!strcmp(metanames[i], names[j]))
+                    Die(names[j], "zip asset name collides with gguf metadata sidecar");
+
+    // order inputs by size, so the big aligned stored weights come
+    // first and the little metadata assets cluster together at the
+    // end beside the central directory. that way the runtime mmap
+    // path doesn't seek back and forth between giant tensor blobs
+    // and tiny text files. insertion sort keeps equal sizes in the
+    // order given, so output stays deterministic
+    if (flag_sort) {
+        int64_t *sizes = Malloc(sizeof(int64_t) * argc);
+        for (int i = optind; i < argc; ++i) {
+            struct stat st;
+            if (stat(argv[i], &st) == -1)
+                DieSys(argv[i]);
+            sizes[i] = st.st_size;
+        }
+        for (int i = optind + 1; i < argc; ++i) {
+            char *path = argv[i];
+            char *name = names[i];
+            int64_t size = sizes[i];
+            int j = i;
+            for (; j > optind && sizes[j - 1] < size; --j) {
+                argv[j] = argv[j - 1];
+                names[j] = names[j - 1];
+                sizes[j] = sizes[j - 1];
+            }
+            argv[j] = path;
+            names[j] = name;
+            sizes[j] = size;
+        }
+        free(sizes);
+    }
+
+    // set up the ring of deflate workers. the ring depth bounds how
+    // much of the tinymalloc arena gets pinned by chunk buffers
+    unsigned njobs = 0;
+    struct DeflateJob *jobs = 0;
+    llamafile_task_t *tasks = 0;
+    if (flag_level) {
+        njobs = __get_cpu_count();
+        if (njobs < 1)
+            njobs = 1;
+        if (njobs > 8)
+            njobs = 8;
+        jobs = Malloc(sizeof(*jobs) * njobs);
+        tasks = Malloc(sizeof(*tasks) * njobs);
+        for (unsigned i = 0; i < njobs; ++i) {
+            jobs[i].in = Malloc(CHUNK);
+            jobs[i].outcap = compressBound(CHUNK) + 64;
+            jobs[i].out = Malloc(jobs[i].outcap);
+            jobs[i].zs.zalloc = 0;
+            jobs[i].zs.zfree = 0;
+            jobs[i].zs.opaque = 0;
+            switch (deflateInit2(&jobs[i].zs, flag_level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
+                                 Z_DEFAULT_STRATEGY)) {
+            case Z_OK:
+                break;
+            case Z_MEM_ERROR:
+                DieOom();
+            default:
+                npassert(!"deflateInit2() called with invalid parameters");
+            }
+        }
+    }
+
     // delete central directory entries about to be replaced
     int new_count = 0;
     off_t new_index = 0;
@@ -239,12 +786,18 @@ int main(int argc, char *argv[]) {
         if (ZIP_CFILE_MAGIC(cdir + entry_offset) != kZipCfileHdrMagic)
             Die(zpath, "corrupted zip central directory entry magic");
 
-        // check if entry name matches any of the new names
+        // check if entry name matches any of the new names, or the
+        // sidecar a new gguf would regenerate, so stale metadata for
+        // replaced weights doesn't linger in the archive
         bool found = false;
         for (int i = optind; i < argc; ++i)
-            if (ZIP_CFILE_NAMESIZE(cdir + entry_offset) == strlen(names[i]) &&
-                !memcmp(ZIP_CFILE_NAME(cdir + entry_offset), names[i],
-                        ZIP_CFILE_NAMESIZE(cdir + entry_offset))) {
+            if ((ZIP_CFILE_NAMESIZE(cdir + entry_offset) == strlen(names[i]) &&
+                 !memcmp(ZIP_CFILE_NAME(cdir + entry_offset), names[i],
+                         ZIP_CFILE_NAMESIZE(cdir + entry_offset))) ||
+                (metanames[i] &&
+                 ZIP_CFILE_NAMESIZE(cdir + entry_offset) == strlen(metanames[i]) &&
+                 !memcmp(ZIP_CFILE_NAME(cdir + entry_offset), metanames[i],
+                         ZIP_CFILE_NAMESIZE(cdir + entry_offset)))) {
                 found = true;
                 break;
             }
@@ -287,77 +840,82 @@ int main(int argc, char *argv[]) {
             ts = 1700000000;
         GetDosLocalTime(ts, &mtime, &mdate);
 
+        // stored gguf weights get a content digest in their headers,
+        // so loaders can tell that two differently-packaged archives
+        // hold identical tensors and share one mapping between them.
+        // compressed entries are never mmapped, so they skip it
+        bool wantsha = !flag_level && IsGguf(names[i]);
+
         // determine size and alignment of local file header
         char *name = names[i];
         size_t namlen = strlen(name);
-        size_t extlen = (2 + 2 + 8 + 8);
+        size_t extlen = (2 + 2 + 8 + 8) + (wantsha ? 2 + 2 + 32 : 0);
         size_t hdrlen = kZipLfileHdrMinSize + namlen + extlen;
         while ((zsize + hdrlen) & (flag_alignment - 1))
             ++zsize;
 
-        // initialize zlib in raw deflate mode
-        z_stream zs;
-        int compression;
-        if (!flag_level) {
-            compression = kZipCompressionNone;
-        } else {
-            compression = kZipCompressionDeflate;
-            zs.zalloc = 0;
-            zs.zfree = 0;
-            zs.opaque = 0;
-            switch (deflateInit2(&zs, flag_level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
-                                 Z_DEFAULT_STRATEGY)) {
-            case Z_OK:
-                break;
-            case Z_MEM_ERROR:
-                DieOom();
-            default:
-                npassert(!"deflateInit2() called with invalid parameters");
-            }
-        }
+        int compression = flag_level ? kZipCompressionDeflate : kZipCompressionNone;
 
         // copy file
         ssize_t rc;
         uint32_t crc = 0;
         uint64_t compsize = 0;
-        _Alignas(4096) static uint8_t iobuf[CHUNK];
-        _Alignas(4096) static uint8_t cdbuf[CHUNK];
-        for (off_t i = 0; i < size; i += rc) {
-            // read chunk
-            if ((rc = pread(fd, iobuf, Min(size, CHUNK), i)) <= 0)
-                DieSys(path);
-            posix_fadvise(fd, i, Min(size, CHUNK), POSIX_FADV_DONTNEED);
-            crc = crc32(crc, iobuf, rc);
-            if (!flag_level) {
-                // write uncompressed chunk to output
+        struct Sha256 sha;
+        uint8_t shadigest[32];
+        llamafile_sha256_init(&sha);
+        if (!flag_level) {
+            // write uncompressed chunks straight to output
+            _Alignas(4096) static uint8_t iobuf[CHUNK];
+            for (off_t i = 0; i < size; i += rc) {
+                if ((rc = pread(fd, iobuf, Min(size - i, CHUNK), i)) <= 0)
+                    DieSys(path);
+                posix_fadvise(fd, i, rc, POSIX_FADV_DONTNEED);
+                crc = llamafile_crc32(crc, iobuf, rc);
+                if (wantsha)
+                    llamafile_sha256_update(&sha, iobuf, rc);
                 if (pwrite(zfd, iobuf, rc, zsize + hdrlen + compsize) != rc)
                     DieSys(zpath);
                 compsize += rc;
-            } else {
-                // compress chunk and write to output
-                zs.avail_in = rc;
-                zs.next_in = iobuf;
-                do {
-                    zs.next_out = cdbuf;
-                    zs.avail_out = CHUNK;
-                    int boop;
-                    switch ((boop = deflate(&zs, rc != CHUNK ? Z_FINISH : Z_FULL_FLUSH))) {
-                    case Z_MEM_ERROR:
-                        DieOom();
-                    case Z_STREAM_ERROR:
-                        npassert(!"deflate() stream error");
-                    default:
-                        break;
-                    }
-                    ssize_t have = CHUNK - zs.avail_out;
-                    if (pwrite(zfd, cdbuf, have, zsize + hdrlen + compsize) != have)
+            }
+        } else {
+            // fan chunks out across the worker ring. chunks are read
+            // and written back in file order, so the main thread only
+            // ever waits on the oldest outstanding worker while that
+            // worker's siblings crunch the chunks behind it. the
+            // entry checksum is stitched together with crc32_combine()
+            unsigned spawned = 0, joined = 0;
+            for (off_t i = 0; i < size; i += rc) {
+                if (spawned - joined == njobs) {
+                    struct DeflateJob *done = &jobs[joined % njobs];
+                    llamafile_task_join(tasks[joined % njobs], 0);
+                    if (pwrite(zfd, done->out, done->outsize,
+                               zsize + hdrlen + compsize) != done->outsize)
                         DieSys(zpath);
-                    compsize += have;
-                } while (!zs.avail_out);
+                    compsize += done->outsize;
+                    crc = crc32_combine(crc, done->crc, done->insize);
+                    ++joined;
+                }
+                struct DeflateJob *job = &jobs[spawned % njobs];
+                if ((rc = pread(fd, job->in, Min(size - i, CHUNK), i)) <= 0)
+                    DieSys(path);
+                posix_fadvise(fd, i, rc, POSIX_FADV_DONTNEED);
+                job->insize = rc;
+                job->final = i + rc >= size;
+                if (llamafile_task_create(&tasks[spawned % njobs], DeflateChunk, job))
+                    DieSys("llamafile_task_create");
+                ++spawned;
+            }
+            while (joined < spawned) {
+                struct DeflateJob *done = &jobs[joined % njobs];
+                llamafile_task_join(tasks[joined % njobs], 0);
+                if (pwrite(zfd, done->out, done->outsize,
+                           zsize + hdrlen + compsize) != done->outsize)
+                    DieSys(zpath);
+                compsize += done->outsize;
+                crc = crc32_combine(crc, done->crc, done->insize);
+                ++joined;
             }
         }
-        if (flag_level)
-            npassert(deflateEnd(&zs) == Z_OK);
 
         // write local file header
         uint8_t *lochdr = Malloc(hdrlen);
@@ -381,13 +939,20 @@ int main(int argc, char *argv[]) {
         p = ZIP_WRITE64(p, size); // uncompressed size
         p = ZIP_WRITE64(p, compsize); // compressed size
 
+        if (wantsha) {
+            llamafile_sha256_final(&sha, shadigest);
+            p = ZIP_WRITE16(p, kZipExtraLlamafileSha256);
+            p = ZIP_WRITE16(p, 32);
+            p = mempcpy(p, shadigest, 32);
+        }
+
         npassert(p == lochdr + hdrlen);
         if (pwrite(zfd, lochdr, hdrlen, zsize) != hdrlen)
             DieSys(zpath);
         free(lochdr);
 
         // create central directory entry
-        extlen = (2 + 2 + 8 + 8 + 8);
+        extlen = (2 + 2 + 8 + 8 + 8) + (wantsha ? 2 + 2 + 32 : 0);
         hdrlen = kZipCfileHdrMinSize + namlen + extlen;
         cdir = Realloc(cdir, cdirsize + hdrlen);
         uint8_t *cdirhdr = cdir + cdirsize;
@@ -418,19 +983,46 @@ int main(int argc, char *argv[]) {
         p = ZIP_WRITE64(p, size); // uncompressed size
         p = ZIP_WRITE64(p, compsize); // compressed size
         p = ZIP_WRITE64(p, zsize); // lfile offset
+
+        if (wantsha) {
+            p = ZIP_WRITE16(p, kZipExtraLlamafileSha256);
+            p = ZIP_WRITE16(p, 32);
+            p = mempcpy(p, shadigest, 32);
+        }
+
         npassert(p == cdirhdr + hdrlen);
 
         // finish up
         ++cnt;
         zsize += hdrlen + compsize;
-        if (close(fd))
-            DieSys(path);
 
         // log asset creation
         if (flag_verbose)
             tinyprint(2, path, " -> ", name, "\n", NULL);
+
+        // emit the metadata sidecar for gguf weights, so tools can
+        // inspect model params without faulting in tensor pages
+        if (metanames[i]) {
+            size_t metasize;
+            char *meta = MakeGgufMeta(fd, &metasize);
+            if (meta) {
+                AddStored(zfd, zpath, metanames[i], (uint8_t *)meta, metasize, mtime, mdate,
+                          &cdir, &cdirsize, &cnt, &zsize);
+                free(meta);
+                if (flag_verbose)
+                    tinyprint(2, path, " -> ", metanames[i], "\n", NULL);
+            }
+        }
+
+        if (close(fd))
+            DieSys(path);
     }
 
+    // retire the deflate workers
+    if (flag_level)
+        for (unsigned i = 0; i < njobs; ++i)
+            deflateEnd(&jobs[i].zs);
+
     // write out central directory
     if (pwrite(zfd, cdir, cdirsize, zsize) != cdirsize)
         DieSys(zpath);
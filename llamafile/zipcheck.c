@@ -15,6 +15,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "crc32.h"
+#include "pool.h"
 #include "zip.h"
 #include <assert.h>
 #include <cosmo.h>
@@ -39,11 +41,13 @@ DESCRIPTION\n\
 FLAGS\n\
 \n\
   -h        help\n\
+  -c        verify crc32 of each entry\n\
 \n"
 
 #define Min(a, b) ((a) < (b) ? (a) : (b))
 
 static const char *prog;
+static bool FLAG_check_crc;
 
 static wontreturn void Die(const char *thing, const char *reason) {
     tinyprint(2, thing, ": ", reason, "\n", NULL);
@@ -79,6 +83,124 @@ static void *Realloc(void *p, size_t n) {
     return p;
 }
 
+// stored entries are carved into chunks this big, each checksummed
+// by its own pool thread, since a 40gb llamafile is dominated by one
+// enormous gguf entry that would otherwise serialize on a single core
+#define kCrcChunkSize (64 * 1024 * 1024)
+
+// read buffer per chunk job, so verification never needs anywhere
+// near as much memory as the archive holds
+#define kCrcIoSize (8 * 1024 * 1024)
+
+struct CrcJob {
+    int zfd;
+    const uint8_t *cfile;
+    off_t off;    // file offset of this chunk's raw bytes
+    int64_t size; // how many raw bytes this job covers
+    uint32_t crc; // result, stitched together with crc32_combine()
+    const char *err;
+};
+
+// how many chunk jobs each entry fanned out into, so the checksums
+// can be recombined in order once every job has been joined
+struct CrcEntry {
+    const uint8_t *cfile;
+    unsigned first;
+    unsigned count;
+};
+
+// checksums one chunk of raw stored content. runs on a pool thread.
+static void *VerifyCrcChunk(void *arg) {
+    struct CrcJob *job = arg;
+    uint8_t *buf = Malloc(Min(job->size, (int64_t)kCrcIoSize));
+    uint32_t crc = 0;
+    for (int64_t i = 0; i < job->size; i += kCrcIoSize) {
+        int64_t got = Min(job->size - i, (int64_t)kCrcIoSize);
+        if (pread(job->zfd, buf, got, job->off + i) != got) {
+            free(buf);
+            job->err = "failed to pread entry content";
+            return 0;
+        }
+        crc = llamafile_crc32(crc, buf, got);
+    }
+    free(buf);
+    job->crc = crc;
+    return 0;
+}
+
+// reads and decompresses one zip entry, then records its checksum
+// for comparison against the central directory. runs on a pool
+// thread.
+static void *VerifyCrc(void *arg) {
+    struct CrcJob *job = arg;
+    const uint8_t *cfile = job->cfile;
+    int64_t csize = get_zip_cfile_compressed_size(cfile);
+    int64_t usize = get_zip_cfile_uncompressed_size(cfile);
+
+    // read local file header to find where the content starts
+    off_t off = get_zip_cfile_offset(cfile);
+    uint8_t lfile[kZipLfileHdrMinSize];
+    if (pread(job->zfd, lfile, kZipLfileHdrMinSize, off) != kZipLfileHdrMinSize) {
+        job->err = "failed to pread lfile";
+        return 0;
+    }
+    if (ZIP_LFILE_MAGIC(lfile) != kZipLfileHdrMagic) {
+        job->err = "corrupted zip local file magic";
+        return 0;
+    }
+    off += ZIP_LFILE_HDRSIZE(lfile);
+
+    // read compressed content
+    uint8_t *cdata = Malloc(csize);
+    if (pread(job->zfd, cdata, csize, off) != csize) {
+        free(cdata);
+        job->err = "failed to pread entry content";
+        return 0;
+    }
+
+    // decompress it
+    uint8_t *udata;
+    switch (ZIP_CFILE_COMPRESSIONMETHOD(cfile)) {
+    case kZipCompressionNone:
+        udata = cdata;
+        cdata = 0;
+        break;
+    case kZipCompressionDeflate: {
+        z_stream zs = {0};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+            DieOom();
+        udata = Malloc(usize);
+        zs.next_in = cdata;
+        zs.next_out = udata;
+        int rc = Z_OK;
+        while (rc == Z_OK) {
+            zs.avail_in = Min(csize - (zs.next_in - cdata), (int64_t)1 << 30);
+            zs.avail_out = Min(usize - (zs.next_out - udata), (int64_t)1 << 30);
+            rc = inflate(&zs, Z_NO_FLUSH);
+        }
+        inflateEnd(&zs);
+        if (rc != Z_STREAM_END || (int64_t)zs.total_out != usize) {
+            free(udata);
+            free(cdata);
+            job->err = "failed to inflate deflate stream";
+            return 0;
+        }
+        break;
+    }
+    default:
+        free(cdata);
+        job->err = "unsupported compression method";
+        return 0;
+    }
+
+    // record the checksum for the report pass
+    job->size = usize;
+    job->crc = llamafile_crc32(0, udata, usize);
+    free(udata);
+    free(cdata);
+    return 0;
+}
+
 static wontreturn void PrintUsage(int fd, int rc) {
     tinyprint(fd, "SYNOPSIS\n\n  ", prog, USAGE, NULL);
     exit(rc);
@@ -147,6 +269,40 @@ static void CheckZip(const char *zpath) {
         DieSys(zpath);
     if (ZIP_READ32(cdir) != kZipCfileHdrMagic)
         Die(zpath, "unable to locate central directory");
+
+    // in crc mode we fan work out across pool threads, keeping at
+    // most one checker per cpu in flight at a time. a counting pass
+    // sizes the job array up front, since tasks hold pointers into
+    // it while they run
+    struct CrcJob *jobs = 0;
+    struct CrcEntry *entries = 0;
+    llamafile_task_t *tasks = 0;
+    unsigned spawned = 0, joined = 0, checked = 0;
+    unsigned window = __get_cpu_count();
+    if (window < 1)
+        window = 1;
+    if (FLAG_check_crc) {
+        unsigned njobs = 0;
+        unsigned nentries = 0;
+        unsigned ei, eo;
+        for (ei = eo = 0;
+             ei < cnt && eo + kZipCfileHdrMinSize <= (unsigned)amt &&
+             eo + ZIP_CFILE_HDRSIZE(cdir + eo) <= (unsigned)amt;
+             ++ei, eo += ZIP_CFILE_HDRSIZE(cdir + eo)) {
+            int64_t csize = get_zip_cfile_compressed_size(cdir + eo);
+            if (!csize)
+                continue;
+            ++nentries;
+            if (ZIP_CFILE_COMPRESSIONMETHOD(cdir + eo) == kZipCompressionNone)
+                njobs += (csize + kCrcChunkSize - 1) / kCrcChunkSize;
+            else
+                ++njobs;
+        }
+        jobs = Malloc(njobs * sizeof *jobs);
+        tasks = Malloc(njobs * sizeof *tasks);
+        entries = Malloc(nentries * sizeof *entries);
+    }
+
     unsigned entry_index, entry_offset;
     for (entry_index = entry_offset = 0;
          entry_index < cnt && entry_offset + kZipCfileHdrMinSize <= amt &&
@@ -161,6 +317,59 @@ static void CheckZip(const char *zpath) {
         if (!get_zip_cfile_compressed_size(cdir + entry_offset))
             continue;
 
+        // queue up crc verification on pool threads. stored entries
+        // fan out chunkwise so the checkers divide one huge entry
+        // just as well as they divide many small ones
+        if (FLAG_check_crc) {
+            struct CrcEntry *entry = entries + checked++;
+            entry->cfile = cdir + entry_offset;
+            entry->first = spawned;
+            entry->count = 0;
+            int64_t csize = get_zip_cfile_compressed_size(cdir + entry_offset);
+            if (ZIP_CFILE_COMPRESSIONMETHOD(cdir + entry_offset) ==
+                kZipCompressionNone) {
+                off_t off = get_zip_cfile_offset(cdir + entry_offset);
+                uint8_t lfile[kZipLfileHdrMinSize];
+                if (pread(zfd, lfile, kZipLfileHdrMinSize, off) !=
+                    kZipLfileHdrMinSize)
+                    Die(zpath, "failed to pread lfile");
+                if (ZIP_LFILE_MAGIC(lfile) != kZipLfileHdrMagic)
+                    Die(zpath, "corrupted zip local file magic");
+                off += ZIP_LFILE_HDRSIZE(lfile);
+                for (int64_t i = 0; i < csize; i += kCrcChunkSize) {
+                    struct CrcJob *job = jobs + spawned;
+                    job->zfd = zfd;
+                    job->cfile = cdir + entry_offset;
+                    job->off = off + i;
+                    job->size = Min(csize - i, (int64_t)kCrcChunkSize);
+                    job->crc = 0;
+                    job->err = 0;
+                    if (spawned - joined == window)
+                        llamafile_task_join(tasks[joined++], 0);
+                    if (llamafile_task_create(tasks + spawned, VerifyCrcChunk,
+                                              job))
+                        DieSys("llamafile_task_create");
+                    ++spawned;
+                    ++entry->count;
+                }
+            } else {
+                struct CrcJob *job = jobs + spawned;
+                job->zfd = zfd;
+                job->cfile = cdir + entry_offset;
+                job->off = 0;
+                job->size = 0;
+                job->crc = 0;
+                job->err = 0;
+                if (spawned - joined == window)
+                    llamafile_task_join(tasks[joined++], 0);
+                if (llamafile_task_create(tasks + spawned, VerifyCrc, job))
+                    DieSys("llamafile_task_create");
+                ++spawned;
+                entry->count = 1;
+            }
+            continue;
+        }
+
         // read local file header
         off_t off = get_zip_cfile_offset(cdir + entry_offset);
         uint8_t lfile[kZipLfileHdrMinSize];
@@ -178,6 +387,42 @@ static void CheckZip(const char *zpath) {
                ZIP_CFILE_NAME(cdir + entry_offset), align);
     }
 
+    // wait for the crc checkers, stitch chunk checksums back into
+    // whole entry checksums, and report
+    if (FLAG_check_crc) {
+        while (joined < spawned)
+            llamafile_task_join(tasks[joined++], 0);
+        bool ok = true;
+        for (unsigned i = 0; i < checked; ++i) {
+            struct CrcEntry *entry = entries + i;
+            const char *err = 0;
+            uint32_t crc = 0;
+            for (unsigned j = 0; j < entry->count && !err; ++j) {
+                struct CrcJob *job = jobs + entry->first + j;
+                if (job->err)
+                    err = job->err;
+                else if (!j)
+                    crc = job->crc;
+                else
+                    crc = crc32_combine(crc, job->crc, job->size);
+            }
+            if (!err && crc != ZIP_CFILE_CRC32(entry->cfile))
+                err = "crc32 mismatch";
+            if (err) {
+                fprintf(stderr, "%s: %.*s: %s\n", zpath,
+                        (int)ZIP_CFILE_NAMESIZE(entry->cfile),
+                        ZIP_CFILE_NAME(entry->cfile), err);
+                ok = false;
+            }
+        }
+        free(entries);
+        free(tasks);
+        free(jobs);
+        if (!ok)
+            exit(1);
+        printf("%s: %u entries ok\n", zpath, checked);
+    }
+
     // close input
     if (close(zfd))
         DieSys(zpath);
@@ -192,8 +437,11 @@ int main(int argc, char *argv[]) {
 
     // parse flags
     int opt;
-    while ((opt = getopt(argc, argv, "h")) != -1) {
+    while ((opt = getopt(argc, argv, "hc")) != -1) {
         switch (opt) {
+        case 'c':
+            FLAG_check_crc = true;
+            break;
         case 'h':
             PrintUsage(1, 0);
         default:
@@ -0,0 +1,463 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "zip.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <third_party/zlib/zlib.h>
+#include <unistd.h>
+
+// differential updates for llamafiles
+//
+// nightly fine-tune refreshes redistribute whole multi-gigabyte
+// llamafiles even though only a fraction of the tensor bytes change
+// between iterations. this tool diffs two archives entry by entry:
+// same-named zip entries get compared in aligned 4096 byte blocks, so
+// unchanged weight pages become copy instructions referencing the old
+// file, and only changed blocks plus the archive scaffolding (headers,
+// central directory, metadata) travel as literal bytes. the patch
+// reconstructs the new archive byte for byte, verified by a whole file
+// crc32 computed when the patch was made; zipcheck -c can then vouch
+// for the individual entries. patches are raw since the literal runs
+// are mostly weight data that hardly deflates.
+
+#define USAGE \
+    " OLD NEW PATCH\n\
+       zipdiff -a OLD PATCH NEW\n\
+\n\
+DESCRIPTION\n\
+\n\
+  Tool for shipping incremental llamafile updates. The default mode\n\
+  writes a binary patch turning the llamafile OLD into NEW. The -a\n\
+  mode rebuilds NEW out of OLD plus PATCH, verifying the result's\n\
+  crc32 before reporting success.\n\
+\n\
+FLAGS\n\
+\n\
+  -h        help\n\
+  -a        apply patch rather than create one\n\
+\n"
+
+#define Min(a, b) ((a) < (b) ? (a) : (b))
+
+// aligned unit of comparison. matches the page alignment zipalign
+// gives weights, so an unchanged tensor region diffs to nothing even
+// when its byte offset moved by a multiple of the page size
+#define BLOCKSIZE 4096
+
+#define kZdiffMagic "ZIPDIFF1"
+#define kZdiffCopy 1
+#define kZdiffData 2
+#define kZdiffEnd 0
+
+static const char *prog;
+static bool FLAG_apply;
+
+static wontreturn void Die(const char *thing, const char *reason) {
+    tinyprint(2, thing, ": ", reason, "\n", NULL);
+    exit(1);
+}
+
+static wontreturn void DieSys(const char *thing) {
+    perror(thing);
+    exit(1);
+}
+
+static wontreturn void DieOom(void) {
+    Die(prog, "out of memory");
+}
+
+static void *Malloc(size_t n) {
+    void *p;
+    if (!(p = malloc(n)))
+        DieOom();
+    return p;
+}
+
+static wontreturn void PrintUsage(int fd, int rc) {
+    tinyprint(fd, "SYNOPSIS\n\n  ", prog, USAGE, NULL);
+    exit(rc);
+}
+
+// crc32 a gigabyte at a time, since zlib
+// measures buffers with unsigned int
+static uint32_t Crc(uint32_t crc, const uint8_t *p, int64_t n) {
+    for (int64_t i = 0; i < n; i += (int64_t)1 << 30)
+        crc = crc32(crc, p + i, Min(n - i, (int64_t)1 << 30));
+    return crc;
+}
+
+struct Entry {
+    const char *name; // not nul-terminated, points into map
+    int namelen;
+    int64_t off; // of content, not local file header
+    int64_t csize;
+};
+
+struct Archive {
+    const char *path;
+    uint8_t *map;
+    int64_t size;
+    struct Entry *entries;
+    int count;
+};
+
+// maps an archive and decodes its central directory into an array of
+// content spans, sorted by file offset
+static int CompareEntryOffset(const void *a, const void *b) {
+    const struct Entry *x = a, *y = b;
+    return (x->off > y->off) - (x->off < y->off);
+}
+
+static void OpenArchive(struct Archive *a, const char *path) {
+    int fd;
+    a->path = path;
+    if ((fd = open(path, O_RDONLY)) == -1)
+        DieSys(path);
+    if ((a->size = lseek(fd, 0, SEEK_END)) == -1)
+        DieSys(path);
+    a->map = mmap(0, a->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (a->map == MAP_FAILED)
+        DieSys(path);
+    close(fd);
+
+    // search backwards for the end-of-central-directory record, which
+    // says where the central directory is, preferring the zip64 one
+    // since llamafiles routinely exceed the old field widths
+    int64_t amt = Min(a->size, 65536);
+    const uint8_t *last = a->map + a->size - amt;
+    int64_t cnt = 0;
+    int64_t off = 0;
+    int64_t size = 0;
+    for (int64_t i = amt - Min(kZipCdirHdrMinSize, kZipCdir64LocatorSize);
+         i >= 0; --i) {
+        uint32_t magic = ZIP_READ32(last + i);
+        if (magic == kZipCdir64LocatorMagic &&
+            i + kZipCdir64LocatorSize <= amt) {
+            int64_t hoff = ZIP_LOCATE64_OFFSET(last + i);
+            if (hoff >= 0 && hoff + kZipCdir64HdrMinSize <= a->size &&
+                ZIP_READ32(a->map + hoff) == kZipCdir64HdrMagic &&
+                ZIP_CDIR64_RECORDS(a->map + hoff) ==
+                    ZIP_CDIR64_RECORDSONDISK(a->map + hoff) &&
+                ZIP_CDIR64_RECORDS(a->map + hoff)) {
+                cnt = ZIP_CDIR64_RECORDS(a->map + hoff);
+                off = ZIP_CDIR64_OFFSET(a->map + hoff);
+                size = ZIP_CDIR64_SIZE(a->map + hoff);
+                break;
+            }
+        }
+        if (magic == kZipCdirHdrMagic && i + kZipCdirHdrMinSize <= amt &&
+            ZIP_CDIR_RECORDS(last + i) == ZIP_CDIR_RECORDSONDISK(last + i) &&
+            ZIP_CDIR_RECORDS(last + i) &&
+            ZIP_CDIR_OFFSET(last + i) != 0xffffffffu) {
+            cnt = ZIP_CDIR_RECORDS(last + i);
+            off = ZIP_CDIR_OFFSET(last + i);
+            size = ZIP_CDIR_SIZE(last + i);
+            break;
+        }
+    }
+    if (!cnt || off < 0 || off + size > a->size)
+        Die(path, "unable to locate central directory");
+
+    a->entries = Malloc(cnt * sizeof(struct Entry));
+    a->count = 0;
+    const uint8_t *cdir = a->map + off;
+    int64_t entry_offset = 0;
+    for (int64_t i = 0; i < cnt && entry_offset + kZipCfileHdrMinSize <= size;
+         ++i, entry_offset += ZIP_CFILE_HDRSIZE(cdir + entry_offset)) {
+        const uint8_t *cfile = cdir + entry_offset;
+        if (ZIP_CFILE_MAGIC(cfile) != kZipCfileHdrMagic)
+            Die(path, "corrupted zip central directory entry magic");
+        int64_t csize = get_zip_cfile_compressed_size(cfile);
+        if (!csize)
+            continue;
+        int64_t loff = get_zip_cfile_offset(cfile);
+        if (loff < 0 || loff + kZipLfileHdrMinSize > a->size)
+            Die(path, "zip entry offset out of bounds");
+        const uint8_t *lfile = a->map + loff;
+        if (ZIP_LFILE_MAGIC(lfile) != kZipLfileHdrMagic)
+            Die(path, "corrupted zip local file magic");
+        struct Entry *e = a->entries + a->count++;
+        e->name = ZIP_CFILE_NAME(cfile);
+        e->namelen = ZIP_CFILE_NAMESIZE(cfile);
+        e->off = loff + ZIP_LFILE_HDRSIZE(lfile);
+        e->csize = csize;
+        if (e->off + e->csize > a->size)
+            Die(path, "zip entry content out of bounds");
+    }
+    qsort(a->entries, a->count, sizeof(struct Entry), CompareEntryOffset);
+}
+
+static struct Entry *FindEntry(struct Archive *a, const char *name, int len) {
+    for (int i = 0; i < a->count; ++i)
+        if (a->entries[i].namelen == len &&
+            !memcmp(a->entries[i].name, name, len))
+            return a->entries + i;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// patch writing
+
+struct Emitter {
+    FILE *f;
+    const uint8_t *newmap;
+    int kind; // pending op, or -1
+    int64_t oldoff;
+    int64_t newoff;
+    int64_t len;
+    int64_t copied;
+    int64_t literal;
+};
+
+static void Put8(FILE *f, int c) {
+    if (fputc(c, f) == EOF)
+        DieSys(prog);
+}
+
+static void Put32(FILE *f, uint32_t x) {
+    uint8_t b[4];
+    ZIP_WRITE32(b, x);
+    if (fwrite(b, 4, 1, f) != 1)
+        DieSys(prog);
+}
+
+static void Put64(FILE *f, uint64_t x) {
+    uint8_t b[8];
+    ZIP_WRITE64(b, x);
+    if (fwrite(b, 8, 1, f) != 1)
+        DieSys(prog);
+}
+
+static void EmitFlush(struct Emitter *e) {
+    if (e->kind == -1 || !e->len)
+        return;
+    Put8(e->f, e->kind);
+    if (e->kind == kZdiffCopy) {
+        Put64(e->f, e->oldoff);
+        Put64(e->f, e->len);
+        e->copied += e->len;
+    } else {
+        Put64(e->f, e->len);
+        if (fwrite(e->newmap + e->newoff, e->len, 1, e->f) != 1)
+            DieSys(prog);
+        e->literal += e->len;
+    }
+    e->kind = -1;
+    e->len = 0;
+}
+
+// queues one span of the new file, merging it into the pending op
+// when both the kind and the offsets line up, so runs of unchanged
+// blocks collapse into a single copy instruction
+static void EmitSpan(struct Emitter *e, int kind, int64_t oldoff,
+                     int64_t newoff, int64_t len) {
+    if (!len)
+        return;
+    if (e->kind == kind && e->newoff + e->len == newoff &&
+        (kind != kZdiffCopy || e->oldoff + e->len == oldoff)) {
+        e->len += len;
+        return;
+    }
+    EmitFlush(e);
+    e->kind = kind;
+    e->oldoff = oldoff;
+    e->newoff = newoff;
+    e->len = len;
+}
+
+static void DiffZips(const char *opath, const char *npath,
+                     const char *ppath) {
+    struct Archive olda;
+    struct Archive newa;
+    OpenArchive(&olda, opath);
+    OpenArchive(&newa, npath);
+
+    FILE *f;
+    if (!(f = fopen(ppath, "wb")))
+        DieSys(ppath);
+    if (fwrite(kZdiffMagic, 8, 1, f) != 1)
+        DieSys(ppath);
+    Put64(f, olda.size);
+    Put64(f, newa.size);
+    Put32(f, Crc(0, newa.map, newa.size));
+
+    struct Emitter e = { f, newa.map, -1 };
+
+    // walk the new file start to finish. content of entries that also
+    // exist in the old archive gets compared block by block against
+    // the old copy; everything else, including all the zip structure
+    // between entries, goes into the patch as literal bytes
+    int64_t pos = 0;
+    for (int i = 0; i < newa.count; ++i) {
+        struct Entry *ne = newa.entries + i;
+        struct Entry *oe = FindEntry(&olda, ne->name, ne->namelen);
+        if (!oe || ne->off < pos)
+            continue;
+        EmitSpan(&e, kZdiffData, 0, pos, ne->off - pos);
+        int64_t n = Min(ne->csize, oe->csize);
+        for (int64_t b = 0; b < n; b += BLOCKSIZE) {
+            int64_t len = Min(BLOCKSIZE, n - b);
+            if (!memcmp(newa.map + ne->off + b, olda.map + oe->off + b, len))
+                EmitSpan(&e, kZdiffCopy, oe->off + b, ne->off + b, len);
+            else
+                EmitSpan(&e, kZdiffData, 0, ne->off + b, len);
+        }
+        pos = ne->off + n;
+    }
+    EmitSpan(&e, kZdiffData, 0, pos, newa.size - pos);
+    EmitFlush(&e);
+    Put8(f, kZdiffEnd);
+    if (fclose(f))
+        DieSys(ppath);
+    printf("%s: %lld of %lld bytes unchanged; %lld literal\n", ppath,
+           (long long)e.copied, (long long)newa.size, (long long)e.literal);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// patch applying
+
+static int64_t Get64(FILE *f, const char *ppath) {
+    uint8_t b[8];
+    if (fread(b, 8, 1, f) != 1)
+        Die(ppath, "truncated patch");
+    uint64_t x = ZIP_READ64(b);
+    if (x > INT64_MAX)
+        Die(ppath, "patch field overflow");
+    return x;
+}
+
+static void WriteAll(int fd, const uint8_t *p, int64_t n, const char *path) {
+    while (n > 0) {
+        ssize_t rc = write(fd, p, Min(n, (int64_t)1 << 30));
+        if (rc <= 0)
+            DieSys(path);
+        p += rc;
+        n -= rc;
+    }
+}
+
+static void ApplyPatch(const char *opath, const char *ppath,
+                       const char *npath) {
+    struct Archive olda = {0};
+    int fd;
+    if ((fd = open(opath, O_RDONLY)) == -1)
+        DieSys(opath);
+    if ((olda.size = lseek(fd, 0, SEEK_END)) == -1)
+        DieSys(opath);
+    olda.map = mmap(0, olda.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (olda.map == MAP_FAILED)
+        DieSys(opath);
+    close(fd);
+
+    FILE *f;
+    if (!(f = fopen(ppath, "rb")))
+        DieSys(ppath);
+    char magic[8];
+    if (fread(magic, 8, 1, f) != 1 || memcmp(magic, kZdiffMagic, 8))
+        Die(ppath, "not a zipdiff patch");
+    int64_t old_size = Get64(f, ppath);
+    int64_t new_size = Get64(f, ppath);
+    uint8_t b[4];
+    if (fread(b, 4, 1, f) != 1)
+        Die(ppath, "truncated patch");
+    uint32_t new_crc = ZIP_READ32(b);
+    if (old_size != olda.size)
+        Die(opath, "size differs from the file this patch was made against");
+
+    int nfd;
+    if ((nfd = creat(npath, 0644)) == -1)
+        DieSys(npath);
+    uint8_t *buf = Malloc(1 << 20);
+    uint32_t crc = 0;
+    int64_t written = 0;
+    for (;;) {
+        int op = fgetc(f);
+        if (op == kZdiffEnd)
+            break;
+        if (op == kZdiffCopy) {
+            int64_t off = Get64(f, ppath);
+            int64_t len = Get64(f, ppath);
+            if (off < 0 || len < 0 || off + len > olda.size)
+                Die(ppath, "copy instruction out of bounds");
+            WriteAll(nfd, olda.map + off, len, npath);
+            crc = Crc(crc, olda.map + off, len);
+            written += len;
+        } else if (op == kZdiffData) {
+            int64_t len = Get64(f, ppath);
+            while (len > 0) {
+                size_t chunk = Min(len, 1 << 20);
+                if (fread(buf, chunk, 1, f) != 1)
+                    Die(ppath, "truncated patch");
+                WriteAll(nfd, buf, chunk, npath);
+                crc = crc32(crc, buf, chunk);
+                written += chunk;
+                len -= chunk;
+            }
+        } else {
+            Die(ppath, "unknown patch instruction");
+        }
+    }
+    free(buf);
+    if (fclose(f))
+        DieSys(ppath);
+    if (close(nfd))
+        DieSys(npath);
+
+    // refuse to bless a reconstruction whose bytes don't hash to what
+    // the diff saw, e.g. because the old file on this node drifted
+    if (written != new_size || crc != new_crc) {
+        unlink(npath);
+        Die(npath, "reconstructed file failed crc32 verification");
+    }
+    printf("%s: %lld bytes ok\n", npath, (long long)written);
+}
+
+int main(int argc, char *argv[]) {
+
+    // get name of program
+    prog = argv[0];
+    if (!prog)
+        prog = "zipdiff";
+
+    // parse flags
+    int opt;
+    while ((opt = getopt(argc, argv, "ha")) != -1) {
+        switch (opt) {
+        case 'a':
+            FLAG_apply = true;
+            break;
+        case 'h':
+            PrintUsage(1, 0);
+        default:
+            PrintUsage(2, 1);
+        }
+    }
+    if (argc - optind != 3)
+        PrintUsage(2, 1);
+
+    if (FLAG_apply)
+        ApplyPatch(argv[optind], argv[optind + 1], argv[optind + 2]);
+    else
+        DiffZips(argv[optind], argv[optind + 1], argv[optind + 2]);
+}
@@ -42,6 +42,8 @@ test::test(const cmd_params &inst, const llama_model *lmodel,
     t_gen = 0;
     t_processed = 0;
     monitor_result = {0.0};
+    prompt_perf = {0.0, 0.0, 0.0, 0.0};
+    gen_perf = {0.0, 0.0, 0.0, 0.0};
     pwr_sampler = sampler;
 
     if (n_prompt > 0 && n_gen == 0) {
@@ -61,6 +63,13 @@ test::test(const cmd_params &inst, const llama_model *lmodel,
     ctx = context;
 }
 
+static void accumulate(perf_sample_t &acc, const perf_sample_t &s) {
+    acc.cycles += s.cycles;
+    acc.instructions += s.instructions;
+    acc.cache_refs += s.cache_refs;
+    acc.cache_misses += s.cache_misses;
+}
+
 void test::run() {
 
     // run the test for however many repetitions specified
@@ -104,6 +113,7 @@ void test::test_prompt() {
     interval.start = utils::get_time_ns();
     interval.end = 0;
     prompt_intervals.push_back(interval);
+    perf_sampler.start();
 
     while (n_processed < n_prompt) {
         int n_tokens = std::min(n_prompt - n_processed, n_batch);
@@ -122,6 +132,7 @@ void test::test_prompt() {
     llama_synchronize(ctx);
 
     prompt_intervals.back().end = utils::get_time_ns();
+    accumulate(prompt_perf, perf_sampler.stop());
 }
 
 void test::test_gen() {
@@ -137,6 +148,7 @@ void test::test_gen() {
     interval.start = utils::get_time_ns();
     interval.end = 0;
     gen_intervals.push_back(interval);
+    perf_sampler.start();
 
     for (int i = 0; i < n_gen; i++) {
         llama_decode(ctx, llama_batch_get_one(&token, 1, n_prompt + i, 0));
@@ -150,6 +162,7 @@ void test::test_gen() {
     }
 
     gen_intervals.back().end = utils::get_time_ns();
+    accumulate(gen_perf, perf_sampler.stop());
 }
 
 std::vector<uint64_t> test::get_samples_ns(token_metric metric) const {
@@ -234,6 +247,38 @@ double test::ttft() const {
     return utils::avg(time_to_first_token);
 }
 
+double test::ipc(token_metric metric) const {
+    const perf_sample_t &s = metric == PROMPT_TPS ? prompt_perf : gen_perf;
+    if (s.cycles == 0.0) {
+        return 0.0;
+    }
+    return s.instructions / s.cycles;
+}
+
+double test::llc_miss_rate(token_metric metric) const {
+    const perf_sample_t &s = metric == PROMPT_TPS ? prompt_perf : gen_perf;
+    if (s.cache_refs == 0.0) {
+        return 0.0;
+    }
+    return s.cache_misses / s.cache_refs;
+}
+
+// estimates dram traffic from llc miss line fills. the real bandwidth
+// counters live in the uncore pmu and differ per machine, so misses
+// times the 64 byte line is the portable floor; it under-reports
+// streams the hardware prefetcher catches
+double test::mem_bw_gbps(token_metric metric) const {
+    const perf_sample_t &s = metric == PROMPT_TPS ? prompt_perf : gen_perf;
+    uint64_t total_ns = 0;
+    for (uint64_t ns : get_samples_ns(metric)) {
+        total_ns += ns;
+    }
+    if (!total_ns) {
+        return 0.0;
+    }
+    return s.cache_misses * 64.0 / total_ns; // bytes per ns is GB/s
+}
+
 std::vector<std::string> test::get_values() const {
     std::string tensor_split_str;
     int max_nonzero = 0;
@@ -274,6 +319,11 @@ std::vector<std::string> test::get_values() const {
         std::to_string(stdev_ts(PROMPT_TPS)), std::to_string(avg_ts(GEN_TPS)),
         std::to_string(get_tps_watt(GEN_TPS)),
         std::to_string(stdev_ts(GEN_TPS)),
+        std::to_string(ipc(PROMPT_TPS)),
+        std::to_string(llc_miss_rate(PROMPT_TPS)),
+        std::to_string(mem_bw_gbps(PROMPT_TPS)), std::to_string(ipc(GEN_TPS)),
+        std::to_string(llc_miss_rate(GEN_TPS)),
+        std::to_string(mem_bw_gbps(GEN_TPS)),
         // name, std::to_string(power), std::to_string(monitor_result.vram),
         // std::to_string(ttft() / 1e6)
         name, std::to_string(power), std::to_string(ttft() / 1e6),
@@ -306,6 +356,8 @@ const std::vector<std::string> test::get_fields() {
         "n_prompt", "n_gen", "test_time", "avg_time_ms", "stddev_time_ms",
         "prompt_tps", "prompt_tps_watt", "prompt_tps_stddev", "gen_tps",
         "gen_tps_watt", "gen_tps_stddev",
+        "prompt_ipc", "prompt_llc_miss_rate", "prompt_mem_bw_gbps",
+        "gen_ipc", "gen_llc_miss_rate", "gen_mem_bw_gbps",
         // "name", "power_watts", "vram_used_mb", "ttft_ms"
         "name", "power_watts", "ttft_ms", "main_gpu"};
     return fields;
@@ -356,6 +408,9 @@ test::field_type test::get_field_type(const std::string &field) {
     if (field == "prompt_tps" || field == "prompt_tps_watt" ||
         field == "prompt_tps_stddev" || field == "gen_tps" ||
         field == "gen_tps_watt" || field == "gen_tps_stddev" ||
+        field == "prompt_ipc" || field == "prompt_llc_miss_rate" ||
+        field == "prompt_mem_bw_gbps" || field == "gen_ipc" ||
+        field == "gen_llc_miss_rate" || field == "gen_mem_bw_gbps" ||
         field == "power_watts" || field == "vram_used_mb") {
         return FLOAT;
     }
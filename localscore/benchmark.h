@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "cmd.h"
+#include "perfsampler.h"
 #include "powersampler.h"
 
 struct time_interval {
@@ -66,6 +67,9 @@ struct test {
     volatile int t_gen;       // this is the total number of tokens generated
     volatile int t_processed; // this is the total number of tokens processed
     power_sample_t monitor_result;
+    perf_sample_t prompt_perf;
+    perf_sample_t gen_perf;
+    PerfSampler perf_sampler;
     std::string test_time;
     std::vector<time_interval> test_intervals;
     std::vector<time_interval> prompt_intervals;
@@ -90,6 +94,9 @@ struct test {
     double stdev_ts(token_metric metric = TOTAL_TPS) const;
     double get_tps_watt(token_metric metric = TOTAL_TPS) const;
     double ttft() const;
+    double ipc(token_metric metric) const;
+    double llc_miss_rate(token_metric metric) const;
+    double mem_bw_gbps(token_metric metric) const;
 
     std::vector<std::string> get_values() const;
     std::map<std::string, std::string> get_map() const;
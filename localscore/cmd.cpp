@@ -3,6 +3,7 @@
 #include "cmd.h"
 #include "llama.cpp/cores.h"
 #include "system.h"
+#include "utils.h"
 #include <cosmo.h>
 
 static const cmd_params cmd_params_defaults = {
@@ -29,8 +30,19 @@ static const cmd_params cmd_params_defaults = {
     /* plaintext     */ false,
     /* send_results  */ SEND_ASK,
     /* output_format */ CONSOLE,
+    /* sweep_threads */ {},
+    /* sweep_batch   */ {},
+    /* sweep_ubatch  */ {},
+    /* sweep_kv      */ {},
+    /* cooldown_temp */ 65,
+    /* cooldown_max  */ 120,
 };
 
+bool cmd_params::has_sweep() const {
+    return !sweep_threads.empty() || !sweep_batch.empty() ||
+           !sweep_ubatch.empty() || !sweep_kv.empty();
+}
+
 llama_model_params cmd_params::to_llama_mparams() const {
     llama_model_params mparams = llama_model_default_params();
 
@@ -67,6 +79,17 @@ llama_context_params cmd_params::to_llama_cparams() const {
     return cparams;
 }
 
+static bool parse_kv_type(const std::string & s, ggml_type * type) {
+    if (s == "f32") *type = GGML_TYPE_F32;
+    else if (s == "f16") *type = GGML_TYPE_F16;
+    else if (s == "bf16") *type = GGML_TYPE_BF16;
+    else if (s == "q8_0") *type = GGML_TYPE_Q8_0;
+    else if (s == "q4_0") *type = GGML_TYPE_Q4_0;
+    else if (s == "q4_1") *type = GGML_TYPE_Q4_1;
+    else return false;
+    return true;
+}
+
 cmd_params parse_cmd_params(int argc, char ** argv) {
     cmd_params params = cmd_params_defaults;
     std::string arg;
@@ -142,6 +165,45 @@ cmd_params parse_cmd_params(int argc, char ** argv) {
                 invalid_param = true;
             }
             else params.reps = std::max(1, std::stoi(argv[i]));
+        } else if (arg == "--sweep-threads") {
+            if (++i >= argc) {
+                invalid_param = true;
+            }
+            else params.sweep_threads = utils::split<int>(argv[i], ',');
+        } else if (arg == "--sweep-batch") {
+            if (++i >= argc) {
+                invalid_param = true;
+            }
+            else params.sweep_batch = utils::split<int>(argv[i], ',');
+        } else if (arg == "--sweep-ubatch") {
+            if (++i >= argc) {
+                invalid_param = true;
+            }
+            else params.sweep_ubatch = utils::split<int>(argv[i], ',');
+        } else if (arg == "--sweep-kv") {
+            if (++i >= argc) {
+                invalid_param = true;
+            }
+            else {
+                for (const auto & name : utils::split<std::string>(argv[i], ',')) {
+                    ggml_type type;
+                    if (!parse_kv_type(name, &type)) {
+                        fprintf(stderr, "error: invalid --sweep-kv value: %s\n", name.c_str());
+                        exit(1);
+                    }
+                    params.sweep_kv.push_back(type);
+                }
+            }
+        } else if (arg == "--cooldown-temp") {
+            if (++i >= argc) {
+                invalid_param = true;
+            }
+            else params.cooldown_temp = std::stoi(argv[i]);
+        } else if (arg == "--cooldown-max") {
+            if (++i >= argc) {
+                invalid_param = true;
+            }
+            else params.cooldown_max = std::max(0, std::stoi(argv[i]));
         } else if (arg == "--recompile") {
             FLAG_recompile = true;
         } else if (arg == "--localscore") {
@@ -202,4 +264,10 @@ void print_usage(int /* argc */, char ** argv) {
     printf("  -e, --extended                             run 4 reps (shortcut for --reps=4)\n");
     printf("  --long                                     run 16 reps (shortcut for --reps=16)\n");
     printf("  --reps <N>                                 set custom number of repetitions\n");
+    printf("  --sweep-threads <N,N,...>                  sweep over thread counts instead of running the baseline suite\n");
+    printf("  --sweep-batch <N,N,...>                    sweep over logical batch sizes\n");
+    printf("  --sweep-ubatch <N,N,...>                   sweep over physical batch sizes\n");
+    printf("  --sweep-kv <f16|bf16|q8_0|...>             sweep over kv cache types\n");
+    printf("  --cooldown-temp <C>                        wait for the GPU to cool below this between sweep trials (default: %d)\n", cmd_params_defaults.cooldown_temp);
+    printf("  --cooldown-max <s>                         give up waiting for cooldown after this many seconds (default: %d)\n", cmd_params_defaults.cooldown_max);
 }
\ No newline at end of file
@@ -31,7 +31,14 @@ struct cmd_params {
     bool plaintext;
     send_results_mode send_results;
     output_formats output_format;
+    std::vector<int> sweep_threads;
+    std::vector<int> sweep_batch;
+    std::vector<int> sweep_ubatch;
+    std::vector<ggml_type> sweep_kv;
+    int cooldown_temp;
+    int cooldown_max;
 
+    bool has_sweep() const;
     llama_model_params to_llama_mparams() const;
     bool equal_mparams(const cmd_params & other) const;
     llama_context_params to_llama_cparams() const;
@@ -495,6 +495,120 @@ bool run_baseline_tests(const std::vector<test_config>& tests, llama_model* mode
     return true;
 }
 
+// waits between sweep trials for the accelerator to drop back below the
+// cooldown temperature, so later configurations aren't penalized by heat
+// soak from earlier ones. samplers without a temperature channel report
+// zero, in which case we settle for a short fixed pause.
+static void sweep_cooldown(PowerSampler* sampler, const cmd_params& params) {
+    double temp = sampler->getTemperature();
+    if (temp <= 0.0) {
+        sleep(5);
+        return;
+    }
+    int waited = 0;
+    while (temp > params.cooldown_temp && waited < params.cooldown_max) {
+        printf("\rCooling down... %.0fC (target %dC)", temp, params.cooldown_temp);
+        fflush(stdout);
+        sleep(1);
+        waited++;
+        temp = sampler->getTemperature();
+    }
+    printf("\r\033[2K");
+}
+
+bool run_sweep_tests(llama_model* model, const cmd_params& params, PowerSampler* sampler) {
+    // grids left unset collapse to the single configured value
+    std::vector<int> threads = params.sweep_threads.empty()
+        ? std::vector<int>{params.n_threads} : params.sweep_threads;
+    std::vector<int> batches = params.sweep_batch.empty()
+        ? std::vector<int>{params.n_batch} : params.sweep_batch;
+    std::vector<int> ubatches = params.sweep_ubatch.empty()
+        ? std::vector<int>{params.n_ubatch} : params.sweep_ubatch;
+    std::vector<ggml_type> kv_types = params.sweep_kv.empty()
+        ? std::vector<ggml_type>{params.type_k} : params.sweep_kv;
+
+    // one representative workload keeps configurations comparable
+    const test_config workload = {1024, 256};
+
+    Json jresults;
+    jresults.setArray();
+    if (params.output_format == CSV) {
+        printf("n_threads,n_batch,n_ubatch,kv_type,"
+               "prompt_tps,prompt_tps_ci95,gen_tps,gen_tps_ci95,"
+               "power_watts,start_temp_c\n");
+    }
+
+    bool first = true;
+    for (int n_threads : threads)
+    for (int n_batch : batches)
+    for (int n_ubatch : ubatches)
+    for (ggml_type kv_type : kv_types) {
+        cmd_params inst = params;
+        inst.n_threads = n_threads;
+        inst.n_batch = n_batch;
+        inst.n_ubatch = std::min(n_ubatch, n_batch);
+        inst.type_k = kv_type;
+        inst.type_v = kv_type;
+        inst.n_prompt = workload.n_prompt;
+        inst.n_gen = workload.n_gen;
+
+        if (!first) {
+            sweep_cooldown(sampler, params);
+        }
+        first = false;
+        double start_temp = sampler->getTemperature();
+
+        llama_context_params cparams = inst.to_llama_cparams();
+        llama_context* ctx = llama_new_context_with_model(model, cparams);
+        if (!ctx) {
+            fprintf(stderr, "%s: error: failed to create context\n", __func__);
+            return false;
+        }
+
+        test t(inst, model, ctx, params.reps, sampler);
+        t.run();
+        llama_free(ctx);
+
+        std::vector<double> prompt_tps = t.get_ts(PROMPT_TPS);
+        std::vector<double> gen_tps = t.get_ts(GEN_TPS);
+        double power = t.get_power();
+
+        if (params.output_format == CSV) {
+            printf("%d,%d,%d,%s,%.2f,%.2f,%.2f,%.2f,%.2f,%.0f\n",
+                   n_threads, n_batch, inst.n_ubatch, ggml_type_name(kv_type),
+                   utils::avg(prompt_tps), utils::ci95(prompt_tps),
+                   utils::avg(gen_tps), utils::ci95(gen_tps),
+                   power, start_temp);
+        } else if (params.output_format == JSON) {
+            Json row;
+            row.setObject();
+            row["n_threads"] = n_threads;
+            row["n_batch"] = n_batch;
+            row["n_ubatch"] = inst.n_ubatch;
+            row["kv_type"] = ggml_type_name(kv_type);
+            row["prompt_tps"] = utils::avg(prompt_tps);
+            row["prompt_tps_ci95"] = utils::ci95(prompt_tps);
+            row["gen_tps"] = utils::avg(gen_tps);
+            row["gen_tps_ci95"] = utils::ci95(gen_tps);
+            row["power_watts"] = power;
+            row["start_temp_c"] = start_temp;
+            jresults.getArray().push_back(std::move(row));
+        } else {
+            printf("threads=%-3d batch=%-5d ubatch=%-4d kv=%-5s | "
+                   "pp %8.2f ±%6.2f tok/s | tg %7.2f ±%5.2f tok/s | %6.2f W\n",
+                   n_threads, n_batch, inst.n_ubatch, ggml_type_name(kv_type),
+                   utils::avg(prompt_tps), utils::ci95(prompt_tps),
+                   utils::avg(gen_tps), utils::ci95(gen_tps), power);
+        }
+        fflush(stdout);
+    }
+
+    if (params.output_format == JSON) {
+        printf("%s\n", jresults.toString().c_str());
+    }
+    return true;
+}
+
 void process_and_submit_results(const std::string& req_payload, const cmd_params& params) {
     auto [status, data] = Json::parse(req_payload);
     if (status != Json::success || !data.isObject()) {
@@ -544,7 +658,17 @@ int localscore_cli(int argc, char** argv) {
     PowerSampler* sampler = getPowerSampler(100, params.main_gpu);
     
     perform_warmup(lmodel, params);
-    
+
+    if (params.has_sweep()) {
+        // swept configurations aren't comparable to the baseline suite,
+        // so nothing gets scored or submitted in this mode
+        bool ok = run_sweep_tests(lmodel, params, sampler);
+        llama_free_model(lmodel);
+        llama_backend_free();
+        delete req_printer;
+        return ok ? 0 : 1;
+    }
+
     p->print_header(params, sys_data.accelerator, sys_data.runtime, sys_data.sys, model_info);
     
     if (!run_baseline_tests(baseline_tests, lmodel, params, p.get(), sampler, req_printer)) {
@@ -38,6 +38,11 @@ static struct Nvml {
         int (__attribute__((__ms_abi__)) *windows_abi)(void *device, unsigned int *power);
     } nvmlDeviceGetPowerUsage;
 
+    union {
+        int (*default_abi)(void *device, int sensorType, unsigned int *temp);
+        int (__attribute__((__ms_abi__)) *windows_abi)(void *device, int sensorType, unsigned int *temp);
+    } nvmlDeviceGetTemperature;
+
     union {
         int (*default_abi)(void);
         int (__attribute__((__ms_abi__)) *windows_abi)(void);
@@ -133,6 +138,7 @@ bool nvml_init() {
     import_nvml_function(lib, "nvmlDeviceGetHandleByIndex_v2", &nvml.nvmlDeviceGetHandleByIndex_v2, &ok);
     import_nvml_function(lib, "nvmlDeviceGetTotalEnergyConsumption", &nvml.nvmlDeviceGetTotalEnergyConsumption, &ok);
     import_nvml_function(lib, "nvmlDeviceGetPowerUsage", &nvml.nvmlDeviceGetPowerUsage, &ok);
+    import_nvml_function(lib, "nvmlDeviceGetTemperature", &nvml.nvmlDeviceGetTemperature, &ok);
     import_nvml_function(lib, "nvmlShutdown", &nvml.nvmlShutdown, &ok);
 
     if (!ok) {
@@ -163,6 +169,12 @@ bool nvml_get_energy_consumption(nvmlDevice_t device, unsigned long long *energy
     return true;
 }
 
+bool nvml_get_temperature(nvmlDevice_t device, unsigned int *temp) {
+    // sensor 0 is NVML_TEMPERATURE_GPU, the die sensor
+    nvml_function_call(nvml.nvmlDeviceGetTemperature, device, 0, temp);
+    return true;
+}
+
 bool nvml_shutdown() {
     nvml_function_call(nvml.nvmlShutdown);
     return true;
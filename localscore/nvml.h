@@ -12,4 +12,6 @@ bool nvml_get_power_usage(nvmlDevice_t device, unsigned int *power);
 
 bool nvml_get_memory_usage(nvmlDevice_t device, float *memory);
 
+bool nvml_get_temperature(nvmlDevice_t device, unsigned int *temp);
+
 bool nvml_shutdown();
\ No newline at end of file
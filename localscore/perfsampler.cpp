@@ -0,0 +1,162 @@
+#include "perfsampler.h"
+#include <cosmo.h>
+#include <string.h>
+#include <unistd.h>
+
+// hardware performance counters for the benchmark harness. tok/s and
+// watts say that a configuration is slow; instructions per cycle and
+// cache behavior say why, e.g. a memory-bound machine shows low ipc
+// with a high llc miss rate while a thermally limited one shows the
+// same ipc at a lower clock. perf_event_open has no libc wrapper even
+// on linux, and cosmo doesn't carry the kernel's uapi header, so the
+// attribute layout and syscall numbers are spelled out below. both
+// are kernel abi and frozen forever.
+
+// PERF_TYPE_HARDWARE generalized event ids
+#define HW_CPU_CYCLES 0
+#define HW_INSTRUCTIONS 1
+#define HW_CACHE_REFERENCES 2
+#define HW_CACHE_MISSES 3
+
+// PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING
+#define READ_FORMAT_TIMES 3
+
+// first 64 bytes of struct perf_event_attr (PERF_ATTR_SIZE_VER0),
+// which every kernel since 2.6.32 accepts
+struct perf_event_attr_v0 {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+
+// inherit | exclude_kernel | exclude_hv. inherit makes the counts
+// cover the compute threads llama_decode() spawns, not just the
+// thread that opened the counter
+#define ATTR_FLAGS ((1ULL << 1) | (1ULL << 5) | (1ULL << 6))
+
+static long sys_perf_event_open(struct perf_event_attr_v0 *attr, int pid,
+                                int cpu, int group_fd, unsigned long flags) {
+#ifdef __x86_64__
+    long rc;
+    register long r10 asm("r10") = group_fd;
+    register long r8 asm("r8") = flags;
+    asm volatile("syscall"
+                 : "=a"(rc)
+                 : "0"(298), "D"(attr), "S"((long)pid), "d"((long)cpu),
+                   "r"(r10), "r"(r8)
+                 : "rcx", "r11", "memory");
+    return rc;
+#elif defined(__aarch64__)
+    register long x8 asm("x8") = 241;
+    register long x0 asm("x0") = (long)attr;
+    register long x1 asm("x1") = pid;
+    register long x2 asm("x2") = cpu;
+    register long x3 asm("x3") = group_fd;
+    register long x4 asm("x4") = flags;
+    asm volatile("svc #0"
+                 : "+r"(x0)
+                 : "r"(x8), "r"(x1), "r"(x2), "r"(x3), "r"(x4)
+                 : "memory");
+    return x0;
+#else
+    (void)attr;
+    (void)pid;
+    (void)cpu;
+    (void)group_fd;
+    (void)flags;
+    return -1;
+#endif
+}
+
+// reads a counter and undoes multiplex scaling. when more events are
+// scheduled than the pmu has slots the kernel timeshares them, and
+// value * enabled / running extrapolates to the full window
+static double read_scaled(int fd) {
+    uint64_t v[3]; // value, time_enabled, time_running
+    if (read(fd, v, sizeof(v)) != sizeof(v)) {
+        return 0.0;
+    }
+    if (v[2] && v[2] != v[1]) {
+        return (double)v[0] * v[1] / v[2];
+    }
+    return (double)v[0];
+}
+
+PerfSampler::PerfSampler() {
+    static const uint64_t configs[NUM_EVENTS] = {
+        HW_CPU_CYCLES,
+        HW_INSTRUCTIONS,
+        HW_CACHE_REFERENCES,
+        HW_CACHE_MISSES,
+    };
+
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        fds_[i] = -1;
+        started_[i] = 0.0;
+    }
+
+    if (!IsLinux()) {
+        return;
+    }
+
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        struct perf_event_attr_v0 attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = 0; // PERF_TYPE_HARDWARE
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.read_format = READ_FORMAT_TIMES;
+        attr.flags = ATTR_FLAGS;
+        long fd = sys_perf_event_open(&attr, 0, -1, -1, 0);
+        if (fd < 0) {
+            // perf_event_paranoid forbids it, or a vm with no pmu.
+            // either way the samples all read as zero
+            for (int j = 0; j < i; j++) {
+                close(fds_[j]);
+                fds_[j] = -1;
+            }
+            return;
+        }
+        fds_[i] = fd;
+    }
+}
+
+PerfSampler::~PerfSampler() {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        if (fds_[i] != -1) {
+            close(fds_[i]);
+        }
+    }
+}
+
+bool PerfSampler::supported() const {
+    return fds_[0] != -1;
+}
+
+void PerfSampler::start() {
+    if (!supported()) {
+        return;
+    }
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        started_[i] = read_scaled(fds_[i]);
+    }
+}
+
+perf_sample_t PerfSampler::stop() {
+    perf_sample_t sample = {0.0, 0.0, 0.0, 0.0};
+    if (!supported()) {
+        return sample;
+    }
+    sample.cycles = read_scaled(fds_[0]) - started_[0];
+    sample.instructions = read_scaled(fds_[1]) - started_[1];
+    sample.cache_refs = read_scaled(fds_[2]) - started_[2];
+    sample.cache_misses = read_scaled(fds_[3]) - started_[3];
+    return sample;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// scaled hardware event counts over one measurement window. these are
+// doubles because counters that get multiplexed off the pmu come back
+// scaled by time_enabled/time_running.
+typedef struct {
+    double cycles;
+    double instructions;
+    double cache_refs;
+    double cache_misses;
+} perf_sample_t;
+
+// samples hardware performance counters around a benchmark phase, the
+// way PowerSampler does for energy. only Linux exposes a stable api
+// for this (perf_event_open); elsewhere every sample reads as zero.
+struct PerfSampler {
+    static const int NUM_EVENTS = 4;
+
+    int fds_[NUM_EVENTS];
+    double started_[NUM_EVENTS];
+
+    PerfSampler();
+    ~PerfSampler();
+
+    bool supported() const;
+    void start();
+    perf_sample_t stop();
+};
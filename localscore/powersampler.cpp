@@ -137,6 +137,14 @@ double NvidiaPowerSampler::getEnergyConsumed() {
     return (double)mj;
 }
 
+double NvidiaPowerSampler::getTemperature() {
+    unsigned int celsius;
+    if (!nvml_get_temperature(device_, &celsius)) {
+        return 0.0;
+    }
+    return (double)celsius;
+}
+
 AMDPowerSampler::AMDPowerSampler(long sample_length_ms)
     : PowerSampler(sample_length_ms) {
         rsmi_init();
@@ -167,6 +175,14 @@ double AMDPowerSampler::getEnergyConsumed() {
     return uj;
 }
 
+double AMDPowerSampler::getTemperature() {
+    double celsius;
+    if (!rsmi_get_temperature(&celsius)) {
+        return 0.0;
+    }
+    return celsius;
+}
+
 ApplePowerSampler::ApplePowerSampler(long sample_length_ms)
     : PowerSampler(sample_length_ms) {
         bool ok = init_apple_mon();
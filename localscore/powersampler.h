@@ -41,6 +41,10 @@ struct PowerSampler {
     // this returns the energy consumed in millijoules
     virtual double getEnergyConsumed() = 0;
 
+    // this returns the device temperature in celsius, or 0.0
+    // when the sampler has no temperature channel
+    virtual double getTemperature() { return 0.0; }
+
 private:
     static void* sampling_thread_func(void* arg);
 };
@@ -53,6 +57,8 @@ struct NvidiaPowerSampler : public PowerSampler {
     NvidiaPowerSampler(long sample_length_ms, unsigned int index);
     ~NvidiaPowerSampler() override;
 
+    double getTemperature() override;
+
 protected:
     power_sample_t sample() override;
     double getEnergyConsumed() override;
@@ -62,6 +68,8 @@ struct AMDPowerSampler : public PowerSampler {
     AMDPowerSampler(long sample_length_ms);
     ~AMDPowerSampler() override;
 
+    double getTemperature() override;
+
 protected:
     power_sample_t sample() override;
     double getEnergyConsumed() override;
@@ -42,6 +42,7 @@ static struct Rsmi {
     int (*rsmi_dev_power_ave_get)(uint32_t dv_ind, uint32_t sensor_ind, uint64_t *power);
     int (*rsmi_dev_energy_count_get)(uint32_t dv_ind, uint64_t *power, float *counter_resolution, uint64_t *timestamp);
     int (*rsmi_dev_memory_usage_get)(uint32_t dv_ind, int mem_type, uint64_t *used);
+    int (*rsmi_dev_temp_metric_get)(uint32_t dv_ind, uint32_t sensor_type, int metric, int64_t *temperature);
     int (*rsmi_shut_down)(void);
 } rsmi;
 
@@ -57,6 +58,7 @@ bool rsmi_init() {
     IMPORT_RSMI_FUNCTION(rsmi_dev_power_ave_get, int (*)(uint32_t, uint32_t, uint64_t*));
     IMPORT_RSMI_FUNCTION(rsmi_dev_energy_count_get, int (*)(uint32_t, uint64_t*, float*, uint64_t*));
     IMPORT_RSMI_FUNCTION(rsmi_dev_memory_usage_get, int (*)(uint32_t, int, uint64_t*));
+    IMPORT_RSMI_FUNCTION(rsmi_dev_temp_metric_get, int (*)(uint32_t, uint32_t, int, int64_t*));
     IMPORT_RSMI_FUNCTION(rsmi_shut_down, int (*)(void));
 
     if (!ok) {
@@ -111,6 +113,14 @@ bool rsmi_get_memory_usage(float *memory) {
     return true;
 }
 
+bool rsmi_get_temperature(double *temp) {
+    int64_t millidegrees;
+    // this is device 0, sensor 0 (RSMI_TEMP_TYPE_EDGE) and metric 0 (RSMI_TEMP_CURRENT)
+    RSMI_FUNCTION_CALL(rsmi_dev_temp_metric_get, "failed to get temperature", 0, 0, 0, &millidegrees);
+    *temp = (double)millidegrees / 1000.0;
+    return true;
+}
+
 bool rsmi_shutdown() {
     RSMI_FUNCTION_CALL(rsmi_shut_down, "failed to shutdown ROCm SMI");
     return true;
@@ -10,4 +10,6 @@ bool rsmi_get_energy_count(double *energy);
 
 bool rsmi_get_memory_usage(float *memory);
 
+bool rsmi_get_temperature(double *temp);
+
 bool rsmi_shutdown();
\ No newline at end of file
@@ -78,6 +78,15 @@ namespace utils {
         return stdev;
     }
 
+    // half-width of a 95% confidence interval around the mean
+    template<typename T>
+    inline double ci95(const std::vector<T>& v) {
+        if (v.size() <= 1) {
+            return 0.0;
+        }
+        return 1.96 * (double)stdev(v) / std::sqrt((double)v.size());
+    }
+
     inline std::string exec(const char* cmd) {
         std::array<char, 128> buffer;
         std::string result;
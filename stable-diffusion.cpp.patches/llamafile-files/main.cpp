@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -87,6 +88,8 @@ struct SDParams {
     std::string input_path;
     std::string control_image_path;
 
+    std::string batch_path;
+
     std::string prompt;
     std::string negative_prompt;
     float min_cfg     = 1.0f;
@@ -185,6 +188,9 @@ void print_usage(int argc, const char* argv[]) {
     printf("  --control-image [IMAGE]            path to image condition, control net\n");
     printf("  -o, --output OUTPUT                path to write result image to (default: ./output.png)\n");
     printf("  -p, --prompt [PROMPT]              the prompt to render\n");
+    printf("  --batch [FILE]                     render a queue of txt2img jobs and keep the model loaded between them.\n");
+    printf("                                     each line is PROMPT, or OUTPUT<TAB>PROMPT, or OUTPUT<TAB>PROMPT<TAB>NEGATIVE;\n");
+    printf("                                     blank lines and lines starting with # are skipped; use - to read from stdin\n");
     printf("  -n, --negative-prompt PROMPT       the negative prompt (default: \"\")\n");
     printf("  --cfg-scale SCALE                  unconditional guidance scale: (default: 7.0)\n");
     printf("  --strength STRENGTH                strength for noising/unnoising (default: 0.75)\n");
@@ -373,6 +379,12 @@ void parse_args(int argc, const char** argv, SDParams& params) {
                 break;
             }
             params.prompt = argv[i];
+        } else if (arg == "--batch") {
+            if (++i >= argc) {
+                invalid_arg = true;
+                break;
+            }
+            params.batch_path = argv[i];
         } else if (arg == "--upscale-repeats") {
             if (++i >= argc) {
                 invalid_arg = true;
@@ -531,7 +543,13 @@ void parse_args(int argc, const char** argv, SDParams& params) {
         params.n_threads = cpu_get_num_math();
     }
 
-    if (params.mode != CONVERT && params.mode != IMG2VID && params.prompt.length() == 0) {
+    if (params.batch_path.length() > 0 && params.mode != TXT2IMG) {
+        fprintf(stderr, "error: --batch only works in txt2img mode\n");
+        exit(1);
+    }
+
+    if (params.mode != CONVERT && params.mode != IMG2VID && params.prompt.length() == 0 &&
+        params.batch_path.length() == 0) {
         fprintf(stderr, "error: the following arguments are required: prompt\n");
         print_usage(argc, argv);
         exit(1);
@@ -664,6 +682,186 @@ void sd_log_cb(enum sd_log_level_t level, const char* log, void* data) {
     fflush(out_stream);
 }
 
+// [jart] batch serving mode
+//
+// art pipelines render thousands of images, and invoking the binary
+// once per image pays for a model load every time. --batch keeps one
+// process resident, feeds it a queue of txt2img jobs, and hands the
+// png encode and disk write of finished images to a writer thread so
+// they overlap the denoising of the next job instead of stalling it.
+
+struct BatchWrite {
+    std::string path;
+    std::string meta;
+    sd_image_t image;
+};
+
+struct BatchWriter {
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond  = PTHREAD_COND_INITIALIZER;
+    std::vector<BatchWrite> queue;
+    bool done    = false;
+    int failures = 0;
+};
+
+static void* batch_writer_thread(void* arg) {
+    BatchWriter* writer = (BatchWriter*)arg;
+    for (;;) {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->queue.empty() && !writer->done) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if (writer->queue.empty()) {
+            pthread_mutex_unlock(&writer->lock);
+            return NULL;
+        }
+        BatchWrite job = std::move(writer->queue.front());
+        writer->queue.erase(writer->queue.begin());
+        pthread_cond_broadcast(&writer->cond);  // unblock a full producer
+        pthread_mutex_unlock(&writer->lock);
+        if (stbi_write_png(job.path.c_str(), job.image.width, job.image.height,
+                           job.image.channel, job.image.data, 0, job.meta.c_str())) {
+            printf("save result image to '%s'\n", job.path.c_str());
+        } else {
+            fprintf(stderr, "write image to '%s' failed\n", job.path.c_str());
+            pthread_mutex_lock(&writer->lock);
+            writer->failures++;
+            pthread_mutex_unlock(&writer->lock);
+        }
+        free(job.image.data);
+    }
+}
+
+// finished images allowed to wait on the writer thread, which bounds
+// memory when the disk falls behind the sampler
+#define BATCH_WRITE_BACKLOG 8
+
+static void batch_submit_write(BatchWriter* writer, std::string path, std::string meta, sd_image_t image) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queue.size() >= BATCH_WRITE_BACKLOG) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+    writer->queue.push_back(BatchWrite{std::move(path), std::move(meta), image});
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+static int run_batch(sd_ctx_t* sd_ctx, SDParams& params, sd_image_t* control_image) {
+    FILE* file;
+    if (params.batch_path == "-") {
+        file = stdin;
+    } else if (!(file = fopen(params.batch_path.c_str(), "r"))) {
+        fprintf(stderr, "error: failed to open batch file '%s'\n", params.batch_path.c_str());
+        return 1;
+    }
+
+    BatchWriter writer;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, batch_writer_thread, &writer)) {
+        fprintf(stderr, "error: failed to create writer thread\n");
+        if (file != stdin) {
+            fclose(file);
+        }
+        return 1;
+    }
+
+    size_t last      = params.output_path.find_last_of(".");
+    std::string stem = last != std::string::npos ? params.output_path.substr(0, last) : params.output_path;
+    std::string default_negative = params.negative_prompt;
+
+    int jobs     = 0;
+    int failures = 0;
+    char* line   = NULL;
+    size_t cap   = 0;
+    ssize_t got;
+    while ((got = getline(&line, &cap, file)) != -1) {
+        while (got > 0 && (line[got - 1] == '\n' || line[got - 1] == '\r')) {
+            line[--got] = 0;
+        }
+        if (!got || line[0] == '#') {
+            continue;
+        }
+
+        // each job is PROMPT, or OUTPUT<TAB>PROMPT, or
+        // OUTPUT<TAB>PROMPT<TAB>NEGATIVE. jobs without a negative
+        // column inherit the one from the command line
+        std::string text = line;
+        std::string output;
+        size_t tab1 = text.find('\t');
+        if (tab1 == std::string::npos) {
+            params.prompt          = text;
+            params.negative_prompt = default_negative;
+        } else {
+            size_t tab2 = text.find('\t', tab1 + 1);
+            output      = text.substr(0, tab1);
+            if (tab2 == std::string::npos) {
+                params.prompt          = text.substr(tab1 + 1);
+                params.negative_prompt = default_negative;
+            } else {
+                params.prompt          = text.substr(tab1 + 1, tab2 - tab1 - 1);
+                params.negative_prompt = text.substr(tab2 + 1);
+            }
+        }
+        if (params.prompt.length() == 0) {
+            continue;
+        }
+        if (output.length() == 0) {
+            output = stem + "_" + std::to_string(jobs + 1) + ".png";
+        }
+
+        sd_image_t* results = txt2img(sd_ctx,
+                                      params.prompt.c_str(),
+                                      params.negative_prompt.c_str(),
+                                      params.clip_skip,
+                                      params.cfg_scale,
+                                      params.width,
+                                      params.height,
+                                      params.sample_method,
+                                      params.sample_steps,
+                                      params.seed,
+                                      params.batch_count,
+                                      control_image,
+                                      params.control_strength,
+                                      params.style_ratio,
+                                      params.normalize_input,
+                                      params.input_id_images_path.c_str());
+        if (results == NULL) {
+            fprintf(stderr, "generate failed for '%s'\n", params.prompt.c_str());
+            params.seed += params.batch_count;
+            failures++;
+            continue;
+        }
+
+        last             = output.find_last_of(".");
+        std::string name = last != std::string::npos ? output.substr(0, last) : output;
+        for (int i = 0; i < params.batch_count; i++) {
+            if (results[i].data == NULL) {
+                continue;
+            }
+            std::string path = i > 0 ? name + "_" + std::to_string(i + 1) + ".png" : name + ".png";
+            batch_submit_write(&writer, std::move(path), get_image_params(params, params.seed + i), results[i]);
+            results[i].data = NULL;
+        }
+        free(results);
+        params.seed += params.batch_count;
+        jobs++;
+    }
+    free(line);
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    pthread_mutex_lock(&writer.lock);
+    writer.done = true;
+    pthread_cond_broadcast(&writer.cond);
+    pthread_mutex_unlock(&writer.lock);
+    pthread_join(thread, NULL);
+    failures += writer.failures;
+
+    printf("rendered %d jobs (%d failed)\n", jobs, failures);
+    return failures ? 1 : 0;
+}
+
 int main(int argc, const char* argv[]) {
     ShowCrashReports();
 
@@ -800,6 +998,13 @@ int main(int argc, const char* argv[]) {
         }
     }
 
+    if (params.batch_path.length() > 0) {
+        int rc = run_batch(sd_ctx, params, control_image);
+        free_sd_ctx(sd_ctx);
+        free(control_image_buffer);
+        return rc;
+    }
+
     sd_image_t* results;
     if (params.mode == TXT2IMG) {
         results = txt2img(sd_ctx,
@@ -69,7 +69,9 @@ for file in "$LLAMAFILE_FILES_DIR"/*.cpp; do
     fi
 done
 cp "$LLAMAFILE_FILES_DIR"/*.hpp . 2>/dev/null || true
-# Don't copy .cu files since whisper-mel-cuda.cu is now patched
+# Don't copy .cu files since whisper-mel-cuda.cu is now patched,
+# except the gpu module wrapper which has no upstream counterpart
+cp "$LLAMAFILE_FILES_DIR/whisper-mel-module.cu" .
 cp "$LLAMAFILE_FILES_DIR/main.1" .
 cp "$LLAMAFILE_FILES_DIR/main.1.asc" .
 cp "$LLAMAFILE_FILES_DIR/jfk.wav" .
@@ -28,14 +28,24 @@ $(WHISPER_CPP_OBJS): private				\
 			-frtti				\
 			-Wno-deprecated-declarations
 
+# mel spectrogram cuda kernels ride in the zip so llamafile/cuda.c can
+# compile them into the dynamically loaded gpu module at runtime
+WHISPER_CPP_GPU_ASSETS =					\
+	o/$(MODE)/whisper.cpp/whisper-mel.hpp.zip.o		\
+	o/$(MODE)/whisper.cpp/whisper-mel-cuda.hpp.zip.o	\
+	o/$(MODE)/whisper.cpp/whisper-mel-cuda.cu.zip.o		\
+	o/$(MODE)/whisper.cpp/whisper-mel-module.cu.zip.o	\
+
 o/$(MODE)/whisper.cpp/main:				\
 		o/$(MODE)/whisper.cpp/main.o		\
 		o/$(MODE)/whisper.cpp/main.1.asc.zip.o	\
+		$(WHISPER_CPP_GPU_ASSETS)		\
 		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
 		o/$(MODE)/third_party/stb/stb.a		\
 
 o/$(MODE)/whisper.cpp/stream:				\
+		$(WHISPER_CPP_GPU_ASSETS)		\
 		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
 		o/$(MODE)/third_party/stb/stb.a		\
@@ -0,0 +1,39 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;tab-width:8;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+
+#include "whisper-mel-cuda.hpp"
+#include "llamafile/llamafile.h"
+#include <cosmo.h>
+
+__static_yoink("whisper.cpp/whisper-mel.hpp");
+__static_yoink("whisper.cpp/whisper-mel-cuda.hpp");
+__static_yoink("whisper.cpp/whisper-mel-cuda.cu");
+__static_yoink("whisper.cpp/whisper-mel-module.cu");
+
+// registers whisper's mel spectrogram kernels before main() runs, so
+// llamafile/cuda.c compiles them into the same cached gpu module as
+// ggml-cuda and everything shares one cuda context in-process
+static struct RegisterMelKernels {
+    RegisterMelKernels() {
+        llamafile_cuda_register_header("/zip/whisper.cpp/whisper-mel.hpp", "whisper-mel.hpp");
+        llamafile_cuda_register_header("/zip/whisper.cpp/whisper-mel-cuda.hpp",
+                                       "whisper-mel-cuda.hpp");
+        llamafile_cuda_register_header("/zip/whisper.cpp/whisper-mel-cuda.cu",
+                                       "whisper-mel-cuda.cu");
+        llamafile_cuda_register_source("/zip/whisper.cpp/whisper-mel-module.cu",
+                                       "whisper-mel-module.cu");
+    }
+} g_register_mel_kernels;
+
+// called by whisper.cpp when computing the mel spectrogram. returns
+// nullptr when no gpu module could be loaded, in which case the
+// caller falls back to the cpu implementation.
+whisper_mel_calc *whisper_mel_calc_create_cuda(ggml_backend_t backend,
+                                               const whisper_filters &filters) {
+    static whisper_mel_calc *(*entry)(ggml_backend_t, const whisper_filters *);
+    if (!entry)
+        entry = (typeof(entry))llamafile_cuda_dlsym("whisper_mel_calc_create_cuda_entry");
+    if (!entry)
+        return nullptr;
+    return entry(backend, &filters);
+}
@@ -0,0 +1,16 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;tab-width:8;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// This file is never compiled by the host toolchain. It rides in the
+// zip assets and gets spliced into the gpu module that llamafile/cuda.c
+// compiles at runtime, right after ggml-cuda.cu, so whisper's mel
+// spectrogram kernels share that module's compile cache, dso, and cuda
+// context. The extern "C" wrapper gives the host process a stable
+// unmangled name to import with llamafile_cuda_dlsym().
+
+#include "whisper-mel-cuda.cu"
+
+extern "C" whisper_mel_calc *whisper_mel_calc_create_cuda_entry(ggml_backend_t backend,
+                                                                const whisper_filters *filters) {
+    return whisper_mel_calc_create_cuda(backend, *filters);
+}
@@ -1,5 +1,11 @@
 #pragma once
+#ifdef LLAMAFILE_GPU_MODULE
+// inside the runtime-compiled gpu module the sources live in one flat
+// directory, so the llama.cpp path prefix doesn't exist there
+#include "ggml-backend.h"
+#else
 #include "llama.cpp/ggml-backend.h"
+#endif
 #include <vector>
 
 struct whisper_mel {